@@ -7,6 +7,8 @@ pub fn build(b: *std.Build) void {
     const posix = b.option(bool, "posix", "Enable C/POSIX realm support") orelse false;
     const tcc_enabled = b.option(bool, "tcc", "Build TCC C compiler (requires -Dposix=true)") orelse false;
     const test_packages = b.option(bool, "test-packages", "Build test packages (xxd) for integration tests") orelse false;
+    const lockstat = b.option(bool, "lockstat", "Collect kernel lock contention statistics (/proc/lockstat)") orelse false;
+    const trace = b.option(bool, "trace", "Kernel event tracing (/dev/trace)") orelse false;
     const user_strip = b.option(bool, "strip", "Strip debug info from userspace binaries") orelse
         (optimize != .Debug); // strip by default on release builds
 
@@ -18,6 +20,8 @@ pub fn build(b: *std.Build) void {
     const build_options = b.addOptions();
     build_options.addOption(bool, "cluster", cluster);
     build_options.addOption(bool, "posix", posix);
+    build_options.addOption(bool, "lockstat", lockstat);
+    build_options.addOption(bool, "trace", trace);
 
     // ── Host tool: mkinitrd ───────────────────────────────────────────
     const mkinitrd = b.addExecutable(.{
@@ -876,6 +880,35 @@ const touch_bin = b.addExecutable(.{
     });
     uptime_bin.image_base = user_image_base;
 
+    const trace_bin = b.addExecutable(.{
+        .name = "trace",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("cmd/trace/main.zig"),
+            .target = x86_64_freestanding,
+            .optimize = user_optimize,
+            .strip = if (user_strip) true else null,
+            .imports = &.{
+                .{ .name = "fornax", .module = fornax_module },
+            },
+        }),
+    });
+    trace_bin.image_base = user_image_base;
+
+    // Benchmark suite: only installed by `zig build bench`
+    const bench_bin = b.addExecutable(.{
+        .name = "bench",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("cmd/bench/main.zig"),
+            .target = x86_64_freestanding,
+            .optimize = user_optimize,
+            .strip = if (user_strip) true else null,
+            .imports = &.{
+                .{ .name = "fornax", .module = fornax_module },
+            },
+        }),
+    });
+    bench_bin.image_base = user_image_base;
+
     // ── POSIX realm support (gated behind -Dposix=true) ─────────────
     // POSIX realm isolation is handled by lib/posix/crt0.S (rfork(RFNAMEG))
     // which runs before musl's __libc_start_main. No separate loader needed.
@@ -1434,6 +1467,7 @@ const touch_bin = b.addExecutable(.{
         crontab_bin,
         date_bin,
         uptime_bin,
+        trace_bin,
     };
     for (disk_programs) |prog| {
         const install = b.addInstallArtifact(prog, .{
@@ -1617,13 +1651,14 @@ const touch_bin = b.addExecutable(.{
         .{ "unzip", "cmd/unzip/main.zig" },
         .{ "tar", "cmd/tar/main.zig" },
         .{ "fay", "cmd/fay/main.zig" },
+        .{ "trace", "cmd/trace/main.zig" },
         .{ "fxfs", "srv/fxfs/main.zig" },
         .{ "partfs", "srv/partfs/main.zig" },
     };
 
     // Build riscv64 initrd programs (init, partfs, fxfs)
     var rv_initrd_bins: [3]*std.Build.Step.Compile = undefined;
-    var rv_disk_bin_buf: [50]*std.Build.Step.Compile = undefined;
+    var rv_disk_bin_buf: [64]*std.Build.Step.Compile = undefined;
     var rv_disk_bin_count: usize = 0;
 
     inline for (rv_user_programs) |prog_info| {
@@ -1689,6 +1724,15 @@ const touch_bin = b.addExecutable(.{
     riscv64_step.dependOn(&riscv64_install.step);
     riscv64_step.dependOn(&rv_initrd.step);
 
+    // x86_64 image plus bin/bench in the rootfs; run it under QEMU with
+    // `scripts/test-integration.py --bench`
+    const bench_install = b.addInstallArtifact(bench_bin, .{
+        .dest_dir = .{ .override = .{ .custom = "rootfs/bin" } },
+    });
+    const bench_step = b.step("bench", "Build x86_64 image with the in-guest benchmark suite");
+    bench_step.dependOn(x86_step);
+    bench_step.dependOn(&bench_install.step);
+
     // ── Unit tests (host-targeted, no OS dependencies) ──────────────
     const test_step = b.step("test", "Run unit tests");
 
@@ -1703,6 +1747,11 @@ const touch_bin = b.addExecutable(.{
     const mod_sha256 = b.createModule(.{ .root_source_file = b.path("lib/sha256.zig"), .target = host, .optimize = test_opt });
     const mod_json = b.createModule(.{ .root_source_file = b.path("lib/json.zig"), .target = host, .optimize = test_opt });
     const mod_time = b.createModule(.{ .root_source_file = b.path("lib/time.zig"), .target = host, .optimize = test_opt });
+    const mod_deflate = b.createModule(.{ .root_source_file = b.path("lib/deflate.zig"), .target = host, .optimize = test_opt });
+    const mod_ring = b.createModule(.{ .root_source_file = b.path("lib/ring.zig"), .target = host, .optimize = test_opt });
+    const mod_ipc = b.createModule(.{ .root_source_file = b.path("lib/ipc.zig"), .target = host, .optimize = test_opt });
+    const mod_scan = b.createModule(.{ .root_source_file = b.path("lib/scan.zig"), .target = host, .optimize = test_opt });
+    const mod_bench = b.createModule(.{ .root_source_file = b.path("lib/bench.zig"), .target = host, .optimize = test_opt });
     const mod_ethernet = b.createModule(.{ .root_source_file = b.path("lib/net/ethernet.zig"), .target = host, .optimize = test_opt });
     const mod_ipv4 = b.createModule(.{ .root_source_file = b.path("lib/net/ipv4.zig"), .target = host, .optimize = test_opt });
     // arp/tcp/dns/icmp use relative @import("ethernet.zig") and @import("ipv4.zig")
@@ -1761,6 +1810,11 @@ const touch_bin = b.addExecutable(.{
                 .{ .name = "dns", .module = mod_dns },
                 .{ .name = "icmp", .module = mod_icmp },
                 .{ .name = "time", .module = mod_time },
+                .{ .name = "deflate", .module = mod_deflate },
+                .{ .name = "ring", .module = mod_ring },
+                .{ .name = "scan", .module = mod_scan },
+                .{ .name = "ipc", .module = mod_ipc },
+                .{ .name = "bench", .module = mod_bench },
             },
         }),
     });
@@ -9,9 +9,11 @@ const fx = @import("fornax");
 const out = fx.io.Writer.stdout;
 const err = fx.io.Writer.stderr;
 
-const LINE_BUF_SIZE = 4096;
+const BLOCK_SIZE = 64 * 1024;
 const MAX_FIELDS = 64;
 
+var block: [BLOCK_SIZE]u8 = undefined;
+
 var delim: u8 = ' ';
 var use_whitespace: bool = true;
 
@@ -78,15 +80,15 @@ fn splitFields(line: []const u8, fields: [][]const u8) usize {
         }
     } else {
         // Single-character delimiter
-        var start = i;
-        while (i <= line.len) : (i += 1) {
-            if (i == line.len or line[i] == delim) {
-                if (count < fields.len) {
-                    fields[count] = line[start..i];
-                    count += 1;
-                }
-                start = i + 1;
-            }
+        while (count < fields.len) {
+            const k = fx.scan.indexOfByte(line[i..], delim) orelse {
+                fields[count] = line[i..];
+                count += 1;
+                break;
+            };
+            fields[count] = line[i..][0..k];
+            count += 1;
+            i += k + 1;
         }
     }
 
@@ -94,31 +96,8 @@ fn splitFields(line: []const u8, fields: [][]const u8) usize {
 }
 
 fn awkFd(fd: i32) void {
-    var line_buf: [LINE_BUF_SIZE]u8 = undefined;
-    var line_len: usize = 0;
-    var buf: [4096]u8 = undefined;
-
-    while (true) {
-        const n = fx.read(fd, &buf);
-        if (n <= 0) break;
-        const len: usize = @intCast(n);
-
-        for (buf[0..len]) |c| {
-            if (c == '\n') {
-                processLine(line_buf[0..line_len]);
-                line_len = 0;
-            } else {
-                if (line_len < LINE_BUF_SIZE) {
-                    line_buf[line_len] = c;
-                    line_len += 1;
-                }
-            }
-        }
-    }
-
-    if (line_len > 0) {
-        processLine(line_buf[0..line_len]);
-    }
+    var lines = fx.io.LineReader.init(fd, &block);
+    while (lines.next()) |line| processLine(line);
 }
 
 fn processLine(line: []const u8) void {
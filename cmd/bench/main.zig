@@ -0,0 +1,579 @@
+/// bench — in-guest microbenchmarks for kernel and server hot paths.
+///
+/// Each case times single operations with the cycle counter (TSC on
+/// x86_64, time CSR on riscv64) and prints one machine-readable line:
+///   BENCH <case> [<param>=<v>] n=<samples> min=<c> p50=<c> p90=<c> p99=<c> max=<c>
+/// with all values in cycles; ipc lines add handoffs=<n>, the direct
+/// handoff wakeups /dev/sysstat counted over the timed round trips. A
+/// leading `BENCH tsc hz=<cycles/s>` line calibrates them against the
+/// timer. scripts/test-integration.py --bench runs `bench all` under
+/// QEMU and collects the lines as JSON.
+///
+/// Usage:
+///   bench all            — every case
+///   bench <case>...      — null ipc ipc-pipelined pipe futex rfork spawn
+///                          fs-seq fs-rand resolve tcp
+///   bench -n N ...       — N samples per case (default 1000)
+///   bench -p PORT ...    — tcp sink port on the host (default 8001)
+///
+/// No loopback interface exists, so `tcp` streams to a discard server on
+/// the QEMU host (10.0.2.2) through netd; it measures netd and the kernel
+/// TCP path plus QEMU's user-mode networking.
+const fx = @import("fornax");
+const out = fx.io.Writer.stdout;
+const cycles = fx.bench.cycles;
+
+const DEFAULT_SAMPLES = 1000;
+const MAX_SAMPLES = 16384;
+const WARMUP = 32;
+
+const IPC_SIZES = [_]u32{ 8, 512, 4000 };
+/// Tagged requests kept in flight; the kernel allows 32 per process.
+const IPC_DEPTHS = [_]u32{ 1, 8, 32 };
+const PIPE_CHUNK = 16 * 1024;
+const TCP_CHUNK = 16 * 1024;
+const DEFAULT_TCP_PORT = 8001;
+
+const FS_PATH = "/tmp/bench.dat";
+const FS_BLOCK = 4096;
+const FS_BLOCKS = 256; // 1 MiB working set
+const RESOLVE_ROOT = "/tmp/bench.d";
+const MAX_DEPTH = 8;
+
+var samples: [MAX_SAMPLES]u64 linksection(".bss") = undefined;
+var io_buf: [PIPE_CHUNK]u8 align(4096) linksection(".bss") = undefined;
+var elf_buf: [1024 * 1024]u8 align(4096) linksection(".bss") = undefined;
+
+var iters: usize = DEFAULT_SAMPLES;
+var tcp_port: u64 = DEFAULT_TCP_PORT;
+
+const Case = struct {
+    name: []const u8,
+    run: *const fn () void,
+};
+
+const cases = [_]Case{
+    .{ .name = "null", .run = benchNull },
+    .{ .name = "ipc", .run = benchIpc },
+    .{ .name = "ipc-pipelined", .run = benchIpcPipelined },
+    .{ .name = "pipe", .run = benchPipe },
+    .{ .name = "futex", .run = benchFutex },
+    .{ .name = "rfork", .run = benchRfork },
+    .{ .name = "spawn", .run = benchSpawn },
+    .{ .name = "fs-seq", .run = benchFsSeq },
+    .{ .name = "fs-rand", .run = benchFsRand },
+    .{ .name = "resolve", .run = benchResolve },
+    .{ .name = "tcp", .run = benchTcp },
+};
+
+export fn _start() noreturn {
+    const args = fx.getArgs();
+
+    // Child of the spawn case: exit straight away
+    if (args.len > 1 and fx.str.eql(span(args[1]), "--nop")) fx.exit(0);
+
+    var selected: [cases.len]bool = [_]bool{false} ** cases.len;
+    var any = false;
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = span(args[i]);
+        if (fx.str.eql(arg, "-n") and i + 1 < args.len) {
+            i += 1;
+            const n = fx.str.parseUint(span(args[i])) orelse usage();
+            iters = @intCast(@max(1, @min(n, MAX_SAMPLES)));
+        } else if (fx.str.eql(arg, "-p") and i + 1 < args.len) {
+            i += 1;
+            tcp_port = fx.str.parseUint(span(args[i])) orelse usage();
+        } else if (fx.str.eql(arg, "all")) {
+            @memset(&selected, true);
+            any = true;
+        } else {
+            const idx = caseIndex(arg) orelse usage();
+            selected[idx] = true;
+            any = true;
+        }
+    }
+    if (!any) usage();
+
+    calibrate();
+    for (cases, 0..) |c, idx| {
+        if (selected[idx]) c.run();
+    }
+    fx.exit(0);
+}
+
+fn usage() noreturn {
+    _ = fx.write(2, "usage: bench [-n N] [-p PORT] all | null ipc ipc-pipelined pipe futex rfork spawn fs-seq fs-rand resolve tcp\n");
+    fx.exit(1);
+}
+
+fn caseIndex(name: []const u8) ?usize {
+    for (cases, 0..) |c, idx| {
+        if (fx.str.eql(c.name, name)) return idx;
+    }
+    return null;
+}
+
+// ── Cases ───────────────────────────────────────────────────────────
+
+/// Cheapest syscall round trip: getpid.
+fn benchNull() void {
+    var n: usize = 0;
+    while (n < WARMUP) : (n += 1) _ = fx.getpid();
+    n = 0;
+    while (n < iters) : (n += 1) {
+        const t = cycles();
+        _ = fx.getpid();
+        samples[n] = cycles() -% t;
+    }
+    report("null", null, 0, iters);
+}
+
+var ipc_server_fd: i32 = -1;
+var ipc_client_fd: i32 = -1;
+
+fn ipcServer(_: *anyopaque) callconv(.c) void {
+    var msg: fx.IpcMessage = undefined;
+    var reply: fx.IpcMessage = undefined;
+    while (true) {
+        if (fx.ipc_recv(ipc_server_fd, &msg) < 0) continue;
+        reply = fx.IpcMessage.init(fx.R_OK);
+        reply.data_len = 0;
+        _ = fx.ipc_reply(ipc_server_fd, &reply);
+    }
+}
+
+/// Channel pair served by a thread, shared by both ipc cases.
+fn ipcSetup(name: []const u8) bool {
+    if (ipc_client_fd >= 0) return true;
+    const pair = fx.ipc_pair();
+    if (pair.err < 0) {
+        skip(name, "ipc_pair failed");
+        return false;
+    }
+    ipc_server_fd = pair.server_fd;
+    _ = fx.thread.spawnThread(ipcServer, null) catch {
+        skip(name, "cannot spawn server thread");
+        return false;
+    };
+    ipc_client_fd = pair.client_fd;
+    return true;
+}
+
+/// Client write → server recv/reply → client wakes, by payload size.
+/// A round trip on the fast path takes two direct handoffs.
+fn benchIpc() void {
+    if (!ipcSetup("ipc")) return;
+    @memset(&io_buf, 'x');
+    for (IPC_SIZES) |size| {
+        const payload = io_buf[0..size];
+        var n: usize = 0;
+        while (n < WARMUP) : (n += 1) _ = fx.write(ipc_client_fd, payload);
+        const handoffs_before = readHandoffs();
+        n = 0;
+        while (n < iters) : (n += 1) {
+            const t = cycles();
+            _ = fx.write(ipc_client_fd, payload);
+            samples[n] = cycles() -% t;
+        }
+        const handoffs = readHandoffs() -% handoffs_before;
+        reportWith("ipc", "size", size, iters, &.{.{ " handoffs=", handoffs }});
+    }
+}
+
+/// Cycles between replies with `depth` tagged requests in flight
+/// (ipc_submit/ipc_collect), against the same server as benchIpc.
+fn benchIpcPipelined() void {
+    if (!ipcSetup("ipc-pipelined")) return;
+    var req = fx.IpcMessage.initWithData(fx.T_WRITE, "x");
+    var reply: fx.IpcMessage = undefined;
+    var cookie: u64 = 0;
+    for (IPC_DEPTHS) |depth| {
+        const total = iters + WARMUP;
+        var submitted: usize = 0;
+        while (submitted < @min(depth, total)) : (submitted += 1) {
+            if (fx.ipc_submit(ipc_client_fd, &req, submitted) < 0) break;
+        }
+        var done: usize = 0;
+        var t = cycles();
+        while (done < submitted) {
+            if (fx.ipc_collect(&reply, &cookie) < 0) break;
+            const now = cycles();
+            if (done >= WARMUP) samples[done - WARMUP] = now -% t;
+            t = now;
+            done += 1;
+            if (submitted < total and fx.ipc_submit(ipc_client_fd, &req, submitted) >= 0) submitted += 1;
+        }
+        if (done < total) {
+            // Drain what is still in flight so it can't land in a later run
+            while (done < submitted) : (done += 1) {
+                if (fx.ipc_collect(&reply, &cookie) < 0) break;
+            }
+            return skip("ipc-pipelined", "ipc_submit or ipc_collect failed");
+        }
+        report("ipc-pipelined", "depth", depth, iters);
+    }
+}
+
+var pipe_write_fd: i32 = -1;
+var pipe_total: usize = 0;
+
+fn pipeWriter(_: *anyopaque) callconv(.c) void {
+    var chunk: [PIPE_CHUNK]u8 = undefined;
+    @memset(&chunk, 'p');
+    var left = pipe_total;
+    while (left > 0) {
+        const n = fx.write(pipe_write_fd, chunk[0..@min(left, chunk.len)]);
+        if (n == 0 or n > chunk.len) break;
+        left -= n;
+    }
+    _ = fx.close(pipe_write_fd);
+}
+
+/// Cycles to receive each PIPE_CHUNK bytes from a writer thread.
+fn benchPipe() void {
+    const p = fx.pipe();
+    if (p.err < 0) return skip("pipe", "pipe failed");
+    pipe_write_fd = p.write_fd;
+    pipe_total = (iters + WARMUP) * PIPE_CHUNK;
+    const writer = fx.thread.spawnThread(pipeWriter, null) catch {
+        _ = fx.close(p.read_fd);
+        _ = fx.close(p.write_fd);
+        return skip("pipe", "cannot spawn writer thread");
+    };
+
+    var n: usize = 0;
+    while (n < iters + WARMUP) : (n += 1) {
+        const t = cycles();
+        var got: usize = 0;
+        while (got < PIPE_CHUNK) {
+            const r = fx.read(p.read_fd, io_buf[got..]);
+            if (r <= 0) break;
+            got += @intCast(r);
+        }
+        if (got < PIPE_CHUNK) break;
+        if (n >= WARMUP) samples[n - WARMUP] = cycles() -% t;
+    }
+    fx.thread.join(&writer);
+    _ = fx.close(p.read_fd);
+    if (n <= WARMUP) return skip("pipe", "short read");
+    report("pipe", "bytes", PIPE_CHUNK, n - WARMUP);
+}
+
+var futex_turn: u32 = 0;
+var futex_rounds: usize = 0;
+
+fn futexPartner(_: *anyopaque) callconv(.c) void {
+    var n: usize = 0;
+    while (n < futex_rounds) : (n += 1) {
+        while (@atomicLoad(u32, &futex_turn, .acquire) != 1) {
+            _ = fx.syscall.futex(@intFromPtr(&futex_turn), 0, 0, 0); // FUTEX_WAIT while 0
+        }
+        @atomicStore(u32, &futex_turn, 0, .release);
+        _ = fx.syscall.futex(@intFromPtr(&futex_turn), 1, 1, 0); // FUTEX_WAKE
+    }
+}
+
+/// Futex ping-pong round trip between two threads. The scheduler places
+/// the partner on the least loaded core, so on SMP this crosses cores.
+fn benchFutex() void {
+    futex_turn = 0;
+    futex_rounds = iters + WARMUP;
+    const partner = fx.thread.spawnThread(futexPartner, null) catch return skip("futex", "cannot spawn thread");
+
+    var n: usize = 0;
+    while (n < futex_rounds) : (n += 1) {
+        const t = cycles();
+        @atomicStore(u32, &futex_turn, 1, .release);
+        _ = fx.syscall.futex(@intFromPtr(&futex_turn), 1, 1, 0);
+        while (@atomicLoad(u32, &futex_turn, .acquire) != 0) {
+            _ = fx.syscall.futex(@intFromPtr(&futex_turn), 0, 1, 0); // FUTEX_WAIT while 1
+        }
+        if (n >= WARMUP) samples[n - WARMUP] = cycles() -% t;
+    }
+    fx.thread.join(&partner);
+    report("futex", null, 0, iters);
+}
+
+/// rfork(RFPROC|RFFDG) of this process plus wait for the child's exit.
+fn benchRfork() void {
+    var n: usize = 0;
+    while (n < iters) : (n += 1) {
+        const t = cycles();
+        const pid = fx.rfork(fx.RFPROC | fx.RFFDG);
+        if (pid == 0) fx.exit(0);
+        if (pid > 0xFFFF_FFFF) return skip("rfork", "rfork failed");
+        _ = fx.wait(@intCast(pid));
+        samples[n] = cycles() -% t;
+    }
+    report("rfork", null, 0, iters);
+}
+
+/// spawn of /bin/bench (which exits at once) plus wait. The ELF is read
+/// once up front, so this is loader and process setup cost, not fxfs.
+fn benchSpawn() void {
+    const fd = fx.open("/bin/bench");
+    if (fd < 0) return skip("spawn", "cannot open /bin/bench");
+    var total: usize = 0;
+    while (total < elf_buf.len) {
+        const r = fx.read(fd, elf_buf[total..]);
+        if (r <= 0) break;
+        total += @intCast(r);
+    }
+    _ = fx.close(fd);
+    if (total == 0) return skip("spawn", "cannot read /bin/bench");
+    // spawn only shares a buffer whose last page has a clean tail
+    const page_end = @min((total + 4095) & ~@as(usize, 4095), elf_buf.len);
+    @memset(elf_buf[total..page_end], 0);
+
+    var argv_buf: [64]u8 = undefined;
+    const argv = fx.buildArgvBlock(&argv_buf, &.{ "bench", "--nop" });
+    // Spawning is slow next to the other cases: cap the sample count
+    const count = @min(iters, 200);
+    var n: usize = 0;
+    while (n < count) : (n += 1) {
+        const t = cycles();
+        const pid = fx.spawn(elf_buf[0..total], &.{}, argv);
+        if (pid < 0) return skip("spawn", "spawn failed");
+        _ = fx.wait(@intCast(pid));
+        samples[n] = cycles() -% t;
+    }
+    report("spawn", null, 0, count);
+}
+
+/// 4 KiB pwrite then pread over a 1 MiB file, in block order.
+fn benchFsSeq() void {
+    benchFs("fs-seq-write", "fs-seq-read", false);
+}
+
+/// 4 KiB pwrite then pread at pseudo-random block offsets.
+fn benchFsRand() void {
+    benchFs("fs-rand-write", "fs-rand-read", true);
+}
+
+fn benchFs(write_name: []const u8, read_name: []const u8, random: bool) void {
+    const fd = fx.create(FS_PATH, 0);
+    if (fd < 0) return skip(write_name, "cannot create " ++ FS_PATH);
+    @memset(&io_buf, 'f');
+    const block = io_buf[0..FS_BLOCK];
+
+    // Lay the file out first so random writes don't extend it
+    var b: u64 = 0;
+    while (b < FS_BLOCKS) : (b += 1) _ = fx.pwrite(fd, block, b * FS_BLOCK);
+
+    var rng: u64 = 0x9E37_79B9_7F4A_7C15;
+    var n: usize = 0;
+    while (n < iters) : (n += 1) {
+        const off = blockOffset(n, random, &rng);
+        const t = cycles();
+        _ = fx.pwrite(fd, block, off);
+        samples[n] = cycles() -% t;
+    }
+    report(write_name, "bytes", FS_BLOCK, iters);
+
+    n = 0;
+    while (n < iters) : (n += 1) {
+        const off = blockOffset(n, random, &rng);
+        const t = cycles();
+        _ = fx.pread(fd, block, off);
+        samples[n] = cycles() -% t;
+    }
+    report(read_name, "bytes", FS_BLOCK, iters);
+
+    _ = fx.close(fd);
+    _ = fx.remove(FS_PATH);
+}
+
+fn blockOffset(n: usize, random: bool, rng: *u64) u64 {
+    if (!random) return (n % FS_BLOCKS) * FS_BLOCK;
+    // xorshift64
+    rng.* ^= rng.* << 13;
+    rng.* ^= rng.* >> 7;
+    rng.* ^= rng.* << 17;
+    return (rng.* % FS_BLOCKS) * FS_BLOCK;
+}
+
+/// open+close of a file `depth` directories below /tmp/bench.d, showing
+/// how path resolution scales with component count.
+fn benchResolve() void {
+    var dir = fx.path.PathBuf.from(RESOLVE_ROOT);
+    var depth: usize = 1;
+    var built: usize = 0;
+    while (depth <= MAX_DEPTH) : (depth += 1) {
+        const dfd = fx.mkdir(dir.slice());
+        if (dfd >= 0) _ = fx.close(dfd);
+        var file = fx.path.PathBuf.from(dir.slice());
+        _ = file.appendRaw("/f");
+        const ffd = fx.create(file.slice(), 0);
+        if (ffd < 0) {
+            _ = fx.remove(dir.slice());
+            break;
+        }
+        _ = fx.close(ffd);
+        built = depth;
+
+        var n: usize = 0;
+        while (n < WARMUP) : (n += 1) _ = fx.close(fx.open(file.slice()));
+        n = 0;
+        while (n < iters) : (n += 1) {
+            const t = cycles();
+            const fd = fx.open(file.slice());
+            _ = fx.close(fd);
+            samples[n] = cycles() -% t;
+        }
+        // Path components: /tmp/bench.d/f is depth 3
+        report("resolve", "depth", depth + 2, iters);
+        _ = dir.appendRaw("/d");
+    }
+    if (built == 0) skip("resolve", "cannot create " ++ RESOLVE_ROOT);
+
+    // Remove deepest first: PathBuf ends at the next (uncreated) level
+    while (built > 0) : (built -= 1) {
+        dir.len -= 2;
+        var file = fx.path.PathBuf.from(dir.slice());
+        _ = file.appendRaw("/f");
+        _ = fx.remove(file.slice());
+        _ = fx.remove(dir.slice());
+    }
+}
+
+/// Cycles per TCP_CHUNK write to a discard server on the host.
+fn benchTcp() void {
+    const clone_fd = fx.open("/net/tcp/clone");
+    if (clone_fd < 0) return skip("tcp", "no /net/tcp");
+    var conn_buf: [16]u8 = undefined;
+    const conn_n = fx.read(clone_fd, &conn_buf);
+    _ = fx.close(clone_fd);
+    if (conn_n <= 0) return skip("tcp", "clone failed");
+    var conn_len: usize = @intCast(conn_n);
+    if (conn_buf[conn_len - 1] == '\n') conn_len -= 1;
+    const conn = conn_buf[0..conn_len];
+
+    var ctl_path = fx.path.PathBuf.from("/net/tcp/");
+    _ = ctl_path.appendRaw(conn);
+    _ = ctl_path.appendRaw("/ctl");
+    const ctl_fd = fx.open(ctl_path.slice());
+    if (ctl_fd < 0) return skip("tcp", "cannot open ctl");
+    var cmd_buf: [48]u8 = undefined;
+    var cmd_len: usize = 0;
+    var port_buf: [20]u8 = undefined;
+    append(&cmd_buf, &cmd_len, "connect 10.0.2.2!");
+    append(&cmd_buf, &cmd_len, fx.fmt.formatDec(&port_buf, tcp_port));
+    append(&cmd_buf, &cmd_len, "\n");
+    const connected = fx.write(ctl_fd, cmd_buf[0..cmd_len]) != 0;
+    _ = fx.close(ctl_fd);
+    if (!connected) return skip("tcp", "connect failed (is the host sink running?)");
+
+    var data_path = fx.path.PathBuf.from("/net/tcp/");
+    _ = data_path.appendRaw(conn);
+    _ = data_path.appendRaw("/data");
+    const data_fd = fx.open(data_path.slice());
+    if (data_fd < 0) return skip("tcp", "cannot open data");
+
+    @memset(&io_buf, 't');
+    var n: usize = 0;
+    while (n < iters + WARMUP) : (n += 1) {
+        const t = cycles();
+        const w = fx.write(data_fd, io_buf[0..TCP_CHUNK]);
+        if (w == 0 or w > TCP_CHUNK) break;
+        if (n >= WARMUP) samples[n - WARMUP] = cycles() -% t;
+    }
+    _ = fx.close(data_fd);
+    if (n <= WARMUP) return skip("tcp", "write failed");
+    report("tcp", "bytes", TCP_CHUNK, n - WARMUP);
+}
+
+// ── Reporting ───────────────────────────────────────────────────────
+
+/// Cycles per second, measured across a 200 ms sleep.
+fn calibrate() void {
+    const t = cycles();
+    fx.sleep(200);
+    const hz = (cycles() -% t) * 5;
+    var buf: [20]u8 = undefined;
+    out.puts("BENCH tsc hz=");
+    out.puts(fx.fmt.formatDec(&buf, hz));
+    out.puts("\n");
+}
+
+fn report(name: []const u8, param: ?[]const u8, value: u64, count: usize) void {
+    reportWith(name, param, value, count, &.{});
+}
+
+/// report() with extra ` key=value` fields after the statistics.
+fn reportWith(name: []const u8, param: ?[]const u8, value: u64, count: usize, extra: []const Field) void {
+    const sum = fx.bench.summarize(samples[0..count]);
+    var line: [160]u8 = undefined;
+    var len: usize = 0;
+    var buf: [20]u8 = undefined;
+    append(&line, &len, "BENCH ");
+    append(&line, &len, name);
+    if (param) |p| {
+        append(&line, &len, " ");
+        append(&line, &len, p);
+        append(&line, &len, "=");
+        append(&line, &len, fx.fmt.formatDec(&buf, value));
+    }
+    const stats = [_]Field{
+        .{ " n=", sum.n },
+        .{ " min=", sum.min },
+        .{ " p50=", sum.p50 },
+        .{ " p90=", sum.p90 },
+        .{ " p99=", sum.p99 },
+        .{ " max=", sum.max },
+    };
+    for ([_][]const Field{ &stats, extra }) |fields| {
+        for (fields) |f| {
+            append(&line, &len, f[0]);
+            append(&line, &len, fx.fmt.formatDec(&buf, f[1]));
+        }
+    }
+    append(&line, &len, "\n");
+    out.puts(line[0..len]);
+}
+
+const Field = struct { []const u8, u64 };
+
+fn skip(name: []const u8, why: []const u8) void {
+    out.puts("BENCH ");
+    out.puts(name);
+    out.puts(" skipped: ");
+    out.puts(why);
+    out.puts("\n");
+}
+
+fn append(line: []u8, len: *usize, s: []const u8) void {
+    const n = @min(s.len, line.len - len.*);
+    @memcpy(line[len.*..][0..n], s[0..n]);
+    len.* += n;
+}
+
+/// Sum of the ipc_handoffs column (6th) of /dev/sysstat over all cores.
+fn readHandoffs() u64 {
+    const fd = fx.open("/dev/sysstat");
+    if (fd < 0) return 0;
+    var buf: [4096]u8 = undefined;
+    const n = fx.read(fd, &buf);
+    _ = fx.close(fd);
+    if (n <= 0) return 0;
+
+    var total: u64 = 0;
+    var field: usize = 0;
+    var val: u64 = 0;
+    for (buf[0..@intCast(n)]) |c| {
+        if (c >= '0' and c <= '9') {
+            val = val * 10 + (c - '0');
+        } else {
+            if (field == 5) total += val;
+            val = 0;
+            field = if (c == '\n') 0 else field + 1;
+        }
+    }
+    return total;
+}
+
+fn span(ptr: [*:0]const u8) []const u8 {
+    var len: usize = 0;
+    while (ptr[len] != 0) len += 1;
+    return ptr[0..len];
+}
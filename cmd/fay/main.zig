@@ -22,7 +22,6 @@ const err = fx.io.Writer.stderr;
 
 var sliding_window: [32768]u8 linksection(".bss") = undefined;
 var io_buf: [8192]u8 linksection(".bss") = undefined;
-var inflate_out_buf: [512]u8 = undefined;
 var download_buf: [8192]u8 linksection(".bss") = undefined;
 var header_buf: [4096]u8 linksection(".bss") = undefined;
 var file_buf: [8192]u8 linksection(".bss") = undefined;
@@ -117,7 +116,7 @@ const GzipReader = struct {
         fd_reader_ctx.fd = fd;
         return .{
             .bit_reader = deflate.BitReader.init(&fdReadFn, @ptrCast(&fd_reader_ctx), &io_buf),
-            .inflater = deflate.Inflater.init(&sliding_window, &inflate_out_buf),
+            .inflater = deflate.Inflater.init(&sliding_window),
         };
     }
 
@@ -144,6 +143,29 @@ const GzipReader = struct {
         if (self.inflater.done) return 0;
         return self.inflater.readBytes(&self.bit_reader, dest);
     }
+
+    /// Inflate a `size`-byte member and its block padding straight into
+    /// `fd` (-1 discards it), one write per window span. False if the
+    /// archive ends early.
+    fn extractTo(self: *GzipReader, fd: i32, size: u64) bool {
+        var sink = FileSink{ .fd = fd, .remaining = size };
+        const padded = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE * tar.HEADER_SIZE;
+        return self.inflater.stream(&self.bit_reader, padded, &FileSink.write, @ptrCast(&sink)) == padded;
+    }
+};
+
+const FileSink = struct {
+    fd: i32,
+    /// File bytes still to write; the rest of the member is padding.
+    remaining: u64,
+
+    fn write(ctx_ptr: *anyopaque, data: []const u8) bool {
+        const self: *FileSink = @ptrCast(@alignCast(ctx_ptr));
+        const n: usize = @intCast(@min(self.remaining, data.len));
+        if (n > 0 and self.fd >= 0) _ = fx.syscall.write(self.fd, data[0..n]);
+        self.remaining -= n;
+        return true;
+    }
 };
 
 // ── Helpers ──────────────────────────────────────────────────────────
@@ -771,13 +793,7 @@ fn extractPackage(fd: i32, info: *PkgInfo) bool {
 
         // Skip metadata files (check before path prefix)
         if (strEql(raw_name, ".PKGINFO") or strEql(raw_name, ".INSTALL")) {
-            if (typeflag == '0' or typeflag == 0) {
-                const blocks = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE;
-                var bi: u64 = 0;
-                while (bi < blocks) : (bi += 1) {
-                    _ = gz.readBlock(&header);
-                }
-            }
+            if (typeflag == '0' or typeflag == 0) _ = gz.extractTo(-1, size);
             continue;
         }
 
@@ -804,25 +820,10 @@ fn extractPackage(fd: i32, info: *PkgInfo) bool {
             ensureParentDirs(name);
             const out_fd = fx.create(name, 0);
             if (out_fd < 0) {
-                // Skip data blocks
-                const blocks = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE;
-                var bi: u64 = 0;
-                while (bi < blocks) : (bi += 1) {
-                    _ = gz.readBlock(&header);
-                }
+                _ = gz.extractTo(-1, size);
                 continue;
             }
-
-            var remaining: u64 = size;
-            const blocks = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE;
-            var bi: u64 = 0;
-            while (bi < blocks) : (bi += 1) {
-                var block: [tar.HEADER_SIZE]u8 = undefined;
-                if (!gz.readBlock(&block)) break;
-                const to_write: usize = @intCast(@min(remaining, tar.HEADER_SIZE));
-                _ = fx.syscall.write(out_fd, block[0..to_write]);
-                remaining -= to_write;
-            }
+            _ = gz.extractTo(out_fd, size);
 
             const mode_val = hdr.mode();
             _ = fx.wstat(out_fd, @intCast(mode_val & 0o7777), 0, 0, fx.WSTAT_MODE);
@@ -836,13 +837,7 @@ fn extractPackage(fd: i32, info: *PkgInfo) bool {
             }
         } else {
             // Skip unknown types
-            if (size > 0) {
-                const blocks = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE;
-                var bi: u64 = 0;
-                while (bi < blocks) : (bi += 1) {
-                    _ = gz.readBlock(&header);
-                }
-            }
+            if (size > 0) _ = gz.extractTo(-1, size);
         }
     }
 
@@ -923,13 +918,7 @@ fn scanPkginfo(fd: i32, info: *PkgInfo) bool {
         }
 
         // Skip data blocks for non-matching entries
-        if (typeflag == '0' or typeflag == 0) {
-            const blocks = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE;
-            var bi: u64 = 0;
-            while (bi < blocks) : (bi += 1) {
-                _ = gz.readBlock(&header);
-            }
-        }
+        if (typeflag == '0' or typeflag == 0) _ = gz.extractTo(-1, size);
     }
 
     return false;
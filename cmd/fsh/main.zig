@@ -11,8 +11,9 @@ const out = fx.io.Writer.stdout;
 
 // ── BSS buffers ────────────────────────────────────────────────────
 
-/// 4 MB buffer for loading ELF binaries (matches spawn syscall limit).
-var elf_buf: [4 * 1024 * 1024]u8 linksection(".bss") = undefined;
+/// 4 MB buffer for loading ELF binaries. Page-aligned so spawn can share
+/// its pages with the child instead of copying them (see src/image.zig).
+var elf_buf: [4 * 1024 * 1024]u8 align(4096) linksection(".bss") = undefined;
 
 /// Scratch buffer for source builtin (separate from elf_buf to avoid
 /// corruption when source'd scripts spawn external commands).
@@ -840,6 +841,10 @@ fn loadElfFromPath(path: []const u8) ?[]const u8 {
     _ = fx.close(fd);
 
     if (total == 0) return null;
+    // Zero the rest of the last page: spawn only shares a buffer whose
+    // tail is clean
+    const page_end = @min((total + 4095) & ~@as(usize, 4095), elf_buf.len);
+    @memset(elf_buf[total..page_end], 0);
     return elf_buf[0..total];
 }
 
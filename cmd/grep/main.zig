@@ -1,57 +1,34 @@
 /// grep — search for a pattern in files.
 ///
-/// Usage: grep pattern [file...]
+/// Usage: grep [-i] pattern [file...]
+///   -i  ignore ASCII case
 /// No args after pattern: read stdin, print matching lines.
 const fx = @import("fornax");
 
 const out = fx.io.Writer.stdout;
 const err = fx.io.Writer.stderr;
 
-const LINE_BUF_SIZE = 4096;
+const BLOCK_SIZE = 64 * 1024;
 
-/// Read lines from fd, print those containing pattern.
-fn grepFd(fd: i32, pattern: []const u8, prefix: []const u8) void {
-    var line_buf: [LINE_BUF_SIZE]u8 = undefined;
-    var line_len: usize = 0;
-    var buf: [4096]u8 = undefined;
-
-    while (true) {
-        const n = fx.read(fd, &buf);
-        if (n <= 0) break;
-        const len: usize = @intCast(n);
+var block: [BLOCK_SIZE]u8 = undefined;
+var ignore_case = false;
 
-        for (buf[0..len]) |c| {
-            if (c == '\n') {
-                const line = line_buf[0..line_len];
-                if (fx.str.indexOfSlice(line, pattern) != null) {
-                    if (prefix.len > 0) {
-                        out.puts(prefix);
-                        out.putc(':');
-                    }
-                    _ = fx.write(1, line);
-                    out.putc('\n');
-                }
-                line_len = 0;
-            } else {
-                if (line_len < LINE_BUF_SIZE) {
-                    line_buf[line_len] = c;
-                    line_len += 1;
-                }
-            }
-        }
-    }
+fn matches(line: []const u8, pattern: []const u8) bool {
+    if (ignore_case) return fx.scan.indexOfIgnoreCase(line, pattern) != null;
+    return fx.scan.indexOf(line, pattern) != null;
+}
 
-    // Handle last line without trailing newline
-    if (line_len > 0) {
-        const line = line_buf[0..line_len];
-        if (fx.str.indexOfSlice(line, pattern) != null) {
-            if (prefix.len > 0) {
-                out.puts(prefix);
-                out.putc(':');
-            }
-            _ = fx.write(1, line);
-            out.putc('\n');
+/// Read lines from fd, print those containing pattern.
+fn grepFd(fd: i32, pattern: []const u8, prefix: []const u8) void {
+    var lines = fx.io.LineReader.init(fd, &block);
+    while (lines.next()) |line| {
+        if (!matches(line, pattern)) continue;
+        if (prefix.len > 0) {
+            out.puts(prefix);
+            out.putc(':');
         }
+        _ = fx.write(1, line);
+        out.putc('\n');
     }
 }
 
@@ -64,19 +41,26 @@ fn argStr(arg: [*]const u8) []const u8 {
 export fn _start() noreturn {
     const args = fx.getArgs();
 
-    if (args.len < 2) {
-        err.puts("usage: grep pattern [file...]\n");
+    var pat_idx: usize = 1;
+    if (args.len > 1 and fx.str.eql(argStr(args[1]), "-i")) {
+        ignore_case = true;
+        pat_idx = 2;
+    }
+
+    if (args.len <= pat_idx) {
+        err.puts("usage: grep [-i] pattern [file...]\n");
         fx.exit(1);
     }
 
-    const pattern = argStr(args[1]);
+    const pattern = argStr(args[pat_idx]);
+    const file_start = pat_idx + 1;
 
-    if (args.len <= 2) {
+    if (args.len <= file_start) {
         // Read stdin
         grepFd(0, pattern, "");
     } else {
-        const multi = args.len > 3;
-        var i: usize = 2;
+        const multi = args.len > file_start + 1;
+        var i: usize = file_start;
         while (i < args.len) : (i += 1) {
             const name = argStr(args[i]);
             const fd = fx.open(name);
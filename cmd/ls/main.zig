@@ -58,12 +58,8 @@ fn listDir(path: []const u8) void {
                 fp_len += name.len;
             }
 
-            const file_fd = fx.open(full_path[0..fp_len]);
-            if (file_fd >= 0) {
-                var st: fx.Stat = undefined;
-                _ = fx.stat(file_fd, &st);
-                _ = fx.close(file_fd);
-
+            var st: fx.Stat = undefined;
+            if (statPath(full_path[0..fp_len], &st)) {
                 if (flag_long) {
                     const mode_str = formatMode(st.mode);
                     var uid_buf: [10]u8 = undefined;
@@ -93,6 +89,39 @@ fn listDir(path: []const u8) void {
     }
 }
 
+var ring: ?fx.ring.Ring = null;
+var ring_tried = false;
+
+/// open → stat → close in one ring_enter, or as three syscalls when there
+/// is no ring or the path has to take the plain syscalls.
+fn statPath(path: []const u8, st: *fx.Stat) bool {
+    if (!ring_tried) {
+        ring_tried = true;
+        ring = fx.ringSetup(4);
+    }
+    if (ring) |*r| {
+        _ = r.push(fx.ring.Sqe.open(path, 0).linked());
+        _ = r.push(fx.ring.Sqe.stat(fx.ring.FD_LINKED, st, 1).linked());
+        _ = r.push(fx.ring.Sqe.close(fx.ring.FD_LINKED, 2));
+        var res = [_]i64{ -1, -1, -1 };
+        if (fx.ringSubmit(r, 3) >= 0) {
+            while (r.popCqe()) |cqe| {
+                if (cqe.user_data < res.len) res[@intCast(cqe.user_data)] = cqe.res;
+            }
+        } else {
+            ring = null;
+        }
+        // -1 (ENOSYS): not something the ring does for this path
+        if (res[0] != -1 and res[1] != -1) return res[0] >= 0 and res[1] == 0;
+    }
+
+    const fd = fx.open(path);
+    if (fd < 0) return false;
+    _ = fx.stat(fd, st);
+    _ = fx.close(fd);
+    return true;
+}
+
 fn printSimple(name: []const u8, file_type: u32) void {
     if (file_type == 1) {
         out.print("{s}/\n", .{name});
@@ -8,7 +8,10 @@ const fx = @import("fornax");
 const out = fx.io.Writer.stdout;
 const err = fx.io.Writer.stderr;
 
-const LINE_BUF_SIZE = 4096;
+const BLOCK_SIZE = 64 * 1024;
+
+var block: [BLOCK_SIZE]u8 = undefined;
+var result_buf: [BLOCK_SIZE]u8 = undefined;
 
 var old_pat: []const u8 = "";
 var new_pat: []const u8 = "";
@@ -50,68 +53,31 @@ fn substituteLine(line: []const u8) void {
         return;
     }
 
-    var result_buf: [LINE_BUF_SIZE]u8 = undefined;
     var result_len: usize = 0;
     var pos: usize = 0;
 
-    while (pos <= line.len) {
-        if (pos + old_pat.len <= line.len) {
-            if (fx.str.eql(line[pos..][0..old_pat.len], old_pat)) {
-                // Copy new_pat
-                const copy_len = @min(new_pat.len, LINE_BUF_SIZE - result_len);
-                @memcpy(result_buf[result_len..][0..copy_len], new_pat[0..copy_len]);
-                result_len += copy_len;
-                pos += old_pat.len;
-                if (!global_flag) {
-                    // Copy remainder
-                    const rem = line[pos..];
-                    const rem_copy = @min(rem.len, LINE_BUF_SIZE - result_len);
-                    @memcpy(result_buf[result_len..][0..rem_copy], rem[0..rem_copy]);
-                    result_len += rem_copy;
-                    break;
-                }
-                continue;
-            }
-        }
-        if (pos >= line.len) break;
-        if (result_len < LINE_BUF_SIZE) {
-            result_buf[result_len] = line[pos];
-            result_len += 1;
-        }
-        pos += 1;
+    while (fx.scan.indexOf(line[pos..], old_pat)) |k| {
+        append(&result_len, line[pos..][0..k]);
+        append(&result_len, new_pat);
+        pos += k + old_pat.len;
+        if (!global_flag) break;
     }
+    append(&result_len, line[pos..]);
 
     _ = fx.write(1, result_buf[0..result_len]);
     out.putc('\n');
 }
 
-fn sedFd(fd: i32) void {
-    var line_buf: [LINE_BUF_SIZE]u8 = undefined;
-    var line_len: usize = 0;
-    var buf: [4096]u8 = undefined;
-
-    while (true) {
-        const n = fx.read(fd, &buf);
-        if (n <= 0) break;
-        const len: usize = @intCast(n);
-
-        for (buf[0..len]) |c| {
-            if (c == '\n') {
-                substituteLine(line_buf[0..line_len]);
-                line_len = 0;
-            } else {
-                if (line_len < LINE_BUF_SIZE) {
-                    line_buf[line_len] = c;
-                    line_len += 1;
-                }
-            }
-        }
-    }
+/// Append to result_buf, truncating at its end.
+fn append(result_len: *usize, s: []const u8) void {
+    const n = @min(s.len, BLOCK_SIZE - result_len.*);
+    @memcpy(result_buf[result_len.*..][0..n], s[0..n]);
+    result_len.* += n;
+}
 
-    // Handle last line without trailing newline
-    if (line_len > 0) {
-        substituteLine(line_buf[0..line_len]);
-    }
+fn sedFd(fd: i32) void {
+    var lines = fx.io.LineReader.init(fd, &block);
+    while (lines.next()) |line| substituteLine(line);
 }
 
 fn argStr(arg: [*]const u8) []const u8 {
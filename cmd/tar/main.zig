@@ -10,7 +10,6 @@ var file_buf: [8192]u8 linksection(".bss") = undefined;
 var dir_buf: [4096]u8 linksection(".bss") = undefined;
 var path_scratch: [512]u8 linksection(".bss") = undefined;
 var crc_table_storage: fx.crc32.Crc32 linksection(".bss") = undefined;
-var inflate_out_buf: [tar.HEADER_SIZE]u8 = undefined;
 
 const tar = fx.tar;
 const deflate = fx.deflate;
@@ -119,7 +118,7 @@ const GzipReader = struct {
         fd_reader_ctx.fd = fd;
         return .{
             .bit_reader = deflate.BitReader.init(&fdReadFn, @ptrCast(&fd_reader_ctx), &io_buf),
-            .inflater = deflate.Inflater.init(&sliding_window, &inflate_out_buf),
+            .inflater = deflate.Inflater.init(&sliding_window),
         };
     }
 
@@ -141,6 +140,29 @@ const GzipReader = struct {
         }
         return true;
     }
+
+    /// Inflate a `size`-byte member and its block padding straight into
+    /// `fd` (-1 discards it), one write per window span. False if the
+    /// archive ends early.
+    fn extractTo(self: *GzipReader, fd: i32, size: u64) bool {
+        var sink = FileSink{ .fd = fd, .remaining = size };
+        const padded = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE * tar.HEADER_SIZE;
+        return self.inflater.stream(&self.bit_reader, padded, &FileSink.write, @ptrCast(&sink)) == padded;
+    }
+};
+
+const FileSink = struct {
+    fd: i32,
+    /// File bytes still to write; the rest of the member is padding.
+    remaining: u64,
+
+    fn write(ctx_ptr: *anyopaque, data: []const u8) bool {
+        const self: *FileSink = @ptrCast(@alignCast(ctx_ptr));
+        const n: usize = @intCast(@min(self.remaining, data.len));
+        if (n > 0 and self.fd >= 0) _ = fx.syscall.write(self.fd, data[0..n]);
+        self.remaining -= n;
+        return true;
+    }
 };
 
 // ── Path helpers ─────────────────────────────────────────────────────
@@ -360,16 +382,20 @@ fn processEntry(header: *[tar.HEADER_SIZE]u8, raw_fd: ?i32, gz: ?*GzipReader, ve
             return;
         }
 
-        var remaining: u64 = size;
-        const blocks = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE;
-        var block_i: u64 = 0;
-        while (block_i < blocks) : (block_i += 1) {
-            var block: [tar.HEADER_SIZE]u8 = undefined;
-            const got = readArchiveBlock(raw_fd, gz, &block);
-            if (!got) break;
-            const to_write: usize = @intCast(@min(remaining, tar.HEADER_SIZE));
-            _ = fx.syscall.write(out_fd, block[0..to_write]);
-            remaining -= to_write;
+        if (gz) |g| {
+            _ = g.extractTo(out_fd, size);
+        } else {
+            var remaining: u64 = size;
+            const blocks = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE;
+            var block_i: u64 = 0;
+            while (block_i < blocks) : (block_i += 1) {
+                var block: [tar.HEADER_SIZE]u8 = undefined;
+                const got = readArchiveBlock(raw_fd, gz, &block);
+                if (!got) break;
+                const to_write: usize = @intCast(@min(remaining, tar.HEADER_SIZE));
+                _ = fx.syscall.write(out_fd, block[0..to_write]);
+                remaining -= to_write;
+            }
         }
 
         _ = fx.wstat(out_fd, @intCast(mode_val & 0o7777), @intCast(uid_val), @intCast(gid_val), fx.WSTAT_MODE | fx.WSTAT_UID | fx.WSTAT_GID);
@@ -397,6 +423,10 @@ fn readArchiveBlock(raw_fd: ?i32, gz: ?*GzipReader, dest: *[tar.HEADER_SIZE]u8)
 }
 
 fn skipDataBlocks(raw_fd: ?i32, gz: ?*GzipReader, size: u64) void {
+    if (gz) |g| {
+        _ = g.extractTo(-1, size);
+        return;
+    }
     const blocks = (size + tar.HEADER_SIZE - 1) / tar.HEADER_SIZE;
     var block: [tar.HEADER_SIZE]u8 = undefined;
     var i: u64 = 0;
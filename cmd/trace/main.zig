@@ -0,0 +1,149 @@
+/// trace — dump kernel trace events from /dev/trace.
+///
+/// Needs a kernel built with -Dtrace=true. Prints one line per event:
+///   cycles core pid event arg0 arg1
+/// with cycles relative to the first event printed. Each read drains the
+/// cores in turn, so lines from different cores are not interleaved in
+/// time order — sort on the first column for a merged timeline.
+///
+/// Usage:
+///   trace             — print buffered events and exit
+///   trace -f          — keep printing new events (follow)
+///   trace -n N        — stop after N events
+///   trace -c          — drop buffered events first
+///   trace start|stop  — resume or pause recording
+const fx = @import("fornax");
+
+/// Mirror of the kernel's trace.Event.
+const Event = extern struct {
+    tsc: u64,
+    pid: u32,
+    core: u8,
+    id: u8,
+    _pad: u16,
+    args: [2]u64,
+};
+
+/// Indexed by trace.EventId.
+const names = [_][]const u8{
+    "lost",
+    "sched_switch",
+    "wakeup",
+    "ipc_send",
+    "ipc_recv",
+    "ipc_reply",
+    "page_fault",
+    "blk_submit",
+    "blk_complete",
+};
+const PAGE_FAULT = 6;
+
+const POLL_MS = 20;
+
+var line_buf: [4096]u8 = undefined;
+var line_len: usize = 0;
+
+export fn _start() noreturn {
+    const args = fx.getArgs();
+
+    var follow = false;
+    var clear = false;
+    var limit: u64 = 0;
+    var ctl: ?[]const u8 = null;
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = span(args[i]);
+        if (fx.str.eql(arg, "-f")) {
+            follow = true;
+        } else if (fx.str.eql(arg, "-c")) {
+            clear = true;
+        } else if (fx.str.eql(arg, "-n") and i + 1 < args.len) {
+            i += 1;
+            limit = fx.str.parseUint(span(args[i])) orelse {
+                _ = fx.write(2, "trace: bad count\n");
+                fx.exit(1);
+            };
+        } else if (fx.str.eql(arg, "start") or fx.str.eql(arg, "stop")) {
+            ctl = arg;
+        } else {
+            _ = fx.write(2, "usage: trace [-f] [-c] [-n N] | trace start|stop\n");
+            fx.exit(1);
+        }
+    }
+
+    const fd = fx.open("/dev/trace");
+    if (fd < 0) {
+        _ = fx.write(2, "trace: /dev/trace not available (kernel built without -Dtrace=true)\n");
+        fx.exit(1);
+    }
+
+    if (ctl) |cmd| {
+        _ = fx.write(fd, cmd);
+        _ = fx.close(fd);
+        fx.exit(0);
+    }
+    if (clear) _ = fx.write(fd, "clear");
+
+    var events: [128]Event = undefined;
+    const bytes: [*]u8 = @ptrCast(&events);
+    var base: u64 = 0;
+    var printed: u64 = 0;
+    while (limit == 0 or printed < limit) {
+        const n = fx.read(fd, bytes[0..@sizeOf(@TypeOf(events))]);
+        if (n <= 0) {
+            if (!follow) break;
+            fx.sleep(POLL_MS);
+            continue;
+        }
+        for (events[0 .. @as(usize, @intCast(n)) / @sizeOf(Event)]) |*ev| {
+            if (base == 0) base = ev.tsc;
+            printEvent(ev, base);
+            printed += 1;
+            if (limit != 0 and printed >= limit) break;
+        }
+        flush();
+    }
+    flush();
+    _ = fx.close(fd);
+    fx.exit(0);
+}
+
+fn printEvent(ev: *const Event, base: u64) void {
+    var buf: [20]u8 = undefined;
+    put(fx.fmt.formatDec(&buf, ev.tsc -% base));
+    put(" ");
+    put(fx.fmt.formatDec(&buf, ev.core));
+    put(" ");
+    put(fx.fmt.formatDec(&buf, ev.pid));
+    put(" ");
+    put(if (ev.id < names.len) names[ev.id] else "?");
+    if (ev.id == PAGE_FAULT) {
+        put(" 0x");
+        put(fx.fmt.formatHex(&buf, ev.args[0]));
+    } else {
+        put(" ");
+        put(fx.fmt.formatDec(&buf, ev.args[0]));
+    }
+    put(" ");
+    put(fx.fmt.formatDec(&buf, ev.args[1]));
+    put("\n");
+}
+
+/// Buffer output so a burst of events is one write, not six per line.
+fn put(s: []const u8) void {
+    if (line_len + s.len > line_buf.len) flush();
+    @memcpy(line_buf[line_len..][0..s.len], s);
+    line_len += s.len;
+}
+
+fn flush() void {
+    if (line_len == 0) return;
+    _ = fx.write(1, line_buf[0..line_len]);
+    line_len = 0;
+}
+
+fn span(ptr: [*:0]const u8) []const u8 {
+    var len: usize = 0;
+    while (ptr[len] != 0) len += 1;
+    return ptr[0..len];
+}
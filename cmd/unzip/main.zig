@@ -8,7 +8,6 @@ const deflate = fx.deflate;
 // ── BSS Buffers ──────────────────────────────────────────────────────
 var sliding_window: [32768]u8 linksection(".bss") = undefined;
 var input_buf: [8192]u8 linksection(".bss") = undefined;
-var out_buf: [8192]u8 linksection(".bss") = undefined;
 var filename_buf: [512]u8 linksection(".bss") = undefined;
 var path_buf: [512]u8 linksection(".bss") = undefined;
 var crc_table_storage: fx.crc32.Crc32 linksection(".bss") = undefined;
@@ -34,34 +33,16 @@ fn preadReadFn(ctx_ptr: *anyopaque, buf: []u8) isize {
     return n;
 }
 
-// ── Output writer with buffering + CRC ───────────────────────────────
-const OutputWriter = struct {
+// ── Inflate sink: CRC + write straight from the window ───────────────
+const OutputSink = struct {
     fd: i32,
-    pos: usize,
     crc: u32,
-    total: u64,
 
-    fn init(fd: i32) OutputWriter {
-        return .{ .fd = fd, .pos = 0, .crc = 0, .total = 0 };
-    }
-
-    fn writeData(self: *OutputWriter, data: []const u8) void {
-        for (data) |b| {
-            out_buf[self.pos] = b;
-            self.pos += 1;
-            if (self.pos >= out_buf.len) {
-                self.flushBuf();
-            }
-        }
-    }
-
-    fn flushBuf(self: *OutputWriter) void {
-        if (self.pos > 0) {
-            self.crc = crc_table_storage.update(self.crc, out_buf[0..self.pos]);
-            self.total += self.pos;
-            _ = fx.syscall.write(self.fd, out_buf[0..self.pos]);
-            self.pos = 0;
-        }
+    fn write(ctx_ptr: *anyopaque, data: []const u8) bool {
+        const self: *OutputSink = @ptrCast(@alignCast(ctx_ptr));
+        self.crc = crc_table_storage.update(self.crc, data);
+        _ = fx.syscall.write(self.fd, data);
+        return true;
     }
 };
 
@@ -209,23 +190,13 @@ export fn _start() noreturn {
             out.print(" inflating: {s}\n", .{name});
             pread_ctx = .{ .zip_fd = zip_fd, .file_offset = data_offset, .bytes_remaining = comp_size };
             var bit_reader = deflate.BitReader.init(&preadReadFn, @ptrCast(&pread_ctx), &input_buf);
-            var inflater = deflate.Inflater.init(&sliding_window, &out_buf);
-            var writer = OutputWriter.init(out_fd);
-
-            var ok = true;
-            while (!inflater.done) {
-                var tmp: [4096]u8 = undefined;
-                const n = inflater.readBytes(&bit_reader, &tmp);
-                if (n == 0) break;
-                writer.writeData(tmp[0..n]);
-            }
-            writer.flushBuf();
+            var inflater = deflate.Inflater.init(&sliding_window);
+            var sink = OutputSink{ .fd = out_fd, .crc = 0 };
+
+            _ = inflater.stream(&bit_reader, ~@as(u64, 0), &OutputSink.write, @ptrCast(&sink));
             if (!inflater.done) {
-                ok = false;
-            }
-            if (!ok) {
                 err.print("  warning: inflate error for {s}\n", .{name});
-            } else if (crc_expected != 0 and writer.crc != crc_expected) {
+            } else if (crc_expected != 0 and sink.crc != crc_expected) {
                 err.print("  warning: CRC mismatch for {s}\n", .{name});
             }
         } else {
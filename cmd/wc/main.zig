@@ -12,27 +12,24 @@ const err = fx.io.Writer.stderr;
 
 const Counts = struct { lines: u64, words: u64, chars: u64 };
 
-fn countFd(fd: i32) Counts {
+const BLOCK_SIZE = 64 * 1024;
+
+var block: [BLOCK_SIZE]u8 = undefined;
+
+/// Word counting is the slow kernel, so it only runs when asked for.
+fn countFd(fd: i32, want_words: bool) Counts {
     var lines: u64 = 0;
     var words: u64 = 0;
     var chars: u64 = 0;
     var in_word = false;
 
-    var buf: [4096]u8 = undefined;
     while (true) {
-        const n = fx.read(fd, &buf);
+        const n = fx.read(fd, &block);
         if (n <= 0) break;
-        const len: usize = @intCast(n);
-        for (buf[0..len]) |c| {
-            chars += 1;
-            if (c == '\n') lines += 1;
-            if (c == ' ' or c == '\t' or c == '\n' or c == '\r') {
-                in_word = false;
-            } else {
-                if (!in_word) words += 1;
-                in_word = true;
-            }
-        }
+        const data = block[0..@intCast(n)];
+        chars += data.len;
+        lines += fx.scan.countLines(data);
+        if (want_words) words += fx.scan.countWords(data, &in_word);
     }
 
     return .{ .lines = lines, .words = words, .chars = chars };
@@ -97,7 +94,7 @@ export fn _start() noreturn {
 
     if (file_start >= args.len) {
         // No file args — read stdin
-        const c = countFd(0);
+        const c = countFd(0, show_words);
         printCounts(c, show_lines, show_words, show_chars, null);
     } else {
         for (args[file_start..]) |arg| {
@@ -110,7 +107,7 @@ export fn _start() noreturn {
                 err.print("wc: {s}: not found\n", .{name});
                 continue;
             }
-            const c = countFd(fd);
+            const c = countFd(fd, show_words);
             _ = fx.close(fd);
             printCounts(c, show_lines, show_words, show_chars, name);
         }
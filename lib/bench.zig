@@ -0,0 +1,83 @@
+/// Timing and statistics helpers for the in-guest benchmarks.
+///
+/// cycles() reads the cycle counter (TSC on x86_64, time CSR on
+/// riscv64). summarize() sorts a sample buffer in place and reduces it
+/// to the figures bench reports.
+const builtin = @import("builtin");
+
+/// Cycle counter (TSC on x86_64, time CSR on riscv64, 0 elsewhere).
+pub fn cycles() u64 {
+    switch (builtin.cpu.arch) {
+        .x86_64 => {
+            var lo: u32 = undefined;
+            var hi: u32 = undefined;
+            asm volatile ("rdtsc"
+                : [lo] "={eax}" (lo),
+                  [hi] "={edx}" (hi),
+            );
+            return (@as(u64, hi) << 32) | lo;
+        },
+        .riscv64 => return asm volatile ("rdtime %[ret]"
+            : [ret] "=r" (-> u64),
+        ),
+        else => return 0,
+    }
+}
+
+pub const Summary = struct {
+    n: usize,
+    min: u64,
+    p50: u64,
+    p90: u64,
+    p99: u64,
+    max: u64,
+};
+
+/// Sort `samples` (at least one) and summarize them.
+pub fn summarize(samples: []u64) Summary {
+    sort(samples);
+    return .{
+        .n = samples.len,
+        .min = samples[0],
+        .p50 = percentile(samples, 50),
+        .p90 = percentile(samples, 90),
+        .p99 = percentile(samples, 99),
+        .max = samples[samples.len - 1],
+    };
+}
+
+/// Nearest-rank percentile of sorted samples.
+pub fn percentile(sorted: []const u64, pct: u64) u64 {
+    const rank = (sorted.len * pct + 99) / 100;
+    return sorted[@max(rank, 1) - 1];
+}
+
+/// In-place heapsort (no allocation, bounded stack).
+pub fn sort(a: []u64) void {
+    if (a.len < 2) return;
+    var start = a.len / 2;
+    while (start > 0) {
+        start -= 1;
+        siftDown(a, start, a.len);
+    }
+    var end = a.len - 1;
+    while (end > 0) : (end -= 1) {
+        const tmp = a[0];
+        a[0] = a[end];
+        a[end] = tmp;
+        siftDown(a, 0, end);
+    }
+}
+
+fn siftDown(a: []u64, root_idx: usize, end: usize) void {
+    var root = root_idx;
+    while (2 * root + 1 < end) {
+        var child = 2 * root + 1;
+        if (child + 1 < end and a[child] < a[child + 1]) child += 1;
+        if (a[root] >= a[child]) return;
+        const tmp = a[root];
+        a[root] = a[child];
+        a[child] = tmp;
+        root = child;
+    }
+}
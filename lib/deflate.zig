@@ -1,5 +1,10 @@
 // DEFLATE decompression (RFC 1951) with generic I/O.
-// BitReader uses function-pointer + context for byte reads.
+// BitReader uses function-pointer + context for byte reads and keeps up to
+// 63 bits buffered, refilled eight bytes at a time.
+// Huffman codes decode through lookup tables: one probe resolves codes up
+// to ROOT_BITS long, a second probe into a subtable the rest.
+// Output collects in the caller's 32 KiB window; readBytes() copies it out
+// and stream() hands it to a sink without an intermediate buffer.
 // All buffers are caller-provided (no allocation).
 
 pub const ReadFn = *const fn (ctx: *anyopaque, buf: []u8) isize;
@@ -11,8 +16,9 @@ pub const BitReader = struct {
     buf_size: usize,
     buf_pos: usize,
     buf_len: usize,
-    bit_buf: u32,
-    bit_count: u5,
+    /// Unconsumed bits, first bit in the LSB; bits above bit_count are 0.
+    bit_buf: u64,
+    bit_count: u8,
 
     pub fn init(read_fn: ReadFn, ctx: *anyopaque, buf: []u8) BitReader {
         return .{
@@ -27,104 +33,221 @@ pub const BitReader = struct {
         };
     }
 
+    /// Refill the byte buffer from read_fn. Only called once it is empty.
+    fn fetch(self: *BitReader) bool {
+        const n = self.read_fn(self.ctx, self.buf[0..self.buf_size]);
+        if (n <= 0) return false;
+        self.buf_len = @intCast(n);
+        self.buf_pos = 0;
+        return true;
+    }
+
+    /// Top bit_buf up to at least 56 bits from the byte buffer: one
+    /// unaligned word when eight bytes are buffered, else byte by byte.
+    /// Never calls read_fn; see ensure().
+    pub inline fn refill(self: *BitReader) void {
+        if (self.buf_len - self.buf_pos >= 8) {
+            const bytes = (63 - self.bit_count) >> 3;
+            self.bit_buf |= loadLe64(self.buf + self.buf_pos) << @intCast(self.bit_count);
+            self.bit_count += bytes * 8;
+            self.bit_buf &= (@as(u64, 1) << @intCast(self.bit_count)) - 1;
+            self.buf_pos += bytes;
+            return;
+        }
+        while (self.bit_count <= 55 and self.buf_pos < self.buf_len) {
+            self.bit_buf |= @as(u64, self.buf[self.buf_pos]) << @intCast(self.bit_count);
+            self.buf_pos += 1;
+            self.bit_count += 8;
+        }
+    }
+
+    /// Make at least `n` (≤ 56) bits available, reading more input if
+    /// needed. False if the input ends first.
+    pub inline fn ensure(self: *BitReader, n: u8) bool {
+        while (self.bit_count < n) {
+            self.refill();
+            if (self.bit_count >= n) break;
+            if (!self.fetch()) return false;
+        }
+        return true;
+    }
+
+    inline fn consume(self: *BitReader, n: u8) void {
+        self.bit_buf >>= @intCast(n);
+        self.bit_count -= n;
+    }
+
+    /// Take `n` (≤ 32) bits already buffered; null if fewer are.
+    pub inline fn take(self: *BitReader, n: u8) ?u32 {
+        if (self.bit_count < n) return null;
+        const val: u32 = @truncate(self.bit_buf & ((@as(u64, 1) << @intCast(n)) - 1));
+        self.consume(n);
+        return val;
+    }
+
+    /// Next whole byte: buffered bits first, then the byte buffer.
     pub fn readByte(self: *BitReader) ?u8 {
-        if (self.buf_pos >= self.buf_len) {
-            const n = self.read_fn(self.ctx, self.buf[0..self.buf_size]);
-            if (n <= 0) return null;
-            self.buf_len = @intCast(n);
-            self.buf_pos = 0;
+        if (self.bit_count >= 8) {
+            const b: u8 = @truncate(self.bit_buf);
+            self.consume(8);
+            return b;
         }
+        if (self.buf_pos >= self.buf_len and !self.fetch()) return null;
         const b = self.buf[self.buf_pos];
         self.buf_pos += 1;
         return b;
     }
 
     pub fn readBits(self: *BitReader, count: u5) ?u32 {
-        while (self.bit_count < count) {
-            const b = self.readByte() orelse return null;
-            self.bit_buf |= @as(u32, b) << self.bit_count;
-            self.bit_count += 8;
-        }
-        const mask = (@as(u32, 1) << count) - 1;
-        const val = self.bit_buf & mask;
-        self.bit_buf >>= count;
-        self.bit_count -= count;
-        return val;
+        if (!self.ensure(count)) return null;
+        return self.take(count);
     }
 
     pub fn readBitsWide(self: *BitReader, count: u8) ?u32 {
-        if (count == 0) return 0;
-        if (count > 25) {
-            const lo = self.readBitsWide(16) orelse return null;
-            const hi = self.readBitsWide(count - 16) orelse return null;
-            return lo | (hi << 16);
-        }
-        while (self.bit_count < @as(u5, @intCast(count))) {
-            const b = self.readByte() orelse return null;
-            self.bit_buf |= @as(u32, b) << self.bit_count;
-            self.bit_count += 8;
-        }
-        const mask = (@as(u32, 1) << @intCast(count)) - 1;
-        const val = self.bit_buf & mask;
-        self.bit_buf >>= @intCast(count);
-        self.bit_count -= @intCast(count);
-        return val;
+        if (!self.ensure(count)) return null;
+        return self.take(count);
     }
 
+    /// Drop the bits left in the current byte.
     pub fn alignToByte(self: *BitReader) void {
-        self.bit_buf = 0;
-        self.bit_count = 0;
+        self.consume(self.bit_count & 7);
+    }
+
+    /// Copy whole bytes into `dest` (after alignToByte), buffered bits
+    /// first. Returns the count, short only at end of input.
+    pub fn readAligned(self: *BitReader, dest: []u8) usize {
+        var n: usize = 0;
+        while (n < dest.len and self.bit_count >= 8) : (n += 1) {
+            dest[n] = @truncate(self.bit_buf);
+            self.consume(8);
+        }
+        while (n < dest.len) {
+            if (self.buf_pos >= self.buf_len and !self.fetch()) break;
+            const chunk = @min(dest.len - n, self.buf_len - self.buf_pos);
+            @memcpy(dest[n..][0..chunk], self.buf[self.buf_pos..][0..chunk]);
+            self.buf_pos += chunk;
+            n += chunk;
+        }
+        return n;
     }
 };
 
+fn loadLe64(p: [*]const u8) u64 {
+    var v: u64 = 0;
+    inline for (0..8) |i| v |= @as(u64, p[i]) << (8 * i);
+    return v;
+}
+
 // ── Huffman Table ────────────────────────────────────────────────────
 pub const MAX_SYMBOLS = 288;
 pub const MAX_BITS = 15;
+/// Code bits resolved by the first table probe.
+pub const ROOT_BITS = 9;
+const ROOT_SIZE = 1 << ROOT_BITS;
+const ROOT_MASK = ROOT_SIZE - 1;
+/// Root table plus subtables. zlib's bound for a literal/length code with
+/// 9 root bits is 852 entries; build() rejects codes that do not fit.
+const TABLE_SIZE = 1024;
+
+// Entries are u16. A leaf holds the symbol (bits 0-8) and its full code
+// length (bits 9-12, 0 = no such code). A link (bit 15) holds a subtable
+// offset (bits 0-9) and the number of bits indexing it (bits 10-12).
+const LINK: u16 = 0x8000;
 
 pub const HuffmanTable = struct {
-    counts: [MAX_BITS + 1]u16,
-    symbols: [MAX_SYMBOLS]u16,
-    num_symbols: u16,
-
-    pub fn build(self: *HuffmanTable, lengths: []const u8, n: usize) void {
-        self.num_symbols = @intCast(n);
-        for (&self.counts) |*c| c.* = 0;
-        for (0..n) |i| {
-            if (lengths[i] > 0 and lengths[i] <= MAX_BITS) {
-                self.counts[lengths[i]] += 1;
+    entries: [TABLE_SIZE]u16,
+
+    /// Build the table for the code lengths in `lengths` (0 = symbol
+    /// unused). Incomplete codes are allowed; false if the lengths
+    /// over-subscribe the code space or their subtables overflow.
+    pub fn build(self: *HuffmanTable, lengths: []const u8) bool {
+        var counts = [_]u16{0} ** (MAX_BITS + 1);
+        for (lengths) |len| {
+            if (len > MAX_BITS) return false;
+            counts[len] += 1;
+        }
+        counts[0] = 0;
+        var left: i32 = 1;
+        for (1..MAX_BITS + 1) |len| {
+            left = (left << 1) - counts[len];
+            if (left < 0) return false;
+        }
+
+        // Canonical codes, bit-reversed: the table is indexed by bits in
+        // stream order, first code bit in the LSB.
+        var next_code: [MAX_BITS + 1]u16 = undefined;
+        var code: u16 = 0;
+        next_code[0] = 0;
+        for (1..MAX_BITS + 1) |len| {
+            code = (code + counts[len - 1]) << 1;
+            next_code[len] = code;
+        }
+        var codes: [MAX_SYMBOLS]u16 = undefined;
+        var sub_bits = [_]u8{0} ** ROOT_SIZE;
+        for (lengths, 0..) |len, sym| {
+            if (len == 0) continue;
+            const rev = @bitReverse(next_code[len]) >> @intCast(16 - @as(u8, len));
+            next_code[len] += 1;
+            codes[sym] = rev;
+            if (len > ROOT_BITS) {
+                const r = rev & ROOT_MASK;
+                sub_bits[r] = @max(sub_bits[r], len - ROOT_BITS);
             }
         }
-        var offsets: [MAX_BITS + 1]u16 = undefined;
-        offsets[0] = 0;
-        var total: u16 = 0;
-        for (1..MAX_BITS + 1) |bits| {
-            offsets[bits] = total;
-            total += self.counts[bits];
+
+        // One subtable per root slot that prefixes longer codes, sized for
+        // the longest of them.
+        @memset(self.entries[0..ROOT_SIZE], 0);
+        var next: usize = ROOT_SIZE;
+        for (sub_bits, 0..) |bits, r| {
+            if (bits == 0) continue;
+            const size = @as(usize, 1) << @intCast(bits);
+            if (next + size > TABLE_SIZE) return false;
+            self.entries[r] = LINK | @as(u16, @intCast(next)) | (@as(u16, bits) << 10);
+            @memset(self.entries[next..][0..size], 0);
+            next += size;
         }
-        for (0..n) |i| {
-            const len = lengths[i];
-            if (len > 0 and len <= MAX_BITS) {
-                self.symbols[offsets[len]] = @intCast(i);
-                offsets[len] += 1;
+
+        // A code shorter than its table's index fills every slot whose
+        // low bits match it.
+        for (lengths, 0..) |len, sym| {
+            if (len == 0) continue;
+            const leaf = @as(u16, @intCast(sym)) | (@as(u16, len) << 9);
+            const rev = codes[sym];
+            if (len <= ROOT_BITS) {
+                var i: usize = rev;
+                while (i < ROOT_SIZE) : (i += @as(usize, 1) << @intCast(len)) self.entries[i] = leaf;
+            } else {
+                const link = self.entries[rev & ROOT_MASK];
+                const base = link & 0x3FF;
+                const size = @as(usize, 1) << @intCast((link >> 10) & 7);
+                var i: usize = rev >> ROOT_BITS;
+                while (i < size) : (i += @as(usize, 1) << @intCast(len - ROOT_BITS)) self.entries[base + i] = leaf;
             }
         }
+        return true;
     }
 
-    pub fn decode(self: *const HuffmanTable, reader: *BitReader) ?u16 {
-        var code: u32 = 0;
-        var first: u32 = 0;
-        var index: u32 = 0;
-        for (1..MAX_BITS + 1) |bit_len| {
-            const b = reader.readBits(1) orelse return null;
-            code = (code << 1) | b;
-            const count: u32 = self.counts[bit_len];
-            if (code -% first < count) {
-                return self.symbols[index + code - first];
-            }
-            index += count;
-            first = (first + count) << 1;
+    /// Decode one symbol from the bits `reader` already holds; null for an
+    /// invalid code or too few bits. Callers refill first.
+    pub inline fn lookup(self: *const HuffmanTable, reader: *BitReader) ?u16 {
+        const bits = reader.bit_buf;
+        var e = self.entries[@intCast(bits & ROOT_MASK)];
+        if (e & LINK != 0) {
+            const mask = (@as(u64, 1) << @intCast((e >> 10) & 7)) - 1;
+            e = self.entries[(e & 0x3FF) + @as(usize, @intCast((bits >> ROOT_BITS) & mask))];
         }
-        return null;
+        const len: u8 = @intCast((e >> 9) & 0xF);
+        if (len == 0 or len > reader.bit_count) return null;
+        reader.consume(len);
+        return e & 0x1FF;
+    }
+
+    pub fn decode(self: *const HuffmanTable, reader: *BitReader) ?u16 {
+        // Best effort: the last code in the stream may be shorter than
+        // MAX_BITS, so a short read is not an error yet.
+        _ = reader.ensure(MAX_BITS);
+        return self.lookup(reader);
     }
 };
 
@@ -152,13 +275,26 @@ pub const dist_extra = [_]u8{
 pub const cl_order = [_]u8{ 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
 // ── Inflater ─────────────────────────────────────────────────────────
+pub const WINDOW_SIZE = 32768;
+const WINDOW_MASK = WINDOW_SIZE - 1;
+const MAX_MATCH = 258;
+/// Decoding stops once this much output is pending, so the next symbol
+/// cannot overwrite window bytes not yet handed out.
+const FILL_LIMIT = WINDOW_SIZE - MAX_MATCH;
+/// Bits for a whole length/distance pair: code, extra, code, extra.
+const PAIR_BITS = MAX_BITS + 5 + MAX_BITS + 13;
+
+/// Receives decompressed data from stream(); return false to stop.
+pub const WriteFn = *const fn (ctx: *anyopaque, data: []const u8) bool;
+
 pub const Inflater = struct {
-    window: *[32768]u8,
+    window: *[WINDOW_SIZE]u8,
     win_pos: usize,
-    out_buf: [*]u8,
-    out_size: usize,
-    out_pos: usize,
-    out_ready: usize,
+    /// Decoded bytes ending at win_pos not yet handed out.
+    pending: usize,
+    /// Bytes decoded so far, capped at WINDOW_SIZE: how far back a match
+    /// may reach.
+    history: usize,
     // Fixed tables (lazily built)
     fixed_lit_table: HuffmanTable,
     fixed_dist_table: HuffmanTable,
@@ -173,16 +309,18 @@ pub const Inflater = struct {
     stored_remaining: u16,
     lit_table_ptr: ?*const HuffmanTable,
     dist_table_ptr: ?*const HuffmanTable,
+    /// Final block decoded; `done` once its output is handed out too.
+    ended: bool,
     done: bool,
+    /// Corrupt or truncated input: no more output will come.
+    failed: bool,
 
-    pub fn init(window: *[32768]u8, out_buf: []u8) Inflater {
+    pub fn init(window: *[WINDOW_SIZE]u8) Inflater {
         return .{
             .window = window,
             .win_pos = 0,
-            .out_buf = out_buf.ptr,
-            .out_size = out_buf.len,
-            .out_pos = 0,
-            .out_ready = 0,
+            .pending = 0,
+            .history = 0,
             .fixed_lit_table = undefined,
             .fixed_dist_table = undefined,
             .fixed_built = false,
@@ -194,7 +332,9 @@ pub const Inflater = struct {
             .stored_remaining = 0,
             .lit_table_ptr = null,
             .dist_table_ptr = null,
+            .ended = false,
             .done = false,
+            .failed = false,
         };
     }
 
@@ -205,28 +345,47 @@ pub const Inflater = struct {
         for (144..256) |i| lit_lengths[i] = 9;
         for (256..280) |i| lit_lengths[i] = 7;
         for (280..288) |i| lit_lengths[i] = 8;
-        self.fixed_lit_table.build(&lit_lengths, 288);
+        _ = self.fixed_lit_table.build(&lit_lengths);
         var dist_lengths: [32]u8 = undefined;
         for (&dist_lengths) |*d| d.* = 5;
-        self.fixed_dist_table.build(&dist_lengths, 32);
+        _ = self.fixed_dist_table.build(&dist_lengths);
         self.fixed_built = true;
     }
 
-    fn writeByte(self: *Inflater, b: u8) void {
-        self.window[self.win_pos] = b;
-        self.win_pos = (self.win_pos + 1) & 0x7FFF;
-        if (self.out_ready < self.out_size) {
-            self.out_buf[self.out_ready] = b;
-        }
-        self.out_ready += 1;
+    fn advance(self: *Inflater, n: usize) void {
+        self.win_pos = (self.win_pos + n) & WINDOW_MASK;
+        self.pending += n;
+        self.history = @min(self.history + n, WINDOW_SIZE);
     }
 
-    fn copyFromWindow(self: *Inflater, dist: u16, length: u16) void {
-        var src = (self.win_pos -% @as(usize, dist)) & 0x7FFF;
-        for (0..length) |_| {
-            const b = self.window[src];
-            src = (src + 1) & 0x7FFF;
-            self.writeByte(b);
+    /// Append a `length`-byte match from `dist` back, a contiguous span
+    /// at a time.
+    fn copyMatch(self: *Inflater, dist: usize, length: usize) void {
+        var left = length;
+        while (left > 0) {
+            const src = (self.win_pos -% dist) & WINDOW_MASK;
+            const n = @min(left, WINDOW_SIZE - self.win_pos, WINDOW_SIZE - src);
+            const to = self.window[self.win_pos..][0..n];
+            if (src == self.win_pos) {
+                // Exactly 32 KiB back: those bytes are already in place.
+            } else if (src + n <= self.win_pos or src >= self.win_pos + n) {
+                @memcpy(to, self.window[src..][0..n]);
+            } else if (src > self.win_pos) {
+                // Source wraps to just ahead of us: old bytes, read before
+                // they are overwritten.
+                for (to, self.window[src..][0..n]) |*d, s| d.* = s;
+            } else {
+                // Overlapping run (dist < n): the output repeats every
+                // `dist` bytes, so copy the pattern in doubling chunks.
+                var done: usize = 0;
+                while (done < n) {
+                    const chunk = @min(n - done, dist + done);
+                    @memcpy(to[done..][0..chunk], self.window[src..][0..chunk]);
+                    done += chunk;
+                }
+            }
+            self.advance(n);
+            left -= n;
         }
     }
 
@@ -241,7 +400,7 @@ pub const Inflater = struct {
         }
 
         var cl_table: HuffmanTable = undefined;
-        cl_table.build(&cl_lengths_arr, 19);
+        if (!cl_table.build(&cl_lengths_arr)) return false;
 
         var all_lengths: [288 + 32]u8 = .{0} ** (288 + 32);
         const total_codes = hlit + hdist;
@@ -279,133 +438,142 @@ pub const Inflater = struct {
             }
         }
 
-        self.dyn_lit_table.build(all_lengths[0..hlit], hlit);
-        self.dyn_dist_table.build(all_lengths[hlit .. hlit + hdist], hdist);
+        if (!self.dyn_lit_table.build(all_lengths[0..hlit])) return false;
+        return self.dyn_dist_table.build(all_lengths[hlit .. hlit + hdist]);
+    }
+
+    fn startBlock(self: *Inflater, reader: *BitReader) bool {
+        const hdr = reader.readBits(3) orelse return false;
+        self.bfinal = hdr & 1 != 0;
+        self.btype = @intCast(hdr >> 1);
+        switch (self.btype) {
+            0 => {
+                reader.alignToByte();
+                const len = reader.readBitsWide(16) orelse return false;
+                const nlen = reader.readBitsWide(16) orelse return false;
+                if (len ^ nlen != 0xFFFF) return false;
+                self.stored_remaining = @intCast(len);
+            },
+            1 => {
+                self.buildFixedTables();
+                self.lit_table_ptr = &self.fixed_lit_table;
+                self.dist_table_ptr = &self.fixed_dist_table;
+            },
+            2 => {
+                if (!self.decodeDynamicTables(reader)) return false;
+                self.lit_table_ptr = &self.dyn_lit_table;
+                self.dist_table_ptr = &self.dyn_dist_table;
+            },
+            else => return false,
+        }
+        self.in_block = true;
         return true;
     }
 
-    /// Read up to `dest.len` decompressed bytes. Returns number of bytes
-    /// written to `dest`, or 0 on EOF/error.
-    pub fn readBytes(self: *Inflater, reader: *BitReader, dest: []u8) usize {
-        if (self.done) return 0;
-
-        // Deliver leftover bytes from previous call's overshoot
-        if (self.out_ready > self.out_pos) {
-            const avail = self.out_ready - self.out_pos;
-            const n = @min(avail, dest.len);
-            @memcpy(dest[0..n], self.out_buf[self.out_pos..][0..n]);
-            self.out_pos += n;
-            if (self.out_pos >= self.out_ready) {
-                self.out_pos = 0;
-                self.out_ready = 0;
-            }
-            return n;
+    fn endBlock(self: *Inflater) void {
+        self.in_block = false;
+        if (self.bfinal) self.ended = true;
+    }
+
+    fn copyStored(self: *Inflater, reader: *BitReader) bool {
+        while (self.stored_remaining > 0 and self.pending < FILL_LIMIT) {
+            const span = @min(self.stored_remaining, FILL_LIMIT - self.pending, WINDOW_SIZE - self.win_pos);
+            const n = reader.readAligned(self.window[self.win_pos..][0..span]);
+            self.advance(n);
+            self.stored_remaining -= @intCast(n);
+            if (n < span) return false;
         }
+        if (self.stored_remaining == 0) self.endBlock();
+        return true;
+    }
 
-        self.out_pos = 0;
-        self.out_ready = 0;
-
-        while (self.out_ready < dest.len) {
-            if (!self.in_block) {
-                const bf = reader.readBits(1) orelse break;
-                const bt = reader.readBits(2) orelse break;
-                self.bfinal = bf == 1;
-                self.btype = @intCast(bt);
-                self.in_block = true;
-
-                switch (self.btype) {
-                    0 => {
-                        reader.alignToByte();
-                        const len_lo = reader.readBitsWide(16) orelse break;
-                        _ = reader.readBitsWide(16) orelse break;
-                        self.stored_remaining = @intCast(len_lo);
-                    },
-                    1 => {
-                        self.buildFixedTables();
-                        self.lit_table_ptr = &self.fixed_lit_table;
-                        self.dist_table_ptr = &self.fixed_dist_table;
-                    },
-                    2 => {
-                        if (!self.decodeDynamicTables(reader)) break;
-                        self.lit_table_ptr = &self.dyn_lit_table;
-                        self.dist_table_ptr = &self.dyn_dist_table;
-                    },
-                    else => break,
-                }
+    fn inflateCodes(self: *Inflater, reader: *BitReader) bool {
+        const lt = self.lit_table_ptr orelse return false;
+        const dt = self.dist_table_ptr orelse return false;
+        while (self.pending < FILL_LIMIT) {
+            // One refill covers a whole length/distance pair, and literal
+            // runs decode from the buffered bits until they run low. Near
+            // the end of input lookup() and take() catch a short read.
+            if (reader.bit_count < PAIR_BITS) _ = reader.ensure(PAIR_BITS);
+            const sym = lt.lookup(reader) orelse return false;
+            if (sym < 256) {
+                self.window[self.win_pos] = @intCast(sym);
+                self.advance(1);
+                continue;
             }
-
-            if (self.btype == 0) {
-                while (self.stored_remaining > 0 and self.out_ready < dest.len) {
-                    const b = reader.readByte() orelse return self.finishRead(dest);
-                    self.writeByte(b);
-                    self.stored_remaining -= 1;
-                }
-                if (self.stored_remaining == 0) {
-                    self.in_block = false;
-                    if (self.bfinal) {
-                        self.done = true;
-                        break;
-                    }
-                }
-            } else {
-                const lt = self.lit_table_ptr orelse break;
-                const dt = self.dist_table_ptr orelse break;
-                while (self.out_ready < dest.len) {
-                    const sym = lt.decode(reader) orelse return self.finishRead(dest);
-                    if (sym < 256) {
-                        self.writeByte(@intCast(sym));
-                    } else if (sym == 256) {
-                        self.in_block = false;
-                        if (self.bfinal) self.done = true;
-                        break;
-                    } else {
-                        const len_idx = sym - 257;
-                        if (len_idx >= len_base.len) return self.finishRead(dest);
-                        const el = len_extra[len_idx];
-                        var length: u16 = len_base[len_idx];
-                        if (el > 0) {
-                            const extra = reader.readBitsWide(el) orelse return self.finishRead(dest);
-                            length += @intCast(extra);
-                        }
-                        const dist_sym = dt.decode(reader) orelse return self.finishRead(dest);
-                        if (dist_sym >= dist_base.len) return self.finishRead(dest);
-                        const ed = dist_extra[dist_sym];
-                        var distance: u16 = dist_base[dist_sym];
-                        if (ed > 0) {
-                            const extra = reader.readBitsWide(ed) orelse return self.finishRead(dest);
-                            distance += @intCast(extra);
-                        }
-                        self.copyFromWindow(distance, length);
-                    }
-                }
+            if (sym == 256) {
+                self.endBlock();
+                return true;
             }
+            const len_idx = sym - 257;
+            if (len_idx >= len_base.len) return false;
+            const length = len_base[len_idx] + (reader.take(len_extra[len_idx]) orelse return false);
+            const dist_sym = dt.lookup(reader) orelse return false;
+            if (dist_sym >= dist_base.len) return false;
+            const distance = dist_base[dist_sym] + (reader.take(dist_extra[dist_sym]) orelse return false);
+            // Reaching before the start of the output would copy stale window bytes
+            if (distance > self.history) return false;
+            self.copyMatch(distance, length);
         }
+        return true;
+    }
 
-        return self.finishRead(dest);
+    /// Decode until FILL_LIMIT bytes are pending, the stream ends, or it
+    /// turns out corrupt.
+    fn fill(self: *Inflater, reader: *BitReader) void {
+        while (self.pending < FILL_LIMIT and !self.ended and !self.failed) {
+            const ok = if (!self.in_block)
+                self.startBlock(reader)
+            else if (self.btype == 0)
+                self.copyStored(reader)
+            else
+                self.inflateCodes(reader);
+            if (!ok) self.failed = true;
+        }
     }
 
-    fn finishRead(self: *Inflater, dest: []u8) usize {
-        const in_buf = @min(self.out_ready, self.out_size);
-        const n = @min(in_buf, dest.len);
-        if (n > 0) {
-            @memcpy(dest[0..n], self.out_buf[0..n]);
+    /// Hand out up to `max` pending bytes, stopping at the window's end.
+    fn nextSpan(self: *Inflater, max: usize) []const u8 {
+        const start = (self.win_pos -% self.pending) & WINDOW_MASK;
+        const n = @min(self.pending, WINDOW_SIZE - start, max);
+        self.pending -= n;
+        if (self.pending == 0 and self.ended) self.done = true;
+        return self.window[start..][0..n];
+    }
+
+    /// Read up to `dest.len` decompressed bytes. Returns number of bytes
+    /// written to `dest`, or 0 on EOF/error.
+    pub fn readBytes(self: *Inflater, reader: *BitReader, dest: []u8) usize {
+        if (self.pending == 0) self.fill(reader);
+        var n: usize = 0;
+        while (n < dest.len and self.pending > 0) {
+            const span = self.nextSpan(dest.len - n);
+            @memcpy(dest[n..][0..span.len], span);
+            n += span.len;
         }
-        const excess = self.out_ready - n;
-        if (excess > 0) {
-            // Replay excess bytes from window into out_buf for next call
-            const to_save = @min(excess, self.out_size);
-            var src = (self.win_pos -% excess) & 0x7FFF;
-            for (0..to_save) |i| {
-                self.out_buf[i] = self.window[src];
-                src = (src + 1) & 0x7FFF;
+        if (self.pending == 0 and self.ended) self.done = true;
+        return n;
+    }
+
+    /// Pass up to `limit` decompressed bytes to `write_fn`, straight from
+    /// the window in spans of up to 32 KiB. Returns the bytes passed;
+    /// fewer than `limit` means the stream ended, was corrupt, or
+    /// write_fn returned false.
+    pub fn stream(self: *Inflater, reader: *BitReader, limit: u64, write_fn: WriteFn, ctx: *anyopaque) u64 {
+        var total: u64 = 0;
+        while (total < limit) {
+            if (self.pending == 0) {
+                self.fill(reader);
+                if (self.pending == 0) {
+                    if (self.ended) self.done = true;
+                    break;
+                }
             }
-            self.out_pos = 0;
-            self.out_ready = to_save;
-        } else {
-            self.out_pos = 0;
-            self.out_ready = 0;
+            const span = self.nextSpan(@intCast(@min(limit - total, WINDOW_SIZE)));
+            total += span.len;
+            if (!write_fn(ctx, span)) break;
         }
-        return n;
+        return total;
     }
 
     /// Convenience: decompress an entire stream, writing to a callback.
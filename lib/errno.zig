@@ -6,9 +6,11 @@ pub const Errno = enum(i32) {
     IO = -5,
     BADF = -9,
     NOMEM = -12,
+    ACCES = -13,
     FAULT = -14,
     INVAL = -22,
     MFILE = -24,
+    CANCELED = -125,
 };
 
 /// Return a human-readable name for a syscall return code.
@@ -20,9 +22,11 @@ pub fn name(code: i32) []const u8 {
         .IO => "EIO",
         .BADF => "EBADF",
         .NOMEM => "ENOMEM",
+        .ACCES => "EACCES",
         .FAULT => "EFAULT",
         .INVAL => "EINVAL",
         .MFILE => "EMFILE",
+        .CANCELED => "ECANCELED",
     };
 }
 
@@ -1,6 +1,7 @@
 /// I/O helpers for Fornax userspace.
 const syscall = @import("syscall.zig");
 const fmt = @import("fmt.zig");
+const scan = @import("scan.zig");
 
 /// Writer parameterized by file descriptor.
 pub const Writer = struct {
@@ -98,6 +99,77 @@ pub fn readAll(fd: i32, buf: []u8) usize {
     return total;
 }
 
+/// Splits an fd into lines, reading in blocks of the caller's buffer
+/// size and finding newlines with scan.indexOfByte. A line longer than
+/// the buffer comes back cut to the buffer's length; the rest of it is
+/// dropped. Returned slices point into the buffer and stay valid until
+/// the next call.
+pub const LineReader = struct {
+    fd: i32,
+    buf: []u8,
+    /// Start of the unconsumed data.
+    pos: usize = 0,
+    /// End of the data read so far.
+    end: usize = 0,
+    /// Bytes past pos already searched for a newline.
+    scanned: usize = 0,
+    eof: bool = false,
+    /// Dropping the tail of an overlong line.
+    skipping: bool = false,
+
+    pub fn init(fd: i32, buf: []u8) LineReader {
+        return .{ .fd = fd, .buf = buf };
+    }
+
+    /// Next line without its newline, or null at end of input.
+    pub fn next(self: *LineReader) ?[]const u8 {
+        while (true) {
+            const pending = self.buf[self.pos..self.end];
+            if (scan.indexOfByte(pending[self.scanned..], '\n')) |k| {
+                const len = self.scanned + k;
+                self.pos += len + 1;
+                self.scanned = 0;
+                if (self.skipping) {
+                    self.skipping = false;
+                    continue;
+                }
+                return pending[0..len];
+            }
+            self.scanned = pending.len;
+
+            if (self.eof) {
+                self.pos = self.end;
+                self.scanned = 0;
+                if (pending.len == 0 or self.skipping) return null;
+                return pending;
+            }
+
+            // Slide the partial line to the front to make room.
+            if (self.pos > 0) {
+                for (0..pending.len) |i| self.buf[i] = self.buf[self.pos + i];
+                self.end = pending.len;
+                self.pos = 0;
+            }
+            if (self.end == self.buf.len) {
+                self.pos = self.end;
+                self.scanned = 0;
+                if (!self.skipping) {
+                    self.skipping = true;
+                    return self.buf[0..self.end];
+                }
+                continue;
+            }
+
+            const n = syscall.read(self.fd, self.buf[self.end..]);
+            if (n <= 0) {
+                self.eof = true;
+            } else {
+                self.end += @intCast(n);
+            }
+        }
+    }
+};
+
 /// Write all data to fd. Returns true if all bytes were written.
 pub fn writeAll(fd: i32, data: []const u8) bool {
     var written: usize = 0;
@@ -39,9 +39,27 @@ pub const T_REMOVE: u32 = 8;
 pub const T_RENAME: u32 = 9;
 pub const T_TRUNCATE: u32 = 10;
 pub const T_WSTAT: u32 = 11;
+/// Bulk write on a grant-enabled channel: payload [handle u32][len u32],
+/// data is fetched with ipc_grant_read. Bulk reads reuse T_READ with a
+/// count above 4096; the server fills the grant and replies [n u32].
+pub const T_WRITE_BULK: u32 = 12;
 pub const R_OK: u32 = 128;
 pub const R_ERROR: u32 = 129;
 
+/// Fill `dest` for a bulk read from a source that returns short reads
+/// (a block, or the rest of one, per call). Keeps reading at
+/// `offset + done` until dest is full or the source returns 0, so a
+/// result below dest.len means end of file.
+pub fn fillBulk(ctx: anytype, comptime readAt: fn (@TypeOf(ctx), u64, []u8) u32, dest: []u8, offset: u64) u32 {
+    var done: u32 = 0;
+    while (done < dest.len) {
+        const n = readAt(ctx, offset + done, dest[done..]);
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
 /// Directory entry returned by reading a directory handle.
 pub const DirEntry = extern struct {
     name: [64]u8, // null-terminated
@@ -7,17 +7,40 @@
 ///   - sendFn: callback to send an IP packet (builds and transmits)
 ///   - getIpFn: callback to get our current IP address
 ///   - getTicksFn: callback to get current tick count (for retransmission)
+///   - setBufferAllocator: memory for per-connection send/receive buffers
+///
+/// Options: MSS, window scaling and timestamps (RFC 7323), SACK (RFC 2018).
+/// Sending is a sliding window bounded by the peer's window and a Reno
+/// congestion window (RFC 5681) with NewReno/SACK loss recovery; the RTO
+/// follows RFC 6298. Buffers start at MIN_BUF_SIZE and double with the
+/// measured bandwidth-delay product up to MAX_BUF_SIZE.
 const ipv4 = @import("ipv4.zig");
 
 pub const HEADER_SIZE = 20;
+/// Header plus the full 40 bytes of options.
+pub const MAX_HEADER_SIZE = 60;
 pub const MAX_CONNECTIONS = 256;
-pub const RX_BUF_SIZE = 16384;
-pub const TX_BUF_SIZE = 4096;
+/// Initial per-connection receive and send buffer size.
+pub const MIN_BUF_SIZE = 4096;
+/// Largest a buffer grows to (the receive side needs window scaling past 64 KB).
+pub const MAX_BUF_SIZE = 256 * 1024;
+/// MSS we advertise and the cap on the peer's.
 pub const DEFAULT_MSS: u16 = 1460;
+/// Send MSS when the peer's SYN has no MSS option (RFC 1122).
+pub const FALLBACK_MSS: u16 = 536;
+pub const MIN_MSS: u16 = 88;
 pub const DEFAULT_WINDOW: u16 = 16384;
+/// Receive window shift we offer: MAX_BUF_SIZE >> 3 fits the 16-bit field.
+pub const WINDOW_SHIFT: u8 = 3;
 pub const INITIAL_RTO: u32 = 18;
+pub const MIN_RTO: u32 = 4;
+pub const MAX_RTO: u32 = 1080;
 pub const MAX_RETRIES: u8 = 8;
 pub const TIME_WAIT_TICKS: u32 = 36;
+/// Initial congestion window in segments (RFC 6928).
+pub const INITIAL_CWND_SEGS = 10;
+pub const MAX_SACK_BLOCKS = 4;
+const DUPACK_THRESHOLD = 3;
 
 // TCP flags
 pub const FIN: u8 = 0x01;
@@ -26,6 +49,15 @@ pub const RST: u8 = 0x04;
 pub const PSH: u8 = 0x08;
 pub const ACK: u8 = 0x10;
 
+// TCP option kinds
+pub const OPT_END: u8 = 0;
+pub const OPT_NOP: u8 = 1;
+pub const OPT_MSS: u8 = 2;
+pub const OPT_WSCALE: u8 = 3;
+pub const OPT_SACK_PERM: u8 = 4;
+pub const OPT_SACK: u8 = 5;
+pub const OPT_TIMESTAMP: u8 = 8;
+
 pub const TcpState = enum(u8) {
     closed,
     listen,
@@ -49,6 +81,24 @@ const HASH_BUCKETS = 256;
 pub const WaiterCallback = *const fn (conn_idx: u8, event: WaiterEvent) void;
 pub const WaiterEvent = enum { data_ready, connect_done, accept_ready, error_reset, eof };
 
+/// Sequence space range [start, end).
+pub const SeqRange = struct {
+    start: u32,
+    end: u32,
+};
+
+/// Options parsed from an incoming segment.
+pub const Options = struct {
+    mss: u16 = 0, // 0 = absent
+    wscale: ?u8 = null,
+    sack_permitted: bool = false,
+    has_ts: bool = false,
+    ts_val: u32 = 0,
+    ts_ecr: u32 = 0,
+    sack: [MAX_SACK_BLOCKS]SeqRange = undefined,
+    sack_count: u8 = 0,
+};
+
 pub const Connection = struct {
     in_use: bool,
     state: TcpState,
@@ -60,13 +110,50 @@ pub const Connection = struct {
     snd_una: u32,
     snd_nxt: u32,
     rcv_nxt: u32,
-    snd_wnd: u16,
-    mss: u16,
-    rx_buf: [RX_BUF_SIZE]u8,
-    rx_head: u16,
-    rx_count: u16,
-    tx_buf: [TX_BUF_SIZE]u8,
-    tx_len: u16,
+    snd_wnd: u32, // remote window, scaled
+    mss: u16, // send MSS
+    // Negotiated options (offered until the handshake settles them)
+    ws_ok: bool,
+    snd_wscale: u8, // shift for windows the peer sends
+    rcv_wscale: u8, // shift for windows we send
+    sack_ok: bool,
+    ts_ok: bool,
+    ts_recent: u32,
+    // Receive ring (power-of-two capacity). rx_head is the offset of
+    // rcv_nxt; out-of-order data sits at its offset past it.
+    rx_buf: [*]u8,
+    rx_cap: u32,
+    rx_head: u32,
+    rx_count: u32, // in-order bytes available
+    ooo: [MAX_SACK_BLOCKS]SeqRange, // out-of-order ranges, most recent first
+    ooo_count: u8,
+    // Transmit ring: tx_len bytes from snd_una on, sent or not
+    tx_buf: [*]u8,
+    tx_cap: u32,
+    tx_head: u32, // offset of snd_una
+    tx_len: u32,
+    fin_queued: bool,
+    fin_sent: bool,
+    // Congestion control and SACK scoreboard
+    cwnd: u32,
+    ssthresh: u32,
+    dupacks: u8,
+    in_recovery: bool,
+    recover: u32,
+    rtx_nxt: u32, // next sequence loss recovery retransmits
+    sacked: [MAX_SACK_BLOCKS]SeqRange,
+    sacked_count: u8,
+    // RTT estimate in ticks, srtt scaled by 8 (0 = no sample) and rttvar by 4
+    srtt: u32,
+    rttvar: u32,
+    rtt_seq: u32, // segment being timed when there are no timestamps
+    rtt_tick: u32,
+    rtt_timing: bool,
+    // Receive buffer autotuning: bytes delivered since rcv_mark, and the
+    // round trip seen from echoed timestamps (scaled by 8)
+    rcv_bytes: u32,
+    rcv_mark: u32,
+    rcv_rtt: u32,
     retransmit_tick: u32,
     retransmit_count: u8,
     rto: u32,
@@ -79,6 +166,10 @@ pub const SendFn = *const fn (dst_ip: [4]u8, tcp_segment: []const u8) void;
 pub const GetIpFn = *const fn () [4]u8;
 /// Callback to get current tick count.
 pub const GetTicksFn = *const fn () u32;
+/// Buffer memory callbacks. Sizes are powers of two, at least MIN_BUF_SIZE;
+/// free gets the size that was passed to alloc.
+pub const BufAllocFn = *const fn (len: usize) ?[*]u8;
+pub const BufFreeFn = *const fn (ptr: [*]u8, len: usize) void;
 
 pub const TcpStack = struct {
     connections: [MAX_CONNECTIONS]Connection,
@@ -90,6 +181,8 @@ pub const TcpStack = struct {
     getIpFn: GetIpFn,
     getTicksFn: GetTicksFn,
     waiter_cb: ?WaiterCallback,
+    buf_alloc: ?BufAllocFn,
+    buf_free: ?BufFreeFn,
     /// TCP statistics counters
     segments_tx: u64,
     segments_rx: u64,
@@ -103,6 +196,8 @@ pub const TcpStack = struct {
         stack.getIpFn = get_ip_fn;
         stack.getTicksFn = get_ticks_fn;
         stack.waiter_cb = null;
+        stack.buf_alloc = null;
+        stack.buf_free = null;
         stack.next_ephemeral_port = 49152;
         stack.seq_counter = 1000;
         stack.max_connections = 32;
@@ -112,6 +207,8 @@ pub const TcpStack = struct {
         stack.active_opens = 0;
         stack.passive_opens = 0;
         for (&stack.connections) |*c| {
+            c.rx_cap = 0;
+            c.tx_cap = 0;
             resetConn(c);
         }
         for (&stack.conn_hash) |*h| {
@@ -120,6 +217,11 @@ pub const TcpStack = struct {
         return stack;
     }
 
+    /// Release every connection's buffers. The stack itself is caller-owned.
+    pub fn deinit(self: *TcpStack) void {
+        for (&self.connections) |*c| self.freeBuffers(c);
+    }
+
     pub fn setWaiterCallback(self: *TcpStack, cb: WaiterCallback) void {
         self.waiter_cb = cb;
     }
@@ -128,6 +230,13 @@ pub const TcpStack = struct {
         self.max_connections = @min(max, MAX_CONNECTIONS);
     }
 
+    /// Set where connection buffers come from. Without an allocator,
+    /// connect and accept fail.
+    pub fn setBufferAllocator(self: *TcpStack, alloc_fn: BufAllocFn, free_fn: BufFreeFn) void {
+        self.buf_alloc = alloc_fn;
+        self.buf_free = free_fn;
+    }
+
     // ── Public API ──────────────────────────────────────────────
 
     pub fn alloc(self: *TcpStack) ?u8 {
@@ -168,11 +277,17 @@ pub const TcpStack = struct {
         if (idx >= self.max_connections) return false;
         const c = &self.connections[idx];
         if (!c.in_use or c.state != .closed) return false;
+        if (!self.allocBuffers(c)) return false;
 
         c.remote_ip = ip;
         c.remote_port = port;
         c.snd_una = self.nextSeq();
         c.snd_nxt = c.snd_una;
+        // Offer everything; the SYN-ACK decides what sticks.
+        c.ws_ok = true;
+        c.rcv_wscale = WINDOW_SHIFT;
+        c.sack_ok = true;
+        c.ts_ok = true;
 
         self.sendSynPkt(c);
         c.snd_nxt = c.snd_una +% 1;
@@ -199,14 +314,14 @@ pub const TcpStack = struct {
         const c = &self.connections[idx];
         if (c.state != .established and c.state != .close_wait) return 0;
 
-        const available = TX_BUF_SIZE - c.tx_len;
-        const to_send: u16 = @intCast(@min(data.len, available));
+        if (c.tx_cap - c.tx_len < data.len) self.growTx(c);
+        const to_send: u32 = @intCast(@min(data.len, c.tx_cap - c.tx_len, 0xFFFF));
         if (to_send == 0) return 0;
 
-        @memcpy(c.tx_buf[c.tx_len..][0..to_send], data[0..to_send]);
+        ringWrite(c.tx_buf, c.tx_cap, c.tx_head +% c.tx_len, data[0..to_send]);
         c.tx_len += to_send;
-        self.sendDataSegment(c);
-        return to_send;
+        self.trySend(c);
+        return @intCast(to_send);
     }
 
     pub fn recvData(self: *TcpStack, idx: u8, buf: []u8) u16 {
@@ -215,20 +330,16 @@ pub const TcpStack = struct {
         if (c.rx_count == 0) return 0;
 
         const old_count = c.rx_count;
-        const to_copy: u16 = @intCast(@min(buf.len, c.rx_count));
-        const read_pos = (c.rx_head -% c.rx_count) % RX_BUF_SIZE;
-        var i: u16 = 0;
-        while (i < to_copy) : (i += 1) {
-            buf[i] = c.rx_buf[(read_pos + i) % RX_BUF_SIZE];
-        }
+        const to_copy: u32 = @intCast(@min(buf.len, c.rx_count, 0xFFFF));
+        ringRead(c.rx_buf, c.rx_cap, c.rx_head -% c.rx_count, buf[0..to_copy]);
         c.rx_count -= to_copy;
 
-        const was_full = old_count > RX_BUF_SIZE / 2;
-        const now_has_room = c.rx_count <= RX_BUF_SIZE / 2;
+        const was_full = old_count > c.rx_cap / 2;
+        const now_has_room = c.rx_count <= c.rx_cap / 2;
         if (c.state == .established and was_full and now_has_room) {
             self.sendAckPkt(c);
         }
-        return to_copy;
+        return @intCast(to_copy);
     }
 
     pub fn hasData(self: *const TcpStack, idx: u8) bool {
@@ -243,17 +354,20 @@ pub const TcpStack = struct {
             c.state == .last_ack or c.state == .time_wait or c.state == .closed;
     }
 
+    /// Close our side. The FIN goes out once all queued data has been sent.
     pub fn startClose(self: *TcpStack, idx: u8) void {
         if (idx >= self.max_connections) return;
         const c = &self.connections[idx];
         switch (c.state) {
             .established => {
-                self.sendFinPkt(c);
+                c.fin_queued = true;
                 c.state = .fin_wait_1;
+                self.trySend(c);
             },
             .close_wait => {
-                self.sendFinPkt(c);
+                c.fin_queued = true;
                 c.state = .last_ack;
+                self.trySend(c);
             },
             .syn_sent, .syn_received => {
                 self.notifyWaiters(idx, .error_reset);
@@ -287,6 +401,7 @@ pub const TcpStack = struct {
 
         if (!verifyChecksum(payload, ip_hdr)) return;
 
+        const opts = parseOptions(payload[HEADER_SIZE..data_offset]);
         const data = payload[data_offset..];
 
         // Hash lookup for established connections
@@ -296,7 +411,7 @@ pub const TcpStack = struct {
                 c.remote_port == src_port and
                 ipv4.ipEqual(c.remote_ip, ip_hdr.src))
             {
-                self.handleSegment(c, idx, seq_num, ack_num, flags, window, data);
+                self.handleSegment(c, idx, seq_num, ack_num, flags, window, data, &opts);
                 return;
             }
         }
@@ -304,7 +419,7 @@ pub const TcpStack = struct {
         // Linear scan for listeners
         for (self.connections[0..self.max_connections], 0..) |*c, i| {
             if (c.in_use and c.state == .listen and c.local_port == dst_port) {
-                self.handleListenSegment(c, @intCast(i), seq_num, flags, ip_hdr, src_port);
+                self.handleListenSegment(c, @intCast(i), seq_num, flags, ip_hdr, src_port, &opts);
                 return;
             }
         }
@@ -331,36 +446,30 @@ pub const TcpStack = struct {
                             self.sendSynPkt(c);
                             c.retransmit_count += 1;
                             c.retransmit_tick = now;
-                            c.rto *= 2;
+                            c.rto = @min(c.rto * 2, MAX_RTO);
                             self.retransmits += 1;
                         }
                     }
                 },
-                .established, .close_wait => {
-                    if (c.tx_len > 0 and seqDiff(c.snd_nxt, c.snd_una) > 0) {
-                        if (now -% c.retransmit_tick >= c.rto) {
-                            if (c.retransmit_count >= MAX_RETRIES) {
+                .established, .close_wait, .fin_wait_1, .last_ack, .closing => {
+                    if (c.snd_nxt != c.snd_una and now -% c.retransmit_tick >= c.rto) {
+                        if (c.retransmit_count >= MAX_RETRIES) {
+                            if (c.state == .established or c.state == .close_wait) {
                                 self.notifyWaiters(idx, .error_reset);
                                 self.sendRstPkt(c);
-                                self.freeConn(c, idx);
-                            } else {
-                                self.sendDataSegment(c);
-                                c.retransmit_count += 1;
-                                c.retransmit_tick = now;
-                                self.retransmits += 1;
                             }
-                        }
-                    }
-                },
-                .fin_wait_1, .last_ack, .closing => {
-                    if (now -% c.retransmit_tick >= c.rto) {
-                        if (c.retransmit_count >= MAX_RETRIES) {
                             self.freeConn(c, idx);
                         } else {
-                            self.sendFinPkt(c);
+                            if (dataSent(c) > 0) {
+                                self.enterRecovery(c, true);
+                            } else {
+                                // Only our FIN is outstanding
+                                self.sendFlagsPkt(c, FIN | ACK, c.snd_nxt -% 1);
+                                self.retransmits += 1;
+                            }
                             c.retransmit_count += 1;
                             c.retransmit_tick = now;
-                            self.retransmits += 1;
+                            c.rto = @min(c.rto * 2, MAX_RTO);
                         }
                     }
                 },
@@ -376,7 +485,7 @@ pub const TcpStack = struct {
 
     // ── Internal ────────────────────────────────────────────────
 
-    fn handleSegment(self: *TcpStack, c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window: u16, data: []const u8) void {
+    fn handleSegment(self: *TcpStack, c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window: u16, data: []const u8, opts: *const Options) void {
         if (flags & RST != 0) {
             self.notifyWaiters(idx, .error_reset);
             self.freeConn(c, idx);
@@ -388,122 +497,291 @@ pub const TcpStack = struct {
                 if (flags & SYN != 0 and flags & ACK != 0 and ack == c.snd_nxt) {
                     c.rcv_nxt = seq +% 1;
                     c.snd_una = ack;
-                    c.snd_wnd = window;
+                    applySynOptions(c, opts);
+                    c.snd_wnd = window; // never scaled on a SYN
                     c.state = .established;
-                    c.retransmit_count = 0;
                     c.rto = INITIAL_RTO;
+                    if (c.retransmit_count == 0) rttSample(c, self.getTicksFn() -% c.retransmit_tick);
+                    c.retransmit_count = 0;
                     c.tx_len = 0;
                     self.sendAckPkt(c);
                     self.notifyWaiters(idx, .connect_done);
                 }
             },
             .syn_received => {
-                if (flags & ACK != 0 and ack == c.snd_nxt) {
+                if (flags & SYN != 0 and flags & ACK == 0) {
+                    // Our SYN-ACK was lost and the peer retried its SYN
+                    self.sendFlagsPkt(c, SYN | ACK, c.snd_una);
+                } else if (flags & ACK != 0 and ack == c.snd_nxt) {
                     c.snd_una = ack;
-                    c.snd_wnd = window;
+                    c.snd_wnd = @as(u32, window) << @intCast(c.snd_wscale);
                     c.state = .established;
-                    c.retransmit_count = 0;
                     c.rto = INITIAL_RTO;
+                    if (c.retransmit_count == 0) rttSample(c, self.getTicksFn() -% c.retransmit_tick);
+                    c.retransmit_count = 0;
                     if (c.parent_idx != 0xFF and c.parent_idx < self.max_connections) {
                         self.notifyWaiters(c.parent_idx, .accept_ready);
                     }
+                    // The handshake ACK may already carry data
+                    if (data.len > 0 or flags & FIN != 0) {
+                        self.handleEstablished(c, idx, seq, ack, flags, window, data, opts);
+                    }
                 }
             },
-            .established => self.handleEstablished(c, idx, seq, ack, flags, window, data),
+            .established, .fin_wait_1, .fin_wait_2, .close_wait, .closing, .last_ack => {
+                self.handleEstablished(c, idx, seq, ack, flags, window, data, opts);
+            },
+            else => {},
+        }
+    }
+
+    /// Segment on a synchronized connection: ACK processing, receive, and
+    /// the close-side state transitions.
+    fn handleEstablished(self: *TcpStack, c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window: u16, data: []const u8, opts: *const Options) void {
+        // RFC 7323 §4.3: echo the TSval of the latest segment at or before rcv_nxt
+        if (c.ts_ok and opts.has_ts and seqDiff(seq, c.rcv_nxt) <= 0) c.ts_recent = opts.ts_val;
+
+        if (flags & ACK != 0) self.processAck(c, ack, window, data.len, opts);
+
+        var fin = false;
+        const receiving = c.state == .established or c.state == .fin_wait_1 or c.state == .fin_wait_2;
+        if (receiving and (data.len > 0 or flags & FIN != 0)) {
+            if (data.len > 0) self.receiveData(c, idx, seq, data, opts);
+            // FIN only counts once everything before it has arrived
+            if (flags & FIN != 0 and seq +% @as(u32, @intCast(data.len)) == c.rcv_nxt) {
+                c.rcv_nxt +%= 1;
+                fin = true;
+            }
+            self.sendAckPkt(c);
+        }
+
+        const fin_acked = c.fin_sent and c.snd_una == c.snd_nxt;
+        switch (c.state) {
+            .established => if (fin) {
+                c.state = .close_wait;
+                self.notifyWaiters(idx, .eof);
+            },
             .fin_wait_1 => {
-                if (flags & ACK != 0 and ack == c.snd_nxt) c.snd_una = ack;
-                if (flags & FIN != 0) {
-                    c.rcv_nxt = seq +% 1;
-                    self.sendAckPkt(c);
-                    c.state = if (c.snd_una == c.snd_nxt) .time_wait else .closing;
+                if (fin) {
+                    c.state = if (fin_acked) .time_wait else .closing;
                     if (c.state == .time_wait) c.retransmit_tick = self.getTicksFn();
-                } else if (c.snd_una == c.snd_nxt) {
+                } else if (fin_acked) {
                     c.state = .fin_wait_2;
                 }
             },
-            .fin_wait_2 => {
-                if (flags & FIN != 0) {
-                    c.rcv_nxt = seq +% 1;
-                    self.sendAckPkt(c);
-                    c.state = .time_wait;
-                    c.retransmit_tick = self.getTicksFn();
-                }
+            .fin_wait_2 => if (fin) {
+                c.state = .time_wait;
+                c.retransmit_tick = self.getTicksFn();
             },
-            .closing => {
-                if (flags & ACK != 0 and ack == c.snd_nxt) {
-                    c.state = .time_wait;
-                    c.retransmit_tick = self.getTicksFn();
-                }
-            },
-            .last_ack => {
-                if (flags & ACK != 0 and ack == c.snd_nxt) {
-                    self.freeConn(c, idx);
-                }
-            },
-            .close_wait => {
-                if (flags & ACK != 0) self.processAck(c, ack, window);
+            .closing => if (fin_acked) {
+                c.state = .time_wait;
+                c.retransmit_tick = self.getTicksFn();
             },
+            .last_ack => if (fin_acked) self.freeConn(c, idx),
             else => {},
         }
     }
 
-    fn handleEstablished(self: *TcpStack, c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window: u16, data: []const u8) void {
-        if (flags & ACK != 0) self.processAck(c, ack, window);
+    /// Place incoming data in the receive ring. In-order bytes advance
+    /// rcv_nxt (absorbing any out-of-order ranges they reach); bytes past a
+    /// hole stay at their offset and are reported back as SACK blocks.
+    fn receiveData(self: *TcpStack, c: *Connection, idx: u8, seg_seq: u32, seg_data: []const u8, opts: *const Options) void {
+        var seq = seg_seq;
+        var data = seg_data;
+        if (seqDiff(c.rcv_nxt, seq) > 0) {
+            const behind = c.rcv_nxt -% seq;
+            if (behind >= data.len) return; // duplicate
+            data = data[behind..];
+            seq = c.rcv_nxt;
+        }
 
-        if (data.len > 0) {
-            if (seq == c.rcv_nxt) {
-                const space = RX_BUF_SIZE - c.rx_count;
-                const to_buf: u16 = @intCast(@min(data.len, space));
-                var i: u16 = 0;
-                while (i < to_buf) : (i += 1) {
-                    c.rx_buf[c.rx_head] = data[i];
-                    c.rx_head = (c.rx_head + 1) % RX_BUF_SIZE;
+        const off = seq -% c.rcv_nxt;
+        const space = c.rx_cap - c.rx_count;
+        if (off >= space) return;
+        const n: u32 = @intCast(@min(data.len, space - off));
+        ringWrite(c.rx_buf, c.rx_cap, c.rx_head +% off, data[0..n]);
+
+        if (off == 0) {
+            advanceRcv(c, n);
+            self.notifyWaiters(idx, .data_ready);
+        } else {
+            addRange(&c.ooo, &c.ooo_count, .{ .start = seq, .end = seq +% n });
+        }
+        self.tuneRx(c, opts);
+    }
+
+    /// Receive buffer autotuning: when the peer delivers more than half the
+    /// buffer within one round trip, the window is what limits it, so the
+    /// buffer doubles.
+    fn tuneRx(self: *TcpStack, c: *Connection, opts: *const Options) void {
+        const now = self.getTicksFn();
+        if (c.ts_ok and opts.has_ts and opts.ts_ecr != 0) {
+            const sample = @max(now -% opts.ts_ecr, 1);
+            c.rcv_rtt = if (c.rcv_rtt == 0) sample << 3 else c.rcv_rtt - (c.rcv_rtt >> 3) + sample;
+        }
+        const rtt8 = if (c.rcv_rtt != 0) c.rcv_rtt else if (c.srtt != 0) c.srtt else INITIAL_RTO << 3;
+        if (now -% c.rcv_mark < @max(rtt8 >> 3, 1)) return;
+        if (c.rcv_bytes > c.rx_cap / 2) self.growRx(c);
+        c.rcv_bytes = 0;
+        c.rcv_mark = now;
+    }
+
+    fn processAck(self: *TcpStack, c: *Connection, ack: u32, window: u16, data_len: usize, opts: *const Options) void {
+        if (seqDiff(ack, c.snd_nxt) > 0) return; // acks data we never sent
+        const wnd = @as(u32, window) << @intCast(c.snd_wscale);
+        const seg = segSize(c);
+        if (c.sack_ok) updateScoreboard(c, opts);
+
+        if (seqDiff(ack, c.snd_una) <= 0) {
+            if (ack != c.snd_una) return; // stale
+            // Duplicate ACK (RFC 5681 §2): no progress, no data, same window,
+            // something outstanding.
+            if (data_len == 0 and wnd == c.snd_wnd and c.snd_nxt != c.snd_una) {
+                c.dupacks +|= 1;
+                if (c.in_recovery) {
+                    c.cwnd += seg;
+                    if (c.sack_ok) self.retransmitHole(c);
+                } else if (c.dupacks == DUPACK_THRESHOLD and dataSent(c) > 0) {
+                    self.enterRecovery(c, false);
                 }
-                c.rx_count += to_buf;
-                c.rcv_nxt +%= @as(u32, to_buf);
-                self.notifyWaiters(idx, .data_ready);
             }
-            self.sendAckPkt(c);
+            c.snd_wnd = wnd; // may be a window update
+            self.trySend(c);
+            return;
         }
 
-        if (flags & FIN != 0) {
-            if (seq == c.rcv_nxt or (data.len > 0 and seq +% @as(u32, @intCast(data.len)) == c.rcv_nxt)) {
-                c.rcv_nxt +%= 1;
+        const now = self.getTicksFn();
+        var acked = ack -% c.snd_una;
+        if (c.fin_sent and ack == c.snd_nxt) acked -= 1; // the FIN takes no buffer space
+        acked = @min(acked, c.tx_len);
+        if (c.tx_cap != 0) c.tx_head = (c.tx_head + acked) & (c.tx_cap - 1);
+        c.tx_len -= acked;
+        c.snd_una = ack;
+        c.snd_wnd = wnd;
+        c.dupacks = 0;
+        pruneScoreboard(c);
+        if (seqDiff(c.rtx_nxt, ack) < 0) c.rtx_nxt = ack;
+
+        // Timestamps give a sample for every ACK, retransmitted or not;
+        // otherwise time one segment at a time (Karn).
+        if (c.ts_ok and opts.has_ts and opts.ts_ecr != 0) {
+            rttSample(c, now -% opts.ts_ecr);
+        } else if (c.rtt_timing and seqDiff(ack, c.rtt_seq) >= 0) {
+            rttSample(c, now -% c.rtt_tick);
+        }
+        if (c.rtt_timing and seqDiff(ack, c.rtt_seq) >= 0) c.rtt_timing = false;
+
+        if (c.in_recovery) {
+            if (seqDiff(ack, c.recover) >= 0) {
+                c.in_recovery = false;
+                c.cwnd = @max(@min(c.cwnd, c.ssthresh), seg);
+            } else {
+                // Partial ACK (RFC 6582): the next hole is lost too
+                self.retransmitHole(c);
             }
-            self.sendAckPkt(c);
-            c.state = .close_wait;
-            self.notifyWaiters(idx, .eof);
-        }
-    }
-
-    fn processAck(self: *TcpStack, c: *Connection, ack: u32, window: u16) void {
-        c.snd_wnd = window;
-        if (seqDiff(ack, c.snd_una) > 0 and seqDiff(ack, c.snd_nxt) <= 0) {
-            const acked = ack -% c.snd_una;
-            c.snd_una = ack;
-            if (acked <= c.tx_len) {
-                const remaining = c.tx_len - @as(u16, @intCast(acked));
-                if (remaining > 0) {
-                    var i: u16 = 0;
-                    while (i < remaining) : (i += 1) {
-                        c.tx_buf[i] = c.tx_buf[@as(u16, @intCast(acked)) + i];
-                    }
+        } else if (c.cwnd < c.ssthresh) {
+            c.cwnd += @min(acked, seg); // slow start
+        } else {
+            c.cwnd += @max(seg * seg / c.cwnd, 1); // congestion avoidance
+        }
+        c.cwnd = @min(c.cwnd, MAX_BUF_SIZE);
+
+        c.retransmit_count = 0;
+        c.retransmit_tick = now;
+        self.trySend(c);
+    }
+
+    /// Loss detected: halve the window (RFC 5681 eq. 4) and retransmit from
+    /// snd_una. On a timeout the window collapses to one segment and the
+    /// SACK scoreboard is dropped, since the receiver may have reneged.
+    fn enterRecovery(self: *TcpStack, c: *Connection, timeout: bool) void {
+        const seg = segSize(c);
+        c.ssthresh = @max((c.snd_nxt -% c.snd_una) / 2, 2 * seg);
+        c.cwnd = if (timeout) seg else c.ssthresh + DUPACK_THRESHOLD * seg;
+        c.in_recovery = true;
+        c.recover = c.snd_nxt;
+        c.rtx_nxt = c.snd_una;
+        c.rtt_timing = false;
+        if (timeout) {
+            c.sacked_count = 0;
+            c.dupacks = 0;
+        }
+        self.retransmitHole(c);
+    }
+
+    /// Retransmit the first sent, unacknowledged, un-SACKed segment at or
+    /// after rtx_nxt.
+    fn retransmitHole(self: *TcpStack, c: *Connection) void {
+        const end = c.snd_una +% dataSent(c);
+        var seq = if (seqDiff(c.rtx_nxt, c.snd_una) > 0) c.rtx_nxt else c.snd_una;
+        var moved = true;
+        while (moved) {
+            moved = false;
+            for (c.sacked[0..c.sacked_count]) |r| {
+                if (seqDiff(r.start, seq) <= 0 and seqDiff(r.end, seq) > 0) {
+                    seq = r.end;
+                    moved = true;
                 }
-                c.tx_len = remaining;
-            } else {
-                c.tx_len = 0;
             }
-            c.retransmit_count = 0;
-            c.rto = INITIAL_RTO;
-            c.retransmit_tick = self.getTicksFn();
+        }
+        if (seqDiff(seq, end) >= 0) return;
+
+        var limit = end;
+        for (c.sacked[0..c.sacked_count]) |r| {
+            if (seqDiff(r.start, seq) > 0 and seqDiff(r.start, limit) < 0) limit = r.start;
+        }
+        const len = @min(limit -% seq, segSize(c));
+        self.sendSegment(c, seq, len);
+        c.rtx_nxt = seq +% len;
+        self.retransmits += 1;
+    }
+
+    /// Send as much unsent data as the peer's window and cwnd allow, then a
+    /// queued FIN once everything before it is out.
+    fn trySend(self: *TcpStack, c: *Connection) void {
+        const seg = segSize(c);
+        while (true) {
+            const sent = dataSent(c);
+            if (sent >= c.tx_len) break;
+            const flight = c.snd_nxt -% c.snd_una;
+            const wnd = @min(c.snd_wnd, c.cwnd);
+            if (flight >= wnd) break;
+            const unsent = c.tx_len - sent;
+            const len = @min(unsent, seg, wnd - flight);
+            // Sender-side silly window avoidance (RFC 1122 §4.2.3.4)
+            if (len < seg and len < unsent and flight > 0) break;
+
+            const now = self.getTicksFn();
+            if (flight == 0) c.retransmit_tick = now;
+            if (!c.rtt_timing) {
+                c.rtt_timing = true;
+                c.rtt_seq = c.snd_nxt +% len;
+                c.rtt_tick = now;
+            }
+            self.sendSegment(c, c.snd_nxt, len);
+            c.snd_nxt +%= len;
+        }
+
+        if (c.fin_queued and !c.fin_sent and dataSent(c) == c.tx_len) {
+            if (c.snd_nxt == c.snd_una) {
+                c.retransmit_tick = self.getTicksFn();
+                c.retransmit_count = 0;
+            }
+            self.sendFlagsPkt(c, FIN | ACK, c.snd_nxt);
+            c.snd_nxt +%= 1;
+            c.fin_sent = true;
         }
     }
 
-    fn handleListenSegment(self: *TcpStack, listener: *Connection, listener_idx: u8, seq: u32, flags: u8, ip_hdr: ipv4.Header, src_port: u16) void {
+    fn handleListenSegment(self: *TcpStack, listener: *Connection, listener_idx: u8, seq: u32, flags: u8, ip_hdr: ipv4.Header, src_port: u16, opts: *const Options) void {
         if (flags & SYN == 0 or flags & ACK != 0 or flags & RST != 0) return;
 
         const child_idx = self.alloc() orelse return;
         const child = &self.connections[child_idx];
+        if (!self.allocBuffers(child)) {
+            resetConn(child);
+            return;
+        }
         child.local_port = listener.local_port;
         child.local_ip = listener.local_ip;
         child.remote_ip = ip_hdr.src;
@@ -514,12 +792,75 @@ pub const TcpStack = struct {
         child.state = .syn_received;
         child.parent_idx = listener_idx;
         child.retransmit_tick = self.getTicksFn();
+        // Agree to whatever the SYN offered
+        child.ws_ok = true;
+        child.sack_ok = true;
+        child.ts_ok = true;
+        applySynOptions(child, opts);
 
         self.hashInsert(child_idx);
         self.sendFlagsPkt(child, SYN | ACK, child.snd_una);
         self.passive_opens += 1;
     }
 
+    // ── Buffers ─────────────────────────────────────────────────
+
+    fn allocBuffers(self: *TcpStack, c: *Connection) bool {
+        const alloc_fn = self.buf_alloc orelse return false;
+        if (c.rx_cap == 0) {
+            c.rx_buf = alloc_fn(MIN_BUF_SIZE) orelse return false;
+            c.rx_cap = MIN_BUF_SIZE;
+        }
+        if (c.tx_cap == 0) {
+            c.tx_buf = alloc_fn(MIN_BUF_SIZE) orelse {
+                self.freeBuffers(c);
+                return false;
+            };
+            c.tx_cap = MIN_BUF_SIZE;
+        }
+        return true;
+    }
+
+    fn freeBuffers(self: *TcpStack, c: *Connection) void {
+        if (self.buf_free) |free_fn| {
+            if (c.rx_cap != 0) free_fn(c.rx_buf, c.rx_cap);
+            if (c.tx_cap != 0) free_fn(c.tx_buf, c.tx_cap);
+        }
+        c.rx_cap = 0;
+        c.tx_cap = 0;
+    }
+
+    /// Double the receive ring. The copy starts at the read position and
+    /// covers the whole old ring, so out-of-order data keeps its offset.
+    fn growRx(self: *TcpStack, c: *Connection) void {
+        // Without window scaling the peer can't use more than 64 KB.
+        const limit: u32 = if (c.rcv_wscale != 0) MAX_BUF_SIZE else 65536;
+        const new_cap = c.rx_cap * 2;
+        if (c.rx_cap == 0 or new_cap > limit) return;
+        const alloc_fn = self.buf_alloc orelse return;
+        const buf = alloc_fn(new_cap) orelse return;
+        ringRead(c.rx_buf, c.rx_cap, c.rx_head -% c.rx_count, buf[0..c.rx_cap]);
+        if (self.buf_free) |free_fn| free_fn(c.rx_buf, c.rx_cap);
+        c.rx_buf = buf;
+        c.rx_head = c.rx_count;
+        c.rx_cap = new_cap;
+    }
+
+    /// Double the send ring while it is smaller than twice what the network
+    /// can hold in flight (min of cwnd and the peer's window).
+    fn growTx(self: *TcpStack, c: *Connection) void {
+        const new_cap = c.tx_cap * 2;
+        if (c.tx_cap == 0 or new_cap > MAX_BUF_SIZE) return;
+        if (c.tx_cap >= 2 * @min(c.cwnd, c.snd_wnd)) return;
+        const alloc_fn = self.buf_alloc orelse return;
+        const buf = alloc_fn(new_cap) orelse return;
+        ringRead(c.tx_buf, c.tx_cap, c.tx_head, buf[0..c.tx_len]);
+        if (self.buf_free) |free_fn| free_fn(c.tx_buf, c.tx_cap);
+        c.tx_buf = buf;
+        c.tx_head = 0;
+        c.tx_cap = new_cap;
+    }
+
     // ── Segment building ────────────────────────────────────────
 
     fn sendSynPkt(self: *TcpStack, c: *Connection) void {
@@ -530,50 +871,99 @@ pub const TcpStack = struct {
         self.sendFlagsPkt(c, ACK, c.snd_nxt);
     }
 
-    fn sendFinPkt(self: *TcpStack, c: *Connection) void {
-        self.sendFlagsPkt(c, FIN | ACK, c.snd_nxt);
-        c.snd_nxt = c.snd_nxt +% 1;
-        c.retransmit_tick = self.getTicksFn();
-        c.retransmit_count = 0;
-    }
-
     fn sendRstPkt(self: *TcpStack, c: *Connection) void {
         self.sendFlagsPkt(c, RST | ACK, c.snd_nxt);
     }
 
     fn sendFlagsPkt(self: *TcpStack, c: *Connection, flags: u8, seq: u32) void {
-        var tcp_buf: [HEADER_SIZE]u8 = undefined;
-        const window = RX_BUF_SIZE - c.rx_count;
-        buildHeader(&tcp_buf, c.local_port, c.remote_port, seq, c.rcv_nxt, flags, window, 0);
-        const cksum = tcpChecksum(c.local_ip, c.remote_ip, &tcp_buf);
+        var tcp_buf: [MAX_HEADER_SIZE]u8 = undefined;
+        const hdr_len = self.writeOptions(c, &tcp_buf, flags, true);
+        buildHeader(&tcp_buf, hdr_len, c.local_port, c.remote_port, seq, c.rcv_nxt, flags, rcvWindow(c, flags & SYN != 0), 0);
+        const cksum = tcpChecksum(c.local_ip, c.remote_ip, tcp_buf[0..hdr_len]);
         ipv4.writeBe16(&tcp_buf, 16, cksum);
-        self.sendFn(c.remote_ip, &tcp_buf);
+        self.sendFn(c.remote_ip, tcp_buf[0..hdr_len]);
         self.segments_tx += 1;
     }
 
-    fn sendDataSegment(self: *TcpStack, c: *Connection) void {
-        if (c.tx_len == 0) return;
-        const send_len: u16 = @intCast(@min(c.tx_len, c.mss));
-        var tcp_buf: [HEADER_SIZE + TX_BUF_SIZE]u8 = undefined;
-        const total_len = HEADER_SIZE + send_len;
-        const window = RX_BUF_SIZE - c.rx_count;
-        buildHeader(tcp_buf[0..HEADER_SIZE], c.local_port, c.remote_port, c.snd_una, c.rcv_nxt, ACK | PSH, window, 0);
-        @memcpy(tcp_buf[HEADER_SIZE..][0..send_len], c.tx_buf[0..send_len]);
+    /// Send `len` bytes of the transmit ring starting at sequence `seq`.
+    fn sendSegment(self: *TcpStack, c: *Connection, seq: u32, len: u32) void {
+        var tcp_buf: [MAX_HEADER_SIZE + DEFAULT_MSS]u8 = undefined;
+        const hdr_len = self.writeOptions(c, &tcp_buf, ACK, false);
+        const off = seq -% c.snd_una;
+        const flags: u8 = if (off + len == c.tx_len) ACK | PSH else ACK;
+        buildHeader(&tcp_buf, hdr_len, c.local_port, c.remote_port, seq, c.rcv_nxt, flags, rcvWindow(c, false), 0);
+        ringRead(c.tx_buf, c.tx_cap, c.tx_head +% off, tcp_buf[hdr_len..][0..len]);
+        const total_len = hdr_len + len;
         const cksum = tcpChecksum(c.local_ip, c.remote_ip, tcp_buf[0..total_len]);
         ipv4.writeBe16(&tcp_buf, 16, cksum);
-        c.snd_nxt = c.snd_una +% @as(u32, send_len);
-        c.retransmit_tick = self.getTicksFn();
         self.sendFn(c.remote_ip, tcp_buf[0..total_len]);
         self.segments_tx += 1;
     }
 
+    /// Write the options for an outgoing segment after the fixed header:
+    /// the negotiable set on SYNs, timestamps once agreed, and SACK blocks
+    /// on pure ACKs. Returns the header length.
+    fn writeOptions(self: *TcpStack, c: *const Connection, buf: []u8, flags: u8, with_sack: bool) usize {
+        if (flags & RST != 0) return HEADER_SIZE;
+        var n: usize = HEADER_SIZE;
+        const syn = flags & SYN != 0;
+        if (syn) {
+            buf[n] = OPT_MSS;
+            buf[n + 1] = 4;
+            ipv4.writeBe16(buf, n + 2, DEFAULT_MSS);
+            n += 4;
+            if (c.ws_ok) {
+                buf[n] = OPT_NOP;
+                buf[n + 1] = OPT_WSCALE;
+                buf[n + 2] = 3;
+                buf[n + 3] = WINDOW_SHIFT;
+                n += 4;
+            }
+            if (c.sack_ok and !c.ts_ok) {
+                buf[n] = OPT_NOP;
+                buf[n + 1] = OPT_NOP;
+                buf[n + 2] = OPT_SACK_PERM;
+                buf[n + 3] = 2;
+                n += 4;
+            }
+        }
+        if (c.ts_ok) {
+            if (syn and c.sack_ok) {
+                buf[n] = OPT_SACK_PERM;
+                buf[n + 1] = 2;
+            } else {
+                buf[n] = OPT_NOP;
+                buf[n + 1] = OPT_NOP;
+            }
+            buf[n + 2] = OPT_TIMESTAMP;
+            buf[n + 3] = 10;
+            ipv4.writeBe32(buf, n + 4, self.getTicksFn());
+            ipv4.writeBe32(buf, n + 8, if (flags & ACK != 0) c.ts_recent else 0);
+            n += 12;
+        }
+        if (with_sack and !syn and c.sack_ok and c.ooo_count > 0) {
+            const count: u8 = @min(c.ooo_count, if (c.ts_ok) @as(u8, 3) else MAX_SACK_BLOCKS);
+            buf[n] = OPT_NOP;
+            buf[n + 1] = OPT_NOP;
+            buf[n + 2] = OPT_SACK;
+            buf[n + 3] = 2 + 8 * count;
+            n += 4;
+            for (c.ooo[0..count]) |r| {
+                ipv4.writeBe32(buf, n, r.start);
+                ipv4.writeBe32(buf, n + 4, r.end);
+                n += 8;
+            }
+        }
+        return n;
+    }
+
     fn sendRstReply(self: *TcpStack, dst_ip: [4]u8, dst_port: u16, src_port: u16, seq: u32, ack: u32, in_flags: u8, data_len: u16) void {
         var tcp_buf: [HEADER_SIZE]u8 = undefined;
         if (in_flags & ACK != 0) {
-            buildHeader(&tcp_buf, src_port, dst_port, ack, 0, RST, 0, 0);
+            buildHeader(&tcp_buf, HEADER_SIZE, src_port, dst_port, ack, 0, RST, 0, 0);
         } else {
             const response_ack = seq +% @as(u32, data_len) +% if (in_flags & SYN != 0) @as(u32, 1) else @as(u32, 0);
-            buildHeader(&tcp_buf, src_port, dst_port, 0, response_ack, RST | ACK, 0, 0);
+            buildHeader(&tcp_buf, HEADER_SIZE, src_port, dst_port, 0, response_ack, RST | ACK, 0, 0);
         }
         const our_ip = self.getIpFn();
         const cksum = tcpChecksum(our_ip, dst_ip, &tcp_buf);
@@ -626,6 +1016,7 @@ pub const TcpStack = struct {
 
     fn freeConn(self: *TcpStack, c: *Connection, idx: u8) void {
         self.hashRemove(idx);
+        self.freeBuffers(c);
         resetConn(c);
     }
 
@@ -671,15 +1062,227 @@ fn resetConn(c: *Connection) void {
     c.rcv_nxt = 0;
     c.snd_wnd = DEFAULT_WINDOW;
     c.mss = DEFAULT_MSS;
+    c.ws_ok = false;
+    c.snd_wscale = 0;
+    c.rcv_wscale = 0;
+    c.sack_ok = false;
+    c.ts_ok = false;
+    c.ts_recent = 0;
+    // rx_buf/tx_buf and their capacities belong to allocBuffers/freeBuffers
     c.rx_head = 0;
     c.rx_count = 0;
+    c.ooo_count = 0;
+    c.tx_head = 0;
     c.tx_len = 0;
+    c.fin_queued = false;
+    c.fin_sent = false;
+    c.cwnd = INITIAL_CWND_SEGS * @as(u32, DEFAULT_MSS);
+    c.ssthresh = 0xFFFF_FFFF;
+    c.dupacks = 0;
+    c.in_recovery = false;
+    c.recover = 0;
+    c.rtx_nxt = 0;
+    c.sacked_count = 0;
+    c.srtt = 0;
+    c.rttvar = 0;
+    c.rtt_seq = 0;
+    c.rtt_tick = 0;
+    c.rtt_timing = false;
+    c.rcv_bytes = 0;
+    c.rcv_mark = 0;
+    c.rcv_rtt = 0;
     c.retransmit_tick = 0;
     c.retransmit_count = 0;
     c.rto = INITIAL_RTO;
     c.parent_idx = 0xFF;
 }
 
+/// Settle the options offered in our SYN (ws_ok/sack_ok/ts_ok set) against
+/// what the peer's SYN or SYN-ACK carried.
+fn applySynOptions(c: *Connection, opts: *const Options) void {
+    c.mss = if (opts.mss != 0) @max(@min(opts.mss, DEFAULT_MSS), MIN_MSS) else FALLBACK_MSS;
+    c.ws_ok = c.ws_ok and opts.wscale != null;
+    c.snd_wscale = if (c.ws_ok) opts.wscale.? else 0;
+    c.rcv_wscale = if (c.ws_ok) WINDOW_SHIFT else 0;
+    c.sack_ok = c.sack_ok and opts.sack_permitted;
+    c.ts_ok = c.ts_ok and opts.has_ts;
+    if (c.ts_ok) c.ts_recent = opts.ts_val;
+    c.cwnd = INITIAL_CWND_SEGS * segSize(c);
+}
+
+/// Payload bytes per segment: the MSS less the options every segment carries.
+fn segSize(c: *const Connection) u32 {
+    return @as(u32, c.mss) - if (c.ts_ok) @as(u32, 12) else 0;
+}
+
+/// Bytes of the transmit ring already sent (snd_nxt less a sent FIN).
+fn dataSent(c: *const Connection) u32 {
+    return (c.snd_nxt -% c.snd_una) - @intFromBool(c.fin_sent);
+}
+
+/// Window to advertise: free receive space, scaled except on SYNs.
+fn rcvWindow(c: *const Connection, syn: bool) u16 {
+    const free = c.rx_cap - c.rx_count;
+    const shift: u5 = if (syn) 0 else @intCast(c.rcv_wscale);
+    return @intCast(@min(free >> shift, 0xFFFF));
+}
+
+/// In-order data arrived: advance rcv_nxt by `n`, then over any
+/// out-of-order ranges that are now contiguous.
+fn advanceRcv(c: *Connection, n: u32) void {
+    var extra = n;
+    while (true) {
+        c.rcv_nxt +%= extra;
+        c.rx_count += extra;
+        c.rx_head = (c.rx_head + extra) & (c.rx_cap - 1);
+        c.rcv_bytes += extra;
+
+        extra = 0;
+        var i: usize = 0;
+        while (i < c.ooo_count) {
+            const r = c.ooo[i];
+            if (seqDiff(r.start, c.rcv_nxt) > 0) {
+                i += 1;
+                continue;
+            }
+            removeRange(&c.ooo, &c.ooo_count, i);
+            if (seqDiff(r.end, c.rcv_nxt) > 0) {
+                extra = r.end -% c.rcv_nxt;
+                break;
+            }
+        }
+        if (extra == 0) return;
+    }
+}
+
+/// Add `new` to a range list, merging overlapping or adjacent ranges. The
+/// result goes first (RFC 2018 wants the latest block first); the oldest
+/// range falls off when the list is full.
+fn addRange(ranges: *[MAX_SACK_BLOCKS]SeqRange, count: *u8, new: SeqRange) void {
+    var r = new;
+    var i: usize = 0;
+    while (i < count.*) {
+        const o = ranges[i];
+        if (seqDiff(o.start, r.end) <= 0 and seqDiff(r.start, o.end) <= 0) {
+            if (seqDiff(o.start, r.start) < 0) r.start = o.start;
+            if (seqDiff(o.end, r.end) > 0) r.end = o.end;
+            removeRange(ranges, count, i);
+        } else {
+            i += 1;
+        }
+    }
+    const keep: u8 = @min(count.*, MAX_SACK_BLOCKS - 1);
+    var j: usize = keep;
+    while (j > 0) : (j -= 1) ranges[j] = ranges[j - 1];
+    ranges[0] = r;
+    count.* = keep + 1;
+}
+
+fn removeRange(ranges: *[MAX_SACK_BLOCKS]SeqRange, count: *u8, i: usize) void {
+    var j = i;
+    while (j + 1 < count.*) : (j += 1) ranges[j] = ranges[j + 1];
+    count.* -= 1;
+}
+
+/// Record the SACK blocks of an incoming ACK that cover data in flight.
+fn updateScoreboard(c: *Connection, opts: *const Options) void {
+    for (opts.sack[0..opts.sack_count]) |r| {
+        if (seqDiff(r.end, r.start) <= 0) continue;
+        if (seqDiff(r.start, c.snd_una) < 0 or seqDiff(r.end, c.snd_nxt) > 0) continue;
+        addRange(&c.sacked, &c.sacked_count, r);
+    }
+}
+
+/// Drop scoreboard ranges the cumulative ACK has passed.
+fn pruneScoreboard(c: *Connection) void {
+    var i: usize = 0;
+    while (i < c.sacked_count) {
+        if (seqDiff(c.sacked[i].end, c.snd_una) <= 0) {
+            removeRange(&c.sacked, &c.sacked_count, i);
+            continue;
+        }
+        if (seqDiff(c.sacked[i].start, c.snd_una) < 0) c.sacked[i].start = c.snd_una;
+        i += 1;
+    }
+}
+
+/// Fold an RTT sample (ticks) into srtt/rttvar and recompute the RTO
+/// (RFC 6298 §2).
+fn rttSample(c: *Connection, sample: u32) void {
+    const r = @min(sample, MAX_RTO);
+    if (c.srtt == 0) {
+        c.srtt = @max(r << 3, 1);
+        c.rttvar = r << 1;
+    } else {
+        const srtt = c.srtt >> 3;
+        const err = if (r > srtt) r - srtt else srtt - r;
+        c.rttvar = c.rttvar - (c.rttvar >> 2) + err;
+        c.srtt = @max(c.srtt - (c.srtt >> 3) + r, 1);
+    }
+    c.rto = @min(@max((c.srtt >> 3) + @max(c.rttvar, 1), MIN_RTO), MAX_RTO);
+}
+
+/// Copy `dest.len` bytes out of a power-of-two ring starting at `pos`.
+fn ringRead(ring: [*]const u8, cap: u32, pos: u32, dest: []u8) void {
+    if (dest.len == 0) return;
+    const start = pos & (cap - 1);
+    const first = @min(dest.len, cap - start);
+    @memcpy(dest[0..first], ring[start..][0..first]);
+    @memcpy(dest[first..], ring[0 .. dest.len - first]);
+}
+
+/// Copy `src` into a power-of-two ring starting at `pos`.
+fn ringWrite(ring: [*]u8, cap: u32, pos: u32, src: []const u8) void {
+    if (src.len == 0) return;
+    const start = pos & (cap - 1);
+    const first = @min(src.len, cap - start);
+    @memcpy(ring[start..][0..first], src[0..first]);
+    @memcpy(ring[0 .. src.len - first], src[first..]);
+}
+
+/// Parse the options area of a segment (bytes between the fixed header
+/// and the data offset). Malformed options end the scan.
+pub fn parseOptions(bytes: []const u8) Options {
+    var o: Options = .{};
+    var i: usize = 0;
+    while (i < bytes.len) {
+        const kind = bytes[i];
+        if (kind == OPT_END) break;
+        if (kind == OPT_NOP) {
+            i += 1;
+            continue;
+        }
+        if (i + 1 >= bytes.len) break;
+        const len = bytes[i + 1];
+        if (len < 2 or i + len > bytes.len) break;
+        const body = bytes[i + 2 .. i + len];
+        switch (kind) {
+            OPT_MSS => if (body.len == 2) {
+                o.mss = be16(body[0..2]);
+            },
+            OPT_WSCALE => if (body.len == 1) {
+                o.wscale = @min(body[0], 14); // RFC 7323 §2.3
+            },
+            OPT_SACK_PERM => o.sack_permitted = true,
+            OPT_TIMESTAMP => if (body.len == 8) {
+                o.has_ts = true;
+                o.ts_val = be32(body, 0);
+                o.ts_ecr = be32(body, 4);
+            },
+            OPT_SACK => {
+                var j: usize = 0;
+                while (j + 8 <= body.len and o.sack_count < MAX_SACK_BLOCKS) : (j += 8) {
+                    o.sack[o.sack_count] = .{ .start = be32(body, j), .end = be32(body, j + 4) };
+                    o.sack_count += 1;
+                }
+            },
+            else => {},
+        }
+        i += len;
+    }
+    return o;
+}
+
 fn connHashFn(local_port: u16, remote_port: u16, remote_ip: [4]u8) u8 {
     var h: u32 = 2166136261;
     h ^= local_port;
@@ -696,12 +1299,14 @@ fn seqDiff(a: u32, b: u32) i32 {
     return @as(i32, @bitCast(a -% b));
 }
 
-fn buildHeader(buf: *[HEADER_SIZE]u8, src_port: u16, dst_port: u16, seq: u32, ack: u32, flags: u8, window: u16, urgent: u16) void {
+/// Fill the fixed header; `hdr_len` (a multiple of 4) includes any options
+/// already written after it.
+fn buildHeader(buf: []u8, hdr_len: usize, src_port: u16, dst_port: u16, seq: u32, ack: u32, flags: u8, window: u16, urgent: u16) void {
     ipv4.writeBe16(buf, 0, src_port);
     ipv4.writeBe16(buf, 2, dst_port);
     ipv4.writeBe32(buf, 4, seq);
     ipv4.writeBe32(buf, 8, ack);
-    buf[12] = 0x50;
+    buf[12] = @intCast((hdr_len / 4) << 4);
     buf[13] = flags;
     ipv4.writeBe16(buf, 14, window);
     ipv4.writeBe16(buf, 16, 0);
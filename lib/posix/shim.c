@@ -33,6 +33,10 @@
 #define FX_PIPE      15
 #define FX_CLONE     37
 #define FX_FUTEX     38
+#define FX_CLOCK_NS  44
+#define FX_SLEEP_NS  45
+#define FX_RING_SETUP 48
+#define FX_RING_ENTER 49
 
 /* rfork flags (Plan 9) */
 #define RFPROC       0x01
@@ -58,6 +62,7 @@
 #define LNX_ACCESS         21
 #define LNX_DUP            32
 #define LNX_DUP2           33
+#define LNX_NANOSLEEP      35
 #define LNX_GETPID         39
 #define LNX_FCNTL          72
 #define LNX_GETCWD         79
@@ -185,14 +190,6 @@ struct utsname {
     char domainname[65];
 };
 
-/* Sysinfo structure (matches Fornax) */
-struct fx_sysinfo {
-    unsigned long long total_pages;
-    unsigned long long free_pages;
-    unsigned long long page_size;
-    unsigned long long uptime_secs;
-};
-
 /* Current working directory buffer */
 static char __cwd[256] = "/";
 static int __cwd_len = 1;
@@ -349,9 +346,14 @@ static long __fx_wait4(long pid, long status_ptr, long options) {
     return result;
 }
 
-/* Exec buffer in BSS — large enough for typical ELF binaries */
-static char __exec_buf[4 * 1024 * 1024] __attribute__((section(".bss")));
-
+/*
+ * execve reads the binary into a fresh anonymous mapping sized to the file.
+ * The mapping is page-aligned and zero past the end of the file, so the
+ * kernel adopts its pages for the new image (shared, copy-on-write) instead
+ * of copying them again. On success the old address space — mapping
+ * included — is gone; sysMunmap doesn't reclaim pages, so a failed exec
+ * just leaves it behind.
+ */
 static long __fx_execve(long path_ptr, long argv_ptr, long envp_ptr) {
     (void)envp_ptr;
     const char *path = (const char *)path_ptr;
@@ -367,15 +369,17 @@ static long __fx_execve(long path_ptr, long argv_ptr, long envp_ptr) {
     if (r != 0) { __fx_raw1(FX_CLOSE, fd); return -5; /* EIO */ }
 
     unsigned long file_size = fxs.size;
-    if (file_size > sizeof(__exec_buf)) {
-        __fx_raw1(FX_CLOSE, fd);
-        return -12; /* ENOMEM */
-    }
+    if (file_size == 0) { __fx_raw1(FX_CLOSE, fd); return -8; /* ENOEXEC */ }
+
+    /* PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS */
+    long map = __fx_raw4(FX_MMAP, 0, (long)file_size, 0x3, 0x22);
+    if (map < 0) { __fx_raw1(FX_CLOSE, fd); return -12; /* ENOMEM */ }
+    char *exec_buf = (char *)map;
 
-    /* Read entire file into buffer */
+    /* Read entire file into the mapping */
     unsigned long total = 0;
     while (total < file_size) {
-        long n = __fx_raw3(FX_READ, fd, (long)(__exec_buf + total), (long)(file_size - total));
+        long n = __fx_raw3(FX_READ, fd, (long)(exec_buf + total), (long)(file_size - total));
         if (n <= 0) break;
         total += (unsigned long)n;
     }
@@ -412,7 +416,156 @@ static long __fx_execve(long path_ptr, long argv_ptr, long envp_ptr) {
     __wire_buf[7] = (char)((str_total >> 24) & 0xFF);
 
     /* Call Fornax exec(elf_ptr, elf_len, argv_wire_ptr) */
-    return __fx_raw3(FX_EXEC, (long)__exec_buf, (long)total, (long)__wire_buf);
+    return __fx_raw3(FX_EXEC, (long)exec_buf, (long)total, (long)__wire_buf);
+}
+
+/* ── Submission ring ─────────────────────────────────────────────── */
+
+/*
+ * Calls that turn into several Fornax calls go through the ring instead,
+ * so they cost one trap: stat(path) is open → stat → close as a linked
+ * chain, and readv/writev post one entry per iovec. The ring is set up on
+ * first use. The kernel's ring state is per thread, so once a thread has
+ * been created the shim stops using it; a forked child sets up its own.
+ */
+
+/* Layout must match src/ring.zig */
+#define RING_ENTRIES   16
+#define RING_OP_OPEN    1
+#define RING_OP_READ    2
+#define RING_OP_WRITE   4
+#define RING_OP_STAT    6
+#define RING_OP_CLOSE   7
+#define RING_SQE_LINK   1
+#define RING_FD_LINKED (-1)
+/* Largest read/write the ring does in one entry (inline IPC data) */
+#define RING_MAX_IO  4092
+
+/* Fornax ENOSYS: the operation has to go through the plain syscall */
+#define FX_ENOSYS (-1)
+
+struct fx_ring_hdr {
+    unsigned int sq_head, sq_tail, sq_entries;
+    unsigned int cq_head, cq_tail, cq_entries;
+    unsigned int sqe_off, cqe_off, cq_overflow;
+    unsigned int reserved[7];
+};
+
+struct fx_sqe {
+    unsigned char      op, flags;
+    unsigned short     pad;
+    int                fd;
+    unsigned long long off, addr;
+    unsigned int       len, pad2;
+    unsigned long long user_data;
+};
+
+struct fx_cqe {
+    unsigned long long user_data;
+    long long          res;
+};
+
+static struct fx_ring_hdr *__ring;
+static int __ring_state; /* 0 = not set up yet, 1 = ready, -1 = don't use */
+
+static struct fx_ring_hdr *__ring_get(void)
+{
+    if (__ring_state == 0) {
+        long base = __fx_raw1(FX_RING_SETUP, RING_ENTRIES);
+        __ring_state = base < 0 ? -1 : 1;
+        if (base >= 0) __ring = (struct fx_ring_hdr *)base;
+    }
+    return __ring_state == 1 ? __ring : 0;
+}
+
+static void __ring_push(struct fx_ring_hdr *r, int op, int flags, int fd,
+                        long addr, unsigned long len, int idx)
+{
+    struct fx_sqe *sqes = (struct fx_sqe *)((char *)r + r->sqe_off);
+    struct fx_sqe *sqe = &sqes[r->sq_tail & (r->sq_entries - 1)];
+    __memset(sqe, 0, sizeof(*sqe));
+    sqe->op = (unsigned char)op;
+    sqe->flags = (unsigned char)flags;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)addr;
+    sqe->len = (unsigned int)len;
+    sqe->user_data = (unsigned long long)idx;
+    r->sq_tail++;
+}
+
+/* Submit the n queued entries, wait for all of them, and store each
+ * result in res[] by the index it was pushed with. */
+static void __ring_run(struct fx_ring_hdr *r, int n, long *res)
+{
+    struct fx_cqe *cqes = (struct fx_cqe *)((char *)r + r->cqe_off);
+    if (__fx_raw2(FX_RING_ENTER, n, n) < 0) {
+        /* No ring after all: nothing ran, so fall back for good */
+        __ring_state = -1;
+        for (int i = 0; i < n; i++) res[i] = FX_ENOSYS;
+        return;
+    }
+    for (int i = 0; i < n; i++) res[i] = -5; /* EIO unless completed */
+    while (r->cq_head != r->cq_tail) {
+        struct fx_cqe *cqe = &cqes[r->cq_head & (r->cq_entries - 1)];
+        if (cqe->user_data < (unsigned long long)n) res[cqe->user_data] = (long)cqe->res;
+        r->cq_head++;
+    }
+}
+
+/* stat(path) into a 64-byte Fornax stat buffer. Returns 0, a negative
+ * errno, or FX_ENOSYS when the path needs the plain syscalls. */
+static long __ring_stat_path(const char *path, void *st)
+{
+    struct fx_ring_hdr *r = __ring_get();
+    if (!r) return FX_ENOSYS;
+    long res[3];
+    __ring_push(r, RING_OP_OPEN, RING_SQE_LINK, 0, (long)path, __strlen(path), 0);
+    __ring_push(r, RING_OP_STAT, RING_SQE_LINK, RING_FD_LINKED, (long)st, 64, 1);
+    __ring_push(r, RING_OP_CLOSE, 0, RING_FD_LINKED, 0, 0, 2);
+    __ring_run(r, 3, res);
+    if (res[0] == FX_ENOSYS || res[1] == FX_ENOSYS) return FX_ENOSYS;
+    if (res[0] < 0) return -2; /* ENOENT */
+    return res[1] == 0 ? 0 : -5; /* EIO */
+}
+
+/* readv/writev, one entry per iovec. Writes are linked so the server
+ * applies them in order, and a short or failed write cancels the rest
+ * (ECANCELED, never counted: the loop stops first); reads are posted
+ * together. Returns FX_ENOSYS
+ * when the fd (console, pipe, ...) or the iovecs don't suit the ring. */
+static long __ring_rwv(long fd, const struct iovec *iov, int iovcnt, int write)
+{
+    if (fd <= 2 || iovcnt < 2 || iovcnt > RING_ENTRIES) return FX_ENOSYS;
+    int last = -1;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > RING_MAX_IO) return FX_ENOSYS;
+        if (iov[i].iov_len > 0) last = i;
+    }
+    if (last < 0) return 0;
+    struct fx_ring_hdr *r = __ring_get();
+    if (!r) return FX_ENOSYS;
+
+    long res[RING_ENTRIES];
+    int n = 0;
+    for (int i = 0; i <= last; i++) {
+        if (iov[i].iov_len == 0) continue;
+        __ring_push(r, write ? RING_OP_WRITE : RING_OP_READ,
+                    write && i < last ? RING_SQE_LINK : 0, (int)fd,
+                    (long)iov[i].iov_base, iov[i].iov_len, n++);
+    }
+    __ring_run(r, n, res);
+    if (res[0] == FX_ENOSYS) return FX_ENOSYS;
+
+    long total = 0;
+    n = 0;
+    for (int i = 0; i <= last; i++) {
+        if (iov[i].iov_len == 0) continue;
+        long got = res[n++];
+        if (got < 0) return total > 0 ? total : got;
+        total += got;
+        if ((unsigned long)got < iov[i].iov_len) break; /* short read/write */
+    }
+    return total;
 }
 
 /* ── The main translation function ───────────────────────────────── */
@@ -449,7 +602,9 @@ long __fornax_syscall(long n, long a, long b, long c, long d, long e, long f)
     case LNX_READV: {
         const struct iovec *iov = (const struct iovec *)b;
         int iovcnt = (int)c;
-        long total = 0;
+        long total = __ring_rwv(a, iov, iovcnt, 0);
+        if (total != FX_ENOSYS) return total;
+        total = 0;
         for (int i = 0; i < iovcnt; i++) {
             if (iov[i].iov_len > 0) {
                 long r = __fx_raw3(FX_READ, a, (long)iov[i].iov_base, (long)iov[i].iov_len);
@@ -464,7 +619,9 @@ long __fornax_syscall(long n, long a, long b, long c, long d, long e, long f)
     case LNX_WRITEV: {
         const struct iovec *iov = (const struct iovec *)b;
         int iovcnt = (int)c;
-        long total = 0;
+        long total = __ring_rwv(a, iov, iovcnt, 1);
+        if (total != FX_ENOSYS) return total;
+        total = 0;
         for (int i = 0; i < iovcnt; i++) {
             if (iov[i].iov_len > 0) {
                 long r = __fx_raw3(FX_WRITE, a, (long)iov[i].iov_base, (long)iov[i].iov_len);
@@ -481,6 +638,12 @@ long __fornax_syscall(long n, long a, long b, long c, long d, long e, long f)
         /* stat(path, buf) → open + fstat + close */
         const char *path = (const char *)a;
         struct linux_stat *lbuf = (struct linux_stat *)b;
+        union { struct fx_stat s; char raw[64]; } rst;
+        long rr = __ring_stat_path(path, &rst);
+        if (rr != FX_ENOSYS) {
+            if (rr == 0) fx_to_linux_stat(&rst.s, lbuf);
+            return rr;
+        }
         long fd = __fx_raw2(FX_OPEN, (long)path, __strlen(path));
         if (fd < 0) return -2; /* ENOENT */
         struct fx_stat fxs;
@@ -505,6 +668,12 @@ long __fornax_syscall(long n, long a, long b, long c, long d, long e, long f)
         const char *path = (const char *)b;
         struct linux_stat *lbuf = (struct linux_stat *)c;
         if (a != AT_FDCWD) return -38;
+        union { struct fx_stat s; char raw[64]; } rst;
+        long rr = __ring_stat_path(path, &rst);
+        if (rr != FX_ENOSYS) {
+            if (rr == 0) fx_to_linux_stat(&rst.s, lbuf);
+            return rr;
+        }
         long fd = __fx_raw2(FX_OPEN, (long)path, __strlen(path));
         if (fd < 0) return -2;
         struct fx_stat fxs;
@@ -616,8 +785,11 @@ long __fornax_syscall(long n, long a, long b, long c, long d, long e, long f)
         return __fx_raw1(FX_GETPID, 0);
 
     case LNX_FORK:
-    case LNX_VFORK:
-        return __fx_raw1(FX_RFORK, RFPROC | RFFDG);
+    case LNX_VFORK: {
+        long pid = __fx_raw1(FX_RFORK, RFPROC | RFFDG);
+        if (pid == 0 && __ring_state == 1) __ring_state = 0; /* parent's ring */
+        return pid;
+    }
 
     case LNX_EXECVE:
         return __fx_execve(a, b, c);
@@ -643,16 +815,28 @@ long __fornax_syscall(long n, long a, long b, long c, long d, long e, long f)
         /* Linux: clone(flags, stack, ptid, ctid, tls)
          *        a=flags b=stack c=ptid d=ctid e=tls
          * Fornax: clone(stack, tls, ctid, ptid, flags)
+         * Threads share the shim's ring memory but not the kernel's ring.
          */
+        __ring_state = -1;
         return __fx_raw5(FX_CLONE, b/*stack*/, e/*tls*/, d/*ctid*/, c/*ptid*/, a/*flags*/);
     }
 
     case LNX_FUTEX: {
         /* Linux: futex(addr, op, val, timeout, addr2, val3)
-         *        a=addr b=op c=val d=timeout
-         * Fornax: futex(addr, op, val, timeout)
+         *        a=addr b=op c=val d=timeout e=addr2
+         * Fornax: futex(addr, op, val, timeout_ms, addr2)
+         * FUTEX_WAIT's relative timespec becomes milliseconds (0 = none);
+         * FUTEX_REQUEUE passes its requeue count in the timeout slot.
          */
-        return __fx_raw4(FX_FUTEX, a, b, c, d);
+        long fop = b & 127;
+        if (fop == 0 /*FUTEX_WAIT*/ && d) {
+            const struct { long tv_sec; long tv_nsec; } *ts = (const void *)d;
+            long ms = ts->tv_sec * 1000 + (ts->tv_nsec + 999999) / 1000000;
+            return __fx_raw5(FX_FUTEX, a, b, c, ms > 0 ? ms : 1, 0);
+        }
+        if (fop == 3 /*FUTEX_REQUEUE*/)
+            return __fx_raw5(FX_FUTEX, a, b, c, d, e);
+        return __fx_raw4(FX_FUTEX, a, b, c, 0);
     }
 
     /* ── Signals (stubs) ─────────────────────────────────────────── */
@@ -678,17 +862,25 @@ long __fornax_syscall(long n, long a, long b, long c, long d, long e, long f)
 
     /* ── Time ────────────────────────────────────────────────────── */
     case LNX_CLOCK_GETTIME: {
-        /* clock_gettime(clk_id, tp) */
+        /* clock_gettime(clk_id, tp): every clock is time since boot */
         struct { long tv_sec; long tv_nsec; } *tp = (void *)b;
         if (tp) {
-            struct fx_sysinfo info;
-            __fx_raw1(FX_SYSINFO, (long)&info);
-            tp->tv_sec = (long)info.uptime_secs;
-            tp->tv_nsec = 0;
+            unsigned long ns = (unsigned long)__fx_raw1(FX_CLOCK_NS, 0);
+            tp->tv_sec = (long)(ns / 1000000000UL);
+            tp->tv_nsec = (long)(ns % 1000000000UL);
         }
         return 0;
     }
 
+    case LNX_NANOSLEEP: {
+        /* nanosleep(req, rem): never interrupted, so rem is untouched */
+        const struct { long tv_sec; long tv_nsec; } *req = (const void *)a;
+        if (!req || req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000L)
+            return -22; /* EINVAL */
+        __fx_raw1(FX_SLEEP_NS, req->tv_sec * 1000000000L + req->tv_nsec);
+        return 0;
+    }
+
     /* ── getcwd ──────────────────────────────────────────────────── */
     case LNX_GETCWD: {
         char *buf = (char *)a;
@@ -0,0 +1,181 @@
+/// Submission/completion ring for batched syscalls.
+///
+/// fx.ringSetup() maps a ring; push() queues operations, fx.ringSubmit()
+/// hands everything queued to the kernel in one trap (optionally waiting
+/// for completions), and popCqe() takes the results in completion order,
+/// matched up by user_data. A CQE's res is what the plain syscall would
+/// have returned; ENOSYS (-1) means the operation can't go through the
+/// ring for that fd (console, pipes, /dev, ...) and should be retried
+/// with the syscall.
+///
+/// Chains: linked() on an SQE holds the next one back until it completes,
+/// and FD_LINKED stands for the fd opened earlier in the chain:
+///
+///     _ = r.push(ring.Sqe.open(path, 0).linked());
+///     _ = r.push(ring.Sqe.stat(ring.FD_LINKED, &st, 1).linked());
+///     _ = r.push(ring.Sqe.close(ring.FD_LINKED, 2));
+///     _ = fx.ringSubmit(&r, 3);
+///
+/// A link that fails, or a read/write that comes back short (breaksChain),
+/// breaks the chain: the rest of it completes with ECANCELED, unstarted.
+/// A close still runs, so the fd opened by the chain isn't leaked.
+///
+/// Layout must match src/ring.zig.
+
+/// Largest SQ; the CQ is twice the SQ.
+pub const MAX_ENTRIES = 64;
+
+pub const Op = enum(u8) { nop, open, read, pread, write, pwrite, stat, close, ipc };
+
+/// Don't start the next SQE until this one completes.
+pub const SQE_LINK: u8 = 1;
+
+/// Sqe.fd value: the fd from the latest open in this chain.
+pub const FD_LINKED: i32 = -1;
+
+/// Cqe.res of an entry cancelled because an earlier link broke its chain.
+pub const ECANCELED: i64 = -125;
+
+pub const Header = extern struct {
+    sq_head: u32,
+    sq_tail: u32,
+    sq_entries: u32,
+    cq_head: u32,
+    cq_tail: u32,
+    cq_entries: u32,
+    sqe_off: u32,
+    cqe_off: u32,
+    /// Completions lost because the CQ was full.
+    cq_overflow: u32,
+    _reserved: [7]u32,
+};
+
+pub const Sqe = extern struct {
+    op: u8,
+    flags: u8 = 0,
+    _pad: u16 = 0,
+    fd: i32 = 0,
+    off: u64 = 0,
+    addr: u64 = 0,
+    len: u32 = 0,
+    _pad2: u32 = 0,
+    user_data: u64,
+
+    pub fn nop(user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.nop), .user_data = user_data };
+    }
+
+    pub fn open(path: []const u8, user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.open), .addr = @intFromPtr(path.ptr), .len = @intCast(path.len), .user_data = user_data };
+    }
+
+    /// Read at the fd's offset (up to 4 KiB on server-backed files).
+    pub fn read(fd: i32, buf: []u8, user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.read), .fd = fd, .addr = @intFromPtr(buf.ptr), .len = @intCast(buf.len), .user_data = user_data };
+    }
+
+    pub fn pread(fd: i32, buf: []u8, offset: u64, user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.pread), .fd = fd, .off = offset, .addr = @intFromPtr(buf.ptr), .len = @intCast(buf.len), .user_data = user_data };
+    }
+
+    pub fn write(fd: i32, data: []const u8, user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.write), .fd = fd, .addr = @intFromPtr(data.ptr), .len = @intCast(data.len), .user_data = user_data };
+    }
+
+    pub fn pwrite(fd: i32, data: []const u8, offset: u64, user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.pwrite), .fd = fd, .off = offset, .addr = @intFromPtr(data.ptr), .len = @intCast(data.len), .user_data = user_data };
+    }
+
+    /// `st` is a 64-byte Stat.
+    pub fn stat(fd: i32, st: *anyopaque, user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.stat), .fd = fd, .addr = @intFromPtr(st), .len = 64, .user_data = user_data };
+    }
+
+    pub fn close(fd: i32, user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.close), .fd = fd, .user_data = user_data };
+    }
+
+    /// Raw IPC request on channel `fd`; the reply replaces `msg`.
+    pub fn ipcRequest(fd: i32, msg: *anyopaque, user_data: u64) Sqe {
+        return .{ .op = @intFromEnum(Op.ipc), .fd = fd, .addr = @intFromPtr(msg), .user_data = user_data };
+    }
+
+    /// Hold the next SQE back until this one completes.
+    pub fn linked(self: Sqe) Sqe {
+        var sqe = self;
+        sqe.flags |= SQE_LINK;
+        return sqe;
+    }
+};
+
+/// Whether `res` for a linked `sqe` cancels the rest of its chain: any
+/// error, or a read/write that moved fewer than sqe.len bytes.
+pub fn breaksChain(sqe: Sqe, res: i64) bool {
+    if (res < 0) return true;
+    const moves_bytes = sqe.op == @intFromEnum(Op.read) or sqe.op == @intFromEnum(Op.pread) or
+        sqe.op == @intFromEnum(Op.write) or sqe.op == @intFromEnum(Op.pwrite);
+    return moves_bytes and res < sqe.len;
+}
+
+pub const Cqe = extern struct {
+    user_data: u64,
+    res: i64,
+};
+
+comptime {
+    if (@sizeOf(Header) != 64 or @sizeOf(Sqe) != 40 or @sizeOf(Cqe) != 16)
+        @compileError("ring layout must match src/ring.zig");
+}
+
+/// Bytes of ring memory for `entries` SQEs.
+pub fn ringSize(entries: u32) usize {
+    return @sizeOf(Header) + @as(usize, entries) * (@sizeOf(Sqe) + 2 * @sizeOf(Cqe));
+}
+
+pub const Ring = struct {
+    hdr: *Header,
+    sqes: [*]Sqe,
+    cqes: [*]Cqe,
+    sq_mask: u32,
+    cq_mask: u32,
+
+    /// Attach to the ring the kernel set up at `base`.
+    pub fn init(base: [*]align(8) u8) Ring {
+        const hdr: *Header = @ptrCast(base);
+        return .{
+            .hdr = hdr,
+            .sqes = @ptrCast(@alignCast(base + hdr.sqe_off)),
+            .cqes = @ptrCast(@alignCast(base + hdr.cqe_off)),
+            .sq_mask = hdr.sq_entries - 1,
+            .cq_mask = hdr.cq_entries - 1,
+        };
+    }
+
+    /// Queue an SQE. False if the SQ is full.
+    pub fn push(self: *Ring, sqe: Sqe) bool {
+        const tail = self.hdr.sq_tail;
+        if (tail -% @atomicLoad(u32, &self.hdr.sq_head, .acquire) > self.sq_mask) return false;
+        self.sqes[tail & self.sq_mask] = sqe;
+        @atomicStore(u32, &self.hdr.sq_tail, tail +% 1, .release);
+        return true;
+    }
+
+    /// SQEs queued and not yet consumed by the kernel.
+    pub fn pending(self: *const Ring) u32 {
+        return self.hdr.sq_tail -% @atomicLoad(u32, &self.hdr.sq_head, .acquire);
+    }
+
+    /// CQEs ready to pop.
+    pub fn ready(self: *const Ring) u32 {
+        return @atomicLoad(u32, &self.hdr.cq_tail, .acquire) -% self.hdr.cq_head;
+    }
+
+    /// Take the oldest completion, if any.
+    pub fn popCqe(self: *Ring) ?Cqe {
+        const head = self.hdr.cq_head;
+        if (@atomicLoad(u32, &self.hdr.cq_tail, .acquire) == head) return null;
+        const cqe = self.cqes[head & self.cq_mask];
+        @atomicStore(u32, &self.hdr.cq_head, head +% 1, .release);
+        return cqe;
+    }
+};
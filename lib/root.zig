@@ -10,6 +10,7 @@ pub const errno = @import("errno.zig");
 pub const fmt = @import("fmt.zig");
 pub const io = @import("io.zig");
 pub const str = @import("str.zig");
+pub const scan = @import("scan.zig");
 pub const path = @import("path.zig");
 pub const mem = @import("mem.zig");
 pub const crypt = @import("crypt.zig");
@@ -25,6 +26,8 @@ pub const http = @import("http.zig");
 pub const thread = @import("thread.zig");
 pub const net = @import("net/root.zig");
 pub const time_lib = @import("time.zig");
+pub const ring = @import("ring.zig");
+pub const bench = @import("bench.zig");
 
 // Re-export syscall functions at top level for backward compatibility.
 pub const SYS = syscall.SYS;
@@ -52,6 +55,14 @@ pub const klog = syscall.klog;
 pub const SysInfo = syscall.SysInfo;
 pub const sysinfo = syscall.sysinfo;
 pub const sleep = syscall.sleep;
+pub const sleepNs = syscall.sleepNs;
+pub const clockNs = syscall.clockNs;
+pub const svcState = syscall.svcState;
+pub const svcStandby = syscall.svcStandby;
+pub const SVC_STATE_SIZE = syscall.SVC_STATE_SIZE;
+pub const ringSetup = syscall.ringSetup;
+pub const ringEnter = syscall.ringEnter;
+pub const ringSubmit = syscall.ringSubmit;
 pub const shutdown = syscall.shutdown;
 pub const reboot = syscall.reboot;
 pub const seek = syscall.seek;
@@ -81,6 +92,12 @@ pub const mount = syscall.mount;
 pub const unmount = syscall.unmount;
 pub const bind = syscall.bind;
 pub const ipc_pair = syscall.ipc_pair;
+pub const ipc_grant_enable = syscall.ipc_grant_enable;
+pub const ipc_grant_read = syscall.ipc_grant_read;
+pub const ipc_grant_write = syscall.ipc_grant_write;
+pub const ipc_submit = syscall.ipc_submit;
+pub const ipc_collect = syscall.ipc_collect;
+pub const splice = syscall.splice;
 pub const time = syscall.time;
 pub const getUptime = syscall.getUptime;
 
@@ -102,6 +119,7 @@ pub const R_ERROR = ipc.R_ERROR;
 pub const T_RENAME = ipc.T_RENAME;
 pub const T_TRUNCATE = ipc.T_TRUNCATE;
 pub const T_WSTAT = ipc.T_WSTAT;
+pub const T_WRITE_BULK = ipc.T_WRITE_BULK;
 
 // Re-export argv helpers at top level.
 pub const ARGV_BASE = syscall.ARGV_BASE;
@@ -0,0 +1,200 @@
+/// Vectorized text scanning: byte counting, memchr, memmem and ASCII
+/// case-insensitive search, shared by grep, wc, sed and awk.
+///
+/// Every kernel works a vector at a time and finishes the tail with a
+/// scalar loop. The vector width is picked at compile time: 32 bytes
+/// when the target has AVX2, 16 (SSE2, always present on x86_64)
+/// otherwise. Other architectures get the plain scalar loops.
+///
+/// Kernels(n) instantiates the same code at any width (0 = scalar),
+/// which is how the tests cross-check the vector paths.
+const builtin = @import("builtin");
+
+/// Vector width in bytes for this target (0 = scalar).
+pub const VEC_LEN: usize = switch (builtin.cpu.arch) {
+    .x86_64 => if (builtin.cpu.has(.x86, .avx2)) 32 else 16,
+    else => 0,
+};
+
+const native = Kernels(VEC_LEN);
+
+pub const countByte = native.countByte;
+pub const countLines = native.countLines;
+pub const countWords = native.countWords;
+pub const indexOfByte = native.indexOfByte;
+pub const indexOf = native.indexOf;
+pub const indexOfIgnoreCase = native.indexOfIgnoreCase;
+
+/// ASCII lowercase.
+pub fn toLower(c: u8) u8 {
+    return if (c -% 'A' < 26) c | 0x20 else c;
+}
+
+/// Equal ignoring ASCII case.
+pub fn eqlIgnoreCase(a: []const u8, b: []const u8) bool {
+    if (a.len != b.len) return false;
+    for (a, b) |ac, bc| {
+        if (toLower(ac) != toLower(bc)) return false;
+    }
+    return true;
+}
+
+fn eql(a: []const u8, b: []const u8) bool {
+    for (a, b) |ac, bc| {
+        if (ac != bc) return false;
+    }
+    return true;
+}
+
+/// wc's notion of word separators.
+fn isSpace(c: u8) bool {
+    return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+}
+
+pub fn Kernels(comptime V: usize) type {
+    return struct {
+        const Vec = @Vector(if (V == 0) 1 else V, u8);
+        /// One bit per lane, lane 0 in bit 0.
+        const Mask = @Type(.{ .int = .{ .signedness = .unsigned, .bits = V } });
+
+        inline fn load(buf: []const u8, i: usize) Vec {
+            return buf[i..][0..V].*;
+        }
+
+        inline fn splat(c: u8) Vec {
+            return @splat(c);
+        }
+
+        inline fn eqMask(v: Vec, c: u8) Mask {
+            return @bitCast(v == splat(c));
+        }
+
+        /// Lowercase every ASCII letter in v.
+        inline fn fold(v: Vec) Vec {
+            return v | @select(u8, v -% splat('A') < splat(26), splat(0x20), splat(0));
+        }
+
+        /// Occurrences of c in buf.
+        pub fn countByte(buf: []const u8, c: u8) usize {
+            var n: usize = 0;
+            var i: usize = 0;
+            if (V > 0) {
+                // Per-lane u8 counters, flushed before they can wrap.
+                while (i + V <= buf.len) {
+                    var acc: Vec = splat(0);
+                    var rounds: usize = 0;
+                    while (rounds < 255 and i + V <= buf.len) : ({
+                        rounds += 1;
+                        i += V;
+                    }) {
+                        acc +%= @select(u8, load(buf, i) == splat(c), splat(1), splat(0));
+                    }
+                    n += @reduce(.Add, @as(@Vector(V, u16), @intCast(acc)));
+                }
+            }
+            for (buf[i..]) |b| n += @intFromBool(b == c);
+            return n;
+        }
+
+        pub fn countLines(buf: []const u8) usize {
+            return countByte(buf, '\n');
+        }
+
+        /// Words starting in buf, wc-style (runs of bytes other than
+        /// space, tab, CR and LF). `in_word` carries the state between
+        /// consecutive blocks of one stream; start it at false.
+        pub fn countWords(buf: []const u8, in_word: *bool) usize {
+            var n: usize = 0;
+            var i: usize = 0;
+            var inside = in_word.*;
+            if (V > 0) {
+                while (i + V <= buf.len) : (i += V) {
+                    const v = load(buf, i);
+                    const space = eqMask(v, ' ') | eqMask(v, '\t') | eqMask(v, '\n') | eqMask(v, '\r');
+                    // A word starts at every non-space byte whose predecessor is a space.
+                    const before: Mask = (space << 1) | @intFromBool(!inside);
+                    n += @popCount(~space & before);
+                    inside = space >> (V - 1) == 0;
+                }
+            }
+            for (buf[i..]) |b| {
+                if (isSpace(b)) {
+                    inside = false;
+                } else {
+                    if (!inside) n += 1;
+                    inside = true;
+                }
+            }
+            in_word.* = inside;
+            return n;
+        }
+
+        /// First index of c in buf (memchr).
+        pub fn indexOfByte(buf: []const u8, c: u8) ?usize {
+            var i: usize = 0;
+            if (V > 0) {
+                while (i + V <= buf.len) : (i += V) {
+                    const m = eqMask(load(buf, i), c);
+                    if (m != 0) return i + @ctz(m);
+                }
+            }
+            while (i < buf.len) : (i += 1) {
+                if (buf[i] == c) return i;
+            }
+            return null;
+        }
+
+        /// First index of needle in haystack (memmem). Vector lanes
+        /// test the needle's first and last bytes at once; only
+        /// positions matching both get a full compare.
+        pub fn indexOf(haystack: []const u8, needle: []const u8) ?usize {
+            if (needle.len == 0) return 0;
+            if (haystack.len < needle.len) return null;
+            if (needle.len == 1) return indexOfByte(haystack, needle[0]);
+
+            const last = needle.len - 1;
+            const end = haystack.len - last; // candidate start positions
+            var i: usize = 0;
+            if (V > 0) {
+                while (i + V <= end) : (i += V) {
+                    var m = eqMask(load(haystack, i), needle[0]) & eqMask(load(haystack, i + last), needle[last]);
+                    while (m != 0) : (m &= m - 1) {
+                        const j = i + @ctz(m);
+                        if (eql(haystack[j + 1 .. j + last], needle[1..last])) return j;
+                    }
+                }
+            }
+            while (i < end) : (i += 1) {
+                if (haystack[i] == needle[0] and eql(haystack[i + 1 .. i + needle.len], needle[1..])) return i;
+            }
+            return null;
+        }
+
+        /// indexOf ignoring ASCII case on both sides.
+        pub fn indexOfIgnoreCase(haystack: []const u8, needle: []const u8) ?usize {
+            if (needle.len == 0) return 0;
+            if (haystack.len < needle.len) return null;
+
+            const last = needle.len - 1;
+            const end = haystack.len - last;
+            const first_c = toLower(needle[0]);
+            const last_c = toLower(needle[last]);
+            var i: usize = 0;
+            if (V > 0) {
+                while (i + V <= end) : (i += V) {
+                    const lo: Mask = @bitCast(fold(load(haystack, i)) == splat(first_c));
+                    const hi: Mask = @bitCast(fold(load(haystack, i + last)) == splat(last_c));
+                    var m = lo & hi;
+                    while (m != 0) : (m &= m - 1) {
+                        const j = i + @ctz(m);
+                        if (eqlIgnoreCase(haystack[j..][0..needle.len], needle)) return j;
+                    }
+                }
+            }
+            while (i < end) : (i += 1) {
+                if (toLower(haystack[i]) == first_c and eqlIgnoreCase(haystack[i..][0..needle.len], needle)) return i;
+            }
+            return null;
+        }
+    };
+}
@@ -45,9 +45,20 @@ pub const SYS = enum(u64) {
     clone = 37,
     futex = 38,
     ipc_pair = 39,
+    ipc_grant = 40,
+    ipc_submit = 41,
+    ipc_collect = 42,
+    splice = 43,
+    clock_ns = 44,
+    sleep_ns = 45,
+    svc_state = 46,
+    svc_standby = 47,
+    ring_setup = 48,
+    ring_enter = 49,
 };
 
 const ipc = @import("ipc.zig");
+const ring = @import("ring.zig");
 pub const IpcMessage = ipc.IpcMessage;
 pub const DirEntry = ipc.DirEntry;
 pub const Stat = ipc.Stat;
@@ -178,6 +189,55 @@ pub fn ipc_reply(fd: i32, msg: *IpcMessage) i32 {
     return @bitCast(@as(u32, @truncate(result)));
 }
 
+/// Opt a server channel in to page-grant bulk requests: reads over 4 KB
+/// arrive as T_READ with a larger count, writes as T_WRITE_BULK.
+/// EACCES unless `fd` is the server end.
+pub fn ipc_grant_enable(fd: i32) i32 {
+    const result = syscall5(.ipc_grant, @bitCast(@as(i64, fd)), 0, 0, 0, 0);
+    return @bitCast(@as(u32, @truncate(result)));
+}
+
+/// Copy `buf.len` bytes from the current request's grant at `offset` into
+/// `buf` (serving T_WRITE_BULK). Returns bytes copied or negative error.
+pub fn ipc_grant_read(fd: i32, offset: u32, buf: []u8) i32 {
+    const result = syscall5(.ipc_grant, @bitCast(@as(i64, fd)), 1, offset, @intFromPtr(buf.ptr), buf.len);
+    return @bitCast(@as(u32, @truncate(result)));
+}
+
+/// Copy `data` into the current request's grant at `offset` (serving a
+/// bulk T_READ). Returns bytes copied or negative error.
+pub fn ipc_grant_write(fd: i32, offset: u32, data: []const u8) i32 {
+    const result = syscall5(.ipc_grant, @bitCast(@as(i64, fd)), 2, offset, @intFromPtr(data.ptr), data.len);
+    return @bitCast(@as(u32, @truncate(result)));
+}
+
+/// Post `msg` on channel `fd` as a tagged request without waiting for the
+/// reply. Up to 32 may be outstanding; -11 (EAGAIN) when that many are.
+pub fn ipc_submit(fd: i32, msg: *const IpcMessage, cookie: u64) i32 {
+    const result = syscall3(.ipc_submit, @bitCast(@as(i64, fd)), @intFromPtr(msg), cookie);
+    return @bitCast(@as(u32, @truncate(result)));
+}
+
+/// Wait for the next tagged reply, in completion order. Stores the reply in
+/// `msg` and the cookie passed to ipc_submit in `cookie`. Negative if
+/// nothing is outstanding.
+pub fn ipc_collect(msg: *IpcMessage, cookie: *u64) i32 {
+    const result = syscall2(.ipc_collect, @intFromPtr(msg), @intFromPtr(cookie));
+    return @bitCast(@as(u32, @truncate(result)));
+}
+
+/// Move up to `len` bytes from `fd_in` to `fd_out` inside the kernel. One
+/// side must be a pipe, the other a TCP data fd or a file. Blocks until
+/// data moves; returns bytes moved, 0 at end of input, or negative error.
+pub fn splice(fd_in: i32, fd_out: i32, len: usize) i32 {
+    while (true) {
+        const result = syscall3(.splice, @bitCast(@as(i64, fd_in)), @bitCast(@as(i64, fd_out)), len);
+        const r: i32 = @bitCast(@as(u32, @truncate(result)));
+        // -11 (EAGAIN): the kernel waited for the pipe or peer; go again
+        if (r != -11) return r;
+    }
+}
+
 pub fn spawn(elf_data: []const u8, fd_map: []const FdMapping, argv_block: ?[]const u8) i32 {
     const argv_ptr: u64 = if (argv_block) |blk| @intFromPtr(blk.ptr) else 0;
     const result = syscall5(.spawn, @intFromPtr(elf_data.ptr), elf_data.len, @intFromPtr(fd_map.ptr), fd_map.len, argv_ptr);
@@ -228,6 +288,58 @@ pub fn sleep(ms: u64) void {
     _ = syscall1(.sleep, ms);
 }
 
+/// Sleep for at least `ns` nanoseconds (the kernel's timer resolution is
+/// ~65 µs).
+pub fn sleepNs(ns: u64) void {
+    _ = syscall1(.sleep_ns, ns);
+}
+
+/// Nanoseconds since boot on the kernel's monotonic clock.
+pub fn clockNs() u64 {
+    return syscall1(.clock_ns, 0);
+}
+
+/// Size of a supervised service's state region (kernel mem.zig).
+pub const SVC_STATE_SIZE: usize = 4 * 4096;
+
+/// The state region the supervisor keeps for this service across
+/// restarts, zeroed when the service is first started. Null when not
+/// running as a supervised service with one.
+pub fn svcState() ?[]align(4096) u8 {
+    const result = syscall1(.svc_state, 0);
+    if (@as(i64, @bitCast(result)) < 0) return null;
+    const base: [*]align(4096) u8 = @ptrFromInt(result);
+    return base[0..SVC_STATE_SIZE];
+}
+
+/// Hot standby: block until this instance becomes the active one.
+/// Returns at once for any other process.
+pub fn svcStandby() void {
+    _ = syscall1(.svc_standby, 0);
+}
+
+/// Map a submission ring with `entries` SQEs (a power of two up to
+/// ring.MAX_ENTRIES). Null if this process already has one or memory ran
+/// out. Each thread needs its own.
+pub fn ringSetup(entries: u32) ?ring.Ring {
+    const result = syscall1(.ring_setup, entries);
+    if (@as(i64, @bitCast(result)) < 0) return null;
+    return ring.Ring.init(@ptrFromInt(result));
+}
+
+/// Hand up to `to_submit` queued SQEs to the kernel and wait until
+/// `min_complete` of this call's completions are in the CQ (fewer once
+/// nothing is left in flight). Returns SQEs consumed or negative error.
+pub fn ringEnter(to_submit: u32, min_complete: u32) i32 {
+    const result = syscall2(.ring_enter, to_submit, min_complete);
+    return @bitCast(@as(u32, @truncate(result)));
+}
+
+/// Submit everything queued in `r`, waiting for `min_complete` completions.
+pub fn ringSubmit(r: *const ring.Ring, min_complete: u32) i32 {
+    return ringEnter(r.pending(), min_complete);
+}
+
 pub fn shutdown() noreturn {
     _ = syscall1(.shutdown, 0);
     unreachable;
@@ -290,10 +402,19 @@ pub fn clone(stack_top: u64, tls: u64, ctid_ptr: u64, ptid_ptr: u64, flags: u64)
     return syscall5(.clone, stack_top, tls, ctid_ptr, ptid_ptr, flags);
 }
 
+/// futex(addr, op, val, timeout): FUTEX_WAIT (0) blocks while *addr == val,
+/// for at most `timeout` ms (0 = no limit; -110 ETIMEDOUT on expiry);
+/// FUTEX_WAKE (1) wakes up to `val` waiters.
 pub fn futex(addr: u64, op: u64, val: u64, timeout: u64) u64 {
     return syscall4(.futex, addr, op, val, timeout);
 }
 
+/// FUTEX_REQUEUE: wake up to `nr_wake` waiters on `addr` and move up to
+/// `nr_requeue` of the others onto `addr2`. Returns the number woken.
+pub fn futex_requeue(addr: u64, nr_wake: u64, nr_requeue: u64, addr2: u64) u64 {
+    return syscall5(.futex, addr, 3, nr_wake, nr_requeue, addr2);
+}
+
 pub const RFNAMEG: u64 = 0x08;
 
 // rfork flags (Plan 9)
@@ -1,6 +1,7 @@
 /// Native Zig threading API for Fornax.
 ///
-/// Provides spawnThread() and Mutex backed by the clone/futex syscalls.
+/// Provides spawnThread(), Mutex, Condition and RwLock backed by the
+/// clone/futex syscalls.
 /// The clone wrapper uses inline asm to handle the child's first execution:
 /// parent returns child PID, child pops func/arg from stack, calls func, exits.
 const fx = @import("syscall.zig");
@@ -117,6 +118,107 @@ pub const Mutex = struct {
     }
 };
 
+/// Condition — futex-based condition variable, used with a Mutex.
+/// broadcast() wakes one waiter and requeues the rest onto the mutex, so
+/// they are handed the lock one at a time instead of all waking to fight
+/// over it. All waiters must use the same mutex.
+pub const Condition = struct {
+    seq: u32 align(4) = 0,
+    mutex: ?*Mutex = null,
+
+    const WAKE_ALL: u64 = 0x7FFF_FFFF;
+    const ETIMEDOUT: u64 = @bitCast(@as(i64, -110));
+
+    /// Atomically release `mutex` and wait for signal()/broadcast(), then
+    /// re-acquire it. Spurious wakeups are possible; re-check the predicate.
+    pub fn wait(self: *Condition, mutex: *Mutex) void {
+        _ = self.timedWait(mutex, 0);
+    }
+
+    /// wait() for at most `timeout_ms` (0 = no limit). Returns false on timeout.
+    pub fn timedWait(self: *Condition, mutex: *Mutex, timeout_ms: u64) bool {
+        @atomicStore(?*Mutex, &self.mutex, mutex, .monotonic);
+        const s = @atomicLoad(u32, &self.seq, .monotonic);
+        mutex.unlock();
+        const ret = fx.futex(@intFromPtr(&self.seq), 0, s, timeout_ms); // FUTEX_WAIT while unchanged
+        mutex.lock();
+        return ret != ETIMEDOUT;
+    }
+
+    pub fn signal(self: *Condition) void {
+        _ = @atomicRmw(u32, &self.seq, .Add, 1, .release);
+        _ = fx.futex(@intFromPtr(&self.seq), 1, 1, 0); // FUTEX_WAKE, count=1
+    }
+
+    pub fn broadcast(self: *Condition) void {
+        _ = @atomicRmw(u32, &self.seq, .Add, 1, .release);
+        const mutex = @atomicLoad(?*Mutex, &self.mutex, .monotonic) orelse {
+            _ = fx.futex(@intFromPtr(&self.seq), 1, WAKE_ALL, 0);
+            return;
+        };
+        // Mutex.unlock() always wakes one waiter, so requeued threads get
+        // the lock in turn.
+        _ = fx.futex_requeue(@intFromPtr(&self.seq), 1, WAKE_ALL, @intFromPtr(&mutex.state));
+    }
+};
+
+/// RwLock — futex-based reader/writer lock. Any number of readers, or one
+/// writer. Writer-preferring: once a writer is waiting, new readers block,
+/// so a steady stream of readers cannot starve it.
+///
+/// Waiters sleep on `seq`, not `state`: every release bumps it, so a
+/// waiter that read the state before a whole lock/unlock cycle (which can
+/// leave `state` back where it was) still sees the futex word change.
+pub const RwLock = struct {
+    state: u32 align(4) = 0, // number of readers, or WRITER
+    writers_waiting: u32 align(4) = 0,
+    seq: u32 align(4) = 0,
+
+    const WRITER: u32 = 0xFFFF_FFFF;
+    const WAKE_ALL: u64 = 0x7FFF_FFFF;
+
+    pub fn lockShared(self: *RwLock) void {
+        while (true) {
+            const q = @atomicLoad(u32, &self.seq, .acquire);
+            const s = @atomicLoad(u32, &self.state, .monotonic);
+            if (s != WRITER and @atomicLoad(u32, &self.writers_waiting, .monotonic) == 0) {
+                if (@cmpxchgWeak(u32, &self.state, s, s + 1, .acquire, .monotonic) == null) return;
+                continue;
+            }
+            _ = fx.futex(@intFromPtr(&self.seq), 0, q, 0); // FUTEX_WAIT while no release
+        }
+    }
+
+    pub fn unlockShared(self: *RwLock) void {
+        if (@atomicRmw(u32, &self.state, .Sub, 1, .release) == 1) {
+            // Last reader out — a waiting writer (and any readers queued
+            // behind it) re-check the state
+            self.release();
+        }
+    }
+
+    pub fn lock(self: *RwLock) void {
+        _ = @atomicRmw(u32, &self.writers_waiting, .Add, 1, .monotonic);
+        while (true) {
+            const q = @atomicLoad(u32, &self.seq, .acquire);
+            if (@cmpxchgWeak(u32, &self.state, 0, WRITER, .acquire, .monotonic) == null) break;
+            if (@atomicLoad(u32, &self.state, .monotonic) == 0) continue;
+            _ = fx.futex(@intFromPtr(&self.seq), 0, q, 0);
+        }
+        _ = @atomicRmw(u32, &self.writers_waiting, .Sub, 1, .monotonic);
+    }
+
+    pub fn unlock(self: *RwLock) void {
+        @atomicStore(u32, &self.state, 0, .release);
+        self.release();
+    }
+
+    fn release(self: *RwLock) void {
+        _ = @atomicRmw(u32, &self.seq, .Add, 1, .release);
+        _ = fx.futex(@intFromPtr(&self.seq), 1, WAKE_ALL, 0); // FUTEX_WAKE all
+    }
+};
+
 /// Wait for a thread to exit by spinning on its ctid_ptr.
 pub fn join(handle: *const ThreadHandle) void {
     // ctid_ptr is cleared and futex-woken by the kernel on thread exit
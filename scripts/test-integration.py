@@ -7,6 +7,11 @@ verifies output. No external dependencies — stdlib only.
 Usage:
     python3 scripts/test-integration.py
     make test
+
+Benchmarks (builds `zig build bench`, boots with 4 cores, runs `bench all`
+and writes the results as JSON, by default to bench-results.json):
+    python3 scripts/test-integration.py --bench [--bench-out FILE]
+    make bench
 """
 
 import gzip
@@ -18,6 +23,7 @@ import os
 import re
 import select
 import signal
+import socket
 import subprocess
 import sys
 import tarfile
@@ -75,10 +81,11 @@ def find_ovmf():
 # ── QemuDriver ───────────────────────────────────────────────────────
 
 class QemuDriver:
-    def __init__(self, ovmf, esp_dir, disk_img):
+    def __init__(self, ovmf, esp_dir, disk_img, smp=1):
         self.ovmf = ovmf
         self.esp_dir = esp_dir
         self.disk_img = disk_img
+        self.smp = smp
         self.proc = None
         self.buf = b""
         self.full_log = b""
@@ -95,6 +102,7 @@ class QemuDriver:
             "-drive", f"if=pflash,format=raw,readonly=on,file={self.ovmf}",
             "-drive", f"format=raw,file=fat:rw:{self.esp_dir}",
             "-m", "1G",
+            "-smp", str(self.smp),
             "-serial", "stdio",
             "-display", "none",
             "-no-reboot",
@@ -306,6 +314,27 @@ def start_http_server(directory, port=8000):
     return server
 
 
+def start_discard_server(port):
+    """Start a daemon TCP server that reads and drops everything (tcp bench sink)."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("0.0.0.0", port))
+    sock.listen(4)
+
+    def drain(conn):
+        with conn:
+            while conn.recv(65536):
+                pass
+
+    def serve():
+        while True:
+            conn, _ = sock.accept()
+            threading.Thread(target=drain, args=(conn,), daemon=True).start()
+
+    threading.Thread(target=serve, daemon=True).start()
+    return sock
+
+
 # ── Disk image builder ───────────────────────────────────────────────
 
 def create_test_disk(tmpdir, rootfs_dir, disk_size_mb=256):
@@ -551,6 +580,90 @@ def test_shutdown(qemu):
         return False
 
 
+# ── Benchmarks ───────────────────────────────────────────────────────
+
+BENCH_LINE = re.compile(rb"^BENCH (\S+)((?: \w+=\d+)*)\s*$", re.MULTILINE)
+BENCH_SKIP = re.compile(rb"^BENCH (\S+) skipped: (.*?)\s*$", re.MULTILINE)
+BENCH_TCP_PORT = 8001
+
+
+def parse_bench(output):
+    """Turn `BENCH <case> k=v...` lines into a results dict."""
+    results = {"tsc_hz": None, "results": [], "skipped": []}
+    for m in BENCH_LINE.finditer(output):
+        name = m.group(1).decode()
+        fields = dict(kv.split("=") for kv in m.group(2).decode().split())
+        fields = {k: int(v) for k, v in fields.items()}
+        if name == "tsc":
+            results["tsc_hz"] = fields.get("hz")
+            continue
+        entry = {"name": name}
+        for param in ("size", "bytes", "depth"):
+            if param in fields:
+                entry[param] = fields.pop(param)
+        entry.update(fields)
+        results["results"].append(entry)
+    for m in BENCH_SKIP.finditer(output):
+        results["skipped"].append({"name": m.group(1).decode(), "reason": m.group(2).decode()})
+    return results
+
+
+def run_bench(qemu, out_path):
+    """Run the in-guest suite and write machine-readable results."""
+    start = len(qemu.full_log)
+    qemu.send_line("bench all; echo __BENCH_DONE__")
+    qemu.expect(r"\n__BENCH_DONE__", timeout=900)
+    results = parse_bench(qemu.full_log[start:].replace(b"\r", b""))
+
+    rev = subprocess.run(
+        ["git", "rev-parse", "--short", "HEAD"],
+        cwd=PROJECT_DIR, capture_output=True, text=True,
+    ).stdout.strip()
+    results["git_rev"] = rev or None
+    results["timestamp"] = int(time.time())
+    results["smp"] = qemu.smp
+
+    with open(out_path, "w") as f:
+        json.dump(results, f, indent=2)
+        f.write("\n")
+    log("BENCH", f"{len(results['results'])} results, {len(results['skipped'])} skipped -> {out_path}")
+    return len(results["results"]) > 0
+
+
+def bench_main(out_path):
+    ovmf = find_ovmf()
+    if not ovmf:
+        print(f"{RED}Error: Could not find OVMF firmware.{RESET}", file=sys.stderr)
+        return 1
+
+    log("BUILD", "Building Fornax with benchmarks (ReleaseSafe kernel)...")
+    for args in (["bench", "-Doptimize=ReleaseSafe"], ["mkgpt", "mkfxfs"]):
+        result = subprocess.run(["zig", "build"] + args, cwd=PROJECT_DIR, capture_output=True, text=True)
+        if result.returncode != 0:
+            print(f"{RED}Build failed:{RESET}\n{result.stderr}", file=sys.stderr)
+            return 1
+
+    qemu = None
+    ok = False
+    try:
+        sink = start_discard_server(BENCH_TCP_PORT)
+        with tempfile.TemporaryDirectory(prefix="fornax-bench-") as tmpdir:
+            rootfs_dir = os.path.join(PROJECT_DIR, "zig-out", "rootfs")
+            prepare_rootfs(rootfs_dir)
+            disk_img = create_test_disk(tmpdir, rootfs_dir)
+            esp_dir = os.path.join(PROJECT_DIR, "zig-out", "esp")
+            qemu = QemuDriver(ovmf, esp_dir, disk_img, smp=4)
+            qemu.start()
+            ok = test_boot_login(qemu) and run_bench(qemu, out_path)
+        sink.close()
+    except (TimeoutError, RuntimeError, OSError) as e:
+        log_fail("bench", str(e))
+    finally:
+        if qemu:
+            qemu.stop()
+    return 0 if ok else 1
+
+
 # ── Main ─────────────────────────────────────────────────────────────
 
 def main():
@@ -568,7 +681,6 @@ def main():
         log("SETUP", f"OVMF: {ovmf}")
 
         # 2. Check port 8000 availability
-        import socket
         sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
         try:
@@ -704,4 +816,9 @@ def main():
 
 
 if __name__ == "__main__":
+    if "--bench" in sys.argv:
+        out = "bench-results.json"
+        if "--bench-out" in sys.argv:
+            out = sys.argv[sys.argv.index("--bench-out") + 1]
+        sys.exit(bench_main(os.path.abspath(out)))
     sys.exit(main())
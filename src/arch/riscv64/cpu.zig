@@ -121,6 +121,11 @@ pub fn fence() void {
     asm volatile ("fence rw, rw" ::: .{ .memory = true });
 }
 
+/// Flush this hart's whole TLB.
+pub fn flushTlb() void {
+    asm volatile ("sfence.vma" ::: .{ .memory = true });
+}
+
 pub fn fenceI() void {
     asm volatile ("fence.i" ::: .{ .memory = true });
 }
@@ -9,6 +9,7 @@ const paging = @import("paging.zig");
 const plic = @import("plic.zig");
 const supervisor = @import("../../supervisor.zig");
 const process = @import("../../process.zig");
+const trace = @import("../../trace.zig");
 
 /// IRQ handler function type. Returns true if it handled the IRQ.
 pub const IrqHandler = *const fn () bool;
@@ -50,6 +51,18 @@ inline fn inlineHex(val: u64) void {
 export fn handleExceptionRv(frame_ptr: u64, scause: u64, stval: u64) callconv(.c) void {
     _ = frame_ptr; // frame is on the stack, entry.S manages it
 
+    if (trace.enabled and (scause == cpu.SCAUSE_STORE_PAGE_FAULT or
+        scause == cpu.SCAUSE_LOAD_PAGE_FAULT or scause == cpu.SCAUSE_INST_PAGE_FAULT))
+    {
+        const pid = if (process.getCurrent()) |p| p.pid else 0;
+        trace.point(.page_fault, pid, stval, scause);
+    }
+
+    // Store fault on a copy-on-write page after fork (from U-mode, or from
+    // the kernel writing a user buffer under SUM). Once resolved, sret
+    // retries the store.
+    if (scause == cpu.SCAUSE_STORE_PAGE_FAULT and process.handleCowFault(stval)) return;
+
     // Check if the fault came from user mode (SSTATUS.SPP == 0)
     const sstatus = cpu.csrRead(cpu.CSR_SSTATUS);
     const from_user = (sstatus & cpu.SSTATUS_SPP) == 0;
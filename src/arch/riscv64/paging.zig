@@ -28,6 +28,7 @@ pub const Flags = struct {
     pub const GLOBAL: u64 = 1 << 5;
     pub const ACCESSED: u64 = 1 << 6;
     pub const DIRTY: u64 = 1 << 7;
+    pub const COW: u64 = 1 << 8; // RSW (software) bit: shared copy-on-write page
 
     // Aliases for compatibility with x86_64 paging API
     pub const PRESENT: u64 = VALID;
@@ -114,6 +115,7 @@ pub fn init() void {
     const satp_val: u64 = (@as(u64, 9) << 60) | (kernel_root_phys >> 12);
     cpu.csrWrite(cpu.CSR_SATP, satp_val);
     asm volatile ("sfence.vma" ::: .{ .memory = true });
+    probeAsids(satp_val);
 
     initialized = true;
 
@@ -228,81 +230,169 @@ pub fn createAddressSpace() ?*PageTable {
     return new_root;
 }
 
-/// Deep-copy the entire user-half address space (Sv48 entries 1-255) for fork.
-/// Entry 0 (identity map) is handled by createAddressSpace(). The kernel half
-/// (entries 256-511) is shared. Each 4KB user page is fully copied (no COW).
-pub fn deepCopyAddressSpace(src_root: *PageTable) ?*PageTable {
-    // Create base address space (kernel half + identity map deep-copy)
+/// Copy-on-write clone of the user half (Sv48 entries 0-255) for fork.
+/// Page tables are copied; user pages are not. Each user frame is mapped by
+/// both address spaces and gains a reference (pmm.refPage). Writable pages
+/// lose WRITE and gain COW on both sides, so the first store from either
+/// side faults into resolveCow. Non-user leaves (identity map under entry 0)
+/// are copied as-is; the kernel half is shared via createAddressSpace().
+///
+/// The source's PTEs are write-protected in place: the caller must flush
+/// its TLB on every hart that may be running it. On failure the partial
+/// copy is freed (dropping the references it took) and null is returned.
+pub fn cowCopyAddressSpace(src_root: *PageTable) ?*PageTable {
     const new_root = createAddressSpace() orelse return null;
+    copyUserHalf(src_root, new_root) catch {
+        freeAddressSpace(new_root);
+        return null;
+    };
+    return new_root;
+}
 
-    // Walk L3 entries 1-255 (user half, excluding entry 0 identity map)
-    for (1..256) |l3_idx| {
-        if (src_root.entries[l3_idx] & Flags.VALID == 0) continue;
-        if (isLeaf(src_root.entries[l3_idx])) {
+fn copyUserHalf(src_root: *PageTable, new_root: *PageTable) error{OutOfMemory}!void {
+    for (0..256) |l3_idx| {
+        const l3e = src_root.entries[l3_idx];
+        if (l3e & Flags.VALID == 0) continue;
+        if (isLeaf(l3e)) {
             // Superpage — copy entry as-is
-            new_root.entries[l3_idx] = src_root.entries[l3_idx];
+            new_root.entries[l3_idx] = l3e;
             continue;
         }
-        const src_l2: *PageTable = tablePtr(pteToPhys(src_root.entries[l3_idx]));
-
-        const new_l2_page = pmm.allocPage() orelse return null;
-        const new_l2: *PageTable = tablePtr(new_l2_page);
-        new_l2.zero();
+        const src_l2: *PageTable = tablePtr(pteToPhys(l3e));
+        const new_l2 = cloneTable(new_root, l3_idx) orelse return error.OutOfMemory;
 
         for (0..512) |l2_idx| {
-            if (src_l2.entries[l2_idx] & Flags.VALID == 0) continue;
-            if (isLeaf(src_l2.entries[l2_idx])) {
+            const l2e = src_l2.entries[l2_idx];
+            if (l2e & Flags.VALID == 0) continue;
+            if (isLeaf(l2e)) {
                 // 1GB superpage — copy as-is
-                new_l2.entries[l2_idx] = src_l2.entries[l2_idx];
+                new_l2.entries[l2_idx] = l2e;
                 continue;
             }
-            const src_l1: *PageTable = tablePtr(pteToPhys(src_l2.entries[l2_idx]));
-
-            const new_l1_page = pmm.allocPage() orelse return null;
-            const new_l1: *PageTable = tablePtr(new_l1_page);
-            new_l1.zero();
+            const src_l1: *PageTable = tablePtr(pteToPhys(l2e));
+            const new_l1 = cloneTable(new_l2, l2_idx) orelse return error.OutOfMemory;
 
             for (0..512) |l1_idx| {
-                if (src_l1.entries[l1_idx] & Flags.VALID == 0) continue;
-                if (isLeaf(src_l1.entries[l1_idx])) {
+                const l1e = src_l1.entries[l1_idx];
+                if (l1e & Flags.VALID == 0) continue;
+                if (isLeaf(l1e)) {
                     // 2MB superpage — copy as-is
-                    new_l1.entries[l1_idx] = src_l1.entries[l1_idx];
+                    new_l1.entries[l1_idx] = l1e;
                     continue;
                 }
-                const src_l0: *PageTable = tablePtr(pteToPhys(src_l1.entries[l1_idx]));
+                const src_l0: *PageTable = tablePtr(pteToPhys(l1e));
 
-                const new_l0_page = pmm.allocPage() orelse return null;
+                // Link the new L0 before filling it so a failure part-way
+                // leaves a tree freeAddressSpace() can walk.
+                const new_l0_page = pmm.allocPage() orelse return error.OutOfMemory;
                 const new_l0: *PageTable = tablePtr(new_l0_page);
                 new_l0.zero();
+                new_l1.entries[l1_idx] = physToPte(new_l0_page) | Flags.VALID;
 
                 for (0..512) |l0_idx| {
-                    if (src_l0.entries[l0_idx] & Flags.VALID == 0) continue;
-                    if (src_l0.entries[l0_idx] & Flags.USER == 0) continue; // skip non-user pages
+                    const pte = src_l0.entries[l0_idx];
+                    if (pte & Flags.VALID == 0) continue;
+                    if (pte & Flags.USER == 0) {
+                        // Split identity-map page, not owned by the process
+                        new_l0.entries[l0_idx] = pte;
+                        continue;
+                    }
+                    new_l0.entries[l0_idx] = shareUserPage(&src_l0.entries[l0_idx]) orelse return error.OutOfMemory;
+                }
+            }
+        }
+    }
+}
 
-                    const src_phys = pteToPhys(src_l0.entries[l0_idx]);
-                    const new_page = pmm.allocPage() orelse return null;
+/// Child-side table at `idx` for copyUserHalf: reuse the private copy
+/// createAddressSpace() already made (identity map), else allocate one.
+fn cloneTable(parent: *PageTable, idx: usize) ?*PageTable {
+    const entry = parent.entries[idx];
+    if (entry & Flags.VALID != 0 and !isLeaf(entry)) return tablePtr(pteToPhys(entry));
+    const page = pmm.allocPage() orelse return null;
+    const table: *PageTable = tablePtr(page);
+    table.zero();
+    // Non-leaf: only VALID bit (no U/A/D — reserved on riscv64)
+    parent.entries[idx] = physToPte(page) | Flags.VALID;
+    return table;
+}
 
-                    // Copy 4KB page content
-                    const src_ptr: [*]const u8 = physPtr(src_phys);
-                    const dst_ptr: [*]u8 = physPtr(new_page);
-                    @memcpy(dst_ptr[0..mem.PAGE_SIZE], src_ptr[0..mem.PAGE_SIZE]);
+/// Share the user page behind `src_pte` and return the child's PTE.
+/// Writable pages become read-only + COW in both address spaces; read-only
+/// pages (text, rodata) are simply shared. Falls back to a private copy if
+/// the frame's reference count is saturated.
+fn shareUserPage(src_pte: *u64) ?u64 {
+    const pte = src_pte.*;
+    const phys = pteToPhys(pte);
+    if (!pmm.refPage(phys)) {
+        const page = pmm.allocPage() orelse return null;
+        @memcpy(physPtr(page)[0..PAGE_SIZE], physPtr(phys)[0..PAGE_SIZE]);
+        return physToPte(page) | (pte & 0x3FF);
+    }
+    if (pte & (Flags.WRITE | Flags.COW) == 0) return pte;
+    const shared = (pte & ~Flags.WRITE) | Flags.COW;
+    src_pte.* = shared;
+    return shared;
+}
 
-                    // Preserve flags, point to new physical page
-                    const flags_bits = src_l0.entries[l0_idx] & 0x3FF; // low 10 bits are flags
-                    new_l0.entries[l0_idx] = physToPte(new_page) | flags_bits;
-                }
+/// Take a reference on each 4KB user page backing `frames.len` pages at
+/// `virt` and store its frame in `frames`. Writable pages become read-only
+/// + COW, so later writes by the owner copy instead of changing the shared
+/// frames. All-or-nothing: returns false (having dropped the references it
+/// took) if a page is missing or not a user page. The caller serializes
+/// CoW updates and flushes the owner's TLB.
+pub fn shareUserPages(pml4: *PageTable, virt: u64, frames: []u64) bool {
+    for (frames, 0..) |*frame, i| {
+        const pte = leafPte(pml4, virt + i * PAGE_SIZE) orelse return unshareFrames(frames[0..i]);
+        const entry = pte.*;
+        if (entry & (Flags.VALID | Flags.USER) != Flags.VALID | Flags.USER) return unshareFrames(frames[0..i]);
+        const phys = pteToPhys(entry);
+        if (!pmm.refPage(phys)) return unshareFrames(frames[0..i]);
+        frame.* = phys;
+        if (entry & Flags.WRITE != 0) pte.* = (entry & ~Flags.WRITE) | Flags.COW;
+    }
+    return true;
+}
 
-                // Non-leaf: only VALID bit (no U/A/D — reserved on riscv64)
-                new_l1.entries[l1_idx] = physToPte(new_l0_page) | Flags.VALID;
-            }
+fn unshareFrames(frames: []const u64) bool {
+    for (frames) |phys| pmm.freePage(phys);
+    return false;
+}
 
-            new_l2.entries[l2_idx] = physToPte(new_l1_page) | Flags.VALID;
-        }
+/// What resolveCow did with a store fault.
+pub const CowFault = enum {
+    /// Not a copy-on-write page: a genuine protection fault.
+    not_cow,
+    /// Sole owner (or already resolved): the PTE is writable in place.
+    reused,
+    /// The frame was still shared: the page now has a private copy.
+    copied,
+    /// A copy was needed but no page was free.
+    no_memory,
+};
 
-        new_root.entries[l3_idx] = physToPte(new_l2_page) | Flags.VALID;
+/// Resolve a store fault at `virt` against a COW PTE. The caller serializes
+/// CoW updates to the same tables and flushes the TLB afterwards — the
+/// local entry always, other harts running these tables after .copied.
+pub fn resolveCow(root: *PageTable, virt: u64) CowFault {
+    const pte = leafPte(root, virt) orelse return .not_cow;
+    const entry = pte.*;
+    if (entry & (Flags.VALID | Flags.USER) != Flags.VALID | Flags.USER) return .not_cow;
+    // Lost a race with another thread, or a stale read-only TLB entry
+    if (entry & Flags.WRITE != 0) return .reused;
+    if (entry & Flags.COW == 0) return .not_cow;
+
+    const phys = pteToPhys(entry);
+    const flags = (entry & 0x3FF & ~Flags.COW) | Flags.WRITE | Flags.DIRTY;
+    if (!pmm.isShared(phys)) {
+        pte.* = physToPte(phys) | flags;
+        return .reused;
     }
-
-    return new_root;
+    const page = pmm.allocPage() orelse return .no_memory;
+    @memcpy(physPtr(page)[0..PAGE_SIZE], physPtr(phys)[0..PAGE_SIZE]);
+    pte.* = physToPte(page) | flags;
+    pmm.freePage(phys); // drops this address space's reference
+    return .copied;
 }
 
 /// Map a single 4KB page in the given address space.
@@ -320,29 +410,24 @@ pub fn mapPage(root: *PageTable, virt: u64, phys: u64, flags: u64) ?void {
     const l0 = getOrAllocTable(l1, l1_idx, 0) orelse return null;
 
     l0.entries[@intCast(l0_idx)] = physToPte(phys) | flags | Flags.VALID | Flags.READ | Flags.ACCESSED | Flags.DIRTY;
+    // A hart may cache invalid entries, and with ASIDs a root can come
+    // back without a full flush: drop any stale "not mapped" for `virt`.
+    invalidatePage(virt);
 }
 
-/// Unmap a single 4KB page.
-pub fn unmapPage(root: *PageTable, virt: u64) void {
-    const l3_idx: usize = @intCast((virt >> 39) & 0x1FF);
-    const l2_idx: usize = @intCast((virt >> 30) & 0x1FF);
-    const l1_idx: usize = @intCast((virt >> 21) & 0x1FF);
-    const l0_idx: usize = @intCast((virt >> 12) & 0x1FF);
-
-    if (root.entries[l3_idx] & Flags.VALID == 0) return;
-    const l2: *PageTable = tablePtr(pteToPhys(root.entries[l3_idx]));
-
-    if (l2.entries[l2_idx] & Flags.VALID == 0) return;
-    if (isLeaf(l2.entries[l2_idx])) return; // Can't unmap inside a superpage
-    const l1: *PageTable = tablePtr(pteToPhys(l2.entries[l2_idx]));
-
-    if (l1.entries[l1_idx] & Flags.VALID == 0) return;
-    if (isLeaf(l1.entries[l1_idx])) return; // Can't unmap inside a superpage
-    const l0: *PageTable = tablePtr(pteToPhys(l1.entries[l1_idx]));
-
-    l0.entries[l0_idx] = 0;
+/// Unmap a single 4KB user page. Returns the frame it mapped, or null if
+/// nothing user-visible was mapped there. Stale translations are left to
+/// the caller (see tlb.shootdown), which frees the frame afterwards.
+pub fn unmapPage(root: *PageTable, virt: u64) ?u64 {
+    const pte = leafPte(root, virt) orelse return null;
+    const entry = pte.*;
+    if (entry & (Flags.VALID | Flags.USER) != Flags.VALID | Flags.USER) return null;
+    pte.* = 0;
+    return pteToPhys(entry);
+}
 
-    // Invalidate TLB for this address
+/// Invalidate this hart's TLB entry for `virt`.
+pub fn invalidatePage(virt: u64) void {
     asm volatile ("sfence.vma %[addr], zero"
         :
         : [addr] "r" (virt),
@@ -350,21 +435,62 @@ pub fn unmapPage(root: *PageTable, virt: u64) void {
     );
 }
 
-/// Switch to a different address space.
-pub fn switchAddressSpace(root: *PageTable) void {
-    const virt = @intFromPtr(root);
-    const phys = if (virt >= mem.KERNEL_VIRT_BASE) virt - mem.KERNEL_VIRT_BASE else virt;
-    const satp_val: u64 = (@as(u64, 9) << 60) | (phys >> 12);
+// ── ASIDs ───────────────────────────────────────────────────────────
+
+/// Number of ASIDs tlb.zig may hand out; 0 when the hart implements none
+/// and every SATP write is followed by a full sfence.vma.
+pub var tag_count: u16 = 0;
+
+const SATP_ASID_SHIFT = 44;
+const SATP_ASID_MASK: u64 = 0xFFFF << SATP_ASID_SHIFT;
+
+/// Find how many ASID bits the hart implements: write all ones to the
+/// SATP ASID field and see which stick. The kernel root stays ASID 0.
+fn probeAsids(satp_val: u64) void {
+    cpu.csrWrite(cpu.CSR_SATP, satp_val | SATP_ASID_MASK);
+    const bits = @popCount((cpu.csrRead(cpu.CSR_SATP) & SATP_ASID_MASK) >> SATP_ASID_SHIFT);
     cpu.csrWrite(cpu.CSR_SATP, satp_val);
     asm volatile ("sfence.vma" ::: .{ .memory = true });
+    if (bits > 0) tag_count = @intCast(@min(@as(u32, 1) << @intCast(bits), 4096));
+}
+
+/// Switch to a different address space, tagged `tag` (ignored without
+/// ASIDs). `flush` discards whatever is cached under `tag`; otherwise the
+/// translations from the last time this root ran under `tag` are reused.
+pub fn switchAddressSpace(root: *PageTable, tag: u16, flush: bool) void {
+    const virt = @intFromPtr(root);
+    const phys = if (virt >= mem.KERNEL_VIRT_BASE) virt - mem.KERNEL_VIRT_BASE else virt;
+    if (tag_count == 0) {
+        cpu.csrWrite(cpu.CSR_SATP, (@as(u64, 9) << 60) | (phys >> 12));
+        asm volatile ("sfence.vma" ::: .{ .memory = true });
+        return;
+    }
+    cpu.csrWrite(cpu.CSR_SATP, (@as(u64, 9) << 60) | (@as(u64, tag) << SATP_ASID_SHIFT) | (phys >> 12));
+    if (flush) asm volatile ("sfence.vma zero, %[asid]"
+        :
+        : [asid] "r" (@as(u64, tag)),
+        : .{ .memory = true }
+    );
 }
 
-/// Switch SATP to the kernel's root page table.
+/// Switch SATP to the kernel's root page table (ASID 0, whose mappings
+/// never change, so nothing is flushed).
 /// Must be called before freeAddressSpace() to avoid walking freed page tables.
 pub fn switchToKernel() void {
     const satp_val: u64 = (@as(u64, 9) << 60) | (kernel_root_phys >> 12);
     cpu.csrWrite(cpu.CSR_SATP, satp_val);
-    asm volatile ("sfence.vma" ::: .{ .memory = true });
+    if (tag_count == 0) asm volatile ("sfence.vma" ::: .{ .memory = true });
+}
+
+/// Invalidate `virt` under `tag`, which need not be the current ASID.
+pub fn invalidateTagPage(tag: u16, virt: u64) bool {
+    asm volatile ("sfence.vma %[addr], %[asid]"
+        :
+        : [addr] "r" (virt),
+          [asid] "r" (@as(u64, tag)),
+        : .{ .memory = true }
+    );
+    return true;
 }
 
 /// Get the kernel root page table.
@@ -403,6 +529,29 @@ pub fn translateVaddr(root: *PageTable, virt: u64) ?u64 {
     return pteToPhys(l0.entries[l0_idx]) | (virt & 0xFFF);
 }
 
+/// Like translateVaddr, but only for a 4KB user page: returns null unless
+/// the leaf is VALID and USER (and WRITE when `write` is set). Used for
+/// kernel-mediated copies into another process's memory.
+pub fn translateUser(root: *PageTable, virt: u64, write: bool) ?u64 {
+    const pte = (leafPte(root, virt) orelse return null).*;
+    const need = Flags.VALID | Flags.USER | (if (write) Flags.WRITE else 0);
+    if (pte & need != need) return null;
+    return pteToPhys(pte) | (virt & 0xFFF);
+}
+
+/// The 4KB leaf PTE slot for `virt`, or null if an intermediate table is
+/// missing or the address lies in a superpage.
+fn leafPte(root: *PageTable, virt: u64) ?*u64 {
+    var table = root;
+    var shift: u6 = 39;
+    while (shift > 12) : (shift -= 9) {
+        const pte = table.entries[@intCast((virt >> shift) & 0x1FF)];
+        if (pte & Flags.VALID == 0 or isLeaf(pte)) return null;
+        table = tablePtr(pteToPhys(pte));
+    }
+    return &table.entries[@intCast((virt >> 12) & 0x1FF)];
+}
+
 /// Free all user-half pages and page tables in an address space.
 pub fn freeAddressSpace(root: *PageTable) void {
     // Walk user-half only (entries 0-255). Kernel half (256-511) is shared.
@@ -1,12 +1,15 @@
 /// Local APIC driver + ACPI MADT parser + AP startup.
 ///
 /// Parses the ACPI MADT to discover LAPIC IDs, initializes the BSP's LAPIC,
-/// and boots Application Processors (APs) via INIT-SIPI-SIPI.
+/// and boots Application Processors (APs) via INIT-SIPI-SIPI. The FADT is
+/// read on the same pass for the PM timer port, which timer.zig uses as
+/// its clock when the TSC is not invariant.
 /// APs enter an idle loop, ready for Phase D scheduling.
 const klog = @import("../../klog.zig");
 const cpu = @import("cpu.zig");
 const gdt = @import("gdt.zig");
 const idt = @import("idt.zig");
+const paging = @import("paging.zig");
 const percpu = @import("../../percpu.zig");
 const mem = @import("../../mem.zig");
 const pmm = @import("../../pmm.zig");
@@ -59,6 +62,12 @@ const MadtLocalApic = extern struct {
 const MADT_LOCAL_APIC = 0;
 const MADT_IO_APIC = 1;
 
+// FADT field offsets
+const FADT_PM_TMR_BLK = 76; // u32 I/O port
+const FADT_PM_TMR_LEN = 91; // u8, 4 when the timer exists
+const FADT_FLAGS = 112; // u32
+const FADT_TMR_VAL_EXT = 1 << 8; // counter is 32 bits, not 24
+
 // ── LAPIC registers (MMIO, at LAPIC base + offset) ──────────────────
 
 const LAPIC_ID = 0x020;
@@ -86,6 +95,7 @@ const ICR_LEVEL_DEASSERT = 0x00000000;
 // IPI vectors
 pub const IPI_SCHEDULE: u8 = 0xFE;
 pub const IPI_TLB_SHOOTDOWN: u8 = 0xFD;
+pub const TIMER_VECTOR: u8 = 0xFC;
 
 // ── Module state ─────────────────────────────────────────────────────
 
@@ -96,6 +106,10 @@ var lapic_virt: u64 = 0; // Higher-half virtual address for MMIO
 pub var lapic_ids: [percpu.MAX_CORES]u8 = [_]u8{0} ** percpu.MAX_CORES;
 pub var core_count: u8 = 0;
 
+/// ACPI PM timer (3.579545 MHz, fixed rate): I/O port, 0 if there is none.
+pub var pm_timer_port: u16 = 0;
+pub var pm_timer_32bit: bool = false;
+
 /// Convert physical address to higher-half virtual address.
 inline fn physToVirt(phys: u64) u64 {
     return phys +% mem.KERNEL_VIRT_BASE;
@@ -169,6 +183,21 @@ fn parseMadt(madt_phys: u64) void {
     }
 }
 
+fn parseFadt(fadt_phys: u64) void {
+    const fadt: [*]const u8 = @ptrFromInt(physToVirt(fadt_phys));
+    const header: *align(1) const AcpiSdtHeader = @ptrCast(fadt);
+    if (header.length < FADT_FLAGS + 4) return;
+    const port = @as(*align(1) const u32, @ptrCast(fadt + FADT_PM_TMR_BLK)).*;
+    if (port == 0 or port > 0xFFFF or fadt[FADT_PM_TMR_LEN] != 4) return;
+    const flags = @as(*align(1) const u32, @ptrCast(fadt + FADT_FLAGS)).*;
+    pm_timer_port = @intCast(port);
+    pm_timer_32bit = flags & FADT_TMR_VAL_EXT != 0;
+    klog.info("FADT: PM timer at port 0x");
+    klog.infoHex(port);
+    klog.info(if (pm_timer_32bit) ", 32-bit\n" else ", 24-bit\n");
+}
+
+/// Walk the XSDT for the MADT (required) and the FADT (optional).
 fn findMadt(rsdp_ptr: [*]const u8) bool {
     const rsdp: *align(1) const RsdpV2 = @ptrCast(rsdp_ptr);
 
@@ -188,20 +217,57 @@ fn findMadt(rsdp_ptr: [*]const u8) bool {
     const entries_len = (xsdt.length - @sizeOf(AcpiSdtHeader)) / 8;
     const entries_base = physToVirt(rsdp.xsdt_address) + @sizeOf(AcpiSdtHeader);
 
+    var found = false;
     for (0..entries_len) |i| {
         const entry_ptr: *align(1) const u64 = @ptrFromInt(entries_base + i * 8);
         const table_phys = entry_ptr.*;
         const table: *align(1) const AcpiSdtHeader = @ptrFromInt(physToVirt(table_phys));
         if (eqlBytes(&table.signature, "APIC")) {
             parseMadt(table_phys);
-            return true;
+            found = true;
+        } else if (eqlBytes(&table.signature, "FACP")) {
+            parseFadt(table_phys);
         }
     }
+    if (found) return true;
 
     klog.err("ACPI: MADT not found in XSDT\n");
     return false;
 }
 
+// ── LAPIC timer ─────────────────────────────────────────────────────
+
+/// LVT timer mode bits; every mode fires TIMER_VECTOR.
+pub const TimerMode = enum(u32) {
+    masked = 0x1_0000,
+    one_shot = 0x0_0000,
+    tsc_deadline = 0x4_0000,
+};
+
+const TIMER_DIVIDE_16 = 0x3;
+
+/// Whether this machine has a usable local APIC.
+pub fn available() bool {
+    return lapic_virt != 0;
+}
+
+/// Set this core's LAPIC timer mode (counting at bus clock / 16). In
+/// TSC-deadline mode it is armed through IA32_TSC_DEADLINE, otherwise by
+/// setTimerCount().
+pub fn setupTimer(mode: TimerMode) void {
+    lapicWrite(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapicWrite(LAPIC_TIMER_LVT, @intFromEnum(mode) | TIMER_VECTOR);
+}
+
+/// Start a countdown of `count` timer ticks; 0 stops the timer.
+pub fn setTimerCount(count: u32) void {
+    lapicWrite(LAPIC_TIMER_INIT, count);
+}
+
+pub fn timerCount() u32 {
+    return lapicRead(LAPIC_TIMER_CURRENT);
+}
+
 // ── LAPIC initialization ────────────────────────────────────────────
 
 fn initLapic() void {
@@ -310,10 +376,10 @@ const trampoline_code = [_]u8{
 
 /// Copy trampoline to 0x8000 and patch data area for the given AP.
 fn setupApTrampoline(stack_top: u64, entry: u64) void {
-    // Read BSP's CR3
-    const cr3: u64 = asm volatile ("mov %%cr3, %[cr3]"
+    // Read BSP's CR3, minus its PCID (the AP enables PCID itself)
+    const cr3: u64 = (asm volatile ("mov %%cr3, %[cr3]"
         : [cr3] "=r" (-> u64),
-    );
+    )) & ~@as(u64, 0xFFF);
 
     // Copy trampoline code to physical 0x8000 (identity-mapped)
     const dest: [*]u8 = @ptrFromInt(TRAMPOLINE_BASE);
@@ -359,6 +425,8 @@ export fn apEntry() callconv(.{ .x86_64_sysv = .{} }) noreturn {
     // Load BSP's GDT (replaces trampoline GDT) and IDT
     gdt.reloadGdtForAp();
     idt.reloadForAp();
+    cpu.enableWriteProtect();
+    paging.enableTags();
 
     // Enable this AP's local APIC
     lapicWrite(LAPIC_SVR, SVR_ENABLE | SVR_SPURIOUS_VECTOR);
@@ -366,6 +434,7 @@ export fn apEntry() callconv(.{ .x86_64_sysv = .{} }) noreturn {
 
     // Set up per-CPU state
     percpu.percpu_array[core_id].core_id = core_id;
+    percpu.percpu_array[core_id].llc_id = percpu.llcId();
     percpu.percpu_array[core_id].online = true;
 
     // Set KERNEL_GS_BASE + GS_BASE for swapgs
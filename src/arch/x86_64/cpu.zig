@@ -94,10 +94,52 @@ pub fn readCr3() u64 {
     );
 }
 
+/// Read CR4 (feature control).
+pub fn readCr4() u64 {
+    return asm volatile ("mov %%cr4, %[cr4]"
+        : [cr4] "=r" (-> u64),
+    );
+}
+
+/// Write CR4.
+pub fn writeCr4(val: u64) void {
+    asm volatile ("mov %[cr4], %%cr4"
+        :
+        : [cr4] "r" (val),
+        : .{ .memory = true });
+}
+
 pub inline fn spinHint() void {
     asm volatile ("pause");
 }
 
+/// Save the x87/MMX/SSE registers to a 512-byte, 16-byte-aligned area.
+pub inline fn fxsave(area: *align(16) [512]u8) void {
+    asm volatile ("fxsave64 (%[area])"
+        :
+        : [area] "r" (area),
+        : .{ .memory = true });
+}
+
+/// Load the x87/MMX/SSE registers from an fxsave area.
+pub inline fn fxrstor(area: *align(16) const [512]u8) void {
+    asm volatile ("fxrstor64 (%[area])"
+        :
+        : [area] "r" (area),
+        : .{ .memory = true });
+}
+
+/// Time-stamp counter.
+pub inline fn rdtsc() u64 {
+    var lo: u32 = undefined;
+    var hi: u32 = undefined;
+    asm volatile ("rdtsc"
+        : [lo] "={eax}" (lo),
+          [hi] "={edx}" (hi),
+    );
+    return (@as(u64, hi) << 32) | lo;
+}
+
 /// Single HLT with interrupts enabled — yields the vCPU so QEMU's event
 /// loop can process pending device I/O (AIO completions, virtio kicks).
 /// Unlike halt() this returns once an interrupt fires.
@@ -116,6 +158,20 @@ pub fn flushTlb() void {
     );
 }
 
+/// Set CR0.WP so supervisor writes honour read-only PTEs. Kernel copies
+/// into user buffers then take copy-on-write faults instead of silently
+/// writing a shared frame. Per core; run on the BSP and every AP.
+pub fn enableWriteProtect() void {
+    asm volatile (
+        \\mov %%cr0, %%rax
+        \\or $0x10000, %%rax
+        \\mov %%rax, %%cr0
+        :
+        :
+        : .{ .rax = true, .memory = true }
+    );
+}
+
 /// ACPI shutdown: write S5 sleep type to QEMU PM1a control port.
 pub fn acpiShutdown() noreturn {
     outw(0x604, 0x2000);
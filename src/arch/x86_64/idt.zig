@@ -59,8 +59,8 @@ pub const ExceptionFrame = extern struct {
 /// ISR stub address table defined in entry.S.
 extern const isr_stub_table: [48]u64;
 
-/// IPI stub addresses defined in entry.S: [0]=vec 253, [1]=vec 254, [2]=vec 255.
-extern const ipi_stub_table: [3]u64;
+/// LAPIC timer and IPI stub addresses defined in entry.S: [0]=vec 252, [1]=vec 253, [2]=vec 254, [3]=vec 255.
+extern const ipi_stub_table: [4]u64;
 
 /// Exception handler wrapper called from entry.S using System V ABI.
 export fn handleExceptionWrapper(frame: *ExceptionFrame) callconv(.{ .x86_64_sysv = .{} }) void {
@@ -86,10 +86,11 @@ pub fn init() void {
         setGate(@intCast(i), isr_stub_table[i]);
     }
 
-    // Install IPI handlers (vectors 253-255) for SMP
-    setGate(253, ipi_stub_table[0]); // TLB shootdown
-    setGate(254, ipi_stub_table[1]); // Schedule IPI
-    setGate(255, ipi_stub_table[2]); // Spurious APIC
+    // Install LAPIC timer and IPI handlers (vectors 252-255)
+    setGate(252, ipi_stub_table[0]); // LAPIC timer
+    setGate(253, ipi_stub_table[1]); // TLB shootdown
+    setGate(254, ipi_stub_table[2]); // Schedule IPI
+    setGate(255, ipi_stub_table[3]); // Spurious APIC
 
     idt_ptr = .{
         .limit = @sizeOf(@TypeOf(idt_entries)) - 1,
@@ -101,7 +102,7 @@ pub fn init() void {
         : [idt_ptr] "r" (&idt_ptr),
     );
 
-    klog.info("IDT: loaded (256 entries, 51 handlers)\n");
+    klog.info("IDT: loaded (256 entries, 52 handlers)\n");
 }
 
 /// Reload IDT on an AP core (reuses BSP's IDT).
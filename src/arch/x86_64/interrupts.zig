@@ -6,6 +6,7 @@ const cpu = @import("cpu.zig");
 const paging = @import("paging.zig");
 const supervisor = @import("../../supervisor.zig");
 const process = @import("../../process.zig");
+const trace = @import("../../trace.zig");
 const pic = @import("../../pic.zig");
 const apic = @import("apic.zig");
 
@@ -81,17 +82,16 @@ inline fn inlineHex(val: u64) void {
 }
 
 pub fn handleException(frame: *idt.ExceptionFrame) void {
-    // IPI dispatch (vectors 253-255, LAPIC-sourced)
-    if (frame.vector >= 253) {
+    // LAPIC timer and IPI dispatch (vectors 252-255, LAPIC-sourced)
+    if (frame.vector >= 252) {
         switch (frame.vector) {
+            252 => {
+                // LAPIC one-shot timer — run this core's expired timers
+                @import("../../timer.zig").handleInterrupt();
+            },
             253 => {
-                // TLB shootdown IPI — flush TLB if pending
-                const percpu = @import("../../percpu.zig");
-                const my_core = percpu.getCoreId();
-                if (@atomicLoad(bool, &percpu.percpu_array[my_core].tlb_flush_pending, .acquire)) {
-                    cpu.flushTlb();
-                    @atomicStore(bool, &percpu.percpu_array[my_core].tlb_flush_pending, false, .release);
-                }
+                // TLB shootdown IPI — invalidate what other cores posted
+                @import("../../tlb.zig").handleIpi();
             },
             254 => {
                 // Schedule IPI — wakes core from hlt; run queue checked in scheduler loop
@@ -133,6 +133,16 @@ pub fn handleException(frame: *idt.ExceptionFrame) void {
         return;
     }
 
+    if (trace.enabled and frame.vector == 14) {
+        const pid = if (process.getCurrent()) |p| p.pid else 0;
+        trace.point(.page_fault, pid, cpu.readCr2(), frame.error_code);
+    }
+
+    // #PF on a present page during a write (error code P|W): copy-on-write
+    // after fork, from user mode or from the kernel writing a user buffer.
+    // Once resolved, returning retries the faulting instruction.
+    if (frame.vector == 14 and frame.error_code & 3 == 3 and process.handleCowFault(cpu.readCr2())) return;
+
     // Check if the fault came from user mode (RPL=3 in CS)
     const from_user = (frame.cs & 3) == 3;
 
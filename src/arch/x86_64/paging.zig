@@ -11,6 +11,7 @@
 const klog = @import("../../klog.zig");
 const pmm = @import("../../pmm.zig");
 const mem = @import("../../mem.zig");
+const cpu = @import("cpu.zig");
 
 const PAGE_SIZE = mem.PAGE_SIZE;
 
@@ -25,6 +26,7 @@ pub const Flags = struct {
     pub const DIRTY: u64 = 1 << 6;
     pub const HUGE_PAGE: u64 = 1 << 7; // 2MB in PD, 1GB in PDPT
     pub const GLOBAL: u64 = 1 << 8;
+    pub const COW: u64 = 1 << 9; // software bit: shared copy-on-write page
     pub const NO_EXECUTE: u64 = @as(u64, 1) << 63;
     pub const EXEC: u64 = 0; // x86_64: pages are executable by default; no-op for compat with riscv64
 };
@@ -93,6 +95,8 @@ pub fn init() void {
         :
         : [cr3] "r" (kernel_pml4_phys),
         : .{ .memory = true });
+    cpu.enableWriteProtect();
+    enableTags();
 
     initialized = true;
 
@@ -216,74 +220,166 @@ pub fn createAddressSpace() ?*PageTable {
     return new_pml4;
 }
 
-/// Deep-copy the entire user-half address space (PML4 entries 1-255) for fork.
-/// Entry 0 (identity map) is handled by createAddressSpace(). The kernel half
-/// (entries 256-511) is shared. Each 4KB user page is fully copied (no COW).
-pub fn deepCopyAddressSpace(src_pml4: *PageTable) ?*PageTable {
-    // Create base address space (kernel half + identity map deep-copy)
+/// Copy-on-write clone of the user half (PML4 entries 0-255) for fork.
+/// Page tables are copied; user pages are not. Each user frame is mapped by
+/// both address spaces and gains a reference (pmm.refPage). Writable pages
+/// lose WRITABLE and gain COW on both sides, so the first write from either
+/// side faults into resolveCow. Non-user leaves (identity map under entry 0)
+/// are copied as-is; the kernel half is shared via createAddressSpace().
+///
+/// The source's PTEs are write-protected in place: the caller must flush
+/// its TLB on every core that may be running it. On failure the partial
+/// copy is freed (dropping the references it took) and null is returned.
+pub fn cowCopyAddressSpace(src_pml4: *PageTable) ?*PageTable {
     const new_pml4 = createAddressSpace() orelse return null;
+    copyUserHalf(src_pml4, new_pml4) catch {
+        freeAddressSpace(new_pml4);
+        return null;
+    };
+    return new_pml4;
+}
 
-    // Walk PML4 entries 1-255 (user half, excluding entry 0 identity map)
-    for (1..256) |pml4_idx| {
-        if (src_pml4.entries[pml4_idx] & Flags.PRESENT == 0) continue;
-        const src_pdpt: *PageTable = tablePtr(src_pml4.entries[pml4_idx] & ADDR_MASK);
-
-        const new_pdpt_page = pmm.allocPage() orelse return null;
-        const new_pdpt: *PageTable = tablePtr(new_pdpt_page);
-        new_pdpt.zero();
+fn copyUserHalf(src_pml4: *PageTable, new_pml4: *PageTable) error{OutOfMemory}!void {
+    for (0..256) |pml4_idx| {
+        const pml4e = src_pml4.entries[pml4_idx];
+        if (pml4e & Flags.PRESENT == 0) continue;
+        const src_pdpt: *PageTable = tablePtr(pml4e & ADDR_MASK);
+        const new_pdpt = cloneTable(new_pml4, pml4_idx, pml4e) orelse return error.OutOfMemory;
 
         for (0..512) |pdpt_idx| {
-            if (src_pdpt.entries[pdpt_idx] & Flags.PRESENT == 0) continue;
-            if (src_pdpt.entries[pdpt_idx] & Flags.HUGE_PAGE != 0) {
+            const pdpte = src_pdpt.entries[pdpt_idx];
+            if (pdpte & Flags.PRESENT == 0) continue;
+            if (pdpte & Flags.HUGE_PAGE != 0) {
                 // 1GB huge page — copy entry as-is (shared, part of identity map)
-                new_pdpt.entries[pdpt_idx] = src_pdpt.entries[pdpt_idx];
+                new_pdpt.entries[pdpt_idx] = pdpte;
                 continue;
             }
-            const src_pd: *PageTable = tablePtr(src_pdpt.entries[pdpt_idx] & ADDR_MASK);
-
-            const new_pd_page = pmm.allocPage() orelse return null;
-            const new_pd: *PageTable = tablePtr(new_pd_page);
-            new_pd.zero();
+            const src_pd: *PageTable = tablePtr(pdpte & ADDR_MASK);
+            const new_pd = cloneTable(new_pdpt, pdpt_idx, pdpte) orelse return error.OutOfMemory;
 
             for (0..512) |pd_idx| {
-                if (src_pd.entries[pd_idx] & Flags.PRESENT == 0) continue;
-                if (src_pd.entries[pd_idx] & Flags.HUGE_PAGE != 0) {
+                const pde = src_pd.entries[pd_idx];
+                if (pde & Flags.PRESENT == 0) continue;
+                if (pde & Flags.HUGE_PAGE != 0) {
                     // 2MB huge page — copy entry as-is (identity map region)
-                    new_pd.entries[pd_idx] = src_pd.entries[pd_idx];
+                    new_pd.entries[pd_idx] = pde;
                     continue;
                 }
-                const src_pt: *PageTable = tablePtr(src_pd.entries[pd_idx] & ADDR_MASK);
+                const src_pt: *PageTable = tablePtr(pde & ADDR_MASK);
 
-                const new_pt_page = pmm.allocPage() orelse return null;
+                // Link the new PT before filling it so a failure part-way
+                // leaves a tree freeAddressSpace() can walk.
+                const new_pt_page = pmm.allocPage() orelse return error.OutOfMemory;
                 const new_pt: *PageTable = tablePtr(new_pt_page);
                 new_pt.zero();
+                new_pd.entries[pd_idx] = new_pt_page | (pde & ~ADDR_MASK);
 
                 for (0..512) |pt_idx| {
-                    if (src_pt.entries[pt_idx] & Flags.PRESENT == 0) continue;
-                    if (src_pt.entries[pt_idx] & Flags.USER == 0) continue; // skip non-user pages
+                    const pte = src_pt.entries[pt_idx];
+                    if (pte & Flags.PRESENT == 0) continue;
+                    if (pte & Flags.USER == 0) {
+                        // Split identity-map page, not owned by the process
+                        new_pt.entries[pt_idx] = pte;
+                        continue;
+                    }
+                    new_pt.entries[pt_idx] = shareUserPage(&src_pt.entries[pt_idx]) orelse return error.OutOfMemory;
+                }
+            }
+        }
+    }
+}
 
-                    const src_phys = src_pt.entries[pt_idx] & ADDR_MASK;
-                    const new_page = pmm.allocPage() orelse return null;
+/// Child-side table at `idx` for copyUserHalf: reuse the private copy
+/// createAddressSpace() already made (identity map), else allocate one.
+fn cloneTable(parent: *PageTable, idx: usize, src_entry: u64) ?*PageTable {
+    const entry = parent.entries[idx];
+    if (entry & Flags.PRESENT != 0 and entry & Flags.HUGE_PAGE == 0) {
+        parent.entries[idx] = entry | (src_entry & (Flags.USER | Flags.WRITABLE));
+        return tablePtr(entry & ADDR_MASK);
+    }
+    const page = pmm.allocPage() orelse return null;
+    const table: *PageTable = tablePtr(page);
+    table.zero();
+    parent.entries[idx] = page | (src_entry & ~ADDR_MASK);
+    return table;
+}
 
-                    // Copy 4KB page content
-                    const src_ptr: [*]const u8 = physPtr(src_phys);
-                    const dst_ptr: [*]u8 = physPtr(new_page);
-                    @memcpy(dst_ptr[0..mem.PAGE_SIZE], src_ptr[0..mem.PAGE_SIZE]);
+/// Share the user page behind `src_pte` and return the child's PTE.
+/// Writable pages become read-only + COW in both address spaces; read-only
+/// pages (text, rodata) are simply shared. Falls back to a private copy if
+/// the frame's reference count is saturated.
+fn shareUserPage(src_pte: *u64) ?u64 {
+    const pte = src_pte.*;
+    const phys = pte & ADDR_MASK;
+    if (!pmm.refPage(phys)) {
+        const page = pmm.allocPage() orelse return null;
+        @memcpy(physPtr(page)[0..PAGE_SIZE], physPtr(phys)[0..PAGE_SIZE]);
+        return page | (pte & ~ADDR_MASK);
+    }
+    if (pte & (Flags.WRITABLE | Flags.COW) == 0) return pte;
+    const shared = (pte & ~Flags.WRITABLE) | Flags.COW;
+    src_pte.* = shared;
+    return shared;
+}
 
-                    // Preserve flags, point to new physical page
-                    new_pt.entries[pt_idx] = new_page | (src_pt.entries[pt_idx] & ~ADDR_MASK);
-                }
+/// Take a reference on each 4KB user page backing `frames.len` pages at
+/// `virt` and store its frame in `frames`. Writable pages become read-only
+/// + COW, so later writes by the owner copy instead of changing the shared
+/// frames. All-or-nothing: returns false (having dropped the references it
+/// took) if a page is missing or not a user page. The caller serializes
+/// CoW updates and flushes the owner's TLB.
+pub fn shareUserPages(pml4: *PageTable, virt: u64, frames: []u64) bool {
+    for (frames, 0..) |*frame, i| {
+        const pte = leafPte(pml4, virt + i * PAGE_SIZE) orelse return unshareFrames(frames[0..i]);
+        const entry = pte.*;
+        if (entry & (Flags.PRESENT | Flags.USER) != Flags.PRESENT | Flags.USER) return unshareFrames(frames[0..i]);
+        const phys = (entry & ADDR_MASK);
+        if (!pmm.refPage(phys)) return unshareFrames(frames[0..i]);
+        frame.* = phys;
+        if (entry & Flags.WRITABLE != 0) pte.* = (entry & ~Flags.WRITABLE) | Flags.COW;
+    }
+    return true;
+}
 
-                new_pd.entries[pd_idx] = new_pt_page | (src_pd.entries[pd_idx] & ~ADDR_MASK);
-            }
+fn unshareFrames(frames: []const u64) bool {
+    for (frames) |phys| pmm.freePage(phys);
+    return false;
+}
 
-            new_pdpt.entries[pdpt_idx] = new_pd_page | (src_pdpt.entries[pdpt_idx] & ~ADDR_MASK);
-        }
+/// What resolveCow did with a write fault.
+pub const CowFault = enum {
+    /// Not a copy-on-write page: a genuine protection fault.
+    not_cow,
+    /// Sole owner (or already resolved): the PTE is writable in place.
+    reused,
+    /// The frame was still shared: the page now has a private copy.
+    copied,
+    /// A copy was needed but no page was free.
+    no_memory,
+};
 
-        new_pml4.entries[pml4_idx] = new_pdpt_page | (src_pml4.entries[pml4_idx] & ~ADDR_MASK);
+/// Resolve a write fault at `virt` against a COW PTE. The caller serializes
+/// CoW updates to the same tables and flushes the TLB afterwards — the
+/// local entry always, other cores running these tables after .copied.
+pub fn resolveCow(pml4: *PageTable, virt: u64) CowFault {
+    const pte = leafPte(pml4, virt) orelse return .not_cow;
+    const entry = pte.*;
+    if (entry & (Flags.PRESENT | Flags.USER) != Flags.PRESENT | Flags.USER) return .not_cow;
+    // Lost a race with another thread, or a stale read-only TLB entry
+    if (entry & Flags.WRITABLE != 0) return .reused;
+    if (entry & Flags.COW == 0) return .not_cow;
+
+    const phys = entry & ADDR_MASK;
+    const flags = (entry & ~ADDR_MASK & ~Flags.COW) | Flags.WRITABLE;
+    if (!pmm.isShared(phys)) {
+        pte.* = phys | flags;
+        return .reused;
     }
-
-    return new_pml4;
+    const page = pmm.allocPage() orelse return .no_memory;
+    @memcpy(physPtr(page)[0..PAGE_SIZE], physPtr(phys)[0..PAGE_SIZE]);
+    pte.* = page | flags;
+    pmm.freePage(phys); // drops this address space's reference
+    return .copied;
 }
 
 /// Map a single 4KB page in the given address space.
@@ -293,8 +389,9 @@ pub fn mapPage(pml4: *PageTable, virt: u64, phys: u64, flags: u64) ?void {
     const pd_idx = (virt >> 21) & 0x1FF;
     const pt_idx = (virt >> 12) & 0x1FF;
 
-    // Propagate USER and WRITABLE to intermediate table entries
-    const propagate = flags & (Flags.USER | Flags.WRITABLE);
+    // Propagate USER and WRITABLE to intermediate table entries (a COW
+    // page becomes writable later, so its tables must already allow it)
+    const propagate = (flags & (Flags.USER | Flags.WRITABLE)) | (if (flags & Flags.COW != 0) Flags.WRITABLE else 0);
     const pdpt = getOrAllocTable(pml4, pml4_idx, propagate) orelse return null;
     const pd = getOrAllocTable(pdpt, pdpt_idx, propagate) orelse return null;
     const pt = getOrAllocTable(pd, pd_idx, propagate) orelse return null;
@@ -302,51 +399,94 @@ pub fn mapPage(pml4: *PageTable, virt: u64, phys: u64, flags: u64) ?void {
     pt.entries[@intCast(pt_idx)] = phys | flags | Flags.PRESENT;
 }
 
-/// Unmap a single 4KB page.
-pub fn unmapPage(pml4: *PageTable, virt: u64) void {
-    const pml4_idx: usize = @intCast((virt >> 39) & 0x1FF);
-    const pdpt_idx: usize = @intCast((virt >> 30) & 0x1FF);
-    const pd_idx: usize = @intCast((virt >> 21) & 0x1FF);
-    const pt_idx: usize = @intCast((virt >> 12) & 0x1FF);
+/// Unmap a single 4KB user page. Returns the frame it mapped, or null if
+/// nothing user-visible was mapped there. Stale translations are left to
+/// the caller (see tlb.shootdown), which frees the frame afterwards.
+pub fn unmapPage(pml4: *PageTable, virt: u64) ?u64 {
+    const pte = leafPte(pml4, virt) orelse return null;
+    const entry = pte.*;
+    if (entry & (Flags.PRESENT | Flags.USER) != Flags.PRESENT | Flags.USER) return null;
+    pte.* = 0;
+    return entry & ADDR_MASK;
+}
 
-    if (pml4.entries[pml4_idx] & Flags.PRESENT == 0) return;
-    const pdpt: *PageTable = tablePtr(pml4.entries[pml4_idx] & ADDR_MASK);
+/// Invalidate this core's TLB entry for `virt` (current PCID).
+pub fn invalidatePage(virt: u64) void {
+    asm volatile ("invlpg (%[addr])"
+        :
+        : [addr] "r" (virt),
+        : .{ .memory = true });
+}
 
-    if (pdpt.entries[pdpt_idx] & Flags.PRESENT == 0) return;
-    const pd: *PageTable = tablePtr(pdpt.entries[pdpt_idx] & ADDR_MASK);
+// ── PCID ────────────────────────────────────────────────────────────
 
-    if (pd.entries[pd_idx] & Flags.PRESENT == 0) return;
-    const pt: *PageTable = tablePtr(pd.entries[pd_idx] & ADDR_MASK);
+/// Number of PCIDs tlb.zig may hand out; 0 when the CPU lacks PCID and
+/// every CR3 load flushes the TLB.
+pub var tag_count: u16 = 0;
 
-    pt.entries[pt_idx] = 0;
+/// INVPCID available: single pages of a PCID other than the current one
+/// can be dropped without loading it.
+var has_invpcid: bool = false;
 
-    // Invalidate TLB for this address
-    asm volatile ("invlpg (%[addr])"
+const CR4_PCIDE: u64 = 1 << 17;
+/// CR3 bit 63: keep the new PCID's cached translations.
+const CR3_NOFLUSH: u64 = @as(u64, 1) << 63;
+
+/// Turn on PCID for this core if the CPU has it. Runs on the BSP from
+/// init() and on each AP at entry; the kernel PML4 is PCID 0 everywhere.
+pub fn enableTags() void {
+    if (cpu.cpuid(1, 0).ecx & (1 << 17) == 0) return;
+    // CR4.PCIDE may only be set while CR3[11:0] is zero
+    cpu.writeCr4(cpu.readCr4() | CR4_PCIDE);
+    // Start from the kernel PML4 with nothing cached under PCID 0 (an AP
+    // arrives on whatever CR3 the BSP had when it was booted).
+    asm volatile ("mov %[cr3], %%cr3"
         :
-        : [addr] "r" (virt),
+        : [cr3] "r" (kernel_pml4_phys),
         : .{ .memory = true });
+    if (cpu.cpuid(0, 0).eax >= 7 and cpu.cpuid(7, 0).ebx & (1 << 10) != 0) has_invpcid = true;
+    tag_count = 4096;
 }
 
-/// Switch to a different address space.
-pub fn switchAddressSpace(pml4: *PageTable) void {
+/// Switch to a different address space, tagged `tag` (ignored without
+/// PCID). `flush` discards whatever is cached under `tag`; otherwise the
+/// translations from the last time this root ran under `tag` are reused.
+pub fn switchAddressSpace(pml4: *PageTable, tag: u16, flush: bool) void {
     // pml4 may be a higher-half pointer — convert back to physical for CR3.
     const virt = @intFromPtr(pml4);
     const phys = if (virt >= mem.KERNEL_VIRT_BASE) virt - mem.KERNEL_VIRT_BASE else virt;
+    const cr3 = if (tag_count == 0) phys else phys | tag | (if (flush) 0 else CR3_NOFLUSH);
     asm volatile ("mov %[cr3], %%cr3"
         :
-        : [cr3] "r" (phys),
+        : [cr3] "r" (cr3),
         : .{ .memory = true });
 }
 
-/// Switch CR3 to the kernel's master PML4.
+/// Switch CR3 to the kernel's master PML4 (PCID 0, whose mappings never
+/// change, so nothing is flushed).
 /// Must be called before freeAddressSpace() to avoid walking freed page tables.
 pub fn switchToKernel() void {
+    const cr3 = if (tag_count == 0) kernel_pml4_phys else kernel_pml4_phys | CR3_NOFLUSH;
     asm volatile ("mov %[cr3], %%cr3"
         :
-        : [cr3] "r" (kernel_pml4_phys),
+        : [cr3] "r" (cr3),
         : .{ .memory = true });
 }
 
+/// Invalidate `virt` under `tag`, which need not be the current PCID.
+/// Returns false if the CPU cannot (no INVPCID).
+pub fn invalidateTagPage(tag: u16, virt: u64) bool {
+    if (!has_invpcid) return false;
+    // Type 0: individual address. Descriptor is { pcid, linear address }.
+    const desc = [2]u64{ tag, virt };
+    asm volatile ("invpcid (%[desc]), %[kind]"
+        :
+        : [desc] "r" (&desc),
+          [kind] "r" (@as(u64, 0)),
+        : .{ .memory = true });
+    return true;
+}
+
 /// Get the physical address of the kernel PML4.
 pub fn getKernelPml4() *PageTable {
     return tablePtr(kernel_pml4_phys);
@@ -380,6 +520,36 @@ pub fn translateVaddr(pml4: *PageTable, virt: u64) ?u64 {
     return (pt.entries[pt_idx] & ADDR_MASK) | (virt & 0xFFF);
 }
 
+/// Like translateVaddr, but only for a 4KB user page: returns null unless
+/// the leaf is PRESENT and USER (and WRITABLE when `write` is set). Used for
+/// kernel-mediated copies into another process's memory.
+pub fn translateUser(pml4: *PageTable, virt: u64, write: bool) ?u64 {
+    const pte = (leafPte(pml4, virt) orelse return null).*;
+    const need = Flags.PRESENT | Flags.USER | (if (write) Flags.WRITABLE else 0);
+    if (pte & need != need) return null;
+    return (pte & ADDR_MASK) | (virt & 0xFFF);
+}
+
+/// The 4KB leaf PTE slot for `virt`, or null if an intermediate table is
+/// missing or the address lies in a huge page.
+fn leafPte(pml4: *PageTable, virt: u64) ?*u64 {
+    const pml4_idx: usize = @intCast((virt >> 39) & 0x1FF);
+    if (pml4.entries[pml4_idx] & Flags.PRESENT == 0) return null;
+    const pdpt: *PageTable = tablePtr(pml4.entries[pml4_idx] & ADDR_MASK);
+
+    const pdpt_idx: usize = @intCast((virt >> 30) & 0x1FF);
+    const pdpte = pdpt.entries[pdpt_idx];
+    if (pdpte & Flags.PRESENT == 0 or pdpte & Flags.HUGE_PAGE != 0) return null;
+    const pd: *PageTable = tablePtr(pdpte & ADDR_MASK);
+
+    const pd_idx: usize = @intCast((virt >> 21) & 0x1FF);
+    const pde = pd.entries[pd_idx];
+    if (pde & Flags.PRESENT == 0 or pde & Flags.HUGE_PAGE != 0) return null;
+    const pt: *PageTable = tablePtr(pde & ADDR_MASK);
+
+    return &pt.entries[@intCast((virt >> 12) & 0x1FF)];
+}
+
 /// Free all user-half pages and page tables in an address space.
 /// Walks PML4 entries 0-255 (user half). Frees leaf pages, intermediate
 /// table pages, and the PML4 page itself.
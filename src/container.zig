@@ -15,7 +15,7 @@ const klog = @import("klog.zig");
 const process = @import("process.zig");
 const namespace = @import("namespace.zig");
 const ipc = @import("ipc.zig");
-const elf = @import("elf.zig");
+const image = @import("image.zig");
 const pmm = @import("pmm.zig");
 const mem = @import("mem.zig");
 
@@ -116,7 +116,7 @@ pub fn start(ct: *Container, init_elf: []const u8, console_channel_id: ?ipc.Chan
     proc.quotas = ct.quotas;
 
     // Create a fresh, empty namespace for isolation
-    proc.ns = namespace.Namespace.init();
+    proc.ns.release();
 
     // Mount /dev/console if a channel was provided
     if (console_channel_id) |chan_id| {
@@ -126,7 +126,7 @@ pub fn start(ct: *Container, init_elf: []const u8, console_channel_id: ?ipc.Chan
     }
 
     // Load ELF into process address space
-    const load_result = elf.load(proc.pml4.?, init_elf) catch {
+    const load_result = image.load(proc.pml4.?, init_elf, null) catch {
         klog.err("[container] ELF load failed for '");
         klog.err(ct.name[0..ct.name_len]);
         klog.err("'\n");
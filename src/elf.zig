@@ -15,6 +15,7 @@ const paging = switch (@import("builtin").cpu.arch) {
             pub const WRITABLE: u64 = 2;
             pub const USER: u64 = 4;
             pub const EXEC: u64 = 0;
+            pub const COW: u64 = 0;
         };
         pub fn mapPage(_: anytype, _: u64, _: u64, _: u64) ?void {}
         pub inline fn physPtr(phys: u64) [*]u8 {
@@ -91,6 +92,18 @@ pub const LoadResult = struct {
 /// Load an ELF64 binary into the given page table.
 /// `elf_data` is the raw bytes of the ELF file.
 pub fn load(page_table: *paging.PageTable, elf_data: []const u8) LoadError!LoadResult {
+    return loadWith(page_table, elf_data, null);
+}
+
+/// Like load, but map segment pages straight from `frames` (frame i holds
+/// file bytes [i * 4K, (i + 1) * 4K), see image.zig) instead of copying:
+/// read-only pages are shared, writable ones copy-on-write. Pages that
+/// straddle a segment's file boundary are still copied.
+pub fn loadShared(page_table: *paging.PageTable, elf_data: []const u8, frames: []const u64) LoadError!LoadResult {
+    return loadWith(page_table, elf_data, frames);
+}
+
+fn loadWith(page_table: *paging.PageTable, elf_data: []const u8, frames: ?[]const u64) LoadError!LoadResult {
     if (elf_data.len < @sizeOf(Elf64Header)) return error.InvalidMagic;
 
     const header: *align(1) const Elf64Header = @ptrCast(elf_data.ptr);
@@ -141,7 +154,7 @@ pub fn load(page_table: *paging.PageTable, elf_data: []const u8) LoadError!LoadR
         }
 
         // Load this segment
-        loadSegment(page_table, elf_data, phdr) orelse return error.OutOfMemory;
+        loadSegment(page_table, elf_data, phdr, frames) orelse return error.OutOfMemory;
 
         const seg_end = phdr.p_vaddr + phdr.p_memsz;
         if (seg_end > highest_addr) highest_addr = seg_end;
@@ -161,7 +174,9 @@ pub fn load(page_table: *paging.PageTable, elf_data: []const u8) LoadError!LoadR
 const std = @import("std");
 
 /// Load a single PT_LOAD segment: allocate pages, map them, copy data.
-fn loadSegment(page_table: *paging.PageTable, elf_data: []const u8, phdr: *align(1) const Elf64Phdr) ?void {
+/// With `frames`, pages lying wholly inside the file data map the file's
+/// own frame instead.
+fn loadSegment(page_table: *paging.PageTable, elf_data: []const u8, phdr: *align(1) const Elf64Phdr, frames: ?[]const u64) ?void {
     const vaddr_start = phdr.p_vaddr & ~@as(u64, mem.PAGE_SIZE - 1);
     const vaddr_end = (phdr.p_vaddr + phdr.p_memsz + mem.PAGE_SIZE - 1) & ~@as(u64, mem.PAGE_SIZE - 1);
 
@@ -170,9 +185,30 @@ fn loadSegment(page_table: *paging.PageTable, elf_data: []const u8, phdr: *align
     if (phdr.p_flags & PF_W != 0) flags |= paging.Flags.WRITABLE;
     if (phdr.p_flags & PF_X != 0) flags |= paging.Flags.EXEC;
 
+    // File pages can be mapped directly only if the segment's file offset
+    // and vaddr agree within a page (true for any sanely linked ELF)
+    const congruent = (phdr.p_vaddr -% phdr.p_offset) & (mem.PAGE_SIZE - 1) == 0;
+
     // Map pages for this segment
     var vaddr = vaddr_start;
     while (vaddr < vaddr_end) : (vaddr += mem.PAGE_SIZE) {
+        if (frames) |f| {
+            if (congruent and vaddr >= phdr.p_vaddr and vaddr + mem.PAGE_SIZE <= phdr.p_vaddr + phdr.p_filesz) {
+                const file_page: usize = @intCast((phdr.p_offset + (vaddr - phdr.p_vaddr)) / mem.PAGE_SIZE);
+                if (file_page < f.len and pmm.refPage(f[file_page])) {
+                    const shared_flags = if (flags & paging.Flags.WRITABLE != 0)
+                        (flags & ~paging.Flags.WRITABLE) | paging.Flags.COW
+                    else
+                        flags;
+                    paging.mapPage(page_table, vaddr, f[file_page], shared_flags) orelse {
+                        pmm.freePage(f[file_page]);
+                        return null;
+                    };
+                    continue;
+                }
+            }
+        }
+
         const phys = pmm.allocPage() orelse return null;
 
         // Zero the page first (use higher-half to avoid identity-map conflicts)
@@ -6,18 +6,28 @@
 /// Modes:
 ///   shared (default) — frames delivered to both kernel stack and ether clients
 ///   exclusive — frames delivered only to ether clients (kernel stack skipped)
+///
+/// Framing (ctl "batch"): by default each read returns one frame and each
+/// write sends one. In batch mode reads and writes carry a sequence of
+/// [len: u16 LE][frame] records — a read returns every queued frame that
+/// fits, a write hands up to virtio_net.TX_BATCH frames to the device per
+/// notify — so a userspace stack pays one syscall per batch, not per frame.
 const SpinLock = @import("spinlock.zig").SpinLock;
 const process = @import("process.zig");
+const virtio_net = @import("virtio_net.zig");
 
 pub const MAX_ETHER_CLIENTS = 8;
 const FRAME_RING_SIZE = 64;
 pub const MAX_FRAME = 1518;
+/// Largest batch-mode read or write.
+pub const MAX_BATCH = 64 * 1024;
 
 const MAX_WAITERS = 4;
 
 pub const EtherClient = struct {
     active: bool,
     exclusive: bool, // true = kernel stack skips frame processing
+    batch: bool, // true = length-prefixed multi-frame reads/writes
     ring: [FRAME_RING_SIZE][MAX_FRAME]u8,
     frame_lens: [FRAME_RING_SIZE]u16,
     head: u8, // next write position
@@ -37,6 +47,7 @@ pub fn init() void {
 fn resetClient(c: *EtherClient) void {
     c.active = false;
     c.exclusive = false;
+    c.batch = false;
     // ring/frame_lens left undefined (BSS)
     c.head = 0;
     c.count = 0;
@@ -144,6 +155,65 @@ pub fn readFrame(idx: u8, dest: []u8) u16 {
     return copy_len;
 }
 
+/// Read from the client: one frame, or in batch mode as many whole frames
+/// as fit in `dest` (which should hold at least MAX_FRAME + 2 bytes), each
+/// prefixed with its u16 LE length. Returns bytes written, 0 if the ring
+/// is empty.
+pub fn read(idx: u8, dest: []u8) usize {
+    if (idx >= MAX_ETHER_CLIENTS) return 0;
+    if (!clients[idx].batch) return readFrame(idx, dest);
+
+    const c = &clients[idx];
+    c.lock.lock();
+    defer c.lock.unlock();
+
+    var pos: usize = 0;
+    while (c.count > 0) {
+        const read_pos = (c.head -% c.count) % FRAME_RING_SIZE;
+        const frame_len = c.frame_lens[read_pos];
+        if (pos + 2 + frame_len > dest.len) break;
+        dest[pos] = @truncate(frame_len);
+        dest[pos + 1] = @truncate(frame_len >> 8);
+        @memcpy(dest[pos + 2 ..][0..frame_len], c.ring[read_pos][0..frame_len]);
+        pos += 2 + frame_len;
+        c.count -= 1;
+    }
+    return pos;
+}
+
+/// Most bytes a read on this client can return.
+pub fn maxRead(idx: u8) usize {
+    if (idx >= MAX_ETHER_CLIENTS) return 0;
+    return if (clients[idx].batch) MAX_BATCH else MAX_FRAME;
+}
+
+/// Whether the client uses batch framing.
+pub fn isBatch(idx: u8) bool {
+    if (idx >= MAX_ETHER_CLIENTS) return false;
+    return clients[idx].batch;
+}
+
+/// Send a batch-mode write buffer. Stops at the first truncated record.
+/// Returns the number of bytes consumed.
+pub fn writeBatch(data: []const u8) usize {
+    var frames: [virtio_net.TX_BATCH][]const u8 = undefined;
+    var n: usize = 0;
+    var pos: usize = 0;
+    while (pos + 2 <= data.len) {
+        const len = @as(usize, data[pos]) | @as(usize, data[pos + 1]) << 8;
+        if (len == 0 or pos + 2 + len > data.len) break;
+        frames[n] = data[pos + 2 ..][0..len];
+        n += 1;
+        pos += 2 + len;
+        if (n == frames.len) {
+            _ = virtio_net.sendFrames(frames[0..n]);
+            n = 0;
+        }
+    }
+    if (n > 0) _ = virtio_net.sendFrames(frames[0..n]);
+    return pos;
+}
+
 /// Check if client has frames available.
 pub fn hasData(idx: u8) bool {
     if (idx >= MAX_ETHER_CLIENTS) return false;
@@ -169,7 +239,7 @@ pub fn setReadWaiter(idx: u8, pid: u16) void {
     c.read_waiters[0] = pid;
 }
 
-/// Process ctl commands: "exclusive" or "shared".
+/// Process ctl commands: "exclusive", "shared", "batch" or "single".
 pub fn handleCtl(idx: u8, cmd: []const u8) bool {
     if (idx >= MAX_ETHER_CLIENTS) return false;
     const c = &clients[idx];
@@ -184,6 +254,14 @@ pub fn handleCtl(idx: u8, cmd: []const u8) bool {
         c.exclusive = false;
         return true;
     }
+    if (strEql(cmd, "batch")) {
+        c.batch = true;
+        return true;
+    }
+    if (strEql(cmd, "single")) {
+        c.batch = false;
+        return true;
+    }
     return false;
 }
 
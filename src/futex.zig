@@ -1,76 +1,141 @@
+/// Futex wait queues.
+///
+/// Waiters hash on (address space, user address) into BUCKETS buckets, each
+/// with its own lock and FIFO list, so wait/wake only touch waiters that
+/// collide with their key. The list links live in the Process itself
+/// (futex_next/futex_addr/futex_space), so waiting never allocates and the
+/// number of waiters is bounded only by the process table.
+///
+/// A timed wait also sets pending_op = .futex_wait with the deadline in
+/// sleep_until and arms the waiter's wake_timer, which calls expire() once
+/// it passes. Wake, requeue, expiry and cancel all dequeue under the bucket
+/// lock, so exactly one of them completes a given wait.
+///
+/// Lock ordering: bucket lock → run-queue locks (markReady), timer wheel
+/// lock. requeue() takes two bucket locks in index order.
 const process = @import("process.zig");
-const SpinLock = @import("spinlock.zig").SpinLock;
-const klog = @import("klog.zig");
+const timer = @import("timer.zig");
+const QueuedLock = @import("spinlock.zig").QueuedLock;
 
-pub const MAX_FUTEX_WAITERS = 128;
+const EAGAIN: u64 = 0xFFFF_FFFF_FFFF_FFF5; // -11
+const EINVAL: u64 = 0xFFFF_FFFF_FFFF_FFEA; // -22
+const ETIMEDOUT: u64 = 0xFFFF_FFFF_FFFF_FF92; // -110
 
-const FutexWaiter = struct {
-    proc_index: u16,
-    addr: u64, // user virtual address
-    pml4_phys: u64, // address space identity (physical PML4 addr)
-    active: bool,
+/// Number of hash buckets.
+const BUCKET_BITS = 8;
+const BUCKETS = 1 << BUCKET_BITS;
+
+const Bucket = struct {
+    lock: QueuedLock = QueuedLock.init("futex"),
+    head: ?*process.Process = null,
+    tail: ?*process.Process = null,
 };
 
-var waiters: [MAX_FUTEX_WAITERS]FutexWaiter linksection(".bss") = undefined;
-var futex_lock: SpinLock = .{};
-var initialized: bool = false;
+var buckets: [BUCKETS]Bucket = [_]Bucket{.{}} ** BUCKETS;
 
-fn ensureInit() void {
-    if (!initialized) {
-        for (&waiters) |*w| {
-            w.active = false;
-        }
-        initialized = true;
-    }
+/// Address space identity of `proc`: the physical PML4 shared by its thread group.
+pub fn spaceOf(proc: *const process.Process) u64 {
+    return if (proc.thread_group) |tg|
+        (if (tg.pml4) |p| @intFromPtr(p) else 0)
+    else
+        (if (proc.pml4) |p| @intFromPtr(p) else 0);
 }
 
-/// Futex wait: if *addr == expected_val, block the caller.
-/// Returns 0 on wake, or EAGAIN (0xFFFF...FFF5) if *addr != expected_val.
-pub fn wait(proc: *process.Process, addr: u64, expected_val: u32) u64 {
-    ensureInit();
-    const EAGAIN: u64 = 0xFFFF_FFFF_FFFF_FFF5;
+fn bucketIndex(space: u64, addr: u64) usize {
+    // Futex words are at least 4-byte aligned; fold both keys and mix.
+    const k = (addr >> 2) ^ (space >> 12) *% 0x9E37_79B9_7F4A_7C15;
+    return @intCast((k *% 0xBF58_476D_1CE4_E5B9) >> (64 - BUCKET_BITS));
+}
 
-    if (addr == 0 or addr >= 0x0000_8000_0000_0000) return EAGAIN;
+fn bucketFor(space: u64, addr: u64) *Bucket {
+    return &buckets[bucketIndex(space, addr)];
+}
 
-    // Read the current value at the user address.
-    // The caller's CR3 is loaded, so user pointers are valid.
-    const user_ptr: *const u32 = @ptrFromInt(addr);
-    const current_val = user_ptr.*;
+fn append(b: *Bucket, p: *process.Process) void {
+    p.futex_next = null;
+    if (b.tail) |t| t.futex_next = p else b.head = p;
+    b.tail = p;
+}
 
-    if (current_val != expected_val) return EAGAIN;
+/// Unlink `p` (whose predecessor is `prev`) from `b`. Bucket lock held.
+fn unlink(b: *Bucket, prev: ?*process.Process, p: *process.Process) void {
+    if (prev) |q| q.futex_next = p.futex_next else b.head = p.futex_next;
+    if (b.tail == p) b.tail = prev;
+    p.futex_next = null;
+    p.futex_queued = false;
+}
 
-    // Get the PML4 physical address for address space identity
-    const pml4_phys: u64 = if (proc.thread_group) |tg|
-        (if (tg.pml4) |p| @intFromPtr(p) else 0)
-    else
-        (if (proc.pml4) |p| @intFromPtr(p) else 0);
+/// Unlink `p` from `b` by search. Returns false if it is not there.
+fn remove(b: *Bucket, p: *process.Process) bool {
+    var prev: ?*process.Process = null;
+    var cur = b.head;
+    while (cur) |q| : (cur = q.futex_next) {
+        if (q == p) {
+            unlink(b, prev, p);
+            return true;
+        }
+        prev = q;
+    }
+    return false;
+}
 
-    futex_lock.lock();
+/// Complete a dequeued wait with `ret`. Bucket lock held.
+fn complete(p: *process.Process, ret: u64) void {
+    p.syscall_ret = ret;
+    p.pending_op = .none;
+    if (p.sleep_until != 0) {
+        p.sleep_until = 0;
+        timer.cancel(&p.wake_timer);
+    }
+    if (p.state == .blocked) process.markReady(p);
+}
 
-    // Find a free waiter slot
-    var slot: ?*FutexWaiter = null;
-    for (&waiters) |*w| {
-        if (!w.active) {
-            slot = w;
-            break;
-        }
+/// Lock the bucket `p` is currently queued in, or return null if `p` is not
+/// queued. A concurrent requeue can move `p`, so re-check after locking.
+fn lockQueued(p: *process.Process) ?*Bucket {
+    while (true) {
+        if (!@atomicLoad(bool, &p.futex_queued, .acquire)) return null;
+        const b = bucketFor(p.futex_space, @atomicLoad(u64, &p.futex_addr, .acquire));
+        b.lock.lock();
+        if (p.futex_queued and bucketFor(p.futex_space, p.futex_addr) == b) return b;
+        b.lock.unlock();
     }
+}
 
-    if (slot) |w| {
-        w.proc_index = process.procIndex(proc);
-        w.addr = addr;
-        w.pml4_phys = pml4_phys;
-        w.active = true;
-    } else {
-        futex_lock.unlock();
-        return EAGAIN; // No free slots
+/// Futex wait: if *addr == expected_val, block the caller until woken or,
+/// when timeout_ms is non-zero, until that many milliseconds pass.
+/// Returns 0 on wake, EAGAIN if *addr != expected_val, ETIMEDOUT on expiry.
+pub fn wait(proc: *process.Process, addr: u64, expected_val: u32, timeout_ms: u64) u64 {
+    if (addr == 0 or addr >= 0x0000_8000_0000_0000 or addr & 3 != 0) return EINVAL;
+
+    const space = spaceOf(proc);
+    const b = bucketFor(space, addr);
+
+    // Compare under the bucket lock so a waker that changed the word and
+    // then called wake() cannot slip in between the check and the enqueue.
+    // The caller's CR3 is loaded, so the user pointer is valid.
+    b.lock.lock();
+    const user_ptr: *const volatile u32 = @ptrFromInt(addr);
+    if (user_ptr.* != expected_val) {
+        b.lock.unlock();
+        return EAGAIN;
     }
 
-    // Block the process
+    proc.futex_addr = addr;
+    proc.futex_space = space;
+    append(b, proc);
+    @atomicStore(bool, &proc.futex_queued, true, .release);
+
     proc.state = .blocked;
-    proc.pending_op = .none;
     proc.syscall_ret = 0;
-    futex_lock.unlock();
+    if (timeout_ms != 0) {
+        proc.sleep_until = timer.now() +| timeout_ms *| 1_000_000;
+        proc.pending_op = .futex_wait;
+        timer.arm(&proc.wake_timer, proc.sleep_until);
+    } else {
+        proc.pending_op = .none;
+    }
+    b.lock.unlock();
 
     process.scheduleNext();
 }
@@ -78,55 +143,106 @@ pub fn wait(proc: *process.Process, addr: u64, expected_val: u32) u64 {
 /// Futex wake: wake up to `count` waiters on the given address.
 /// Returns the number of waiters woken.
 pub fn wake(proc: *process.Process, addr: u64, count: u32) u64 {
-    ensureInit();
     if (addr == 0) return 0;
+    return wakeKey(spaceOf(proc), addr, count);
+}
 
-    // Get the PML4 physical address for address space identity
-    const pml4_phys: u64 = if (proc.thread_group) |tg|
-        (if (tg.pml4) |p| @intFromPtr(p) else 0)
-    else
-        (if (proc.pml4) |p| @intFromPtr(p) else 0);
-
-    futex_lock.lock();
-    defer futex_lock.unlock();
+fn wakeKey(space: u64, addr: u64, count: u64) u64 {
+    const b = bucketFor(space, addr);
+    b.lock.lock();
+    defer b.lock.unlock();
 
     var woken: u64 = 0;
-    for (&waiters) |*w| {
+    var prev: ?*process.Process = null;
+    var cur = b.head;
+    while (cur) |p| {
         if (woken >= count) break;
-        if (w.active and w.addr == addr and w.pml4_phys == pml4_phys) {
-            w.active = false;
-            // Wake the blocked process
-            const table = process.getProcessTable();
-            const target = &table[w.proc_index];
-            if (target.state == .blocked) {
-                target.syscall_ret = 0;
-                process.markReady(target);
-            }
+        cur = p.futex_next;
+        if (p.futex_addr == addr and p.futex_space == space) {
+            unlink(b, prev, p);
+            complete(p, 0);
             woken += 1;
+        } else {
+            prev = p;
         }
     }
+    return woken;
+}
 
+/// Futex requeue: wake up to `wake_count` waiters on `addr` and move up to
+/// `requeue_count` of the rest onto `addr2` without waking them. Lets a
+/// condition-variable broadcast wake one thread and park the others on the
+/// mutex instead of having them all race for it. Returns the number woken.
+pub fn requeue(proc: *process.Process, addr: u64, wake_count: u32, addr2: u64, requeue_count: u32) u64 {
+    if (addr == 0 or addr2 == 0 or addr2 >= 0x0000_8000_0000_0000 or addr2 & 3 != 0) return EINVAL;
+
+    const space = spaceOf(proc);
+    const src_idx = bucketIndex(space, addr);
+    const dst_idx = bucketIndex(space, addr2);
+    const src = &buckets[src_idx];
+    const dst = &buckets[dst_idx];
+    if (src_idx <= dst_idx) {
+        src.lock.lock();
+        if (dst != src) dst.lock.lock();
+    } else {
+        dst.lock.lock();
+        src.lock.lock();
+    }
+    defer {
+        src.lock.unlock();
+        if (dst != src) dst.lock.unlock();
+    }
+
+    var woken: u64 = 0;
+    var moved: u64 = 0;
+    var prev: ?*process.Process = null;
+    var cur = src.head;
+    // Bounded by the waiters present on entry: on a shared bucket, moved
+    // waiters land at the tail and must not be visited again.
+    const last = src.tail;
+    while (cur) |p| {
+        if (woken >= wake_count and moved >= requeue_count) break;
+        cur = p.futex_next;
+        const at_end = p == last;
+        if (p.futex_addr == addr and p.futex_space == space) {
+            unlink(src, prev, p);
+            if (woken < wake_count) {
+                complete(p, 0);
+                woken += 1;
+            } else {
+                @atomicStore(u64, &p.futex_addr, addr2, .release);
+                append(dst, p);
+                @atomicStore(bool, &p.futex_queued, true, .release);
+                moved += 1;
+            }
+        } else {
+            prev = p;
+        }
+        if (at_end) break;
+    }
     return woken;
 }
 
 /// Wake a single waiter on a specific address (used by CLONE_CHILD_CLEARTID).
 pub fn wakeOne(pml4_phys: u64, addr: u64) void {
-    ensureInit();
     if (addr == 0) return;
+    _ = wakeKey(pml4_phys, addr, 1);
+}
 
-    futex_lock.lock();
-    defer futex_lock.unlock();
-
-    for (&waiters) |*w| {
-        if (w.active and w.addr == addr and w.pml4_phys == pml4_phys) {
-            w.active = false;
-            const table = process.getProcessTable();
-            const target = &table[w.proc_index];
-            if (target.state == .blocked) {
-                target.syscall_ret = 0;
-                process.markReady(target);
-            }
-            return;
-        }
-    }
+/// Wake timer: fail `proc`'s timed wait with ETIMEDOUT if its deadline has
+/// passed and no waker got to it first.
+pub fn expire(proc: *process.Process, now: u64) void {
+    const b = lockQueued(proc) orelse return;
+    defer b.lock.unlock();
+    if (proc.pending_op != .futex_wait) return;
+    if (now < proc.sleep_until) return;
+    if (remove(b, proc)) complete(proc, ETIMEDOUT);
+}
+
+/// Drop `proc` from any wait queue without waking it (process teardown).
+pub fn cancel(proc: *process.Process) void {
+    const b = lockQueued(proc) orelse return;
+    defer b.lock.unlock();
+    _ = remove(b, proc);
+    if (proc.pending_op == .futex_wait) proc.pending_op = .none;
 }
@@ -1,89 +1,78 @@
-/// Kernel bump allocator backed by PMM.
-/// No free for MVP — just bumps forward. Good enough for kernel init structures.
+/// Kernel general-purpose allocator (kmalloc-style) on top of slab caches.
+///
+/// Requests up to MAX_SMALL bytes are served from power-of-two size-class
+/// caches (see slab.zig); anything larger takes whole pages from the PMM.
+/// free() takes the size that was passed to alloc(), like std.mem.Allocator.
+/// Usable once paging is initialized.
+const mem = @import("mem.zig");
 const pmm = @import("pmm.zig");
+const slab = @import("slab.zig");
 const klog = @import("klog.zig");
 
 const page_size = 4096;
 
-/// Number of pages to grab from PMM at init for the heap arena.
-const initial_pages = 64; // 256 KB
+/// Largest size served from a slab cache.
+const MAX_SMALL = 2048;
+
+var classes = [_]slab.Cache{
+    slab.Cache.init("kmalloc-32", 32, 32),
+    slab.Cache.init("kmalloc-64", 64, 64),
+    slab.Cache.init("kmalloc-128", 128, 64),
+    slab.Cache.init("kmalloc-256", 256, 64),
+    slab.Cache.init("kmalloc-512", 512, 64),
+    slab.Cache.init("kmalloc-1024", 1024, 64),
+    slab.Cache.init("kmalloc-2048", 2048, 64),
+};
 
-var arena_base: usize = 0;
-var arena_size: usize = 0;
-var offset: usize = 0;
 var initialized: bool = false;
 
 pub fn init() void {
-    // Allocate contiguous-ish pages from PMM
-    // For MVP, grab the first page and use it as the base, then grab more
-    const first = pmm.allocPage() orelse {
-        klog.err("Heap: failed to allocate from PMM!\n");
-        return;
-    };
-    arena_base = first;
-    arena_size = page_size;
-
-    // Try to grab more pages — they may not be contiguous but we allocate
-    // enough initial pages to cover MVP needs
-    var pages_allocated: usize = 1;
-    while (pages_allocated < initial_pages) : (pages_allocated += 1) {
-        const page = pmm.allocPage() orelse break;
-        // Only extend arena if this page is contiguous
-        if (page == arena_base + arena_size) {
-            arena_size += page_size;
-        } else {
-            // Non-contiguous — return it and stop
-            pmm.freePage(page);
-            break;
-        }
-    }
-
-    offset = 0;
     initialized = true;
-
     klog.info("Heap: ");
-    klog.infoDec(arena_size / 1024);
-    klog.info(" KB arena at ");
-    klog.infoHex(arena_base);
-    klog.info("\n");
+    klog.infoDec(classes.len);
+    klog.info(" size classes up to ");
+    klog.infoDec(MAX_SMALL);
+    klog.info(" bytes, page allocations above\n");
+}
+
+/// Size-class cache for `size` bytes, or null if it needs whole pages.
+fn classFor(size: usize) ?*slab.Cache {
+    if (size > MAX_SMALL) return null;
+    var class: usize = 32;
+    var i: usize = 0;
+    while (class < size) : (i += 1) class *= 2;
+    return &classes[i];
 }
 
 pub fn alloc(size: usize) ?[*]u8 {
     return allocAligned(size, 8);
 }
 
+/// Allocate `size` bytes aligned to `alignment` (a power of two, at most
+/// one page). Small objects get at least min(class size, 64)-byte alignment.
 pub fn allocAligned(size: usize, alignment: usize) ?[*]u8 {
-    if (!initialized or size == 0) return null;
-
-    // Align offset up
-    const aligned_offset = (offset + alignment - 1) & ~(alignment - 1);
-    if (aligned_offset + size > arena_size) {
-        // Try to grow by allocating more pages from PMM
-        const needed = aligned_offset + size - arena_size;
-        const pages_needed = (needed + page_size - 1) / page_size;
-        var grown: usize = 0;
-        while (grown < pages_needed) : (grown += 1) {
-            const page = pmm.allocPage() orelse break;
-            if (page == arena_base + arena_size) {
-                arena_size += page_size;
-            } else {
-                pmm.freePage(page);
-                break;
-            }
-        }
-        if (aligned_offset + size > arena_size) return null;
+    if (!initialized or size == 0 or alignment > page_size) return null;
+    const want = if (alignment > 64) @max(size, MAX_SMALL + 1) else @max(size, alignment);
+    if (classFor(want)) |cache| {
+        return @ptrCast(cache.alloc() orelse return null);
     }
-
-    offset = aligned_offset + size;
-    return @ptrFromInt(arena_base + aligned_offset);
+    const pages = (want + page_size - 1) / page_size;
+    const phys = pmm.allocContiguousPages(pages) orelse return null;
+    return @ptrFromInt(mem.physToVirt(phys));
 }
 
-/// Returns how much heap space has been used so far.
-pub fn used() usize {
-    return offset;
+/// Free memory from alloc()/allocAligned(). `size` and `alignment` must
+/// match the allocation.
+pub fn free(ptr: [*]u8, size: usize) void {
+    freeAligned(ptr, size, 8);
 }
 
-/// Returns total arena capacity.
-pub fn capacity() usize {
-    return arena_size;
+pub fn freeAligned(ptr: [*]u8, size: usize, alignment: usize) void {
+    const want = if (alignment > 64) @max(size, MAX_SMALL + 1) else @max(size, alignment);
+    if (classFor(want)) |cache| {
+        cache.free(ptr);
+        return;
+    }
+    const pages = (want + page_size - 1) / page_size;
+    pmm.freeContiguousPages(mem.virtToPhys(@intFromPtr(ptr)), pages);
 }
@@ -0,0 +1,205 @@
+/// Executable image cache: exec/spawn map ELF file pages instead of
+/// copying them.
+///
+/// An Image holds a binary's bytes in page frames (frame i = file bytes
+/// [i * 4K, (i + 1) * 4K), tail of the last page zeroed). elf.loadShared
+/// maps read-only segment pages straight from those frames and writable
+/// ones copy-on-write, so a process only gets private copies of the pages
+/// it actually writes. Every mapping holds its own PMM share reference, so
+/// frames outlive the cache entry for as long as any process maps them.
+///
+/// Images are looked up by content (hash, then a full compare), so every
+/// process running the same binary shares one set of text pages. The
+/// cache keeps its own frame references; beyond MAX_IMAGES the least
+/// recently used image that is not being mapped right now is dropped.
+///
+/// When the ELF arrives in a page-aligned user buffer (lib/posix execve
+/// reads the file into a fresh mmap), the buffer's frames are adopted —
+/// shared copy-on-write with the caller — rather than copied.
+const std = @import("std");
+const pmm = @import("pmm.zig");
+const mem = @import("mem.zig");
+const heap = @import("heap.zig");
+const elf = @import("elf.zig");
+const process = @import("process.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
+
+const paging = switch (@import("builtin").cpu.arch) {
+    .x86_64 => @import("arch/x86_64/paging.zig"),
+    .riscv64 => @import("arch/riscv64/paging.zig"),
+    else => struct {
+        pub const PageTable = struct { entries: [512]u64 };
+        pub inline fn physPtr(phys: u64) [*]u8 {
+            return @ptrFromInt(phys);
+        }
+    },
+};
+
+/// Largest binary exec/spawn accept.
+pub const MAX_IMAGE_SIZE = 64 * 1024 * 1024;
+/// Cached images (each keeps its frames alive until evicted).
+const MAX_IMAGES = 8;
+
+const Image = struct {
+    hash: u64 = 0,
+    len: usize = 0,
+    frames: [*]u64 = undefined,
+    npages: usize = 0,
+    /// Loads currently mapping from this image; pinned images are not evicted.
+    pins: u32 = 0,
+    last_use: u64 = 0,
+    active: bool = false,
+
+    pub fn frameSlice(self: *const Image) []const u64 {
+        return self.frames[0..self.npages];
+    }
+};
+
+var images: [MAX_IMAGES]Image = [_]Image{.{}} ** MAX_IMAGES;
+/// Guards `images` and `use_clock`. Lock ordering: cache_lock → pmm_lock.
+var cache_lock: SpinLock = .{};
+var use_clock: u64 = 0;
+
+/// Load `elf_data` into `page_table`, mapping file pages from the shared
+/// image cache where possible and copying otherwise. `owner` is the
+/// process whose memory `elf_data` lives in (its frames may be adopted),
+/// or null for kernel memory such as the initrd.
+pub fn load(page_table: *paging.PageTable, elf_data: []const u8, owner: ?*process.Process) elf.LoadError!elf.LoadResult {
+    const img = acquire(elf_data, owner) orelse return elf.load(page_table, elf_data);
+    defer release(img);
+    return elf.loadShared(page_table, elf_data, img.frameSlice());
+}
+
+/// Find or build the pinned image for `data`. Null when out of memory or
+/// every cache slot is pinned; the caller then falls back to copying.
+fn acquire(data: []const u8, owner: ?*process.Process) ?*Image {
+    if (data.len == 0 or data.len > MAX_IMAGE_SIZE) return null;
+    const hash = std.hash.Wyhash.hash(0, data);
+
+    if (lookup(hash, data)) |img| return img;
+
+    const npages = (data.len + mem.PAGE_SIZE - 1) / mem.PAGE_SIZE;
+    const frames_mem = heap.alloc(npages * @sizeOf(u64)) orelse return null;
+    const frames: [*]u64 = @ptrCast(@alignCast(frames_mem));
+    if (!adoptFrames(data, owner, frames[0..npages]) and !copyFrames(data, frames[0..npages])) {
+        heap.free(frames_mem, npages * @sizeOf(u64));
+        return null;
+    }
+
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    const slot = victim() orelse {
+        dropFrames(frames, npages);
+        return null;
+    };
+    if (slot.active) evict(slot);
+    use_clock += 1;
+    slot.* = .{
+        .hash = hash,
+        .len = data.len,
+        .frames = frames,
+        .npages = npages,
+        .pins = 1,
+        .last_use = use_clock,
+        .active = true,
+    };
+    return slot;
+}
+
+/// Unpin an image returned by acquire().
+fn release(img: *Image) void {
+    cache_lock.lock();
+    img.pins -= 1;
+    cache_lock.unlock();
+}
+
+/// Cached image with the same contents as `data`, pinned. Candidates are
+/// matched on hash and length under cache_lock, then pinned and compared
+/// with it dropped: a compare can cover 64 MiB.
+fn lookup(hash: u64, data: []const u8) ?*Image {
+    for (&images) |*img| {
+        cache_lock.lock();
+        const candidate = img.active and img.hash == hash and img.len == data.len;
+        if (candidate) img.pins += 1;
+        cache_lock.unlock();
+        if (!candidate) continue;
+
+        // Pinned, so its frames stay put while the compare runs
+        const same = sameBytes(img, data);
+        cache_lock.lock();
+        defer cache_lock.unlock();
+        if (same) {
+            use_clock += 1;
+            img.last_use = use_clock;
+            return img;
+        }
+        img.pins -= 1;
+    }
+    return null;
+}
+
+fn sameBytes(img: *const Image, data: []const u8) bool {
+    var off: usize = 0;
+    for (img.frameSlice()) |frame| {
+        const n = @min(data.len - off, mem.PAGE_SIZE);
+        const page: [*]const u8 = paging.physPtr(frame);
+        if (!std.mem.eql(u8, page[0..n], data[off..][0..n])) return false;
+        off += n;
+    }
+    return true;
+}
+
+/// Share the owner's frames behind a page-aligned user buffer. The last
+/// page must be the owner's own, zero past the end of the data, for the
+/// image to be usable as-is.
+fn adoptFrames(data: []const u8, owner: ?*process.Process, frames: []u64) bool {
+    const proc = owner orelse return false;
+    const va = @intFromPtr(data.ptr);
+    if (va & (mem.PAGE_SIZE - 1) != 0) return false;
+    const tail = data.len % mem.PAGE_SIZE;
+    if (tail != 0) {
+        const end: [*]const u8 = data.ptr + data.len;
+        for (end[0 .. mem.PAGE_SIZE - tail]) |b| if (b != 0) return false;
+    }
+    return process.shareUserPages(proc, va, frames);
+}
+
+/// Copy `data` into freshly allocated frames.
+fn copyFrames(data: []const u8, frames: []u64) bool {
+    var off: usize = 0;
+    for (frames, 0..) |*frame, i| {
+        const page = pmm.allocPage() orelse {
+            for (frames[0..i]) |f| pmm.freePage(f);
+            return false;
+        };
+        const n = @min(data.len - off, mem.PAGE_SIZE);
+        const dst = paging.physPtr(page);
+        @memcpy(dst[0..n], data[off..][0..n]);
+        @memset(dst[n..mem.PAGE_SIZE], 0);
+        frame.* = page;
+        off += n;
+    }
+    return true;
+}
+
+/// Free slot, else the least recently used unpinned one. cache_lock held.
+fn victim() ?*Image {
+    var best: ?*Image = null;
+    for (&images) |*img| {
+        if (!img.active) return img;
+        if (img.pins != 0) continue;
+        if (best == null or img.last_use < best.?.last_use) best = img;
+    }
+    return best;
+}
+
+/// Drop the cache's references to an unpinned image. cache_lock held.
+fn evict(img: *Image) void {
+    dropFrames(img.frames, img.npages);
+    img.active = false;
+}
+
+fn dropFrames(frames: [*]u64, npages: usize) void {
+    for (frames[0..npages]) |frame| pmm.freePage(frame);
+    heap.free(@ptrCast(frames), npages * @sizeOf(u64));
+}
@@ -7,20 +7,37 @@
 /// recv() blocks until a sender calls send().
 /// Transfer happens at rendezvous — no kernel buffering.
 ///
+/// Tagged requests (ipc_submit/ipc_collect) are the asynchronous exception:
+/// the kernel keeps a copy of each one (TaggedRequest) so a client can have
+/// up to MAX_TAGGED in flight and collect replies in completion order.
+/// Submission rings (ring.zig) post their server-bound operations the same
+/// way, with a separate per-process done queue.
+///
+/// Pending senders are queued on the channel as slab-allocated Request
+/// nodes, so the queue has no fixed length.
+///
+/// Channel objects are allocated from a slab cache on first use of an id;
+/// the channel table itself is just pointers, so idle systems only pay for
+/// the channels they created.
+///
 /// SMP: Per-channel spinlock guards endpoint state. Global alloc lock guards
 /// channel allocation. Lock ordering: alloc_lock → channel.lock.
-const heap = @import("heap.zig");
+const slab = @import("slab.zig");
 const klog = @import("klog.zig");
 const SpinLock = @import("spinlock.zig").SpinLock;
+const QueuedLock = @import("spinlock.zig").QueuedLock;
 
-/// Maximum number of channels system-wide.
-const MAX_CHANNELS = 256;
+/// Maximum number of channels system-wide (size of the id space).
+const MAX_CHANNELS = 4096;
 
 /// Maximum inline message data size.
 pub const MAX_MSG_DATA = 4096;
 
-/// Maximum number of clients that can queue on a single channel.
-pub const MAX_CLIENT_WAITERS = 16;
+/// Largest client buffer a single bulk (page-grant) read/write may cover.
+pub const MAX_GRANT = 1 << 20;
+
+/// Tagged requests one process may have outstanding across all channels.
+pub const MAX_TAGGED = 32;
 
 /// 9P-inspired message tags.
 pub const Tag = enum(u32) {
@@ -35,6 +52,9 @@ pub const Tag = enum(u32) {
     t_rename = 9,
     t_truncate = 10,
     t_wstat = 11,
+    /// Bulk write: payload is [handle][len u32]; data is pulled from the
+    /// client's grant with ipc_grant.
+    t_write_bulk = 12,
     r_ok = 128,
     r_error = 129,
 };
@@ -86,15 +106,154 @@ pub const MAX_SERVER_WAITERS = 8;
 pub const PendingClient = struct {
     pid: u32,
     msg_ptr: ?*Message,
+    /// Non-null for a tagged request: the reply completes it instead of
+    /// waking `pid`.
+    tagged: ?*TaggedRequest = null,
+};
+
+/// Queue node for one pending send. Synchronous senders get a node from
+/// request_cache; tagged requests embed theirs.
+const Request = struct {
+    next: ?*Request = null,
+    entry: PendingClient,
+    owned: bool,
+};
+
+var request_cache = slab.ObjectCache(Request).init("ipc_request");
+
+/// Kernel-held tagged request. Carries the request until a server receives
+/// it, then the reply until the client collects it.
+pub const TaggedRequest = struct {
+    node: Request,
+    /// Client-chosen value returned with the reply.
+    cookie: u64,
+    msg: Message,
+    next_done: ?*TaggedRequest = null,
+    /// Set when posted from a submission ring: how to reap the reply.
+    ring: RingOp = .{},
+};
+
+/// Submission-ring operation carried by a tagged request (see ring.zig).
+/// op 0 is a plain ipc_submit request.
+pub const RingOp = struct {
+    op: u8 = 0,
+    flags: u8 = 0,
+    fd: u32 = 0,
+    /// Ring generation at submission; a mismatch drops the reply.
+    gen: u32 = 0,
+    /// User buffer and length, and the file offset of a read.
+    addr: u64 = 0,
+    len: u32 = 0,
+    off: u32 = 0,
+};
+
+var tagged_cache = slab.ObjectCache(TaggedRequest).init("ipc_tagged");
+
+/// Allocate a tagged request for `pid` holding a copy of `msg`.
+pub fn allocTagged(pid: u32, cookie: u64) ?*TaggedRequest {
+    const tr = tagged_cache.create() orelse return null;
+    tr.node = .{ .entry = .{ .pid = pid, .msg_ptr = &tr.msg, .tagged = tr }, .owned = false };
+    tr.cookie = cookie;
+    tr.next_done = null;
+    tr.ring = .{};
+    return tr;
+}
+
+pub fn freeTagged(tr: *TaggedRequest) void {
+    tagged_cache.destroy(tr);
+}
+
+/// Per-process list of completed tagged requests awaiting ipc_collect (or,
+/// for a submission ring's queue, reaping into its CQ).
+pub const DoneQueue = struct {
+    lock: SpinLock = .{},
+    head: ?*TaggedRequest = null,
+    tail: ?*TaggedRequest = null,
+    /// Submitted and not yet collected (queued, in service, or done).
+    inflight: u32 = 0,
+    /// Owner is blocked in ipc_collect / ring_enter.
+    waiting: bool = false,
+
+    /// Append a completed request. Returns true if the owner was blocked
+    /// waiting for it and must be woken.
+    pub fn push(self: *DoneQueue, tr: *TaggedRequest) bool {
+        self.lock.lock();
+        defer self.lock.unlock();
+        tr.next_done = null;
+        if (self.tail) |t| t.next_done = tr else self.head = tr;
+        self.tail = tr;
+        const wake = self.waiting;
+        self.waiting = false;
+        return wake;
+    }
+
+    /// Count one more request in flight, unless MAX_TAGGED already are.
+    /// The check and the increment share one hold of the lock.
+    pub fn reserve(self: *DoneQueue) bool {
+        self.lock.lock();
+        defer self.lock.unlock();
+        if (self.inflight >= MAX_TAGGED) return false;
+        self.inflight += 1;
+        return true;
+    }
+
+    /// Give back a reserve() whose request was never posted.
+    pub fn unreserve(self: *DoneQueue) void {
+        self.lock.lock();
+        defer self.lock.unlock();
+        self.inflight -= 1;
+    }
+
+    /// Take the oldest completed request, if any, without registering the
+    /// owner as a waiter.
+    pub fn tryPop(self: *DoneQueue) ?*TaggedRequest {
+        self.lock.lock();
+        defer self.lock.unlock();
+        const tr = self.head orelse return null;
+        self.head = tr.next_done;
+        if (self.head == null) self.tail = null;
+        self.inflight -= 1;
+        return tr;
+    }
+
+    /// Take the oldest completed request. If there is none and requests are
+    /// still in flight, marks the owner as waiting and sets `must_wait`
+    /// (the owner must then block until push() wakes it).
+    pub fn pop(self: *DoneQueue, must_wait: *bool) ?*TaggedRequest {
+        self.lock.lock();
+        defer self.lock.unlock();
+        const tr = self.head orelse {
+            self.waiting = self.inflight > 0;
+            must_wait.* = self.waiting;
+            return null;
+        };
+        must_wait.* = false;
+        self.head = tr.next_done;
+        if (self.head == null) self.tail = null;
+        self.inflight -= 1;
+        return tr;
+    }
+
+    /// Free uncollected replies and reset (process slot being reused).
+    /// Requests still in flight are freed by the server's reply, which
+    /// finds their pid gone.
+    pub fn release(self: *DoneQueue) void {
+        var it = self.head;
+        while (it) |tr| {
+            it = tr.next_done;
+            freeTagged(tr);
+        }
+        self.* = .{};
+    }
 };
 
 pub const ChannelEnd = struct {
     /// Process ID of the process that owns this end (0 = unowned).
     owner_pid: u32,
-    /// Ring buffer of pending client senders.
-    pending: [MAX_CLIENT_WAITERS]PendingClient = [_]PendingClient{.{ .pid = 0, .msg_ptr = null }} ** MAX_CLIENT_WAITERS,
-    pending_head: u8 = 0,
-    pending_count: u8 = 0,
+    /// FIFO of pending client senders.
+    pending_head: ?*Request = null,
+    pending_tail: ?*Request = null,
+    pending_count: u32 = 0,
     /// PID of the client currently being served by the server (set by recv, used by reply).
     serving_pid: u32 = 0,
     /// Whether the server end is waiting to receive.
@@ -105,21 +264,29 @@ pub const ChannelEnd = struct {
     server_waiters: [MAX_SERVER_WAITERS]u16 = [_]u16{0} ** MAX_SERVER_WAITERS,
     server_waiter_count: u8 = 0,
 
-    /// Enqueue a client sender. Returns false if queue is full.
+    /// Enqueue a client sender. Returns false if no queue node could be
+    /// allocated.
     pub fn enqueue(self: *ChannelEnd, pid: u32, msg_ptr: *Message) bool {
-        if (self.pending_count >= MAX_CLIENT_WAITERS) return false;
-        const idx = (self.pending_head + self.pending_count) % MAX_CLIENT_WAITERS;
-        self.pending[idx] = .{ .pid = pid, .msg_ptr = msg_ptr };
-        self.pending_count += 1;
+        const node = request_cache.create() orelse return false;
+        node.* = .{ .entry = .{ .pid = pid, .msg_ptr = msg_ptr }, .owned = true };
+        self.append(node);
         return true;
     }
 
+    /// Enqueue a tagged request (its queue node is embedded; cannot fail).
+    pub fn enqueueTagged(self: *ChannelEnd, tr: *TaggedRequest) void {
+        tr.node.next = null;
+        self.append(&tr.node);
+    }
+
     /// Dequeue the next pending client. Returns null if empty.
     pub fn dequeue(self: *ChannelEnd) ?PendingClient {
-        if (self.pending_count == 0) return null;
-        const entry = self.pending[self.pending_head];
-        self.pending_head = (self.pending_head + 1) % MAX_CLIENT_WAITERS;
+        const node = self.pending_head orelse return null;
+        self.pending_head = node.next;
+        if (self.pending_head == null) self.pending_tail = null;
         self.pending_count -= 1;
+        const entry = node.entry;
+        if (node.owned) request_cache.destroy(node);
         return entry;
     }
 
@@ -128,6 +295,12 @@ pub const ChannelEnd = struct {
         return self.pending_count > 0;
     }
 
+    fn append(self: *ChannelEnd, node: *Request) void {
+        if (self.pending_tail) |t| t.next = node else self.pending_head = node;
+        self.pending_tail = node;
+        self.pending_count += 1;
+    }
+
     /// Add a server PID to the wait queue. Returns false if full.
     pub fn addServerWaiter(self: *ChannelEnd, pid: u16) bool {
         if (self.server_waiter_count >= MAX_SERVER_WAITERS) return false;
@@ -147,6 +320,31 @@ pub const ChannelEnd = struct {
         self.server_waiter_count -= 1;
         return pid;
     }
+
+    /// Forget a server thread blocked in recv (it died). Returns true if it
+    /// was waiting.
+    pub fn removeServerWaiter(self: *ChannelEnd, pid: u32) bool {
+        var found = false;
+        if (self.blocked_pid == pid) {
+            self.blocked_pid = 0;
+            self.recv_waiting = false;
+            found = true;
+        }
+        var i: u8 = 0;
+        while (i < self.server_waiter_count) {
+            if (self.server_waiters[i] != pid) {
+                i += 1;
+                continue;
+            }
+            var j = i + 1;
+            while (j < self.server_waiter_count) : (j += 1) {
+                self.server_waiters[j - 1] = self.server_waiters[j];
+            }
+            self.server_waiter_count -= 1;
+            found = true;
+        }
+        return found;
+    }
 };
 
 const empty_end = ChannelEnd{
@@ -161,19 +359,18 @@ pub const Channel = struct {
     /// Kernel-backed data: if non-null, reads are served directly from this
     /// buffer (no IPC message passing). Used for initrd file server.
     kernel_data: ?[]const u8,
+    /// Server accepts page-grant bulk transfers (set via ipc_grant ENABLE).
+    /// Large reads/writes on a grant channel skip the 4 KB inline message.
+    grants: bool = false,
     /// Per-channel spinlock for SMP safety.
     lock: SpinLock = .{},
 };
 
-var channels: [MAX_CHANNELS]Channel = [_]Channel{.{
-    .state = .free,
-    .server = empty_end,
-    .client = empty_end,
-    .kernel_data = null,
-}} ** MAX_CHANNELS;
+var channels: [MAX_CHANNELS]?*Channel = [_]?*Channel{null} ** MAX_CHANNELS;
+var channel_cache = slab.ObjectCache(Channel).init("ipc_channel");
 
 /// Global lock for channel allocation.
-var alloc_lock: SpinLock = .{};
+var alloc_lock: QueuedLock = QueuedLock.init("ipc_alloc");
 
 var initialized: bool = false;
 
@@ -196,39 +393,32 @@ pub const IpcError = error{
 pub fn channelCreate() IpcError!struct { server: ChannelId, client: ChannelId } {
     if (!initialized) return error.NotInitialized;
 
-    alloc_lock.lock();
-    defer alloc_lock.unlock();
-
-    for (0..MAX_CHANNELS) |i| {
-        if (channels[i].state == .free) {
-            channels[i] = .{
-                .state = .open,
-                .server = empty_end,
-                .client = empty_end,
-                .kernel_data = null,
-            };
-            const id: ChannelId = @intCast(i);
-            return .{ .server = id, .client = id };
-        }
-    }
-    return error.NoFreeChannels;
+    const id = try allocChannel(null);
+    return .{ .server = id, .client = id };
 }
 
 /// Create a kernel-backed channel: reads served directly from data, no server process.
 pub fn channelCreateKernelBacked(data: []const u8) IpcError!ChannelId {
     if (!initialized) return error.NotInitialized;
 
+    return allocChannel(data);
+}
+
+/// Take the first unused channel id and give it a fresh, open Channel.
+fn allocChannel(kernel_data: ?[]const u8) IpcError!ChannelId {
     alloc_lock.lock();
     defer alloc_lock.unlock();
 
-    for (0..MAX_CHANNELS) |i| {
-        if (channels[i].state == .free) {
-            channels[i] = .{
+    for (&channels, 0..) |*slot, i| {
+        if (slot.* == null) {
+            const chan = channel_cache.create() orelse return error.NoFreeChannels;
+            chan.* = .{
                 .state = .open,
                 .server = empty_end,
                 .client = empty_end,
-                .kernel_data = data,
+                .kernel_data = kernel_data,
             };
+            slot.* = chan;
             return @intCast(i);
         }
     }
@@ -242,7 +432,7 @@ pub fn send(chan_id: ChannelId, msg: *Message) IpcError!void {
     if (!initialized) return error.NotInitialized;
     if (chan_id >= MAX_CHANNELS) return error.InvalidChannel;
 
-    const chan = &channels[chan_id];
+    const chan = channels[chan_id] orelse return error.InvalidChannel;
     chan.lock.lock();
     defer chan.lock.unlock();
 
@@ -258,7 +448,7 @@ pub fn recv(chan_id: ChannelId, out_msg: *Message) IpcError!void {
     if (!initialized) return error.NotInitialized;
     if (chan_id >= MAX_CHANNELS) return error.InvalidChannel;
 
-    const chan = &channels[chan_id];
+    const chan = channels[chan_id] orelse return error.InvalidChannel;
     chan.lock.lock();
     defer chan.lock.unlock();
 
@@ -278,7 +468,7 @@ pub fn reply(chan_id: ChannelId, msg: *Message) IpcError!void {
     if (!initialized) return error.NotInitialized;
     if (chan_id >= MAX_CHANNELS) return error.InvalidChannel;
 
-    const chan = &channels[chan_id];
+    const chan = channels[chan_id] orelse return error.InvalidChannel;
     chan.lock.lock();
     defer chan.lock.unlock();
 
@@ -291,7 +481,7 @@ pub fn reply(chan_id: ChannelId, msg: *Message) IpcError!void {
 /// Close a channel.
 pub fn channelClose(chan_id: ChannelId) void {
     if (chan_id >= MAX_CHANNELS) return;
-    const chan = &channels[chan_id];
+    const chan = channels[chan_id] orelse return;
     chan.lock.lock();
     defer chan.lock.unlock();
     chan.state = .closed;
@@ -302,6 +492,7 @@ pub fn channelClose(chan_id: ChannelId) void {
 /// must handle locking externally if they do complex multi-step operations.
 pub fn getChannel(chan_id: ChannelId) ?*Channel {
     if (chan_id >= MAX_CHANNELS) return null;
-    if (channels[chan_id].state == .free) return null;
-    return &channels[chan_id];
+    const chan = channels[chan_id] orelse return null;
+    if (chan.state == .free) return null;
+    return chan;
 }
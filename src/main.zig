@@ -23,6 +23,7 @@ const namespace = @import("namespace.zig");
 const panic_handler = @import("panic.zig");
 const klog = @import("klog.zig");
 const percpu = @import("percpu.zig");
+const trace = @import("trace.zig");
 
 const paging = switch (builtin.cpu.arch) {
     .x86_64 => @import("arch/x86_64/paging.zig"),
@@ -126,6 +127,9 @@ pub fn kernelInit(initrd_base: ?[*]const u8, initrd_size: usize, rsdp: ?[*]const
     // Phase 23: Serial console input (COM1 IRQ 4 on x86_64, UART PLIC IRQ 10 on riscv64)
     serial.enableRxInterrupt();
 
+    // Event tracing rings (one per core, so after AP startup)
+    trace.init();
+
     // Phase 9: IPC
     ipc.init();
 
@@ -203,9 +207,10 @@ pub fn kernelInit(initrd_base: ?[*]const u8, initrd_size: usize, rsdp: ?[*]const
         time.init(0);
     }
 
-    // Phase 100: Timer tick counter (for TCP retransmission)
+    // Phase 100: Monotonic clock and timer wheels
     const timer = @import("timer.zig");
     timer.init();
+    if (builtin.cpu.arch == .x86_64) @import("xhci.zig").startPolling();
 
     // Phase 16+100: IP stack + TCP/DNS
     net.init();
@@ -237,76 +242,23 @@ fn spawnPartfs() void {
         return;
     };
 
-    const proc = process.create() orelse {
-        klog.err("Failed to create partfs process!\n");
-        return;
-    };
-
-    const load_result = elf.load(proc.pml4.?, partfs_elf) catch {
-        klog.err("Failed to load partfs ELF!\n");
-        proc.state = .dead;
-        return;
-    };
-
-    proc.user_rip = load_result.entry_point;
-    proc.brk = load_result.brk;
-
-    // Allocate user stack
-    for (0..process.USER_STACK_PAGES) |i| {
-        const page = pmm.allocPage() orelse {
-            klog.err("Failed to allocate partfs stack!\n");
-            proc.state = .dead;
-            return;
-        };
-        const ptr: [*]u8 = paging.physPtr(page);
-        @memset(ptr[0..mem.PAGE_SIZE], 0);
-        const vaddr = mem.USER_STACK_TOP - (process.USER_STACK_PAGES - i) * mem.PAGE_SIZE;
-        paging.mapPage(proc.pml4.?, vaddr, page, paging.Flags.WRITABLE | paging.Flags.USER) orelse {
-            klog.err("Failed to map partfs stack!\n");
-            proc.state = .dead;
-            return;
-        };
-    }
-    proc.user_rsp = mem.USER_STACK_INIT;
-
-    // Create IPC channel for partfs
-    const chan = ipc.channelCreate() catch {
-        klog.err("Failed to create partfs channel!\n");
-        proc.state = .dead;
-        return;
-    };
-
-    // Server end as fd 3
-    proc.setFd(3, chan.server, true);
-
     // Block device as fd 4 (raw, whole disk — partfs reads GPT itself)
-    proc.fds[4] = .{
+    const fds = [_]process.FdEntry{.{
         .fd_type = .blk,
         .channel_id = 0,
         .is_server = false,
         .read_offset = 0,
         .server_handle = 0,
-    };
+    }};
 
-    // Mount client end at "/dev/" in root namespace
-    const root_ns = namespace.getRootNamespace();
-    root_ns.mount("/dev/", chan.client, .{ .replace = true }) catch {
-        klog.err("Failed to mount partfs at /dev/!\n");
-        proc.state = .dead;
+    // Server end as fd 3, client end mounted at "/dev/" in root namespace
+    const svc = supervisor.spawnService("partfs", partfs_elf, "/dev/", .{ .fds = &fds }) orelse {
+        klog.err("Failed to spawn partfs!\n");
         return;
     };
 
-    proc.parent_pid = null;
-    root_ns.cloneInto(&proc.ns);
-
-    klog.debug("[partfs: pid=");
-    klog.debugDec(proc.pid);
-    klog.debug(" entry=");
-    klog.debugHex(load_result.entry_point);
-    klog.debug("]\n");
-
     klog.info("Spawned partfs (PID ");
-    klog.infoDec(proc.pid);
+    klog.infoDec(svc.pid.?);
     klog.info(")\n");
 }
 
@@ -319,94 +271,38 @@ fn spawnFxfs() void {
         return;
     };
 
-    const proc = process.create() orelse {
-        klog.err("Failed to create fxfs process!\n");
-        return;
-    };
-
-    const load_result = elf.load(proc.pml4.?, fxfs_elf) catch {
-        klog.err("Failed to load fxfs ELF!\n");
-        proc.state = .dead;
-        return;
-    };
-
-    proc.user_rip = load_result.entry_point;
-    proc.brk = load_result.brk;
-
-    // Allocate user stack
-    for (0..process.USER_STACK_PAGES) |i| {
-        const page = pmm.allocPage() orelse {
-            klog.err("Failed to allocate fxfs stack!\n");
-            proc.state = .dead;
-            return;
-        };
-        const ptr: [*]u8 = paging.physPtr(page);
-        @memset(ptr[0..mem.PAGE_SIZE], 0);
-        const vaddr = mem.USER_STACK_TOP - (process.USER_STACK_PAGES - i) * mem.PAGE_SIZE;
-        paging.mapPage(proc.pml4.?, vaddr, page, paging.Flags.WRITABLE | paging.Flags.USER) orelse {
-            klog.err("Failed to map fxfs stack!\n");
-            proc.state = .dead;
-            return;
-        };
-    }
-    proc.user_rsp = mem.USER_STACK_INIT;
-
-    // Create IPC channel for fxfs
-    const chan = ipc.channelCreate() catch {
-        klog.err("Failed to create fxfs channel!\n");
-        proc.state = .dead;
-        return;
-    };
-
-    // Server end as fd 3
-    proc.setFd(3, chan.server, true);
-
     // Block device as fd 4 (with partition offset if GPT detected)
+    var fds = [_]process.FdEntry{.{
+        .fd_type = .blk,
+        .channel_id = 0,
+        .is_server = false,
+        .read_offset = 0,
+        .server_handle = 0,
+    }};
     const gpt = @import("gpt.zig");
     if (gpt.isInitialized() and gpt.getPartitionCount() > 0) {
         const part = gpt.getPartition(0).?;
-        proc.fds[4] = .{
-            .fd_type = .blk,
-            .channel_id = 0,
-            .is_server = false,
-            .read_offset = 0,
-            .server_handle = 0,
-            .blk_offset = part.first_lba * 512,
-            .blk_size = (part.last_lba - part.first_lba + 1) * 512,
-        };
+        fds[0].blk_offset = part.first_lba * 512;
+        fds[0].blk_size = (part.last_lba - part.first_lba + 1) * 512;
         klog.debug("[fxfs: using partition 1 at LBA ");
         klog.debugDec(part.first_lba);
         klog.debug("]\n");
-    } else {
-        // Fallback: whole disk (backward compatible with unpartitioned disks)
-        proc.fds[4] = .{
-            .fd_type = .blk,
-            .channel_id = 0,
-            .is_server = false,
-            .read_offset = 0,
-            .server_handle = 0,
-        };
     }
-
-    // Mount client end at "/" in root namespace (root filesystem)
-    const root_ns = namespace.getRootNamespace();
-    root_ns.mount("/", chan.client, .{ .replace = true }) catch {
-        klog.err("Failed to mount fxfs at /!\n");
-        proc.state = .dead;
+    // Else whole disk (backward compatible with unpartitioned disks)
+
+    // Mounted at "/" (root filesystem). The standby takes over a crashed
+    // instance with its handle table intact (state region).
+    const svc = supervisor.spawnService("fxfs", fxfs_elf, "/", .{
+        .fds = &fds,
+        .hot_standby = true,
+        .state_region = true,
+    }) orelse {
+        klog.err("Failed to spawn fxfs!\n");
         return;
     };
 
-    proc.parent_pid = null;
-    root_ns.cloneInto(&proc.ns);
-
-    klog.debug("[fxfs: pid=");
-    klog.debugDec(proc.pid);
-    klog.debug(" entry=");
-    klog.debugHex(load_result.entry_point);
-    klog.debug("]\n");
-
     klog.info("Spawned fxfs (PID ");
-    klog.infoDec(proc.pid);
+    klog.infoDec(svc.pid.?);
     klog.info(")\n");
 }
 
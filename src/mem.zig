@@ -32,6 +32,12 @@ pub const ARGV_BASE: u64 = USER_STACK_TOP - PAGE_SIZE;
 /// Used by POSIX programs for AT_PHDR, AT_PHNUM, etc.
 pub const AUXV_BASE: u64 = ARGV_BASE - PAGE_SIZE;
 
+/// Supervised-service state region (see supervisor.zig), in the unused
+/// gap above the stack. The same frames are mapped into every instance
+/// of a service, so what one instance leaves there the next one finds.
+pub const SERVICE_STATE_BASE: u64 = USER_STACK_TOP;
+pub const SERVICE_STATE_PAGES: usize = 4;
+
 /// How much physical memory to map in the kernel half (4 GB).
 pub const KERNEL_MAP_SIZE: u64 = 4 * 1024 * 1024 * 1024;
 
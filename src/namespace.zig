@@ -1,18 +1,40 @@
 /// Per-process namespace — Plan 9's killer feature.
 ///
 /// Each process has its own view of the filesystem tree.
-/// The namespace is a list of mount entries, sorted by path length (longest first)
-/// for longest-prefix matching.
+/// The namespace is a table of mount entries resolved by longest-prefix match.
 ///
 /// Mount flags support union directories (Plan 9 style):
 ///   REPLACE — new mount replaces the old entry
 ///   BEFORE  — new mount searched first in union
 ///   AFTER   — new mount searched after existing
+///
+/// Resolution walks a path-component trie built over the mount table, so
+/// an open costs one child lookup per component instead of a compare
+/// against every mount. The trie is rebuilt on mount/unmount, which are rare.
+///
+/// Mount tables are reference counted and shared copy-on-write: rfork
+/// (RFNAMEG) and process creation just take a reference to the parent's
+/// table, and the first mount or unmount in either namespace copies it.
+/// A Namespace with no table is empty.
+///
+/// SMP: the threads of a group share one Namespace. Its lock covers the
+/// table pointer and the table's contents while this namespace is the
+/// only holder, so an in-place edit, a copy-and-swap or the final drop
+/// can't run under a sibling's resolve or clone. Tables shared with other
+/// namespaces are never written, only copied.
+const std = @import("std");
 const ipc = @import("ipc.zig");
 const heap = @import("heap.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
 
 const MAX_MOUNTS = 32;
 const MAX_PATH = 256;
+/// Trie nodes per table. If the mounts need more, resolve() falls back to
+/// scanning the mount table.
+const MAX_NODES = MAX_MOUNTS * 4;
+/// No mount / no node.
+const NONE: u8 = 0xFF;
+const NIL: u16 = 0;
 
 pub const MountFlags = packed struct {
     replace: bool = false,
@@ -33,106 +55,305 @@ pub const MountEntry = struct {
     active: bool,
 };
 
-pub const Namespace = struct {
+/// Trie node for one path component (the text between two slashes).
+/// Node 0 is the root and stands for zero components consumed.
+const Node = struct {
+    /// Component bytes: mounts[comp_mount].path[comp_off..][0..comp_len].
+    comp_mount: u8,
+    comp_off: u16,
+    comp_len: u16,
+    /// First child and next sibling (NIL = none; the root is never a child).
+    child: u16,
+    sibling: u16,
+    /// Mount whose path is exactly these components ("/dev").
+    exact: u8,
+    /// Mount whose path is these components plus a trailing slash ("/dev/").
+    /// Both match any path that starts with these components; `dir` is the
+    /// longer mount path, so it wins.
+    dir: u8,
+};
+
+/// Shared, reference-counted mount table with its resolution trie.
+const Table = struct {
     mounts: [MAX_MOUNTS]MountEntry,
     count: u16,
+    refs: u32,
+    nodes: [MAX_NODES]Node,
+    node_count: u16,
+    /// The trie ran out of nodes; resolve() scans `mounts` instead.
+    overflow: bool,
 
-    pub fn init() Namespace {
-        var ns = Namespace{
-            .mounts = undefined,
-            .count = 0,
-        };
-        for (&ns.mounts) |*m| {
+    fn reset(self: *Table) void {
+        for (&self.mounts) |*m| {
             m.active = false;
             m.path_len = 0;
             m.channel_id = 0;
             m.flags = .{};
         }
-        return ns;
+        self.count = 0;
+        self.refs = 1;
+        self.rebuild();
+    }
+
+    fn component(self: *const Table, n: *const Node) []const u8 {
+        return self.mounts[n.comp_mount].path[n.comp_off..][0..n.comp_len];
+    }
+
+    fn findChild(self: *const Table, parent: u16, comp: []const u8) ?u16 {
+        var i = self.nodes[parent].child;
+        while (i != NIL) : (i = self.nodes[i].sibling) {
+            if (pathEqual(self.component(&self.nodes[i]), comp)) return i;
+        }
+        return null;
+    }
+
+    fn addChild(self: *Table, parent: u16, mount_idx: u8, off: u16, len: u16) ?u16 {
+        if (self.node_count == MAX_NODES) return null;
+        const i = self.node_count;
+        self.node_count += 1;
+        self.nodes[i] = .{
+            .comp_mount = mount_idx,
+            .comp_off = off,
+            .comp_len = len,
+            .child = NIL,
+            .sibling = self.nodes[parent].child,
+            .exact = NONE,
+            .dir = NONE,
+        };
+        self.nodes[parent].child = i;
+        return i;
+    }
+
+    /// Rebuild the trie from the active mounts. Slots are visited in order
+    /// and a later duplicate replaces an earlier one, as the scan does.
+    fn rebuild(self: *Table) void {
+        self.nodes[0] = .{ .comp_mount = 0, .comp_off = 0, .comp_len = 0, .child = NIL, .sibling = NIL, .exact = NONE, .dir = NONE };
+        self.node_count = 1;
+        self.overflow = false;
+        for (&self.mounts, 0..) |*m, i| {
+            if (!m.active) continue;
+            if (!self.insert(@intCast(i))) {
+                self.overflow = true;
+                return;
+            }
+        }
+    }
+
+    fn insert(self: *Table, idx: u8) bool {
+        const m = &self.mounts[idx];
+        const path = m.path[0..m.path_len];
+        // The empty mount path is a prefix of everything.
+        if (path.len == 0) {
+            self.nodes[0].exact = idx;
+            return true;
+        }
+        const is_dir = path[path.len - 1] == '/';
+        const walk_len = if (is_dir) path.len - 1 else path.len;
+
+        var node: u16 = 0;
+        var pos: usize = 0;
+        while (true) {
+            const end = std.mem.indexOfScalarPos(u8, path[0..walk_len], pos, '/') orelse walk_len;
+            const comp = path[pos..end];
+            node = self.findChild(node, comp) orelse
+                self.addChild(node, idx, @intCast(pos), @intCast(comp.len)) orelse return false;
+            if (end == walk_len) break;
+            pos = end + 1;
+        }
+        if (is_dir) self.nodes[node].dir = idx else self.nodes[node].exact = idx;
+        return true;
+    }
+
+    /// Index of the longest mount that is a prefix of `path`, via the trie.
+    fn walk(self: *const Table, path: []const u8) ?u8 {
+        var best = bestOf(&self.nodes[0]);
+        var node: u16 = 0;
+        var pos: usize = 0;
+        while (true) {
+            const end = std.mem.indexOfScalarPos(u8, path, pos, '/') orelse path.len;
+            node = self.findChild(node, path[pos..end]) orelse break;
+            if (bestOf(&self.nodes[node])) |m| best = m;
+            if (end == path.len) break;
+            pos = end + 1;
+        }
+        return best;
+    }
+
+    /// Same as walk(), by comparing against every mount.
+    fn scan(self: *const Table, path: []const u8) ?u8 {
+        var best_len: u16 = 0;
+        var best: ?u8 = null;
+        for (&self.mounts, 0..) |*m, i| {
+            if (!m.active) continue;
+            if (isPrefix(m.path[0..m.path_len], path) and m.path_len >= best_len) {
+                best_len = m.path_len;
+                best = @intCast(i);
+            }
+        }
+        return best;
+    }
+};
+
+fn bestOf(n: *const Node) ?u8 {
+    if (n.dir != NONE) return n.dir;
+    if (n.exact != NONE) return n.exact;
+    return null;
+}
+
+fn allocTable() ?*Table {
+    const ptr = heap.alloc(@sizeOf(Table)) orelse return null;
+    return @ptrCast(@alignCast(ptr));
+}
+
+fn retainTable(t: *Table) void {
+    _ = @atomicRmw(u32, &t.refs, .Add, 1, .monotonic);
+}
+
+fn dropTable(t: *Table) void {
+    if (@atomicRmw(u32, &t.refs, .Sub, 1, .acq_rel) == 1) {
+        heap.free(@ptrCast(t), @sizeOf(Table));
+    }
+}
+
+pub const Namespace = struct {
+    /// Mount table, possibly shared with other namespaces (null = empty).
+    table: ?*Table = null,
+    lock: SpinLock = .{},
+
+    pub fn init() Namespace {
+        return .{};
+    }
+
+    /// This namespace's table, copied first if it is shared and created
+    /// if there is none yet. Caller holds self.lock.
+    fn own(self: *Namespace) error{OutOfMemory}!*Table {
+        const old = self.table orelse {
+            const t = allocTable() orelse return error.OutOfMemory;
+            t.reset();
+            self.table = t;
+            return t;
+        };
+        if (@atomicLoad(u32, &old.refs, .acquire) == 1) return old;
+        const t = allocTable() orelse return error.OutOfMemory;
+        t.* = old.*;
+        t.refs = 1;
+        self.table = t;
+        dropTable(old);
+        return t;
     }
 
     /// Mount a file server channel at the given path.
     pub fn mount(self: *Namespace, path: []const u8, channel_id: ipc.ChannelId, flags: MountFlags) !void {
         if (path.len > MAX_PATH) return error.PathTooLong;
+        self.lock.lock();
+        defer self.lock.unlock();
+        const t = try self.own();
 
         // If REPLACE, remove existing mount at this exact path
         if (flags.replace) {
-            for (&self.mounts) |*m| {
+            for (&t.mounts) |*m| {
                 if (m.active and pathEqual(m.path[0..m.path_len], path)) {
                     m.active = false;
-                    self.count -= 1;
+                    t.count -= 1;
                     break;
                 }
             }
         }
 
         // Find a free slot
-        for (&self.mounts) |*m| {
+        for (&t.mounts) |*m| {
             if (!m.active) {
                 @memcpy(m.path[0..path.len], path);
                 m.path_len = @intCast(path.len);
                 m.channel_id = channel_id;
                 m.flags = flags;
                 m.active = true;
-                self.count += 1;
+                t.count += 1;
+                t.rebuild();
                 return;
             }
         }
+        t.rebuild();
         return error.TooManyMounts;
     }
 
-    /// Unmount the file server at the given path.
+    /// Unmount the file server at the given path. Leaves the namespace
+    /// unchanged if a shared table cannot be copied.
     pub fn unmount(self: *Namespace, path: []const u8) void {
-        for (&self.mounts) |*m| {
-            if (m.active and pathEqual(m.path[0..m.path_len], path)) {
-                m.active = false;
-                self.count -= 1;
-                return;
-            }
-        }
+        self.lock.lock();
+        defer self.lock.unlock();
+        const shared = self.table orelse return;
+        const idx = for (&shared.mounts, 0..) |*m, i| {
+            if (m.active and pathEqual(m.path[0..m.path_len], path)) break i;
+        } else return;
+        const t = self.own() catch return;
+        t.mounts[idx].active = false;
+        t.count -= 1;
+        t.rebuild();
     }
 
     /// Look up the longest-prefix matching mount for a path.
     /// Returns the channel ID of the file server and the remaining path suffix.
-    pub fn resolve(self: *const Namespace, path: []const u8) ?struct { channel_id: ipc.ChannelId, suffix: []const u8 } {
-        var best_len: u16 = 0;
-        var best_channel: ?ipc.ChannelId = null;
+    pub fn resolve(self: *Namespace, path: []const u8) ?struct { channel_id: ipc.ChannelId, suffix: []const u8 } {
+        self.lock.lock();
+        defer self.lock.unlock();
+        const t = self.table orelse return null;
+        const idx = (if (t.overflow) t.scan(path) else t.walk(path)) orelse return null;
+        const m = &t.mounts[idx];
+        return .{
+            .channel_id = m.channel_id,
+            .suffix = if (m.path_len < path.len) path[m.path_len..] else "",
+        };
+    }
 
-        for (&self.mounts) |*m| {
-            if (!m.active) continue;
-            const mount_path = m.path[0..m.path_len];
-            if (isPrefix(mount_path, path) and m.path_len >= best_len) {
-                best_len = m.path_len;
-                best_channel = m.channel_id;
-            }
+    /// Whether any mount path starts with `prefix`.
+    pub fn hasMountUnder(self: *Namespace, prefix: []const u8) bool {
+        self.lock.lock();
+        defer self.lock.unlock();
+        const t = self.table orelse return false;
+        for (&t.mounts) |*m| {
+            if (m.active and m.path_len >= prefix.len and pathEqual(m.path[0..prefix.len], prefix)) return true;
         }
+        return false;
+    }
 
-        if (best_channel) |ch| {
-            return .{
-                .channel_id = ch,
-                .suffix = if (best_len < path.len) path[best_len..] else "",
-            };
-        }
-        return null;
+    /// Number of active mounts.
+    pub fn count(self: *Namespace) u16 {
+        self.lock.lock();
+        defer self.lock.unlock();
+        return if (self.table) |t| t.count else 0;
     }
 
-    /// Clone this namespace (for rfork with RFNAMEG).
-    pub fn clone(self: *const Namespace) Namespace {
-        var new_ns = Namespace.init();
-        for (0..MAX_MOUNTS) |i| {
-            new_ns.mounts[i] = self.mounts[i];
-        }
-        new_ns.count = self.count;
-        return new_ns;
+    /// Clone this namespace (for rfork with RFNAMEG). The copy shares the
+    /// mount table until either side changes it.
+    pub fn clone(self: *Namespace) Namespace {
+        self.lock.lock();
+        defer self.lock.unlock();
+        if (self.table) |t| retainTable(t);
+        return .{ .table = self.table };
     }
 
-    /// Copy this namespace into a destination pointer (no stack temporaries).
-    /// Use this instead of clone() when stack space is limited (e.g., kernel stacks).
-    pub fn cloneInto(self: *const Namespace, dest: *Namespace) void {
-        for (0..MAX_MOUNTS) |i| {
-            dest.mounts[i] = self.mounts[i];
-        }
-        dest.count = self.count;
+    /// Make `dest` a clone of this namespace, dropping what `dest` had.
+    /// `dest` must be initialized (at least Namespace.init()).
+    pub fn cloneInto(self: *Namespace, dest: *Namespace) void {
+        if (dest == self) return;
+        self.lock.lock();
+        const t = self.table;
+        if (t) |tbl| retainTable(tbl);
+        self.lock.unlock();
+        dest.release();
+        dest.lock.lock();
+        dest.table = t;
+        dest.lock.unlock();
+    }
+
+    /// Drop this namespace's reference to its table, leaving it empty.
+    pub fn release(self: *Namespace) void {
+        self.lock.lock();
+        const t = self.table;
+        self.table = null;
+        self.lock.unlock();
+        if (t) |tbl| dropTable(tbl);
     }
 };
 
@@ -4,6 +4,8 @@
 /// Provides a poll loop and high-level send/receive operations.
 const klog = @import("klog.zig");
 const virtio_net = @import("virtio_net.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
+const timer = @import("timer.zig");
 
 pub const ethernet = @import("net/ethernet.zig");
 pub const arp = @import("net/arp.zig");
@@ -19,6 +21,8 @@ var our_ip: [4]u8 = .{ 10, 0, 2, 15 }; // QEMU user-mode default
 var gateway_ip: [4]u8 = .{ 10, 0, 2, 2 }; // QEMU user-mode default gateway
 var subnet_mask: [4]u8 = .{ 255, 255, 255, 0 };
 var initialized: bool = false;
+/// Serializes draining the RX ring (virtio-net IRQ vs. idle-loop poll).
+var rx_lock: SpinLock = .{};
 
 pub fn init() void {
     if (!virtio_net.isInitialized()) {
@@ -37,6 +41,7 @@ pub fn init() void {
     tcp.init();
     dns.init();
     initialized = true;
+    virtio_net.setRxHandler(&drainRx);
 }
 
 /// Configure IP address.
@@ -76,17 +81,12 @@ pub fn isInitialized() bool {
 
 /// Poll for incoming packets and process them.
 /// Processes up to 64 frames per call, then runs TCP timers and DNS checks.
+/// While any of those has a timeout running, poll_timer calls back in a
+/// tick; an idle stack arms nothing.
 pub fn poll() void {
     if (!initialized) return;
 
-    const timer = @import("timer.zig");
-
-    // Process multiple pending frames
-    var frames: usize = 0;
-    while (frames < 64) : (frames += 1) {
-        const frame = virtio_net.poll() orelse break;
-        handleFrame(frame);
-    }
+    drainRx();
 
     // Run TCP retransmit/timeout timers
     tcp.tick(timer.getTicks());
@@ -96,6 +96,29 @@ pub fn poll() void {
 
     // Check for pending DNS responses
     dns.checkForResponse();
+
+    if (tcp.timersPending() or icmp.waiting() or dns.waiting()) {
+        timer.armOnce(&poll_timer, timer.now() + timer.TICK_NS);
+    }
+}
+
+var poll_timer: timer.Timer = .{ .func = &pollTimerFired };
+
+fn pollTimerFired(_: *timer.Timer) void {
+    poll();
+}
+
+/// Process up to 64 pending frames. Runs from the virtio-net RX IRQ, so
+/// /dev/ether0 readers are woken as soon as a frame lands, and from poll().
+fn drainRx() void {
+    rx_lock.lock();
+    defer rx_lock.unlock();
+    var frames: usize = 0;
+    while (frames < 64) : (frames += 1) {
+        const frame = virtio_net.poll() orelse break;
+        handleFrame(frame);
+    }
+    virtio_net.flushRx();
 }
 
 /// Process a raw Ethernet frame.
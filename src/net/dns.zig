@@ -114,6 +114,11 @@ pub fn getResult() ?[4]u8 {
     return pending_result;
 }
 
+/// Whether a query is in flight, waiting for an answer or a retry.
+pub fn waiting() bool {
+    return pending_name_len > 0 and pending_result == null;
+}
+
 /// Check for DNS responses on the UDP connection. Retries on timeout.
 pub fn checkForResponse() void {
     const conn = udp_conn orelse return;
@@ -198,6 +198,14 @@ pub fn getReplyText(idx: u8, buf: []u8) u16 {
     return pos;
 }
 
+/// Whether an echo request is still waiting for its reply or timeout.
+pub fn waiting() bool {
+    for (&connections) |*c| {
+        if (c.in_use and c.waiter_pid != 0 and !c.got_reply and !c.timed_out) return true;
+    }
+    return false;
+}
+
 /// Check for ICMP read timeouts and wake blocked waiters.
 pub fn checkTimeouts(current_tick: u32) void {
     for (&connections) |*c| {
@@ -1,8 +1,15 @@
 /// TCP: Transmission Control Protocol (RFC 793).
 ///
-/// Minimal TCP implementation with connection state machine, retransmission,
+/// TCP implementation with connection state machine, retransmission,
 /// and ring buffers. Supports connect, listen, send, and receive.
 ///
+/// Options: MSS, window scaling and timestamps (RFC 7323), SACK (RFC 2018).
+/// Sending is a sliding window bounded by the peer's window and a Reno
+/// congestion window (RFC 5681) with NewReno/SACK loss recovery; the RTO
+/// follows RFC 6298. Send and receive buffers come from the kernel heap
+/// when a connection opens, start at MIN_BUF_SIZE and double with the
+/// measured bandwidth-delay product up to MAX_BUF_SIZE.
+///
 /// SMP locking model:
 ///   alloc_lock (global) — protects conn_hash[], in_use flags,
 ///     next_ephemeral_port, seq_counter. Acquired for alloc/free/hash ops.
@@ -15,17 +22,31 @@ const ipv4 = @import("ipv4.zig");
 const klog = @import("../klog.zig");
 const timer = @import("../timer.zig");
 const process = @import("../process.zig");
+const slab = @import("../slab.zig");
+const heap = @import("../heap.zig");
 const SpinLock = @import("../spinlock.zig").SpinLock;
 
-const HEADER_SIZE = 20; // no options
+const HEADER_SIZE = 20; // without options
+const MAX_HEADER_SIZE = 60; // with the full 40 bytes of options
 pub const MAX_CONNECTIONS = 256;
-const RX_BUF_SIZE = 16384;
-const TX_BUF_SIZE = 4096;
-const DEFAULT_MSS: u16 = 1460;
+/// Initial per-connection receive and send buffer size.
+const MIN_BUF_SIZE = 4096;
+/// Largest a buffer grows to (the receive side needs window scaling past 64 KB).
+const MAX_BUF_SIZE = 256 * 1024;
+const DEFAULT_MSS: u16 = 1460; // advertised, and the cap on the peer's
+const FALLBACK_MSS: u16 = 536; // peer sent no MSS option (RFC 1122)
+const MIN_MSS: u16 = 88;
 const DEFAULT_WINDOW: u16 = 16384;
+/// Receive window shift we offer: MAX_BUF_SIZE >> 3 fits the 16-bit field.
+const WINDOW_SHIFT: u8 = 3;
 const INITIAL_RTO: u32 = 18; // ~1 second at 18 Hz
+const MIN_RTO: u32 = 4;
+const MAX_RTO: u32 = 1080; // ~60 seconds
 const MAX_RETRIES: u8 = 8;
 const TIME_WAIT_TICKS: u32 = 36; // ~2 seconds
+const INITIAL_CWND_SEGS = 10; // RFC 6928
+const MAX_SACK_BLOCKS = 4;
+const DUPACK_THRESHOLD = 3;
 
 // TCP flags
 const FIN: u8 = 0x01;
@@ -34,6 +55,15 @@ const RST: u8 = 0x04;
 const PSH: u8 = 0x08;
 const ACK: u8 = 0x10;
 
+// TCP option kinds
+const OPT_END: u8 = 0;
+const OPT_NOP: u8 = 1;
+const OPT_MSS: u8 = 2;
+const OPT_WSCALE: u8 = 3;
+const OPT_SACK_PERM: u8 = 4;
+const OPT_SACK: u8 = 5;
+const OPT_TIMESTAMP: u8 = 8;
+
 pub const TcpState = enum(u8) {
     closed,
     listen,
@@ -54,6 +84,24 @@ const MAX_WAITERS = 4;
 const HASH_EMPTY: u8 = 0xFF;
 const HASH_BUCKETS = 256;
 
+/// Sequence space range [start, end).
+const SeqRange = struct {
+    start: u32,
+    end: u32,
+};
+
+/// Options parsed from an incoming segment.
+const Options = struct {
+    mss: u16 = 0, // 0 = absent
+    wscale: ?u8 = null,
+    sack_permitted: bool = false,
+    has_ts: bool = false,
+    ts_val: u32 = 0,
+    ts_ecr: u32 = 0,
+    sack: [MAX_SACK_BLOCKS]SeqRange = undefined,
+    sack_count: u8 = 0,
+};
+
 pub const Connection = struct {
     // Per-connection lock (hot field, first cache line)
     lock: SpinLock,
@@ -68,16 +116,52 @@ pub const Connection = struct {
     snd_una: u32, // oldest unacknowledged
     snd_nxt: u32, // next to send
     rcv_nxt: u32, // next expected from remote
-    snd_wnd: u16, // remote window
-    mss: u16,
-    // Receive ring buffer
-    rx_buf: [RX_BUF_SIZE]u8,
-    rx_head: u16, // write position
-    rx_count: u16, // bytes available
-    // Transmit buffer (for retransmission)
-    tx_buf: [TX_BUF_SIZE]u8,
-    tx_len: u16, // bytes in tx_buf awaiting ACK
-    // Retransmit timer
+    snd_wnd: u32, // remote window, scaled
+    mss: u16, // send MSS
+    // Negotiated options (offered until the handshake settles them)
+    ws_ok: bool,
+    snd_wscale: u8, // shift for windows the peer sends
+    rcv_wscale: u8, // shift for windows we send
+    sack_ok: bool,
+    ts_ok: bool,
+    ts_recent: u32,
+    // Receive ring (power-of-two capacity). rx_head is the offset of
+    // rcv_nxt; out-of-order data sits at its offset past it.
+    rx_buf: [*]u8,
+    rx_cap: u32,
+    rx_head: u32,
+    rx_count: u32, // in-order bytes available
+    ooo: [MAX_SACK_BLOCKS]SeqRange, // out-of-order ranges, most recent first
+    ooo_count: u8,
+    // Transmit ring: tx_len bytes from snd_una on, sent or not
+    tx_buf: [*]u8,
+    tx_cap: u32,
+    tx_head: u32, // offset of snd_una
+    tx_len: u32,
+    fin_queued: bool,
+    fin_sent: bool,
+    // Congestion control and SACK scoreboard
+    cwnd: u32,
+    ssthresh: u32,
+    dupacks: u8,
+    in_recovery: bool,
+    recover: u32,
+    rtx_nxt: u32, // next sequence loss recovery retransmits
+    sacked: [MAX_SACK_BLOCKS]SeqRange,
+    sacked_count: u8,
+    // RTT estimate in ticks, srtt scaled by 8 (0 = no sample) and rttvar by 4
+    srtt: u32,
+    rttvar: u32,
+    rtt_seq: u32, // segment being timed when there are no timestamps
+    rtt_tick: u32,
+    rtt_timing: bool,
+    // Receive buffer autotuning: bytes delivered since rcv_mark, and the
+    // round trip seen from echoed timestamps (scaled by 8)
+    rcv_bytes: u32,
+    rcv_mark: u32,
+    rcv_rtt: u32,
+    // Retransmit / TIME-WAIT timer; startTimer() also flags the slot in
+    // `timed` so tick() visits it
     retransmit_tick: u32,
     retransmit_count: u8,
     rto: u32,
@@ -87,10 +171,17 @@ pub const Connection = struct {
     listen_waiters: [MAX_WAITERS]?u16,
     // Listener parent index (for connections spawned by accept)
     parent_idx: u8,
+    // This connection's own slot index
+    idx: u8,
 };
 
-/// Connections array — must be in BSS to avoid bloating .data (~5.8 MB)
-var connections: [MAX_CONNECTIONS]Connection linksection(".bss") = undefined;
+/// Connection slots. A Connection is allocated from conn_cache the first
+/// time its slot is used and then kept for reuse: lookups lock a
+/// connection before checking in_use, so its memory must outlive the slot.
+/// Its buffers are only held while the connection is open.
+/// Allocated slots always form a prefix of the table.
+var connections: [MAX_CONNECTIONS]?*Connection = [_]?*Connection{null} ** MAX_CONNECTIONS;
+var conn_cache = slab.ObjectCache(Connection).init("tcp_conn");
 var next_ephemeral_port: u16 = 49152;
 var seq_counter: u32 = 1000;
 
@@ -98,6 +189,11 @@ var seq_counter: u32 = 1000;
 /// next_ephemeral_port, seq_counter.
 var alloc_lock: SpinLock = .{};
 
+/// Connections whose retransmit or TIME-WAIT timer may be running, one bit
+/// per slot. tick() visits only these and clears the bits of connections
+/// it finds idle; bits change under the connection's lock.
+var timed: [MAX_CONNECTIONS / 64]u64 = [_]u64{0} ** (MAX_CONNECTIONS / 64);
+
 /// Hash table for O(1) established-connection demux (chained).
 /// Listeners are NOT in the hash table (linear scan, few listeners).
 var conn_hash: [HASH_BUCKETS]u8 = [_]u8{HASH_EMPTY} ** HASH_BUCKETS;
@@ -108,9 +204,6 @@ const net = @import("../net.zig");
 const no_waiters = [_]?u16{null} ** MAX_WAITERS;
 
 pub fn init() void {
-    for (&connections) |*c| {
-        resetConn(c);
-    }
     for (&conn_hash) |*h| {
         h.* = HASH_EMPTY;
     }
@@ -121,6 +214,12 @@ fn resetConn(c: *Connection) void {
     c.lock = .{};
     c.in_use = false;
     c.state = .closed;
+    clearConn(c);
+}
+
+/// Reset everything but the lock, in_use and state. Buffers must already
+/// have been released (freeBuffers).
+fn clearConn(c: *Connection) void {
     c.hash_next = HASH_EMPTY;
     c.local_port = 0;
     c.remote_port = 0;
@@ -131,10 +230,34 @@ fn resetConn(c: *Connection) void {
     c.rcv_nxt = 0;
     c.snd_wnd = DEFAULT_WINDOW;
     c.mss = DEFAULT_MSS;
-    // rx_buf/tx_buf left undefined (BSS)
+    c.ws_ok = false;
+    c.snd_wscale = 0;
+    c.rcv_wscale = 0;
+    c.sack_ok = false;
+    c.ts_ok = false;
+    c.ts_recent = 0;
     c.rx_head = 0;
     c.rx_count = 0;
+    c.ooo_count = 0;
+    c.tx_head = 0;
     c.tx_len = 0;
+    c.fin_queued = false;
+    c.fin_sent = false;
+    c.cwnd = INITIAL_CWND_SEGS * @as(u32, DEFAULT_MSS);
+    c.ssthresh = 0xFFFF_FFFF;
+    c.dupacks = 0;
+    c.in_recovery = false;
+    c.recover = 0;
+    c.rtx_nxt = 0;
+    c.sacked_count = 0;
+    c.srtt = 0;
+    c.rttvar = 0;
+    c.rtt_seq = 0;
+    c.rtt_tick = 0;
+    c.rtt_timing = false;
+    c.rcv_bytes = 0;
+    c.rcv_mark = 0;
+    c.rcv_rtt = 0;
     c.retransmit_tick = 0;
     c.retransmit_count = 0;
     c.rto = INITIAL_RTO;
@@ -162,7 +285,7 @@ fn connHashFn(local_port: u16, remote_port: u16, remote_ip: [4]u8) u8 {
 
 /// Prepend connection idx to its hash bucket chain. Caller holds alloc_lock.
 fn hashInsert(idx: u8) void {
-    const c = &connections[idx];
+    const c = connections[idx].?;
     const bucket = connHashFn(c.local_port, c.remote_port, c.remote_ip);
     c.hash_next = conn_hash[bucket];
     conn_hash[bucket] = idx;
@@ -170,18 +293,18 @@ fn hashInsert(idx: u8) void {
 
 /// Remove connection idx from its hash bucket chain. Caller holds alloc_lock.
 fn hashRemove(idx: u8) void {
-    const c = &connections[idx];
+    const c = connections[idx].?;
     const bucket = connHashFn(c.local_port, c.remote_port, c.remote_ip);
     if (conn_hash[bucket] == idx) {
         conn_hash[bucket] = c.hash_next;
     } else {
         var prev = conn_hash[bucket];
         while (prev != HASH_EMPTY) {
-            if (connections[prev].hash_next == idx) {
-                connections[prev].hash_next = c.hash_next;
+            if (connections[prev].?.hash_next == idx) {
+                connections[prev].?.hash_next = c.hash_next;
                 break;
             }
-            prev = connections[prev].hash_next;
+            prev = connections[prev].?.hash_next;
         }
     }
     c.hash_next = HASH_EMPTY;
@@ -193,7 +316,7 @@ fn hashLookup(local_port: u16, remote_port: u16, remote_ip: [4]u8) ?u8 {
     const bucket = connHashFn(local_port, remote_port, remote_ip);
     var idx = conn_hash[bucket];
     while (idx != HASH_EMPTY) {
-        const c = &connections[idx];
+        const c = connections[idx].?;
         if (c.in_use and c.local_port == local_port and
             c.remote_port == remote_port and
             ipv4.ipEqual(c.remote_ip, remote_ip))
@@ -216,10 +339,20 @@ pub fn alloc() ?u8 {
 
 /// Internal alloc — caller must hold alloc_lock.
 fn allocLocked() ?u8 {
-    for (&connections, 0..) |*c, i| {
+    for (&connections, 0..) |*slot, i| {
+        const c = slot.* orelse blk: {
+            // First use of this slot
+            const fresh = conn_cache.create() orelse return null;
+            fresh.rx_cap = 0;
+            fresh.tx_cap = 0;
+            resetConn(fresh);
+            @atomicStore(?*Connection, slot, fresh, .release); // tick() reads unlocked
+            break :blk fresh;
+        };
         if (!c.in_use) {
             resetConn(c);
             c.in_use = true;
+            c.idx = @intCast(i);
             c.local_port = allocEphemeralPort();
             c.local_ip = net.getIp();
             return @intCast(i);
@@ -228,10 +361,15 @@ fn allocLocked() ?u8 {
     return null;
 }
 
+/// Connection for a caller-supplied index, or null if the slot was never used.
+fn getConn(idx: u8) ?*Connection {
+    if (idx >= MAX_CONNECTIONS) return null;
+    return connections[idx];
+}
+
 /// Get connection state for status queries.
 pub fn getState(idx: u8) ?TcpState {
-    if (idx >= MAX_CONNECTIONS) return null;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return null;
     c.lock.lock();
     defer c.lock.unlock();
     if (!c.in_use) return null;
@@ -240,8 +378,7 @@ pub fn getState(idx: u8) ?TcpState {
 
 /// Get connection's local port and IP.
 pub fn getLocal(idx: u8) ?struct { ip: [4]u8, port: u16 } {
-    if (idx >= MAX_CONNECTIONS) return null;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return null;
     c.lock.lock();
     defer c.lock.unlock();
     if (!c.in_use) return null;
@@ -250,8 +387,7 @@ pub fn getLocal(idx: u8) ?struct { ip: [4]u8, port: u16 } {
 
 /// Get connection's remote port and IP.
 pub fn getRemote(idx: u8) ?struct { ip: [4]u8, port: u16 } {
-    if (idx >= MAX_CONNECTIONS) return null;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return null;
     c.lock.lock();
     defer c.lock.unlock();
     if (!c.in_use) return null;
@@ -261,22 +397,29 @@ pub fn getRemote(idx: u8) ?struct { ip: [4]u8, port: u16 } {
 /// Initiate a TCP connection (active open).
 /// Lock order: conn.lock → alloc_lock (for hash insert).
 pub fn connect(idx: u8, ip: [4]u8, port: u16) bool {
-    if (idx >= MAX_CONNECTIONS) return false;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return false;
     c.lock.lock();
     defer c.lock.unlock();
     if (!c.in_use or c.state != .closed) return false;
+    if (!allocBuffers(c)) return false;
 
     c.remote_ip = ip;
     c.remote_port = port;
+    alloc_lock.lock();
     c.snd_una = nextSeqLocked();
+    alloc_lock.unlock();
     c.snd_nxt = c.snd_una;
+    // Offer everything; the SYN-ACK decides what sticks.
+    c.ws_ok = true;
+    c.rcv_wscale = WINDOW_SHIFT;
+    c.sack_ok = true;
+    c.ts_ok = true;
 
     // Send SYN
     sendSyn(c);
     c.snd_nxt = c.snd_una +% 1; // SYN consumes one sequence number
     c.state = .syn_sent;
-    c.retransmit_tick = timer.getTicks();
+    startTimer(c, timer.getTicks());
     c.retransmit_count = 0;
 
     // Insert into hash table
@@ -295,8 +438,7 @@ pub fn connect(idx: u8, ip: [4]u8, port: u16) bool {
 /// Set up a listening socket (passive open).
 /// Listeners are NOT in the hash table.
 pub fn announce(idx: u8, port: u16) bool {
-    if (idx >= MAX_CONNECTIONS) return false;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return false;
     c.lock.lock();
     defer c.lock.unlock();
     if (!c.in_use or c.state != .closed) return false;
@@ -312,91 +454,108 @@ pub fn announce(idx: u8, port: u16) bool {
 
 /// Queue data for transmission on an established connection.
 pub fn sendData(idx: u8, data: []const u8) u16 {
-    if (idx >= MAX_CONNECTIONS) return 0;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return 0;
     c.lock.lock();
     defer c.lock.unlock();
     if (c.state != .established and c.state != .close_wait) return 0;
 
-    const available = TX_BUF_SIZE - c.tx_len;
-    const to_send: u16 = @intCast(@min(data.len, available));
+    if (c.tx_cap - c.tx_len < data.len) growTx(c);
+    const to_send: u32 = @intCast(@min(data.len, c.tx_cap - c.tx_len, 0xFFFF));
     if (to_send == 0) return 0;
 
-    @memcpy(c.tx_buf[c.tx_len..][0..to_send], data[0..to_send]);
+    ringWrite(c.tx_buf, c.tx_cap, c.tx_head +% c.tx_len, data[0..to_send]);
     c.tx_len += to_send;
 
-    // Send segment immediately
-    sendDataSegment(c);
+    // Send whatever the windows allow right away
+    trySend(c);
 
-    return to_send;
+    return @intCast(to_send);
 }
 
 /// Read received data from the connection's rx ring buffer.
 pub fn recvData(idx: u8, buf: []u8) u16 {
-    if (idx >= MAX_CONNECTIONS) return 0;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return 0;
+    c.lock.lock();
+    defer c.lock.unlock();
+    return recvLocked(c, buf);
+}
+
+/// recvData, or if nothing is buffered: 0 at EOF, otherwise register `pid`
+/// as a read waiter (unless 0) and return null. The check and the
+/// registration share one hold of conn.lock, so data landing in between
+/// can't slip past the waiter.
+pub fn recvOrWait(idx: u8, buf: []u8, pid: u16) ?u16 {
+    const c = getConn(idx) orelse return 0;
     c.lock.lock();
     defer c.lock.unlock();
+    if (c.rx_count > 0) return recvLocked(c, buf);
+    if (eofLocked(c)) return 0;
+    if (pid != 0) addWaiter(&c.read_waiters, pid);
+    return null;
+}
+
+/// Caller holds c.lock.
+fn recvLocked(c: *Connection, buf: []u8) u16 {
     if (c.rx_count == 0) return 0;
 
     const old_count = c.rx_count;
-    const to_copy: u16 = @intCast(@min(buf.len, c.rx_count));
+    const to_copy: u32 = @intCast(@min(buf.len, c.rx_count, 0xFFFF));
     // Read from ring buffer — head points to the write position,
     // read position = head - count (wrapped)
-    const read_pos = (c.rx_head -% c.rx_count) % RX_BUF_SIZE;
-
-    var i: u16 = 0;
-    while (i < to_copy) : (i += 1) {
-        buf[i] = c.rx_buf[(read_pos + i) % RX_BUF_SIZE];
-    }
+    ringRead(c.rx_buf, c.rx_cap, c.rx_head -% c.rx_count, buf[0..to_copy]);
     c.rx_count -= to_copy;
 
     // Send window update ACK if buffer was previously too full for an MSS-sized
     // segment and now has room. This unblocks the remote when it stopped sending
     // due to a small/zero advertised window.
-    const was_full = old_count > RX_BUF_SIZE / 2;
-    const now_has_room = c.rx_count <= RX_BUF_SIZE / 2;
+    const was_full = old_count > c.rx_cap / 2;
+    const now_has_room = c.rx_count <= c.rx_cap / 2;
     if (c.state == .established and was_full and now_has_room) {
         sendAck(c);
     }
-    return to_copy;
+    return @intCast(to_copy);
 }
 
 /// Check if connection has data available to read.
 pub fn hasData(idx: u8) bool {
-    if (idx >= MAX_CONNECTIONS) return false;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return false;
     c.lock.lock();
     defer c.lock.unlock();
-    return connections[idx].rx_count > 0;
+    return c.rx_count > 0;
 }
 
 /// Check if connection is in a state where no more data will arrive (EOF).
 pub fn isEof(idx: u8) bool {
-    if (idx >= MAX_CONNECTIONS) return true;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return true;
     c.lock.lock();
     defer c.lock.unlock();
+    return eofLocked(c);
+}
+
+/// Caller holds c.lock.
+fn eofLocked(c: *const Connection) bool {
     return c.state == .close_wait or c.state == .closing or
         c.state == .last_ack or c.state == .time_wait or c.state == .closed;
 }
 
-/// Initiate a graceful close (send FIN).
+/// Initiate a graceful close. The FIN goes out once all queued data has
+/// been sent.
 /// Lock order: conn.lock → alloc_lock (for freeConn).
 pub fn startClose(idx: u8) void {
-    if (idx >= MAX_CONNECTIONS) return;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return;
     c.lock.lock();
 
     switch (c.state) {
         .established => {
-            sendFin(c);
+            c.fin_queued = true;
             c.state = .fin_wait_1;
+            trySend(c);
             c.lock.unlock();
         },
         .close_wait => {
-            sendFin(c);
+            c.fin_queued = true;
             c.state = .last_ack;
+            trySend(c);
             c.lock.unlock();
         },
         .syn_sent, .syn_received => {
@@ -419,8 +578,7 @@ pub fn startClose(idx: u8) void {
 
 /// Register a waiter for read (blocks until data arrives).
 pub fn setReadWaiter(idx: u8, pid: u16) void {
-    if (idx >= MAX_CONNECTIONS) return;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return;
     c.lock.lock();
     defer c.lock.unlock();
     addWaiter(&c.read_waiters, pid);
@@ -428,8 +586,7 @@ pub fn setReadWaiter(idx: u8, pid: u16) void {
 
 /// Register a waiter for connect completion.
 pub fn setConnectWaiter(idx: u8, pid: u16) void {
-    if (idx >= MAX_CONNECTIONS) return;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return;
     c.lock.lock();
     defer c.lock.unlock();
     addWaiter(&c.connect_waiters, pid);
@@ -437,8 +594,7 @@ pub fn setConnectWaiter(idx: u8, pid: u16) void {
 
 /// Register a waiter for listen/accept.
 pub fn setListenWaiter(idx: u8, pid: u16) void {
-    if (idx >= MAX_CONNECTIONS) return;
-    const c = &connections[idx];
+    const c = getConn(idx) orelse return;
     c.lock.lock();
     defer c.lock.unlock();
     addWaiter(&c.listen_waiters, pid);
@@ -472,6 +628,7 @@ pub fn handlePacket(payload: []const u8, ip_hdr: ipv4.Header) void {
         return;
     }
 
+    const opts = parseOptions(payload[HEADER_SIZE..data_offset]);
     const data = payload[data_offset..];
 
     // Step 1: Hash lookup for established/in-progress connections
@@ -480,14 +637,14 @@ pub fn handlePacket(payload: []const u8, ip_hdr: ipv4.Header) void {
     alloc_lock.unlock();
 
     if (matched_idx) |idx| {
-        const c = &connections[idx];
+        const c = connections[idx].?;
         c.lock.lock();
         // Verify connection still matches (race with free/reuse)
         if (c.in_use and c.local_port == dst_port and
             c.remote_port == src_port and
             ipv4.ipEqual(c.remote_ip, ip_hdr.src))
         {
-            handleSegment(c, idx, seq_num, ack_num, flags, window, data, ip_hdr);
+            handleSegment(c, idx, seq_num, ack_num, flags, window, data, &opts);
             // handleSegment may call freeConn which releases lock
             if (c.lock.isLocked()) c.lock.unlock();
         } else {
@@ -499,7 +656,8 @@ pub fn handlePacket(payload: []const u8, ip_hdr: ipv4.Header) void {
     // Step 2: Linear scan for listeners (rare — SYN only)
     alloc_lock.lock();
     var listener_idx: ?u8 = null;
-    for (&connections, 0..) |*c, i| {
+    for (connections, 0..) |slot, i| {
+        const c = slot orelse break;
         if (c.in_use and c.state == .listen and c.local_port == dst_port) {
             listener_idx = @intCast(i);
             break;
@@ -508,13 +666,13 @@ pub fn handlePacket(payload: []const u8, ip_hdr: ipv4.Header) void {
     alloc_lock.unlock();
 
     if (listener_idx) |lidx| {
-        const listener = &connections[lidx];
+        const listener = connections[lidx].?;
         listener.lock.lock();
         // Verify still a listener
         if (listener.in_use and listener.state == .listen and
             listener.local_port == dst_port)
         {
-            handleListenSegment(listener, lidx, seq_num, flags, ip_hdr, src_port);
+            handleListenSegment(listener, lidx, seq_num, flags, ip_hdr, src_port, &opts);
         }
         listener.lock.unlock();
         return;
@@ -526,87 +684,114 @@ pub fn handlePacket(payload: []const u8, ip_hdr: ipv4.Header) void {
     }
 }
 
-/// Timer tick — check retransmission timers and TIME_WAIT expiry.
-/// Acquires per-connection locks individually.
+/// Timer tick — check retransmission timers and TIME_WAIT expiry on the
+/// connections flagged in `timed`. Acquires per-connection locks
+/// individually.
 pub fn tick(now: u32) void {
-    for (&connections, 0..) |*c, i| {
-        // Quick non-locked check to skip unused slots
-        if (!@atomicLoad(bool, &c.in_use, .acquire)) continue;
-
-        c.lock.lock();
-        if (!c.in_use) {
-            c.lock.unlock();
-            continue;
+    for (&timed, 0..) |*word, w| {
+        var bits = @atomicLoad(u64, word, .acquire);
+        while (bits != 0) : (bits &= bits - 1) {
+            const i: u8 = @intCast(w * 64 + @ctz(bits));
+            tickConn(i, now);
         }
+    }
+}
 
-        switch (c.state) {
-            .syn_sent => {
-                if (now -% c.retransmit_tick >= c.rto) {
-                    if (c.retransmit_count >= MAX_RETRIES) {
-                        klog.debug("tcp: connect timeout\n");
-                        wakeAllWaiters(&c.connect_waiters, true);
-                        freeConn(c, @intCast(i)); // releases lock
-                        continue;
-                    } else {
-                        // Retransmit SYN
-                        klog.debug("tcp: retransmit SYN #");
-                        klog.debugDec(c.retransmit_count + 1);
-                        klog.debug("\n");
-                        sendSyn(c);
-                        c.retransmit_count += 1;
-                        c.retransmit_tick = now;
-                        c.rto *= 2; // exponential backoff
-                    }
+/// Whether any connection has a timer running.
+pub fn timersPending() bool {
+    for (&timed) |*word| {
+        if (@atomicLoad(u64, word, .monotonic) != 0) return true;
+    }
+    return false;
+}
+
+fn tickConn(i: u8, now: u32) void {
+    const c = @atomicLoad(?*Connection, &connections[i], .acquire) orelse return;
+    c.lock.lock();
+    if (!c.in_use or !timerRunning(c)) {
+        stopTimer(i);
+        c.lock.unlock();
+        return;
+    }
+
+    switch (c.state) {
+        .syn_sent => {
+            if (now -% c.retransmit_tick >= c.rto) {
+                if (c.retransmit_count >= MAX_RETRIES) {
+                    klog.debug("tcp: connect timeout\n");
+                    wakeAllWaiters(&c.connect_waiters, true);
+                    freeConn(c, i); // releases lock
+                    return;
+                } else {
+                    // Retransmit SYN
+                    klog.debug("tcp: retransmit SYN #");
+                    klog.debugDec(c.retransmit_count + 1);
+                    klog.debug("\n");
+                    sendSyn(c);
+                    c.retransmit_count += 1;
+                    c.retransmit_tick = now;
+                    c.rto = @min(c.rto * 2, MAX_RTO); // exponential backoff
                 }
-            },
-            .established, .close_wait => {
-                // Retransmit data if unacked
-                if (c.tx_len > 0 and seqDiff(c.snd_nxt, c.snd_una) > 0) {
-                    if (now -% c.retransmit_tick >= c.rto) {
-                        if (c.retransmit_count >= MAX_RETRIES) {
-                            klog.debug("tcp: retransmit timeout\n");
-                            wakeAllWaiters(&c.read_waiters, true);
-                            sendRst(c);
-                            freeConn(c, @intCast(i)); // releases lock
-                            continue;
-                        } else {
-                            sendDataSegment(c);
-                            c.retransmit_count += 1;
-                            c.retransmit_tick = now;
-                        }
+            }
+        },
+        .established, .close_wait, .fin_wait_1, .last_ack, .closing => {
+            // Retransmit if data or our FIN is unacked
+            if (c.snd_nxt != c.snd_una and now -% c.retransmit_tick >= c.rto) {
+                if (c.retransmit_count >= MAX_RETRIES) {
+                    klog.debug("tcp: retransmit timeout\n");
+                    if (c.state == .established or c.state == .close_wait) {
+                        wakeAllWaiters(&c.read_waiters, true);
+                        sendRst(c);
                     }
-                }
-            },
-            .fin_wait_1, .last_ack, .closing => {
-                if (now -% c.retransmit_tick >= c.rto) {
-                    if (c.retransmit_count >= MAX_RETRIES) {
-                        freeConn(c, @intCast(i)); // releases lock
-                        continue;
+                    freeConn(c, i); // releases lock
+                    return;
+                } else {
+                    if (dataSent(c) > 0) {
+                        enterRecovery(c, true);
                     } else {
-                        sendFin(c);
-                        c.retransmit_count += 1;
-                        c.retransmit_tick = now;
+                        // Only our FIN is outstanding
+                        sendFlags(c, FIN | ACK, c.snd_nxt -% 1);
                     }
+                    c.retransmit_count += 1;
+                    c.retransmit_tick = now;
+                    c.rto = @min(c.rto * 2, MAX_RTO);
                 }
-            },
-            .time_wait => {
-                if (now -% c.retransmit_tick >= TIME_WAIT_TICKS) {
-                    freeConn(c, @intCast(i)); // releases lock
-                    continue;
-                }
-            },
-            else => {},
-        }
-        c.lock.unlock();
+            }
+        },
+        .time_wait => {
+            if (now -% c.retransmit_tick >= TIME_WAIT_TICKS) {
+                freeConn(c, i); // releases lock
+                return;
+            }
+        },
+        else => {},
     }
+    c.lock.unlock();
 }
 
 // ── Internal helpers ────────────────────────────────────────────────
-// handleSegment and handleEstablished: caller holds conn.lock.
+// Everything below that takes a Connection: caller holds conn.lock.
+
+/// (Re)start the retransmit or TIME-WAIT timer from `now`.
+fn startTimer(c: *Connection, now: u32) void {
+    c.retransmit_tick = now;
+    _ = @atomicRmw(u64, &timed[c.idx / 64], .Or, @as(u64, 1) << @intCast(c.idx % 64), .release);
+}
+
+fn stopTimer(idx: u8) void {
+    _ = @atomicRmw(u64, &timed[idx / 64], .And, ~(@as(u64, 1) << @intCast(idx % 64)), .release);
+}
 
-fn handleSegment(c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window: u16, data: []const u8, ip_hdr: ipv4.Header) void {
-    _ = ip_hdr;
+/// Whether tick() has anything to check on `c`.
+fn timerRunning(c: *const Connection) bool {
+    return switch (c.state) {
+        .syn_sent, .time_wait => true,
+        .established, .close_wait, .fin_wait_1, .last_ack, .closing => c.snd_nxt != c.snd_una,
+        else => false,
+    };
+}
 
+fn handleSegment(c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window: u16, data: []const u8, opts: *const Options) void {
     // RST handling — always process
     if (flags & RST != 0) {
         klog.debug("tcp: received RST\n");
@@ -624,10 +809,12 @@ fn handleSegment(c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window:
                 if (ack == c.snd_nxt) {
                     c.rcv_nxt = seq +% 1;
                     c.snd_una = ack;
-                    c.snd_wnd = window;
+                    applySynOptions(c, opts);
+                    c.snd_wnd = window; // never scaled on a SYN
                     c.state = .established;
-                    c.retransmit_count = 0;
                     c.rto = INITIAL_RTO;
+                    if (c.retransmit_count == 0) rttSample(c, timer.getTicks() -% c.retransmit_tick);
+                    c.retransmit_count = 0;
                     c.tx_len = 0;
                     sendAck(c);
                     klog.debug("tcp: connected\n");
@@ -636,166 +823,300 @@ fn handleSegment(c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window:
             }
         },
         .syn_received => {
-            if (flags & ACK != 0 and ack == c.snd_nxt) {
+            if (flags & SYN != 0 and flags & ACK == 0) {
+                // Our SYN-ACK was lost and the peer retried its SYN
+                sendFlags(c, SYN | ACK, c.snd_una);
+            } else if (flags & ACK != 0 and ack == c.snd_nxt) {
                 c.snd_una = ack;
-                c.snd_wnd = window;
+                c.snd_wnd = @as(u32, window) << @intCast(c.snd_wscale);
                 c.state = .established;
-                c.retransmit_count = 0;
                 c.rto = INITIAL_RTO;
+                if (c.retransmit_count == 0) rttSample(c, timer.getTicks() -% c.retransmit_tick);
+                c.retransmit_count = 0;
                 klog.debug("tcp: accept complete\n");
                 // Wake the listener's waiter — must lock parent briefly
                 if (c.parent_idx != 0xFF and c.parent_idx < MAX_CONNECTIONS) {
-                    const parent = &connections[c.parent_idx];
+                    const parent = connections[c.parent_idx].?;
                     parent.lock.lock();
                     wakeAllWaiters(&parent.listen_waiters, false);
                     parent.lock.unlock();
                 }
+                // The handshake ACK may already carry data
+                if (data.len > 0 or flags & FIN != 0) {
+                    handleEstablished(c, idx, seq, ack, flags, window, data, opts);
+                }
             }
         },
-        .established => {
-            handleEstablished(c, seq, ack, flags, window, data);
+        .established, .fin_wait_1, .fin_wait_2, .close_wait, .closing, .last_ack => {
+            handleEstablished(c, idx, seq, ack, flags, window, data, opts);
+        },
+        else => {},
+    }
+}
+
+/// Segment on a synchronized connection: ACK processing, receive, and
+/// the close-side state transitions. May free the connection (last_ack).
+fn handleEstablished(c: *Connection, idx: u8, seq: u32, ack: u32, flags: u8, window: u16, data: []const u8, opts: *const Options) void {
+    // RFC 7323 §4.3: echo the TSval of the latest segment at or before rcv_nxt
+    if (c.ts_ok and opts.has_ts and seqDiff(seq, c.rcv_nxt) <= 0) c.ts_recent = opts.ts_val;
+
+    if (flags & ACK != 0) processAck(c, ack, window, data.len, opts);
+
+    var fin = false;
+    const receiving = c.state == .established or c.state == .fin_wait_1 or c.state == .fin_wait_2;
+    if (receiving and (data.len > 0 or flags & FIN != 0)) {
+        if (data.len > 0) receiveData(c, seq, data, opts);
+        // FIN only counts once everything before it has arrived
+        if (flags & FIN != 0 and seq +% @as(u32, @intCast(data.len)) == c.rcv_nxt) {
+            c.rcv_nxt +%= 1; // FIN consumes one sequence number
+            fin = true;
+        }
+        // ACK (also for out-of-order data: the duplicate ACK and its SACK
+        // blocks drive fast retransmit on the remote)
+        sendAck(c);
+    }
+
+    const fin_acked = c.fin_sent and c.snd_una == c.snd_nxt;
+    switch (c.state) {
+        .established => if (fin) {
+            c.state = .close_wait;
+            // Wake reader with EOF
+            wakeAllWaiters(&c.read_waiters, false);
+            klog.debug("tcp: remote closed (FIN)\n");
         },
         .fin_wait_1 => {
-            // Process ACK of our FIN
-            if (flags & ACK != 0) {
-                if (ack == c.snd_nxt) {
-                    c.snd_una = ack;
-                }
-            }
-            if (flags & FIN != 0) {
-                c.rcv_nxt = seq +% 1;
-                sendAck(c);
-                if (c.snd_una == c.snd_nxt) {
-                    // Our FIN was acked — go to TIME_WAIT
-                    c.state = .time_wait;
-                    c.retransmit_tick = timer.getTicks();
-                } else {
-                    c.state = .closing;
-                }
-            } else if (c.snd_una == c.snd_nxt) {
+            if (fin) {
+                // Our FIN acked too — go to TIME_WAIT
+                c.state = if (fin_acked) .time_wait else .closing;
+                if (c.state == .time_wait) startTimer(c, timer.getTicks());
+            } else if (fin_acked) {
                 c.state = .fin_wait_2;
             }
         },
-        .fin_wait_2 => {
-            if (flags & FIN != 0) {
-                c.rcv_nxt = seq +% 1;
-                sendAck(c);
-                c.state = .time_wait;
-                c.retransmit_tick = timer.getTicks();
-            }
-        },
-        .closing => {
-            if (flags & ACK != 0 and ack == c.snd_nxt) {
-                c.state = .time_wait;
-                c.retransmit_tick = timer.getTicks();
-            }
-        },
-        .last_ack => {
-            if (flags & ACK != 0 and ack == c.snd_nxt) {
-                freeConn(c, idx); // releases conn.lock
-                return;
-            }
+        .fin_wait_2 => if (fin) {
+            c.state = .time_wait;
+            startTimer(c, timer.getTicks());
         },
-        .close_wait => {
-            // We can still receive ACKs for data we sent
-            if (flags & ACK != 0) {
-                processAck(c, ack, window);
-            }
+        .closing => if (fin_acked) {
+            c.state = .time_wait;
+            startTimer(c, timer.getTicks());
         },
+        .last_ack => if (fin_acked) freeConn(c, idx), // releases conn.lock
         else => {},
     }
 }
 
-fn handleEstablished(c: *Connection, seq: u32, ack: u32, flags: u8, window: u16, data: []const u8) void {
-    // Process ACK
-    if (flags & ACK != 0) {
-        processAck(c, ack, window);
+/// Place incoming data in the receive ring. In-order bytes advance
+/// rcv_nxt (absorbing any out-of-order ranges they reach); bytes past a
+/// hole stay at their offset and are reported back as SACK blocks.
+fn receiveData(c: *Connection, seg_seq: u32, seg_data: []const u8, opts: *const Options) void {
+    var seq = seg_seq;
+    var data = seg_data;
+    if (seqDiff(c.rcv_nxt, seq) > 0) {
+        const behind = c.rcv_nxt -% seq;
+        if (behind >= data.len) return; // duplicate
+        data = data[behind..];
+        seq = c.rcv_nxt;
     }
 
-    // Process incoming data
-    if (data.len > 0) {
-        if (seq == c.rcv_nxt) {
-            // In-order data — buffer it
-            const space = RX_BUF_SIZE - c.rx_count;
-            const to_buf: u16 = @intCast(@min(data.len, space));
-            var i: u16 = 0;
-            while (i < to_buf) : (i += 1) {
-                c.rx_buf[c.rx_head] = data[i];
-                c.rx_head = (c.rx_head + 1) % RX_BUF_SIZE;
-            }
-            c.rx_count += to_buf;
-            c.rcv_nxt +%= @as(u32, to_buf);
-
-            if (to_buf < data.len) {
-                klog.debug("tcp: partial buf ");
-                klog.debugDec(to_buf);
-                klog.debug("/");
-                klog.debugDec(@as(u16, @intCast(data.len)));
-                klog.debug(" rx_count=");
-                klog.debugDec(c.rx_count);
-                klog.debug("\n");
+    const off = seq -% c.rcv_nxt;
+    const space = c.rx_cap - c.rx_count;
+    if (off >= space) return;
+    const n: u32 = @intCast(@min(data.len, space - off));
+    ringWrite(c.rx_buf, c.rx_cap, c.rx_head +% off, data[0..n]);
+
+    if (n < data.len) {
+        klog.debug("tcp: partial buf ");
+        klog.debugDec(n);
+        klog.debug("/");
+        klog.debugDec(data.len);
+        klog.debug(" rx_count=");
+        klog.debugDec(c.rx_count);
+        klog.debug("\n");
+    }
+
+    if (off == 0) {
+        advanceRcv(c, n);
+        // Wake read waiters
+        wakeAllWaiters(&c.read_waiters, false);
+    } else {
+        klog.debug("tcp: OOO seq=");
+        klog.debugHex(seq);
+        klog.debug(" exp=");
+        klog.debugHex(c.rcv_nxt);
+        klog.debug("\n");
+        addRange(&c.ooo, &c.ooo_count, .{ .start = seq, .end = seq +% n });
+    }
+    tuneRx(c, opts);
+}
+
+/// Receive buffer autotuning: when the peer delivers more than half the
+/// buffer within one round trip, the window is what limits it, so the
+/// buffer doubles.
+fn tuneRx(c: *Connection, opts: *const Options) void {
+    const now = timer.getTicks();
+    if (c.ts_ok and opts.has_ts and opts.ts_ecr != 0) {
+        const sample = @max(now -% opts.ts_ecr, 1);
+        c.rcv_rtt = if (c.rcv_rtt == 0) sample << 3 else c.rcv_rtt - (c.rcv_rtt >> 3) + sample;
+    }
+    const rtt8 = if (c.rcv_rtt != 0) c.rcv_rtt else if (c.srtt != 0) c.srtt else INITIAL_RTO << 3;
+    if (now -% c.rcv_mark < @max(rtt8 >> 3, 1)) return;
+    if (c.rcv_bytes > c.rx_cap / 2) growRx(c);
+    c.rcv_bytes = 0;
+    c.rcv_mark = now;
+}
+
+fn processAck(c: *Connection, ack: u32, window: u16, data_len: usize, opts: *const Options) void {
+    if (seqDiff(ack, c.snd_nxt) > 0) return; // acks data we never sent
+    const wnd = @as(u32, window) << @intCast(c.snd_wscale);
+    const seg = segSize(c);
+    if (c.sack_ok) updateScoreboard(c, opts);
+
+    if (seqDiff(ack, c.snd_una) <= 0) {
+        if (ack != c.snd_una) return; // stale
+        // Duplicate ACK (RFC 5681 §2): no progress, no data, same window,
+        // something outstanding.
+        if (data_len == 0 and wnd == c.snd_wnd and c.snd_nxt != c.snd_una) {
+            c.dupacks +|= 1;
+            if (c.in_recovery) {
+                c.cwnd += seg;
+                if (c.sack_ok) retransmitHole(c);
+            } else if (c.dupacks == DUPACK_THRESHOLD and dataSent(c) > 0) {
+                klog.debug("tcp: fast retransmit\n");
+                enterRecovery(c, false);
             }
+        }
+        c.snd_wnd = wnd; // may be a window update
+        trySend(c);
+        return;
+    }
 
-            // Wake read waiters
-            wakeAllWaiters(&c.read_waiters, false);
+    const now = timer.getTicks();
+    var acked = ack -% c.snd_una;
+    if (c.fin_sent and ack == c.snd_nxt) acked -= 1; // the FIN takes no buffer space
+    acked = @min(acked, c.tx_len);
+    if (c.tx_cap != 0) c.tx_head = (c.tx_head + acked) & (c.tx_cap - 1);
+    c.tx_len -= acked;
+    c.snd_una = ack;
+    c.snd_wnd = wnd;
+    c.dupacks = 0;
+    pruneScoreboard(c);
+    if (seqDiff(c.rtx_nxt, ack) < 0) c.rtx_nxt = ack;
+
+    // Timestamps give a sample for every ACK, retransmitted or not;
+    // otherwise time one segment at a time (Karn).
+    if (c.ts_ok and opts.has_ts and opts.ts_ecr != 0) {
+        rttSample(c, now -% opts.ts_ecr);
+    } else if (c.rtt_timing and seqDiff(ack, c.rtt_seq) >= 0) {
+        rttSample(c, now -% c.rtt_tick);
+    }
+    if (c.rtt_timing and seqDiff(ack, c.rtt_seq) >= 0) c.rtt_timing = false;
+
+    if (c.in_recovery) {
+        if (seqDiff(ack, c.recover) >= 0) {
+            c.in_recovery = false;
+            c.cwnd = @max(@min(c.cwnd, c.ssthresh), seg);
         } else {
-            klog.debug("tcp: OOO seq=");
-            klog.debugHex(seq);
-            klog.debug(" exp=");
-            klog.debugHex(c.rcv_nxt);
-            klog.debug("\n");
+            // Partial ACK (RFC 6582): the next hole is lost too
+            retransmitHole(c);
         }
-        // Send ACK (even for out-of-order to trigger fast retransmit on remote)
-        sendAck(c);
-    } else if (flags & FIN == 0) {
-        // ACK-only (no data, no FIN) — print for debug
-        klog.debug("tcp: ack-only\n");
+    } else if (c.cwnd < c.ssthresh) {
+        c.cwnd += @min(acked, seg); // slow start
+    } else {
+        c.cwnd += @max(seg * seg / c.cwnd, 1); // congestion avoidance
     }
+    c.cwnd = @min(c.cwnd, MAX_BUF_SIZE);
 
-    // Process FIN
-    if (flags & FIN != 0) {
-        // Only advance rcv_nxt if this FIN's seq matches what we expect
-        if (seq == c.rcv_nxt or (data.len > 0 and seq +% @as(u32, @intCast(data.len)) == c.rcv_nxt)) {
-            c.rcv_nxt +%= 1; // FIN consumes one sequence number
-        }
-        sendAck(c);
-        c.state = .close_wait;
-        // Wake reader with EOF
-        wakeAllWaiters(&c.read_waiters, false);
-        klog.debug("tcp: remote closed (FIN)\n");
+    // Reset retransmit on progress
+    c.retransmit_count = 0;
+    c.retransmit_tick = now;
+    trySend(c);
+}
+
+/// Loss detected: halve the window (RFC 5681 eq. 4) and retransmit from
+/// snd_una. On a timeout the window collapses to one segment and the
+/// SACK scoreboard is dropped, since the receiver may have reneged.
+fn enterRecovery(c: *Connection, timeout: bool) void {
+    const seg = segSize(c);
+    c.ssthresh = @max((c.snd_nxt -% c.snd_una) / 2, 2 * seg);
+    c.cwnd = if (timeout) seg else c.ssthresh + DUPACK_THRESHOLD * seg;
+    c.in_recovery = true;
+    c.recover = c.snd_nxt;
+    c.rtx_nxt = c.snd_una;
+    c.rtt_timing = false;
+    if (timeout) {
+        c.sacked_count = 0;
+        c.dupacks = 0;
     }
+    retransmitHole(c);
 }
 
-fn processAck(c: *Connection, ack: u32, window: u16) void {
-    c.snd_wnd = window;
-    // Check if ACK advances snd_una
-    if (seqDiff(ack, c.snd_una) > 0 and seqDiff(ack, c.snd_nxt) <= 0) {
-        const acked = ack -% c.snd_una;
-        c.snd_una = ack;
-        // Remove acked data from tx buffer
-        if (acked <= c.tx_len) {
-            const remaining = c.tx_len - @as(u16, @intCast(acked));
-            if (remaining > 0) {
-                // Shift remaining data to front
-                var i: u16 = 0;
-                while (i < remaining) : (i += 1) {
-                    c.tx_buf[i] = c.tx_buf[@as(u16, @intCast(acked)) + i];
-                }
+/// Retransmit the first sent, unacknowledged, un-SACKed segment at or
+/// after rtx_nxt.
+fn retransmitHole(c: *Connection) void {
+    const end = c.snd_una +% dataSent(c);
+    var seq = if (seqDiff(c.rtx_nxt, c.snd_una) > 0) c.rtx_nxt else c.snd_una;
+    var moved = true;
+    while (moved) {
+        moved = false;
+        for (c.sacked[0..c.sacked_count]) |r| {
+            if (seqDiff(r.start, seq) <= 0 and seqDiff(r.end, seq) > 0) {
+                seq = r.end;
+                moved = true;
             }
-            c.tx_len = remaining;
-        } else {
-            c.tx_len = 0;
         }
-        // Reset retransmit on progress
-        c.retransmit_count = 0;
-        c.rto = INITIAL_RTO;
-        c.retransmit_tick = timer.getTicks();
+    }
+    if (seqDiff(seq, end) >= 0) return;
+
+    var limit = end;
+    for (c.sacked[0..c.sacked_count]) |r| {
+        if (seqDiff(r.start, seq) > 0 and seqDiff(r.start, limit) < 0) limit = r.start;
+    }
+    const len = @min(limit -% seq, segSize(c));
+    sendSegment(c, seq, len);
+    c.rtx_nxt = seq +% len;
+}
+
+/// Send as much unsent data as the peer's window and cwnd allow, then a
+/// queued FIN once everything before it is out.
+fn trySend(c: *Connection) void {
+    const seg = segSize(c);
+    while (true) {
+        const sent = dataSent(c);
+        if (sent >= c.tx_len) break;
+        const flight = c.snd_nxt -% c.snd_una;
+        const wnd = @min(c.snd_wnd, c.cwnd);
+        if (flight >= wnd) break;
+        const unsent = c.tx_len - sent;
+        const len = @min(unsent, seg, wnd - flight);
+        // Sender-side silly window avoidance (RFC 1122 §4.2.3.4)
+        if (len < seg and len < unsent and flight > 0) break;
+
+        const now = timer.getTicks();
+        if (flight == 0) startTimer(c, now);
+        if (!c.rtt_timing) {
+            c.rtt_timing = true;
+            c.rtt_seq = c.snd_nxt +% len;
+            c.rtt_tick = now;
+        }
+        sendSegment(c, c.snd_nxt, len);
+        c.snd_nxt +%= len;
+    }
+
+    if (c.fin_queued and !c.fin_sent and dataSent(c) == c.tx_len) {
+        if (c.snd_nxt == c.snd_una) {
+            startTimer(c, timer.getTicks());
+            c.retransmit_count = 0;
+        }
+        sendFlags(c, FIN | ACK, c.snd_nxt);
+        c.snd_nxt +%= 1; // FIN consumes a sequence number
+        c.fin_sent = true;
     }
 }
 
 /// Handle SYN on a listener. Caller holds listener.lock.
 /// Lock order: listener.lock already held → alloc_lock (for allocLocked + hashInsert).
-fn handleListenSegment(listener: *Connection, listener_idx: u8, seq: u32, flags: u8, ip_hdr: ipv4.Header, src_port: u16) void {
+fn handleListenSegment(listener: *Connection, listener_idx: u8, seq: u32, flags: u8, ip_hdr: ipv4.Header, src_port: u16, opts: *const Options) void {
     if (flags & SYN == 0) return; // Only SYN expected on listener
     if (flags & ACK != 0) return; // SYN must not have ACK
     if (flags & RST != 0) return;
@@ -807,7 +1128,13 @@ fn handleListenSegment(listener: *Connection, listener_idx: u8, seq: u32, flags:
         klog.debug("tcp: listen: no free connections\n");
         return;
     };
-    const child = &connections[child_idx];
+    const child = connections[child_idx].?;
+    if (!allocBuffers(child)) {
+        child.in_use = false;
+        alloc_lock.unlock();
+        klog.debug("tcp: listen: no memory for buffers\n");
+        return;
+    }
     child.local_port = listener.local_port;
     child.local_ip = listener.local_ip;
     child.remote_ip = ip_hdr.src;
@@ -818,6 +1145,11 @@ fn handleListenSegment(listener: *Connection, listener_idx: u8, seq: u32, flags:
     child.state = .syn_received;
     child.parent_idx = listener_idx;
     child.retransmit_tick = timer.getTicks();
+    // Agree to whatever the SYN offered
+    child.ws_ok = true;
+    child.sack_ok = true;
+    child.ts_ok = true;
+    applySynOptions(child, opts);
     // Insert child into hash table
     hashInsert(child_idx);
     alloc_lock.unlock();
@@ -835,6 +1167,59 @@ fn handleListenSegment(listener: *Connection, listener_idx: u8, seq: u32, flags:
     klog.debug(")\n");
 }
 
+// ── Buffers ─────────────────────────────────────────────────────────
+
+fn allocBuffers(c: *Connection) bool {
+    if (c.rx_cap == 0) {
+        c.rx_buf = heap.alloc(MIN_BUF_SIZE) orelse return false;
+        c.rx_cap = MIN_BUF_SIZE;
+    }
+    if (c.tx_cap == 0) {
+        c.tx_buf = heap.alloc(MIN_BUF_SIZE) orelse {
+            freeBuffers(c);
+            return false;
+        };
+        c.tx_cap = MIN_BUF_SIZE;
+    }
+    return true;
+}
+
+fn freeBuffers(c: *Connection) void {
+    if (c.rx_cap != 0) heap.free(c.rx_buf, c.rx_cap);
+    if (c.tx_cap != 0) heap.free(c.tx_buf, c.tx_cap);
+    c.rx_cap = 0;
+    c.tx_cap = 0;
+}
+
+/// Double the receive ring. The copy starts at the read position and
+/// covers the whole old ring, so out-of-order data keeps its offset.
+fn growRx(c: *Connection) void {
+    // Without window scaling the peer can't use more than 64 KB.
+    const limit: u32 = if (c.rcv_wscale != 0) MAX_BUF_SIZE else 65536;
+    const new_cap = c.rx_cap * 2;
+    if (c.rx_cap == 0 or new_cap > limit) return;
+    const buf = heap.alloc(new_cap) orelse return;
+    ringRead(c.rx_buf, c.rx_cap, c.rx_head -% c.rx_count, buf[0..c.rx_cap]);
+    heap.free(c.rx_buf, c.rx_cap);
+    c.rx_buf = buf;
+    c.rx_head = c.rx_count;
+    c.rx_cap = new_cap;
+}
+
+/// Double the send ring while it is smaller than twice what the network
+/// can hold in flight (min of cwnd and the peer's window).
+fn growTx(c: *Connection) void {
+    const new_cap = c.tx_cap * 2;
+    if (c.tx_cap == 0 or new_cap > MAX_BUF_SIZE) return;
+    if (c.tx_cap >= 2 * @min(c.cwnd, c.snd_wnd)) return;
+    const buf = heap.alloc(new_cap) orelse return;
+    ringRead(c.tx_buf, c.tx_cap, c.tx_head, buf[0..c.tx_len]);
+    heap.free(c.tx_buf, c.tx_cap);
+    c.tx_buf = buf;
+    c.tx_head = 0;
+    c.tx_cap = new_cap;
+}
+
 // ── Segment building ────────────────────────────────────────────────
 
 fn sendSyn(c: *Connection) void {
@@ -845,62 +1230,108 @@ fn sendAck(c: *Connection) void {
     sendFlags(c, ACK, c.snd_nxt);
 }
 
-fn sendFin(c: *Connection) void {
-    sendFlags(c, FIN | ACK, c.snd_nxt);
-    c.snd_nxt = c.snd_nxt +% 1; // FIN consumes a sequence number
-    c.retransmit_tick = timer.getTicks();
-    c.retransmit_count = 0;
-}
-
 fn sendRst(c: *Connection) void {
     sendFlags(c, RST | ACK, c.snd_nxt);
 }
 
 fn sendFlags(c: *Connection, flags: u8, seq: u32) void {
-    var tcp_buf: [HEADER_SIZE]u8 = undefined;
-    const window = RX_BUF_SIZE - c.rx_count;
-    buildHeader(&tcp_buf, c.local_port, c.remote_port, seq, c.rcv_nxt, flags, window, 0);
+    var tcp_buf: [MAX_HEADER_SIZE]u8 = undefined;
+    const hdr_len = writeOptions(c, &tcp_buf, flags, true);
+    buildHeader(&tcp_buf, hdr_len, c.local_port, c.remote_port, seq, c.rcv_nxt, flags, rcvWindow(c, flags & SYN != 0), 0);
 
     // Compute checksum
-    const cksum = tcpChecksum(c.local_ip, c.remote_ip, &tcp_buf);
+    const cksum = tcpChecksum(c.local_ip, c.remote_ip, tcp_buf[0..hdr_len]);
     writeBe16(&tcp_buf, 16, cksum);
 
-    sendTcpPacket(c.remote_ip, &tcp_buf);
+    sendTcpPacket(c.remote_ip, tcp_buf[0..hdr_len]);
 }
 
-fn sendDataSegment(c: *Connection) void {
-    if (c.tx_len == 0) return;
-
-    const send_len: u16 = @intCast(@min(c.tx_len, c.mss));
-    var tcp_buf: [HEADER_SIZE + TX_BUF_SIZE]u8 = undefined;
-    const total_len = HEADER_SIZE + send_len;
-
-    const window = RX_BUF_SIZE - c.rx_count;
-    buildHeader(tcp_buf[0..HEADER_SIZE], c.local_port, c.remote_port, c.snd_una, c.rcv_nxt, ACK | PSH, window, 0);
+/// Send `len` bytes of the transmit ring starting at sequence `seq`.
+fn sendSegment(c: *Connection, seq: u32, len: u32) void {
+    var tcp_buf: [MAX_HEADER_SIZE + DEFAULT_MSS]u8 = undefined;
+    const hdr_len = writeOptions(c, &tcp_buf, ACK, false);
+    const off = seq -% c.snd_una;
+    const flags: u8 = if (off + len == c.tx_len) ACK | PSH else ACK;
+    buildHeader(&tcp_buf, hdr_len, c.local_port, c.remote_port, seq, c.rcv_nxt, flags, rcvWindow(c, false), 0);
 
     // Copy data
-    @memcpy(tcp_buf[HEADER_SIZE..][0..send_len], c.tx_buf[0..send_len]);
+    ringRead(c.tx_buf, c.tx_cap, c.tx_head +% off, tcp_buf[hdr_len..][0..len]);
 
     // Compute checksum over header + data
+    const total_len = hdr_len + len;
     const cksum = tcpChecksum(c.local_ip, c.remote_ip, tcp_buf[0..total_len]);
     writeBe16(&tcp_buf, 16, cksum);
 
-    c.snd_nxt = c.snd_una +% @as(u32, send_len);
-    c.retransmit_tick = timer.getTicks();
-
     sendTcpPacket(c.remote_ip, tcp_buf[0..total_len]);
 }
 
+/// Write the options for an outgoing segment after the fixed header:
+/// the negotiable set on SYNs, timestamps once agreed, and SACK blocks
+/// on pure ACKs. Returns the header length.
+fn writeOptions(c: *const Connection, buf: []u8, flags: u8, with_sack: bool) usize {
+    if (flags & RST != 0) return HEADER_SIZE;
+    var n: usize = HEADER_SIZE;
+    const syn = flags & SYN != 0;
+    if (syn) {
+        buf[n] = OPT_MSS;
+        buf[n + 1] = 4;
+        writeBe16(buf, n + 2, DEFAULT_MSS);
+        n += 4;
+        if (c.ws_ok) {
+            buf[n] = OPT_NOP;
+            buf[n + 1] = OPT_WSCALE;
+            buf[n + 2] = 3;
+            buf[n + 3] = WINDOW_SHIFT;
+            n += 4;
+        }
+        if (c.sack_ok and !c.ts_ok) {
+            buf[n] = OPT_NOP;
+            buf[n + 1] = OPT_NOP;
+            buf[n + 2] = OPT_SACK_PERM;
+            buf[n + 3] = 2;
+            n += 4;
+        }
+    }
+    if (c.ts_ok) {
+        if (syn and c.sack_ok) {
+            buf[n] = OPT_SACK_PERM;
+            buf[n + 1] = 2;
+        } else {
+            buf[n] = OPT_NOP;
+            buf[n + 1] = OPT_NOP;
+        }
+        buf[n + 2] = OPT_TIMESTAMP;
+        buf[n + 3] = 10;
+        writeBe32(buf, n + 4, timer.getTicks());
+        writeBe32(buf, n + 8, if (flags & ACK != 0) c.ts_recent else 0);
+        n += 12;
+    }
+    if (with_sack and !syn and c.sack_ok and c.ooo_count > 0) {
+        const count: u8 = @min(c.ooo_count, if (c.ts_ok) @as(u8, 3) else MAX_SACK_BLOCKS);
+        buf[n] = OPT_NOP;
+        buf[n + 1] = OPT_NOP;
+        buf[n + 2] = OPT_SACK;
+        buf[n + 3] = 2 + 8 * count;
+        n += 4;
+        for (c.ooo[0..count]) |r| {
+            writeBe32(buf, n, r.start);
+            writeBe32(buf, n + 4, r.end);
+            n += 8;
+        }
+    }
+    return n;
+}
+
 fn sendRstReply(dst_ip: [4]u8, dst_port: u16, src_port: u16, seq: u32, ack: u32, in_flags: u8, data_len: u16) void {
     var tcp_buf: [HEADER_SIZE]u8 = undefined;
 
     if (in_flags & ACK != 0) {
         // Use their ACK as our SEQ, no ACK from us
-        buildHeader(&tcp_buf, src_port, dst_port, ack, 0, RST, 0, 0);
+        buildHeader(&tcp_buf, HEADER_SIZE, src_port, dst_port, ack, 0, RST, 0, 0);
     } else {
         // ACK their data
         const response_ack = seq +% @as(u32, data_len) +% if (in_flags & SYN != 0) @as(u32, 1) else @as(u32, 0);
-        buildHeader(&tcp_buf, src_port, dst_port, 0, response_ack, RST | ACK, 0, 0);
+        buildHeader(&tcp_buf, HEADER_SIZE, src_port, dst_port, 0, response_ack, RST | ACK, 0, 0);
     }
 
     const our_ip = net.getIp();
@@ -910,12 +1341,13 @@ fn sendRstReply(dst_ip: [4]u8, dst_port: u16, src_port: u16, seq: u32, ack: u32,
     sendTcpPacket(dst_ip, &tcp_buf);
 }
 
-fn buildHeader(buf: *[HEADER_SIZE]u8, src_port: u16, dst_port: u16, seq: u32, ack: u32, flags: u8, window: u16, urgent: u16) void {
+/// Fill in the fixed header; options (if any) are already at buf[20..hdr_len].
+fn buildHeader(buf: []u8, hdr_len: usize, src_port: u16, dst_port: u16, seq: u32, ack: u32, flags: u8, window: u16, urgent: u16) void {
     writeBe16(buf, 0, src_port);
     writeBe16(buf, 2, dst_port);
     writeBe32(buf, 4, seq);
     writeBe32(buf, 8, ack);
-    buf[12] = 0x50; // data offset = 5 (20 bytes), no options
+    buf[12] = @as(u8, @intCast(hdr_len / 4)) << 4; // data offset in 32-bit words
     buf[13] = flags;
     writeBe16(buf, 14, window);
     writeBe16(buf, 16, 0); // checksum placeholder
@@ -975,33 +1407,205 @@ fn freeConn(c: *Connection, idx: u8) void {
     c.in_use = false;
     c.state = .closed;
     alloc_lock.unlock();
+    stopTimer(idx);
 
-    // Reset remaining fields (safe — no one else can see this slot now)
-    c.hash_next = HASH_EMPTY;
-    c.local_port = 0;
-    c.remote_port = 0;
-    c.local_ip = .{ 0, 0, 0, 0 };
-    c.remote_ip = .{ 0, 0, 0, 0 };
-    c.snd_una = 0;
-    c.snd_nxt = 0;
-    c.rcv_nxt = 0;
-    c.snd_wnd = DEFAULT_WINDOW;
-    c.mss = DEFAULT_MSS;
-    c.rx_head = 0;
-    c.rx_count = 0;
-    c.tx_len = 0;
-    c.retransmit_tick = 0;
-    c.retransmit_count = 0;
-    c.rto = INITIAL_RTO;
-    c.read_waiters = no_waiters;
-    c.connect_waiters = no_waiters;
-    c.listen_waiters = no_waiters;
-    c.parent_idx = 0xFF;
+    // Release buffers and reset remaining fields (safe — no one else can
+    // see this slot now)
+    freeBuffers(c);
+    clearConn(c);
 
     // Release conn.lock last
     c.lock.unlock();
 }
 
+// ── Option, window and ring helpers ─────────────────────────────────
+
+/// Settle the options offered in our SYN (ws_ok/sack_ok/ts_ok set) against
+/// what the peer's SYN or SYN-ACK carried.
+fn applySynOptions(c: *Connection, opts: *const Options) void {
+    c.mss = if (opts.mss != 0) @max(@min(opts.mss, DEFAULT_MSS), MIN_MSS) else FALLBACK_MSS;
+    c.ws_ok = c.ws_ok and opts.wscale != null;
+    c.snd_wscale = if (c.ws_ok) opts.wscale.? else 0;
+    c.rcv_wscale = if (c.ws_ok) WINDOW_SHIFT else 0;
+    c.sack_ok = c.sack_ok and opts.sack_permitted;
+    c.ts_ok = c.ts_ok and opts.has_ts;
+    if (c.ts_ok) c.ts_recent = opts.ts_val;
+    c.cwnd = INITIAL_CWND_SEGS * segSize(c);
+}
+
+/// Payload bytes per segment: the MSS less the options every segment carries.
+fn segSize(c: *const Connection) u32 {
+    return @as(u32, c.mss) - if (c.ts_ok) @as(u32, 12) else 0;
+}
+
+/// Bytes of the transmit ring already sent (snd_nxt less a sent FIN).
+fn dataSent(c: *const Connection) u32 {
+    return (c.snd_nxt -% c.snd_una) - @intFromBool(c.fin_sent);
+}
+
+/// Window to advertise: free receive space, scaled except on SYNs.
+fn rcvWindow(c: *const Connection, syn: bool) u16 {
+    const free = c.rx_cap - c.rx_count;
+    const shift: u5 = if (syn) 0 else @intCast(c.rcv_wscale);
+    return @intCast(@min(free >> shift, 0xFFFF));
+}
+
+/// In-order data arrived: advance rcv_nxt by `n`, then over any
+/// out-of-order ranges that are now contiguous.
+fn advanceRcv(c: *Connection, n: u32) void {
+    var extra = n;
+    while (true) {
+        c.rcv_nxt +%= extra;
+        c.rx_count += extra;
+        c.rx_head = (c.rx_head + extra) & (c.rx_cap - 1);
+        c.rcv_bytes += extra;
+
+        extra = 0;
+        var i: usize = 0;
+        while (i < c.ooo_count) {
+            const r = c.ooo[i];
+            if (seqDiff(r.start, c.rcv_nxt) > 0) {
+                i += 1;
+                continue;
+            }
+            removeRange(&c.ooo, &c.ooo_count, i);
+            if (seqDiff(r.end, c.rcv_nxt) > 0) {
+                extra = r.end -% c.rcv_nxt;
+                break;
+            }
+        }
+        if (extra == 0) return;
+    }
+}
+
+/// Add `new` to a range list, merging overlapping or adjacent ranges. The
+/// result goes first (RFC 2018 wants the latest block first); the oldest
+/// range falls off when the list is full.
+fn addRange(ranges: *[MAX_SACK_BLOCKS]SeqRange, count: *u8, new: SeqRange) void {
+    var r = new;
+    var i: usize = 0;
+    while (i < count.*) {
+        const o = ranges[i];
+        if (seqDiff(o.start, r.end) <= 0 and seqDiff(r.start, o.end) <= 0) {
+            if (seqDiff(o.start, r.start) < 0) r.start = o.start;
+            if (seqDiff(o.end, r.end) > 0) r.end = o.end;
+            removeRange(ranges, count, i);
+        } else {
+            i += 1;
+        }
+    }
+    const keep: u8 = @min(count.*, MAX_SACK_BLOCKS - 1);
+    var j: usize = keep;
+    while (j > 0) : (j -= 1) ranges[j] = ranges[j - 1];
+    ranges[0] = r;
+    count.* = keep + 1;
+}
+
+fn removeRange(ranges: *[MAX_SACK_BLOCKS]SeqRange, count: *u8, i: usize) void {
+    var j = i;
+    while (j + 1 < count.*) : (j += 1) ranges[j] = ranges[j + 1];
+    count.* -= 1;
+}
+
+/// Record the SACK blocks of an incoming ACK that cover data in flight.
+fn updateScoreboard(c: *Connection, opts: *const Options) void {
+    for (opts.sack[0..opts.sack_count]) |r| {
+        if (seqDiff(r.end, r.start) <= 0) continue;
+        if (seqDiff(r.start, c.snd_una) < 0 or seqDiff(r.end, c.snd_nxt) > 0) continue;
+        addRange(&c.sacked, &c.sacked_count, r);
+    }
+}
+
+/// Drop scoreboard ranges the cumulative ACK has passed.
+fn pruneScoreboard(c: *Connection) void {
+    var i: usize = 0;
+    while (i < c.sacked_count) {
+        if (seqDiff(c.sacked[i].end, c.snd_una) <= 0) {
+            removeRange(&c.sacked, &c.sacked_count, i);
+            continue;
+        }
+        if (seqDiff(c.sacked[i].start, c.snd_una) < 0) c.sacked[i].start = c.snd_una;
+        i += 1;
+    }
+}
+
+/// Fold an RTT sample (ticks) into srtt/rttvar and recompute the RTO
+/// (RFC 6298 §2).
+fn rttSample(c: *Connection, sample: u32) void {
+    const r = @min(sample, MAX_RTO);
+    if (c.srtt == 0) {
+        c.srtt = @max(r << 3, 1);
+        c.rttvar = r << 1;
+    } else {
+        const srtt = c.srtt >> 3;
+        const err = if (r > srtt) r - srtt else srtt - r;
+        c.rttvar = c.rttvar - (c.rttvar >> 2) + err;
+        c.srtt = @max(c.srtt - (c.srtt >> 3) + r, 1);
+    }
+    c.rto = @min(@max((c.srtt >> 3) + @max(c.rttvar, 1), MIN_RTO), MAX_RTO);
+}
+
+/// Copy `dest.len` bytes out of a power-of-two ring starting at `pos`.
+fn ringRead(ring: [*]const u8, cap: u32, pos: u32, dest: []u8) void {
+    if (dest.len == 0) return;
+    const start = pos & (cap - 1);
+    const first = @min(dest.len, cap - start);
+    @memcpy(dest[0..first], ring[start..][0..first]);
+    @memcpy(dest[first..], ring[0 .. dest.len - first]);
+}
+
+/// Copy `src` into a power-of-two ring starting at `pos`.
+fn ringWrite(ring: [*]u8, cap: u32, pos: u32, src: []const u8) void {
+    if (src.len == 0) return;
+    const start = pos & (cap - 1);
+    const first = @min(src.len, cap - start);
+    @memcpy(ring[start..][0..first], src[0..first]);
+    @memcpy(ring[0 .. src.len - first], src[first..]);
+}
+
+/// Parse the options area of a segment (bytes between the fixed header
+/// and the data offset). Malformed options end the scan.
+fn parseOptions(bytes: []const u8) Options {
+    var o: Options = .{};
+    var i: usize = 0;
+    while (i < bytes.len) {
+        const kind = bytes[i];
+        if (kind == OPT_END) break;
+        if (kind == OPT_NOP) {
+            i += 1;
+            continue;
+        }
+        if (i + 1 >= bytes.len) break;
+        const len = bytes[i + 1];
+        if (len < 2 or i + len > bytes.len) break;
+        const body = bytes[i + 2 .. i + len];
+        switch (kind) {
+            OPT_MSS => if (body.len == 2) {
+                o.mss = be16(body[0..2]);
+            },
+            OPT_WSCALE => if (body.len == 1) {
+                o.wscale = @min(body[0], 14); // RFC 7323 §2.3
+            },
+            OPT_SACK_PERM => o.sack_permitted = true,
+            OPT_TIMESTAMP => if (body.len == 8) {
+                o.has_ts = true;
+                o.ts_val = be32(body, 0);
+                o.ts_ecr = be32(body, 4);
+            },
+            OPT_SACK => {
+                var j: usize = 0;
+                while (j + 8 <= body.len and o.sack_count < MAX_SACK_BLOCKS) : (j += 8) {
+                    o.sack[o.sack_count] = .{ .start = be32(body, j), .end = be32(body, j + 4) };
+                    o.sack_count += 1;
+                }
+            },
+            else => {},
+        }
+        i += len;
+    }
+    return o;
+}
+
 // ── Waiter helpers ──────────────────────────────────────────────────
 
 /// Add a PID to a waiter array. Overwrites oldest slot if full.
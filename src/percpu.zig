@@ -5,14 +5,26 @@
 ///      from entry.S via %gs:offset (x86_64) or TP-relative (riscv64).
 ///   2. PerCpu — Zig-level per-core state (run queue, core ID, etc.)
 ///
+/// Run queues are lock-free: a Chase-Lev deque per priority level that only
+/// the owning core pushes to and pops from, an inbox stack for wakeups from
+/// other cores, and stealing from the deque tops (see process.scheduleNext).
+///
 /// GS_BASE (after swapgs in SYSCALL entry) points to asm_states[core_id].
 /// Zig code uses percpu.get() for PerCpu and percpu.getAsm() for AsmState.
+const std = @import("std");
 const builtin = @import("builtin");
-const SpinLock = @import("spinlock.zig").SpinLock;
 const klog = @import("klog.zig");
+const heap = @import("heap.zig");
 
 pub const MAX_CORES = 128;
+/// Initial capacity of each run-queue level; rings double on demand.
 pub const RUN_QUEUE_SIZE = 64;
+pub const RUN_QUEUE_MAX = 4096;
+/// Process table indices the run queues can hold (>= process.MAX_PROCESSES).
+pub const MAX_TASKS = 128;
+pub const PAGE_CACHE_SIZE = 64;
+/// PerCpu.handoff value meaning "no direct handoff pending".
+pub const NO_HANDOFF: u16 = 0xFFFF;
 
 // ── Assembly-accessible state (extern struct = guaranteed C layout) ────
 
@@ -29,6 +41,8 @@ pub const AsmState = extern struct {
     saved_user_rflags: u64 = 0, // gs:24
     /// Saved kernel RSP after building GPR frame (for resume_from_kernel_frame).
     saved_kernel_rsp: u64 = 0, // gs:32
+    /// This entry's index, so getCoreId() is one %gs load, not an rdmsr.
+    core_id: u64 = 0, // gs:40
 };
 
 // Offsets for use in entry.S (verified by comptime assertions below).
@@ -37,6 +51,7 @@ pub const ASM_SAVED_USER_RSP = 8;
 pub const ASM_SAVED_USER_RIP = 16;
 pub const ASM_SAVED_USER_RFLAGS = 24;
 pub const ASM_SAVED_KERNEL_RSP = 32;
+pub const ASM_CORE_ID = 40;
 
 comptime {
     if (@offsetOf(AsmState, "kernel_stack_top") != ASM_KERNEL_STACK_TOP) @compileError("AsmState offset mismatch: kernel_stack_top");
@@ -44,91 +59,279 @@ comptime {
     if (@offsetOf(AsmState, "saved_user_rip") != ASM_SAVED_USER_RIP) @compileError("AsmState offset mismatch: saved_user_rip");
     if (@offsetOf(AsmState, "saved_user_rflags") != ASM_SAVED_USER_RFLAGS) @compileError("AsmState offset mismatch: saved_user_rflags");
     if (@offsetOf(AsmState, "saved_kernel_rsp") != ASM_SAVED_KERNEL_RSP) @compileError("AsmState offset mismatch: saved_kernel_rsp");
-    if (@sizeOf(AsmState) != 40) @compileError("AsmState size mismatch");
+    if (@offsetOf(AsmState, "core_id") != ASM_CORE_ID) @compileError("AsmState offset mismatch: core_id");
+    if (@sizeOf(AsmState) != 48) @compileError("AsmState size mismatch");
 }
 
 /// Per-core AsmState array. Index by core_id. GS_BASE points into this.
-pub var asm_states: [MAX_CORES]AsmState = [_]AsmState{.{}} ** MAX_CORES;
+pub var asm_states: [MAX_CORES]AsmState = blk: {
+    var states: [MAX_CORES]AsmState = undefined;
+    for (&states, 0..) |*st, i| st.* = .{ .core_id = i };
+    break :blk states;
+};
 
 // ── Zig-level per-CPU state ───────────────────────────────────────────
 
-/// Circular run queue for per-core scheduling.
-/// Local push/pop are lockless (single producer/consumer = owning core).
-/// Steal operations from other cores acquire the lock.
-pub const RunQueue = struct {
-    entries: [RUN_QUEUE_SIZE]u16 = [_]u16{0} ** RUN_QUEUE_SIZE,
-    head: u32 = 0,
-    tail: u32 = 0,
-    len: u32 = 0,
-    lock: SpinLock = .{},
-
-    pub fn push(self: *RunQueue, pid: u16) bool {
-        if (self.len >= RUN_QUEUE_SIZE) return false;
-        self.entries[self.tail % RUN_QUEUE_SIZE] = pid;
-        self.tail +%= 1;
-        self.len += 1;
+/// Scheduling class. Lower values run first; see RunQueue.pop.
+pub const Priority = enum(u8) {
+    /// IPC servers (anything that has called ipc_recv): fxfs, netd workers.
+    server,
+    /// Default for everything else.
+    interactive,
+    /// Throughput work, set via /proc/N/ctl "pri batch".
+    batch,
+};
+pub const PRIORITY_LEVELS = @typeInfo(Priority).@"enum".fields.len;
+
+/// Lower levels get the next pick once every FAIR_PASSES picks, so a stream
+/// of server work can delay batch jobs but not starve them.
+const FAIR_PASSES = 16;
+
+/// Ring header; the slots follow it in memory.
+const Ring = extern struct {
+    mask: u32,
+    /// Smaller ring this one replaced. Kept, not freed: a thief may still be
+    /// reading from it.
+    retired: ?*Ring,
+
+    fn slots(self: *Ring) [*]u16 {
+        return @ptrFromInt(@intFromPtr(self) + @sizeOf(Ring));
+    }
+};
+
+/// The ring every deque starts with, embedded in the deque itself.
+const InitialRing = extern struct {
+    hdr: Ring = .{ .mask = RUN_QUEUE_SIZE - 1, .retired = null },
+    slots: [RUN_QUEUE_SIZE]u16 = [_]u16{0} ** RUN_QUEUE_SIZE,
+};
+
+/// Chase-Lev work-stealing deque of process table indices, in the
+/// formulation for weak memory models by Lê et al. (PPoPP 2013). The owning
+/// core pushes and pops at the bottom; other cores steal from the top and
+/// race only on the CAS of `top`, so neither side takes a lock.
+/// The ring doubles when full, up to RUN_QUEUE_MAX.
+pub const Deque = struct {
+    top: i64 = 0,
+    bottom: i64 = 0,
+    /// Current ring, or null while still on `initial`.
+    ring: ?*Ring = null,
+    initial: InitialRing = .{},
+
+    fn current(self: *Deque) *Ring {
+        return @atomicLoad(?*Ring, &self.ring, .acquire) orelse &self.initial.hdr;
+    }
+
+    /// Owner only. False if the ring is full and may not (`can_grow`) or
+    /// cannot grow.
+    pub fn push(self: *Deque, idx: u16, can_grow: bool) bool {
+        const b = @atomicLoad(i64, &self.bottom, .monotonic);
+        const t = @atomicLoad(i64, &self.top, .acquire);
+        var r = self.current();
+        if (b - t > r.mask) {
+            if (!can_grow) return false;
+            r = self.grow(r, t, b) orelse return false;
+        }
+        @atomicStore(u16, &r.slots()[@as(u64, @bitCast(b)) & r.mask], idx, .monotonic);
+        @atomicStore(i64, &self.bottom, b + 1, .release);
         return true;
     }
 
-    pub fn pop(self: *RunQueue) ?u16 {
-        if (self.len == 0) return null;
-        const pid = self.entries[self.head % RUN_QUEUE_SIZE];
-        self.head +%= 1;
-        self.len -= 1;
-        return pid;
+    /// Owner only.
+    pub fn pop(self: *Deque) ?u16 {
+        const b = @atomicLoad(i64, &self.bottom, .monotonic) - 1;
+        const r = self.current();
+        // The exchange orders the bottom store before the top load (the
+        // seq_cst fence of the original algorithm).
+        _ = @atomicRmw(i64, &self.bottom, .Xchg, b, .seq_cst);
+        const t = @atomicLoad(i64, &self.top, .seq_cst);
+        if (t > b) {
+            @atomicStore(i64, &self.bottom, b + 1, .monotonic);
+            return null;
+        }
+        const idx = @atomicLoad(u16, &r.slots()[@as(u64, @bitCast(b)) & r.mask], .monotonic);
+        if (t == b) {
+            // Last entry: race the thieves for it.
+            const won = @cmpxchgStrong(i64, &self.top, t, t + 1, .seq_cst, .monotonic) == null;
+            @atomicStore(i64, &self.bottom, b + 1, .monotonic);
+            return if (won) idx else null;
+        }
+        return idx;
     }
 
-    pub fn isEmpty(self: *const RunQueue) bool {
-        return self.len == 0;
+    /// Any core. Null if empty or another core won the race for the entry.
+    pub fn steal(self: *Deque) ?u16 {
+        const t = @atomicLoad(i64, &self.top, .seq_cst);
+        const b = @atomicLoad(i64, &self.bottom, .seq_cst);
+        if (t >= b) return null;
+        const r = self.current();
+        const idx = @atomicLoad(u16, &r.slots()[@as(u64, @bitCast(t)) & r.mask], .monotonic);
+        if (@cmpxchgStrong(i64, &self.top, t, t + 1, .seq_cst, .monotonic) != null) return null;
+        return idx;
     }
 
-    /// Steal half of victim's queue into self. Both queues locked by caller.
-    /// Returns number of entries stolen.
-    pub fn stealHalf(self: *RunQueue, victim: *RunQueue) u32 {
-        victim.lock.lock();
-        defer victim.lock.unlock();
+    /// The entry a steal would take next (racy; a hint only).
+    pub fn peekTop(self: *Deque) ?u16 {
+        const t = @atomicLoad(i64, &self.top, .acquire);
+        const b = @atomicLoad(i64, &self.bottom, .acquire);
+        if (t >= b) return null;
+        const r = self.current();
+        return @atomicLoad(u16, &r.slots()[@as(u64, @bitCast(t)) & r.mask], .monotonic);
+    }
 
-        const to_steal = victim.len / 2;
-        if (to_steal == 0) return 0;
+    pub fn len(self: *const Deque) u32 {
+        const n = @atomicLoad(i64, &self.bottom, .acquire) - @atomicLoad(i64, &self.top, .acquire);
+        return if (n > 0) @intCast(n) else 0;
+    }
 
-        var stolen: u32 = 0;
-        while (stolen < to_steal) : (stolen += 1) {
-            if (victim.len == 0) break;
-            const pid = victim.entries[victim.head % RUN_QUEUE_SIZE];
-            victim.head +%= 1;
-            victim.len -= 1;
+    /// Copy [t, b) into a ring twice the size and publish it.
+    fn grow(self: *Deque, old: *Ring, t: i64, b: i64) ?*Ring {
+        const cap: usize = (@as(usize, old.mask) + 1) * 2;
+        if (cap > RUN_QUEUE_MAX) return null;
+        const buf = heap.alloc(@sizeOf(Ring) + cap * @sizeOf(u16)) orelse return null;
+        const r: *Ring = @ptrCast(@alignCast(buf));
+        r.* = .{ .mask = @intCast(cap - 1), .retired = old };
+        var i = t;
+        while (i < b) : (i += 1) {
+            const pos: u64 = @bitCast(i);
+            r.slots()[pos & r.mask] = old.slots()[pos & old.mask];
+        }
+        @atomicStore(?*Ring, &self.ring, r, .release);
+        return r;
+    }
+};
 
-            if (self.len >= RUN_QUEUE_SIZE) break;
-            self.entries[self.tail % RUN_QUEUE_SIZE] = pid;
-            self.tail +%= 1;
-            self.len += 1;
+/// Wakeups from other cores, and overflow from a full deque. A lock-free
+/// stack of process table indices linked through inbox_next; any core
+/// pushes, any core takes the whole list at once (the owner when it
+/// schedules, a thief when the owner is idle), so there is no ABA.
+pub const Inbox = struct {
+    head: u16 = INBOX_EMPTY,
+    count: u32 = 0,
+
+    /// Any core. A process already in some inbox is left where it is.
+    pub fn push(self: *Inbox, idx: u16) void {
+        if (@cmpxchgStrong(bool, &inbox_queued[idx], false, true, .acq_rel, .monotonic) != null) return;
+        // Count first, so takeAll never subtracts an entry not yet counted.
+        _ = @atomicRmw(u32, &self.count, .Add, 1, .monotonic);
+        var head = @atomicLoad(u16, &self.head, .monotonic);
+        while (true) {
+            inbox_next[idx] = head;
+            head = @cmpxchgWeak(u16, &self.head, head, idx, .release, .monotonic) orelse break;
         }
-        return stolen;
+    }
+
+    /// Any core. Detach the whole list; returns its entries oldest first
+    /// through `out`, and how many there were.
+    pub fn takeAll(self: *Inbox, out: *[MAX_TASKS]u16) usize {
+        var idx = @atomicRmw(u16, &self.head, .Xchg, INBOX_EMPTY, .acquire);
+        var n: usize = 0;
+        while (idx != INBOX_EMPTY) : (n += 1) {
+            out[n] = idx;
+            const next = inbox_next[idx];
+            @atomicStore(bool, &inbox_queued[idx], false, .release);
+            idx = next;
+        }
+        if (n > 0) _ = @atomicRmw(u32, &self.count, .Sub, @intCast(n), .monotonic);
+        std.mem.reverse(u16, out[0..n]);
+        return n;
+    }
+
+    pub fn isEmpty(self: *const Inbox) bool {
+        return @atomicLoad(u16, &self.head, .acquire) == INBOX_EMPTY;
     }
 };
 
+const INBOX_EMPTY: u16 = 0xFFFF;
+/// Inbox links, indexed by process table index. A process is in at most
+/// one inbox (inbox_queued), so one link per process suffices.
+var inbox_next: [MAX_TASKS]u16 = [_]u16{INBOX_EMPTY} ** MAX_TASKS;
+var inbox_queued: [MAX_TASKS]bool = [_]bool{false} ** MAX_TASKS;
+
+/// Per-core run queue: one deque per priority level plus the inbox.
+pub const RunQueue = struct {
+    levels: [PRIORITY_LEVELS]Deque = [_]Deque{.{}} ** PRIORITY_LEVELS,
+    inbox: Inbox = .{},
+    /// Picks since a lower level last went first.
+    passes: u8 = 0,
+
+    /// Owner only. Wakeups can come with locks held, so this never
+    /// allocates: a full ring spills into the inbox, and refill() grows it.
+    pub fn push(self: *RunQueue, pri: Priority, idx: u16) void {
+        if (!self.levels[@intFromEnum(pri)].push(idx, false)) self.inbox.push(idx);
+    }
+
+    /// Owner only, from the scheduler (no locks held): like push(), but may
+    /// grow the ring.
+    pub fn refill(self: *RunQueue, pri: Priority, idx: u16) void {
+        if (!self.levels[@intFromEnum(pri)].push(idx, true)) self.inbox.push(idx);
+    }
+
+    /// Owner only. Highest priority first, except that every FAIR_PASSES
+    /// picks the lowest non-empty level goes first.
+    pub fn pop(self: *RunQueue) ?u16 {
+        self.passes +%= 1;
+        if (self.passes >= FAIR_PASSES) {
+            self.passes = 0;
+            var l: usize = PRIORITY_LEVELS;
+            while (l > 0) {
+                l -= 1;
+                if (self.levels[l].pop()) |idx| return idx;
+            }
+            return null;
+        }
+        for (&self.levels) |*d| {
+            if (d.pop()) |idx| return idx;
+        }
+        return null;
+    }
+
+    pub fn len(self: *const RunQueue) u32 {
+        var n: u32 = @atomicLoad(u32, &self.inbox.count, .monotonic);
+        for (&self.levels) |*d| n += d.len();
+        return n;
+    }
+
+    pub fn isEmpty(self: *const RunQueue) bool {
+        return self.len() == 0;
+    }
+};
+
+/// Per-core magazine of free physical pages (page numbers), owned by pmm.
+/// Only the owning core touches it, so no lock is needed.
+pub const PageCache = struct {
+    pages: [PAGE_CACHE_SIZE]u32 = [_]u32{0} ** PAGE_CACHE_SIZE,
+    count: u32 = 0,
+};
+
 /// Per-CPU kernel state. One instance per core.
 pub const PerCpu = struct {
     /// Logical core ID (0 = BSP).
     core_id: u8 = 0,
+    /// Last-level cache this core sits behind (cores with equal IDs share it).
+    llc_id: u8 = 0,
     /// Currently running process (null = idle).
     /// Stored as ?*anyopaque to avoid circular dependency with process.zig.
     /// Cast to ?*Process via process.getCurrent().
     current: ?*anyopaque = null,
     /// Per-core run queue.
     run_queue: RunQueue = .{},
+    /// Per-core free page cache (see pmm.allocPage).
+    page_cache: PageCache = .{},
+    /// Process table index to run next, ahead of the run queue (IPC
+    /// direct handoff, see process.handoff). NO_HANDOFF = none.
+    handoff: u16 = NO_HANDOFF,
     /// Number of idle ticks on this core.
     idle_ticks: u64 = 0,
     /// Pending IPI bitmap (bit 0 = schedule, bit 1 = TLB shootdown).
     ipi_pending: u8 = 0,
-    /// TLB shootdown: if non-zero, full TLB flush requested.
-    tlb_flush_pending: bool = false,
     /// Set to true once this core is online.
     online: bool = false,
     /// Per-core statistics counters.
     ctx_switches: u64 = 0,
     syscalls: u64 = 0,
     interrupts: u64 = 0,
+    /// IPC wakeups that switched directly to the target, bypassing the run queue.
+    ipc_handoffs: u64 = 0,
 };
 
 /// Array of per-CPU data. Index by core_id.
@@ -143,6 +346,7 @@ pub var cores_online: u8 = 0;
 /// Called once during early boot, before any scheduling.
 pub fn init() void {
     percpu_array[0].core_id = 0;
+    percpu_array[0].llc_id = llcId();
     percpu_array[0].online = true;
     cores_online = 1;
 
@@ -160,18 +364,52 @@ pub fn init() void {
     klog.info("Per-CPU init: BSP (core 0) online.\n");
 }
 
+/// LLC identifier for the calling core: its initial APIC ID with the bits
+/// that distinguish cores sharing the deepest cache (CPUID leaf 4) dropped.
+/// 0 where the leaf is missing, i.e. every core is treated as sharing.
+pub fn llcId() u8 {
+    if (builtin.cpu.arch != .x86_64) return 0;
+    const cpu = @import("arch/x86_64/cpu.zig");
+    if (cpu.cpuid(0, 0).eax < 4) return 0;
+    var sharing: u32 = 0;
+    var level: u32 = 0;
+    var sub: u32 = 0;
+    while (sub < 8) : (sub += 1) {
+        const r = cpu.cpuid(4, sub);
+        if (r.eax & 0x1F == 0) break; // no more caches
+        const l = (r.eax >> 5) & 0x7;
+        if (l >= level) {
+            level = l;
+            sharing = ((r.eax >> 14) & 0xFFF) + 1;
+        }
+    }
+    if (sharing <= 1) return @truncate(cpu.cpuid(1, 0).ebx >> 24);
+    const shift: u5 = @intCast(32 - @clz(sharing - 1)); // ceil(log2(sharing))
+    return @truncate((cpu.cpuid(1, 0).ebx >> 24) >> shift);
+}
+
+/// Bitmap of online cores behind the same LLC as `core` (including it).
+pub fn llcMask(core: u8) u128 {
+    var mask: u128 = 0;
+    var i: u8 = 0;
+    while (i < cores_online) : (i += 1) {
+        if (percpu_array[i].llc_id == percpu_array[core].llc_id) mask |= @as(u128, 1) << @intCast(i);
+    }
+    return mask;
+}
+
 /// Get the current core's ID.
 pub inline fn getCoreId() u8 {
     if (builtin.cpu.arch == .x86_64) {
         // Before percpu.init() sets GS_BASE, we're on BSP (core 0)
         if (cores_online == 0) return 0;
-        // Read GS_BASE MSR (0xC0000101), which points to asm_states[core_id].
-        // Compute index from pointer offset into the asm_states array.
-        const cpu = @import("arch/x86_64/cpu.zig");
-        const gs_base = cpu.rdmsr(0xC0000101);
-        const base = @intFromPtr(&asm_states[0]);
-        const offset = gs_base -% base;
-        return @intCast(offset / @sizeOf(AsmState));
+        // GS_BASE points to asm_states[core_id], which records its index.
+        // A %gs-relative load costs far less than rdmsr of GS_BASE, and
+        // this runs on every lock acquire and percpu.get().
+        const id = asm volatile ("movq %%gs:40, %[id]"
+            : [id] "=r" (-> u64),
+        );
+        return @intCast(id);
     } else {
         // riscv64: single-core for now
         return 0;
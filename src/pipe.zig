@@ -1,67 +1,225 @@
 /// Kernel pipe subsystem — ring-buffer pipes for inter-process communication.
 ///
 /// Pipes are kernel-managed and do not require an IPC server. Each pipe has
-/// a fixed-size buffer and reference-counted read/write ends.
+/// a heap ring buffer and reference-counted read/write ends. The ring starts
+/// at PIPE_BUF_SIZE and doubles, up to PIPE_MAX_SIZE, whenever a write does
+/// not fit, so a fast writer can run ahead of its reader by a full 64 KiB.
 ///
 /// Wake pattern: waker just marks the process as .ready. Actual data delivery
 /// happens in process.switchTo() after the target's address space is loaded,
 /// same as console_read and net_read.
 ///
+/// Wakeups are batched. A blocked reader is woken once WAKE_MARK bytes are
+/// buffered (or its whole request is), a blocked writer once half the ring
+/// (or its whole request) is free. Waiters left asleep mark the pipe
+/// deferred; flushDeferred() wakes them when the current process blocks
+/// (scheduleNext) or, at the latest, FLUSH_DELAY_NS after the wakeup was
+/// deferred, from a one-shot timer.
+///
+/// drainTo()/fillFrom() move data between the ring and another kernel
+/// buffer without a user-space bounce (the splice syscall); peekTo() and
+/// consume() split a drain around a server round trip.
+///
+/// Pipe objects come from a slab cache on alloc() and are returned once both
+/// ends are closed, so only live pipes cost memory; MAX_PIPES only bounds
+/// the id space (pipe ids are u8).
+///
 /// SMP: Per-pipe spinlock guards all buffer/refcount operations. Global alloc
-/// lock guards pipe slot allocation. Lock ordering: alloc_lock → pipe.lock.
+/// lock guards pipe slot allocation and lookup: every operation pins the
+/// pipe under it, and free() leaves a pinned pipe (and its ring) to the
+/// last unpin, so a close racing a transfer or a flush can't free memory
+/// still in use. Lock ordering: alloc_lock → pipe.lock
+/// → TCP connection lock (splice), timer wheel lock (deferWake). Rings are
+/// allocated and freed with the pipe lock dropped.
 const process = @import("process.zig");
+const slab = @import("slab.zig");
+const heap = @import("heap.zig");
 const SpinLock = @import("spinlock.zig").SpinLock;
+const timer = @import("timer.zig");
 
-pub const MAX_PIPES = 32;
+pub const MAX_PIPES = 256;
+/// Initial ring size.
 pub const PIPE_BUF_SIZE = 4096;
+/// Largest a ring grows.
+pub const PIPE_MAX_SIZE = 64 * 1024;
+/// Most bytes one read/write syscall moves through a pipe.
+pub const MAX_TRANSFER = PIPE_MAX_SIZE;
+/// Buffered bytes at which blocked readers are woken right away.
+const WAKE_MARK = 1024;
+
+/// Blocked processes, one bit per process table slot.
+const Waiters = u128;
+
+comptime {
+    if (process.MAX_PROCESSES > @bitSizeOf(Waiters)) @compileError("pipe waiter set too small");
+}
 
 pub const Pipe = struct {
-    buf: [PIPE_BUF_SIZE]u8 = undefined,
+    /// Ring storage, `cap` bytes (a power of two).
+    buf: [*]u8 = undefined,
+    cap: usize = 0,
     read_pos: usize = 0,
-    write_pos: usize = 0,
     count: usize = 0,
     readers: u8 = 0,
     writers: u8 = 0,
-    read_waiters: [4]?u16 = [_]?u16{null} ** 4,
-    write_waiters: [4]?u16 = [_]?u16{null} ** 4,
+    read_waiters: Waiters = 0,
+    write_waiters: Waiters = 0,
     active: bool = false,
+    /// Lookups in flight (pin/unpin), under alloc_lock.
+    pins: u32 = 0,
+    /// Slot already freed; the last unpin releases the pipe.
+    unlinked: bool = false,
     /// Per-pipe spinlock for SMP safety.
     lock: SpinLock = .{},
+
+    fn space(self: *const Pipe) usize {
+        return self.cap - self.count;
+    }
+
+    fn writePos(self: *const Pipe) usize {
+        return (self.read_pos + self.count) & (self.cap - 1);
+    }
+
+    /// Copy up to dest.len buffered bytes out and consume them.
+    fn take(self: *Pipe, dest: []u8) usize {
+        const n = @min(dest.len, self.count);
+        const first = @min(n, self.cap - self.read_pos);
+        @memcpy(dest[0..first], self.buf[self.read_pos..][0..first]);
+        @memcpy(dest[first..n], self.buf[0 .. n - first]);
+        self.read_pos = (self.read_pos + n) & (self.cap - 1);
+        self.count -= n;
+        return n;
+    }
+
+    /// Copy up to src.len bytes in, as many as fit.
+    fn put(self: *Pipe, src: []const u8) usize {
+        const n = @min(src.len, self.space());
+        const pos = self.writePos();
+        const first = @min(n, self.cap - pos);
+        @memcpy(self.buf[pos..][0..first], src[0..first]);
+        @memcpy(self.buf[0 .. n - first], src[first..n]);
+        self.count += n;
+        return n;
+    }
 };
 
-var pipes: [MAX_PIPES]Pipe = [_]Pipe{.{}} ** MAX_PIPES;
+var pipes: [MAX_PIPES]?*Pipe = [_]?*Pipe{null} ** MAX_PIPES;
+var pipe_cache = slab.ObjectCache(Pipe).init("pipe");
 
 /// Global lock for pipe slot allocation.
 var alloc_lock: SpinLock = .{};
 
+/// Pipes with waiters left asleep by a batched wakeup, one bit per id.
+var deferred: [MAX_PIPES / 64]u64 = [_]u64{0} ** (MAX_PIPES / 64);
+/// Longest a deferred wakeup waits for a process to block and flush it.
+const FLUSH_DELAY_NS: u64 = 1_000_000;
+var flush_timer: timer.Timer = .{ .func = &flushTimerFired };
+
 /// Allocate a new pipe. Returns pipe_id or null if full.
 pub fn alloc() ?u8 {
     alloc_lock.lock();
     defer alloc_lock.unlock();
 
-    for (&pipes, 0..) |*p, i| {
-        if (!p.active) {
+    for (&pipes, 0..) |*slot, i| {
+        if (slot.* == null) {
+            const p = pipe_cache.create() orelse return null;
+            const buf = heap.alloc(PIPE_BUF_SIZE) orelse {
+                pipe_cache.destroy(p);
+                return null;
+            };
             p.* = .{};
+            p.buf = buf;
+            p.cap = PIPE_BUF_SIZE;
             p.active = true;
             p.readers = 1;
             p.writers = 1;
+            slot.* = p;
             return @intCast(i);
         }
     }
     return null;
 }
 
-/// Free a pipe slot. Caller must hold pipe lock or ensure exclusive access.
+/// Free a pipe slot and return its memory. Both ends must be closed (so no
+/// fd can still name the id) and the pipe lock must NOT be held. The pipe
+/// and its ring outlive the slot until the last pin is dropped.
 pub fn free(id: u8) void {
-    if (id >= MAX_PIPES) return;
-    pipes[id].active = false;
+    alloc_lock.lock();
+    const p = pipes[id] orelse {
+        alloc_lock.unlock();
+        return;
+    };
+    pipes[id] = null;
+    p.unlinked = true;
+    const idle = p.pins == 0;
+    alloc_lock.unlock();
+    if (idle) destroy(p);
+}
+
+/// Look a pipe up and pin it, so a concurrent free() can't release it or
+/// its ring until the matching unpin().
+fn pin(id: u8) ?*Pipe {
+    alloc_lock.lock();
+    defer alloc_lock.unlock();
+    const p = pipes[id] orelse return null;
+    p.pins += 1;
+    return p;
+}
+
+/// Drop a pin; the last one on a freed pipe releases it. No pipe lock held.
+fn unpin(p: *Pipe) void {
+    alloc_lock.lock();
+    p.pins -= 1;
+    const dead = p.pins == 0 and p.unlinked;
+    alloc_lock.unlock();
+    if (dead) destroy(p);
+}
+
+fn destroy(p: *Pipe) void {
+    heap.free(p.buf, p.cap);
+    pipe_cache.destroy(p);
+}
+
+/// Ring size that fits `n` more bytes, or 0 if the ring is already big
+/// enough or at PIPE_MAX_SIZE. Pipe lock held.
+fn growTarget(p: *const Pipe, n: usize) usize {
+    if (p.space() >= n or p.cap >= PIPE_MAX_SIZE) return 0;
+    var target = p.cap;
+    while (target - p.count < n and target < PIPE_MAX_SIZE) target *= 2;
+    return target;
+}
+
+/// Grow the ring to fit `n` more bytes if it is too small. Called with no
+/// locks held; on allocation failure the ring just stays as it is.
+fn reserve(p: *Pipe, n: usize) void {
+    p.lock.lock();
+    const target = if (p.active) growTarget(p, n) else 0;
+    p.lock.unlock();
+    if (target == 0) return;
+
+    const new_buf = heap.alloc(target) orelse return;
+    var drop = new_buf;
+    var drop_len = target;
+    p.lock.lock();
+    if (p.active and p.cap < target) {
+        const n_buffered = p.count;
+        _ = p.take(new_buf[0..n_buffered]);
+        drop = p.buf;
+        drop_len = p.cap;
+        p.buf = new_buf;
+        p.cap = target;
+        p.read_pos = 0;
+        p.count = n_buffered;
+    }
+    p.lock.unlock();
+    heap.free(drop, drop_len);
 }
 
 /// Read from pipe into dest. Returns bytes read, null if empty and writers
 /// exist (caller should block), or 0 if EOF (no writers left).
 pub fn pipeRead(id: u8, dest: []u8) ?usize {
-    if (id >= MAX_PIPES) return 0;
-    const p = &pipes[id];
+    const p = pin(id) orelse return 0;
+    defer unpin(p);
     p.lock.lock();
     defer p.lock.unlock();
 
@@ -72,23 +230,8 @@ pub fn pipeRead(id: u8, dest: []u8) ?usize {
         return null; // block — no data yet
     }
 
-    const n = @min(dest.len, p.count);
-    for (0..n) |i| {
-        dest[i] = p.buf[p.read_pos];
-        p.read_pos = (p.read_pos + 1) % PIPE_BUF_SIZE;
-    }
-    p.count -= n;
-
-    // Wake all blocked writers — they'll retry in switchTo
-    for (&p.write_waiters) |*slot| {
-        if (slot.*) |wpid| {
-            if (process.getByPid(wpid)) |wproc| {
-                if (wproc.state == .blocked) process.markReady(wproc);
-            }
-            slot.* = null;
-        }
-    }
-
+    const n = p.take(dest);
+    if (wakeWriters(p, false)) deferWake(id);
     return n;
 }
 
@@ -97,8 +240,9 @@ pub fn pipeRead(id: u8, dest: []u8) ?usize {
 pub const EPIPE: usize = 0xFFFFFFFFFFFFFFFF;
 
 pub fn pipeWrite(id: u8, src: []const u8) ?usize {
-    if (id >= MAX_PIPES) return EPIPE;
-    const p = &pipes[id];
+    const p = pin(id) orelse return EPIPE;
+    defer unpin(p);
+    reserve(p, src.len);
     p.lock.lock();
     defer p.lock.unlock();
 
@@ -106,35 +250,121 @@ pub fn pipeWrite(id: u8, src: []const u8) ?usize {
 
     if (p.readers == 0) return EPIPE;
 
-    if (p.count >= PIPE_BUF_SIZE) {
+    if (p.count >= p.cap) {
         return null; // block — pipe full
     }
 
-    const space = PIPE_BUF_SIZE - p.count;
-    const n = @min(src.len, space);
-    for (0..n) |i| {
-        p.buf[p.write_pos] = src[i];
-        p.write_pos = (p.write_pos + 1) % PIPE_BUF_SIZE;
-    }
-    p.count += n;
-
-    // Wake all blocked readers — they'll get data in switchTo
-    for (&p.read_waiters) |*slot| {
-        if (slot.*) |rpid| {
-            if (process.getByPid(rpid)) |rproc| {
-                if (rproc.state == .blocked) process.markReady(rproc);
-            }
-            slot.* = null;
-        }
+    const n = p.put(src);
+    if (wakeReaders(p, false)) deferWake(id);
+    return n;
+}
+
+/// Result of moving data between a pipe and another kernel buffer.
+pub const Transfer = union(enum) {
+    /// Bytes moved (non-zero).
+    moved: usize,
+    /// The pipe is empty (drainTo) or full (fillFrom); wait on the pipe.
+    pipe_wait,
+    /// The other side took or gave nothing; wait on it.
+    peer_wait,
+    /// drainTo: no data and no writers. fillFrom: the source is at EOF.
+    eof,
+    /// fillFrom: no readers left.
+    broken,
+};
+
+/// Hand up to `max` buffered bytes straight from the ring to `sink`, which
+/// returns how many of them it took; only those are consumed. `sink` runs
+/// with the pipe lock held, on at most two contiguous spans.
+pub fn drainTo(id: u8, max: usize, ctx: anytype, comptime sink: fn (@TypeOf(ctx), []const u8) usize) Transfer {
+    return transferOut(id, max, ctx, sink, true);
+}
+
+/// drainTo, but the bytes stay buffered until consume(): for a splice into
+/// a file, where only the server's reply says how many were written. A
+/// second reader of the same pipe can still read them in between.
+pub fn peekTo(id: u8, max: usize, ctx: anytype, comptime sink: fn (@TypeOf(ctx), []const u8) usize) Transfer {
+    return transferOut(id, max, ctx, sink, false);
+}
+
+/// Drop up to `n` bytes from the read end, once a peekTo's copy is used.
+pub fn consume(id: u8, n: usize) void {
+    const p = pin(id) orelse return;
+    defer unpin(p);
+    p.lock.lock();
+    defer p.lock.unlock();
+    if (!p.active or n == 0) return;
+    const dropped = @min(n, p.count);
+    p.read_pos = (p.read_pos + dropped) & (p.cap - 1);
+    p.count -= dropped;
+    if (wakeWriters(p, false)) deferWake(id);
+}
+
+fn transferOut(id: u8, max: usize, ctx: anytype, comptime sink: fn (@TypeOf(ctx), []const u8) usize, comptime take_bytes: bool) Transfer {
+    const p = pin(id) orelse return .eof;
+    defer unpin(p);
+    p.lock.lock();
+    defer p.lock.unlock();
+
+    if (!p.active) return .eof;
+    if (p.count == 0) return if (p.writers == 0) .eof else .pipe_wait;
+
+    const n = @min(max, p.count);
+    const first = @min(n, p.cap - p.read_pos);
+    var moved = sink(ctx, p.buf[p.read_pos..][0..first]);
+    if (moved == first and n > first) moved += sink(ctx, p.buf[0 .. n - first]);
+    if (moved == 0) return .peer_wait;
+
+    if (take_bytes) {
+        p.read_pos = (p.read_pos + moved) & (p.cap - 1);
+        p.count -= moved;
+        if (wakeWriters(p, false)) deferWake(id);
     }
+    return .{ .moved = moved };
+}
 
-    return n;
+/// Let `source` write up to `max` bytes straight into the ring's free
+/// space. `source` returns bytes produced, 0 at EOF or null if it has
+/// nothing yet; it runs with the pipe lock held, on at most two spans.
+pub fn fillFrom(id: u8, max: usize, ctx: anytype, comptime source: fn (@TypeOf(ctx), []u8) ?usize) Transfer {
+    const p = pin(id) orelse return .broken;
+    defer unpin(p);
+    reserve(p, max);
+    p.lock.lock();
+    defer p.lock.unlock();
+
+    if (!p.active or p.readers == 0) return .broken;
+    if (p.count >= p.cap) return .pipe_wait;
+
+    const n = @min(max, p.space());
+    const pos = p.writePos();
+    const first = @min(n, p.cap - pos);
+    var got = source(ctx, p.buf[pos..][0..first]) orelse return .peer_wait;
+    if (got == 0) return .eof;
+    if (got == first and n > first) got += source(ctx, p.buf[0 .. n - first]) orelse 0;
+
+    p.count += got;
+    if (wakeReaders(p, false)) deferWake(id);
+    return .{ .moved = got };
+}
+
+/// Free space in the pipe after growing it for `want` bytes: null if
+/// full, EPIPE if there are no readers.
+pub fn writable(id: u8, want: usize) ?usize {
+    const p = pin(id) orelse return EPIPE;
+    defer unpin(p);
+    reserve(p, want);
+    p.lock.lock();
+    defer p.lock.unlock();
+    if (!p.active or p.readers == 0) return EPIPE;
+    if (p.count >= p.cap) return null;
+    return p.space();
 }
 
 /// Check if pipe has data or is at EOF (for delivery in switchTo).
 pub fn hasDataOrEof(id: u8) bool {
-    if (id >= MAX_PIPES) return true;
-    const p = &pipes[id];
+    const p = pin(id) orelse return true;
+    defer unpin(p);
     p.lock.lock();
     defer p.lock.unlock();
     if (!p.active) return true;
@@ -143,64 +373,143 @@ pub fn hasDataOrEof(id: u8) bool {
 
 /// Check if pipe has space for writing (for delivery in switchTo).
 pub fn hasSpaceOrBroken(id: u8) bool {
-    if (id >= MAX_PIPES) return true;
-    const p = &pipes[id];
+    const p = pin(id) orelse return true;
+    defer unpin(p);
     p.lock.lock();
     defer p.lock.unlock();
     if (!p.active) return true;
-    return p.count < PIPE_BUF_SIZE or p.readers == 0;
+    return p.count < p.cap or p.readers == 0;
 }
 
-/// Close the read end. Decrements readers, wakes blocked writer.
-pub fn closeReadEnd(id: u8) void {
-    if (id >= MAX_PIPES) return;
-    const p = &pipes[id];
-    p.lock.lock();
-    defer p.lock.unlock();
+// ── Waiters ───────────────────────────────────────────────────────────
 
-    if (!p.active) return;
-    if (p.readers > 0) p.readers -= 1;
+fn waitsOnPipe(proc: *const process.Process) bool {
+    return proc.pending_op == .pipe_read or proc.pending_op == .pipe_write or proc.pending_op == .splice;
+}
 
-    // Wake all blocked writers — they'll get EPIPE on retry in switchTo
-    for (&p.write_waiters) |*slot| {
-        if (slot.*) |wpid| {
-            if (process.getByPid(wpid)) |wproc| {
-                if (wproc.state == .blocked) process.markReady(wproc);
-            }
-            slot.* = null;
+/// Wake the members of `set` that are blocked on a pipe and for which
+/// `ready(request)` holds (`request` = bytes the waiter asked for). Ones
+/// still on their way to sleep stay in the set. Returns true if any
+/// waiter was left in it. Pipe lock held.
+fn wakeSet(set: *Waiters, p: *const Pipe, all: bool, comptime ready: fn (*const Pipe, u64) bool) bool {
+    const table = process.getProcessTable();
+    var left = false;
+    var pending = set.*;
+    while (pending != 0) {
+        const i = @ctz(pending);
+        const bit = @as(Waiters, 1) << @intCast(i);
+        pending &= ~bit;
+        const w = &table[i];
+        if (!waitsOnPipe(w)) {
+            set.* &= ~bit; // slot moved on to something else
+        } else if (w.state == .running) {
+            left = true; // registered, not blocked yet
+        } else if (w.state != .blocked) {
+            set.* &= ~bit;
+        } else if (all or ready(p, w.syscall_ret)) {
+            set.* &= ~bit;
+            process.markReady(w);
+        } else {
+            left = true;
         }
     }
+    return left;
+}
 
-    if (p.readers == 0 and p.writers == 0) free(id);
+fn readerReady(p: *const Pipe, request: u64) bool {
+    return p.count > 0 and (p.count >= WAKE_MARK or p.count >= request);
 }
 
-/// Close the write end. Decrements writers, wakes blocked reader (EOF).
-pub fn closeWriteEnd(id: u8) void {
-    if (id >= MAX_PIPES) return;
-    const p = &pipes[id];
-    p.lock.lock();
-    defer p.lock.unlock();
+fn writerReady(p: *const Pipe, request: u64) bool {
+    const free_space = p.space();
+    return free_space > 0 and (free_space >= p.cap / 2 or free_space >= request);
+}
+
+fn wakeReaders(p: *Pipe, all: bool) bool {
+    return wakeSet(&p.read_waiters, p, all, readerReady);
+}
 
-    if (!p.active) return;
-    if (p.writers > 0) p.writers -= 1;
+fn wakeWriters(p: *Pipe, all: bool) bool {
+    return wakeSet(&p.write_waiters, p, all, writerReady);
+}
+
+fn deferWake(id: u8) void {
+    _ = @atomicRmw(u64, &deferred[id / 64], .Or, @as(u64, 1) << @intCast(id % 64), .release);
+    timer.armOnce(&flush_timer, timer.now() + FLUSH_DELAY_NS);
+}
 
-    // Wake all blocked readers — they'll get EOF in switchTo
-    for (&p.read_waiters) |*slot| {
-        if (slot.*) |rpid| {
-            if (process.getByPid(rpid)) |rproc| {
-                if (rproc.state == .blocked) process.markReady(rproc);
-            }
-            slot.* = null;
+fn flushTimerFired(_: *timer.Timer) void {
+    flushDeferred();
+}
+
+/// Wake everyone a batched wakeup left asleep who can make progress now.
+/// Called when a process blocks and from flush_timer; must not be called
+/// with a pipe lock held.
+pub fn flushDeferred() void {
+    for (&deferred, 0..) |*word, w| {
+        if (@atomicLoad(u64, word, .monotonic) == 0) continue;
+        var bits = @atomicRmw(u64, word, .Xchg, 0, .acquire);
+        while (bits != 0) {
+            const b = @ctz(bits);
+            bits &= bits - 1;
+            const p = pin(@intCast(w * 64 + b)) orelse continue;
+            p.lock.lock();
+            if (p.count > 0 or p.writers == 0) _ = wakeReaders(p, true);
+            if (p.space() > 0 or p.readers == 0) _ = wakeWriters(p, true);
+            p.lock.unlock();
+            unpin(p);
         }
     }
+}
 
-    if (p.readers == 0 and p.writers == 0) free(id);
+/// Close the read end. Decrements readers, wakes blocked writer.
+pub fn closeReadEnd(id: u8) void {
+    const p = pin(id) orelse return;
+    defer unpin(p);
+    const last = blk: {
+        p.lock.lock();
+        defer p.lock.unlock();
+
+        if (!p.active) return;
+        if (p.readers > 0) p.readers -= 1;
+
+        // Wake all blocked writers — they'll get EPIPE on retry in switchTo
+        _ = wakeWriters(p, true);
+
+        if (p.readers != 0 or p.writers != 0) break :blk false;
+        p.active = false;
+        break :blk true;
+    };
+    // Release outside the pipe lock — the lock lives in the freed object
+    if (last) free(id);
+}
+
+/// Close the write end. Decrements writers, wakes blocked reader (EOF).
+pub fn closeWriteEnd(id: u8) void {
+    const p = pin(id) orelse return;
+    defer unpin(p);
+    const last = blk: {
+        p.lock.lock();
+        defer p.lock.unlock();
+
+        if (!p.active) return;
+        if (p.writers > 0) p.writers -= 1;
+
+        // Wake all blocked readers — they'll get EOF in switchTo
+        _ = wakeReaders(p, true);
+
+        if (p.readers != 0 or p.writers != 0) break :blk false;
+        p.active = false;
+        break :blk true;
+    };
+    // Release outside the pipe lock — the lock lives in the freed object
+    if (last) free(id);
 }
 
 /// Increment reader count (used when spawning child with pipe fd).
 pub fn incrementReaders(id: u8) void {
-    if (id >= MAX_PIPES) return;
-    const p = &pipes[id];
+    const p = pin(id) orelse return;
+    defer unpin(p);
     p.lock.lock();
     defer p.lock.unlock();
     if (p.active) p.readers += 1;
@@ -208,39 +517,32 @@ pub fn incrementReaders(id: u8) void {
 
 /// Increment writer count (used when spawning child with pipe fd).
 pub fn incrementWriters(id: u8) void {
-    if (id >= MAX_PIPES) return;
-    const p = &pipes[id];
+    const p = pin(id) orelse return;
+    defer unpin(p);
     p.lock.lock();
     defer p.lock.unlock();
     if (p.active) p.writers += 1;
 }
 
-pub fn setReadWaiter(id: u8, pid: u16) void {
-    if (id >= MAX_PIPES) return;
-    const p = &pipes[id];
+/// Register `proc` to be woken when data arrives. Set proc.syscall_ret to
+/// the requested byte count first; it decides when batching wakes it.
+/// Data that raced in since the caller looked is caught by the flush in
+/// the scheduleNext() that follows.
+pub fn setReadWaiter(id: u8, proc: *process.Process) void {
+    const p = pin(id) orelse return;
+    defer unpin(p);
     p.lock.lock();
     defer p.lock.unlock();
-    for (&p.read_waiters) |*slot| {
-        if (slot.* == null) {
-            slot.* = pid;
-            return;
-        }
-    }
-    // All slots full — overwrite the first one (best effort)
-    p.read_waiters[0] = pid;
+    p.read_waiters |= @as(Waiters, 1) << @intCast(process.procIndex(proc));
+    if (p.count > 0 or p.writers == 0) deferWake(id);
 }
 
-pub fn setWriteWaiter(id: u8, pid: u16) void {
-    if (id >= MAX_PIPES) return;
-    const p = &pipes[id];
+/// Register `proc` to be woken when space frees up (see setReadWaiter).
+pub fn setWriteWaiter(id: u8, proc: *process.Process) void {
+    const p = pin(id) orelse return;
+    defer unpin(p);
     p.lock.lock();
     defer p.lock.unlock();
-    for (&p.write_waiters) |*slot| {
-        if (slot.* == null) {
-            slot.* = pid;
-            return;
-        }
-    }
-    // All slots full — overwrite the first one (best effort)
-    p.write_waiters[0] = pid;
+    p.write_waiters |= @as(Waiters, 1) << @intCast(process.procIndex(proc));
+    if (p.space() > 0 or p.readers == 0) deferWake(id);
 }
@@ -1,21 +1,99 @@
+/// Physical page allocator.
+///
+/// Binary buddy allocator: free blocks of 2^order pages (order 0..MAX_ORDER)
+/// sit on per-order doubly linked lists, so a contiguous allocation costs
+/// O(MAX_ORDER) and a free coalesces with its buddy. List links and block
+/// orders live in side arrays indexed by page number, placed after the
+/// bitmap — free pages themselves are never written, so the same code
+/// works before and after paging init.
+///
+/// Single pages go through a per-core magazine (percpu.PageCache) without
+/// taking pmm_lock; it is refilled from / drained to the buddy lists
+/// PAGE_CACHE_BATCH pages at a time. The kernel runs with interrupts
+/// disabled, so only the owning core ever touches its magazine.
+///
+/// The bitmap (1 = used) stays in sync for isFreeAddr and double-free
+/// detection. Pages held in a magazine are marked used in the bitmap and
+/// IN_MAGAZINE in page_order, so freeing one again is caught too.
+///
+/// Pages shared copy-on-write between address spaces carry a count of extra
+/// references (page_share, 0 = sole owner). freePage drops one of those
+/// before it ever returns the page, so every owner just calls freePage.
 const std = @import("std");
 const builtin = @import("builtin");
 const boot = @import("boot.zig");
 const klog = @import("klog.zig");
-const SpinLock = @import("spinlock.zig").SpinLock;
+const percpu = @import("percpu.zig");
+const QueuedLock = @import("spinlock.zig").QueuedLock;
 
 const page_size = 4096;
 
+/// Largest buddy block: 2^MAX_ORDER pages (4 MB).
+pub const MAX_ORDER = 10;
+/// Pages moved between a magazine and the buddy lists per refill/drain.
+const PAGE_CACHE_BATCH = percpu.PAGE_CACHE_SIZE / 2;
+
+const NO_PAGE: u32 = 0xFFFF_FFFF;
+const NOT_HEAD: u8 = 0xFF; // page_order value for pages not heading a free block
+const IN_MAGAZINE: u8 = 0xFE; // page_order value for pages held in a magazine
+
 var bitmap: [*]u8 = undefined;
 var bitmap_size: usize = 0; // in bytes
 var total_pages: usize = 0;
-var free_pages: usize = 0;
-var search_hint: usize = 0;
+var free_pages: usize = 0; // pages on the buddy lists (magazines not included)
 var usable_pages: usize = 0;
 var initialized: bool = false;
 
-/// Spinlock guarding PMM bitmap, free_pages, and search_hint.
-pub var pmm_lock: SpinLock = .{};
+var free_heads: [MAX_ORDER + 1]u32 = [_]u32{NO_PAGE} ** (MAX_ORDER + 1);
+var page_order: [*]u8 = undefined;
+var page_next: [*]u32 = undefined;
+var page_prev: [*]u32 = undefined;
+var page_share: [*]u16 = undefined;
+
+/// Most extra references a page can carry; refPage fails beyond this.
+const MAX_SHARE: u16 = 0xFFFF;
+
+/// Lock guarding the bitmap, buddy lists and free_pages.
+pub var pmm_lock: QueuedLock = QueuedLock.init("pmm");
+
+/// Bytes of bookkeeping (bitmap + buddy side arrays + share counts) for
+/// `pages` frames.
+fn metadataSize(pages: usize) usize {
+    const bm = (pages + 7) / 8;
+    const order_off = bm;
+    const links_off = (order_off + pages + 3) & ~@as(usize, 3);
+    return links_off + pages * 10;
+}
+
+/// Point the bitmap and side arrays at `phys` (sized by metadataSize).
+fn placeMetadata(phys: u64) void {
+    bitmap = @ptrFromInt(phys);
+    const order_off = bitmap_size;
+    const links_off = (order_off + total_pages + 3) & ~@as(usize, 3);
+    page_order = @ptrFromInt(phys + order_off);
+    page_next = @ptrFromInt(phys + links_off);
+    page_prev = @ptrFromInt(phys + links_off + total_pages * 4);
+    page_share = @ptrFromInt(phys + links_off + total_pages * 8);
+    @memset(page_order[0..total_pages], NOT_HEAD);
+    @memset(page_share[0..total_pages], 0);
+}
+
+/// Put every page the bitmap marks free onto the buddy lists.
+fn buildFreeLists() void {
+    free_pages = 0;
+    var run_start: usize = 0;
+    var run_len: usize = 0;
+    for (0..total_pages) |page| {
+        if (isFree(page)) {
+            if (run_len == 0) run_start = page;
+            run_len += 1;
+        } else if (run_len > 0) {
+            freeRange(run_start, run_len);
+            run_len = 0;
+        }
+    }
+    if (run_len > 0) freeRange(run_start, run_len);
+}
 
 pub const PmmError = error{
     NoConventionalMemory,
@@ -38,8 +116,10 @@ pub fn init(memory_map: boot.MemoryMap) PmmError!void {
 
     total_pages = @intCast(highest_addr / page_size);
     bitmap_size = (total_pages + 7) / 8;
+    const meta_size = metadataSize(total_pages);
 
-    // Pass 2: Find a large enough conventional memory region to place the bitmap
+    // Pass 2: Find a large enough conventional memory region to place the
+    // bitmap and buddy side arrays
     var bitmap_phys: u64 = 0;
     var found = false;
     {
@@ -47,7 +127,7 @@ pub fn init(memory_map: boot.MemoryMap) PmmError!void {
         while (it.next()) |desc| {
             if (desc.type != .conventional_memory) continue;
             const region_size = desc.number_of_pages * page_size;
-            if (region_size >= bitmap_size) {
+            if (region_size >= meta_size) {
                 bitmap_phys = desc.physical_start;
                 found = true;
                 break;
@@ -57,8 +137,8 @@ pub fn init(memory_map: boot.MemoryMap) PmmError!void {
 
     if (!found) return error.NoConventionalMemory;
 
-    // Place bitmap
-    bitmap = @ptrFromInt(bitmap_phys);
+    // Place bitmap + side arrays
+    placeMetadata(bitmap_phys);
 
     // Mark everything as used (bit = 0 means free, bit = 1 means used)
     @memset(bitmap[0..bitmap_size], 0xFF);
@@ -76,20 +156,14 @@ pub fn init(memory_map: boot.MemoryMap) PmmError!void {
         }
     }
 
-    // Mark bitmap's own pages as used
-    const bitmap_pages = (bitmap_size + page_size - 1) / page_size;
+    // Mark the metadata's own pages as used
+    const meta_pages = (meta_size + page_size - 1) / page_size;
     const bitmap_start_page: usize = @intCast(bitmap_phys / page_size);
-    for (bitmap_start_page..bitmap_start_page + bitmap_pages) |page| {
+    for (bitmap_start_page..bitmap_start_page + meta_pages) |page| {
         markUsed(page);
     }
 
-    // Count free pages
-    free_pages = 0;
-    for (0..total_pages) |page| {
-        if (isFree(page)) {
-            free_pages += 1;
-        }
-    }
+    buildFreeLists();
 
     usable_pages = free_pages;
     initialized = true;
@@ -105,23 +179,24 @@ pub fn init(memory_map: boot.MemoryMap) PmmError!void {
 /// Initialize PMM from a flat physical memory range (for freestanding targets).
 /// `ram_base` / `ram_size`: total RAM region.
 /// `reserved_end`: everything below this address is reserved (firmware + kernel + initrd).
-/// The bitmap is placed at `reserved_end`, free memory starts after it.
+/// The bitmap and buddy side arrays are placed at `reserved_end`, free
+/// memory starts after them.
 pub fn initDirect(ram_base: u64, ram_size: u64, reserved_end: u64) void {
     const ram_end = ram_base + ram_size;
 
     total_pages = @intCast(ram_end / page_size);
     bitmap_size = (total_pages + 7) / 8;
 
-    // Place bitmap right after reserved area
+    // Place metadata right after reserved area
     const bitmap_phys = (reserved_end + page_size - 1) & ~@as(u64, page_size - 1);
-    bitmap = @ptrFromInt(bitmap_phys);
+    placeMetadata(bitmap_phys);
 
     // Mark everything as used
     @memset(bitmap[0..bitmap_size], 0xFF);
 
-    // Mark free region (after bitmap) as free
-    const bitmap_pages = (bitmap_size + page_size - 1) / page_size;
-    const free_start = bitmap_phys + bitmap_pages * page_size;
+    // Mark free region (after metadata) as free
+    const meta_pages = (metadataSize(total_pages) + page_size - 1) / page_size;
+    const free_start = bitmap_phys + meta_pages * page_size;
     const free_start_page: usize = @intCast(free_start / page_size);
     const end_page: usize = @intCast(ram_end / page_size);
 
@@ -129,13 +204,7 @@ pub fn initDirect(ram_base: u64, ram_size: u64, reserved_end: u64) void {
         markFree(page);
     }
 
-    // Count free pages
-    free_pages = 0;
-    for (0..total_pages) |page| {
-        if (isFree(page)) {
-            free_pages += 1;
-        }
-    }
+    buildFreeLists();
 
     usable_pages = free_pages;
     initialized = true;
@@ -149,81 +218,194 @@ pub fn initDirect(ram_base: u64, ram_size: u64, reserved_end: u64) void {
 
 pub fn allocPage() ?usize {
     if (!initialized) return null;
-    pmm_lock.lock();
-    defer pmm_lock.unlock();
-    // Start scanning from where we last found a free page (avoids O(n) rescan)
-    var checked: usize = 0;
-    while (checked < total_pages) : (checked += 1) {
-        const page = (search_hint + checked) % total_pages;
-        if (isFree(page)) {
-            markUsed(page);
-            free_pages -= 1;
-            search_hint = page + 1;
-            return page * page_size;
+    const cache = &percpu.get().page_cache;
+    if (cache.count == 0) {
+        // Refill the magazine with a batch from the buddy lists
+        pmm_lock.lock();
+        defer pmm_lock.unlock();
+        while (cache.count < PAGE_CACHE_BATCH) {
+            const page = allocBlock(0) orelse break;
+            page_order[page] = IN_MAGAZINE;
+            cache.pages[cache.count] = @intCast(page);
+            cache.count += 1;
         }
+        if (cache.count == 0) return null;
     }
-    return null;
+    cache.count -= 1;
+    const page = cache.pages[cache.count];
+    @atomicStore(u8, &page_order[page], NOT_HEAD, .release);
+    return @as(usize, page) * page_size;
 }
 
 /// Allocate `count` physically contiguous pages.
 /// Returns the physical address of the first page, or null if no
-/// contiguous run of that length is available.
+/// contiguous run of that length is available. The request is rounded up
+/// to a buddy block and the unused tail given back.
 pub fn allocContiguousPages(count: usize) ?usize {
-    if (!initialized or count == 0) return null;
+    if (!initialized or count == 0 or count > (1 << MAX_ORDER)) return null;
+    var order: u6 = 0;
+    while ((@as(usize, 1) << order) < count) order += 1;
+
     pmm_lock.lock();
     defer pmm_lock.unlock();
+    const page = allocBlock(order) orelse return null;
+    const block_pages = @as(usize, 1) << order;
+    if (block_pages > count) freeRange(page + count, block_pages - count);
+    return page * page_size;
+}
 
-    var start = search_hint;
-    var checked: usize = 0;
-    while (checked < total_pages) {
-        // Check if `count` pages starting at `start` are all free
-        var run_ok = true;
-        var i: usize = 0;
-        while (i < count) : (i += 1) {
-            const page = (start + i) % total_pages;
-            if (page + count > total_pages and start + i >= total_pages) {
-                // Would wrap around — skip
-                run_ok = false;
-                break;
-            }
-            if (!isFree(page)) {
-                // Skip past this used page
-                checked += i + 1;
-                start = start + i + 1;
-                run_ok = false;
-                break;
-            }
-        }
-        if (run_ok) {
-            // Found a run — mark all used
-            for (0..count) |j| {
-                markUsed((start + j) % total_pages);
-            }
-            free_pages -= count;
-            search_hint = start + count;
-            return (start % total_pages) * page_size;
+pub fn freePage(phys_addr: usize) void {
+    if (!initialized) return;
+    const page = phys_addr / page_size;
+    // Ignore double frees (page already free)
+    if (page >= total_pages or isFree(page)) return;
+    // Shared page: drop one reference, the last owner frees it
+    if (unshare(page)) return;
+    // Already sitting in some core's magazine: a double free
+    if (@cmpxchgStrong(u8, &page_order[page], NOT_HEAD, IN_MAGAZINE, .acq_rel, .monotonic) != null) return;
+    const cache = &percpu.get().page_cache;
+    if (cache.count == percpu.PAGE_CACHE_SIZE) {
+        // Magazine full: return the older half to the buddy lists
+        pmm_lock.lock();
+        defer pmm_lock.unlock();
+        for (cache.pages[0..PAGE_CACHE_BATCH]) |p| {
+            page_order[p] = NOT_HEAD;
+            freeRange(p, 1);
         }
+        std.mem.copyForwards(u32, cache.pages[0 .. cache.count - PAGE_CACHE_BATCH], cache.pages[PAGE_CACHE_BATCH..cache.count]);
+        cache.count -= PAGE_CACHE_BATCH;
     }
-    return null;
+    cache.pages[cache.count] = @intCast(page);
+    cache.count += 1;
 }
 
-pub fn freePage(phys_addr: usize) void {
-    if (!initialized) return;
+/// Free `count` contiguous pages from allocContiguousPages straight back to
+/// the buddy lists (bypassing the per-core magazine).
+pub fn freeContiguousPages(phys_addr: usize, count: usize) void {
+    if (!initialized or count == 0) return;
+    const start = phys_addr / page_size;
+    if (start + count > total_pages) return;
     pmm_lock.lock();
     defer pmm_lock.unlock();
+    for (start..start + count) |page| {
+        // Double free — leave the range alone
+        if (isFree(page) or page_order[page] == IN_MAGAZINE) return;
+    }
+    freeRange(start, count);
+}
+
+/// Take an extra reference on an allocated page so another address space
+/// can map it copy-on-write. Returns false if the count would overflow (the
+/// caller copies the page instead).
+pub fn refPage(phys_addr: usize) bool {
     const page = phys_addr / page_size;
-    if (page < total_pages and !isFree(page)) {
-        markFree(page);
-        free_pages += 1;
+    if (!initialized or page >= total_pages) return false;
+    var n = @atomicLoad(u16, &page_share[page], .acquire);
+    while (n < MAX_SHARE) {
+        n = @cmpxchgWeak(u16, &page_share[page], n, n + 1, .acq_rel, .acquire) orelse return true;
+    }
+    return false;
+}
+
+/// Whether a page has owners besides the caller (see refPage).
+pub fn isShared(phys_addr: usize) bool {
+    const page = phys_addr / page_size;
+    if (!initialized or page >= total_pages) return false;
+    return @atomicLoad(u16, &page_share[page], .acquire) != 0;
+}
+
+/// Drop one extra reference. Returns false if the caller was the sole owner.
+fn unshare(page: usize) bool {
+    var n = @atomicLoad(u16, &page_share[page], .acquire);
+    while (n != 0) {
+        n = @cmpxchgWeak(u16, &page_share[page], n, n - 1, .acq_rel, .acquire) orelse return true;
     }
+    return false;
 }
 
 pub fn getTotalPages() usize {
     return usable_pages;
 }
 
+/// Free pages, including those parked in per-core magazines.
 pub fn getFreePages() usize {
-    return free_pages;
+    var n = free_pages;
+    for (&percpu.percpu_array) |*cpu| n += cpu.page_cache.count;
+    return n;
+}
+
+// ── Buddy lists (pmm_lock held) ──────────────────────────────────────
+
+fn listPush(order: u6, page: usize) void {
+    const head = free_heads[order];
+    page_order[page] = order;
+    page_prev[page] = NO_PAGE;
+    page_next[page] = head;
+    if (head != NO_PAGE) page_prev[head] = @intCast(page);
+    free_heads[order] = @intCast(page);
+}
+
+fn listRemove(order: u6, page: usize) void {
+    const next = page_next[page];
+    const prev = page_prev[page];
+    if (prev != NO_PAGE) page_next[prev] = next else free_heads[order] = next;
+    if (next != NO_PAGE) page_prev[next] = prev;
+    page_order[page] = NOT_HEAD;
+}
+
+/// Take a free block of 2^order pages, splitting a larger one if needed.
+/// Returns its first page number.
+fn allocBlock(order: u6) ?usize {
+    var j: u6 = order;
+    while (j <= MAX_ORDER and free_heads[j] == NO_PAGE) j += 1;
+    if (j > MAX_ORDER) return null;
+
+    const page: usize = free_heads[j];
+    listRemove(j, page);
+    // Return the upper halves to the lists until the block is the right size
+    while (j > order) {
+        j -= 1;
+        listPush(j, page + (@as(usize, 1) << j));
+    }
+
+    const n = @as(usize, 1) << order;
+    for (page..page + n) |p| markUsed(p);
+    free_pages -= n;
+    return page;
+}
+
+/// Free a block of 2^order pages at `page` and merge it with free buddies.
+fn freeBlock(page_in: usize, order_in: u6) void {
+    const n = @as(usize, 1) << order_in;
+    for (page_in..page_in + n) |p| markFree(p);
+    free_pages += n;
+
+    var page = page_in;
+    var order = order_in;
+    while (order < MAX_ORDER) {
+        const buddy = page ^ (@as(usize, 1) << order);
+        if (buddy >= total_pages or page_order[buddy] != order) break;
+        listRemove(order, buddy);
+        page = @min(page, buddy);
+        order += 1;
+    }
+    listPush(order, page);
+}
+
+/// Free `count` pages from `start`, as the largest aligned blocks that fit.
+fn freeRange(start: usize, count: usize) void {
+    var page = start;
+    var left = count;
+    while (left > 0) {
+        var order: u6 = 0;
+        while (order < MAX_ORDER) : (order += 1) {
+            const next = @as(usize, 1) << (order + 1);
+            if (page % next != 0 or next > left) break;
+        }
+        freeBlock(page, order);
+        page += @as(usize, 1) << order;
+        left -= @as(usize, 1) << order;
+    }
 }
 
 fn isFree(page: usize) bool {
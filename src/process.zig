@@ -7,7 +7,9 @@ const klog = @import("klog.zig");
 const mem = @import("mem.zig");
 const ipc = @import("ipc.zig");
 const namespace = @import("namespace.zig");
+const ring = @import("ring.zig");
 const SpinLock = @import("spinlock.zig").SpinLock;
+const QueuedLock = @import("spinlock.zig").QueuedLock;
 pub const thread_group = @import("thread_group.zig");
 
 const paging = switch (@import("builtin").cpu.arch) {
@@ -19,6 +21,9 @@ const paging = switch (@import("builtin").cpu.arch) {
             return null;
         }
         pub fn mapPage(_: anytype, _: u64, _: u64, _: u64) ?void {}
+        pub fn translateUser(_: anytype, _: u64, _: bool) ?u64 {
+            return null;
+        }
         pub fn switchAddressSpace(_: anytype) void {}
         pub fn isInitialized() bool {
             return false;
@@ -50,6 +55,9 @@ const cpu = switch (@import("builtin").cpu.arch) {
 };
 
 const percpu = @import("percpu.zig");
+const trace = @import("trace.zig");
+const tlb = @import("tlb.zig");
+const timer = @import("timer.zig");
 
 const syscall_entry = switch (@import("builtin").cpu.arch) {
     .x86_64 => @import("arch/x86_64/syscall_entry.zig"),
@@ -73,11 +81,18 @@ const RET_SLOT: usize = switch (@import("builtin").cpu.arch) {
     else => 12,
 };
 
+/// Returned from a woken splice: retry the call.
+const EAGAIN: u64 = 0xFFFF_FFFF_FFFF_FFF5; // -11
+
 pub const MAX_PROCESSES = 128;
 pub const MAX_FDS = 32;
 pub const KERNEL_STACK_PAGES = 8; // 32 KB kernel stack per process
 pub const USER_STACK_PAGES = 64; // 256 KB user stack per process
 
+comptime {
+    if (MAX_PROCESSES > percpu.MAX_TASKS) @compileError("run queues cannot index every process");
+}
+
 pub const ProcessState = enum {
     free,
     running,
@@ -94,9 +109,9 @@ pub const ResourceQuotas = struct {
     cpu_priority: u8 = 128, // 0=lowest, 255=highest
 };
 
-pub const PendingOp = enum(u8) { none, open, create, read, write, close, stat, remove, rename, truncate, wstat, console_read, net_read, net_connect, net_listen, dns_query, icmp_read, pipe_read, pipe_write, sleep, ether_read };
+pub const PendingOp = enum(u8) { none, open, create, read, write, close, stat, remove, rename, truncate, wstat, console_read, net_read, net_connect, net_listen, dns_query, icmp_read, pipe_read, pipe_write, sleep, ether_read, blk_read, blk_write, ipc_collect, futex_wait, splice, splice_read, splice_write, standby, ring_enter };
 
-pub const FdType = enum(u8) { ipc, net, pipe, blk, proc, dev_null, dev_zero, dev_random, dev_pci, dev_usb, dev_mouse, dev_cpu, dev_ether, dev_sysname, dev_osversion, dev_time, dev_kmesg, dev_reboot, dev_drivers, dev_pid, dev_user, dev_consctl, dev_sysstat };
+pub const FdType = enum(u8) { ipc, net, pipe, blk, proc, dev_null, dev_zero, dev_random, dev_pci, dev_usb, dev_mouse, dev_cpu, dev_ether, dev_sysname, dev_osversion, dev_time, dev_kmesg, dev_reboot, dev_drivers, dev_pid, dev_user, dev_consctl, dev_sysstat, dev_trace };
 
 pub const ProcFdKind = enum(u8) {
     dir,
@@ -104,6 +119,8 @@ pub const ProcFdKind = enum(u8) {
     status,
     ctl,
     meminfo,
+    slabinfo,
+    lockstat,
 };
 
 pub const NetFdKind = enum(u8) {
@@ -195,10 +212,15 @@ pub const Process = struct {
     pending_op: PendingOp,
     /// Pre-allocated fd for open/create reply handling.
     pending_fd: u32,
+    /// Pipe fd a splice_read reply is written into, or a splice_write
+    /// reply consumes from.
+    splice_fd: u32 = 0,
     /// Deferred kernel stack free (can't free while running on it).
     needs_stack_free: bool = false,
-    /// Tick at which a sleeping process should wake up.
-    sleep_until: u32 = 0,
+    /// Deadline (timer.now() ns) of a sleep, timed futex wait or splice
+    /// retry; 0 = none. wake_timer fires at it.
+    sleep_until: u64 = 0,
+    wake_timer: timer.Timer = .{ .func = &wakeTimerFired },
     /// Virtual terminal index (0-3) for console I/O routing.
     vt: u8 = 0,
     /// Process user ID (for permission checks).
@@ -209,18 +231,44 @@ pub const Process = struct {
     assigned_core: u8 = 0,
     /// Core affinity: -1 = any core, >=0 = pinned to specific core.
     core_affinity: i16 = -1,
-    /// Bitmap of cores that have run this process (for TLB shootdown).
+    /// Bitmap of cores that have run this process (for TLB shootdown and
+    /// cache-affine work stealing).
     cores_ran_on: u128 = 0,
+    /// Run-queue level (see percpu.Priority).
+    priority: percpu.Priority = .interactive,
     /// Next virtual address for anonymous mmap allocations.
     mmap_next: u64 = 0x0000_4000_0000_0000,
     /// Saved FS_BASE MSR value (for TLS, used by musl libc).
     fs_base: u64 = 0,
+    /// x87/SSE registers (fxsave image) while another process owns them.
+    fpu: [512]u8 align(16) = fpu_reset,
     /// Thread group pointer (non-null for threads sharing an address space).
     thread_group: ?*thread_group.ThreadGroup = null,
     /// Address to clear and futex-wake on thread exit (CLONE_CHILD_CLEARTID).
     ctid_ptr: u64 = 0,
     /// PID of the client this server thread is currently serving (for IPC reply).
     ipc_serving_client: u32 = 0,
+    /// Tagged request this server thread is serving; its reply completes the
+    /// request instead of waking a blocked client.
+    ipc_serving_tagged: ?*ipc.TaggedRequest = null,
+    /// Completed tagged requests awaiting ipc_collect.
+    ipc_done: ipc.DoneQueue = .{},
+    /// Where a blocked ipc_collect stores the cookie (reply goes to ipc_recv_buf_ptr).
+    ipc_collect_cookie_ptr: u64 = 0,
+    /// Submission ring (ring_setup/ring_enter), if any.
+    ring: ring.State = .{},
+    /// Page grant for an in-flight bulk IPC request: the client buffer the
+    /// serving server may copy to/from with ipc_grant. ipc_grant_len 0 = none.
+    ipc_grant_va: u64 = 0,
+    ipc_grant_len: u32 = 0,
+    /// Server may write the grant (client read) rather than only read it.
+    ipc_grant_writable: bool = false,
+    /// Futex wait queue link and key (see futex.zig). Guarded by the
+    /// bucket lock for (futex_space, futex_addr) while futex_queued.
+    futex_next: ?*Process = null,
+    futex_addr: u64 = 0,
+    futex_space: u64 = 0,
+    futex_queued: bool = false,
     /// Process name (basename of executable), for /proc/N/status.
     name: [16]u8 = .{0} ** 16,
 
@@ -411,8 +459,8 @@ var processes: [MAX_PROCESSES]Process = undefined;
 var initialized: bool = false;
 pub var next_pid: u32 = 1;
 
-/// Spinlock guarding process table allocation (next_pid, state transitions).
-pub var table_lock: SpinLock = .{};
+/// Lock guarding process table allocation (next_pid, state transitions).
+pub var table_lock: QueuedLock = QueuedLock.init("process_table");
 
 /// Index for round-robin scheduling.
 var schedule_index: usize = 0;
@@ -449,6 +497,10 @@ pub fn init() void {
         p.ipc_recv_buf_ptr = 0;
         p.ipc_pending_msg = null;
         p.ipc_serving_client = 0;
+        p.ipc_serving_tagged = null;
+        p.ipc_done = .{};
+        p.ring = .{};
+        p.ipc_grant_len = 0;
         p.parent_pid = null;
         p.exit_status = 0;
         p.waiting_for_pid = null;
@@ -456,9 +508,13 @@ pub fn init() void {
         p.pending_fd = 0;
         p.needs_stack_free = false;
         p.sleep_until = 0;
+        p.wake_timer = .{ .func = &wakeTimerFired };
+        p.futex_queued = false;
+        p.futex_next = null;
         p.vt = 0;
         p.thread_group = null;
         p.ctid_ptr = 0;
+        p.ns = namespace.Namespace.init();
         p.initFds();
     }
     thread_group.init();
@@ -524,6 +580,10 @@ pub fn create() ?*Process {
     proc.ipc_recv_buf_ptr = 0;
     proc.ipc_pending_msg = null;
     proc.ipc_serving_client = 0;
+    proc.ipc_serving_tagged = null;
+    proc.ipc_done.release();
+    proc.ring.release();
+    proc.ipc_grant_len = 0;
     proc.parent_pid = parent_pid;
     proc.exit_status = 0;
     proc.waiting_for_pid = null;
@@ -531,12 +591,15 @@ pub fn create() ?*Process {
     proc.pending_fd = 0;
     proc.needs_stack_free = false;
     proc.sleep_until = 0;
+    proc.futex_queued = false;
+    proc.futex_next = null;
     proc.vt = if (current()) |cur| cur.vt else 0;
     proc.uid = 0;
     proc.gid = 0;
     proc.thread_group = null;
     proc.ctid_ptr = 0;
     proc.fs_base = 0;
+    resetFpu(proc);
     proc.mmap_next = 0x0000_4000_0000_0000;
     namespace.getRootNamespace().cloneInto(&proc.ns);
     proc.ipc_msg = ipc.Message.init(.t_open);
@@ -545,6 +608,7 @@ pub fn create() ?*Process {
     proc.assigned_core = if (current()) |_| leastLoadedCore() else 0;
     proc.core_affinity = -1; // any core
     proc.cores_ran_on = 0;
+    proc.priority = .interactive;
 
     // Enqueue on the assigned core's run queue
     markReady(proc);
@@ -612,6 +676,10 @@ pub fn createThread(parent: *Process) ?*Process {
     proc.ipc_recv_buf_ptr = 0;
     proc.ipc_pending_msg = null;
     proc.ipc_serving_client = 0;
+    proc.ipc_serving_tagged = null;
+    proc.ipc_done.release();
+    proc.ring.release();
+    proc.ipc_grant_len = 0;
     proc.parent_pid = parent.pid;
     proc.exit_status = 0;
     proc.waiting_for_pid = null;
@@ -619,12 +687,15 @@ pub fn createThread(parent: *Process) ?*Process {
     proc.pending_fd = 0;
     proc.needs_stack_free = false;
     proc.sleep_until = 0;
+    proc.futex_queued = false;
+    proc.futex_next = null;
     proc.vt = parent.vt;
     proc.uid = parent.uid;
     proc.gid = parent.gid;
-    proc.ns = namespace.Namespace{ .mounts = undefined, .count = 0 };
+    proc.ns.release(); // threads use the group's namespace
     proc.ipc_msg = ipc.Message.init(.t_open);
     proc.fs_base = 0;
+    resetFpu(proc);
     proc.ctid_ptr = 0;
     proc.mmap_next = 0; // not used directly, group has the shared value
 
@@ -636,6 +707,7 @@ pub fn createThread(parent: *Process) ?*Process {
     proc.assigned_core = leastLoadedCore();
     proc.core_affinity = -1;
     proc.cores_ran_on = 0;
+    proc.priority = parent.priority;
 
     markReady(proc);
     return proc;
@@ -662,10 +734,10 @@ pub fn getByPid(pid: u32) ?*Process {
 /// Pick the online core with the shortest run queue.
 pub fn leastLoadedCore() u8 {
     var best: u8 = 0;
-    var best_len: u32 = percpu.percpu_array[0].run_queue.len;
+    var best_len: u32 = percpu.percpu_array[0].run_queue.len();
     var i: u8 = 1;
     while (i < percpu.cores_online) : (i += 1) {
-        const len = percpu.percpu_array[i].run_queue.len;
+        const len = percpu.percpu_array[i].run_queue.len();
         if (len < best_len) {
             best = i;
             best_len = len;
@@ -679,12 +751,19 @@ pub fn procIndex(proc: *const Process) u16 {
     return @intCast((@intFromPtr(proc) - @intFromPtr(&processes[0])) / @sizeOf(Process));
 }
 
-/// Mark a process as ready and enqueue it on its assigned core's run queue.
-/// If the target core is different from the current core, sends a schedule IPI.
+/// Mark a process as ready and enqueue it on its assigned core's run queue:
+/// straight onto the deque for its priority when that is this core's,
+/// otherwise onto the target's inbox with a schedule IPI.
 pub fn markReady(proc: *Process) void {
     proc.state = .ready;
     const target_core = proc.assigned_core;
-    _ = percpu.percpu_array[target_core].run_queue.push(procIndex(proc));
+    trace.point(.wakeup, proc.pid, target_core, 0);
+    const rq = &percpu.percpu_array[target_core].run_queue;
+    if (target_core == percpu.getCoreId()) {
+        rq.push(proc.priority, procIndex(proc));
+    } else {
+        rq.inbox.push(procIndex(proc));
+    }
 
     // Send IPI if target core is remote (and LAPIC is available)
     if (@import("builtin").cpu.arch == .x86_64) {
@@ -695,30 +774,185 @@ pub fn markReady(proc: *Process) void {
     }
 }
 
-/// Send TLB shootdown IPI to all cores that have run this process.
-/// Called when tearing down page tables (process exit, exec).
-/// The current core flushes its own TLB directly; remote cores get an IPI.
-pub fn tlbShootdown(proc: *const Process) void {
+/// IPC direct handoff (L4-style): `proc` becomes the next process this core
+/// runs, without a run-queue round trip or IPI. The caller is about to block
+/// and call scheduleNext(), which switches straight to `proc` — in effect the
+/// caller donates the rest of its turn. Only taken when `proc` last ran on
+/// this core (so its kernel stack is idle); otherwise this is markReady().
+/// An earlier hint that was never consumed is moved to the run queue.
+pub fn handoff(proc: *Process) void {
+    const pc = percpu.get();
+    if (proc.assigned_core != pc.core_id) {
+        markReady(proc);
+        return;
+    }
+    flushHandoff();
+    proc.state = .ready;
+    pc.handoff = procIndex(proc);
+    pc.ipc_handoffs += 1;
+}
+
+/// Queue this core's pending handoff target normally. Called when the
+/// current process keeps running instead of blocking, so the target
+/// doesn't wait behind it (and stays visible to work stealing).
+pub fn flushHandoff() void {
+    const pc = percpu.get();
+    const idx = pc.handoff;
+    if (idx == percpu.NO_HANDOFF) return;
+    pc.handoff = percpu.NO_HANDOFF;
+    if (processes[idx].state == .ready) markReady(&processes[idx]);
+}
+
+// ── FPU state ───────────────────────────────────────────────────────
+//
+// The kernel is built soft-float and never touches the x87/SSE registers,
+// so they always hold the state of the last process that ran in user mode.
+// switchTo saves them only when a different process comes in. APs don't
+// run processes yet, so one owner covers the machine.
+
+/// fxsave image after reset: every x87 and SSE exception masked.
+const fpu_reset: [512]u8 = blk: {
+    var img = [_]u8{0} ** 512;
+    img[0] = 0x7F; // FCW = 0x037F
+    img[1] = 0x03;
+    img[24] = 0x80; // MXCSR = 0x1F80
+    img[25] = 0x1F;
+    break :blk img;
+};
+
+/// Process whose FPU state is in the registers (null = none).
+var fpu_owner: ?*Process = null;
+
+/// Put proc's FPU state in the registers, saving the previous owner's.
+fn loadFpu(proc: *Process) void {
     if (@import("builtin").cpu.arch != .x86_64) return;
-    if (percpu.cores_online <= 1) return;
+    if (fpu_owner == proc) return;
+    if (fpu_owner) |owner| cpu.fxsave(&owner.fpu);
+    cpu.fxrstor(&proc.fpu);
+    fpu_owner = proc;
+}
 
-    const my_core = percpu.getCoreId();
-    const bitmap = proc.cores_ran_on;
-    const apic = @import("arch/x86_64/apic.zig");
+/// Write proc's live FPU registers back to proc.fpu, for fork/clone to copy.
+pub fn syncFpu(proc: *Process) void {
+    if (@import("builtin").cpu.arch != .x86_64) return;
+    if (fpu_owner == proc) cpu.fxsave(&proc.fpu);
+}
 
-    var core: u8 = 0;
-    while (core < percpu.cores_online) : (core += 1) {
-        if (bitmap & (@as(u128, 1) << @intCast(core)) == 0) continue;
-        if (core == my_core) {
-            // Flush own TLB by reloading CR3
-            const cpu_mod = @import("arch/x86_64/cpu.zig");
-            cpu_mod.flushTlb();
-        } else {
-            // Set pending flag and send IPI
-            @atomicStore(bool, &percpu.percpu_array[core].tlb_flush_pending, true, .release);
-            apic.sendIpi(apic.lapic_ids[core], apic.IPI_TLB_SHOOTDOWN);
+/// Give proc a clean FPU state (new slot, exec). Drops its ownership so
+/// the next switchTo loads the clean image rather than keeping the old
+/// registers.
+pub fn resetFpu(proc: *Process) void {
+    proc.fpu = fpu_reset;
+    if (fpu_owner == proc) fpu_owner = null;
+}
+
+// ── Copy-on-write ───────────────────────────────────────────────────
+
+/// Serializes CoW PTE updates: fork write-protecting an address space and
+/// write faults resolving pages in it, so two threads sharing the tables
+/// never copy (and unreference) the same page twice.
+var cow_lock: SpinLock = .{};
+
+/// Clone `parent`'s address space copy-on-write for rfork(RFPROC).
+/// Returns null when out of memory.
+pub fn forkAddressSpace(parent: *Process) ?*paging.PageTable {
+    const pml4 = (if (parent.thread_group) |tg| tg.pml4 else parent.pml4) orelse return null;
+    cow_lock.lock();
+    const child = paging.cowCopyAddressSpace(pml4);
+    cow_lock.unlock();
+    // The parent's writable pages are read-only now
+    tlb.shootdown(pml4, 0, tlb.ALL);
+    return child;
+}
+
+/// Share the frames behind `frames.len` user pages at `va` in `proc`'s
+/// address space (see image.zig). The pages turn copy-on-write for `proc`.
+pub fn shareUserPages(proc: *Process, va: u64, frames: []u64) bool {
+    const pml4 = (if (proc.thread_group) |tg| tg.pml4 else proc.pml4) orelse return false;
+    cow_lock.lock();
+    const ok = paging.shareUserPages(pml4, va, frames);
+    cow_lock.unlock();
+    tlb.shootdown(pml4, va, frames.len);
+    return ok;
+}
+
+/// Unmap `pages` user pages at `va` in `proc`'s address space and free
+/// their frames, once no core can still reach them (munmap).
+pub fn unmapUserPages(proc: *Process, va: u64, pages: u64) void {
+    const pml4 = (if (proc.thread_group) |tg| tg.pml4 else proc.pml4) orelse return;
+    // Unmap in batches: one shootdown per batch, frames freed after it.
+    var frames: [tlb.MAX_RANGE_PAGES]u64 = undefined;
+    var done: u64 = 0;
+    while (done < pages) {
+        const batch = @min(pages - done, frames.len);
+        const start = va + done * mem.PAGE_SIZE;
+        var n: usize = 0;
+        cow_lock.lock();
+        for (0..batch) |i| {
+            if (paging.unmapPage(pml4, start + i * mem.PAGE_SIZE)) |phys| {
+                frames[n] = phys;
+                n += 1;
+            }
+        }
+        cow_lock.unlock();
+        if (n > 0) {
+            tlb.shootdown(pml4, start, batch);
+            for (frames[0..n]) |phys| pmm.freePage(phys);
+            proc.pages_used -|= @intCast(n);
         }
+        done += batch;
+    }
+}
+
+/// Write fault at user address `addr` in the current address space (from
+/// user mode, or from the kernel copying into a user buffer). Returns true
+/// if it hit a copy-on-write page that is now writable, so the faulting
+/// access can simply be retried.
+pub fn handleCowFault(addr: u64) bool {
+    const proc = getCurrent() orelse return false;
+    return breakCow(proc, addr);
+}
+
+/// Give `proc` a private, writable copy of the copy-on-write page at user
+/// address `addr`. Also needed before the kernel writes into another
+/// process's memory through the higher-half map (IPC grants), which
+/// bypasses page protection. Returns false if the page is not CoW or no
+/// memory is left for the copy.
+pub fn breakCow(proc: *Process, addr: u64) bool {
+    if (addr >= 0x0000_8000_0000_0000) return false;
+    const pml4 = (if (proc.thread_group) |tg| tg.pml4 else proc.pml4) orelse return false;
+    cow_lock.lock();
+    const result = paging.resolveCow(pml4, addr);
+    cow_lock.unlock();
+    switch (result) {
+        .not_cow => return false,
+        .no_memory => {
+            klog.warn("[cow: out of memory]\n");
+            return false;
+        },
+        .reused => paging.invalidatePage(addr),
+        // Other cores (sibling threads, or this address space's cached
+        // tag) may still map the old frame
+        .copied => tlb.shootdown(pml4, addr & ~@as(u64, mem.PAGE_SIZE - 1), 1),
+    }
+    return true;
+}
+
+/// Whether the kernel may write [addr, addr + len) of `proc`'s memory:
+/// every page mapped user-writable, or copy-on-write (broken here, as the
+/// write itself would). With CR0.WP set, a kernel write to any other user
+/// page (.text, .rodata) is a fatal kernel #PF, so syscalls check their
+/// output buffers with this and fail with EFAULT instead.
+pub fn userWritable(proc: *Process, addr: u64, len: u64) bool {
+    if (len == 0) return true;
+    if (addr >= 0x0000_8000_0000_0000 or len > 0x0000_8000_0000_0000 - addr) return false;
+    const pml4 = (if (proc.thread_group) |tg| tg.pml4 else proc.pml4) orelse return false;
+    var page = addr & ~@as(u64, mem.PAGE_SIZE - 1);
+    while (page < addr + len) : (page += mem.PAGE_SIZE) {
+        if (paging.translateUser(pml4, page, true) != null) continue;
+        if (!breakCow(proc, page)) return false;
     }
+    return true;
 }
 
 /// Mark a process as ready by PID. Returns false if PID not found.
@@ -730,6 +964,18 @@ pub fn markReadyByPid(pid: u32) bool {
     return false;
 }
 
+/// wake_timer callback: the sleep_until deadline of a sleep, timed futex
+/// wait or splice retry has passed. Stale firings find nothing to do.
+fn wakeTimerFired(t: *timer.Timer) void {
+    const p: *Process = @fieldParentPtr("wake_timer", t);
+    if (p.state != .blocked or p.sleep_until == 0) return;
+    switch (p.pending_op) {
+        .sleep, .splice => if (timer.now() >= p.sleep_until) markReady(p),
+        .futex_wait => @import("futex.zig").expire(p, timer.now()),
+        else => {},
+    }
+}
+
 /// Recursively kill all children of a process (Fornax orphan policy).
 /// When a parent exits, its entire subtree dies — Plan 9/L4/VMS style.
 pub fn killChildren(parent_pid: u32) void {
@@ -769,9 +1015,13 @@ pub fn saveCurrentContext() void {
     }
 }
 
-/// Round-robin scheduler: pick the next .ready process and jump to it.
-/// If no process is ready, halts the system.
+/// Scheduler: pick the next .ready process and jump to it — the IPC handoff
+/// target, else the highest-priority local entry (FIFO within a level),
+/// else one stolen from another core. If no process is ready, idles.
 pub fn scheduleNext() noreturn {
+    // Batched pipe wakeups can wait no longer than the writer keeps running
+    @import("pipe.zig").flushDeferred();
+
     // Mark current as no longer running (if it was)
     if (current()) |proc| {
         if (proc.state == .running) {
@@ -783,7 +1033,17 @@ pub fn scheduleNext() noreturn {
     const my_core = percpu.getCoreId();
     const my_queue = &percpu.percpu_array[my_core].run_queue;
 
+    // Direct IPC handoff target goes ahead of the run queue
+    const hint = percpu.percpu_array[my_core].handoff;
+    if (hint != percpu.NO_HANDOFF) {
+        percpu.percpu_array[my_core].handoff = percpu.NO_HANDOFF;
+        if (processes[hint].state == .ready) switchTo(&processes[hint]);
+    }
+
     while (true) {
+        // Wakeups from other cores join the local deques first
+        drainInbox(my_queue, my_core);
+
         // Try to pop from local run queue
         if (my_queue.pop()) |pid| {
             const proc = &processes[pid];
@@ -796,30 +1056,7 @@ pub fn scheduleNext() noreturn {
         }
 
         // Run queue empty — try work stealing from other cores
-        if (percpu.cores_online > 1) {
-            var victim: u8 = (my_core +% 1) % percpu.cores_online;
-            var attempts: u8 = 0;
-            while (attempts < percpu.cores_online - 1) : (attempts += 1) {
-                if (victim != my_core) {
-                    const stolen = my_queue.stealHalf(&percpu.percpu_array[victim].run_queue);
-                    if (stolen > 0) {
-                        // Update assigned_core for stolen processes
-                        var peek: u32 = 0;
-                        while (peek < stolen) : (peek += 1) {
-                            const idx = (my_queue.head +% peek) % percpu.RUN_QUEUE_SIZE;
-                            const spid = my_queue.entries[idx];
-                            if (spid < MAX_PROCESSES) {
-                                processes[spid].assigned_core = my_core;
-                            }
-                        }
-                        break; // Got work, will pop on next iteration
-                    }
-                }
-                victim = (victim +% 1) % percpu.cores_online;
-            }
-            // If we stole work, loop back to pop
-            if (!my_queue.isEmpty()) continue;
-        }
+        if (percpu.cores_online > 1 and stealWork(my_queue, my_core)) continue;
 
         // No ready process found — check if any are alive
         var any_alive = false;
@@ -873,6 +1110,86 @@ pub fn scheduleNext() noreturn {
     }
 }
 
+/// Move `rq`'s inbox onto its deques. Runs on the owning core.
+fn drainInbox(rq: *percpu.RunQueue, core: u8) void {
+    if (rq.inbox.isEmpty()) return;
+    var batch: [percpu.MAX_TASKS]u16 = undefined;
+    const n = rq.inbox.takeAll(&batch);
+    for (batch[0..n]) |idx| {
+        const proc = &processes[idx];
+        if (proc.state != .ready) continue;
+        proc.assigned_core = core;
+        rq.refill(proc.priority, idx);
+    }
+}
+
+/// Steal work for idle `core` from another core's run queue.
+///
+/// Victims are ranked by cache affinity: cores behind the same LLC first,
+/// then cores whose next stealable process has run behind this LLC before
+/// (cores_ran_on), then the rest, longest queue first within a rank. From
+/// a core sharing the LLC up to half of the highest non-empty level moves;
+/// across LLCs only one process does, keeping cold-cache migrations to the
+/// minimum that gets this core busy. An idle victim's inbox (wakeups it
+/// has not picked up yet) is taken whole.
+fn stealWork(my_queue: *percpu.RunQueue, my_core: u8) bool {
+    const llc = percpu.llcMask(my_core);
+    var best: ?u8 = null;
+    var best_rank: u8 = 0;
+    var best_len: u32 = 0;
+    var core: u8 = 0;
+    while (core < percpu.cores_online) : (core += 1) {
+        if (core == my_core) continue;
+        const rq = &percpu.percpu_array[core].run_queue;
+        const len = rq.len();
+        if (len == 0) continue;
+        var rank: u8 = 0;
+        if (llc & (@as(u128, 1) << @intCast(core)) != 0) {
+            rank = 2;
+        } else {
+            for (&rq.levels) |*d| {
+                const idx = d.peekTop() orelse continue;
+                if (idx < MAX_PROCESSES and processes[idx].cores_ran_on & llc != 0) rank = 1;
+                break;
+            }
+        }
+        if (best == null or rank > best_rank or (rank == best_rank and len > best_len)) {
+            best = core;
+            best_rank = rank;
+            best_len = len;
+        }
+    }
+    const victim = best orelse return false;
+    const vq = &percpu.percpu_array[victim].run_queue;
+
+    var got = false;
+    if (percpu.percpu_array[victim].current == null and !vq.inbox.isEmpty()) {
+        var batch: [percpu.MAX_TASKS]u16 = undefined;
+        const n = vq.inbox.takeAll(&batch);
+        for (batch[0..n]) |idx| {
+            const proc = &processes[idx];
+            if (proc.state != .ready) continue;
+            proc.assigned_core = my_core;
+            my_queue.refill(proc.priority, idx);
+            got = true;
+        }
+    }
+
+    for (&vq.levels, 0..) |*d, level| {
+        const want = if (best_rank == 2) @max(d.len() / 2, 1) else 1;
+        var taken: u32 = 0;
+        while (taken < want) : (taken += 1) {
+            const idx = d.steal() orelse break;
+            if (idx >= MAX_PROCESSES) continue;
+            processes[idx].assigned_core = my_core;
+            my_queue.refill(@enumFromInt(level), idx);
+            got = true;
+        }
+        if (taken > 0) break;
+    }
+    return got;
+}
+
 /// Assembly entry point defined in entry.S — returns to userspace.
 /// x86_64: IRETQ. riscv64: SRET.
 /// Args: rip, rsp, flags, ret_val
@@ -888,15 +1205,9 @@ fn switchTo(proc: *Process) noreturn {
     // Increment per-core context switch counter
     const core_id = percpu.getCoreId();
     percpu.percpu_array[core_id].ctx_switches += 1;
-    // Track which cores have run this process (for TLB shootdown)
-    const core_bit = @as(u128, 1) << @intCast(core_id);
-    proc.cores_ran_on |= core_bit;
-    // Also track in thread group for group-wide TLB shootdown
-    if (proc.thread_group) |tg| {
-        tg.lock.lock();
-        tg.cores_ran_on |= core_bit;
-        tg.lock.unlock();
-    }
+    trace.point(.sched_switch, proc.pid, @intFromEnum(proc.pending_op), 0);
+    // Track which cores have run this process (cache affinity)
+    proc.cores_ran_on |= @as(u128, 1) << @intCast(core_id);
 
     // Set up kernel stack for this process
     syscall_entry.setKernelStack(proc.kernel_stack_top);
@@ -904,25 +1215,24 @@ fn switchTo(proc: *Process) noreturn {
 
     // Switch address space
     if (proc.pml4) |pml4| {
-        paging.switchAddressSpace(pml4);
+        tlb.switchTo(pml4);
     }
 
     // Restore FS_BASE MSR for TLS (used by musl libc errno, etc.)
     if (@import("builtin").cpu.arch == .x86_64 and proc.fs_base != 0) {
         cpu.wrmsr(0xC0000100, proc.fs_base);
     }
+    loadFpu(proc);
 
     // Sleep delivery — check if the sleep timer has elapsed
     if (proc.pending_op == .sleep) {
-        const timer = @import("timer.zig");
-        const now = timer.getTicks();
-        const elapsed = (now -% proc.sleep_until) < 0x8000_0000;
-        if (elapsed) {
+        if (timer.now() >= proc.sleep_until) {
             proc.syscall_ret = 0;
             proc.pending_op = .none;
             proc.sleep_until = 0;
         } else {
-            // Not yet — re-block
+            // Not yet — re-block until the timer fires
+            timer.arm(&proc.wake_timer, proc.sleep_until);
             proc.state = .blocked;
             setCurrentInternal(null);
             scheduleNext();
@@ -1069,7 +1379,7 @@ fn switchTo(proc: *Process) noreturn {
         if (pipe_mod.hasDataOrEof(fd_entry.pipe_id)) {
             if (proc.ipc_recv_buf_ptr != 0 and proc.ipc_recv_buf_ptr < 0x0000_8000_0000_0000) {
                 const dest: [*]u8 = @ptrFromInt(proc.ipc_recv_buf_ptr);
-                const buf_size = @min(proc.syscall_ret, 4096);
+                const buf_size = @min(proc.syscall_ret, pipe_mod.MAX_TRANSFER);
                 if (pipe_mod.pipeRead(fd_entry.pipe_id, dest[0..buf_size])) |n| {
                     proc.syscall_ret = n;
                 } else {
@@ -1080,7 +1390,7 @@ fn switchTo(proc: *Process) noreturn {
             }
         } else {
             // Still no data — re-block
-            pipe_mod.setReadWaiter(fd_entry.pipe_id, @intCast(proc.pid));
+            pipe_mod.setReadWaiter(fd_entry.pipe_id, proc);
             proc.state = .blocked;
             setCurrentInternal(null);
             scheduleNext();
@@ -1090,6 +1400,16 @@ fn switchTo(proc: *Process) noreturn {
         proc.pending_fd = 0;
     }
 
+    // Splice wakeup — the pipe or peer is ready; the caller retries
+    if (proc.pending_op == .splice) {
+        proc.syscall_ret = EAGAIN;
+        if (proc.sleep_until != 0) {
+            proc.sleep_until = 0;
+            timer.cancel(&proc.wake_timer);
+        }
+        proc.pending_op = .none;
+    }
+
     // Pipe write delivery — address space is active, retry the write
     if (proc.pending_op == .pipe_write) {
         const pipe_mod = @import("pipe.zig");
@@ -1111,7 +1431,7 @@ fn switchTo(proc: *Process) noreturn {
         if (pipe_mod.hasSpaceOrBroken(fd_entry.pipe_id)) {
             if (proc.ipc_recv_buf_ptr != 0 and proc.ipc_recv_buf_ptr < 0x0000_8000_0000_0000) {
                 const src: [*]const u8 = @ptrFromInt(proc.ipc_recv_buf_ptr);
-                const n = @min(proc.syscall_ret, 4096);
+                const n = @min(proc.syscall_ret, pipe_mod.MAX_TRANSFER);
                 if (pipe_mod.pipeWrite(fd_entry.pipe_id, src[0..n])) |bytes| {
                     proc.syscall_ret = bytes;
                 } else {
@@ -1122,7 +1442,7 @@ fn switchTo(proc: *Process) noreturn {
             }
         } else {
             // Still full — re-block
-            pipe_mod.setWriteWaiter(fd_entry.pipe_id, @intCast(proc.pid));
+            pipe_mod.setWriteWaiter(fd_entry.pipe_id, proc);
             proc.state = .blocked;
             setCurrentInternal(null);
             scheduleNext();
@@ -1153,8 +1473,8 @@ fn switchTo(proc: *Process) noreturn {
         if (ether_mod.hasData(fd_entry.ether_client)) {
             if (proc.ipc_recv_buf_ptr != 0 and proc.ipc_recv_buf_ptr < 0x0000_8000_0000_0000) {
                 const dest: [*]u8 = @ptrFromInt(proc.ipc_recv_buf_ptr);
-                const buf_size: u16 = @intCast(@min(proc.syscall_ret, ether_mod.MAX_FRAME));
-                proc.syscall_ret = ether_mod.readFrame(fd_entry.ether_client, dest[0..buf_size]);
+                const buf_size: usize = @intCast(@min(proc.syscall_ret, ether_mod.maxRead(fd_entry.ether_client)));
+                proc.syscall_ret = ether_mod.read(fd_entry.ether_client, dest[0..buf_size]);
             } else {
                 proc.syscall_ret = 0;
             }
@@ -1170,6 +1490,51 @@ fn switchTo(proc: *Process) noreturn {
         proc.pending_fd = 0;
     }
 
+    // Block I/O delivery — address space is active, copy completed reads
+    // and submit the next round of the batch (or re-block until the IRQ)
+    if (proc.pending_op == .blk_read or proc.pending_op == .blk_write) {
+        const virtio_blk = @import("virtio_blk.zig");
+        if (virtio_blk.resumeBatch(proc)) |ret| {
+            proc.syscall_ret = ret;
+        } else {
+            setCurrentInternal(null);
+            scheduleNext();
+        }
+        proc.pending_op = .none;
+    }
+
+    // Submission ring — reap what completed and carry on with the batch
+    if (proc.pending_op == .ring_enter) {
+        if (ring.resumeEnter(proc)) |ret| {
+            proc.syscall_ret = ret;
+        } else {
+            setCurrentInternal(null);
+            scheduleNext();
+        }
+        proc.pending_op = .none;
+    }
+
+    // Tagged reply collection — retry now that a request has completed
+    if (proc.pending_op == .ipc_collect) {
+        // Blocked first, as in sysIpcCollect, so a concurrent completion
+        // can't be lost between the check and re-blocking
+        proc.state = .blocked;
+        switch (collectTagged(proc)) {
+            .delivered => proc.state = .running,
+            .none_outstanding => {
+                proc.state = .running;
+                proc.syscall_ret = @bitCast(@as(i64, -22)); // EINVAL
+            },
+            .wait => {
+                setCurrentInternal(null);
+                scheduleNext();
+            },
+        }
+        proc.ipc_recv_buf_ptr = 0;
+        proc.ipc_collect_cookie_ptr = 0;
+        proc.pending_op = .none;
+    }
+
     // If there's a pending IPC message to deliver, do it now
     // (address space is loaded, so user pointers are valid)
     if (proc.ipc_pending_msg) |msg| {
@@ -1210,9 +1575,30 @@ fn deliverRawData(msg: *const ipc.Message, user_buf_ptr: u64) void {
     @memcpy(dest[0..msg.data_len], msg.data_buf[0..msg.data_len]);
 }
 
+pub const CollectResult = enum { delivered, wait, none_outstanding };
+
+/// Deliver the oldest completed tagged reply to the buffers recorded in
+/// ipc_recv_buf_ptr / ipc_collect_cookie_ptr (proc's address space must be
+/// active). `.wait`: nothing has completed yet and proc must block; the
+/// DoneQueue wakes it on the next completion.
+pub fn collectTagged(proc: *Process) CollectResult {
+    var must_wait = false;
+    const tr = proc.ipc_done.pop(&must_wait) orelse
+        return if (must_wait) .wait else .none_outstanding;
+    deliverIpcMessage(&tr.msg, proc.ipc_recv_buf_ptr);
+    const cookie_ptr = proc.ipc_collect_cookie_ptr;
+    if (cookie_ptr != 0 and cookie_ptr < 0x0000_8000_0000_0000) {
+        const dest: *align(1) u64 = @ptrFromInt(cookie_ptr);
+        dest.* = tr.cookie;
+    }
+    ipc.freeTagged(tr);
+    proc.syscall_ret = 0;
+    return .delivered;
+}
+
 /// Copy an IPC message to a user-space IpcMessage struct.
 /// Layout: tag(u32) + data_len(u32) + data([4096]u8) = 4104 bytes.
-fn deliverIpcMessage(msg: *const ipc.Message, user_buf_ptr: u64) void {
+pub fn deliverIpcMessage(msg: *const ipc.Message, user_buf_ptr: u64) void {
     // Validate user pointer
     if (user_buf_ptr == 0 or user_buf_ptr >= 0x0000_8000_0000_0000) return;
 
@@ -1238,19 +1624,25 @@ pub fn allocPageForProcess(proc: *Process) ?u64 {
 /// Free the user address space (page tables and user pages).
 /// Safe to call even if pml4 is null.
 pub fn freeUserMemory(proc: *Process) void {
+    // A process torn down while blocked in futex wait must leave its bucket
+    // before the slot can be reused. Likewise its timer.
+    @import("futex.zig").cancel(proc);
+    timer.cancel(&proc.wake_timer);
+    // A blk pread/pwrite cut short still holds DMA pages
+    @import("virtio_blk.zig").releaseBatch(proc);
+    proc.ns.release();
     if (proc.thread_group) |tg| {
         // Thread: release group reference. Last thread frees the address space.
-        _ = thread_group.releaseGroup(tg, proc);
+        _ = thread_group.releaseGroup(tg);
         proc.thread_group = null;
         proc.pml4 = null;
         proc.pages_used = 0;
         proc.cores_ran_on = 0;
     } else if (proc.pml4) |pml4| {
-        // Non-threaded process: free address space directly
-        tlbShootdown(proc);
-        // Switch to kernel page tables before freeing, so CR3 doesn't
-        // point to the page tables we're about to free.
-        paging.switchToKernel();
+        // Non-threaded process: free address space directly. Retiring
+        // it also moves off it, so CR3 doesn't point to the page tables
+        // we're about to free.
+        tlb.retire(pml4);
         paging.freeAddressSpace(pml4);
         proc.pml4 = null;
         proc.pages_used = 0;
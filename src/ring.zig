@@ -0,0 +1,595 @@
+/// Submission/completion rings: batches of syscalls for one trap.
+///
+/// ring_setup maps a ring into the caller: an array of submission entries
+/// (SQEs) it fills in, and twice as many completion entries (CQEs) the
+/// kernel fills in. ring_enter consumes the queued SQEs and optionally
+/// waits for completions, so a burst of small operations — stat on every
+/// directory entry, open/read/close per header — costs one entry/exit
+/// instead of one per call.
+///
+/// Operations on server-backed fds (and raw IPC requests) are posted as
+/// tagged requests (ipc.zig), so a batch to a file server is pipelined
+/// rather than a round trip per call; kernel-backed (initrd) files complete
+/// inline. Anything else — console, pipes, net, /dev, /proc, blk — would
+/// block or needs the synchronous path, and completes with ENOSYS so the
+/// caller can fall back to the plain syscall.
+///
+/// Replies are reaped into the CQ only while the owner is current — in
+/// ring_enter, or in switchTo when it resumes from a blocking ring_enter —
+/// so fd bookkeeping and copies into user buffers run in its address space.
+///
+/// SQE_LINK orders a chain: the next SQE is not started until this one has
+/// completed. FD_LINKED names the fd opened by the latest open in the chain,
+/// which is how open → stat → close goes in a single batch. A link that
+/// fails, or a read/write that comes back short, breaks the chain: the rest
+/// of it completes with ECANCELED without being started. A close still runs,
+/// so a broken chain doesn't leak the fd it opened.
+///
+/// Layout at the ring base, shared with lib/ring.zig:
+///   [Header: 64 bytes][entries × Sqe][2·entries × Cqe]
+/// The owner writes SQEs, sq_tail and cq_head; the kernel writes sq_head,
+/// CQEs and cq_tail. The kernel keeps its own head/tail copies and never
+/// trusts the header's.
+const std = @import("std");
+const process = @import("process.zig");
+const ipc = @import("ipc.zig");
+const mem = @import("mem.zig");
+const pmm = @import("pmm.zig");
+const syscall = @import("syscall.zig");
+
+const paging = switch (@import("builtin").cpu.arch) {
+    .x86_64 => @import("arch/x86_64/paging.zig"),
+    .riscv64 => @import("arch/riscv64/paging.zig"),
+    else => struct {
+        pub const Flags = struct {
+            pub const WRITABLE: u64 = 0;
+            pub const USER: u64 = 0;
+        };
+        pub fn physPtr(_: u64) [*]u8 {
+            return @ptrFromInt(0);
+        }
+        pub fn mapPage(_: anytype, _: u64, _: u64, _: u64) ?void {
+            return null;
+        }
+    },
+};
+
+const ENOSYS: u64 = @bitCast(@as(i64, -1));
+const ENOENT: u64 = @bitCast(@as(i64, -2));
+const EIO: u64 = @bitCast(@as(i64, -5));
+const EBADF: u64 = @bitCast(@as(i64, -9));
+const ENOMEM: u64 = @bitCast(@as(i64, -12));
+const EFAULT: u64 = @bitCast(@as(i64, -14));
+const EBUSY: u64 = @bitCast(@as(i64, -16));
+const EINVAL: u64 = @bitCast(@as(i64, -22));
+const EMFILE: u64 = @bitCast(@as(i64, -24));
+const ECANCELED: u64 = @bitCast(@as(i64, -125));
+
+const USER_END: u64 = 0x0000_8000_0000_0000;
+
+/// Largest SQ (power of two); the CQ is twice this.
+pub const MAX_ENTRIES = 64;
+
+pub const Op = enum(u8) { nop, open, read, pread, write, pwrite, stat, close, ipc };
+
+/// Don't start the next SQE until this one completes.
+pub const SQE_LINK: u8 = 1;
+
+/// Sqe.fd value: the fd from the latest open in this chain.
+pub const FD_LINKED: i32 = -1;
+
+pub const Header = extern struct {
+    sq_head: u32,
+    sq_tail: u32,
+    sq_entries: u32,
+    cq_head: u32,
+    cq_tail: u32,
+    cq_entries: u32,
+    /// Byte offsets of the SQE and CQE arrays from the ring base.
+    sqe_off: u32,
+    cqe_off: u32,
+    /// Completions lost because the owner let the CQ fill up.
+    cq_overflow: u32,
+    _reserved: [7]u32,
+};
+
+/// One queued operation. `addr`/`len` are the path (open), buffer
+/// (read/write), Stat (stat) or IpcMessage (ipc, replaced by the reply);
+/// `off` is the pread/pwrite offset.
+pub const Sqe = extern struct {
+    op: u8,
+    flags: u8,
+    _pad: u16,
+    fd: i32,
+    off: u64,
+    addr: u64,
+    len: u32,
+    _pad2: u32,
+    user_data: u64,
+};
+
+/// `res` is what the matching syscall would have returned.
+pub const Cqe = extern struct {
+    user_data: u64,
+    res: i64,
+};
+
+comptime {
+    std.debug.assert(@sizeOf(Header) == 64);
+    std.debug.assert(@sizeOf(Sqe) == 40);
+    std.debug.assert(@sizeOf(Cqe) == 16);
+}
+
+fn sqeOffset() u32 {
+    return @sizeOf(Header);
+}
+
+fn cqeOffset(entries: u32) u32 {
+    return sqeOffset() + entries * @sizeOf(Sqe);
+}
+
+fn ringPages(entries: u32) u64 {
+    const size: u64 = cqeOffset(entries) + 2 * entries * @sizeOf(Cqe);
+    return (size + mem.PAGE_SIZE - 1) / mem.PAGE_SIZE;
+}
+
+/// Per-process ring state (Process.ring).
+pub const State = struct {
+    /// User VA of the ring (0 = none) and its SQ size.
+    base: u64 = 0,
+    entries: u32 = 0,
+    /// Kernel copies of the indices it owns.
+    sq_head: u32 = 0,
+    cq_tail: u32 = 0,
+    /// Replies to posted operations, waiting to be reaped.
+    done: ipc.DoneQueue = .{},
+    /// Bumped on release so replies meant for an old ring are dropped.
+    gen: u32 = 0,
+    /// Current ring_enter: SQEs left to consume, SQEs consumed, CQEs
+    /// posted, and completions the caller is waiting for.
+    to_submit: u32 = 0,
+    submitted: u32 = 0,
+    completed: u32 = 0,
+    min_complete: u32 = 0,
+    /// A linked SQE is in flight; the next one waits for it.
+    link_wait: bool = false,
+    /// fd from the latest open in the current chain (FD_LINKED), -1 = none.
+    link_fd: i32 = -1,
+    /// A link in the current chain failed; the rest completes with ECANCELED.
+    link_broken: bool = false,
+
+    /// Drop the ring (exec, exit, slot reuse). The pages go with the
+    /// address space; replies still in flight are freed when they land.
+    pub fn release(self: *State) void {
+        self.done.release();
+        self.* = .{ .gen = self.gen +% 1 };
+    }
+};
+
+fn header(st: *const State) *Header {
+    return @ptrFromInt(st.base);
+}
+
+fn sqes(st: *const State) [*]const Sqe {
+    return @ptrFromInt(st.base + sqeOffset());
+}
+
+fn cqes(st: *const State) [*]Cqe {
+    return @ptrFromInt(st.base + cqeOffset(st.entries));
+}
+
+/// CQEs the owner has not consumed yet (CQ size if cq_head is bogus).
+fn cqUsed(st: *const State) u32 {
+    const used = st.cq_tail -% @atomicLoad(u32, &header(st).cq_head, .acquire);
+    return @min(used, 2 * st.entries);
+}
+
+fn isErr(res: u64) bool {
+    return @as(i64, @bitCast(res)) < 0;
+}
+
+// ── Syscalls ─────────────────────────────────────────────────────────
+
+/// ring_setup(entries): map a ring with `entries` SQEs (a power of two up
+/// to MAX_ENTRIES) into the caller. Returns its base address. One ring per
+/// process; threads each have their own.
+pub fn setup(proc: *process.Process, entries: u64) u64 {
+    if (proc.ring.base != 0) return EBUSY;
+    if (entries == 0 or entries > MAX_ENTRIES or entries & (entries - 1) != 0) return EINVAL;
+    const n: u32 = @intCast(entries);
+
+    // Placed like an anonymous mmap (see sysMmap)
+    const pml4 = (if (proc.thread_group) |tg| tg.pml4 else proc.pml4) orelse return ENOMEM;
+    if (proc.thread_group) |tg| tg.lock.lock();
+    defer if (proc.thread_group) |tg| tg.lock.unlock();
+    const base = if (proc.thread_group) |tg| tg.mmap_next else proc.mmap_next;
+
+    const pages = ringPages(n);
+    var i: u64 = 0;
+    while (i < pages) : (i += 1) {
+        const page = pmm.allocPage() orelse break;
+        const ptr: [*]u8 = paging.physPtr(page);
+        @memset(ptr[0..mem.PAGE_SIZE], 0);
+        paging.mapPage(pml4, base + i * mem.PAGE_SIZE, page, paging.Flags.WRITABLE | paging.Flags.USER) orelse {
+            pmm.freePage(page);
+            break;
+        };
+        proc.pages_used += 1;
+    }
+    if (i < pages) {
+        // Out of memory: take back the pages mapped so far
+        process.unmapUserPages(proc, base, i);
+        return ENOMEM;
+    }
+    const new_next = base + pages * mem.PAGE_SIZE;
+    if (proc.thread_group) |tg| {
+        tg.mmap_next = new_next;
+    } else {
+        proc.mmap_next = new_next;
+    }
+
+    const st = &proc.ring;
+    st.base = base;
+    st.entries = n;
+    st.sq_head = 0;
+    st.cq_tail = 0;
+    st.link_wait = false;
+    st.link_fd = -1;
+    const hdr = header(st);
+    hdr.sq_entries = n;
+    hdr.cq_entries = 2 * n;
+    hdr.sqe_off = sqeOffset();
+    hdr.cqe_off = cqeOffset(n);
+    return base;
+}
+
+/// ring_enter(to_submit, min_complete): consume up to `to_submit` queued
+/// SQEs and wait until at least `min_complete` CQEs have been posted by
+/// this call (fewer if nothing is left in flight). Returns the number of
+/// SQEs consumed, or EFAULT if the ring is no longer mapped.
+pub fn enter(proc: *process.Process, to_submit: u64, min_complete: u64) u64 {
+    const st = &proc.ring;
+    if (st.base == 0) return EINVAL;
+    st.to_submit = @intCast(@min(to_submit, st.entries));
+    st.min_complete = @intCast(@min(min_complete, 2 * st.entries));
+    st.submitted = 0;
+    st.completed = 0;
+
+    proc.pending_op = .ring_enter;
+    if (resumeEnter(proc)) |ret| {
+        proc.pending_op = .none;
+        return ret;
+    }
+    process.scheduleNext();
+}
+
+/// Reap completed replies and consume SQEs until neither makes progress.
+/// Returns ring_enter's result, or null with proc blocked when it must
+/// wait for more completions (switchTo calls this again on resume; proc's
+/// address space must be active).
+pub fn resumeEnter(proc: *process.Process) ?u64 {
+    const st = &proc.ring;
+    // The owner may have unmapped the ring since setup or while blocked
+    if (!process.userWritable(proc, st.base, ringPages(st.entries) * mem.PAGE_SIZE)) return EFAULT;
+    while (true) {
+        var progress = false;
+        while (st.done.tryPop()) |tr| {
+            reap(proc, tr);
+            progress = true;
+        }
+        if (submit(proc)) progress = true;
+        if (progress) continue;
+
+        if (st.completed >= st.min_complete or st.done.inflight == 0) break;
+
+        // Blocked before the final check, as in sysIpcCollect, so a reply
+        // on another core that finds us waiting can't be lost
+        proc.state = .blocked;
+        var must_wait = false;
+        if (st.done.pop(&must_wait)) |tr| {
+            proc.state = .running;
+            reap(proc, tr);
+            continue;
+        }
+        if (must_wait) return null;
+        proc.state = .running;
+        break;
+    }
+    return st.submitted;
+}
+
+// ── Submission ───────────────────────────────────────────────────────
+
+/// Consume queued SQEs. Stops at the caller's count, a linked SQE still in
+/// flight, MAX_TAGGED posted requests, or when the CQ could not take one
+/// more completion. Returns whether anything was consumed.
+fn submit(proc: *process.Process) bool {
+    const st = &proc.ring;
+    const hdr = header(st);
+    var consumed = false;
+    while (st.to_submit > 0 and !st.link_wait) {
+        const queued = @atomicLoad(u32, &hdr.sq_tail, .acquire) -% st.sq_head;
+        if (queued == 0 or queued > st.entries) break;
+        if (cqUsed(st) + st.done.inflight >= 2 * st.entries) break;
+        if (st.done.inflight >= ipc.MAX_TAGGED) break;
+
+        // Copied: the owner may reuse the slot as soon as sq_head moves
+        const sqe = sqes(st)[st.sq_head & (st.entries - 1)];
+        st.sq_head +%= 1;
+        @atomicStore(u32, &hdr.sq_head, st.sq_head, .release);
+        st.to_submit -= 1;
+        st.submitted += 1;
+        consumed = true;
+
+        const linked = sqe.flags & SQE_LINK != 0;
+        if (st.link_broken and sqe.op != @intFromEnum(Op.close)) {
+            // An earlier link failed: cancel without starting
+            complete(proc, sqe.op, 0, 0, sqe.user_data, ECANCELED);
+        } else if (start(proc, &sqe)) |res| {
+            complete(proc, sqe.op, sqe.flags, sqe.len, sqe.user_data, res);
+        } else if (linked) {
+            st.link_wait = true;
+        }
+        // Chain ends here
+        if (!linked) {
+            st.link_fd = -1;
+            st.link_broken = false;
+        }
+    }
+    return consumed;
+}
+
+/// Start one operation. Returns its result if it completed inline, or
+/// null once it has been posted to a server.
+fn start(proc: *process.Process, sqe: *const Sqe) ?u64 {
+    const op = std.meta.intToEnum(Op, sqe.op) catch return EINVAL;
+    if (op == .nop) return 0;
+    if (sqe.addr >= USER_END or sqe.len > USER_END - sqe.addr) return EFAULT;
+    if (op == .open) return startOpen(proc, sqe);
+
+    const fd: u32 = if (sqe.fd == FD_LINKED)
+        (if (proc.ring.link_fd >= 0) @intCast(proc.ring.link_fd) else return EBADF)
+    else if (sqe.fd < 0)
+        return EBADF
+    else
+        @intCast(sqe.fd);
+    // Default console fds go through the syscall
+    const entry = proc.getFdEntryPtr(fd) orelse return if (fd <= 2) ENOSYS else EBADF;
+    if (entry.fd_type != .ipc) return ENOSYS;
+    const chan = ipc.getChannel(entry.channel_id) orelse return EBADF;
+    if ((op == .read or op == .write or op == .stat or op == .ipc) and sqe.addr == 0) return EFAULT;
+    // Results are written back when the reply is reaped
+    const out_len: u64 = switch (op) {
+        .read, .pread => sqe.len,
+        .stat => 64,
+        .ipc => 8 + ipc.MAX_MSG_DATA,
+        else => 0,
+    };
+    if (!process.userWritable(proc, sqe.addr, out_len)) return EFAULT;
+
+    if (op == .ipc) {
+        if (chan.kernel_data != null) return EINVAL;
+        const tag_ptr: *align(1) const u32 = @ptrFromInt(sqe.addr);
+        const len_ptr: *align(1) const u32 = @ptrFromInt(sqe.addr + 4);
+        const data_ptr: [*]const u8 = @ptrFromInt(sqe.addr + 8);
+        const tag = std.meta.intToEnum(ipc.Tag, tag_ptr.*) catch return EINVAL;
+        const len = len_ptr.*;
+        if (len > ipc.MAX_MSG_DATA) return EINVAL;
+        const tr = newRequest(proc, sqe, fd, tag) orelse return ENOMEM;
+        tr.msg.data_len = len;
+        @memcpy(tr.msg.data_buf[0..len], data_ptr[0..len]);
+        return post(proc, chan, tr);
+    }
+
+    // Kernel-backed channel (initrd): served here, as by sysRead/sysStat
+    if (chan.kernel_data) |data| {
+        switch (op) {
+            .read, .pread => {
+                const offset: usize = if (op == .read) entry.read_offset else @intCast(@min(sqe.off, data.len));
+                if (offset >= data.len) return 0;
+                const n = @min(sqe.len, data.len - offset, 4096);
+                const dest: [*]u8 = @ptrFromInt(sqe.addr);
+                @memcpy(dest[0..n], data[offset..][0..n]);
+                if (op == .read) entry.read_offset += @intCast(n);
+                return n;
+            },
+            .stat => {
+                const stat_ptr: *align(1) [64]u8 = @ptrFromInt(sqe.addr);
+                @memset(stat_ptr, 0);
+                std.mem.writeInt(u32, stat_ptr[0..4], @intCast(data.len), .little);
+                return 0;
+            },
+            .close => {
+                proc.closeFd(fd);
+                return 0;
+            },
+            else => return ENOSYS,
+        }
+    }
+
+    // Raw channel reads/writes keep their synchronous semantics
+    if (entry.server_handle == 0) return ENOSYS;
+
+    switch (op) {
+        .read, .pread => {
+            // Inline replies only: a longer read comes back short
+            const count: u32 = @min(sqe.len, ipc.MAX_MSG_DATA);
+            const offset: u32 = if (op == .read) entry.read_offset else std.math.cast(u32, sqe.off) orelse return EINVAL;
+            const tr = newRequest(proc, sqe, fd, .t_read) orelse return ENOMEM;
+            std.mem.writeInt(u32, tr.msg.data_buf[0..4], entry.server_handle, .little);
+            std.mem.writeInt(u32, tr.msg.data_buf[4..8], offset, .little);
+            std.mem.writeInt(u32, tr.msg.data_buf[8..12], count, .little);
+            tr.msg.data_len = 12;
+            tr.ring.len = count;
+            tr.ring.off = offset;
+            // Claim the range now so reads later in the batch follow on;
+            // reap gives back what a short read didn't use
+            if (op == .read) entry.read_offset += count;
+            return post(proc, chan, tr);
+        },
+        .write => {
+            const count: u32 = @min(sqe.len, ipc.MAX_MSG_DATA - 4);
+            const src: [*]const u8 = @ptrFromInt(sqe.addr);
+            const tr = newRequest(proc, sqe, fd, .t_write) orelse return ENOMEM;
+            std.mem.writeInt(u32, tr.msg.data_buf[0..4], entry.server_handle, .little);
+            @memcpy(tr.msg.data_buf[4..][0..count], src[0..count]);
+            tr.msg.data_len = 4 + count;
+            tr.ring.len = count;
+            return post(proc, chan, tr);
+        },
+        .stat, .close => {
+            const tr = newRequest(proc, sqe, fd, if (op == .stat) .t_stat else .t_close) orelse return ENOMEM;
+            std.mem.writeInt(u32, tr.msg.data_buf[0..4], entry.server_handle, .little);
+            tr.msg.data_len = 4;
+            return post(proc, chan, tr);
+        },
+        // T_WRITE has no offset: the server writes at the handle's position
+        else => return ENOSYS,
+    }
+}
+
+/// open: as sysOpen for namespace paths. Kernel-intercepted prefixes are
+/// left to the syscall.
+fn startOpen(proc: *process.Process, sqe: *const Sqe) ?u64 {
+    if (sqe.addr == 0) return EFAULT;
+    if (sqe.len == 0 or sqe.len > 256) return ENOENT;
+    const path_ptr: [*]const u8 = @ptrFromInt(sqe.addr);
+    const path = path_ptr[0..sqe.len];
+    if (std.mem.startsWith(u8, path, "/dev/") or std.mem.startsWith(u8, path, "/proc") or
+        std.mem.startsWith(u8, path, "/net/")) return ENOSYS;
+
+    const resolved = proc.getNs().resolve(path) orelse return ENOENT;
+    const chan = ipc.getChannel(resolved.channel_id) orelse return ENOENT;
+    const fd = proc.allocFd(resolved.channel_id, false) orelse return EMFILE;
+    if (chan.kernel_data != null) return fd;
+
+    const tr = newRequest(proc, sqe, fd, .t_open) orelse {
+        proc.closeFd(fd);
+        return ENOMEM;
+    };
+    const suffix = resolved.suffix;
+    @memcpy(tr.msg.data_buf[0..suffix.len], suffix);
+    tr.msg.data_len = @intCast(suffix.len);
+    return post(proc, chan, tr);
+}
+
+fn newRequest(proc: *process.Process, sqe: *const Sqe, fd: u32, tag: ipc.Tag) ?*ipc.TaggedRequest {
+    const tr = ipc.allocTagged(proc.pid, sqe.user_data) orelse return null;
+    tr.msg = ipc.Message.init(tag);
+    tr.ring = .{
+        .op = sqe.op,
+        .flags = sqe.flags,
+        .fd = fd,
+        .gen = proc.ring.gen,
+        .addr = sqe.addr,
+        .len = sqe.len,
+    };
+    return tr;
+}
+
+/// Hand a request to the channel's server. Null once posted; otherwise
+/// the request is freed (and an open's fd closed) and the result is EIO if
+/// the channel is closed, or EBUSY if MAX_TAGGED are already in flight.
+fn post(proc: *process.Process, chan: *ipc.Channel, tr: *ipc.TaggedRequest) ?u64 {
+    const done = &proc.ring.done;
+    const res = if (!done.reserve()) EBUSY else blk: {
+        if (syscall.postTagged(chan, tr)) return null;
+        done.unreserve();
+        break :blk EIO;
+    };
+    if (tr.ring.op == @intFromEnum(Op.open)) proc.closeFd(tr.ring.fd);
+    ipc.freeTagged(tr);
+    return res;
+}
+
+// ── Completion ───────────────────────────────────────────────────────
+
+/// Turn a server's reply into the operation's result, as completeRequest
+/// does for the synchronous calls, and post its CQE.
+fn reap(proc: *process.Process, tr: *ipc.TaggedRequest) void {
+    const r = tr.ring;
+    const ok = tr.msg.tag == .r_ok;
+    const reply = tr.msg.data_buf[0..tr.msg.data_len];
+    const op: Op = @enumFromInt(r.op);
+
+    const res: u64 = switch (op) {
+        .open => blk: {
+            if (ok and reply.len >= 4) {
+                if (proc.getFdEntryPtr(r.fd)) |entry| {
+                    entry.server_handle = std.mem.readInt(u32, reply[0..4], .little);
+                }
+                break :blk r.fd;
+            }
+            proc.closeFd(r.fd);
+            break :blk ENOENT;
+        },
+        .read, .pread => blk: {
+            // The buffer was checked at submission, but may be gone by now
+            var n: u32 = if (ok) @intCast(@min(reply.len, r.len)) else 0;
+            const fault = n > 0 and !process.userWritable(proc, r.addr, n);
+            if (fault) n = 0;
+            if (n > 0) {
+                const dest: [*]u8 = @ptrFromInt(r.addr);
+                @memcpy(dest[0..n], reply[0..n]);
+            }
+            if (op == .read and n < r.len) {
+                if (proc.getFdEntryPtr(r.fd)) |entry| {
+                    entry.read_offset = @min(entry.read_offset, r.off + n);
+                }
+            }
+            break :blk if (fault) EFAULT else if (ok) n else EIO;
+        },
+        .write => if (!ok) EIO else if (reply.len >= 4) std.mem.readInt(u32, reply[0..4], .little) else r.len,
+        .stat => blk: {
+            if (!ok) break :blk EIO;
+            const n = @min(reply.len, 64);
+            if (!process.userWritable(proc, r.addr, n)) break :blk EFAULT;
+            const dest: [*]u8 = @ptrFromInt(r.addr);
+            @memcpy(dest[0..n], reply[0..n]);
+            break :blk 0;
+        },
+        .close => blk: {
+            proc.closeFd(r.fd);
+            break :blk 0;
+        },
+        .ipc => blk: {
+            if (!process.userWritable(proc, r.addr, 8 + ipc.MAX_MSG_DATA)) break :blk EFAULT;
+            process.deliverIpcMessage(&tr.msg, r.addr);
+            break :blk 0;
+        },
+        .nop, .pwrite => EINVAL,
+    };
+    const user_data = tr.cookie;
+    ipc.freeTagged(tr);
+    complete(proc, r.op, r.flags, r.len, user_data, res);
+}
+
+/// A failed entry, or a read/write that moved fewer than `len` bytes.
+/// Mirrored by lib/ring.zig breaksChain.
+fn breaksChain(op: u8, len: u32, res: u64) bool {
+    if (isErr(res)) return true;
+    const short = res < len;
+    return short and (op == @intFromEnum(Op.read) or op == @intFromEnum(Op.pread) or
+        op == @intFromEnum(Op.write) or op == @intFromEnum(Op.pwrite));
+}
+
+/// Post a CQE and, for a linked SQE, let the chain continue — or mark it
+/// broken if this one failed or moved fewer than `len` bytes.
+fn complete(proc: *process.Process, op: u8, flags: u8, len: u32, user_data: u64, res: u64) void {
+    const st = &proc.ring;
+    if (flags & SQE_LINK != 0) {
+        st.link_wait = false;
+        if (op == @intFromEnum(Op.open)) st.link_fd = if (isErr(res)) -1 else @intCast(res);
+        if (breaksChain(op, len, res)) st.link_broken = true;
+    }
+    st.completed += 1;
+
+    const hdr = header(st);
+    if (cqUsed(st) >= 2 * st.entries) {
+        hdr.cq_overflow +%= 1;
+        return;
+    }
+    cqes(st)[st.cq_tail & (2 * st.entries - 1)] = .{ .user_data = user_data, .res = @bitCast(res) };
+    st.cq_tail +%= 1;
+    @atomicStore(u32, &hdr.cq_tail, st.cq_tail, .release);
+}
@@ -0,0 +1,288 @@
+/// Slab allocator: fixed-size object caches backed by PMM pages.
+///
+/// A Cache carves buddy blocks ("slabs", 1..MAX_SLAB_PAGES pages, a power
+/// of two so the block is naturally aligned) into equal objects. The Slab
+/// header sits at the start of the block, so free() finds it by masking the
+/// object address. Slabs with free objects are kept on a doubly linked
+/// partial list; fully empty slabs beyond KEEP_EMPTY go back to the PMM.
+///
+/// Each core has a small magazine of objects in front of every cache, so
+/// the common alloc/free touches no lock. Magazines refill from / drain to
+/// the slabs MAG_BATCH objects at a time under the cache lock.
+///
+/// Slab memory is addressed through the higher-half map (mem.physToVirt),
+/// so caches must only be used after paging init.
+///
+/// Lock ordering: cache.lock → registry_lock, cache.lock → pmm_lock.
+const mem = @import("mem.zig");
+const pmm = @import("pmm.zig");
+const percpu = @import("percpu.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
+
+const page_size = 4096;
+
+/// Largest slab: 16 pages (64 KB). Objects bigger than that don't belong here.
+const MAX_SLAB_PAGES = 16;
+/// Per-core magazine capacity and refill/drain batch.
+const MAG_SIZE = 8;
+const MAG_BATCH = MAG_SIZE / 2;
+/// Empty slabs a cache keeps before returning pages to the PMM.
+const KEEP_EMPTY = 1;
+
+const FreeObj = struct {
+    next: ?*FreeObj,
+};
+
+const Slab = struct {
+    cache: *Cache,
+    next: ?*Slab,
+    prev: ?*Slab,
+    free_list: ?*FreeObj,
+    inuse: u32,
+    on_partial: bool,
+    phys: u64,
+};
+
+const Magazine = struct {
+    objs: [MAG_SIZE]usize = [_]usize{0} ** MAG_SIZE,
+    count: u32 = 0,
+    allocs: u64 = 0,
+    frees: u64 = 0,
+};
+
+/// Usage snapshot for /proc/slabinfo.
+pub const Stats = struct {
+    name: []const u8,
+    obj_size: usize,
+    /// Objects handed out and not yet freed.
+    active: u64,
+    /// Object capacity of all slabs.
+    total: u64,
+    slabs: u64,
+    pages: u64,
+};
+
+pub const Cache = struct {
+    name: []const u8,
+    obj_size: usize,
+    /// Offset of the first object from the slab base (header rounded up).
+    obj_offset: usize,
+    slab_pages: usize,
+    objs_per_slab: u32,
+
+    /// Guards the slab lists and counters below.
+    lock: SpinLock = .{},
+    partial: ?*Slab = null,
+    slabs: u32 = 0,
+    empty_slabs: u32 = 0,
+
+    registered: bool = false,
+    next_cache: ?*Cache = null,
+
+    /// Per-core magazines. Only the owning core touches its entry.
+    cpu: [percpu.MAX_CORES]Magazine = [_]Magazine{.{}} ** percpu.MAX_CORES,
+
+    /// Describe a cache of `size`-byte objects. Slab geometry is fixed at
+    /// compile time: the smallest power-of-two slab that wastes at most
+    /// 1/8 of its bytes (or holds at least one object at MAX_SLAB_PAGES).
+    pub fn init(comptime name: []const u8, comptime size: usize, comptime alignment: usize) Cache {
+        const obj_align = @max(alignment, @alignOf(FreeObj));
+        const obj_size = comptime alignUp(@max(size, @sizeOf(FreeObj)), obj_align);
+        const obj_offset = comptime alignUp(@sizeOf(Slab), obj_align);
+        const pages = comptime slabPages(obj_offset, obj_size);
+        const objs = (pages * page_size - obj_offset) / obj_size;
+        if (objs == 0) @compileError("slab: object too large for cache " ++ name);
+        return .{
+            .name = name,
+            .obj_size = obj_size,
+            .obj_offset = obj_offset,
+            .slab_pages = pages,
+            .objs_per_slab = objs,
+        };
+    }
+
+    /// Allocate one object. Returns null when the PMM is out of pages.
+    pub fn alloc(self: *Cache) ?*anyopaque {
+        const mag = &self.cpu[percpu.getCoreId()];
+        if (mag.count == 0) {
+            self.lock.lock();
+            defer self.lock.unlock();
+            while (mag.count < MAG_BATCH) {
+                const obj = self.slabAlloc() orelse break;
+                mag.objs[mag.count] = @intFromPtr(obj);
+                mag.count += 1;
+            }
+            if (mag.count == 0) return null;
+        }
+        mag.count -= 1;
+        mag.allocs += 1;
+        return @ptrFromInt(mag.objs[mag.count]);
+    }
+
+    /// Return an object obtained from this cache's alloc().
+    pub fn free(self: *Cache, ptr: *anyopaque) void {
+        const mag = &self.cpu[percpu.getCoreId()];
+        if (mag.count == MAG_SIZE) {
+            self.lock.lock();
+            defer self.lock.unlock();
+            while (mag.count > MAG_SIZE - MAG_BATCH) {
+                mag.count -= 1;
+                self.slabFree(@ptrFromInt(mag.objs[mag.count]));
+            }
+        }
+        mag.objs[mag.count] = @intFromPtr(ptr);
+        mag.count += 1;
+        mag.frees += 1;
+    }
+
+    pub fn stats(self: *Cache) Stats {
+        var allocs: u64 = 0;
+        var frees: u64 = 0;
+        for (&self.cpu) |*mag| {
+            allocs += mag.allocs;
+            frees += mag.frees;
+        }
+        self.lock.lock();
+        const slabs = self.slabs;
+        self.lock.unlock();
+        return .{
+            .name = self.name,
+            .obj_size = self.obj_size,
+            .active = allocs -% frees,
+            .total = @as(u64, slabs) * self.objs_per_slab,
+            .slabs = slabs,
+            .pages = @as(u64, slabs) * self.slab_pages,
+        };
+    }
+
+    // ── Slab lists (self.lock held) ───────────────────────────────────
+
+    fn slabAlloc(self: *Cache) ?*FreeObj {
+        const slab = self.partial orelse (self.grow() orelse return null);
+        const obj = slab.free_list.?;
+        slab.free_list = obj.next;
+        if (slab.inuse == 0) self.empty_slabs -= 1;
+        slab.inuse += 1;
+        if (slab.free_list == null) self.unlink(slab);
+        return obj;
+    }
+
+    fn slabFree(self: *Cache, obj: *FreeObj) void {
+        const slab_bytes = self.slab_pages * page_size;
+        const slab: *Slab = @ptrFromInt(@intFromPtr(obj) & ~(slab_bytes - 1));
+        obj.next = slab.free_list;
+        slab.free_list = obj;
+        if (!slab.on_partial) self.push(slab);
+        slab.inuse -= 1;
+        if (slab.inuse != 0) return;
+
+        if (self.empty_slabs >= KEEP_EMPTY) {
+            self.unlink(slab);
+            self.slabs -= 1;
+            if (self.slab_pages == 1) pmm.freePage(slab.phys) else pmm.freeContiguousPages(slab.phys, self.slab_pages);
+        } else {
+            self.empty_slabs += 1;
+        }
+    }
+
+    fn grow(self: *Cache) ?*Slab {
+        const phys = (if (self.slab_pages == 1) pmm.allocPage() else pmm.allocContiguousPages(self.slab_pages)) orelse return null;
+        const base: [*]u8 = @ptrFromInt(mem.physToVirt(phys));
+        const slab: *Slab = @ptrCast(@alignCast(base));
+        slab.* = .{
+            .cache = self,
+            .next = null,
+            .prev = null,
+            .free_list = null,
+            .inuse = 0,
+            .on_partial = false,
+            .phys = phys,
+        };
+        // Thread the free list so objects come out in address order
+        var i: usize = self.objs_per_slab;
+        while (i > 0) {
+            i -= 1;
+            const obj: *FreeObj = @ptrCast(@alignCast(base + self.obj_offset + i * self.obj_size));
+            obj.next = slab.free_list;
+            slab.free_list = obj;
+        }
+        self.push(slab);
+        self.slabs += 1;
+        self.empty_slabs += 1;
+        if (!self.registered) register(self);
+        return slab;
+    }
+
+    fn push(self: *Cache, slab: *Slab) void {
+        slab.prev = null;
+        slab.next = self.partial;
+        if (self.partial) |head| head.prev = slab;
+        self.partial = slab;
+        slab.on_partial = true;
+    }
+
+    fn unlink(self: *Cache, slab: *Slab) void {
+        if (slab.prev) |p| p.next = slab.next else self.partial = slab.next;
+        if (slab.next) |n| n.prev = slab.prev;
+        slab.next = null;
+        slab.prev = null;
+        slab.on_partial = false;
+    }
+};
+
+/// Typed front end over Cache.
+pub fn ObjectCache(comptime T: type) type {
+    return struct {
+        cache: Cache,
+
+        const Self = @This();
+
+        pub fn init(comptime name: []const u8) Self {
+            return .{ .cache = Cache.init(name, @sizeOf(T), @alignOf(T)) };
+        }
+
+        pub fn create(self: *Self) ?*T {
+            return @ptrCast(@alignCast(self.cache.alloc() orelse return null));
+        }
+
+        pub fn destroy(self: *Self, obj: *T) void {
+            self.cache.free(obj);
+        }
+    };
+}
+
+// ── Registry (for /proc/slabinfo) ───────────────────────────────────
+
+var registry: ?*Cache = null;
+var registry_lock: SpinLock = .{};
+
+fn register(cache: *Cache) void {
+    registry_lock.lock();
+    defer registry_lock.unlock();
+    cache.next_cache = registry;
+    registry = cache;
+    cache.registered = true;
+}
+
+/// First cache that has ever allocated a slab; follow `next_cache`.
+/// Caches are static and never unregistered, so walking without a lock is safe.
+pub fn firstCache() ?*Cache {
+    registry_lock.lock();
+    defer registry_lock.unlock();
+    return registry;
+}
+
+fn slabPages(obj_offset: usize, obj_size: usize) usize {
+    var pages: usize = 1;
+    while (pages < MAX_SLAB_PAGES) : (pages *= 2) {
+        const bytes = pages * page_size;
+        if (bytes < obj_offset + obj_size) continue;
+        const n = (bytes - obj_offset) / obj_size;
+        if ((bytes - n * obj_size) * 8 <= bytes) break;
+    }
+    return pages;
+}
+
+fn alignUp(v: usize, a: usize) usize {
+    return (v + a - 1) & ~(a - 1);
+}
@@ -1,9 +1,20 @@
-/// Ticket spinlock for SMP synchronization.
+/// Spinlocks for SMP synchronization.
 ///
-/// Uses atomic fetch_add for fairness (FIFO ordering). Each core spins
-/// on `serving` until its ticket number is served. Debug builds track
-/// owner core ID and panic on recursive locking.
+/// SpinLock is a ticket lock: atomic fetch_add for fairness (FIFO
+/// ordering), each core spinning on `serving` until its ticket is served.
+/// Small and fine for per-object locks that rarely see more than two cores.
+///
+/// QueuedLock is an MCS lock for the global hot locks (pmm, process table,
+/// futex buckets, IPC channel allocation). Waiters queue up through
+/// per-core nodes and each spins on its own cache line, so a handoff
+/// touches one waiter instead of every core. Built with -Dlockstat=true,
+/// each QueuedLock also counts acquisitions, contended acquisitions, spin
+/// cycles and the longest hold, reported per lock name in /proc/lockstat.
+///
+/// Debug builds track owner core ID.
 const builtin = @import("builtin");
+const lockstat = @import("build_options").lockstat;
+const percpu = @import("percpu.zig");
 
 const cpu = switch (builtin.cpu.arch) {
     .x86_64 => @import("arch/x86_64/cpu.zig"),
@@ -56,8 +67,173 @@ pub const SpinLock = struct {
     }
 };
 
+// ── Queued (MCS) lock ─────────────────────────────────────────────────
+
+/// Queued locks one core can hold at once (nesting depth).
+const NODES_PER_CORE = 4;
+
+/// A waiter's queue entry, alone on its cache line.
+const QNode = struct {
+    next: ?*QNode align(64) = null,
+    /// Cleared by the previous holder to pass the lock on.
+    locked: bool = false,
+    in_use: bool = false,
+};
+
+var qnodes: [percpu.MAX_CORES][NODES_PER_CORE]QNode = [_][NODES_PER_CORE]QNode{[_]QNode{.{}} ** NODES_PER_CORE} ** percpu.MAX_CORES;
+
+/// Contention counters, only present with -Dlockstat=true. Updated by
+/// the holder, so plain stores suffice.
+pub const LockStats = struct {
+    acquisitions: u64 = 0,
+    contended: u64 = 0,
+    spin_cycles: u64 = 0,
+    max_hold_cycles: u64 = 0,
+    hold_start: u64 = 0,
+    registered: bool = false,
+    next: ?*QueuedLock = null,
+};
+
+pub const QueuedLock = struct {
+    /// Last waiter in the queue (null = free).
+    tail: ?*QNode = null,
+    /// Node of the current holder, for unlock.
+    holder: ?*QNode = null,
+    name: []const u8,
+    /// Core that holds the lock (-1 = nobody). Debug only.
+    owner: i8 = -1,
+    stats: if (lockstat) LockStats else void = if (lockstat) .{} else {},
+
+    pub fn init(comptime name: []const u8) QueuedLock {
+        return .{ .name = name };
+    }
+
+    pub fn lock(self: *QueuedLock) void {
+        const node = claimNode();
+        const prev = @atomicRmw(?*QNode, &self.tail, .Xchg, node, .acq_rel);
+        var spin: u64 = 0;
+        if (prev) |p| {
+            const start = if (lockstat) cycles() else 0;
+            @atomicStore(?*QNode, &p.next, node, .release);
+            while (@atomicLoad(bool, &node.locked, .acquire)) {
+                cpu.spinHint();
+            }
+            if (lockstat) spin = cycles() -% start;
+        }
+        self.holder = node;
+        if (builtin.mode == .Debug) {
+            self.owner = coreId();
+        }
+        if (lockstat) self.account(prev != null, spin);
+    }
+
+    pub fn unlock(self: *QueuedLock) void {
+        if (lockstat) {
+            const held = cycles() -% self.stats.hold_start;
+            if (held > self.stats.max_hold_cycles) self.stats.max_hold_cycles = held;
+        }
+        if (builtin.mode == .Debug) {
+            self.owner = -1;
+        }
+        const node = self.holder.?;
+        self.holder = null;
+        var next = @atomicLoad(?*QNode, &node.next, .acquire);
+        if (next == null) {
+            // No known successor: free the lock, unless one is just queueing.
+            if (@cmpxchgStrong(?*QNode, &self.tail, node, null, .release, .monotonic) == null) {
+                releaseNode(node);
+                return;
+            }
+            while (next == null) {
+                cpu.spinHint();
+                next = @atomicLoad(?*QNode, &node.next, .acquire);
+            }
+        }
+        @atomicStore(bool, &next.?.locked, false, .release);
+        releaseNode(node);
+    }
+
+    /// Try to acquire without blocking. Returns true if acquired.
+    pub fn tryLock(self: *QueuedLock) bool {
+        if (@atomicLoad(?*QNode, &self.tail, .monotonic) != null) return false;
+        const node = claimNode();
+        if (@cmpxchgStrong(?*QNode, &self.tail, null, node, .acquire, .monotonic) != null) {
+            releaseNode(node);
+            return false;
+        }
+        self.holder = node;
+        if (builtin.mode == .Debug) {
+            self.owner = coreId();
+        }
+        if (lockstat) self.account(false, 0);
+        return true;
+    }
+
+    pub fn isLocked(self: *const QueuedLock) bool {
+        return @atomicLoad(?*QNode, &self.tail, .monotonic) != null;
+    }
+
+    fn account(self: *QueuedLock, contended: bool, spin: u64) void {
+        const st = &self.stats;
+        if (!st.registered) register(self);
+        st.acquisitions += 1;
+        if (contended) st.contended += 1;
+        st.spin_cycles += spin;
+        st.hold_start = cycles();
+    }
+};
+
+/// A free node of this core's. Locks are never held across a context
+/// switch, so only this core touches its nodes.
+fn claimNode() *QNode {
+    for (&qnodes[percpu.getCoreId()]) |*n| {
+        if (!n.in_use) {
+            n.in_use = true;
+            n.next = null;
+            n.locked = true;
+            return n;
+        }
+    }
+    @panic("QueuedLock: nested too deep");
+}
+
+fn releaseNode(node: *QNode) void {
+    @atomicStore(bool, &node.in_use, false, .release);
+}
+
+// ── Lock statistics registry (for /proc/lockstat) ─────────────────────
+
+var registry: ?*QueuedLock = null;
+
+/// Lock-free push; runs with `lock` held, so it is registered once.
+fn register(lock: *QueuedLock) void {
+    lock.stats.registered = true;
+    var head = @atomicLoad(?*QueuedLock, &registry, .monotonic);
+    while (true) {
+        lock.stats.next = head;
+        head = @cmpxchgWeak(?*QueuedLock, &registry, head, lock, .release, .monotonic) orelse return;
+    }
+}
+
+/// First queued lock that has been taken since boot; follow `stats.next`.
+/// Only valid with lockstat; locks are static and never unregistered.
+pub fn firstStats() ?*QueuedLock {
+    if (!lockstat) return null;
+    return @atomicLoad(?*QueuedLock, &registry, .acquire);
+}
+
+pub const enabled = lockstat;
+
+/// Cycle counter for spin/hold accounting.
+fn cycles() u64 {
+    return switch (builtin.cpu.arch) {
+        .x86_64 => cpu.rdtsc(),
+        .riscv64 => cpu.rdtime(),
+        else => 0,
+    };
+}
+
 /// Get current core ID for debug owner tracking.
 fn coreId() i8 {
-    const percpu = @import("percpu.zig");
     return @intCast(percpu.getCoreId());
 }
@@ -1,8 +1,20 @@
 /// VMS-inspired fault supervisor.
 ///
 /// Monitors registered file servers. When one crashes (exception in Ring 3),
-/// the supervisor restarts it from the saved ELF binary, re-mounts it at
-/// the same path in the root namespace, and notifies waiting clients.
+/// the supervisor starts a new instance from the saved ELF binary on the
+/// same IPC channel. The mount every namespace already holds stays valid,
+/// and requests queued on the channel during the crash are served by the
+/// new instance instead of failing. Requests the dead instance had already
+/// taken fail with R_ERROR: it may have half-applied them.
+///
+/// Hot standby: a service registered with `hot_standby` keeps a second,
+/// fully loaded instance that runs its own setup and parks in
+/// svc_standby() before touching live state. A crash promotes it on the
+/// spot; the next standby is loaded behind it.
+///
+/// State region: a service can ask for SERVICE_STATE_PAGES pages owned by
+/// the supervisor and mapped at SERVICE_STATE_BASE in each of its
+/// instances (svc_state()). What it keeps there survives the crash.
 ///
 /// Design: crash isolation — a GPU driver crash restarts the server,
 /// never locks the system.
@@ -10,9 +22,13 @@ const klog = @import("klog.zig");
 const process = @import("process.zig");
 const namespace = @import("namespace.zig");
 const ipc = @import("ipc.zig");
-const elf = @import("elf.zig");
+const image = @import("image.zig");
 const pmm = @import("pmm.zig");
 const mem = @import("mem.zig");
+const futex = @import("futex.zig");
+const timer = @import("timer.zig");
+const syscall = @import("syscall.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
 
 const paging = switch (@import("builtin").cpu.arch) {
     .x86_64 => @import("arch/x86_64/paging.zig"),
@@ -32,8 +48,22 @@ const paging = switch (@import("builtin").cpu.arch) {
 const MAX_SERVICES = 16;
 const MAX_NAME = 64;
 const MAX_MOUNT_PATH = 128;
+/// Device fds a service can be given, from fd 4 up (fd 3 is its channel).
+const MAX_SERVICE_FDS = 4;
 const USER_STACK_PAGES = process.USER_STACK_PAGES;
 
+/// How a service is run (see spawnService).
+pub const Options = struct {
+    /// Fds every instance starts with at fd 4, 5, ...
+    fds: []const process.FdEntry = &.{},
+    /// Keep a parked instance ready to take over. The service must call
+    /// svc_standby() before serving or reading state the active instance
+    /// may still change.
+    hot_standby: bool = false,
+    /// Give the service a state region that outlives its instances.
+    state_region: bool = false,
+};
+
 pub const SupervisedService = struct {
     /// Human-readable service name.
     name: [MAX_NAME]u8,
@@ -45,12 +75,21 @@ pub const SupervisedService = struct {
     mount_path_len: u16,
     /// Current process (null if dead/not yet started).
     pid: ?u32,
-    /// IPC channel ID for this service.
+    /// IPC channel ID for this service, kept across restarts.
     channel_id: ?ipc.ChannelId,
     /// How many times this service has been restarted.
     restart_count: u32,
     /// Give up after this many restarts.
     max_restarts: u32,
+    /// Fds handed to each instance from fd 4 up.
+    fds: [MAX_SERVICE_FDS]process.FdEntry,
+    fd_count: u8,
+    /// Keep a standby instance; standby_pid is the current one, if any.
+    hot_standby: bool,
+    standby_pid: ?u32,
+    /// Frames of the state region (valid when has_state).
+    state_frames: [mem.SERVICE_STATE_PAGES]u64,
+    has_state: bool,
     /// Whether this service entry is in use.
     active: bool,
 };
@@ -58,6 +97,9 @@ pub const SupervisedService = struct {
 var services: [MAX_SERVICES]SupervisedService = undefined;
 var initialized: bool = false;
 
+/// Serializes crash handling against standbys parking on other cores.
+var lock: SpinLock = .{};
+
 pub fn init() void {
     for (&services) |*s| {
         s.active = false;
@@ -67,6 +109,10 @@ pub fn init() void {
         s.max_restarts = 5;
         s.name_len = 0;
         s.mount_path_len = 0;
+        s.fd_count = 0;
+        s.hot_standby = false;
+        s.standby_pid = null;
+        s.has_state = false;
     }
     initialized = true;
     klog.info("Supervisor: initialized (max ");
@@ -75,9 +121,10 @@ pub fn init() void {
 }
 
 /// Register a file server for supervision (without spawning it).
-pub fn register(name: []const u8, elf_data: []const u8, mount_path: []const u8) ?*SupervisedService {
+pub fn register(name: []const u8, elf_data: []const u8, mount_path: []const u8, opts: Options) ?*SupervisedService {
     if (!initialized) return null;
     if (name.len > MAX_NAME or mount_path.len > MAX_MOUNT_PATH) return null;
+    if (opts.fds.len > MAX_SERVICE_FDS) return null;
 
     for (&services) |*s| {
         if (!s.active) {
@@ -90,6 +137,12 @@ pub fn register(name: []const u8, elf_data: []const u8, mount_path: []const u8)
             s.channel_id = null;
             s.restart_count = 0;
             s.max_restarts = 5;
+            @memcpy(s.fds[0..opts.fds.len], opts.fds);
+            s.fd_count = @intCast(opts.fds.len);
+            s.hot_standby = opts.hot_standby;
+            s.standby_pid = null;
+            s.has_state = false;
+            if (opts.state_region and !allocState(s)) return null;
             s.active = true;
             return s;
         }
@@ -97,38 +150,70 @@ pub fn register(name: []const u8, elf_data: []const u8, mount_path: []const u8)
     return null;
 }
 
-/// Spawn a supervised file server: register, create process, load ELF,
-/// set up IPC channel, mount in root namespace.
-pub fn spawnService(name: []const u8, elf_data: []const u8, mount_path: []const u8) ?*SupervisedService {
+/// Allocate a zeroed state region; the supervisor keeps one reference to
+/// each frame for the life of the service.
+fn allocState(svc: *SupervisedService) bool {
+    for (&svc.state_frames, 0..) |*frame, i| {
+        const page = pmm.allocPage() orelse {
+            for (svc.state_frames[0..i]) |f| pmm.freePage(f);
+            return false;
+        };
+        const ptr: [*]u8 = paging.physPtr(page);
+        @memset(ptr[0..mem.PAGE_SIZE], 0);
+        frame.* = page;
+    }
+    svc.has_state = true;
+    return true;
+}
+
+/// Spawn a supervised file server: register, set up its IPC channel,
+/// mount it in the root namespace and start it (and its standby).
+pub fn spawnService(name: []const u8, elf_data: []const u8, mount_path: []const u8, opts: Options) ?*SupervisedService {
     // Register the service
-    const svc = register(name, elf_data, mount_path) orelse return null;
+    const svc = register(name, elf_data, mount_path, opts) orelse return null;
 
-    // Spawn the process
-    if (spawnServiceProcess(svc)) {
-        return svc;
-    } else {
+    // One channel for the life of the service: instances come and go
+    // behind it
+    const chan_pair = ipc.channelCreate() catch {
+        logFailure(svc, "Channel create");
         svc.active = false;
         return null;
-    }
+    };
+    const root_ns = namespace.getRootNamespace();
+    root_ns.mount(svc.mount_path[0..svc.mount_path_len], chan_pair.client, .{ .replace = true }) catch {
+        logFailure(svc, "Mount");
+        svc.active = false;
+        return null;
+    };
+    svc.channel_id = chan_pair.server;
+
+    lock.lock();
+    defer lock.unlock();
+    const proc = spawnInstance(svc) orelse {
+        svc.active = false;
+        return null;
+    };
+    svc.pid = proc.pid;
+    if (svc.hot_standby) armStandby(svc);
+    return svc;
 }
 
-/// Internal: create a process for a supervised service.
-fn spawnServiceProcess(svc: *SupervisedService) bool {
+/// Internal: create and start one instance of a supervised service, with
+/// the service channel as fd 3.
+fn spawnInstance(svc: *SupervisedService) ?*process.Process {
     // Create process
     const proc = process.create() orelse {
-        klog.err("[supervisor] Failed to create process for '");
-        klog.err(svc.name[0..svc.name_len]);
-        klog.err("'\n");
-        return false;
+        logFailure(svc, "Process create");
+        return null;
     };
+    // Not runnable until it is loaded
+    proc.state = .blocked;
 
     // Load ELF into process address space
-    const load_result = elf.load(proc.pml4.?, svc.elf_data) catch {
-        klog.err("[supervisor] ELF load failed for '");
-        klog.err(svc.name[0..svc.name_len]);
-        klog.err("'\n");
+    const load_result = image.load(proc.pml4.?, svc.elf_data, null) catch {
+        logFailure(svc, "ELF load");
         proc.state = .dead;
-        return false;
+        return null;
     };
 
     proc.user_rip = load_result.entry_point;
@@ -137,60 +222,72 @@ fn spawnServiceProcess(svc: *SupervisedService) bool {
     // Allocate user stack
     for (0..USER_STACK_PAGES) |i| {
         const page = pmm.allocPage() orelse {
-            klog.err("[supervisor] Stack alloc failed for '");
-            klog.err(svc.name[0..svc.name_len]);
-            klog.err("'\n");
+            logFailure(svc, "Stack alloc");
             proc.state = .dead;
-            return false;
+            return null;
         };
         const ptr: [*]u8 = paging.physPtr(page);
         @memset(ptr[0..mem.PAGE_SIZE], 0);
 
         const virt = mem.USER_STACK_TOP - (USER_STACK_PAGES - i) * mem.PAGE_SIZE;
         paging.mapPage(proc.pml4.?, virt, page, paging.Flags.WRITABLE | paging.Flags.USER) orelse {
-            klog.err("[supervisor] Stack map failed for '");
-            klog.err(svc.name[0..svc.name_len]);
-            klog.err("'\n");
+            logFailure(svc, "Stack map");
             proc.state = .dead;
-            return false;
+            return null;
         };
     }
     proc.user_rsp = mem.USER_STACK_INIT;
 
-    // Create IPC channel for this service
-    const chan_pair = ipc.channelCreate() catch {
-        klog.err("[supervisor] Channel create failed for '");
-        klog.err(svc.name[0..svc.name_len]);
-        klog.err("'\n");
-        proc.state = .dead;
-        return false;
-    };
-
-    // Give the server end to the process as fd 3
-    proc.setFd(3, chan_pair.server, true);
+    // Shared state region: each instance holds its own frame references
+    if (svc.has_state) {
+        for (svc.state_frames, 0..) |frame, i| {
+            const virt = mem.SERVICE_STATE_BASE + i * mem.PAGE_SIZE;
+            if (!pmm.refPage(frame) or
+                paging.mapPage(proc.pml4.?, virt, frame, paging.Flags.WRITABLE | paging.Flags.USER) == null)
+            {
+                logFailure(svc, "State map");
+                proc.state = .dead;
+                return null;
+            }
+        }
+    }
 
-    // Mount the client end in the root namespace
-    const root_ns = namespace.getRootNamespace();
-    root_ns.mount(svc.mount_path[0..svc.mount_path_len], chan_pair.client, .{ .replace = true }) catch {
-        klog.err("[supervisor] Mount failed for '");
-        klog.err(svc.name[0..svc.name_len]);
-        klog.err("'\n");
-        proc.state = .dead;
-        return false;
-    };
-
-    svc.pid = proc.pid;
-    svc.channel_id = chan_pair.server;
+    // Server end of the service channel as fd 3, device fds after it
+    proc.setFd(3, svc.channel_id.?, true);
+    for (svc.fds[0..svc.fd_count], 0..) |entry, i| proc.fds[4 + i] = entry;
+    proc.parent_pid = null;
 
     klog.debug("[supervisor] Spawned '");
     klog.debug(svc.name[0..svc.name_len]);
     klog.debug("' (pid=");
     klog.debugDec(proc.pid);
     klog.debug(", channel=");
-    klog.debugDec(chan_pair.server);
+    klog.debugDec(svc.channel_id.?);
     klog.debug(")\n");
 
-    return true;
+    process.markReady(proc);
+    return proc;
+}
+
+/// Load the next standby. It runs its setup and parks in svc_standby().
+/// Caller holds `lock`, so the instance can't reach svc_standby() before
+/// it is known to be the standby.
+fn armStandby(svc: *SupervisedService) void {
+    const proc = spawnInstance(svc) orelse {
+        klog.warn("[supervisor] No standby for '");
+        klog.warn(svc.name[0..svc.name_len]);
+        klog.warn("'\n");
+        return;
+    };
+    svc.standby_pid = proc.pid;
+}
+
+fn logFailure(svc: *const SupervisedService, what: []const u8) void {
+    klog.err("[supervisor] ");
+    klog.err(what);
+    klog.err(" failed for '");
+    klog.err(svc.name[0..svc.name_len]);
+    klog.err("'\n");
 }
 
 /// Called by the exception handler when a userspace process faults.
@@ -198,10 +295,25 @@ fn spawnServiceProcess(svc: *SupervisedService) bool {
 /// Returns true if the fault was handled (service will be restarted).
 pub fn handleProcessFault(pid: u32) bool {
     if (!initialized) return false;
+    const proc = process.getByPid(pid) orelse return false;
+    // Any thread of an instance takes the whole instance down
+    const leader = if (proc.thread_group) |tg| tg.leader_pid else pid;
+
+    lock.lock();
+    defer lock.unlock();
 
     for (&services) |*s| {
         if (!s.active) continue;
-        if (s.pid == pid) {
+        if (s.standby_pid == leader) {
+            // Crashed during its own setup: the next crash restarts cold
+            klog.warn("[supervisor] Standby of '");
+            klog.warn(s.name[0..s.name_len]);
+            klog.warn("' crashed\n");
+            s.standby_pid = null;
+            killInstance(s, leader);
+            return true;
+        }
+        if (s.pid == leader) {
             klog.warn("[supervisor] Service '");
             klog.warn(s.name[0..s.name_len]);
             klog.warn("' crashed (pid=");
@@ -210,12 +322,15 @@ pub fn handleProcessFault(pid: u32) bool {
             klog.warnDec(s.restart_count);
             klog.warn(")\n");
 
+            killInstance(s, leader);
+            s.pid = null;
+
             if (s.restart_count >= s.max_restarts) {
                 klog.err("[supervisor] Max restarts exceeded, giving up\n");
                 klog.err("[supervisor] Service '");
                 klog.err(s.name[0..s.name_len]);
                 klog.err("' permanently failed\n");
-                s.pid = null;
+                failQueued(s);
                 return true;
             }
 
@@ -228,32 +343,128 @@ pub fn handleProcessFault(pid: u32) bool {
     return false;
 }
 
-/// Restart a supervised service: mark old dead, create new process, load ELF, re-mount.
-fn restartService(svc: *SupervisedService) void {
-    klog.debug("[supervisor] Restarting '");
-    klog.debug(svc.name[0..svc.name_len]);
-    klog.debug("'...\n");
+/// Stop every thread of the instance led by `leader`: take them off the
+/// service channel and fail the requests they were serving. Requests
+/// still queued on the channel are left for the next instance.
+fn killInstance(svc: *SupervisedService, leader: u32) void {
+    const chan = if (svc.channel_id) |id| ipc.getChannel(id) else null;
+    const group = if (process.getByPid(leader)) |p| p.thread_group else null;
 
-    // Mark old process as dead
-    if (svc.pid) |old_pid| {
-        if (process.getByPid(old_pid)) |proc| {
-            proc.state = .dead;
+    for (process.getProcessTable()) |*p| {
+        if (p.state == .free or p.state == .dead) continue;
+        const member = p.pid == leader or (if (group) |tg| p.thread_group == tg else false);
+        if (!member) continue;
+
+        if (chan) |c| {
+            c.lock.lock();
+            _ = c.client.removeServerWaiter(p.pid);
+            c.lock.unlock();
+        }
+        if (p.ipc_serving_client != 0 or p.ipc_serving_tagged != null) {
+            syscall.failRequest(p.ipc_serving_client, p.ipc_serving_tagged);
+            p.ipc_serving_client = 0;
+            p.ipc_serving_tagged = null;
         }
+        futex.cancel(p);
+        timer.cancel(&p.wake_timer);
+        p.state = .dead;
     }
+}
 
-    // Spawn new process with same ELF and mount path
-    if (spawnServiceProcess(svc)) {
-        klog.info("[supervisor] Restarted '");
+/// Bring a crashed service back: promote its standby if it has one,
+/// otherwise start a new instance from the saved ELF. Either way it
+/// serves the same channel, so nothing is re-mounted.
+fn restartService(svc: *SupervisedService) void {
+    if (promoteStandby(svc)) {
+        klog.info("[supervisor] Standby took over '");
         klog.info(svc.name[0..svc.name_len]);
         klog.info("' (restart #");
         klog.infoDec(svc.restart_count);
         klog.info(")\n");
-    } else {
+        armStandby(svc);
+        return;
+    }
+
+    klog.debug("[supervisor] Restarting '");
+    klog.debug(svc.name[0..svc.name_len]);
+    klog.debug("'...\n");
+
+    // Spawn new process with same ELF on the same channel
+    const proc = spawnInstance(svc) orelse {
         klog.err("[supervisor] Failed to restart '");
         klog.err(svc.name[0..svc.name_len]);
         klog.err("'\n");
-        svc.pid = null;
+        failQueued(svc);
+        return;
+    };
+    svc.pid = proc.pid;
+    klog.info("[supervisor] Restarted '");
+    klog.info(svc.name[0..svc.name_len]);
+    klog.info("' (restart #");
+    klog.infoDec(svc.restart_count);
+    klog.info(")\n");
+    if (svc.hot_standby) armStandby(svc);
+}
+
+/// Make the standby the active instance. Parked in svc_standby() it is
+/// woken; still in its setup, its svc_standby() call will return at once.
+fn promoteStandby(svc: *SupervisedService) bool {
+    const pid = svc.standby_pid orelse return false;
+    svc.standby_pid = null;
+    const proc = process.getByPid(pid) orelse return false;
+    if (proc.state == .dead) return false;
+
+    svc.pid = pid;
+    if (proc.state == .blocked and proc.pending_op == .standby) {
+        proc.pending_op = .none;
+        proc.syscall_ret = 0;
+        process.markReady(proc);
+    }
+    return true;
+}
+
+/// The service is gone for good: close its channel and fail whatever is
+/// still queued on it.
+fn failQueued(svc: *SupervisedService) void {
+    const id = svc.channel_id orelse return;
+    const chan = ipc.getChannel(id) orelse return;
+    ipc.channelClose(id);
+    while (true) {
+        chan.lock.lock();
+        const entry = chan.client.dequeue();
+        chan.lock.unlock();
+        const e = entry orelse break;
+        syscall.failRequest(e.pid, e.tagged);
+    }
+}
+
+/// svc_standby(): if `proc` is a standby, block it until promotion and
+/// return true.
+pub fn parkStandby(proc: *process.Process) bool {
+    if (!initialized) return false;
+    lock.lock();
+    defer lock.unlock();
+    for (&services) |*s| {
+        if (s.active and s.standby_pid == proc.pid) {
+            proc.syscall_ret = 0;
+            proc.pending_op = .standby;
+            proc.state = .blocked;
+            return true;
+        }
     }
+    return false;
+}
+
+/// svc_state(): whether `proc` belongs to a service with a state region
+/// (mapped at SERVICE_STATE_BASE).
+pub fn hasStateRegion(proc: *const process.Process) bool {
+    if (!initialized) return false;
+    const leader = if (proc.thread_group) |tg| tg.leader_pid else proc.pid;
+    for (&services) |*s| {
+        if (!s.active or !s.has_state) continue;
+        if (s.pid == leader or s.standby_pid == leader) return true;
+    }
+    return false;
 }
 
 /// Set the PID for a supervised service (after initial spawn).
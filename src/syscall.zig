@@ -7,16 +7,22 @@ const console = @import("console.zig");
 const process = @import("process.zig");
 const ipc = @import("ipc.zig");
 const namespace = @import("namespace.zig");
-const elf = @import("elf.zig");
+const image = @import("image.zig");
 const paging = switch (@import("builtin").cpu.arch) {
     .x86_64 => @import("arch/x86_64/paging.zig"),
     .riscv64 => @import("arch/riscv64/paging.zig"),
     else => struct {},
 };
 const pmm = @import("pmm.zig");
+const slab = @import("slab.zig");
 const mem = @import("mem.zig");
 const klog = @import("klog.zig");
 const timer = @import("timer.zig");
+const spinlock = @import("spinlock.zig");
+const trace = @import("trace.zig");
+const tlb = @import("tlb.zig");
+const supervisor = @import("supervisor.zig");
+const ring = @import("ring.zig");
 
 pub const SYS = enum(u64) {
     open = 0,
@@ -59,6 +65,16 @@ pub const SYS = enum(u64) {
     clone = 37,
     futex = 38,
     ipc_pair = 39,
+    ipc_grant = 40,
+    ipc_submit = 41,
+    ipc_collect = 42,
+    splice = 43,
+    clock_ns = 44,
+    sleep_ns = 45,
+    svc_state = 46,
+    svc_standby = 47,
+    ring_setup = 48,
+    ring_enter = 49,
 };
 
 /// Error return values.
@@ -70,6 +86,8 @@ const EMFILE: u64 = @bitCast(@as(i64, -24));
 const EIO: u64 = @bitCast(@as(i64, -5));
 const ENOMEM: u64 = @bitCast(@as(i64, -12));
 const EINVAL: u64 = @bitCast(@as(i64, -22));
+const EAGAIN: u64 = @bitCast(@as(i64, -11));
+const EACCES: u64 = @bitCast(@as(i64, -13));
 
 // --- Helpers ---
 
@@ -98,49 +116,65 @@ fn readU32LE(buf: *const [4]u8) u32 {
         (@as(u32, buf[3]) << 24);
 }
 
-/// Send a client message on a channel and wake the server if it's blocked in recv.
-fn sendToServer(chan: *ipc.Channel, proc: *process.Process) void {
+/// Queue a client message on a channel, wake a server thread blocked in
+/// recv, and block the client until the reply. Only returns on failure.
+fn sendToServer(chan: *ipc.Channel, proc: *process.Process) u64 {
     chan.lock.lock();
-    defer chan.lock.unlock();
 
-    // Enqueue this client's message in the ring buffer
-    if (!chan.client.enqueue(proc.pid, &proc.ipc_msg)) {
-        // Queue full — leave process blocked, it will be retried
-        // when a slot opens (on next sysIpcReply)
-        return;
+    // A closed channel's server is gone for good (see supervisor.zig)
+    const chan_open = chan.state == .open;
+    if (!chan_open or !chan.client.enqueue(proc.pid, &proc.ipc_msg)) {
+        chan.lock.unlock();
+        if (proc.pending_op == .open or proc.pending_op == .create) proc.closeFd(proc.pending_fd);
+        proc.pending_op = .none;
+        proc.ipc_recv_buf_ptr = 0;
+        proc.ipc_grant_len = 0;
+        return if (chan_open) ENOMEM else EIO;
     }
 
-    // Fast path: if a server thread is waiting for a message, wake it directly
+    trace.point(.ipc_send, proc.pid, @intFromEnum(proc.ipc_msg.tag), proc.ipc_msg.data_len);
+
+    // Blocked before any server can see the message, so a reply from
+    // another core can't race ahead of it
+    proc.state = .blocked;
+    wakeServer(chan, true);
+    chan.lock.unlock();
+    process.scheduleNext();
+}
+
+/// If a server thread is blocked in recv, hand it the oldest pending
+/// message and wake it — by direct handoff when the caller is about to
+/// block (`direct`), otherwise through the run queue. chan.lock held.
+fn wakeServer(chan: *ipc.Channel, direct: bool) void {
+    var server: ?*process.Process = null;
     if (chan.client.server_waiter_count > 0) {
         if (chan.client.popServerWaiter()) |server_pid_u16| {
-            const server_pid: u32 = server_pid_u16;
-            if (process.getByPid(server_pid)) |server_proc| {
-                // Dequeue the entry we just enqueued and deliver it
-                if (chan.client.dequeue()) |entry| {
-                    if (entry.msg_ptr) |msg_ptr| {
-                        server_proc.ipc_pending_msg = msg_ptr;
-                    }
-                    server_proc.ipc_serving_client = entry.pid;
-                }
-                process.markReady(server_proc);
-                server_proc.syscall_ret = 0;
-            }
+            server = process.getByPid(server_pid_u16);
         }
     } else if (chan.client.recv_waiting and chan.client.blocked_pid != 0) {
         // Legacy single-server fast path
-        if (process.getByPid(chan.client.blocked_pid)) |server_proc| {
-            if (chan.client.dequeue()) |entry| {
-                if (entry.msg_ptr) |msg_ptr| {
-                    server_proc.ipc_pending_msg = msg_ptr;
-                }
-                server_proc.ipc_serving_client = entry.pid;
-            }
-            process.markReady(server_proc);
-            server_proc.syscall_ret = 0;
+        server = process.getByPid(chan.client.blocked_pid);
+        if (server != null) {
             chan.client.recv_waiting = false;
             chan.client.blocked_pid = 0;
         }
     }
+    const server_proc = server orelse return;
+
+    if (chan.client.dequeue()) |entry| startServing(server_proc, entry);
+    server_proc.syscall_ret = 0;
+    if (direct) process.handoff(server_proc) else process.markReady(server_proc);
+}
+
+/// Record the request a server thread is now serving (for ipc_reply) and
+/// queue its message for delivery into the server's recv buffer.
+fn startServing(server_proc: *process.Process, entry: ipc.PendingClient) void {
+    if (entry.msg_ptr) |msg_ptr| {
+        server_proc.ipc_pending_msg = msg_ptr;
+    }
+    server_proc.ipc_serving_client = entry.pid;
+    server_proc.ipc_serving_tagged = entry.tagged;
+    trace.point(.ipc_recv, server_proc.pid, entry.pid, 0);
 }
 
 /// Main syscall dispatch. Called from arch-specific entry point.
@@ -156,6 +190,10 @@ pub fn dispatch(nr: u64, arg0: u64, arg1: u64, arg2: u64, arg3: u64, arg4: u64)
         percpu.percpu_array[core_id].syscalls += 1;
     }
 
+    // An unconsumed IPC handoff (see process.handoff) means the caller kept
+    // running; only ipc_recv can still block and switch to it
+    if (nr != @intFromEnum(SYS.ipc_recv)) process.flushHandoff();
+
     const sys = std.meta.intToEnum(SYS, nr) catch {
         klog.warn("syscall: unknown nr=");
         klog.warnDec(nr);
@@ -163,6 +201,8 @@ pub fn dispatch(nr: u64, arg0: u64, arg1: u64, arg2: u64, arg3: u64, arg4: u64)
         return ENOSYS;
     };
 
+    if (!outputsWritable(sys, arg0, arg1, arg2, arg3, arg4)) return EFAULT;
+
     return switch (sys) {
         .write => sysWrite(arg0, arg1, arg2),
         .exit => sysExit(arg0),
@@ -199,11 +239,50 @@ pub fn dispatch(nr: u64, arg0: u64, arg1: u64, arg2: u64, arg3: u64, arg4: u64)
         .arch_prctl => sysArchPrctl(arg0, arg1),
         .rfork => sysRfork(arg0),
         .clone => sysClone(arg0, arg1, arg2, arg3, arg4),
-        .futex => sysFutex(arg0, arg1, arg2, arg3),
+        .futex => sysFutex(arg0, arg1, arg2, arg3, arg4),
         .mount => sysMount(arg0, arg1, arg2, arg3),
         .bind => sysBind(arg0, arg1, arg2, arg3),
         .unmount => sysUnmount(arg0, arg1),
         .ipc_pair => sysIpcPair(arg0),
+        .ipc_grant => sysIpcGrant(arg0, arg1, arg2, arg3, arg4),
+        .ipc_submit => sysIpcSubmit(arg0, arg1, arg2),
+        .ipc_collect => sysIpcCollect(arg0, arg1),
+        .splice => sysSplice(arg0, arg1, arg2),
+        .clock_ns => sysClockNs(),
+        .sleep_ns => sysSleepNs(arg0),
+        .svc_state => sysSvcState(),
+        .svc_standby => sysSvcStandby(),
+        .ring_setup => sysRingSetup(arg0),
+        .ring_enter => sysRingEnter(arg0, arg1),
+    };
+}
+
+/// Check the user buffers a syscall writes into (now, or when it resumes)
+/// with process.userWritable, so a read-only destination fails with EFAULT
+/// rather than a kernel #PF. Null and kernel-half pointers are left to the
+/// handlers, which already reject them.
+fn outputsWritable(sys: SYS, arg0: u64, arg1: u64, arg2: u64, arg3: u64, arg4: u64) bool {
+    const proc = process.getCurrent() orelse return true;
+    const Out = struct {
+        fn ok(p: *process.Process, ptr: u64, len: u64) bool {
+            if (ptr == 0 or ptr >= 0x0000_8000_0000_0000) return true;
+            return process.userWritable(p, ptr, len);
+        }
+    };
+    const msg_size = 8 + ipc.MAX_MSG_DATA;
+    return switch (sys) {
+        // No read moves more than a bulk grant
+        .read, .pread => Out.ok(proc, arg1, @min(arg2, ipc.MAX_GRANT)),
+        .stat => Out.ok(proc, arg1, 64),
+        .klog => Out.ok(proc, arg0, @min(arg1, 4096)),
+        .sysinfo => Out.ok(proc, arg0, 32),
+        .pipe, .ipc_pair => Out.ok(proc, arg0, 8),
+        .ipc_recv => Out.ok(proc, arg1, msg_size),
+        .ipc_collect => Out.ok(proc, arg0, msg_size) and Out.ok(proc, arg1, 8),
+        .ipc_grant => arg1 != GRANT_READ or Out.ok(proc, arg3, @min(arg4, ipc.MAX_GRANT)),
+        // ptid now, ctid at thread exit
+        .clone => Out.ok(proc, arg2, 4) and Out.ok(proc, arg3, 4),
+        else => true,
     };
 }
 
@@ -248,16 +327,16 @@ fn sysWrite(fd: u64, buf_ptr: u64, count: u64) u64 {
     // Pipe fd: write to pipe buffer
     if (entry.fd_type == .pipe) {
         const buf: [*]const u8 = @ptrFromInt(buf_ptr);
-        const n = @min(count, 4096);
+        const n = @min(count, pipe_mod.MAX_TRANSFER);
         if (pipe_mod.pipeWrite(entry.pipe_id, buf[0..n])) |bytes| {
             return bytes;
         }
         // Block — pipe full
-        pipe_mod.setWriteWaiter(entry.pipe_id, @intCast(proc.pid));
         proc.pending_op = .pipe_write;
         proc.pending_fd = @intCast(fd);
         proc.ipc_recv_buf_ptr = buf_ptr;
         proc.syscall_ret = n;
+        pipe_mod.setWriteWaiter(entry.pipe_id, proc);
         proc.state = .blocked;
         process.scheduleNext();
     }
@@ -375,6 +454,18 @@ fn sysWrite(fd: u64, buf_ptr: u64, count: u64) u64 {
         return len;
     }
 
+    // /dev/trace: "start", "stop" or "clear"
+    if (entry.fd_type == .dev_trace) {
+        const src: [*]const u8 = @ptrFromInt(buf_ptr);
+        const len: usize = @intCast(@min(count, 16));
+        var end = len;
+        while (end > 0 and (src[end - 1] == '\n' or src[end - 1] == ' ')) {
+            end -= 1;
+        }
+        if (!trace.control(src[0..end])) return EINVAL;
+        return len;
+    }
+
     // Read-only /dev/ files: reject writes
     if (entry.fd_type == .dev_osversion or
         entry.fd_type == .dev_kmesg or entry.fd_type == .dev_drivers or
@@ -384,11 +475,12 @@ fn sysWrite(fd: u64, buf_ptr: u64, count: u64) u64 {
         return EBADF;
     }
 
-    // Raw Ethernet write: ctl commands or send frame via virtio-net
+    // Raw Ethernet write: ctl commands, or send frame(s) via virtio-net
     if (entry.fd_type == .dev_ether) {
         const ether_mod = @import("ether.zig");
         const src: [*]const u8 = @ptrFromInt(buf_ptr);
-        const len: usize = @intCast(@min(count, 1518));
+        const batch = ether_mod.isBatch(entry.ether_client);
+        const len: usize = @intCast(@min(count, if (batch) ether_mod.MAX_BATCH else ether_mod.MAX_FRAME));
         // Check for ctl commands (short text strings)
         if (len <= 12) {
             var cmd_len = len;
@@ -399,7 +491,8 @@ fn sysWrite(fd: u64, buf_ptr: u64, count: u64) u64 {
                 return len;
             }
         }
-        // Not a ctl command — send as raw Ethernet frame
+        // Not a ctl command — send as raw Ethernet frame(s)
+        if (batch) return ether_mod.writeBatch(src[0..len]);
         const virtio_net = @import("virtio_net.zig");
         _ = virtio_net.send(src[0..len]);
         return len;
@@ -411,6 +504,23 @@ fn sysWrite(fd: u64, buf_ptr: u64, count: u64) u64 {
     // Server-backed fd: T_WRITE with [handle: u32][data...]
     if (entry.server_handle > 0) {
         const max_data = ipc.MAX_MSG_DATA - 4;
+
+        // Bulk: T_WRITE_BULK [handle][len], server pulls the data from a
+        // read-only grant of the caller's buffer
+        if (chan.grants and count > max_data) {
+            const grant_len: u32 = @intCast(@min(count, ipc.MAX_GRANT));
+            proc.ipc_msg = ipc.Message.init(.t_write_bulk);
+            writeU32LE(proc.ipc_msg.data_buf[0..4], entry.server_handle);
+            writeU32LE(proc.ipc_msg.data_buf[4..8], grant_len);
+            proc.ipc_msg.data_len = 8;
+            setGrant(proc, buf_ptr, grant_len, false);
+
+            proc.pending_op = .write;
+            proc.pending_fd = @intCast(fd);
+
+            return sendToServer(chan, proc);
+        }
+
         const data_len: u32 = @intCast(@min(count, max_data));
 
         proc.ipc_msg = ipc.Message.init(.t_write);
@@ -421,9 +531,7 @@ fn sysWrite(fd: u64, buf_ptr: u64, count: u64) u64 {
         proc.pending_op = .write;
         proc.pending_fd = @intCast(fd);
 
-        sendToServer(chan, proc);
-        proc.state = .blocked;
-        process.scheduleNext();
+        return sendToServer(chan, proc);
     }
 
     // Raw IPC write (existing behavior for non-server-backed channels)
@@ -434,9 +542,7 @@ fn sysWrite(fd: u64, buf_ptr: u64, count: u64) u64 {
     proc.ipc_msg.data_len = len;
 
     proc.pending_op = .none;
-    sendToServer(chan, proc);
-    proc.state = .blocked;
-    process.scheduleNext();
+    return sendToServer(chan, proc);
 }
 
 /// exit(status) — terminate the current process and schedule next.
@@ -467,10 +573,11 @@ fn sysExit(status: u64) noreturn {
                     futex_mod.wakeOne(pml4_phys, p.ctid_ptr);
                     p.ctid_ptr = 0;
                 }
+                futex_mod.cancel(p);
                 p.state = .dead;
                 p.thread_group = null;
                 // Release the group ref for this sibling
-                _ = process.thread_group.releaseGroup(tg, p);
+                _ = process.thread_group.releaseGroup(tg);
             }
         }
     }
@@ -697,17 +804,8 @@ fn strEql(a: []const u8, b: []const u8) bool {
 
 /// Check if the namespace has a mount specifically at /net/ (userspace netd).
 /// Used to skip the kernel /net/* interception when a userspace server handles it.
-fn hasNetMount(ns: *const namespace.Namespace) bool {
-    const prefix = "/net/";
-    for (&ns.mounts) |*m| {
-        if (!m.active) continue;
-        if (m.path_len >= prefix.len) {
-            const mp = m.path[0..m.path_len];
-            if (mp[0] == '/' and mp[1] == 'n' and mp[2] == 'e' and mp[3] == 't' and mp[4] == '/')
-                return true;
-        }
-    }
-    return false;
+fn hasNetMount(ns: *namespace.Namespace) bool {
+    return ns.hasMountUnder("/net/");
 }
 
 // ---------- /proc helpers ----------
@@ -773,7 +871,8 @@ const ProcDirEntry = extern struct {
     size: u32,
 };
 
-var proc_dir_buf: [65 * @sizeOf(ProcDirEntry)]u8 linksection(".bss") = undefined;
+var proc_dir_buf: [67 * @sizeOf(ProcDirEntry)]u8 linksection(".bss") = undefined;
+var slabinfo_buf: [2048]u8 linksection(".bss") = undefined;
 
 fn procRead(entry_ptr: *process.FdEntry, buf_ptr: u64, count: u64) u64 {
     const dest: [*]u8 = @ptrFromInt(buf_ptr);
@@ -799,10 +898,11 @@ fn procRead(entry_ptr: *process.FdEntry, buf_ptr: u64, count: u64) u64 {
                 pos += @sizeOf(ProcDirEntry);
             }
 
-            // Add "meminfo" entry
-            if (pos + @sizeOf(ProcDirEntry) <= proc_dir_buf.len) {
+            // Add "meminfo", "slabinfo" and "lockstat" entries
+            for ([_][]const u8{ "meminfo", "slabinfo", "lockstat" }) |fname| {
+                if (pos + @sizeOf(ProcDirEntry) > proc_dir_buf.len) break;
                 var de_mi: ProcDirEntry = .{ .name = [_]u8{0} ** 64, .file_type = 0, .size = 0 };
-                @memcpy(de_mi.name[0..7], "meminfo");
+                @memcpy(de_mi.name[0..fname.len], fname);
                 const mi_bytes: *const [@sizeOf(ProcDirEntry)]u8 = @ptrCast(&de_mi);
                 @memcpy(proc_dir_buf[pos..][0..@sizeOf(ProcDirEntry)], mi_bytes);
                 pos += @sizeOf(ProcDirEntry);
@@ -882,6 +982,11 @@ fn procRead(entry_ptr: *process.FdEntry, buf_ptr: u64, count: u64) u64 {
                 pos = appendKV(&text_buf, pos, "affinity", @intCast(@as(u16, @bitCast(target.core_affinity))));
             }
 
+            // Scheduling priority
+            pos = appendStr(&text_buf, pos, "pri ");
+            pos = appendStr(&text_buf, pos, @tagName(target.priority));
+            pos = appendStr(&text_buf, pos, "\n");
+
             // VT
             pos = appendKV(&text_buf, pos, "vt", target.vt);
 
@@ -926,6 +1031,75 @@ fn procRead(entry_ptr: *process.FdEntry, buf_ptr: u64, count: u64) u64 {
             entry_ptr.read_offset += @intCast(to_copy);
             return to_copy;
         },
+        .slabinfo => {
+            // One line per cache: name objsize active total slabs pages
+            var pos: usize = 0;
+            pos = appendStr(&slabinfo_buf, pos, "# name objsize active total slabs pages\n");
+            var cache = slab.firstCache();
+            while (cache) |c| : (cache = c.next_cache) {
+                const st = c.stats();
+                pos = appendStr(&slabinfo_buf, pos, st.name);
+                for ([_]u64{ st.obj_size, st.active, st.total, st.slabs, st.pages }) |v| {
+                    var dec_buf: [20]u8 = undefined;
+                    pos = appendStr(&slabinfo_buf, pos, " ");
+                    pos = appendStr(&slabinfo_buf, pos, fmtDecimal(v, &dec_buf));
+                }
+                pos = appendStr(&slabinfo_buf, pos, "\n");
+            }
+
+            const offset: usize = entry_ptr.read_offset;
+            if (offset >= pos) return 0;
+            const available = pos - offset;
+            const to_copy = @min(available, max_bytes);
+            @memcpy(dest[0..to_copy], slabinfo_buf[offset..][0..to_copy]);
+            entry_ptr.read_offset += @intCast(to_copy);
+            return to_copy;
+        },
+        .lockstat => {
+            // One line per lock name (locks sharing a name, like the futex
+            // buckets, are summed; max_hold is the largest of them)
+            var pos: usize = 0;
+            if (!spinlock.enabled) {
+                pos = appendStr(&slabinfo_buf, pos, "# lockstat disabled (build with -Dlockstat=true)\n");
+            } else {
+                pos = appendStr(&slabinfo_buf, pos, "# name acquisitions contended spin_cycles max_hold_cycles\n");
+                var names: [32][]const u8 = undefined;
+                var sums: [32][4]u64 = undefined;
+                var n: usize = 0;
+                var lk = spinlock.firstStats();
+                while (lk) |l| : (lk = l.stats.next) {
+                    var i: usize = 0;
+                    while (i < n and !strEql(names[i], l.name)) : (i += 1) {}
+                    if (i == n) {
+                        if (n == names.len) continue;
+                        names[n] = l.name;
+                        sums[n] = .{ 0, 0, 0, 0 };
+                        n += 1;
+                    }
+                    sums[i][0] += l.stats.acquisitions;
+                    sums[i][1] += l.stats.contended;
+                    sums[i][2] += l.stats.spin_cycles;
+                    sums[i][3] = @max(sums[i][3], l.stats.max_hold_cycles);
+                }
+                for (names[0..n], sums[0..n]) |name, vals| {
+                    pos = appendStr(&slabinfo_buf, pos, name);
+                    for (vals) |v| {
+                        var dec_buf: [20]u8 = undefined;
+                        pos = appendStr(&slabinfo_buf, pos, " ");
+                        pos = appendStr(&slabinfo_buf, pos, fmtDecimal(v, &dec_buf));
+                    }
+                    pos = appendStr(&slabinfo_buf, pos, "\n");
+                }
+            }
+
+            const offset: usize = entry_ptr.read_offset;
+            if (offset >= pos) return 0;
+            const available = pos - offset;
+            const to_copy = @min(available, max_bytes);
+            @memcpy(dest[0..to_copy], slabinfo_buf[offset..][0..to_copy]);
+            entry_ptr.read_offset += @intCast(to_copy);
+            return to_copy;
+        },
     }
 }
 
@@ -1089,7 +1263,7 @@ fn sysstatRead(entry_ptr: *process.FdEntry, buf_ptr: u64, count: u64) u64 {
     var text_buf: [4096]u8 = undefined;
     var pos: usize = 0;
 
-    // One line per online core: "core_id ctx_switches interrupts syscalls idle_ticks"
+    // One line per online core: "core_id ctx_switches interrupts syscalls idle_ticks ipc_handoffs"
     var i: u8 = 0;
     while (i < percpu.cores_online) : (i += 1) {
         const pc = &percpu.percpu_array[i];
@@ -1122,6 +1296,12 @@ fn sysstatRead(entry_ptr: *process.FdEntry, buf_ptr: u64, count: u64) u64 {
         var dec5: [20]u8 = undefined;
         const idle_str = fmtDecimal(pc.idle_ticks, &dec5);
         pos = appendStr(&text_buf, pos, idle_str);
+        pos = appendStr(&text_buf, pos, " ");
+
+        // ipc_handoffs
+        var dec6: [20]u8 = undefined;
+        const ho_str = fmtDecimal(pc.ipc_handoffs, &dec6);
+        pos = appendStr(&text_buf, pos, ho_str);
         pos = appendStr(&text_buf, pos, "\n");
     }
 
@@ -1138,9 +1318,9 @@ fn sysstatRead(entry_ptr: *process.FdEntry, buf_ptr: u64, count: u64) u64 {
 
 fn devRandomFill(buf: []u8) void {
     var state = dev_random_state;
-    // Seed from timer ticks on first call for some entropy
+    // Seed from the clock on first call for some entropy
     if (state == 0x853c49e6748fea9b) {
-        state ^= timer.getTicks();
+        state ^= timer.now();
         if (state == 0) state = 0x853c49e6748fea9b;
     }
     var i: usize = 0;
@@ -1396,14 +1576,14 @@ fn etherRead(proc: *process.Process, fd_num: u64, entry_ptr: *process.FdEntry, b
         proc.ipc_recv_buf_ptr = buf_ptr;
         // Stash fd number in pending_fd, max count in syscall_ret (net_read pattern)
         proc.pending_fd = @intCast(fd_num);
-        proc.syscall_ret = @min(count, ether_mod.MAX_FRAME);
+        proc.syscall_ret = @min(count, ether_mod.maxRead(client_idx));
         proc.state = .blocked;
         process.scheduleNext();
     }
     // Data available — read directly
     const dest: [*]u8 = @ptrFromInt(buf_ptr);
-    const max_bytes: usize = @intCast(@min(count, ether_mod.MAX_FRAME));
-    return ether_mod.readFrame(client_idx, dest[0..max_bytes]);
+    const max_bytes: usize = @intCast(@min(count, ether_mod.maxRead(client_idx)));
+    return ether_mod.read(client_idx, dest[0..max_bytes]);
 }
 
 fn procWrite(entry: process.FdEntry, buf_ptr: u64, count: u64) u64 {
@@ -1501,6 +1681,15 @@ fn procWrite(entry: process.FdEntry, buf_ptr: u64, count: u64) u64 {
         return len;
     }
 
+    // "pri server|interactive|batch" — set scheduling priority
+    if (cmd_len >= 5 and buf[0] == 'p' and buf[1] == 'r' and buf[2] == 'i' and buf[3] == ' ') {
+        const target = process.getByPid(entry.proc_pid) orelse return ENOENT;
+        const pri = std.meta.stringToEnum(@import("percpu.zig").Priority, buf[4..cmd_len]) orelse return EINVAL;
+        // Takes effect the next time the process is queued
+        target.priority = pri;
+        return len;
+    }
+
     // "close N" — close fd N in target process
     if (cmd_len >= 7 and buf[0] == 'c' and buf[1] == 'l' and buf[2] == 'o' and
         buf[3] == 's' and buf[4] == 'e' and buf[5] == ' ')
@@ -1610,6 +1799,9 @@ fn sysOpen(path_ptr: u64, path_len: u64) u64 {
         if (strEql(path_slice, "/dev/sysstat")) {
             return proc.allocDevFd(.dev_sysstat) orelse return EMFILE;
         }
+        if (trace.enabled and strEql(path_slice, "/dev/trace")) {
+            return proc.allocDevFd(.dev_trace) orelse return EMFILE;
+        }
     }
 
     // Intercept /net/* paths for kernel TCP/DNS — only when no userspace netd is mounted.
@@ -1660,6 +1852,16 @@ fn sysOpen(path_ptr: u64, path_len: u64) u64 {
             return proc.allocProcFd(.meminfo, 0) orelse return EMFILE;
         }
 
+        // "/proc/slabinfo"
+        if (strEql(suffix, "slabinfo")) {
+            return proc.allocProcFd(.slabinfo, 0) orelse return EMFILE;
+        }
+
+        // "/proc/lockstat"
+        if (strEql(suffix, "lockstat")) {
+            return proc.allocProcFd(.lockstat, 0) orelse return EMFILE;
+        }
+
         // Parse PID: digits until '/' or end
         var pid: u32 = 0;
         var i: usize = 0;
@@ -1722,9 +1924,7 @@ fn sysOpen(path_ptr: u64, path_len: u64) u64 {
     // Pre-set return value (overridden on error in reply handler)
     proc.syscall_ret = fd;
 
-    sendToServer(chan, proc);
-    proc.state = .blocked;
-    process.scheduleNext();
+    return sendToServer(chan, proc);
 }
 
 /// create(path_ptr, path_len, flags) → fd
@@ -1760,9 +1960,7 @@ fn sysCreate(path_ptr: u64, path_len: u64, flags: u64) u64 {
 
     proc.syscall_ret = fd;
 
-    sendToServer(chan, proc);
-    proc.state = .blocked;
-    process.scheduleNext();
+    return sendToServer(chan, proc);
 }
 
 /// read(fd, buf, count) → bytes_read
@@ -1807,16 +2005,16 @@ fn sysRead(fd: u64, buf_ptr: u64, count: u64) u64 {
     // Pipe fd: read from pipe buffer
     if (entry_ptr.fd_type == .pipe) {
         const dest: [*]u8 = @ptrFromInt(buf_ptr);
-        const n = @min(count, 4096);
+        const n = @min(count, pipe_mod.MAX_TRANSFER);
         if (pipe_mod.pipeRead(entry_ptr.pipe_id, dest[0..n])) |bytes| {
             return bytes;
         }
         // Block — no data available yet
-        pipe_mod.setReadWaiter(entry_ptr.pipe_id, @intCast(proc.pid));
         proc.pending_op = .pipe_read;
         proc.pending_fd = @intCast(fd);
         proc.ipc_recv_buf_ptr = buf_ptr;
         proc.syscall_ret = n;
+        pipe_mod.setReadWaiter(entry_ptr.pipe_id, proc);
         proc.state = .blocked;
         process.scheduleNext();
     }
@@ -1911,6 +2109,10 @@ fn sysRead(fd: u64, buf_ptr: u64, count: u64) u64 {
     if (entry_ptr.fd_type == .dev_sysstat) {
         return sysstatRead(entry_ptr, buf_ptr, count);
     }
+    if (entry_ptr.fd_type == .dev_trace) {
+        // Whole binary events; 0 until more are recorded
+        return trace.read(@ptrFromInt(buf_ptr), @intCast(count));
+    }
 
     const chan = ipc.getChannel(entry_ptr.channel_id) orelse return EBADF;
 
@@ -1929,7 +2131,11 @@ fn sysRead(fd: u64, buf_ptr: u64, count: u64) u64 {
 
     // Server-backed fd: T_READ with [handle: u32][offset: u32][count: u32]
     if (entry_ptr.server_handle > 0) {
-        const read_count: u32 = @intCast(@min(count, ipc.MAX_MSG_DATA));
+        // Counts above MAX_MSG_DATA on a grant channel are a bulk read: the
+        // server writes straight into the caller's buffer via ipc_grant and
+        // replies with just the byte count
+        const bulk = chan.grants and count > ipc.MAX_MSG_DATA;
+        const read_count: u32 = @intCast(@min(count, if (bulk) ipc.MAX_GRANT else ipc.MAX_MSG_DATA));
 
         proc.ipc_msg = ipc.Message.init(.t_read);
         writeU32LE(proc.ipc_msg.data_buf[0..4], entry_ptr.server_handle);
@@ -1939,11 +2145,14 @@ fn sysRead(fd: u64, buf_ptr: u64, count: u64) u64 {
 
         proc.pending_op = .read;
         proc.pending_fd = @intCast(fd);
-        proc.ipc_recv_buf_ptr = buf_ptr;
+        if (bulk) {
+            setGrant(proc, buf_ptr, read_count, true);
+            proc.ipc_recv_buf_ptr = 0;
+        } else {
+            proc.ipc_recv_buf_ptr = buf_ptr;
+        }
 
-        sendToServer(chan, proc);
-        proc.state = .blocked;
-        process.scheduleNext();
+        return sendToServer(chan, proc);
     }
 
     // Raw IPC read (existing behavior)
@@ -1955,9 +2164,7 @@ fn sysRead(fd: u64, buf_ptr: u64, count: u64) u64 {
     proc.pending_op = .none;
     proc.ipc_recv_buf_ptr = buf_ptr;
 
-    sendToServer(chan, proc);
-    proc.state = .blocked;
-    process.scheduleNext();
+    return sendToServer(chan, proc);
 }
 
 fn sysPread(fd: u64, buf_ptr: u64, count: u64, offset: u64) u64 {
@@ -1984,22 +2191,12 @@ fn sysPread(fd: u64, buf_ptr: u64, count: u64, offset: u64) u64 {
     // Block device: offset and count must be 4096-aligned
     if (real_offset % 4096 != 0 or actual_count % 4096 != 0) return EINVAL;
 
-    const block_start = real_offset / 4096;
-    const block_count = actual_count / 4096;
-    var bytes_read: u64 = 0;
-    var i: u64 = 0;
+    if (actual_count > 0x0000_8000_0000_0000 - buf_ptr) return EFAULT;
 
-    while (i < block_count) : (i += 1) {
-        const dest: [*]u8 = @ptrFromInt(buf_ptr + i * 4096);
-        const buf: *[4096]u8 = @ptrCast(dest);
-        if (!virtio_blk.readBlock(block_start + i, buf)) {
-            if (bytes_read > 0) return bytes_read;
-            return EIO;
-        }
-        bytes_read += 4096;
-    }
-
-    return bytes_read;
+    // Submit the blocks and sleep until the IRQ completes them; data is
+    // copied to buf_ptr in switchTo (virtio_blk.resumeBatch)
+    if (!virtio_blk.startBatch(proc, false, buf_ptr, real_offset / 4096, actual_count / 4096)) return EIO;
+    process.scheduleNext();
 }
 
 fn sysPwrite(fd: u64, buf_ptr: u64, count: u64, offset: u64) u64 {
@@ -2026,22 +2223,12 @@ fn sysPwrite(fd: u64, buf_ptr: u64, count: u64, offset: u64) u64 {
     // Block device: offset and count must be 4096-aligned
     if (real_offset % 4096 != 0 or actual_count % 4096 != 0) return EINVAL;
 
-    const block_start = real_offset / 4096;
-    const block_count = actual_count / 4096;
-    var bytes_written: u64 = 0;
-    var i: u64 = 0;
-
-    while (i < block_count) : (i += 1) {
-        const src: [*]const u8 = @ptrFromInt(buf_ptr + i * 4096);
-        const buf: *const [4096]u8 = @ptrCast(src);
-        if (!virtio_blk.writeBlock(block_start + i, buf)) {
-            if (bytes_written > 0) return bytes_written;
-            return EIO;
-        }
-        bytes_written += 4096;
-    }
+    if (actual_count > 0x0000_8000_0000_0000 - buf_ptr) return EFAULT;
 
-    return bytes_written;
+    // Data is copied into DMA pages as each round is submitted; the caller
+    // sleeps until the IRQ completes the whole transfer
+    if (!virtio_blk.startBatch(proc, true, buf_ptr, real_offset / 4096, actual_count / 4096)) return EIO;
+    process.scheduleNext();
 }
 
 fn sysKlog(buf_ptr: u64, buf_len: u64, offset: u64) u64 {
@@ -2064,21 +2251,62 @@ fn sysSysinfo(info_ptr: u64) u64 {
     ptr[0] = pmm.getTotalPages();
     ptr[1] = pmm.getFreePages();
     ptr[2] = 4096;
-    ptr[3] = timer.getTicks() / timer.TICKS_PER_SEC;
+    ptr[3] = timer.now() / timer.NS_PER_SEC;
     return 0;
 }
 
 fn sysSleep(ms: u64) u64 {
+    return sysSleepNs(ms *| 1_000_000);
+}
+
+/// sleep_ns(ns): block for at least `ns` nanoseconds (to the timer wheel's
+/// ~65 µs resolution).
+fn sysSleepNs(ns: u64) u64 {
     const proc = process.getCurrent() orelse return EFAULT;
 
-    // At least 1 tick, even for small ms values
-    const ticks_to_sleep: u32 = @intCast(@max(1, ms * timer.TICKS_PER_SEC / 1000));
-    proc.sleep_until = timer.getTicks() +% ticks_to_sleep;
+    proc.sleep_until = @max(timer.now() +| ns, 1);
     proc.pending_op = .sleep;
     proc.state = .blocked;
+    timer.arm(&proc.wake_timer, proc.sleep_until);
     process.scheduleNext();
 }
 
+/// clock_ns() → nanoseconds since boot on the monotonic clock.
+fn sysClockNs() u64 {
+    return timer.now();
+}
+
+/// svc_state() → address of the caller's service state region, or ENOENT
+/// if it isn't a supervised service with one (see supervisor.zig).
+fn sysSvcState() u64 {
+    const proc = process.getCurrent() orelse return ENOSYS;
+    if (!supervisor.hasStateRegion(proc)) return ENOENT;
+    return mem.SERVICE_STATE_BASE;
+}
+
+/// svc_standby() → 0 once the caller is its service's active instance.
+/// A hot standby blocks here until the supervisor promotes it; anyone
+/// else returns at once.
+fn sysSvcStandby() u64 {
+    const proc = process.getCurrent() orelse return ENOSYS;
+    if (!supervisor.parkStandby(proc)) return 0;
+    process.scheduleNext();
+}
+
+/// ring_setup(entries) → ring base address, or negative error.
+/// Maps a submission/completion ring with `entries` SQEs (see ring.zig).
+fn sysRingSetup(entries: u64) u64 {
+    const proc = process.getCurrent() orelse return ENOSYS;
+    return ring.setup(proc, entries);
+}
+
+/// ring_enter(to_submit, min_complete) → SQEs consumed, or negative error.
+/// Blocks until `min_complete` of them (or all in flight) have completed.
+fn sysRingEnter(to_submit: u64, min_complete: u64) u64 {
+    const proc = process.getCurrent() orelse return ENOSYS;
+    return ring.enter(proc, to_submit, min_complete);
+}
+
 fn sysShutdown(flags: u64) noreturn {
     const cpu = switch (@import("builtin").cpu.arch) {
         .x86_64 => @import("arch/x86_64/cpu.zig"),
@@ -2213,9 +2441,7 @@ fn sysClose(fd: u64) u64 {
         proc.pending_op = .close;
         proc.pending_fd = @intCast(fd);
 
-        sendToServer(chan, proc);
-        proc.state = .blocked;
-        process.scheduleNext();
+        return sendToServer(chan, proc);
     }
 
     // Non-server fd: just close locally
@@ -2314,9 +2540,7 @@ fn sysStat(fd: u64, stat_buf_ptr: u64) u64 {
         proc.pending_fd = @intCast(fd);
         proc.ipc_recv_buf_ptr = stat_buf_ptr;
 
-        sendToServer(chan, proc);
-        proc.state = .blocked;
-        process.scheduleNext();
+        return sendToServer(chan, proc);
     }
 
     return EBADF;
@@ -2352,9 +2576,7 @@ fn sysRemove(path_ptr: u64, path_len: u64) u64 {
     proc.pending_fd = 0;
     proc.syscall_ret = 0;
 
-    sendToServer(chan, proc);
-    proc.state = .blocked;
-    process.scheduleNext();
+    return sendToServer(chan, proc);
 }
 
 /// rename(old_path_ptr, old_path_len, new_path_ptr, new_path_len) → 0 or negative error.
@@ -2398,9 +2620,7 @@ fn sysRename(old_ptr: u64, old_len: u64, new_ptr: u64, new_len: u64) u64 {
     proc.pending_fd = 0;
     proc.syscall_ret = 0;
 
-    sendToServer(chan, proc);
-    proc.state = .blocked;
-    process.scheduleNext();
+    return sendToServer(chan, proc);
 }
 
 /// truncate(fd, new_size) → 0 or negative error.
@@ -2422,9 +2642,7 @@ fn sysTruncate(fd: u64, new_size: u64) u64 {
     proc.pending_fd = @intCast(fd);
     proc.syscall_ret = 0;
 
-    sendToServer(chan, proc);
-    proc.state = .blocked;
-    process.scheduleNext();
+    return sendToServer(chan, proc);
 }
 
 /// wstat(fd, mode, uid, gid, mask) → 0 or negative error.
@@ -2450,9 +2668,7 @@ fn sysWstat(fd: u64, mode: u64, uid: u64, gid: u64, mask: u64) u64 {
     proc.pending_fd = @intCast(fd);
     proc.syscall_ret = 0;
 
-    sendToServer(chan, proc);
-    proc.state = .blocked;
-    process.scheduleNext();
+    return sendToServer(chan, proc);
 }
 
 /// setuid(uid, gid) — set process uid and gid. Only root (uid 0) can call this.
@@ -2522,12 +2738,13 @@ fn sysMmap(addr_hint: u64, length: u64, prot: u64, flags: u64) u64 {
     return base;
 }
 
-/// SYS 33: munmap — Unmap memory region.
-/// Currently a no-op (acceptable leak for Phase 1000).
+/// SYS 33: munmap — Unmap memory region and free its pages. Holes in the
+/// range are skipped; the address space is not reused (mmap bumps).
 fn sysMunmap(addr: u64, length: u64) u64 {
-    _ = addr;
-    _ = length;
-    // Don't free physical pages — acceptable for single-threaded POSIX programs.
+    const proc = process.getCurrent() orelse return ENOSYS;
+    if (length == 0 or addr & (mem.PAGE_SIZE - 1) != 0) return EINVAL;
+    if (addr >= 0x0000_8000_0000_0000 or length > 0x0000_8000_0000_0000 - addr) return EINVAL;
+    process.unmapUserPages(proc, addr, (length + mem.PAGE_SIZE - 1) / mem.PAGE_SIZE);
     return 0;
 }
 
@@ -2630,6 +2847,8 @@ fn sysClone(stack_top: u64, tls: u64, ctid_ptr: u64, ptid_ptr: u64, flags: u64)
     child.syscall_ret = 0; // child sees RAX=0
     child.saved_kernel_rsp = 0; // first-run via IRETQ
     child.fs_base = tls; // new thread's TLS (CLONE_SETTLS)
+    process.syncFpu(parent);
+    child.fpu = parent.fpu;
 
     // CLONE_CHILD_CLEARTID: store ctid_ptr for futex wake on exit
     if (ctid_ptr != 0) {
@@ -2655,22 +2874,28 @@ fn sysClone(stack_top: u64, tls: u64, ctid_ptr: u64, ptid_ptr: u64, flags: u64)
     return child.pid;
 }
 
-/// futex(addr, op, val, timeout) — placeholder, implemented in Phase J
-fn sysFutex(addr: u64, op: u64, val: u64, timeout: u64) u64 {
-    _ = timeout;
+/// futex(addr, op, val, timeout, addr2)
+///   FUTEX_WAIT:    block while *addr == val; timeout in ms (0 = none).
+///   FUTEX_WAKE:    wake up to val waiters on addr.
+///   FUTEX_REQUEUE: wake up to val waiters on addr, move up to `timeout`
+///                  more onto addr2.
+fn sysFutex(addr: u64, op: u64, val: u64, timeout: u64, addr2: u64) u64 {
     const futex_mod = @import("futex.zig");
     const proc = process.getCurrent() orelse return ENOSYS;
 
     const FUTEX_WAIT: u64 = 0;
     const FUTEX_WAKE: u64 = 1;
+    const FUTEX_REQUEUE: u64 = 3;
     const FUTEX_PRIVATE_FLAG: u64 = 128;
 
     const raw_op = op & ~FUTEX_PRIVATE_FLAG;
 
     if (raw_op == FUTEX_WAIT) {
-        return futex_mod.wait(proc, addr, @truncate(val));
+        return futex_mod.wait(proc, addr, @truncate(val), timeout);
     } else if (raw_op == FUTEX_WAKE) {
         return futex_mod.wake(proc, addr, @truncate(val));
+    } else if (raw_op == FUTEX_REQUEUE) {
+        return futex_mod.requeue(proc, addr, @truncate(val), addr2, @truncate(timeout));
     }
     return ENOSYS;
 }
@@ -2728,13 +2953,13 @@ fn sysRfork(flags: u64) u64 {
         const stack_base: u64 = pmm.allocContiguousPages(process.KERNEL_STACK_PAGES) orelse return ENOMEM;
         const stack_virt = if (paging.isInitialized()) stack_base + mem.KERNEL_VIRT_BASE else stack_base;
 
-        // Address space: deep-copy or share
+        // Address space: copy-on-write clone or share
         if (flags & RFMEM != 0) {
             // Share address space (vfork-like)
             child.pml4 = parent.pml4;
         } else {
-            // Full deep copy (fork)
-            child.pml4 = paging.deepCopyAddressSpace(parent.pml4.?) orelse return ENOMEM;
+            // Copy-on-write (fork): pages are copied on first write
+            child.pml4 = process.forkAddressSpace(parent) orelse return ENOMEM;
         }
 
         // Set up child process state
@@ -2748,6 +2973,8 @@ fn sysRfork(flags: u64) u64 {
         child.brk = parent.brk;
         child.mmap_next = parent.mmap_next;
         child.fs_base = parent.fs_base;
+        process.syncFpu(parent);
+        child.fpu = parent.fpu;
         child.uid = parent.uid;
         child.gid = parent.gid;
         child.vt = parent.vt;
@@ -2762,6 +2989,10 @@ fn sysRfork(flags: u64) u64 {
         child.quotas = .{};
         child.ipc_recv_buf_ptr = 0;
         child.ipc_pending_msg = null;
+        child.ipc_serving_tagged = null;
+        child.ipc_done.release();
+        child.ring.release();
+        child.ipc_grant_len = 0;
         child.thread_group = null;
         child.ctid_ptr = 0;
         child.ipc_msg = ipc.Message.init(.t_open);
@@ -2786,6 +3017,7 @@ fn sysRfork(flags: u64) u64 {
         child.assigned_core = process.leastLoadedCore();
         child.core_affinity = -1;
         child.cores_ran_on = 0;
+        child.priority = parent.priority;
 
         // Mark ready — child will be scheduled
         process.markReady(child);
@@ -2825,6 +3057,10 @@ fn sysIpcRecv(fd: u64, msg_buf_ptr: u64) u64 {
 
     const chan = ipc.getChannel(entry.channel_id) orelse return EBADF;
 
+    // Serving IPC makes this a server thread: it runs ahead of other work
+    // unless it was explicitly set to batch.
+    if (proc.priority == .interactive) proc.priority = .server;
+
     chan.lock.lock();
 
     // Check for pending message from client ring buffer
@@ -2835,7 +3071,11 @@ fn sysIpcRecv(fd: u64, msg_buf_ptr: u64) u64 {
         }
         // Track which client we're serving so sysIpcReply knows who to wake
         proc.ipc_serving_client = pending_entry.pid;
+        proc.ipc_serving_tagged = pending_entry.tagged;
+        trace.point(.ipc_recv, proc.pid, pending_entry.pid, 0);
         chan.lock.unlock();
+        // Not blocking, so a client handed off by the last reply must queue
+        process.flushHandoff();
         return 0;
     }
 
@@ -2868,14 +3108,52 @@ fn sysIpcReply(fd: u64, reply_msg_ptr: u64) u64 {
 
     const reply_tag = reply_tag_ptr.*;
     const reply_data_len = @min(reply_len_ptr.*, ipc.MAX_MSG_DATA);
+    const client_pid = proc.ipc_serving_client;
+    const tagged = proc.ipc_serving_tagged;
+    if (trace.enabled) {
+        trace.point(.ipc_reply, proc.pid, if (tagged) |tr| tr.node.entry.pid else client_pid, reply_tag);
+    }
+
+    proc.ipc_serving_client = 0;
+    proc.ipc_serving_tagged = null;
+    completeRequest(client_pid, tagged, reply_tag, reply_data_ptr[0..reply_data_len]);
+    return 0;
+}
+
+/// A server thread died holding a request (see supervisor.zig): complete
+/// it with R_ERROR, as if the server had replied with an error.
+pub fn failRequest(client_pid: u32, tagged: ?*ipc.TaggedRequest) void {
+    completeRequest(client_pid, tagged, @intFromEnum(ipc.Tag.r_error), &.{});
+}
+
+/// Deliver a server's reply to the request it was serving: the sync
+/// client `client_pid` or the tagged request `tagged`.
+fn completeRequest(client_pid: u32, tagged: ?*ipc.TaggedRequest, reply_tag: u32, reply: []const u8) void {
+    const reply_data_ptr = reply.ptr;
+    const reply_data_len: u32 = @intCast(reply.len);
+
+    // Tagged request: store the reply and queue it for the client's ipc_collect
+    if (tagged) |tr| {
+        tr.msg.tag = std.meta.intToEnum(ipc.Tag, reply_tag) catch .r_error;
+        tr.msg.data_len = reply_data_len;
+        @memcpy(tr.msg.data_buf[0..reply_data_len], reply_data_ptr[0..reply_data_len]);
+        const client = process.getByPid(tr.node.entry.pid) orelse {
+            ipc.freeTagged(tr);
+            return;
+        };
+        // Ring operations are reaped by ring_enter, not ipc_collect
+        const done = if (tr.ring.op == 0) &client.ipc_done else &client.ring.done;
+        if (tr.ring.op != 0 and tr.ring.gen != client.ring.gen) {
+            ipc.freeTagged(tr);
+            return;
+        }
+        if (done.push(tr)) process.handoff(client);
+        return;
+    }
 
     // Find the client being served by this server thread
-    const serving_pid = proc.ipc_serving_client;
-    if (serving_pid == 0) return 0;
-    const client_proc = process.getByPid(serving_pid) orelse {
-        proc.ipc_serving_client = 0;
-        return 0;
-    };
+    if (client_pid == 0) return;
+    const client_proc = process.getByPid(client_pid) orelse return;
 
     const is_ok = reply_tag == @intFromEnum(ipc.Tag.r_ok);
 
@@ -2892,7 +3170,17 @@ fn sysIpcReply(fd: u64, reply_msg_ptr: u64) u64 {
             }
         },
         .read => {
-            if (is_ok) {
+            if (is_ok and client_proc.ipc_grant_len > 0) {
+                // Bulk read: data is already in the client's buffer
+                const n: u32 = if (reply_data_len >= 4)
+                    @min(readU32LE(reply_data_ptr[0..4]), client_proc.ipc_grant_len)
+                else
+                    0;
+                client_proc.syscall_ret = n;
+                if (client_proc.getFdEntryPtr(client_proc.pending_fd)) |fd_entry| {
+                    fd_entry.read_offset += n;
+                }
+            } else if (is_ok) {
                 if (reply_data_len > 0 and client_proc.ipc_recv_buf_ptr != 0) {
                     client_proc.ipc_msg = ipc.Message.init(.r_ok);
                     client_proc.ipc_msg.data_len = reply_data_len;
@@ -2909,7 +3197,12 @@ fn sysIpcReply(fd: u64, reply_msg_ptr: u64) u64 {
             }
         },
         .write => {
-            if (is_ok and reply_data_len >= 4) {
+            if (is_ok and client_proc.ipc_grant_len > 0) {
+                client_proc.syscall_ret = if (reply_data_len >= 4)
+                    @min(readU32LE(reply_data_ptr[0..4]), client_proc.ipc_grant_len)
+                else
+                    0;
+            } else if (is_ok and reply_data_len >= 4) {
                 client_proc.syscall_ret = readU32LE(reply_data_ptr[0..4]);
             } else if (is_ok) {
                 client_proc.syscall_ret = if (client_proc.ipc_msg.data_len > 4)
@@ -2920,6 +3213,29 @@ fn sysIpcReply(fd: u64, reply_msg_ptr: u64) u64 {
                 client_proc.syscall_ret = EIO;
             }
         },
+        .splice_read => {
+            // The reply data goes straight into the splice's pipe
+            const pipe_mod = @import("pipe.zig");
+            client_proc.syscall_ret = if (!is_ok) EIO else if (reply_data_len == 0) 0 else blk: {
+                const pipe_fd = client_proc.getFdEntryPtr(client_proc.splice_fd) orelse break :blk EBADF;
+                const n = pipe_mod.pipeWrite(pipe_fd.pipe_id, reply_data_ptr[0..reply_data_len]) orelse break :blk EAGAIN;
+                if (n == pipe_mod.EPIPE) break :blk n;
+                if (client_proc.getFdEntryPtr(client_proc.pending_fd)) |fd_entry| {
+                    fd_entry.read_offset += @intCast(n);
+                }
+                break :blk n;
+            };
+        },
+        .splice_write => {
+            // Only what the server wrote leaves the splice's pipe
+            const pipe_mod = @import("pipe.zig");
+            const sent = client_proc.ipc_msg.data_len -| 4;
+            const n: u32 = if (!is_ok) 0 else if (reply_data_len >= 4) @min(readU32LE(reply_data_ptr[0..4]), sent) else sent;
+            if (client_proc.getFdEntryPtr(client_proc.splice_fd)) |pipe_fd| {
+                pipe_mod.consume(pipe_fd.pipe_id, n);
+            }
+            client_proc.syscall_ret = if (is_ok) n else EIO;
+        },
         .close => {
             client_proc.closeFd(client_proc.pending_fd);
             client_proc.syscall_ret = 0;
@@ -2943,7 +3259,7 @@ fn sysIpcReply(fd: u64, reply_msg_ptr: u64) u64 {
         .truncate, .wstat => {
             client_proc.syscall_ret = if (is_ok) 0 else EIO;
         },
-        .console_read, .net_read, .net_connect, .net_listen, .dns_query, .icmp_read, .pipe_read, .pipe_write, .sleep, .ether_read => {},
+        .console_read, .net_read, .net_connect, .net_listen, .dns_query, .icmp_read, .pipe_read, .pipe_write, .sleep, .ether_read, .blk_read, .blk_write, .ipc_collect, .futex_wait, .splice, .standby, .ring_enter => {},
         .none => {
             if (is_ok) {
                 if (client_proc.ipc_recv_buf_ptr != 0 and reply_data_len > 0) {
@@ -2968,12 +3284,293 @@ fn sysIpcReply(fd: u64, reply_msg_ptr: u64) u64 {
     if ((client_proc.pending_op != .read and client_proc.pending_op != .stat) or client_proc.ipc_pending_msg == null) {
         client_proc.pending_op = .none;
     }
-    process.markReady(client_proc);
-    proc.ipc_serving_client = 0;
+    client_proc.ipc_grant_len = 0;
+    // Usually followed by ipc_recv blocking, which switches straight back
+    process.handoff(client_proc);
+}
+
+/// ipc_submit(fd, msg_ptr, cookie) → 0, or negative error. Non-blocking.
+/// Posts a copy of the IpcMessage at msg_ptr as a tagged request on channel
+/// fd. The reply is fetched later with ipc_collect, tagged with `cookie`.
+/// Up to ipc.MAX_TAGGED requests may be outstanding per process.
+fn sysIpcSubmit(fd: u64, msg_ptr: u64, cookie: u64) u64 {
+    const proc = process.getCurrent() orelse return ENOSYS;
+    const entry = proc.getFdEntry(@intCast(fd)) orelse return EBADF;
+    if (msg_ptr == 0 or msg_ptr >= 0x0000_8000_0000_0000) return EFAULT;
 
+    const chan = ipc.getChannel(entry.channel_id) orelse return EBADF;
+    if (chan.kernel_data != null) return EINVAL;
+
+    const tag_ptr: *align(1) const u32 = @ptrFromInt(msg_ptr);
+    const len_ptr: *align(1) const u32 = @ptrFromInt(msg_ptr + 4);
+    const data_ptr: [*]const u8 = @ptrFromInt(msg_ptr + 8);
+    const tag = std.meta.intToEnum(ipc.Tag, tag_ptr.*) catch return EINVAL;
+    const len = len_ptr.*;
+    if (len > ipc.MAX_MSG_DATA) return EINVAL;
+
+    if (!proc.ipc_done.reserve()) return EAGAIN;
+    const tr = ipc.allocTagged(proc.pid, cookie) orelse {
+        proc.ipc_done.unreserve();
+        return ENOMEM;
+    };
+    tr.msg = ipc.Message.init(tag);
+    tr.msg.data_len = len;
+    @memcpy(tr.msg.data_buf[0..len], data_ptr[0..len]);
+
+    if (!postTagged(chan, tr)) {
+        proc.ipc_done.unreserve();
+        ipc.freeTagged(tr);
+        return EBADF;
+    }
     return 0;
 }
 
+/// Queue tagged request `tr` on `chan` and wake a server thread for it.
+/// False if the channel is closed; the caller still owns `tr` then.
+pub fn postTagged(chan: *ipc.Channel, tr: *ipc.TaggedRequest) bool {
+    chan.lock.lock();
+    defer chan.lock.unlock();
+    if (chan.state != .open) return false;
+    chan.client.enqueueTagged(tr);
+    wakeServer(chan, false);
+    return true;
+}
+
+/// ipc_collect(msg_ptr, cookie_ptr) → 0, or negative error.
+/// Waits for the next tagged reply (in completion order, from any channel),
+/// copies it to the IpcMessage at msg_ptr and its cookie to cookie_ptr.
+/// EINVAL if nothing is outstanding.
+fn sysIpcCollect(msg_ptr: u64, cookie_ptr: u64) u64 {
+    const proc = process.getCurrent() orelse return ENOSYS;
+    if (msg_ptr == 0 or msg_ptr >= 0x0000_8000_0000_0000) return EFAULT;
+    if (cookie_ptr >= 0x0000_8000_0000_0000) return EFAULT;
+
+    proc.ipc_recv_buf_ptr = msg_ptr;
+    proc.ipc_collect_cookie_ptr = cookie_ptr;
+    // Blocked before checking, so a completion on another core that finds
+    // us waiting can't mark us ready before we block
+    proc.pending_op = .ipc_collect;
+    proc.state = .blocked;
+    const result = process.collectTagged(proc);
+    if (result != .wait) {
+        proc.state = .running;
+        proc.pending_op = .none;
+        proc.ipc_recv_buf_ptr = 0;
+        proc.ipc_collect_cookie_ptr = 0;
+        return if (result == .delivered) 0 else EINVAL;
+    }
+
+    // Retried in switchTo when a reply completes
+    process.scheduleNext();
+}
+
+/// splice(fd_in, fd_out, len) → bytes moved, 0 at end of input, or
+/// negative error. Moves up to `len` bytes between a pipe and a kernel TCP
+/// data fd or a server-backed file without copying them through user
+/// space. When the pipe or peer is not ready it blocks until it is, then
+/// returns EAGAIN so the caller retries (lib's splice() does).
+fn sysSplice(fd_in: u64, fd_out: u64, len: u64) u64 {
+    const pipe_mod = @import("pipe.zig");
+    const tcp = @import("net.zig").tcp;
+    const proc = process.getCurrent() orelse return EBADF;
+    const in = proc.getFdEntryPtr(@intCast(fd_in)) orelse return EBADF;
+    const out = proc.getFdEntryPtr(@intCast(fd_out)) orelse return EBADF;
+    if (len == 0) return 0;
+    const max: usize = @intCast(@min(len, pipe_mod.MAX_TRANSFER));
+
+    // Set before registering as a waiter: it decides when we are woken
+    proc.pending_op = .splice;
+    proc.syscall_ret = max;
+
+    if (in.fd_type == .pipe and in.pipe_is_read and out.fd_type != .pipe) {
+        // Pipe → TCP
+        if (isTcpData(out)) {
+            const state = tcp.getState(out.net_conn) orelse return spliceDone(proc, EIO);
+            if (state != .established and state != .close_wait) return spliceDone(proc, EIO);
+            switch (pipe_mod.drainTo(in.pipe_id, max, out.net_conn, tcpSink)) {
+                .moved => |n| return spliceDone(proc, n),
+                .eof => return spliceDone(proc, 0),
+                .pipe_wait => pipe_mod.setReadWaiter(in.pipe_id, proc),
+                // Send buffer full; TCP has no send waiters, so poll per tick
+                .peer_wait => {
+                    proc.sleep_until = timer.now() + timer.TICK_NS;
+                    timer.arm(&proc.wake_timer, proc.sleep_until);
+                },
+                .broken => return spliceDone(proc, EIO),
+            }
+        } else if (out.fd_type == .ipc and out.server_handle > 0) {
+            // Pipe → file: T_WRITE [handle][data] filled from the ring
+            const chan = ipc.getChannel(out.channel_id) orelse return spliceDone(proc, EBADF);
+            proc.ipc_msg = ipc.Message.init(.t_write);
+            writeU32LE(proc.ipc_msg.data_buf[0..4], out.server_handle);
+            proc.ipc_msg.data_len = 4;
+            // Peeked, not drained: the reply says how much to consume
+            switch (pipe_mod.peekTo(in.pipe_id, @min(max, ipc.MAX_MSG_DATA - 4), &proc.ipc_msg, msgSink)) {
+                .moved => {
+                    proc.pending_op = .splice_write;
+                    proc.pending_fd = @intCast(fd_out);
+                    proc.splice_fd = @intCast(fd_in);
+                    return sendToServer(chan, proc);
+                },
+                .eof => return spliceDone(proc, 0),
+                .pipe_wait => pipe_mod.setReadWaiter(in.pipe_id, proc),
+                .peer_wait, .broken => return spliceDone(proc, EIO),
+            }
+        } else {
+            return spliceDone(proc, EINVAL);
+        }
+    } else if (out.fd_type == .pipe and !out.pipe_is_read and in.fd_type != .pipe) {
+        // TCP → pipe
+        if (isTcpData(in)) {
+            var src: TcpSource = .{ .conn = in.net_conn, .waiter = @intCast(proc.pid) };
+            switch (pipe_mod.fillFrom(out.pipe_id, max, &src, tcpSource)) {
+                .moved => |n| return spliceDone(proc, n),
+                .eof => return spliceDone(proc, 0),
+                .broken => return spliceDone(proc, pipe_mod.EPIPE),
+                .pipe_wait => pipe_mod.setWriteWaiter(out.pipe_id, proc),
+                // Already registered as a read waiter by tcpSource
+                .peer_wait => {},
+            }
+        } else if (in.fd_type == .ipc and in.server_handle > 0) {
+            // File → pipe: T_READ sized to the pipe's free space; the
+            // reply is written into the pipe by sysIpcReply
+            const chan = ipc.getChannel(in.channel_id) orelse return spliceDone(proc, EBADF);
+            if (pipe_mod.writable(out.pipe_id, max)) |space| {
+                if (space == pipe_mod.EPIPE) return spliceDone(proc, pipe_mod.EPIPE);
+                const read_count: u32 = @intCast(@min(max, space, ipc.MAX_MSG_DATA));
+                proc.ipc_msg = ipc.Message.init(.t_read);
+                writeU32LE(proc.ipc_msg.data_buf[0..4], in.server_handle);
+                writeU32LE(proc.ipc_msg.data_buf[4..8], in.read_offset);
+                writeU32LE(proc.ipc_msg.data_buf[8..12], read_count);
+                proc.ipc_msg.data_len = 12;
+                proc.pending_op = .splice_read;
+                proc.pending_fd = @intCast(fd_in);
+                proc.splice_fd = @intCast(fd_out);
+                proc.ipc_recv_buf_ptr = 0;
+                return sendToServer(chan, proc);
+            }
+            pipe_mod.setWriteWaiter(out.pipe_id, proc);
+        } else {
+            return spliceDone(proc, EINVAL);
+        }
+    } else {
+        // Pipe to pipe is not supported: two splices in opposite directions
+        // would take the pipe locks in opposite order
+        return spliceDone(proc, EINVAL);
+    }
+
+    // Retried by the caller after switchTo hands back EAGAIN
+    proc.state = .blocked;
+    process.scheduleNext();
+}
+
+fn spliceDone(proc: *process.Process, ret: u64) u64 {
+    proc.pending_op = .none;
+    if (proc.sleep_until != 0) {
+        proc.sleep_until = 0;
+        timer.cancel(&proc.wake_timer);
+    }
+    return ret;
+}
+
+fn isTcpData(entry: *const process.FdEntry) bool {
+    return entry.fd_type == .net and entry.net_kind == .tcp_data;
+}
+
+fn tcpSink(conn: u8, data: []const u8) usize {
+    return @import("net.zig").tcp.sendData(conn, data);
+}
+
+/// Splice source state. The caller becomes a read waiter under the
+/// connection's lock when there is nothing to read, so data arriving
+/// before it blocks still wakes it. Only the first span registers: a
+/// second span coming up empty means some bytes were already moved.
+const TcpSource = struct {
+    conn: u8,
+    waiter: u16,
+};
+
+fn tcpSource(src: *TcpSource, buf: []u8) ?usize {
+    const n = @import("net.zig").tcp.recvOrWait(src.conn, buf, src.waiter);
+    src.waiter = 0;
+    if (n) |got| return got;
+    return null;
+}
+
+fn msgSink(msg: *ipc.Message, data: []const u8) usize {
+    @memcpy(msg.data_buf[msg.data_len..][0..data.len], data);
+    msg.data_len += @intCast(data.len);
+    return data.len;
+}
+
+/// Page-grant ops for ipc_grant().
+const GRANT_ENABLE = 0;
+const GRANT_READ = 1;
+const GRANT_WRITE = 2;
+
+/// Attach a grant of the caller's [va, va+len) to its next request. The
+/// buffer stays in the client's address space; the server reaches it only
+/// through ipc_grant while the client is blocked on the request.
+fn setGrant(proc: *process.Process, va: u64, len: u32, writable: bool) void {
+    proc.ipc_grant_va = va;
+    proc.ipc_grant_len = len;
+    proc.ipc_grant_writable = writable;
+}
+
+/// ipc_grant(fd, op, offset, buf_ptr, len) → bytes copied, or negative error.
+/// Server-side access to the buffer granted with the request being served on fd.
+///   GRANT_ENABLE: mark the channel as accepting bulk requests (other args unused).
+///   GRANT_READ:   copy grant[offset..] into buf (client write, read-only grant).
+///   GRANT_WRITE:  copy buf into grant[offset..] (client read, writable grant).
+/// fd must be the server end of the channel (EACCES otherwise).
+/// One kernel copy, page by page through the client's page tables — the
+/// client's pages are never mapped into the server.
+fn sysIpcGrant(fd: u64, op: u64, offset: u64, buf_ptr: u64, len: u64) u64 {
+    const proc = process.getCurrent() orelse return ENOSYS;
+    const entry = proc.getFdEntry(@intCast(fd)) orelse return EBADF;
+    const chan = ipc.getChannel(entry.channel_id) orelse return EBADF;
+    if (entry.fd_type != .ipc or !entry.is_server) return EACCES;
+
+    if (op == GRANT_ENABLE) {
+        chan.grants = true;
+        return 0;
+    }
+    if (op != GRANT_READ and op != GRANT_WRITE) return EINVAL;
+    if (buf_ptr >= 0x0000_8000_0000_0000 or len > 0x0000_8000_0000_0000 - buf_ptr) return EFAULT;
+
+    const client = process.getByPid(proc.ipc_serving_client) orelse return EINVAL;
+    if (client.ipc_grant_len == 0) return EINVAL;
+    if (client.ipc_grant_writable != (op == GRANT_WRITE)) return EINVAL;
+    if (offset >= client.ipc_grant_len) return 0;
+
+    const client_pml4 = (if (client.thread_group) |tg| tg.pml4 else client.pml4) orelse return EFAULT;
+    const n: usize = @intCast(@min(len, client.ipc_grant_len - offset));
+    const buf: [*]u8 = @ptrFromInt(buf_ptr);
+
+    var done: usize = 0;
+    while (done < n) {
+        const va = client.ipc_grant_va + offset + done;
+        const page_offset = va & 0xFFF;
+        const chunk = @min(n - done, mem.PAGE_SIZE - page_offset);
+
+        var mapped = paging.translateUser(client_pml4, va, op == GRANT_WRITE);
+        // The client's buffer may still be shared copy-on-write after a fork
+        if (mapped == null and op == GRANT_WRITE and process.breakCow(client, va)) {
+            mapped = paging.translateUser(client_pml4, va, true);
+        }
+        const phys = mapped orelse break;
+        const page: [*]u8 = paging.physPtr(phys & ~@as(u64, 0xFFF));
+        if (op == GRANT_WRITE) {
+            @memcpy(page[page_offset..][0..chunk], buf[done..][0..chunk]);
+        } else {
+            @memcpy(buf[done..][0..chunk], page[page_offset..][0..chunk]);
+        }
+        done += chunk;
+    }
+    if (done == 0 and n > 0) return EFAULT;
+    return done;
+}
+
 /// ipc_pair(result_ptr) → 0 on success, negative on error.
 /// Creates an IPC channel pair and returns two fds: [server_fd, client_fd].
 fn sysIpcPair(result_ptr: u64) u64 {
@@ -3032,16 +3629,16 @@ fn sysExec(elf_ptr: u64, elf_len: u64, argv_ptr: u64) u64 {
 
     // Validate pointer not in kernel space
     if (elf_ptr >= 0x0000_8000_0000_0000) return EFAULT;
-    if (elf_len == 0 or elf_len > 4 * 1024 * 1024) return EINVAL;
+    if (elf_len == 0 or elf_len > image.MAX_IMAGE_SIZE) return EINVAL;
 
     const elf_data: []const u8 = @as([*]const u8, @ptrFromInt(elf_ptr))[0..@intCast(elf_len)];
 
     // Create fresh address space (kernel mappings + identity map)
     const new_pml4 = paging.createAddressSpace() orelse return ENOMEM;
 
-    // Load ELF into new address space
+    // Load ELF into new address space, sharing the file pages
     // CR3 still has old PML4, so elf_data (user ptr) is readable
-    const load_result = elf.load(new_pml4, elf_data) catch {
+    const load_result = image.load(new_pml4, elf_data, proc) catch {
         // New PML4 + any partially allocated pages leaked (future cleanup)
         proc.state = .dead;
         process.scheduleNext(); // noreturn
@@ -3162,9 +3759,11 @@ fn sysExec(elf_ptr: u64, elf_len: u64, argv_ptr: u64) u64 {
     // === Point of no return: swap to new address space ===
     // Old PML4 + user pages freed
     if (proc.pml4) |old_pml4| {
+        tlb.retire(old_pml4);
         paging.freeAddressSpace(old_pml4);
     }
     proc.pml4 = new_pml4;
+    process.resetFpu(proc);
     proc.user_rip = load_result.entry_point;
     proc.user_rsp = mem.ARGV_BASE - 8;
     proc.user_rflags = switch (@import("builtin").cpu.arch) {
@@ -3176,6 +3775,7 @@ fn sysExec(elf_ptr: u64, elf_len: u64, argv_ptr: u64) u64 {
     proc.saved_kernel_rsp = 0; // Force IRETQ path in switchTo
     proc.syscall_ret = 0;
     proc.mmap_next = 0x0000_4000_0000_0000;
+    proc.ring.release();
 
     // Clear IPC state (old user buffers are gone)
     proc.ipc_pending_msg = null;
@@ -3224,7 +3824,7 @@ fn sysSpawn(elf_ptr: u64, elf_len: u64, fd_map_ptr: u64, fd_map_len: u64, argv_p
 
     // Validate ELF pointer
     if (elf_ptr >= 0x0000_8000_0000_0000) return EFAULT;
-    if (elf_len == 0 or elf_len > 4 * 1024 * 1024) return EINVAL;
+    if (elf_len == 0 or elf_len > image.MAX_IMAGE_SIZE) return EINVAL;
 
     // Validate fd map pointer
     if (fd_map_len > process.MAX_FDS) return EINVAL;
@@ -3236,7 +3836,7 @@ fn sysSpawn(elf_ptr: u64, elf_len: u64, fd_map_ptr: u64, fd_map_len: u64, argv_p
     const child = process.create() orelse return ENOMEM;
 
     // Load ELF into child's address space
-    const load_result = elf.load(child.pml4.?, elf_data) catch {
+    const load_result = image.load(child.pml4.?, elf_data, parent) catch {
         child.state = .dead;
         return ENOMEM;
     };
@@ -3273,7 +3873,7 @@ fn sysSpawn(elf_ptr: u64, elf_len: u64, fd_map_ptr: u64, fd_map_len: u64, argv_p
         };
 
         // Load interpreter into child's address space (at its own image_base, e.g., 0x20000000)
-        const interp_result = elf.load(child.pml4.?, interp_data) catch {
+        const interp_result = image.load(child.pml4.?, interp_data, null) catch {
             child.state = .dead;
             return ENOMEM;
         };
@@ -5,6 +5,7 @@ const paging = switch (@import("builtin").cpu.arch) {
     else => @import("arch/x86_64/paging.zig"),
 };
 const namespace = @import("namespace.zig");
+const tlb = @import("tlb.zig");
 const SpinLock = @import("spinlock.zig").SpinLock;
 const klog = @import("klog.zig");
 
@@ -34,10 +35,8 @@ pub const ThreadGroup = struct {
     brk: u64,
     /// PID of the thread group leader (first thread).
     leader_pid: u32,
-    /// Protects mmap_next, brk, cores_ran_on.
+    /// Protects mmap_next, brk.
     lock: SpinLock,
-    /// Union of all threads' TLB footprints for group-wide shootdown.
-    cores_ran_on: u128,
     /// Whether this slot is in use.
     active: bool,
 };
@@ -54,6 +53,7 @@ pub fn init() void {
         g.ref_count = 0;
         g.lock = .{};
     }
+    for (&namespaces) |*ns| ns.* = namespace.Namespace.init();
     for (&fd_tables) |*ft| {
         ft.ref_count = 0;
         ft.lock = .{};
@@ -99,7 +99,6 @@ pub fn createGroup(leader: *process.Process) ?*ThreadGroup {
     g.brk = leader.brk;
     g.leader_pid = leader.pid;
     g.lock = .{};
-    g.cores_ran_on = leader.cores_ran_on;
     g.active = true;
 
     // Update leader to point at the group
@@ -117,12 +116,9 @@ pub fn retainGroup(g: *ThreadGroup) void {
 
 /// Decrement reference count. When last thread exits, free the address space.
 /// Returns true if this was the last reference (address space freed).
-pub fn releaseGroup(g: *ThreadGroup, proc: *process.Process) bool {
+pub fn releaseGroup(g: *ThreadGroup) bool {
     g.lock.lock();
 
-    // Merge this thread's TLB footprint into the group
-    g.cores_ran_on |= proc.cores_ran_on;
-
     if (g.ref_count > 1) {
         g.ref_count -= 1;
         g.lock.unlock();
@@ -135,14 +131,15 @@ pub fn releaseGroup(g: *ThreadGroup, proc: *process.Process) bool {
     g.lock.unlock();
 
     if (pml4) |p| {
-        // TLB shootdown for all cores that ran any thread in this group
-        shootdownGroup(g);
-        // Switch to kernel page tables before freeing, so CR3 doesn't
-        // point to the page tables we're about to free.
-        paging.switchToKernel();
+        // Drop the address space from every core's TLB, and move this
+        // core off it so CR3 doesn't point to the page tables we're about
+        // to free.
+        tlb.retire(p);
         paging.freeAddressSpace(p);
     }
 
+    if (g.ns) |ns| ns.release();
+
     // Mark group as free
     alloc_lock.lock();
     g.pml4 = null;
@@ -154,29 +151,6 @@ pub fn releaseGroup(g: *ThreadGroup, proc: *process.Process) bool {
     return true;
 }
 
-/// Perform TLB shootdown for all cores that ran threads in this group.
-fn shootdownGroup(g: *ThreadGroup) void {
-    if (@import("builtin").cpu.arch != .x86_64) return;
-    const percpu = @import("percpu.zig");
-    if (percpu.cores_online <= 1) return;
-
-    const my_core = percpu.getCoreId();
-    const bitmap = g.cores_ran_on;
-    const apic = @import("arch/x86_64/apic.zig");
-    const cpu_mod = @import("arch/x86_64/cpu.zig");
-
-    var core: u8 = 0;
-    while (core < percpu.cores_online) : (core += 1) {
-        if (bitmap & (@as(u128, 1) << @intCast(core)) == 0) continue;
-        if (core == my_core) {
-            cpu_mod.flushTlb();
-        } else {
-            @atomicStore(bool, &percpu.percpu_array[core].tlb_flush_pending, true, .release);
-            apic.sendIpi(apic.lapic_ids[core], apic.IPI_TLB_SHOOTDOWN);
-        }
-    }
-}
-
 /// Get the shared fd slice for a process (group-shared or inline).
 pub fn getFdSlice(proc: *process.Process) *[process.MAX_FDS]?process.FdEntry {
     if (proc.thread_group) |tg| {
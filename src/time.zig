@@ -25,12 +25,12 @@ pub fn wallClock() u64 {
 
 /// Seconds since boot.
 pub fn uptime() u64 {
-    return @as(u64, timer.getTicks()) / timer.TICKS_PER_SEC;
+    return timer.now() / timer.NS_PER_SEC;
 }
 
 /// Milliseconds since boot.
 pub fn uptimeMs() u64 {
-    return @as(u64, timer.getTicks()) * 1000 / timer.TICKS_PER_SEC;
+    return timer.now() / 1_000_000;
 }
 
 /// Adjust the clock offset (for NTP or manual `date -s`).
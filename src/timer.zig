@@ -1,8 +1,40 @@
-/// Timer tick counter for TCP retransmission and sleep.
+/// Monotonic clock and per-core timer wheels.
 ///
-/// x86_64: PIT IRQ 0 at ~18.2 Hz (default PIT frequency).
-/// riscv64: CLINT via SBI set_timer at ~18 Hz (10 MHz timebase / 555555).
+/// now() counts nanoseconds since timer.init(): the TSC on x86_64,
+/// calibrated against PIT channel 2 (cores must share a synchronised TSC),
+/// or the ACPI PM timer when CPUID does not report the TSC invariant; the
+/// 10 MHz `time` CSR on riscv64. getTicks() derives the old ~18 Hz tick
+/// from it for TCP, DNS and ICMP timeouts.
+///
+/// Timers live in per-core hierarchical wheels: LEVELS levels of SLOTS
+/// lists, level n slots 64^n units wide (a unit is 2^UNIT_SHIFT ns, about
+/// 65 µs). arm() and cancel() are O(1) list operations. A timer sits at the
+/// lowest level whose window still covers it and drops down a level each
+/// time the wheel reaches its slot, so every timer is moved at most LEVELS
+/// times. An occupancy bitmap per level makes the next event one ctz per
+/// level.
+///
+/// Nothing ticks periodically. Each core programs a one-shot interrupt for
+/// its own next event — LAPIC TSC-deadline mode, or a LAPIC one-shot count
+/// calibrated against the PIT, on x86_64; SBI set_timer on riscv64 — so an
+/// idle core stays in hlt until something is due. On the PM timer clock,
+/// core 0 also wakes at least once per half counter wrap (about 2.3 s for
+/// a 24-bit counter) so the 64-bit extension never misses a wrap. Without
+/// a LAPIC, or with neither an invariant TSC nor a PM timer, the PIT runs
+/// periodically instead and the wheel advances at its ~55 ms tick.
+///
+/// Callbacks run from the timer interrupt on the core the timer was armed
+/// on, with the wheel lock dropped, and may re-arm their own timer. A timer
+/// already picked for expiry can still fire after being cancelled or
+/// re-armed, so callbacks re-check whatever they act on.
+///
+/// Lock ordering: callers' locks → wheel lock. Callbacks are called with no
+/// timer lock held.
+const std = @import("std");
 const builtin = @import("builtin");
+const klog = @import("klog.zig");
+const percpu = @import("percpu.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
 
 const pic = switch (builtin.cpu.arch) {
     .x86_64 => @import("pic.zig"),
@@ -21,60 +53,469 @@ const interrupts = switch (builtin.cpu.arch) {
     },
 };
 
+const cpu = switch (builtin.cpu.arch) {
+    .x86_64 => @import("arch/x86_64/cpu.zig"),
+    .riscv64 => @import("arch/riscv64/cpu.zig"),
+    else => struct {},
+};
+
+pub const NS_PER_SEC: u64 = 1_000_000_000;
 pub const TICKS_PER_SEC: u32 = 18;
+/// Length of one getTicks() tick.
+pub const TICK_NS: u64 = NS_PER_SEC / TICKS_PER_SEC;
+
+/// Wheel resolution: 2^16 ns ≈ 65.5 µs.
+const UNIT_SHIFT = 16;
+const LEVEL_BITS = 6;
+const SLOTS = 1 << LEVEL_BITS;
+/// Six levels reach 2^52 ns (52 days); later deadlines wait at the top
+/// and are re-sorted as it turns.
+const LEVELS = 6;
+const NEVER: u64 = ~@as(u64, 0);
+/// Callbacks run per wheel lock hold.
+const BATCH = 32;
+
+/// PIT input clock and its default divisor (18.2 Hz on IRQ 0).
+const PIT_HZ: u64 = 1_193_182;
+const PIT_TICK_NS: u64 = 65536 * NS_PER_SEC / PIT_HZ;
+/// ACPI PM timer rate.
+const PM_TIMER_HZ: u64 = 3_579_545;
+/// riscv64 `time` CSR rate (QEMU virt).
+const RISCV_TIMEBASE_HZ: u64 = 10_000_000;
+
+const IA32_TSC_DEADLINE: u32 = 0x6E0;
+
+pub const Timer = struct {
+    func: *const fn (*Timer) void,
+    /// Deadline, ns on the now() clock.
+    expires: u64 = 0,
+    next: ?*Timer = null,
+    prev: ?*Timer = null,
+    /// Wheel (core) and list (level * SLOTS + slot) while armed.
+    core: u8 = 0,
+    slot: u16 = 0,
+    armed: bool = false,
+    /// Held by arm() so two cores never link the same timer.
+    busy: bool = false,
+};
+
+const Wheel = struct {
+    lock: SpinLock,
+    /// Next unit to expire; everything before it has run.
+    clk: u64,
+    occupied: [LEVELS]u64,
+    lists: [LEVELS * SLOTS]?*Timer,
+    /// Unit this core's interrupt is set for, NEVER if none.
+    programmed: u64,
+};
 
-/// CLINT timer interval for ~18 Hz at 10 MHz timebase
-const CLINT_INTERVAL: u64 = 555555;
+var wheels: [percpu.MAX_CORES]Wheel linksection(".bss") = undefined;
 
-var ticks: u32 = 0;
+const Mode = enum { none, pit, lapic, tsc_deadline, sbi };
+var mode: Mode = .none;
+
+/// Clock origin (raw counter value at init) and counter → ns multiplier
+/// (32.32 fixed point); 0 until calibrated, when now() counts PIT ticks.
+var clock_base: u64 = 0;
+var ns_mult: u64 = 0;
+/// Inverse multipliers for programming deadlines: ns → TSC cycles and
+/// ns → LAPIC timer counts (divide by 16).
+var tsc_mult: u64 = 0;
+var lapic_mult: u64 = 0;
+var pit_ticks: u64 = 0;
+/// PM timer clock: port (0 = the TSC is the clock), counter mask, the
+/// longest one-shot that cannot miss a wrap, and the last count read,
+/// extended to 64 bits.
+var pm_port: u16 = 0;
+var pm_mask: u64 = 0;
+var pm_max_ns: u64 = 0;
+var pm_last: u64 = 0;
+/// LAPIC timer LVT set up on this core yet.
+var lvt_ready: [percpu.MAX_CORES]bool = [_]bool{false} ** percpu.MAX_CORES;
 
 pub fn init() void {
+    for (&wheels) |*w| w.* = .{
+        .lock = .{},
+        .clk = 0,
+        .occupied = [_]u64{0} ** LEVELS,
+        .lists = [_]?*Timer{null} ** (LEVELS * SLOTS),
+        .programmed = NEVER,
+    };
     _ = interrupts.registerIrqHandler(0, handleIrq);
 
     switch (builtin.cpu.arch) {
-        .x86_64 => {
-            pic.unmask(0);
-        },
+        .x86_64 => initX86(),
         .riscv64 => {
-            // Program first timer interrupt via SBI
-            const cpu = @import("arch/riscv64/cpu.zig");
-            const now = cpu.rdtime();
-            cpu.sbiSetTimer(now + CLINT_INTERVAL);
+            clock_base = cpu.rdtime();
+            mode = .sbi;
+            klog.info("Timer: SBI one-shot, ");
+            klog.infoDec(RISCV_TIMEBASE_HZ / 1000);
+            klog.info(" kHz timebase\n");
         },
         else => {},
     }
 }
 
+fn initX86() void {
+    const apic = @import("arch/x86_64/apic.zig");
+    const lapic = apic.available();
+    const cal = calibrate(lapic) orelse {
+        // No usable TSC: the PIT is both clock and timer.
+        mode = .pit;
+        pic.unmask(0);
+        klog.warn("Timer: TSC calibration failed, using 18 Hz PIT\n");
+        return;
+    };
+    // The TSC may change rate with P-states or stop in deep C-states
+    // unless CPUID says otherwise; then neither the clock nor TSC-deadline
+    // interrupts can rely on it.
+    const tsc_invariant = invariantTsc();
+    if (tsc_invariant) {
+        clock_base = cpu.rdtsc();
+        ns_mult = @intCast((@as(u128, NS_PER_SEC) << 32) / cal.tsc_hz);
+        tsc_mult = @intCast((@as(u128, cal.tsc_hz) << 32) / NS_PER_SEC);
+        klog.info("Timer: TSC ");
+        klog.infoDec(cal.tsc_hz / 1_000_000);
+        klog.info(" MHz, ");
+    } else if (apic.pm_timer_port != 0) {
+        pm_port = apic.pm_timer_port;
+        pm_mask = if (apic.pm_timer_32bit) 0xFFFF_FFFF else 0xFF_FFFF;
+        pm_max_ns = (pm_mask + 1) / 2 * NS_PER_SEC / PM_TIMER_HZ;
+        pm_last = cpu.inl(pm_port) & pm_mask;
+        clock_base = pm_last;
+        ns_mult = @intCast((@as(u128, NS_PER_SEC) << 32) / PM_TIMER_HZ);
+        klog.info("Timer: TSC not invariant, ACPI PM timer clock, ");
+    } else {
+        mode = .pit;
+        pic.unmask(0);
+        klog.warn("Timer: TSC not invariant and no PM timer, using 18 Hz PIT\n");
+        return;
+    }
+
+    if (!lapic or cal.lapic_hz == 0) {
+        mode = .pit;
+        pic.unmask(0);
+        klog.info("18 Hz PIT (no LAPIC)\n");
+        return;
+    }
+    lapic_mult = @intCast((@as(u128, cal.lapic_hz) << 32) / NS_PER_SEC);
+    // CPUID.1:ECX[24]: the LAPIC timer can fire at an absolute TSC value
+    if (tsc_invariant and cpu.cpuid(1, 0).ecx & (1 << 24) != 0) {
+        mode = .tsc_deadline;
+        klog.info("LAPIC TSC-deadline one-shot\n");
+    } else {
+        mode = .lapic;
+        klog.info("LAPIC one-shot at ");
+        klog.infoDec(cal.lapic_hz / 1000);
+        klog.info(" kHz\n");
+    }
+    // PIT IRQ 0 stays masked: nothing ticks.
+}
+
+/// CPUID.80000007H:EDX[8]: the TSC runs at a constant rate in every
+/// P-, C- and T-state.
+fn invariantTsc() bool {
+    if (cpu.cpuid(0x8000_0000, 0).eax < 0x8000_0007) return false;
+    return cpu.cpuid(0x8000_0007, 0).edx & (1 << 8) != 0;
+}
+
+const Calibration = struct { tsc_hz: u64, lapic_hz: u64 };
+
+/// Count TSC cycles and LAPIC timer ticks across 10 ms of PIT channel 2.
+fn calibrate(lapic: bool) ?Calibration {
+    const apic = @import("arch/x86_64/apic.zig");
+    const CAL_MS = 10;
+    const count: u16 = @intCast(PIT_HZ * CAL_MS / 1000);
+
+    // Channel 2 gate on, speaker off; mode 0 raises OUT2 at terminal count
+    cpu.outb(0x61, (cpu.inb(0x61) & ~@as(u8, 0x02)) | 0x01);
+    cpu.outb(0x43, 0xB0);
+    cpu.outb(0x42, @truncate(count));
+    if (lapic) {
+        apic.setupTimer(.masked);
+        apic.setTimerCount(0xFFFF_FFFF);
+    }
+    cpu.outb(0x42, @truncate(count >> 8));
+    const t0 = cpu.rdtsc();
+    var spins: u32 = 0;
+    while (cpu.inb(0x61) & 0x20 == 0) : (spins += 1) {
+        if (spins > 1 << 24) return null;
+    }
+    const t1 = cpu.rdtsc();
+    const lapic_ticks: u64 = if (lapic) 0xFFFF_FFFF - apic.timerCount() else 0;
+    if (lapic) apic.setTimerCount(0);
+    if (t1 <= t0) return null;
+    return .{
+        .tsc_hz = (t1 - t0) * (1000 / CAL_MS),
+        .lapic_hz = lapic_ticks * (1000 / CAL_MS),
+    };
+}
+
+// ── Clock ───────────────────────────────────────────────────────────
+
+/// Nanoseconds since timer.init().
+pub fn now() u64 {
+    switch (builtin.cpu.arch) {
+        .x86_64 => {
+            if (ns_mult == 0) return @atomicLoad(u64, &pit_ticks, .monotonic) * PIT_TICK_NS;
+            const raw = if (pm_port != 0) pmRead() else cpu.rdtsc();
+            return scale(raw -% clock_base, ns_mult);
+        },
+        .riscv64 => return (cpu.rdtime() -% clock_base) * (NS_PER_SEC / RISCV_TIMEBASE_HZ),
+        else => return 0,
+    }
+}
+
+/// PM timer count extended to 64 bits. Correct as long as some core reads
+/// it at least once per wrap, which setDeadline guarantees.
+fn pmRead() u64 {
+    while (true) {
+        const last = @atomicLoad(u64, &pm_last, .monotonic);
+        const raw: u64 = cpu.inl(pm_port) & pm_mask;
+        const next = last +% ((raw -% last) & pm_mask);
+        if (@cmpxchgWeak(u64, &pm_last, last, next, .monotonic, .monotonic) == null) return next;
+    }
+}
+
+/// ~18 Hz tick count, for code that keeps time in ticks.
 pub fn getTicks() u32 {
-    return ticks;
+    return @truncate(now() / TICK_NS);
 }
 
-fn handleIrq() bool {
-    ticks +%= 1;
-
-    // Re-arm timer on riscv64
-    if (builtin.cpu.arch == .riscv64) {
-        const cpu = @import("arch/riscv64/cpu.zig");
-        const now = cpu.rdtime();
-        cpu.sbiSetTimer(now + CLINT_INTERVAL);
-    }
-
-    // Wake processes whose sleep timer has expired
-    const process = @import("process.zig");
-    const table = process.getProcessTable();
-    for (table) |*p| {
-        if (p.state == .blocked and p.pending_op == .sleep) {
-            if ((ticks -% p.sleep_until) < 0x8000_0000) {
-                process.markReady(p);
+/// x * mult / 2^32.
+fn scale(x: u64, mult: u64) u64 {
+    return @truncate((@as(u128, x) * mult) >> 32);
+}
+
+// ── Arm / cancel ────────────────────────────────────────────────────
+
+/// Arm `t` to fire at `deadline` (ns on the now() clock) on this core,
+/// moving it if it is already armed. A deadline in the past fires at the
+/// next unit.
+pub fn arm(t: *Timer, deadline: u64) void {
+    claim(t);
+    defer @atomicStore(bool, &t.busy, false, .release);
+    cancel(t);
+    insert(t, deadline);
+}
+
+/// Arm `t` unless it is already armed; an armed timer keeps its deadline.
+pub fn armOnce(t: *Timer, deadline: u64) void {
+    if (@atomicLoad(bool, &t.armed, .acquire)) return;
+    claim(t);
+    defer @atomicStore(bool, &t.busy, false, .release);
+    if (!@atomicLoad(bool, &t.armed, .acquire)) insert(t, deadline);
+}
+
+/// Disarm `t` if it is armed, on whichever core.
+pub fn cancel(t: *Timer) void {
+    while (@atomicLoad(bool, &t.armed, .acquire)) {
+        const core = @atomicLoad(u8, &t.core, .acquire);
+        const w = &wheels[core];
+        w.lock.lock();
+        defer w.lock.unlock();
+        if (t.armed and t.core == core) {
+            unlink(w, t);
+            return;
+        }
+    }
+}
+
+fn claim(t: *Timer) void {
+    while (@cmpxchgWeak(bool, &t.busy, false, true, .acquire, .monotonic) != null) {
+        cpu.spinHint();
+    }
+}
+
+fn insert(t: *Timer, deadline: u64) void {
+    const core = percpu.getCoreId();
+    const w = &wheels[core];
+    w.lock.lock();
+    defer w.lock.unlock();
+    // An empty wheel may have idled far behind the clock: catch it up so
+    // the timer is sorted against the present.
+    if (isEmpty(w)) w.clk = @max(w.clk, now() >> UNIT_SHIFT);
+    t.expires = deadline;
+    @atomicStore(u8, &t.core, core, .release);
+    enqueue(w, t);
+    program(w);
+}
+
+// ── Wheel ───────────────────────────────────────────────────────────
+// Everything below: caller holds the wheel lock.
+
+fn unitsUp(ns: u64) u64 {
+    return (ns +| ((1 << UNIT_SHIFT) - 1)) >> UNIT_SHIFT;
+}
+
+fn shiftOf(level: usize) u6 {
+    return @intCast(LEVEL_BITS * level);
+}
+
+fn isEmpty(w: *const Wheel) bool {
+    for (w.occupied) |bits| {
+        if (bits != 0) return false;
+    }
+    return true;
+}
+
+/// Link `t` into the slot for its deadline: level 0 if it falls in the
+/// current 64-unit window, else the lowest level whose window holds it.
+fn enqueue(w: *Wheel, t: *Timer) void {
+    var due = @max(unitsUp(t.expires), w.clk);
+    // Beyond the top level: wait at the end of its window
+    if ((due ^ w.clk) >> shiftOf(LEVELS) != 0) due = w.clk | ((@as(u64, 1) << shiftOf(LEVELS)) - 1);
+    var level: usize = 0;
+    while (level < LEVELS - 1 and (due ^ w.clk) >> shiftOf(level + 1) != 0) level += 1;
+    const idx: usize = @intCast((due >> shiftOf(level)) & (SLOTS - 1));
+    const slot: u16 = @intCast(level * SLOTS + idx);
+
+    t.slot = slot;
+    t.prev = null;
+    t.next = w.lists[slot];
+    if (t.next) |n| n.prev = t;
+    w.lists[slot] = t;
+    w.occupied[level] |= @as(u64, 1) << @intCast(idx);
+    @atomicStore(bool, &t.armed, true, .release);
+}
+
+fn unlink(w: *Wheel, t: *Timer) void {
+    if (t.prev) |p| p.next = t.next else w.lists[t.slot] = t.next;
+    if (t.next) |n| n.prev = t.prev;
+    if (w.lists[t.slot] == null) {
+        w.occupied[t.slot / SLOTS] &= ~(@as(u64, 1) << @intCast(t.slot % SLOTS));
+    }
+    t.next = null;
+    t.prev = null;
+    @atomicStore(bool, &t.armed, false, .release);
+}
+
+/// First unit after (or, for level 0, at) clk with work: a level-0 slot to
+/// expire or a higher slot to cascade. NEVER if the wheel is empty.
+fn nextEvent(w: *const Wheel) u64 {
+    var best = NEVER;
+    for (w.occupied, 0..) |bits, level| {
+        if (bits == 0) continue;
+        // Slots behind the wheel's position are always empty, so the
+        // lowest set bit is the nearest.
+        const window = shiftOf(level) + LEVEL_BITS;
+        const at = ((w.clk >> window) << window) | (@as(u64, @ctz(bits)) << shiftOf(level));
+        best = @min(best, at);
+    }
+    return best;
+}
+
+/// Move the higher-level slots that begin at clk down the wheel, top level
+/// first so its timers can fall through the levels below.
+fn cascade(w: *Wheel) void {
+    var level: usize = LEVELS - 1;
+    while (level > 0) : (level -= 1) {
+        const shift = shiftOf(level);
+        if (w.clk & ((@as(u64, 1) << shift) - 1) != 0) continue;
+        const idx: usize = @intCast((w.clk >> shift) & (SLOTS - 1));
+        const bit = @as(u64, 1) << @intCast(idx);
+        if (w.occupied[level] & bit == 0) continue;
+        const slot = level * SLOTS + idx;
+        var cur = w.lists[slot];
+        w.lists[slot] = null;
+        w.occupied[level] &= ~bit;
+        while (cur) |t| {
+            cur = t.next;
+            enqueue(w, t);
+        }
+    }
+}
+
+/// Expire everything due up to and including unit `target`.
+fn run(w: *Wheel, target: u64) void {
+    var batch: [BATCH]*Timer = undefined;
+    while (true) {
+        cascade(w);
+        if (w.clk > target) return;
+
+        const slot: usize = @intCast(w.clk & (SLOTS - 1));
+        var n: usize = 0;
+        while (n < BATCH) {
+            const t = w.lists[slot] orelse break;
+            unlink(w, t);
+            if (unitsUp(t.expires) > w.clk) {
+                // Parked at the top of the wheel: still not due
+                enqueue(w, t);
+                continue;
             }
+            batch[n] = t;
+            n += 1;
+        }
+        if (n > 0) {
+            w.lock.unlock();
+            for (batch[0..n]) |t| t.func(t);
+            w.lock.lock();
+            continue;
         }
+        // Skip the empty stretch up to the next slot with work
+        w.clk = @min(nextEvent(w), target + 1);
     }
+}
 
-    // Poll USB HID events (x86_64 only)
-    if (builtin.cpu.arch == .x86_64) {
-        const xhci = @import("xhci.zig");
-        xhci.pollUsbHid();
+/// Point this core's interrupt at the wheel's next event, if it moved.
+fn program(w: *Wheel) void {
+    const next = nextEvent(w);
+    if (next == w.programmed) return;
+    w.programmed = next;
+    setDeadline(next);
+}
+
+fn setDeadline(unit: u64) void {
+    switch (builtin.cpu.arch) {
+        .x86_64 => {
+            const apic = @import("arch/x86_64/apic.zig");
+            if (mode != .lapic and mode != .tsc_deadline) return;
+            const core = percpu.getCoreId();
+            if (!lvt_ready[core]) {
+                apic.setupTimer(if (mode == .tsc_deadline) .tsc_deadline else .one_shot);
+                lvt_ready[core] = true;
+            }
+            if (mode == .tsc_deadline) {
+                const at = if (unit == NEVER) 0 else clock_base +% scale(unit << UNIT_SHIFT, tsc_mult);
+                cpu.wrmsr(IA32_TSC_DEADLINE, at);
+            } else {
+                // On the PM timer clock, core 0 never sleeps through a wrap
+                const cap = if (pm_port != 0 and core == 0) pm_max_ns else NEVER;
+                if (unit == NEVER and cap == NEVER) {
+                    apic.setTimerCount(0);
+                    return;
+                }
+                const at = if (unit == NEVER) NEVER else unit << UNIT_SHIFT;
+                const delta = @min(at -| now(), cap);
+                apic.setTimerCount(@intCast(std.math.clamp(scale(delta, lapic_mult), 1, 0xFFFF_FFFF)));
+            }
+        },
+        .riscv64 => {
+            const at = if (unit == NEVER) NEVER else clock_base +% (unit << UNIT_SHIFT) / (NS_PER_SEC / RISCV_TIMEBASE_HZ);
+            cpu.sbiSetTimer(at);
+        },
+        else => {},
     }
+}
+
+// ── Interrupts ──────────────────────────────────────────────────────
 
+/// Timer interrupt (LAPIC vector, or IRQ 0 via handleIrq): run what is due
+/// on this core and set up the next interrupt.
+pub fn handleInterrupt() void {
+    const w = &wheels[percpu.getCoreId()];
+    w.lock.lock();
+    defer w.lock.unlock();
+    run(w, now() >> UNIT_SHIFT);
+    // The interrupt consumed the old setting (and on riscv64 stays pending
+    // until set_timer is called again), so always reprogram.
+    w.programmed = nextEvent(w);
+    setDeadline(w.programmed);
+}
+
+/// IRQ 0: the PIT fallback on x86_64, the supervisor timer on riscv64.
+fn handleIrq() bool {
+    if (builtin.cpu.arch == .x86_64) _ = @atomicRmw(u64, &pit_ticks, .Add, 1, .monotonic);
+    handleInterrupt();
     return true;
 }
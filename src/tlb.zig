@@ -0,0 +1,245 @@
+/// TLB management: tagged address spaces and shootdowns.
+///
+/// Each core keeps the roots it loaded most recently in a small table, one
+/// per hardware tag (PCID on x86_64, ASID on riscv64). Switching back to a
+/// root still in the table reuses its tag without a flush, so a client and
+/// server trading the CPU through IPC keep their translations warm. Tag 0
+/// is the kernel root, whose mappings never change after boot. Without
+/// hardware tags every switch flushes, as before.
+///
+/// shootdown() invalidates a page range of one address space everywhere
+/// it may be cached. A core that merely holds the root in its table just
+/// forgets it — its next switch to the root takes a fresh, flushed tag —
+/// so only cores running the root right now get an IPI, and they drop the
+/// range page by page (whole tag past MAX_RANGE_PAGES). The caller spins
+/// until every IPI is acknowledged, so frames can be freed on return.
+///
+/// Shootdowns wait with interrupts off: callers must not hold a lock a
+/// target core could be spinning on. Cores waiting on each other's
+/// shootdowns serve the incoming requests while they spin.
+const builtin = @import("builtin");
+const mem = @import("mem.zig");
+const percpu = @import("percpu.zig");
+
+const paging = switch (builtin.cpu.arch) {
+    .x86_64 => @import("arch/x86_64/paging.zig"),
+    .riscv64 => @import("arch/riscv64/paging.zig"),
+    else => struct {
+        pub const PageTable = struct { entries: [512]u64 };
+        pub var tag_count: u16 = 0;
+        pub fn switchAddressSpace(_: *PageTable, _: u16, _: bool) void {}
+        pub fn switchToKernel() void {}
+        pub fn invalidatePage(_: u64) void {}
+        pub fn invalidateTagPage(_: u16, _: u64) bool {
+            return false;
+        }
+    },
+};
+
+const cpu = switch (builtin.cpu.arch) {
+    .x86_64 => @import("arch/x86_64/cpu.zig"),
+    .riscv64 => @import("arch/riscv64/cpu.zig"),
+    else => struct {
+        pub inline fn spinHint() void {}
+    },
+};
+
+const PageTable = paging.PageTable;
+
+/// Tags cached per core, including the kernel's tag 0.
+const SLOTS = 8;
+
+/// Longest range invalidated page by page; anything longer flushes the
+/// whole tag.
+pub const MAX_RANGE_PAGES = 32;
+
+/// `pages` value covering the whole address space.
+pub const ALL: u64 = ~@as(u64, 0);
+
+const Request = struct {
+    /// Address space (PageTable address) to invalidate.
+    root: usize = 0,
+    start: u64 = 0,
+    pages: u64 = 0,
+    /// The address space is being freed: targets still on it move to the
+    /// kernel root.
+    retire: bool = false,
+};
+
+const CoreTlb = struct {
+    /// Root cached under each tag; 0 = free. Slot 0 (kernel) stays 0.
+    /// Written by the owner on a switch, cleared by shootdowns elsewhere.
+    roots: [SLOTS]usize align(64) = [_]usize{0} ** SLOTS,
+    /// Root loaded right now, 0 for the kernel root.
+    current: usize = 0,
+    current_tag: u16 = 0,
+    /// Round-robin victim for the next miss.
+    next: u16 = 1,
+    /// Requests waiting for this core: bit n = core n's `req`.
+    pending: [percpu.MAX_CORES / 64]u64 = [_]u64{0} ** (percpu.MAX_CORES / 64),
+    /// This core's outstanding shootdown and the acks still owed for it.
+    req: Request align(64) = .{},
+    acks: u32 = 0,
+};
+
+var cores: [percpu.MAX_CORES]CoreTlb = [_]CoreTlb{.{}} ** percpu.MAX_CORES;
+
+/// Tags in use per core; below 2 there is no room beside the kernel's.
+fn slots() u16 {
+    return @min(SLOTS, paging.tag_count);
+}
+
+/// Load `root` on this core, reusing its tag if it is still cached.
+pub fn switchTo(root: *PageTable) void {
+    const c = &cores[percpu.getCoreId()];
+    const key = @intFromPtr(root);
+    // Publish before the table lookup: a shootdown clears the slot and
+    // then reads `current`, so it either makes us miss or sends an IPI.
+    @atomicStore(usize, &c.current, key, .seq_cst);
+
+    const n = slots();
+    if (n < 2) {
+        paging.switchAddressSpace(root, 0, true);
+        return;
+    }
+    var tag: u16 = 1;
+    while (tag < n) : (tag += 1) {
+        if (@atomicLoad(usize, &c.roots[tag], .seq_cst) == key) {
+            c.current_tag = tag;
+            paging.switchAddressSpace(root, tag, false);
+            return;
+        }
+    }
+    tag = c.next;
+    c.next = if (tag + 1 >= n) 1 else tag + 1;
+    @atomicStore(usize, &c.roots[tag], key, .seq_cst);
+    c.current_tag = tag;
+    paging.switchAddressSpace(root, tag, true);
+}
+
+/// Load the kernel root on this core.
+pub fn switchToKernel() void {
+    const c = &cores[percpu.getCoreId()];
+    @atomicStore(usize, &c.current, 0, .seq_cst);
+    c.current_tag = 0;
+    paging.switchToKernel();
+}
+
+/// Invalidate `pages` pages from `start` (or ALL) of `root` on every core,
+/// after its page tables have been changed. Returns once no core can still
+/// use the old translations.
+pub fn shootdown(root: *PageTable, start: u64, pages: u64) void {
+    post(.{ .root = @intFromPtr(root), .start = start, .pages = pages });
+}
+
+/// `root` is about to be freed: make every core forget it, moving this
+/// core to the kernel root if it is still on it. A later address space at
+/// the same address then starts from clean tags.
+pub fn retire(root: *PageTable) void {
+    const c = &cores[percpu.getCoreId()];
+    if (c.current == @intFromPtr(root)) switchToKernel();
+    post(.{ .root = @intFromPtr(root), .pages = ALL, .retire = true });
+}
+
+/// IPI_TLB_SHOOTDOWN handler.
+pub fn handleIpi() void {
+    serve(percpu.getCoreId());
+}
+
+fn post(req: Request) void {
+    const c = &cores[percpu.getCoreId()];
+    // riscv64 runs a single hart: nobody else to tell.
+    if (builtin.cpu.arch == .x86_64) postRemote(c, req);
+    invalidateLocal(c, req);
+    while (@atomicLoad(u32, &c.acks, .acquire) != 0) {
+        serve(percpu.getCoreId());
+        cpu.spinHint();
+    }
+}
+
+/// Forget `req.root` on every other core and IPI those running it.
+fn postRemote(c: *CoreTlb, req: Request) void {
+    const apic = @import("arch/x86_64/apic.zig");
+    const me = percpu.getCoreId();
+    const n = slots();
+
+    var targets = [_]u64{0} ** (percpu.MAX_CORES / 64);
+    var count: u32 = 0;
+    var core: u8 = 0;
+    while (core < percpu.cores_online) : (core += 1) {
+        if (core == me) continue;
+        const other = &cores[core];
+        var tag: u16 = 1;
+        while (tag < n) : (tag += 1) {
+            _ = @cmpxchgStrong(usize, &other.roots[tag], req.root, 0, .seq_cst, .seq_cst);
+        }
+        if (@atomicLoad(usize, &other.current, .seq_cst) == req.root) {
+            targets[core / 64] |= @as(u64, 1) << @intCast(core % 64);
+            count += 1;
+        }
+    }
+    if (count == 0) return;
+
+    c.req = req;
+    @atomicStore(u32, &c.acks, count, .release);
+    const bit = @as(u64, 1) << @intCast(me % 64);
+    core = 0;
+    while (core < percpu.cores_online) : (core += 1) {
+        if (targets[core / 64] & (@as(u64, 1) << @intCast(core % 64)) == 0) continue;
+        _ = @atomicRmw(u64, &cores[core].pending[me / 64], .Or, bit, .release);
+        apic.sendIpi(apic.lapic_ids[core], apic.IPI_TLB_SHOOTDOWN);
+    }
+}
+
+/// Act on the requests other cores have posted to `me`.
+fn serve(me: u8) void {
+    const c = &cores[me];
+    for (&c.pending, 0..) |*word, w| {
+        var bits = @atomicRmw(u64, word, .Xchg, 0, .acquire);
+        while (bits != 0) {
+            const sender = w * 64 + @ctz(bits);
+            bits &= bits - 1;
+            const src = &cores[sender];
+            const req = src.req;
+            if (c.current == req.root) {
+                if (req.retire) switchToKernel() else flushCurrent(c, req);
+            }
+            _ = @atomicRmw(u32, &src.acks, .Sub, 1, .release);
+        }
+    }
+}
+
+/// Invalidate `req` in this core's own TLB.
+fn invalidateLocal(c: *CoreTlb, req: Request) void {
+    if (c.current == req.root) {
+        flushCurrent(c, req);
+        return;
+    }
+    // Cached under a tag we are not using: drop the pages from that tag
+    // if the hardware can, else forget the tag.
+    const n = slots();
+    var tag: u16 = 1;
+    while (tag < n) : (tag += 1) {
+        if (@atomicLoad(usize, &c.roots[tag], .monotonic) != req.root) continue;
+        if (req.pages <= MAX_RANGE_PAGES and invalidateTagRange(tag, req)) continue;
+        @atomicStore(usize, &c.roots[tag], 0, .seq_cst);
+    }
+}
+
+fn invalidateTagRange(tag: u16, req: Request) bool {
+    var i: u64 = 0;
+    while (i < req.pages) : (i += 1) {
+        if (!paging.invalidateTagPage(tag, req.start + i * mem.PAGE_SIZE)) return false;
+    }
+    return true;
+}
+
+/// `req.root` is loaded on this core: drop the range, or the whole tag.
+fn flushCurrent(c: *CoreTlb, req: Request) void {
+    if (req.pages <= MAX_RANGE_PAGES) {
+        var i: u64 = 0;
+        while (i < req.pages) : (i += 1) paging.invalidatePage(req.start + i * mem.PAGE_SIZE);
+        return;
+    }
+    paging.switchAddressSpace(@ptrFromInt(c.current), c.current_tag, true);
+}
@@ -0,0 +1,198 @@
+/// Kernel event tracing.
+///
+/// Each core records fixed-size binary events into its own ring. Only the
+/// owning core writes a ring, and kernel code runs with interrupts off, so
+/// recording an event is a plain store into the slot plus a release store
+/// of `head` — no lock, no atomic read-modify-write. A full ring overwrites
+/// its oldest events.
+///
+/// /dev/trace streams the rings: read() returns whole Events, drained from
+/// every core in turn, and 0 when nothing new has been recorded. Events a
+/// reader fell too far behind to see are reported as one `.lost` event
+/// carrying the count. Writing "start", "stop" or "clear" controls
+/// recording. Timestamps are raw cycle counts (rdtsc/rdtime).
+///
+/// Tracepoints compile to nothing unless the kernel is built with
+/// -Dtrace=true; /dev/trace then does not exist.
+const std = @import("std");
+const builtin = @import("builtin");
+const klog = @import("klog.zig");
+const heap = @import("heap.zig");
+const percpu = @import("percpu.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
+
+const cpu = switch (builtin.cpu.arch) {
+    .x86_64 => @import("arch/x86_64/cpu.zig"),
+    .riscv64 => @import("arch/riscv64/cpu.zig"),
+    else => struct {},
+};
+
+pub const enabled = @import("build_options").trace;
+
+pub const EventId = enum(u8) {
+    /// Reader overran the ring: args[0] = events dropped on `core`.
+    lost,
+    /// `pid` starts running: args[0] = pending_op it resumes with.
+    sched_switch,
+    /// `pid` queued on a run queue: args[0] = target core. A direct IPC
+    /// handoff skips the queue and shows up only as its sched_switch.
+    wakeup,
+    /// `pid` sent a request: args[0] = tag, args[1] = data length.
+    ipc_send,
+    /// Server `pid` picked up a request: args[0] = client pid.
+    ipc_recv,
+    /// Server `pid` replied: args[0] = client pid, args[1] = reply tag.
+    ipc_reply,
+    /// Page fault in `pid`: args[0] = faulting address, args[1] = error code.
+    page_fault,
+    /// Block request queued: args[0] = block, args[1] = segments.
+    blk_submit,
+    /// Block request completed: args[0] = descriptor head, args[1] = ok.
+    blk_complete,
+};
+
+/// One trace record, as returned by read() on /dev/trace.
+pub const Event = extern struct {
+    tsc: u64,
+    pid: u32,
+    core: u8,
+    id: u8,
+    _pad: u16 = 0,
+    args: [2]u64,
+};
+
+comptime {
+    if (@sizeOf(Event) != 32) @compileError("trace.Event must stay 32 bytes");
+}
+
+/// Events per core (power of two): 128 KiB of ring per core.
+const RING_EVENTS = 4096;
+
+const Ring = struct {
+    /// Events ever recorded on this core; slot = head % RING_EVENTS.
+    head: u64 align(64) = 0,
+    events: [RING_EVENTS]Event align(64) = undefined,
+};
+
+var rings: [percpu.MAX_CORES]?*Ring = [_]?*Ring{null} ** percpu.MAX_CORES;
+/// Reader position per core. /dev/trace has a single cursor: concurrent
+/// readers split the stream between them.
+var cursors: [percpu.MAX_CORES]u64 = [_]u64{0} ** percpu.MAX_CORES;
+var read_lock: SpinLock = .{};
+var recording: bool = true;
+
+/// Allocate a ring per online core. Called once SMP bring-up has settled
+/// the core count.
+pub fn init() void {
+    if (!enabled) return;
+    var i: u8 = 0;
+    while (i < percpu.cores_online) : (i += 1) {
+        const ptr = heap.allocAligned(@sizeOf(Ring), 64) orelse {
+            klog.warn("Trace: out of memory for core rings\n");
+            return;
+        };
+        const ring: *Ring = @ptrCast(@alignCast(ptr));
+        ring.head = 0;
+        rings[i] = ring;
+    }
+    klog.info("Trace: ");
+    klog.infoDec(percpu.cores_online);
+    klog.info(" core rings of ");
+    klog.infoDec(RING_EVENTS);
+    klog.info(" events\n");
+}
+
+/// Record an event on this core. Free when tracing is compiled out.
+pub inline fn point(id: EventId, pid: u32, arg0: u64, arg1: u64) void {
+    if (!enabled) return;
+    record(id, pid, arg0, arg1);
+}
+
+fn record(id: EventId, pid: u32, arg0: u64, arg1: u64) void {
+    if (!@atomicLoad(bool, &recording, .monotonic)) return;
+    const core = percpu.getCoreId();
+    const ring = rings[core] orelse return;
+    const h = ring.head;
+    ring.events[h & (RING_EVENTS - 1)] = .{
+        .tsc = cycles(),
+        .pid = pid,
+        .core = core,
+        .id = @intFromEnum(id),
+        .args = .{ arg0, arg1 },
+    };
+    @atomicStore(u64, &ring.head, h + 1, .release);
+}
+
+/// Copy whole events into `dest` (`len` bytes). Returns bytes written.
+pub fn read(dest: [*]u8, len: usize) usize {
+    if (!enabled) return 0;
+    const out: [*]align(1) Event = @ptrCast(dest);
+    const max = len / @sizeOf(Event);
+    var n: usize = 0;
+
+    read_lock.lock();
+    defer read_lock.unlock();
+
+    var core: u8 = 0;
+    while (core < percpu.cores_online and n < max) : (core += 1) {
+        const ring = rings[core] orelse continue;
+        while (n < max) {
+            const head = @atomicLoad(u64, &ring.head, .acquire);
+            const pos = cursors[core];
+            if (pos == head) break;
+
+            // The producer may be rewriting slot `head`, which is also
+            // the oldest slot once the ring is full: skip past both.
+            if (head - pos >= RING_EVENTS) {
+                const oldest = head - (RING_EVENTS - 1);
+                out[n] = .{
+                    .tsc = cycles(),
+                    .pid = 0,
+                    .core = core,
+                    .id = @intFromEnum(EventId.lost),
+                    .args = .{ oldest - pos, 0 },
+                };
+                n += 1;
+                cursors[core] = oldest;
+                continue;
+            }
+
+            const ev = ring.events[pos & (RING_EVENTS - 1)];
+            // Lapped while copying: the slot may be torn, so go round
+            // again and count it as lost. (A seq_cst load also orders the
+            // copy before it on riscv.)
+            if (@atomicLoad(u64, &ring.head, .seq_cst) - pos >= RING_EVENTS) continue;
+            out[n] = ev;
+            n += 1;
+            cursors[core] = pos + 1;
+        }
+    }
+    return n * @sizeOf(Event);
+}
+
+/// Handle a control write: "start", "stop" or "clear" (drop everything
+/// not yet read). Returns false for an unknown command.
+pub fn control(cmd: []const u8) bool {
+    if (std.mem.eql(u8, cmd, "start")) {
+        @atomicStore(bool, &recording, true, .monotonic);
+    } else if (std.mem.eql(u8, cmd, "stop")) {
+        @atomicStore(bool, &recording, false, .monotonic);
+    } else if (std.mem.eql(u8, cmd, "clear")) {
+        read_lock.lock();
+        var core: u8 = 0;
+        while (core < percpu.cores_online) : (core += 1) {
+            const ring = rings[core] orelse continue;
+            cursors[core] = @atomicLoad(u64, &ring.head, .acquire);
+        }
+        read_lock.unlock();
+    } else return false;
+    return true;
+}
+
+fn cycles() u64 {
+    return switch (builtin.cpu.arch) {
+        .x86_64 => cpu.rdtsc(),
+        .riscv64 => cpu.rdtime(),
+        else => 0,
+    };
+}
@@ -117,6 +117,11 @@ pub const Virtqueue = struct {
     io_base: u16,
     /// Queue index (for notify).
     queue_index: u16,
+
+    /// Head of the free descriptor list (see initFreeList).
+    free_head: u16 = 0,
+    /// Number of descriptors on the free list.
+    num_free: u16 = 0,
 };
 
 /// A virtio device.
@@ -329,6 +334,63 @@ pub fn addBufferChain3(
     return head;
 }
 
+/// Thread the first `count` descriptors into a free list. Drivers that keep
+/// several requests in flight use allocChain/freeChain instead of the linear
+/// next_desc allocator, so chains can complete and be reused out of order.
+pub fn initFreeList(vq: *Virtqueue, count: u16) void {
+    const n = @min(count, vq.size);
+    var i: u16 = 0;
+    while (i < n) : (i += 1) {
+        vq.desc[i] = .{ .addr = 0, .len = 0, .flags = 0, .next = i + 1 };
+    }
+    vq.free_head = 0;
+    vq.num_free = n;
+}
+
+/// Take `n` descriptors off the free list, linked through `next` with
+/// VRING_DESC_F_NEXT set on all but the last. The caller fills in addr/len
+/// and ORs in VRING_DESC_F_WRITE where needed. Returns the head index.
+pub fn allocChain(vq: *Virtqueue, n: u16) ?u16 {
+    if (n == 0 or vq.num_free < n) return null;
+
+    const head = vq.free_head;
+    var idx = head;
+    var i: u16 = 0;
+    while (i < n) : (i += 1) {
+        const next = vq.desc[idx].next;
+        if (i + 1 < n) {
+            vq.desc[idx].flags = VRING_DESC_F_NEXT;
+            idx = next;
+        } else {
+            vq.desc[idx].flags = 0;
+            vq.free_head = next;
+        }
+    }
+    vq.num_free -= n;
+    return head;
+}
+
+/// Return a chain obtained from allocChain to the free list.
+pub fn freeChain(vq: *Virtqueue, head: u16) void {
+    var idx = head;
+    var count: u16 = 1;
+    while (vq.desc[idx].flags & VRING_DESC_F_NEXT != 0) : (count += 1) {
+        idx = vq.desc[idx].next;
+    }
+    vq.desc[idx].flags = 0;
+    vq.desc[idx].next = vq.free_head;
+    vq.free_head = head;
+    vq.num_free += count;
+}
+
+/// Make a filled-in descriptor chain available to the device.
+pub fn submitChain(vq: *Virtqueue, head: u16) void {
+    const avail_idx = vq.avail.idx;
+    vq.avail_ring[avail_idx % vq.size] = head;
+    memoryBarrier();
+    vq.avail.idx = avail_idx +% 1;
+}
+
 /// Notify the device that there are new available buffers.
 pub fn notify(vq: *Virtqueue) void {
     write16(vq.io_base, REG_QUEUE_NOTIFY, vq.queue_index);
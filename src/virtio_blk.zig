@@ -1,13 +1,31 @@
 /// virtio-blk block device driver.
 ///
 /// Runs kernel-side (needs I/O port access).
-/// Provides readBlock/writeBlock for 4096-byte blocks.
+/// Provides readBlock/writeBlock for 4096-byte blocks (synchronous, used by
+/// the kernel at boot) and per-process batches for pread/pwrite, which keep
+/// several requests in flight and are completed by the device IRQ.
+///
+/// Requests are tracked by descriptor chain head: descriptors come from the
+/// virtqueue free list, so chains complete and are recycled out of order.
+/// A single request carries up to MAX_SEGS contiguous blocks (one data
+/// descriptor per 4 KiB DMA page), so a multi-block pread is one device
+/// round-trip per 64 KiB rather than per block.
+///
+/// Wake pattern: the IRQ handler reaps the used ring and marks the owning
+/// process ready once its whole round has completed. Data is copied to the
+/// user buffer in process.switchTo() after the address space is loaded.
+///
+/// SMP: blk_lock guards the virtqueue, request slots and batches. Lock
+/// ordering: blk_lock → pmm_lock.
 ///
 /// virtio-blk legacy device config (at io_base + 0x14):
 ///   0x14  capacity  — total sectors (u64, 512 bytes each)
 const pmm = @import("pmm.zig");
 const klog = @import("klog.zig");
 const virtio = @import("virtio.zig");
+const process = @import("process.zig");
+const trace = @import("trace.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
 
 const paging = switch (@import("builtin").cpu.arch) {
     .x86_64 => @import("arch/x86_64/paging.zig"),
@@ -40,12 +58,43 @@ const cpu = switch (@import("builtin").cpu.arch) {
     },
 };
 
+const interrupts = switch (@import("builtin").cpu.arch) {
+    .x86_64 => @import("arch/x86_64/interrupts.zig"),
+    .riscv64 => @import("arch/riscv64/interrupts.zig"),
+    else => struct {
+        pub fn registerIrqHandler(_: u8, _: anytype) bool {
+            return false;
+        }
+    },
+};
+
 const VIRTIO_BLK_T_IN = 0; // read
 const VIRTIO_BLK_T_OUT = 1; // write
 const VIRTIO_BLK_S_OK = 0;
 
 const SECTORS_PER_BLOCK = 8; // 4096 / 512
 
+/// Maximum data segments (4 KiB blocks) per device request. A request is
+/// one chain: header (r), MAX_SEGS data descriptors, status (w).
+pub const MAX_SEGS = 16;
+
+/// Maximum descriptors tracked (request slots are indexed by chain head).
+const MAX_QUEUE_SIZE = 256;
+
+/// Bytes of header DMA area per slot: 16-byte VirtioBlkReq + status byte.
+const HDR_STRIDE = 32;
+const HDR_PAGES = MAX_QUEUE_SIZE * HDR_STRIDE / 4096;
+
+/// Maximum requests a single pread/pwrite keeps in flight at once.
+const BATCH_REQS = 4;
+
+/// Returned by resumeBatch when a batch fails before any block completed.
+pub const EIO: u64 = @bitCast(@as(i64, -5));
+
+/// Slot owner sentinels (otherwise a process-table index).
+const OWNER_SYNC: u16 = 0xFFFF; // kernel caller spinning in readBlock/writeBlock
+const OWNER_ORPHAN: u16 = 0xFFFE; // caller gave up; free on completion
+
 /// virtio-blk request header (16 bytes).
 const VirtioBlkReq = extern struct {
     req_type: u32,
@@ -67,6 +116,48 @@ var blk_dev: BlkDevice = .{
     .initialized = false,
 };
 
+/// An in-flight request, indexed by its descriptor chain head.
+const Slot = struct {
+    active: bool = false,
+    done: bool = false,
+    ok: bool = false,
+    owner: u16 = OWNER_SYNC,
+    nsegs: u8 = 0,
+    data_phys: [MAX_SEGS]u64 = [_]u64{0} ** MAX_SEGS,
+};
+
+/// A blocking pread/pwrite, indexed by the caller's process-table index.
+/// Blocks are submitted in rounds of up to BATCH_REQS requests, each
+/// covering up to MAX_SEGS contiguous blocks.
+const Batch = struct {
+    active: bool = false,
+    pid: u32 = 0,
+    write: bool = false,
+    /// No descriptors were free when the round was submitted.
+    starved: bool = false,
+    failed: bool = false,
+    user_buf: u64 = 0,
+    next_block: u64 = 0,
+    blocks_left: u64 = 0,
+    /// Offset into user_buf of the current round's first block.
+    round_off: u64 = 0,
+    /// Contiguous bytes transferred successfully so far.
+    bytes_done: u64 = 0,
+    heads: [BATCH_REQS]u16 = [_]u16{0} ** BATCH_REQS,
+    count: u8 = 0,
+    inflight: u8 = 0,
+};
+
+var slots: [MAX_QUEUE_SIZE]Slot linksection(".bss") = undefined;
+var batches: [process.MAX_PROCESSES]Batch linksection(".bss") = undefined;
+var starved_count: u32 = 0;
+
+/// Header/status DMA area: one HDR_STRIDE entry per descriptor head.
+var hdr_phys: u64 = 0;
+var hdr_area: [*]u8 = undefined;
+
+var blk_lock: SpinLock = .{};
+
 /// Initialize the virtio-blk device.
 pub fn init() bool {
     if (@import("builtin").cpu.arch != .x86_64 and @import("builtin").cpu.arch != .riscv64) return false;
@@ -96,6 +187,15 @@ pub fn init() bool {
         klog.err("virtio-blk: failed to setup queue\n");
         return false;
     }
+    virtio.initFreeList(&(blk_dev.queue.?), MAX_QUEUE_SIZE);
+
+    hdr_phys = pmm.allocContiguousPages(HDR_PAGES) orelse {
+        klog.err("virtio-blk: failed to allocate request headers\n");
+        return false;
+    };
+    hdr_area = paging.physPtr(hdr_phys);
+    for (&slots) |*slot| slot.* = .{};
+    for (&batches) |*b| b.* = .{};
 
     // Read capacity from device config at BAR + 0x14 (u64 LE, sector count)
     const cap_lo: u64 = blk: {
@@ -121,6 +221,15 @@ pub fn init() bool {
     blk_dev.dev = dev;
     blk_dev.initialized = true;
 
+    // Completion IRQ. Without it requests still complete via the
+    // polling in readBlock/writeBlock, but batches would never be woken.
+    const irq = irqLine(pci_dev);
+    if (interrupts.registerIrqHandler(irq, handleIrq)) {
+        enableIrq(irq);
+    } else {
+        klog.err("virtio-blk: failed to register IRQ handler\n");
+    }
+
     const sectors = blk_dev.capacity;
     const mb = sectors / 2048; // sectors * 512 / 1048576
     klog.info("virtio-blk: ");
@@ -132,75 +241,71 @@ pub fn init() bool {
     return true;
 }
 
-/// Read a 4096-byte block from the device.
+/// Read a 4096-byte block from the device (synchronous, kernel callers).
 /// block is a 4K-block number (sector = block * 8).
 pub fn readBlock(block: u64, buf: *[4096]u8) bool {
     if (!blk_dev.initialized) return false;
+    if (block * SECTORS_PER_BLOCK + SECTORS_PER_BLOCK > blk_dev.capacity) return false;
 
-    const vq = &(blk_dev.queue.?);
-    const sector = block * SECTORS_PER_BLOCK;
-
-    if (sector + SECTORS_PER_BLOCK > blk_dev.capacity) return false;
-
-    // Allocate DMA pages. Use higher-half pointers for CPU access — identity-map
+    // Allocate DMA page. Use higher-half pointers for CPU access — identity-map
     // may have been modified by user ELF mappings (huge page splits).
-    const req_phys = pmm.allocPage() orelse {
-        klog.err("virtio-blk: read OOM req blk=");
-        klog.errDec(block);
-        klog.err(" free=");
-        klog.errDec(pmm.getFreePages());
-        klog.err("\n");
-        return false;
-    };
     const data_phys = pmm.allocPage() orelse {
         klog.err("virtio-blk: read OOM data blk=");
         klog.errDec(block);
         klog.err(" free=");
         klog.errDec(pmm.getFreePages());
         klog.err("\n");
-        pmm.freePage(req_phys);
         return false;
     };
-    const req_ptr: [*]u8 = paging.physPtr(req_phys);
+
+    if (!syncRequest(block, false, &[_]u64{data_phys}, 10_000_000)) return false;
+
+    // Copy DMA buffer to caller's buffer
     const data_ptr: [*]u8 = paging.physPtr(data_phys);
+    @memcpy(buf, data_ptr[0..4096]);
+    pmm.freePage(data_phys);
+    return true;
+}
 
-    // Write request header at start of req page
-    const hdr: *VirtioBlkReq = @ptrCast(@alignCast(req_ptr));
-    hdr.* = .{
-        .req_type = VIRTIO_BLK_T_IN,
-        .reserved = 0,
-        .sector = sector,
-    };
+/// Write a 4096-byte block to the device (synchronous, kernel callers).
+/// block is a 4K-block number (sector = block * 8).
+pub fn writeBlock(block: u64, buf: *const [4096]u8) bool {
+    if (!blk_dev.initialized) return false;
+    if (block * SECTORS_PER_BLOCK + SECTORS_PER_BLOCK > blk_dev.capacity) return false;
+
+    const data_phys = pmm.allocPage() orelse return false;
+    const data_ptr: [*]u8 = paging.physPtr(data_phys);
+    @memcpy(data_ptr[0..4096], buf);
+
+    if (!syncRequest(block, true, &[_]u64{data_phys}, 100_000_000)) return false;
 
-    // Status byte at offset 16
-    req_ptr[16] = 0xFF; // sentinel
-
-    // 3-descriptor chain: header (r), data (w), status (w)
-    // DMA addresses are physical — device accesses memory directly
-    _ = virtio.addBufferChain3(
-        vq,
-        req_phys,
-        @sizeOf(VirtioBlkReq),
-        false, // device-readable
-        data_phys,
-        4096,
-        true, // device-writable (read into DMA buf)
-        req_phys + 16,
-        1,
-        true, // device-writable
-    ) orelse {
-        pmm.freePage(data_phys);
-        pmm.freePage(req_phys);
+    pmm.freePage(data_phys);
+    return true;
+}
+
+/// Submit one request and spin until it completes. On success the data
+/// pages still belong to the caller. On failure they have been freed — or,
+/// on timeout, handed to the orphaned slot and freed when the device completes.
+fn syncRequest(block: u64, write: bool, pages: []const u64, max_spins: u32) bool {
+    blk_lock.lock();
+    const head = queueRequest(block, write, pages, OWNER_SYNC) orelse {
+        blk_lock.unlock();
+        for (pages) |page| pmm.freePage(page);
         return false;
     };
+    virtio.notify(&(blk_dev.queue.?));
+    blk_lock.unlock();
 
-    virtio.notify(vq);
-
-    // Poll for completion
     var spins: u32 = 0;
-    while (virtio.pollUsed(vq) == null) : (spins += 1) {
-        if (spins > 10_000_000) {
-            klog.err("virtio-blk: read timeout blk=");
+    while (true) : (spins += 1) {
+        blk_lock.lock();
+        reap();
+        if (slots[head].done) break;
+        if (spins > max_spins) {
+            const vq = &(blk_dev.queue.?);
+            klog.err("virtio-blk: ");
+            klog.err(if (write) "write" else "read");
+            klog.err(" timeout blk=");
             klog.errDec(block);
             klog.err(" avail=");
             klog.errDec(vq.avail.idx);
@@ -208,116 +313,339 @@ pub fn readBlock(block: u64, buf: *[4096]u8) bool {
             klog.errDec(vq.used.idx);
             klog.err(" last=");
             klog.errDec(vq.last_used_idx);
-            klog.err(" free=");
-            klog.errDec(pmm.getFreePages());
             klog.err("\n");
-            vq.next_desc = 0;
-            pmm.freePage(data_phys);
-            pmm.freePage(req_phys);
+            slots[head].owner = OWNER_ORPHAN;
+            blk_lock.unlock();
             return false;
         }
+        blk_lock.unlock();
         cpu.spinHint();
     }
 
-    // Synchronous I/O complete — recycle all descriptors for next request
-    vq.next_desc = 0;
+    const ok = slots[head].ok;
+    slots[head] = .{};
+    blk_lock.unlock();
 
-    const status = req_ptr[16];
-
-    // Copy DMA buffer to caller's buffer (which may be a userspace address)
-    if (status == VIRTIO_BLK_S_OK) {
-        @memcpy(buf, data_ptr[0..4096]);
+    if (!ok) {
+        for (pages) |page| pmm.freePage(page);
     }
+    return ok;
+}
 
-    pmm.freePage(data_phys);
-    pmm.freePage(req_phys);
+// ---------- blocking pread/pwrite batches ----------
+
+/// Start a blocking transfer of `count` blocks at `block` for `proc`.
+/// Must run with the caller's address space loaded (writes copy the user
+/// buffer into DMA pages at submission). On success the caller is marked
+/// blocked and must call process.scheduleNext(); completion is picked up by
+/// resumeBatch() from process.switchTo(). Returns false if nothing could be
+/// started (device missing, out of range, out of memory).
+pub fn startBatch(proc: *process.Process, write: bool, user_buf: u64, block: u64, count: u64) bool {
+    if (!blk_dev.initialized or count == 0) return false;
+    if ((block + count) * SECTORS_PER_BLOCK > blk_dev.capacity) return false;
+
+    const idx = process.procIndex(proc);
+    blk_lock.lock();
+    defer blk_lock.unlock();
+
+    const b = &batches[idx];
+    releaseStale(idx);
+    b.* = .{
+        .active = true,
+        .pid = proc.pid,
+        .write = write,
+        .user_buf = user_buf,
+        .next_block = block,
+        .blocks_left = count,
+    };
 
-    return status == VIRTIO_BLK_S_OK;
+    submitRound(b, idx);
+    if (b.failed and b.count == 0) {
+        b.active = false;
+        return false;
+    }
+
+    proc.pending_op = if (write) .blk_write else .blk_read;
+    proc.state = .blocked;
+    return true;
 }
 
-/// Write a 4096-byte block to the device.
-/// block is a 4K-block number (sector = block * 8).
-pub fn writeBlock(block: u64, buf: *const [4096]u8) bool {
-    if (!blk_dev.initialized) return false;
+/// Collect a completed round for `proc` (called from process.switchTo with
+/// the address space loaded). Returns the syscall result once the batch is
+/// finished, or null after re-blocking the process while requests are still
+/// outstanding.
+pub fn resumeBatch(proc: *process.Process) ?u64 {
+    const idx = process.procIndex(proc);
+    const b = &batches[idx];
+
+    blk_lock.lock();
+    if (!b.active or b.pid != proc.pid) {
+        blk_lock.unlock();
+        return EIO;
+    }
+    if (b.starved) submitRound(b, idx);
+    if (b.inflight > 0 or b.starved) {
+        proc.state = .blocked;
+        blk_lock.unlock();
+        return null;
+    }
+    blk_lock.unlock();
+
+    // Every request in this round is done; slots are ours until released,
+    // so the copy runs without the lock.
+    var off = b.round_off;
+    var i: u8 = 0;
+    while (i < b.count) : (i += 1) {
+        const slot = &slots[b.heads[i]];
+        const len: u64 = @as(u64, slot.nsegs) * 4096;
+        if (slot.ok and !b.failed) {
+            if (!b.write) {
+                for (slot.data_phys[0..slot.nsegs], 0..) |page, j| {
+                    const dest: [*]u8 = @ptrFromInt(b.user_buf + off + @as(u64, j) * 4096);
+                    const src: [*]const u8 = paging.physPtr(page);
+                    @memcpy(dest[0..4096], src[0..4096]);
+                }
+            }
+            b.bytes_done += len;
+        } else {
+            b.failed = true;
+        }
+        off += len;
+        freeSlotPages(slot);
+        slot.* = .{};
+    }
+    b.count = 0;
+
+    blk_lock.lock();
+    defer blk_lock.unlock();
 
+    if (!b.failed and b.blocks_left > 0) {
+        submitRound(b, idx);
+        if (b.count > 0 or b.starved) {
+            proc.state = .blocked;
+            return null;
+        }
+    }
+
+    b.active = false;
+    return if (b.bytes_done > 0) b.bytes_done else EIO;
+}
+
+/// Submit up to BATCH_REQS multi-segment requests for the next part of a
+/// batch. Caller holds blk_lock.
+fn submitRound(b: *Batch, idx: u16) void {
     const vq = &(blk_dev.queue.?);
-    const sector = block * SECTORS_PER_BLOCK;
 
-    if (sector + SECTORS_PER_BLOCK > blk_dev.capacity) return false;
+    b.round_off = b.bytes_done;
+    b.count = 0;
+    b.inflight = 0;
+
+    var off = b.round_off;
+    while (b.count < BATCH_REQS and b.blocks_left > 0) {
+        // Gather DMA pages for up to MAX_SEGS blocks (fewer if memory is short)
+        const want: usize = @intCast(@min(b.blocks_left, MAX_SEGS));
+        var pages: [MAX_SEGS]u64 = undefined;
+        var n: usize = 0;
+        while (n < want) : (n += 1) {
+            pages[n] = pmm.allocPage() orelse break;
+            if (b.write) {
+                const src: [*]const u8 = @ptrFromInt(b.user_buf + off + @as(u64, n) * 4096);
+                const dst: [*]u8 = paging.physPtr(pages[n]);
+                @memcpy(dst[0..4096], src[0..4096]);
+            }
+        }
+        if (n == 0) {
+            if (b.count == 0) b.failed = true;
+            break;
+        }
 
-    // Allocate DMA pages. Use higher-half pointers for CPU access — identity-map
-    // may have been modified by user ELF mappings (huge page splits).
-    const req_phys = pmm.allocPage() orelse return false;
-    const data_phys = pmm.allocPage() orelse {
-        pmm.freePage(req_phys);
-        return false;
-    };
-    const req_ptr: [*]u8 = paging.physPtr(req_phys);
-    const data_ptr: [*]u8 = paging.physPtr(data_phys);
+        const head = queueRequest(b.next_block, b.write, pages[0..n], idx) orelse {
+            for (pages[0..n]) |page| pmm.freePage(page);
+            break;
+        };
+        b.heads[b.count] = head;
+        b.count += 1;
+        b.inflight += 1;
+        b.next_block += @as(u64, n);
+        b.blocks_left -= @as(u64, n);
+        off += @as(u64, n) * 4096;
+        if (n < want) break; // out of memory — finish this round first
+    }
 
-    // Copy caller's buffer to DMA buffer (caller may be userspace address)
-    @memcpy(data_ptr[0..4096], buf);
+    if (b.count > 0) virtio.notify(vq);
+    if (b.count > 0 or b.failed) {
+        if (b.starved) {
+            b.starved = false;
+            starved_count -= 1;
+        }
+    } else if (!b.starved) {
+        // Queue is full of other requests — retry when descriptors free up
+        b.starved = true;
+        starved_count += 1;
+    }
+}
+
+/// Drop proc's batch, if any, when its memory is torn down: DMA pages of
+/// finished requests are freed now, in-flight ones on completion.
+pub fn releaseBatch(proc: *process.Process) void {
+    if (!blk_dev.initialized) return;
+    const idx = process.procIndex(proc);
+    blk_lock.lock();
+    defer blk_lock.unlock();
+    if (batches[idx].pid == proc.pid) releaseStale(idx);
+}
+
+/// Detach a previous batch left behind by a process that was killed while
+/// blocked (same table index, different pid). Caller holds blk_lock.
+fn releaseStale(idx: u16) void {
+    const b = &batches[idx];
+    if (!b.active) return;
+    var i: u8 = 0;
+    while (i < b.count) : (i += 1) {
+        const slot = &slots[b.heads[i]];
+        if (slot.done) {
+            freeSlotPages(slot);
+            slot.* = .{};
+        } else {
+            slot.owner = OWNER_ORPHAN;
+        }
+    }
+    if (b.starved) starved_count -= 1;
+    b.active = false;
+}
+
+// ---------- request queue ----------
+
+fn freeSlotPages(slot: *Slot) void {
+    for (slot.data_phys[0..slot.nsegs]) |page| pmm.freePage(page);
+}
+
+/// Build and submit one request chain covering `pages.len` contiguous blocks
+/// starting at `block`. Caller holds blk_lock and notifies.
+fn queueRequest(block: u64, write: bool, pages: []const u64, owner: u16) ?u16 {
+    const vq = &(blk_dev.queue.?);
+    const nsegs: u16 = @intCast(pages.len);
+    const head = virtio.allocChain(vq, nsegs + 2) orelse return null;
 
-    // Write request header
-    const hdr: *VirtioBlkReq = @ptrCast(@alignCast(req_ptr));
+    const hdr_off: u64 = @as(u64, head) * HDR_STRIDE;
+    const hdr: *VirtioBlkReq = @ptrCast(@alignCast(hdr_area + hdr_off));
     hdr.* = .{
-        .req_type = VIRTIO_BLK_T_OUT,
+        .req_type = if (write) VIRTIO_BLK_T_OUT else VIRTIO_BLK_T_IN,
         .reserved = 0,
-        .sector = sector,
+        .sector = block * SECTORS_PER_BLOCK,
     };
-
-    // Status byte at offset 16
-    req_ptr[16] = 0xFF;
-
-    // 3-descriptor chain: header (r), data (r), status (w)
-    _ = virtio.addBufferChain3(
-        vq,
-        req_phys,
-        @sizeOf(VirtioBlkReq),
-        false, // device-readable
-        data_phys,
-        4096,
-        false, // device-readable (write from DMA buf)
-        req_phys + 16,
-        1,
-        true, // device-writable
-    ) orelse {
-        pmm.freePage(data_phys);
-        pmm.freePage(req_phys);
-        return false;
+    hdr_area[hdr_off + 16] = 0xFF; // status sentinel
+
+    // DMA addresses are physical — device accesses memory directly.
+    // Chain: header (r) -> data[0..n] (w for reads) -> status (w)
+    vq.desc[head].addr = hdr_phys + hdr_off;
+    vq.desc[head].len = @sizeOf(VirtioBlkReq);
+
+    var d = vq.desc[head].next;
+    for (pages) |page| {
+        vq.desc[d].addr = page;
+        vq.desc[d].len = 4096;
+        if (!write) vq.desc[d].flags |= virtio.VRING_DESC_F_WRITE;
+        d = vq.desc[d].next;
+    }
+    vq.desc[d].addr = hdr_phys + hdr_off + 16;
+    vq.desc[d].len = 1;
+    vq.desc[d].flags |= virtio.VRING_DESC_F_WRITE;
+
+    slots[head] = .{
+        .active = true,
+        .owner = owner,
+        .nsegs = @intCast(pages.len),
     };
+    @memcpy(slots[head].data_phys[0..pages.len], pages);
 
-    virtio.notify(vq);
+    virtio.submitChain(vq, head);
+    trace.point(.blk_submit, ownerPid(owner), block, pages.len);
+    return head;
+}
 
-    // Poll for completion
-    var spins: u32 = 0;
-    while (virtio.pollUsed(vq) == null) : (spins += 1) {
-        if (spins > 100_000_000) {
-            klog.err("virtio-blk: write timeout blk=");
-            klog.errDec(block);
-            klog.err(" avail=");
-            klog.errDec(vq.avail.idx);
-            klog.err(" used=");
-            klog.errDec(vq.used.idx);
-            klog.err(" last=");
-            klog.errDec(vq.last_used_idx);
-            klog.err("\n");
-            vq.next_desc = 0;
-            pmm.freePage(data_phys);
-            pmm.freePage(req_phys);
-            return false;
+/// Pid of the process a request belongs to (0 for kernel and orphaned ones).
+fn ownerPid(owner: u16) u32 {
+    return if (owner < process.MAX_PROCESSES) batches[owner].pid else 0;
+}
+
+/// Drain the used ring: mark slots complete, recycle their descriptors and
+/// wake processes whose round has finished. Caller holds blk_lock.
+fn reap() void {
+    const vq = &(blk_dev.queue.?);
+    var freed = false;
+
+    while (virtio.pollUsed(vq)) |elem| {
+        const head: u16 = @truncate(elem.id);
+        if (head >= MAX_QUEUE_SIZE or !slots[head].active) continue;
+        const slot = &slots[head];
+
+        virtio.freeChain(vq, head);
+        freed = true;
+        slot.ok = hdr_area[@as(u64, head) * HDR_STRIDE + 16] == VIRTIO_BLK_S_OK;
+        slot.done = true;
+        trace.point(.blk_complete, ownerPid(slot.owner), head, @intFromBool(slot.ok));
+
+        switch (slot.owner) {
+            OWNER_SYNC => {},
+            OWNER_ORPHAN => {
+                freeSlotPages(slot);
+                slot.* = .{};
+            },
+            else => |idx| {
+                const b = &batches[idx];
+                if (b.inflight > 0) b.inflight -= 1;
+                if (b.inflight == 0) wakeBatch(b, idx);
+            },
+        }
+    }
+
+    // Descriptors came back — let starved batches retry
+    if (freed and starved_count > 0) {
+        for (&batches, 0..) |*b, i| {
+            if (b.active and b.starved) wakeBatch(b, @intCast(i));
         }
-        cpu.spinHint();
     }
+}
 
-    // Synchronous I/O complete — recycle all descriptors for next request
-    vq.next_desc = 0;
+fn wakeBatch(b: *Batch, idx: u16) void {
+    const proc = &process.getProcessTable()[idx];
+    if (proc.pid != b.pid or proc.state != .blocked) return;
+    if (proc.pending_op != .blk_read and proc.pending_op != .blk_write) return;
+    process.markReady(proc);
+}
 
-    const status = req_ptr[16];
-    pmm.freePage(data_phys);
-    pmm.freePage(req_phys);
+/// IRQ handler — called from interrupt dispatch. Returns true if we handled it.
+fn handleIrq() bool {
+    if (!blk_dev.initialized) return false;
 
-    return status == VIRTIO_BLK_S_OK;
+    // Check ISR status (clears on read)
+    const isr = virtio.readIsr(&blk_dev.dev);
+    if (isr & 1 == 0) return false;
+
+    blk_lock.lock();
+    reap();
+    blk_lock.unlock();
+    return true;
+}
+
+/// Interrupt line for the device. x86_64 uses the PCI interrupt line
+/// programmed by firmware; QEMU riscv64 virt routes INTA..INTD to PLIC
+/// sources 32..35, swizzled by slot.
+fn irqLine(pci_dev: *pci.PciDevice) u8 {
+    if (comptime @import("builtin").cpu.arch == .riscv64) {
+        const pin: u8 = if (pci_dev.interrupt_pin == 0) 1 else pci_dev.interrupt_pin;
+        return 32 + ((pci_dev.slot + pin - 1) % 4);
+    }
+    return pci_dev.interrupt_line;
+}
+
+fn enableIrq(irq: u8) void {
+    switch (@import("builtin").cpu.arch) {
+        .x86_64 => @import("pic.zig").unmask(irq),
+        .riscv64 => @import("arch/riscv64/plic.zig").enable(irq),
+        else => {},
+    }
 }
 
 pub fn isInitialized() bool {
@@ -4,12 +4,17 @@
 /// Will be moved to userspace as a file server at /dev/ether0/ once
 /// MMIO mapping to userspace is implemented.
 ///
+/// RX is interrupt-driven: the device IRQ calls the handler installed with
+/// setRxHandler() (net.zig drains the ring there), so frames reach
+/// /dev/ether0 readers as they arrive rather than when the BSP next idles.
+///
 /// virtio-net legacy device config (at io_base + 0x14):
 ///   0x14  mac[0..5]     — MAC address (6 bytes)
 ///   0x1A  status         — link status (u16)
 const pmm = @import("pmm.zig");
 const klog = @import("klog.zig");
 const virtio = @import("virtio.zig");
+const SpinLock = @import("spinlock.zig").SpinLock;
 
 const paging = switch (@import("builtin").cpu.arch) {
     .x86_64 => @import("arch/x86_64/paging.zig"),
@@ -39,10 +44,23 @@ const cpu = switch (@import("builtin").cpu.arch) {
     },
 };
 
+const interrupts = switch (@import("builtin").cpu.arch) {
+    .x86_64 => @import("arch/x86_64/interrupts.zig"),
+    .riscv64 => @import("arch/riscv64/interrupts.zig"),
+    else => struct {
+        pub fn registerIrqHandler(_: u8, _: anytype) bool {
+            return false;
+        }
+    },
+};
+
 const RX_QUEUE = 0;
 const TX_QUEUE = 1;
 const RX_BUFFERS = 16;
-const TX_BUFFERS = 16;
+/// TX buffer pages, allocated once; also the most frames per notify.
+pub const TX_BATCH = 16;
+/// Largest frame send() accepts (Ethernet frame without FCS).
+pub const MAX_TX_FRAME = 1514;
 const FRAME_SIZE = 1514 + 10; // Max Ethernet frame + virtio-net header
 
 /// virtio-net header prepended to every packet.
@@ -62,9 +80,12 @@ pub const NetDevice = struct {
     tx_queue: ?virtio.Virtqueue,
     mac: [6]u8,
     rx_buffers: [RX_BUFFERS]u64, // physical addresses of receive buffers
+    tx_buffers: [TX_BATCH]u64, // physical addresses of transmit buffers
     initialized: bool,
     /// Index of the RX buffer to recycle on next poll (0xFF = none pending).
     pending_recycle: u8,
+    /// Recycled RX buffers not yet announced to the device (see flushRx).
+    pending_rx_notify: bool,
 };
 
 var net_dev: NetDevice = .{
@@ -73,10 +94,18 @@ var net_dev: NetDevice = .{
     .tx_queue = null,
     .mac = .{ 0, 0, 0, 0, 0, 0 },
     .rx_buffers = .{0} ** RX_BUFFERS,
+    .tx_buffers = .{0} ** TX_BATCH,
     .initialized = false,
     .pending_recycle = 0xFF,
+    .pending_rx_notify = false,
 };
 
+/// Called from the device IRQ when the used ring may hold new frames.
+var rx_handler: ?*const fn () void = null;
+/// Serializes the TX queue and buffers (kernel stack and /dev/ether0
+/// writers on any core, ARP replies from the RX IRQ).
+var tx_lock: SpinLock = .{};
+
 /// Initialize the virtio-net device.
 pub fn init() bool {
     if (@import("builtin").cpu.arch != .x86_64 and @import("builtin").cpu.arch != .riscv64) return false;
@@ -137,9 +166,25 @@ pub fn init() bool {
     // Post receive buffers
     postRxBuffers();
 
+    // Transmit buffers are reused for every send
+    for (&net_dev.tx_buffers) |*buf| {
+        buf.* = pmm.allocPage() orelse {
+            klog.err("virtio-net: failed to allocate TX buffers\n");
+            return false;
+        };
+    }
+
     net_dev.dev = dev;
     net_dev.initialized = true;
 
+    // RX IRQ. Without it frames are still picked up by the idle-loop poll.
+    const irq = irqLine(pci_dev);
+    if (interrupts.registerIrqHandler(irq, handleIrq)) {
+        enableIrq(irq);
+    } else {
+        klog.err("virtio-net: failed to register IRQ handler\n");
+    }
+
     klog.info("virtio-net: initialized (RX/TX queues ready)\n");
     return true;
 }
@@ -170,94 +215,158 @@ fn postRxBuffers() void {
 /// Send a raw Ethernet frame.
 /// `data` should NOT include the virtio-net header — this function prepends it.
 pub fn send(data: []const u8) bool {
-    if (!net_dev.initialized) return false;
-    if (data.len > 1514) return false; // Max Ethernet frame
+    if (data.len > MAX_TX_FRAME) return false;
+    return sendFrames(&.{data}) == 1;
+}
 
-    const tx = &(net_dev.tx_queue.?);
+/// Send up to TX_BATCH frames with a single device notify, then wait for
+/// the device to consume them all. Frames longer than MAX_TX_FRAME are
+/// dropped. Returns the number of frames handed to the device.
+pub fn sendFrames(frames: []const []const u8) usize {
+    if (!net_dev.initialized) return 0;
 
-    // Allocate a page for the TX buffer
-    const buf_phys = pmm.allocPage() orelse return false;
-    // Use higher-half pointer — identity-map may have been modified by user
-    // ELF mappings (huge page splits), so @ptrFromInt(buf_phys) can write
-    // to the wrong physical page.
-    const buf: [*]u8 = paging.physPtr(buf_phys);
+    tx_lock.lock();
+    defer tx_lock.unlock();
 
-    // Write virtio-net header (all zeros = no offloading)
+    const tx = &(net_dev.tx_queue.?);
     const hdr_size = @sizeOf(VirtioNetHeader);
-    @memset(buf[0..hdr_size], 0);
 
-    // Copy frame data after header
-    @memcpy(buf[hdr_size..][0..data.len], data);
-
-    const total_len: u32 = @intCast(hdr_size + data.len);
-
-    // Add to TX queue
-    _ = virtio.addBuffer(tx, buf_phys, total_len, false) orelse {
-        pmm.freePage(buf_phys);
-        return false;
-    };
+    var queued: usize = 0;
+    for (frames[0..@min(frames.len, TX_BATCH)]) |data| {
+        if (data.len > MAX_TX_FRAME) continue;
+        const buf_phys = net_dev.tx_buffers[queued];
+        // Higher-half pointer — the identity map may have been modified by
+        // user ELF mappings (huge page splits).
+        const buf: [*]u8 = paging.physPtr(buf_phys);
+
+        // virtio-net header (all zeros = no offloading), then the frame
+        @memset(buf[0..hdr_size], 0);
+        @memcpy(buf[hdr_size..][0..data.len], data);
+
+        const total_len: u32 = @intCast(hdr_size + data.len);
+        _ = virtio.addBuffer(tx, buf_phys, total_len, false) orelse break;
+        queued += 1;
+    }
+    if (queued == 0) return 0;
     virtio.notify(tx);
 
-    // Poll for TX completion so we can free the buffer page.
-    // Synchronous send — waits until the device processes the descriptor.
+    // Synchronous send — wait until the device has processed every
+    // descriptor, so the buffers and descriptors can be reused.
+    var done: usize = 0;
     var spins: u32 = 0;
-    while (virtio.pollUsed(tx) == null) : (spins += 1) {
+    while (done < queued) {
+        if (virtio.pollUsed(tx) != null) {
+            done += 1;
+            continue;
+        }
+        spins += 1;
         if (spins > 10_000_000) {
             klog.err("virtio-net: TX timeout\n");
-            pmm.freePage(buf_phys);
-            return false;
+            break;
         }
         cpu.spinHint();
     }
 
-    // Synchronous TX complete — recycle descriptor for next send
+    // TX complete — recycle descriptors for the next batch
     tx.next_desc = 0;
-
-    pmm.freePage(buf_phys);
-    return true;
+    return done;
 }
 
-/// Poll for received packets. Returns the data portion (after virtio-net header) or null.
+/// Poll for received packets. Returns the data portion (after virtio-net
+/// header), or null once the used ring is empty. Completions too short to
+/// hold a frame are recycled and skipped.
+/// Recycled buffers are re-posted but the device is only notified by
+/// flushRx(), which the caller runs once at the end of a batch of polls.
 pub fn poll() ?[]u8 {
     if (!net_dev.initialized) return null;
 
     const rx = &(net_dev.rx_queue.?);
+    const hdr_size = @sizeOf(VirtioNetHeader);
 
-    // Recycle the previous RX buffer before polling for a new one.
-    // The caller has finished processing the frame returned by the last poll().
-    if (net_dev.pending_recycle != 0xFF) {
-        const idx: u16 = net_dev.pending_recycle;
-        // Zero the buffer before re-posting
-        const buf_phys = net_dev.rx_buffers[idx];
-        const ptr: [*]u8 = paging.physPtr(buf_phys);
-        @memset(ptr[0..4096], 0);
-        // Re-post existing descriptor to the available ring (descriptor
-        // already points to the correct buffer from initial setup)
-        virtio.recycleDesc(rx, idx);
-        virtio.notify(rx);
-        net_dev.pending_recycle = 0xFF;
+    while (true) {
+        // The caller has finished processing the frame returned by the last poll()
+        recyclePending(rx);
+
+        const used = virtio.pollUsed(rx) orelse return null;
+
+        const buf_idx = used.id;
+        if (buf_idx >= RX_BUFFERS) continue;
+
+        const buf_phys = net_dev.rx_buffers[buf_idx];
+        // Use higher-half pointer — safe regardless of which process's page
+        // tables are active (identity-map may have modified entries).
+        const buf: [*]u8 = paging.physPtr(buf_phys);
+
+        const data_len = used.len;
+
+        // Mark this buffer for recycling on next poll() call
+        net_dev.pending_recycle = @intCast(buf_idx);
+
+        if (data_len <= hdr_size) continue;
+
+        const frame_len: usize = @intCast(data_len - hdr_size);
+        return buf[hdr_size..][0..frame_len];
     }
+}
 
-    const used = virtio.pollUsed(rx) orelse return null;
+/// Re-post the RX buffer returned by the last poll(), zeroed. The
+/// descriptor already points to the correct buffer from initial setup.
+fn recyclePending(rx: *virtio.Virtqueue) void {
+    if (net_dev.pending_recycle == 0xFF) return;
+    const idx: u16 = net_dev.pending_recycle;
+    const ptr: [*]u8 = paging.physPtr(net_dev.rx_buffers[idx]);
+    @memset(ptr[0..4096], 0);
+    virtio.recycleDesc(rx, idx);
+    net_dev.pending_recycle = 0xFF;
+    net_dev.pending_rx_notify = true;
+}
 
-    const buf_idx = used.id;
-    if (buf_idx >= RX_BUFFERS) return null;
+/// Recycle the last polled RX buffer and notify the device once for every
+/// buffer re-posted since the previous flush.
+pub fn flushRx() void {
+    if (!net_dev.initialized) return;
+    const rx = &(net_dev.rx_queue.?);
+    recyclePending(rx);
+    if (net_dev.pending_rx_notify) {
+        virtio.notify(rx);
+        net_dev.pending_rx_notify = false;
+    }
+}
 
-    const buf_phys = net_dev.rx_buffers[buf_idx];
-    // Use higher-half pointer — safe regardless of which process's page
-    // tables are active (identity-map may have modified entries).
-    const buf: [*]u8 = paging.physPtr(buf_phys);
+/// Install the function the RX IRQ calls to drain received frames.
+pub fn setRxHandler(handler: *const fn () void) void {
+    rx_handler = handler;
+}
 
-    const hdr_size = @sizeOf(VirtioNetHeader);
-    const data_len = used.len;
+/// IRQ handler — called from interrupt dispatch. Returns true if we handled it.
+fn handleIrq() bool {
+    if (!net_dev.initialized) return false;
 
-    if (data_len <= hdr_size) return null;
+    // Check ISR status (clears on read)
+    const isr = virtio.readIsr(&net_dev.dev);
+    if (isr & 1 == 0) return false;
 
-    // Mark this buffer for recycling on next poll() call
-    net_dev.pending_recycle = @intCast(buf_idx);
+    if (rx_handler) |handler| handler();
+    return true;
+}
+
+/// Interrupt line for the device. x86_64 uses the PCI interrupt line
+/// programmed by firmware; QEMU riscv64 virt routes INTA..INTD to PLIC
+/// sources 32..35, swizzled by slot.
+fn irqLine(pci_dev: *pci.PciDevice) u8 {
+    if (comptime @import("builtin").cpu.arch == .riscv64) {
+        const pin: u8 = if (pci_dev.interrupt_pin == 0) 1 else pci_dev.interrupt_pin;
+        return 32 + ((pci_dev.slot + pin - 1) % 4);
+    }
+    return pci_dev.interrupt_line;
+}
 
-    const frame_len: usize = @intCast(data_len - hdr_size);
-    return buf[hdr_size..][0..frame_len];
+fn enableIrq(irq: u8) void {
+    switch (@import("builtin").cpu.arch) {
+        .x86_64 => @import("pic.zig").unmask(irq),
+        .riscv64 => @import("arch/riscv64/plic.zig").enable(irq),
+        else => {},
+    }
 }
 
 /// Get the MAC address.
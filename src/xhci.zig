@@ -10,6 +10,7 @@ const paging = @import("arch/x86_64/paging.zig");
 const keyboard = @import("keyboard.zig");
 const process = @import("process.zig");
 const mem = @import("mem.zig");
+const timer = @import("timer.zig");
 
 // ── TRB (Transfer Request Block) ────────────────────────────────────
 
@@ -1283,6 +1284,22 @@ fn enqueueHidEp(dev: *UsbDevice, trb: Trb) void {
 
 // ── HID Event Processing ────────────────────────────────────────────
 
+/// HID event ring poll interval while a controller is up.
+const POLL_NS: u64 = timer.TICK_NS;
+var poll_timer: timer.Timer = .{ .func = &pollTimerFired };
+
+/// Start polling for HID events once the timer is running. Nothing is armed
+/// without a controller, so a machine without USB never wakes for it.
+pub fn startPolling() void {
+    if (!initialized) return;
+    timer.arm(&poll_timer, timer.now() + POLL_NS);
+}
+
+fn pollTimerFired(t: *timer.Timer) void {
+    pollUsbHid();
+    timer.arm(t, timer.now() + POLL_NS);
+}
+
 pub fn pollUsbHid() void {
     if (!initialized) return;
 
@@ -8,11 +8,18 @@
 ///   T_CREATE(flags, path)  → R_OK(handle) or R_ERROR
 ///   T_READ(handle, off, n) → R_OK(data) or R_ERROR
 ///   T_WRITE(handle, data)  → R_OK(bytes_written) or R_ERROR
+///   T_WRITE_BULK(handle, n) → R_OK(bytes_written) or R_ERROR  (data via grant)
 ///   T_CLOSE(handle)        → R_OK or R_ERROR
 ///   T_STAT(handle)         → R_OK(stat_data) or R_ERROR
 ///   T_REMOVE(path)         → R_OK or R_ERROR
+///
+/// The server channel is grant-enabled: T_READ with n > 4096 is a bulk
+/// read whose data is copied into the client's buffer with ipc_grant_write,
+/// and the reply carries only the byte count.
 const fx = @import("fornax");
 const Mutex = fx.thread.Mutex;
+const Condition = fx.thread.Condition;
+const RwLock = fx.thread.RwLock;
 
 const BLOCK_SIZE = 4096;
 const MAGIC = "FXFS0001";
@@ -46,7 +53,36 @@ const MAX_LEAF_ITEMS = 194;
 const MAX_INTERNAL_KEYS = 163;
 
 // Node cache
-const CACHE_SIZE = 16;
+// Buffer cache: capacity is chosen at mount from free memory (1/CACHE_MEM_SHARE
+// of free pages), clamped to [CACHE_MIN_BLOCKS, CACHE_MAX_BLOCKS].
+const CACHE_MIN_BLOCKS = 32;
+const CACHE_MAX_BLOCKS = 8192; // 32 MB
+const CACHE_MEM_SHARE = 32;
+
+/// Blocks fetched per extent read-ahead (one multi-block pread).
+const RA_BLOCKS = 16;
+
+/// Worker threads spawned at startup; the main thread serves as one more.
+const NUM_WORKERS = 3;
+
+/// Bulk transfers move through the grant in chunks of this size. Reads use
+/// a per-worker stack buffer; writes share bulk_write_buf under write_lock.
+const BULK_READ_CHUNK = 16 * 1024;
+const BULK_WRITE_CHUNK = 64 * 1024;
+var bulk_write_buf: [BULK_WRITE_CHUNK]u8 linksection(".bss") = undefined;
+
+// Group commit: transactions accumulate in memory and are committed
+// together with one superblock write, when GROUP_MAX_TXNS is reached,
+// dirty nodes fill a quarter of the cache, PENDING_FREE_COMMIT free ranges
+// are queued, GROUP_COMMIT_MS passes, or on ctl "sync".
+const GROUP_MAX_TXNS = 64;
+const GROUP_COMMIT_MS = 500;
+const GROUP_ALLOC_RANGES = 128;
+const PENDING_FREE_RANGES = 1024;
+const PENDING_FREE_COMMIT = 256;
+/// Ranges kept free for one tree operation's CoW path before a
+/// multi-extent free commits early.
+const PENDING_FREE_HEADROOM = 64;
 
 // ── On-disk structures ─────────────────────────────────────────────
 
@@ -108,13 +144,35 @@ const Handle = struct {
     active: bool,
 };
 
-var handles: [MAX_HANDLES]Handle linksection(".bss") = undefined;
+var handle_table: [MAX_HANDLES]Handle linksection(".bss") = undefined;
+
+/// The live handle table: handle_table, or the copy in the supervisor's
+/// state region, which a restarted instance takes over.
+var handles: *[MAX_HANDLES]Handle = &handle_table;
+
+/// Layout of the state region (svcState). magic is only set while the
+/// table is trusted; see validateHandles().
+const SavedState = struct {
+    magic: u64,
+    handles: [MAX_HANDLES]Handle,
+};
+
+const STATE_MAGIC: u64 = 0x3130_5453_5346_5846; // "FXFSST01"
+
+comptime {
+    if (@sizeOf(SavedState) > fx.SVC_STATE_SIZE) @compileError("fxfs state exceeds the state region");
+}
+
+/// Protects the handles[] array. Taken on its own, never around tree work.
+var handle_lock: Mutex = .{};
 
 fn allocHandle(inode_nr: u64) ?u32 {
     return allocHandleAt(inode_nr, 0);
 }
 
 fn allocHandleAt(inode_nr: u64, write_offset: u64) ?u32 {
+    handle_lock.lock();
+    defer handle_lock.unlock();
     for (1..MAX_HANDLES) |i| {
         if (!handles[i].active) {
             handles[i] = .{ .inode_nr = inode_nr, .write_offset = write_offset, .active = true };
@@ -125,76 +183,474 @@ fn allocHandleAt(inode_nr: u64, write_offset: u64) ?u32 {
 }
 
 fn freeHandle(handle: u32) void {
+    handle_lock.lock();
+    defer handle_lock.unlock();
     if (handle > 0 and handle < MAX_HANDLES) {
         handles[handle].active = false;
     }
 }
 
-fn getHandle(handle: u32) ?*Handle {
+/// Check a handle table taken over from a previous instance against the
+/// disk. That instance may have died partway through changing a handle,
+/// so drop any that don't name a live inode and clamp write offsets to
+/// the file size. Runs before the workers start, with the tree loaded.
+fn validateHandles() u32 {
+    var dropped: u32 = 0;
+    for (handles[1..]) |*h| {
+        // Look at the flag as a byte; anything but 0 or 1 is a torn entry.
+        const flag: *const u8 = @ptrCast(&h.active);
+        if (flag.* == 0) continue;
+        const inode = if (flag.* == 1 and h.inode_nr != 0 and h.inode_nr < sb_next_inode)
+            readInode(h.inode_nr)
+        else
+            null;
+        if (inode) |ino| {
+            if (h.write_offset > ino.size) h.write_offset = ino.size;
+        } else {
+            h.* = .{ .inode_nr = 0, .write_offset = 0, .active = false };
+            dropped += 1;
+        }
+    }
+    return dropped;
+}
+
+/// Copy of an open handle, taken under handle_lock. Another worker may
+/// close the handle meanwhile, so offset changes go back through
+/// setWriteOffset/clampWriteOffset rather than through a table pointer.
+fn getHandle(handle: u32) ?Handle {
     if (handle == 0 or handle >= MAX_HANDLES) return null;
+    handle_lock.lock();
+    defer handle_lock.unlock();
     if (!handles[handle].active) return null;
-    return &handles[handle];
+    return handles[handle];
 }
 
-// ── Node cache ─────────────────────────────────────────────────────
+/// Set the write offset of `handle`, if it is still open on `inode_nr`.
+fn setWriteOffset(handle: u32, inode_nr: u64, offset: u64) void {
+    handle_lock.lock();
+    defer handle_lock.unlock();
+    const h = &handles[handle];
+    if (h.active and h.inode_nr == inode_nr) h.write_offset = offset;
+}
+
+/// Lower the write offset of `handle` to at most `limit`, if it is still
+/// open on `inode_nr`.
+fn clampWriteOffset(handle: u32, inode_nr: u64, limit: u64) void {
+    handle_lock.lock();
+    defer handle_lock.unlock();
+    const h = &handles[handle];
+    if (h.active and h.inode_nr == inode_nr and h.write_offset > limit) h.write_offset = limit;
+}
+
+// ── Buffer cache ───────────────────────────────────────────────────
+//
+// Hashed lookup (chained through `next`, NO_ENTRY terminated) with CLOCK
+// eviction: a hit sets `referenced`; the hand clears it on the first pass
+// and evicts on the second. B-tree nodes and file data share the cache;
+// data blocks are inserted unreferenced so a streaming read cannot push
+// out hot metadata.
+//
+// Readers run concurrently under tree_lock (shared) and keep pointers into
+// cache_blocks while they walk the tree, so eviction must not recycle an
+// entry another reader may still be looking at. Each reader takes a pin
+// (cachePin) recording the epoch it started in; every lookup stamps the
+// entry with the current epoch. An entry stamped at or after the oldest
+// active pin is never recycled; if every entry is, a reader's miss is
+// served from its own spill buffers instead. All metadata is under cache_lock;
+// block contents are only written by inserts of absent blocks, or by a
+// writer overwriting under tree_lock exclusive when no reader is active.
+//
+// B-tree nodes are write-back: writeTreeNode only caches the node as
+// dirty, and groupCommit writes all dirty nodes before the superblock.
+// CoW never writes a block the committed tree uses, so a dirty node that
+// must be evicted early can always be written in place.
+
+const NO_ENTRY: u32 = 0xFFFF_FFFF;
 
 const CacheEntry = struct {
     block_nr: u64,
+    next: u32,
     valid: bool,
-    use_count: u32,
+    referenced: bool,
+    dirty: bool, // node not yet written to disk
+    stamp: u64, // cache_epoch at last lookup or insert
 };
 
-var cache_blocks: [CACHE_SIZE][BLOCK_SIZE]u8 linksection(".bss") = undefined;
-var cache_entries: [CACHE_SIZE]CacheEntry linksection(".bss") = undefined;
+const MAX_READERS = NUM_WORKERS + 1;
+/// Blocks a reader can hold from cacheFill at once when the cache is full
+/// of pinned entries: a scanned leaf plus the block its callback reads.
+const SPILL_BLOCKS = 4;
+
+var cache_fallback_blocks: [CACHE_MIN_BLOCKS][BLOCK_SIZE]u8 linksection(".bss") = undefined;
+var cache_fallback_entries: [CACHE_MIN_BLOCKS]CacheEntry linksection(".bss") = undefined;
+var cache_fallback_buckets: [CACHE_MIN_BLOCKS * 2]u32 linksection(".bss") = undefined;
+
+var cache_blocks: [][BLOCK_SIZE]u8 = &.{};
+var cache_entries: []CacheEntry = &.{};
+var cache_buckets: []u32 = &.{};
+var cache_hand: usize = 0;
+
+var cache_lock: Mutex = .{};
+var cache_epoch: u64 = 1;
+var cache_pins: [MAX_READERS]u64 = [_]u64{0} ** MAX_READERS; // 0 = slot free
+var cache_pin_pid: [MAX_READERS]u32 = [_]u32{0} ** MAX_READERS;
+var cache_pin_free: Condition = .{};
+/// Per-pin blocks handed out round-robin when nothing can be evicted.
+var cache_spill: [MAX_READERS][SPILL_BLOCKS][BLOCK_SIZE]u8 linksection(".bss") = undefined;
+var cache_spill_next: [MAX_READERS]u8 = [_]u8{0} ** MAX_READERS;
+
+var cache_hits: u64 = 0;
+var cache_misses: u64 = 0;
+var cache_evictions: u64 = 0;
+var cache_spills: u64 = 0;
+var cache_dirty: u64 = 0;
+var cache_wb_failed: bool = false; // sticky: a write-back failed, refuse to commit
+var cache_wb_inflight: u32 = 0; // eviction write-backs running outside cache_lock
+var cache_wb_done: Condition = .{};
+
+/// A dirty node cacheEvict copied out, for the caller to write back once
+/// cache_lock is dropped.
+const WriteBack = struct {
+    pending: bool = false,
+    block_nr: u64 = 0,
+    buf: [BLOCK_SIZE]u8 = undefined,
+};
 
+/// Size the cache from free memory and map its storage. Falls back to a
+/// static CACHE_MIN_BLOCKS cache if the mapping fails.
 fn cacheInit() void {
-    for (0..CACHE_SIZE) |i| {
-        cache_entries[i] = .{ .block_nr = 0, .valid = false, .use_count = 0 };
+    var capacity: usize = CACHE_MIN_BLOCKS;
+    if (fx.sysinfo()) |info| {
+        const share: usize = @intCast(info.free_pages / CACHE_MEM_SHARE);
+        capacity = @max(CACHE_MIN_BLOCKS, @min(share, CACHE_MAX_BLOCKS));
+    }
+    // Bucket count: power of two, about two buckets per entry
+    var nbuckets: usize = 1;
+    while (nbuckets < capacity * 2) nbuckets <<= 1;
+
+    cache_blocks = &cache_fallback_blocks;
+    cache_entries = &cache_fallback_entries;
+    cache_buckets = &cache_fallback_buckets;
+
+    if (capacity > CACHE_MIN_BLOCKS) {
+        const MAP_ANONYMOUS: u64 = 0x20;
+        const MAP_PRIVATE: u64 = 0x02;
+        const PROT_RW: u64 = 0x3;
+        const bytes = capacity * BLOCK_SIZE + capacity * @sizeOf(CacheEntry) + nbuckets * @sizeOf(u32);
+        const base = fx.mmap(0, bytes, PROT_RW, MAP_ANONYMOUS | MAP_PRIVATE);
+        if (base != 0 and base < 0xFFFF_FFFF_FFFF_0000) {
+            const blocks_ptr: [*][BLOCK_SIZE]u8 = @ptrFromInt(base);
+            const entries_ptr: [*]CacheEntry = @ptrFromInt(base + capacity * BLOCK_SIZE);
+            const buckets_ptr: [*]u32 = @ptrFromInt(base + capacity * BLOCK_SIZE + capacity * @sizeOf(CacheEntry));
+            cache_blocks = blocks_ptr[0..capacity];
+            cache_entries = entries_ptr[0..capacity];
+            cache_buckets = buckets_ptr[0..nbuckets];
+        }
+    }
+
+    for (cache_entries) |*e| {
+        e.* = .{ .block_nr = 0, .next = NO_ENTRY, .valid = false, .referenced = false, .dirty = false, .stamp = 0 };
+    }
+    @memset(cache_buckets, NO_ENTRY);
+    cache_hand = 0;
+}
+
+fn cacheBucket(block_nr: u64) usize {
+    // Fibonacci hashing — consecutive block numbers spread across buckets
+    const h = block_nr *% 0x9E37_79B9_7F4A_7C15;
+    return @intCast((h >> 32) & (cache_buckets.len - 1));
+}
+
+fn cacheFind(block_nr: u64) ?usize {
+    var idx = cache_buckets[cacheBucket(block_nr)];
+    while (idx != NO_ENTRY) {
+        const e = &cache_entries[idx];
+        if (e.valid and e.block_nr == block_nr) return idx;
+        idx = e.next;
+    }
+    return null;
+}
+
+fn cacheUnlink(idx: usize) void {
+    const bucket = &cache_buckets[cacheBucket(cache_entries[idx].block_nr)];
+    if (bucket.* == idx) {
+        bucket.* = cache_entries[idx].next;
+    } else {
+        var cur = bucket.*;
+        while (cur != NO_ENTRY) {
+            if (cache_entries[cur].next == idx) {
+                cache_entries[cur].next = cache_entries[idx].next;
+                break;
+            }
+            cur = cache_entries[cur].next;
+        }
+    }
+    if (cache_entries[idx].dirty) {
+        cache_entries[idx].dirty = false;
+        cache_dirty -= 1;
+    }
+    cache_entries[idx].valid = false;
+    cache_entries[idx].next = NO_ENTRY;
+}
+
+/// Start a read-side critical section: blocks looked up until the matching
+/// cacheUnpin stay resident. Waits if every slot is taken; pin holders
+/// never wait on each other, so one always comes free.
+fn cachePin() usize {
+    const pid = fx.getpid();
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    while (true) {
+        for (&cache_pins, 0..) |*pin, i| {
+            if (pin.* == 0) {
+                cache_epoch += 1;
+                pin.* = cache_epoch;
+                cache_pin_pid[i] = pid;
+                return i;
+            }
+        }
+        cache_pin_free.wait(&cache_lock);
     }
 }
 
+fn cacheUnpin(slot: usize) void {
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    cache_pins[slot] = 0;
+    cache_pin_free.signal();
+}
+
+/// Next spill buffer of the calling reader's pin. Caller holds cache_lock.
+fn cacheSpill(pid: u32) ?*[BLOCK_SIZE]u8 {
+    for (cache_pins, 0..) |pin, i| {
+        if (pin == 0 or cache_pin_pid[i] != pid) continue;
+        const n = cache_spill_next[i];
+        cache_spill_next[i] = @intCast((n + 1) % SPILL_BLOCKS);
+        cache_spills += 1;
+        return &cache_spill[i][n];
+    }
+    return null;
+}
+
+/// Epoch of the oldest active pin; entries stamped at or after it are in use.
+fn cacheOldestPin() u64 {
+    var oldest: u64 = 0xFFFF_FFFF_FFFF_FFFF;
+    for (cache_pins) |pin| {
+        if (pin != 0 and pin < oldest) oldest = pin;
+    }
+    return oldest;
+}
+
 fn cacheRead(block_nr: u64) ?*[BLOCK_SIZE]u8 {
-    // Check if already cached
-    for (0..CACHE_SIZE) |i| {
-        if (cache_entries[i].valid and cache_entries[i].block_nr == block_nr) {
-            cache_entries[i].use_count +%= 1;
-            return &cache_blocks[i];
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    if (cacheFind(block_nr)) |idx| {
+        cache_entries[idx].referenced = true;
+        cache_entries[idx].stamp = cache_epoch;
+        cache_hits += 1;
+        return &cache_blocks[idx];
+    }
+    cache_misses += 1;
+    return null;
+}
+
+/// Pick an entry to reuse and unlink it, or null if every entry may be in
+/// use by a pinned reader. If the pick is dirty it is copied into `wb`
+/// instead and null returned: the caller writes it with cacheWriteBack
+/// and tries again. Caller holds cache_lock.
+fn cacheEvict(wb: *WriteBack) ?usize {
+    // CLOCK: advance the hand, clearing reference bits, until an entry
+    // that is free or was not referenced since the last pass. Dirty nodes
+    // are passed over for two full sweeps, then written back. Entries
+    // pinned by an active reader are never taken.
+    const oldest = cacheOldestPin();
+    var scanned: usize = 0;
+    while (scanned < 3 * cache_entries.len) : (scanned += 1) {
+        const idx = cache_hand;
+        cache_hand = (cache_hand + 1) % cache_entries.len;
+        const e = &cache_entries[idx];
+        if (!e.valid) return idx;
+        if (e.stamp >= oldest) continue;
+        if (scanned < 2 * cache_entries.len) {
+            if (e.dirty) continue;
+            if (e.referenced) {
+                e.referenced = false;
+                continue;
+            }
+        }
+        if (e.dirty) {
+            // Stays cached (clean) while the write runs, so lookups hit it
+            @memcpy(&wb.buf, &cache_blocks[idx]);
+            wb.block_nr = e.block_nr;
+            wb.pending = true;
+            e.dirty = false;
+            cache_dirty -= 1;
+            cache_wb_inflight += 1;
+            return null;
         }
+        cacheUnlink(idx);
+        cache_evictions += 1;
+        return idx;
     }
     return null;
 }
 
-fn cacheInsert(block_nr: u64, data: *const [BLOCK_SIZE]u8) *[BLOCK_SIZE]u8 {
-    // Find free slot or evict LRU
-    var min_use: u32 = 0xFFFFFFFF;
-    var evict_idx: usize = 0;
-    for (0..CACHE_SIZE) |i| {
-        if (!cache_entries[i].valid) {
-            evict_idx = i;
-            break;
+/// Write the node cacheEvict copied out. Drops cache_lock for the I/O, so
+/// the caller must look its block up again afterwards.
+fn cacheWriteBack(wb: *WriteBack) void {
+    wb.pending = false;
+    cache_lock.unlock();
+    const ok = writeBlockRaw(wb.block_nr, &wb.buf);
+    cache_lock.lock();
+    if (!ok) cache_wb_failed = true;
+    cache_wb_inflight -= 1;
+    if (cache_wb_inflight == 0) cache_wb_done.broadcast();
+}
+
+fn cacheLink(idx: usize, block_nr: u64, referenced: bool) void {
+    const bucket = &cache_buckets[cacheBucket(block_nr)];
+    cache_entries[idx] = .{
+        .block_nr = block_nr,
+        .next = bucket.*,
+        .valid = true,
+        .referenced = referenced,
+        .dirty = false,
+        .stamp = cache_epoch,
+    };
+    bucket.* = @intCast(idx);
+}
+
+/// Insert (or overwrite) a cached block. `referenced` starts the entry with
+/// its second chance already granted — used for B-tree nodes. Overwriting
+/// is only done by writers, which hold tree_lock exclusive. The block is
+/// on disk already, so if nothing can be evicted it is simply not cached.
+fn cacheInsertAs(block_nr: u64, data: *const [BLOCK_SIZE]u8, referenced: bool) void {
+    var wb: WriteBack = .{};
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    while (true) {
+        if (cacheFind(block_nr)) |idx| {
+            @memcpy(&cache_blocks[idx], data);
+            cache_entries[idx].referenced = cache_entries[idx].referenced or referenced;
+            cache_entries[idx].stamp = cache_epoch;
+            return;
         }
-        if (cache_entries[i].use_count < min_use) {
-            min_use = cache_entries[i].use_count;
-            evict_idx = i;
+        const victim = cacheEvict(&wb) orelse {
+            if (!wb.pending) return;
+            cacheWriteBack(&wb);
+            continue;
+        };
+        @memcpy(&cache_blocks[victim], data);
+        cacheLink(victim, block_nr, referenced);
+        return;
+    }
+}
+
+fn cacheInsert(block_nr: u64, data: *const [BLOCK_SIZE]u8) void {
+    cacheInsertAs(block_nr, data, true);
+}
+
+/// Cache a B-tree node that has not been written yet. Returns false if an
+/// eviction write-back has failed. With no entry to spare, the node is
+/// written through instead, outside cache_lock.
+fn cacheInsertDirty(block_nr: u64, data: *const [BLOCK_SIZE]u8) bool {
+    var wb: WriteBack = .{};
+    {
+        cache_lock.lock();
+        defer cache_lock.unlock();
+        while (true) {
+            const idx = cacheFind(block_nr) orelse blk: {
+                const victim = cacheEvict(&wb) orelse {
+                    if (!wb.pending) break;
+                    cacheWriteBack(&wb);
+                    continue;
+                };
+                cacheLink(victim, block_nr, true);
+                break :blk victim;
+            };
+            @memcpy(&cache_blocks[idx], data);
+            cache_entries[idx].stamp = cache_epoch;
+            if (!cache_entries[idx].dirty) {
+                cache_entries[idx].dirty = true;
+                cache_dirty += 1;
+            }
+            return !cache_wb_failed;
         }
     }
+    return writeBlockRaw(block_nr, data) and !cache_wb_failed;
+}
 
-    @memcpy(&cache_blocks[evict_idx], data);
-    cache_entries[evict_idx] = .{ .block_nr = block_nr, .valid = true, .use_count = 1 };
-    return &cache_blocks[evict_idx];
+fn cacheDirtyCount() u64 {
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    return cache_dirty;
 }
 
-fn cacheInvalidate(block_nr: u64) void {
-    for (0..CACHE_SIZE) |i| {
-        if (cache_entries[i].valid and cache_entries[i].block_nr == block_nr) {
-            cache_entries[i].valid = false;
+/// Write every dirty node to disk. The copy is taken under cache_lock and
+/// written outside it, so readers are not held up by the I/O.
+fn cacheFlushDirty() bool {
+    var buf: [BLOCK_SIZE]u8 = undefined;
+    var i: usize = 0;
+    while (true) : (i += 1) {
+        var block_nr: u64 = 0;
+        {
+            cache_lock.lock();
+            defer cache_lock.unlock();
+            while (i < cache_entries.len and !cache_entries[i].dirty) i += 1;
+            if (i == cache_entries.len) break;
+            @memcpy(&buf, &cache_blocks[i]);
+            block_nr = cache_entries[i].block_nr;
+            cache_entries[i].dirty = false;
+            cache_dirty -= 1;
+        }
+        if (!writeBlockRaw(block_nr, &buf)) {
+            cache_wb_failed = true;
+            return false;
         }
     }
+    // Nodes cleaned by an eviction must be on disk before the superblock
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    while (cache_wb_inflight > 0) cache_wb_done.wait(&cache_lock);
+    return !cache_wb_failed;
 }
 
-// ── Block I/O ──────────────────────────────────────────────────────
+/// Insert a block just read from disk, for the read paths. If another
+/// reader raced us and cached it first, keep its copy — the contents are
+/// identical and it may already be in use. If every entry is pinned, the
+/// block goes to one of the caller's spill buffers instead.
+fn cacheFill(block_nr: u64, data: *const [BLOCK_SIZE]u8, referenced: bool) ?*[BLOCK_SIZE]u8 {
+    const pid = fx.getpid();
+    var wb: WriteBack = .{};
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    while (true) {
+        if (cacheFind(block_nr)) |idx| {
+            cache_entries[idx].stamp = cache_epoch;
+            return &cache_blocks[idx];
+        }
+        const victim = cacheEvict(&wb) orelse {
+            if (wb.pending) {
+                cacheWriteBack(&wb);
+                continue;
+            }
+            const spill = cacheSpill(pid) orelse return null;
+            @memcpy(spill, data);
+            return spill;
+        };
+        @memcpy(&cache_blocks[victim], data);
+        cacheLink(victim, block_nr, referenced);
+        return &cache_blocks[victim];
+    }
+}
+
+fn cacheInvalidate(block_nr: u64) void {
+    cache_lock.lock();
+    defer cache_lock.unlock();
+    if (cacheFind(block_nr)) |idx| cacheUnlink(idx);
+}
 
-var io_buf: [BLOCK_SIZE]u8 linksection(".bss") = undefined;
+// ── Block I/O ──────────────────────────────────────────────────────
 
 fn readBlock(block_nr: u64, buf: *[BLOCK_SIZE]u8) bool {
     const n = fx.pread(BLK_FD, buf, block_nr * BLOCK_SIZE);
@@ -202,15 +658,37 @@ fn readBlock(block_nr: u64, buf: *[BLOCK_SIZE]u8) bool {
 }
 
 fn writeBlock(block_nr: u64, buf: *const [BLOCK_SIZE]u8) bool {
+    raInvalidate(block_nr, 1);
+    return writeBlockRaw(block_nr, buf);
+}
+
+/// Write without touching the read-ahead window — for B-tree node
+/// write-back. Nodes are never read through the window.
+fn writeBlockRaw(block_nr: u64, buf: *const [BLOCK_SIZE]u8) bool {
     const n = fx.pwrite(BLK_FD, buf, block_nr * BLOCK_SIZE);
     return n == BLOCK_SIZE;
 }
 
+/// Read buf.len / BLOCK_SIZE consecutive blocks with a single pread.
+fn readBlocks(block_nr: u64, buf: []u8) bool {
+    const n = fx.pread(BLK_FD, buf, block_nr * BLOCK_SIZE);
+    return n == @as(isize, @intCast(buf.len));
+}
+
+/// Write buf.len / BLOCK_SIZE consecutive blocks with a single pwrite.
+fn writeBlocks(block_nr: u64, buf: []const u8) bool {
+    raInvalidate(block_nr, buf.len / BLOCK_SIZE);
+    const n = fx.pwrite(BLK_FD, buf, block_nr * BLOCK_SIZE);
+    return n == @as(isize, @intCast(buf.len));
+}
+
 fn readBlockCached(block_nr: u64) ?*[BLOCK_SIZE]u8 {
     if (cacheRead(block_nr)) |cached| return cached;
 
-    if (!readBlock(block_nr, &io_buf)) return null;
-    return cacheInsert(block_nr, &io_buf);
+    // Read outside cache_lock so concurrent misses overlap on the disk
+    var buf: [BLOCK_SIZE]u8 = undefined;
+    if (!readBlock(block_nr, &buf)) return null;
+    return cacheFill(block_nr, &buf, true);
 }
 
 // ── Superblock ─────────────────────────────────────────────────────
@@ -649,9 +1127,9 @@ fn isDirectory(inode: InodeItem) bool {
 
 // ── Directory lookup ───────────────────────────────────────────────
 
-/// Look up a name in a directory inode. Returns the child inode number, or null.
-fn dirLookup(dir_inode: u64, name: []const u8) ?u64 {
-    const name_hash = fnvHash(name);
+/// Look up a name in a directory inode. Returns the child inode number, or
+/// null; `file_type` receives the entry's DT_* type.
+fn dirLookup(dir_inode: u64, name: []const u8, name_hash: u64, file_type: *u8) ?u64 {
     const key = Key{ .inode_nr = dir_inode, .item_type = DIR_ENTRY, .offset = name_hash };
 
     // Exact hash lookup first
@@ -661,6 +1139,7 @@ fn dirLookup(dir_inode: u64, name: []const u8) ?u64 {
             if (entry_name_len <= data.len - 10) {
                 const entry_name = data[10..][0..entry_name_len];
                 if (fx.str.eql(entry_name, name)) {
+                    file_type.* = data[8];
                     return readU64LE(data[0..8]);
                 }
             }
@@ -671,8 +1150,9 @@ fn dirLookup(dir_inode: u64, name: []const u8) ?u64 {
     const Ctx = struct {
         target_name: []const u8,
         result: ?u64,
+        file_type: u8,
     };
-    var ctx = Ctx{ .target_name = name, .result = null };
+    var ctx = Ctx{ .target_name = name, .result = null, .file_type = 0 };
 
     _ = btreeScan(dir_inode, DIR_ENTRY, &ctx, struct {
         fn cb(c: *Ctx, _: Key, data: []const u8) void {
@@ -682,18 +1162,106 @@ fn dirLookup(dir_inode: u64, name: []const u8) ?u64 {
                     const n = data[10..][0..n_len];
                     if (fx.str.eql(n, c.target_name)) {
                         c.result = readU64LE(data[0..8]);
+                        c.file_type = data[8];
                     }
                 }
             }
         }
     }.cb);
 
+    file_type.* = ctx.file_type;
     return ctx.result;
 }
 
+// ── Dentry cache ───────────────────────────────────────────────────
+//
+// Direct-mapped cache of (parent inode, name) → child, in front of
+// dirLookup. Misses are cached too (child = 0; inode 0 is never valid), so
+// PATH searches for absent names stay off the B-tree. Entries also record
+// whether the child is a directory, which lets resolvePath skip the
+// per-component inode read. Mutating handlers call dcacheInvalidate for
+// every name they add, remove or rename, while still holding tree_lock
+// exclusive; inode numbers are never reused, so entries under a removed
+// directory are simply unreachable. Names longer than DCACHE_NAME_MAX
+// always go to the tree.
+
+const DCACHE_SIZE = 512; // power of two
+const DCACHE_NAME_MAX = 47;
+
+const Dentry = struct {
+    parent: u64,
+    name_hash: u64,
+    child: u64, // 0 = known absent
+    is_dir: bool,
+    valid: bool,
+    name_len: u8,
+    name: [DCACHE_NAME_MAX]u8,
+};
+
+const DcacheHit = struct { child: u64, is_dir: bool };
+
+var dcache: [DCACHE_SIZE]Dentry linksection(".bss") = undefined;
+var dcache_lock: Mutex = .{};
+var dcache_hits: u64 = 0;
+var dcache_neg_hits: u64 = 0;
+var dcache_misses: u64 = 0;
+
+fn dcacheInit() void {
+    for (&dcache) |*d| d.valid = false;
+}
+
+fn dcacheSlot(parent: u64, name_hash: u64) *Dentry {
+    const h = (name_hash ^ (parent *% 0x9E37_79B9_7F4A_7C15)) *% 0x9E37_79B9_7F4A_7C15;
+    return &dcache[@intCast((h >> 32) & (DCACHE_SIZE - 1))];
+}
+
+fn dcacheMatch(d: *const Dentry, parent: u64, name: []const u8, name_hash: u64) bool {
+    return d.valid and d.parent == parent and d.name_hash == name_hash and
+        fx.str.eql(d.name[0..d.name_len], name);
+}
+
+fn dcacheLookup(parent: u64, name: []const u8, name_hash: u64) ?DcacheHit {
+    if (name.len > DCACHE_NAME_MAX) return null;
+    dcache_lock.lock();
+    defer dcache_lock.unlock();
+    const d = dcacheSlot(parent, name_hash);
+    if (!dcacheMatch(d, parent, name, name_hash)) {
+        dcache_misses += 1;
+        return null;
+    }
+    if (d.child == 0) dcache_neg_hits += 1 else dcache_hits += 1;
+    return .{ .child = d.child, .is_dir = d.is_dir };
+}
+
+fn dcacheInsert(parent: u64, name: []const u8, name_hash: u64, child: u64, is_dir: bool) void {
+    if (name.len > DCACHE_NAME_MAX) return;
+    dcache_lock.lock();
+    defer dcache_lock.unlock();
+    const d = dcacheSlot(parent, name_hash);
+    d.* = .{
+        .parent = parent,
+        .name_hash = name_hash,
+        .child = child,
+        .is_dir = is_dir,
+        .valid = true,
+        .name_len = @intCast(name.len),
+        .name = undefined,
+    };
+    @memcpy(d.name[0..name.len], name);
+}
+
+fn dcacheInvalidate(parent: u64, name: []const u8) void {
+    const name_hash = fnvHash(name);
+    dcache_lock.lock();
+    defer dcache_lock.unlock();
+    const d = dcacheSlot(parent, name_hash);
+    if (dcacheMatch(d, parent, name, name_hash)) d.valid = false;
+}
+
 /// Resolve a path from root (inode 1) to an inode number.
 fn resolvePath(path: []const u8) ?u64 {
     var current: u64 = 1; // root inode
+    var current_is_dir = true;
     var remaining = path;
 
     // Skip leading slash
@@ -707,26 +1275,104 @@ fn resolvePath(path: []const u8) ?u64 {
             comp_end += 1;
         }
         const component = remaining[0..comp_end];
-        if (component.len == 0) {
-            remaining = if (comp_end < remaining.len) remaining[comp_end + 1 ..] else remaining[remaining.len..];
+        remaining = if (comp_end < remaining.len) remaining[comp_end + 1 ..] else remaining[remaining.len..];
+        if (component.len == 0) continue;
+
+        // Directory type comes from the parent's entry (root is known)
+        if (!current_is_dir) return null;
+
+        const name_hash = fnvHash(component);
+        if (dcacheLookup(current, component, name_hash)) |hit| {
+            if (hit.child == 0) return null;
+            current = hit.child;
+            current_is_dir = hit.is_dir;
             continue;
         }
 
-        // Verify current is a directory
-        const inode = readInode(current) orelse return null;
-        if (!isDirectory(inode)) return null;
-
-        current = dirLookup(current, component) orelse return null;
-        remaining = if (comp_end < remaining.len) remaining[comp_end + 1 ..] else remaining[remaining.len..];
+        var file_type: u8 = 0;
+        const child = dirLookup(current, component, name_hash, &file_type);
+        dcacheInsert(current, component, name_hash, child orelse 0, file_type == DT_DIR);
+        current = child orelse return null;
+        current_is_dir = file_type == DT_DIR;
     }
 
     return current;
 }
 
+// ── Extent read-ahead ──────────────────────────────────────────────
+//
+// Clients read 4 KiB per T_READ, but an extent is contiguous on disk.
+// The first read into an extent fetches up to RA_BLOCKS blocks of it with
+// one pread; the following sequential reads are served from the window.
+
+var ra_buf: [RA_BLOCKS * BLOCK_SIZE]u8 linksection(".bss") = undefined;
+var ra_start: u64 = 0; // first disk block in the window
+var ra_count: u64 = 0; // blocks in the window (0 = empty)
+/// A refill is reading into ra_buf with ra_lock dropped; other readers
+/// wait on ra_filled instead of starting their own.
+var ra_filling: bool = false;
+/// A write overlapped the in-flight refill, so its data may be stale.
+var ra_stale: bool = false;
+var ra_fill_start: u64 = 0;
+var ra_fill_count: u64 = 0;
+/// Protects the window and the refill state. Ordered before cache_lock.
+var ra_lock: Mutex = .{};
+var ra_filled: Condition = .{};
+
+/// Drop the window if it overlaps [block_nr, block_nr + count).
+fn raInvalidate(block_nr: u64, count: u64) void {
+    ra_lock.lock();
+    defer ra_lock.unlock();
+    if (ra_count > 0 and block_nr < ra_start + ra_count and ra_start < block_nr + count) {
+        ra_count = 0;
+    }
+    if (ra_filling and block_nr < ra_fill_start + ra_fill_count and ra_fill_start < block_nr + count) {
+        ra_stale = true;
+    }
+}
+
+/// Get disk block `block_nr` of an extent ending (exclusive) at `ext_end`.
+/// Served from the buffer cache, then the read-ahead window; on a miss the
+/// window is refilled from the rest of the extent. The refill's pread runs
+/// without ra_lock, so cache hits and writers aren't held up behind it.
+/// The block is returned through the cache (inserted unreferenced) so
+/// re-reads of file data hit.
+fn readExtentBlock(block_nr: u64, ext_end: u64) ?*const [BLOCK_SIZE]u8 {
+    if (cacheRead(block_nr)) |cached| return cached;
+
+    ra_lock.lock();
+    defer ra_lock.unlock();
+    while (ra_count == 0 or block_nr < ra_start or block_nr >= ra_start + ra_count) {
+        if (ra_filling) {
+            ra_filled.wait(&ra_lock);
+            continue;
+        }
+        const n = @min(RA_BLOCKS, ext_end - block_nr);
+        ra_count = 0;
+        ra_filling = true;
+        ra_stale = false;
+        ra_fill_start = block_nr;
+        ra_fill_count = n;
+
+        ra_lock.unlock();
+        const ok = readBlocks(block_nr, ra_buf[0..@intCast(n * BLOCK_SIZE)]);
+        ra_lock.lock();
+
+        ra_filling = false;
+        ra_filled.broadcast();
+        if (!ok) return null;
+        // Raced with a write: read it again rather than publish old data
+        if (ra_stale) continue;
+        ra_start = block_nr;
+        ra_count = n;
+    }
+    const off: usize = @intCast((block_nr - ra_start) * BLOCK_SIZE);
+    return cacheFill(block_nr, ra_buf[off..][0..BLOCK_SIZE], false);
+}
+
 // ── File data reading ──────────────────────────────────────────────
 
 /// Read file data at a given offset. Returns bytes read.
-var read_data_buf: [BLOCK_SIZE]u8 linksection(".bss") = undefined;
 
 fn readFileData(inode_nr: u64, file_offset: u64, dest: []u8) u32 {
     const inode = readInode(inode_nr) orelse return 0;
@@ -748,11 +1394,11 @@ fn readFileData(inode_nr: u64, file_offset: u64, dest: []u8) u32 {
                 const offset_in_block = file_offset % BLOCK_SIZE;
                 const target_block = disk_block + block_in_extent;
 
-                if (!readBlock(target_block, &read_data_buf)) return 0;
+                const block = readExtentBlock(target_block, disk_block + num_blocks) orelse return 0;
 
                 const block_avail: u32 = @intCast(BLOCK_SIZE - offset_in_block);
                 const to_copy = @min(want, block_avail);
-                @memcpy(dest[0..to_copy], read_data_buf[@intCast(offset_in_block)..][0..to_copy]);
+                @memcpy(dest[0..to_copy], block[@intCast(offset_in_block)..][0..to_copy]);
                 return to_copy;
             }
             // file_offset beyond first extent — fall through to multi-extent scan
@@ -792,11 +1438,11 @@ fn readFileData(inode_nr: u64, file_offset: u64, dest: []u8) u32 {
                 const offset_in_block = offset_in_extent % BLOCK_SIZE;
                 const target_block = disk_block + block_in_extent;
 
-                if (!readBlock(target_block, &read_data_buf)) return;
+                const block = readExtentBlock(target_block, disk_block + num_blocks) orelse return;
 
                 const block_avail: u32 = @intCast(BLOCK_SIZE - offset_in_block);
                 const to_copy = @min(c.want, block_avail);
-                @memcpy(c.dest[0..to_copy], read_data_buf[@intCast(offset_in_block)..][0..to_copy]);
+                @memcpy(c.dest[0..to_copy], block[@intCast(offset_in_block)..][0..to_copy]);
                 c.result = to_copy;
             }
         }
@@ -805,97 +1451,319 @@ fn readFileData(inode_nr: u64, file_offset: u64, dest: []u8) u32 {
     return ctx.result;
 }
 
-// ── Bitmap operations (multi-block) ───────────────────────────────
+// ── Bitmap allocator ──────────────────────────────────────────────
 //
-// One bitmap block covers BLOCK_SIZE*8 = 32768 blocks = 128 MB.
-// For larger filesystems, the bitmap spans multiple consecutive blocks
-// starting at sb_bitmap_start. We cache one bitmap block at a time.
+// One bitmap block covers BLOCK_SIZE*8 = 32768 blocks = 128 MB. The whole
+// bitmap (sb_bitmap_start .. sb_data_start) is loaded at mount and kept in
+// memory as 64-bit words; only the bitmap blocks that changed are written
+// back. Each bitmap block has a summary — free count and longest free run —
+// so allocExtent skips full or fragmented regions without touching their
+// bits and can hand out N contiguous blocks in one call.
 
 const BITS_PER_BITMAP_BLOCK: u64 = BLOCK_SIZE * 8;
+const WORDS_PER_BITMAP_BLOCK = BLOCK_SIZE / 8;
 
-var bitmap_buf: [BLOCK_SIZE]u8 linksection(".bss") = undefined;
-var bitmap_loaded: bool = false;
-var bitmap_cached_idx: u64 = 0; // which bitmap block is cached (0-based)
-var bitmap_dirty: bool = false;
-
-/// Ensure the bitmap block covering `block_nr` is loaded into bitmap_buf.
-fn ensureBitmapBlock(block_nr: u64) bool {
-    const idx = block_nr / BITS_PER_BITMAP_BLOCK;
-    if (bitmap_loaded and bitmap_cached_idx == idx) return true;
-    // Flush current block if dirty
-    if (bitmap_loaded and bitmap_dirty) {
-        if (!writeBlock(sb_bitmap_start + bitmap_cached_idx, &bitmap_buf)) return false;
-        bitmap_dirty = false;
-    }
-    // Load the needed bitmap block
-    if (!readBlock(sb_bitmap_start + idx, &bitmap_buf)) return false;
-    bitmap_cached_idx = idx;
-    bitmap_loaded = true;
-    return true;
-}
+const BitmapSummary = struct {
+    free: u32,
+    longest: u32, // longest free run; an upper bound unless `exact`
+    exact: bool,
+    dirty: bool, // changed since the last flush
+};
 
-fn isBitSet(block: u64) bool {
-    if (!ensureBitmapBlock(block)) return true; // assume allocated on failure
-    const local_bit = block % BITS_PER_BITMAP_BLOCK;
-    const byte_idx = local_bit / 8;
-    const bit_idx: u3 = @intCast(local_bit % 8);
-    return (bitmap_buf[byte_idx] & (@as(u8, 1) << bit_idx)) != 0;
+var bitmap_words: []u64 = &.{};
+var bitmap_summary: []BitmapSummary = &.{};
+var bitmap_dirty: bool = false; // any bitmap block dirty
+
+/// Read the whole bitmap into memory and build the summaries.
+fn bitmapLoad() bool {
+    if (sb_data_start <= sb_bitmap_start) return false;
+    const nblocks: usize = @intCast(sb_data_start - sb_bitmap_start);
+    if (nblocks * BITS_PER_BITMAP_BLOCK < sb_total_blocks) return false;
+
+    const MAP_ANONYMOUS: u64 = 0x20;
+    const MAP_PRIVATE: u64 = 0x02;
+    const PROT_RW: u64 = 0x3;
+    const bytes = nblocks * BLOCK_SIZE + nblocks * @sizeOf(BitmapSummary);
+    const base = fx.mmap(0, bytes, PROT_RW, MAP_ANONYMOUS | MAP_PRIVATE);
+    if (base == 0 or base > 0xFFFF_FFFF_FFFF_0000) return false;
+
+    const raw: [*]u8 = @ptrFromInt(base);
+    if (!readBlocks(sb_bitmap_start, raw[0 .. nblocks * BLOCK_SIZE])) return false;
+    const words_ptr: [*]u64 = @ptrFromInt(base);
+    const summary_ptr: [*]BitmapSummary = @ptrFromInt(base + nblocks * BLOCK_SIZE);
+    bitmap_words = words_ptr[0 .. nblocks * WORDS_PER_BITMAP_BLOCK];
+    bitmap_summary = summary_ptr[0..nblocks];
+
+    // Bits past the end of the disk count as allocated
+    var b = sb_total_blocks;
+    while (b < nblocks * BITS_PER_BITMAP_BLOCK) : (b += 1) {
+        bitmap_words[@intCast(b / 64)] |= @as(u64, 1) << @as(u6, @intCast(b % 64));
+    }
+
+    for (bitmap_summary, 0..) |*sum, g| {
+        sum.dirty = false;
+        summaryRecompute(g);
+    }
+    bitmap_dirty = false;
+    return true;
 }
 
-fn setBit(block: u64) void {
-    if (!ensureBitmapBlock(block)) return;
-    const local_bit = block % BITS_PER_BITMAP_BLOCK;
-    const byte_idx = local_bit / 8;
-    const bit_idx: u3 = @intCast(local_bit % 8);
-    bitmap_buf[byte_idx] |= @as(u8, 1) << bit_idx;
-    bitmap_dirty = true;
+fn summaryRecompute(g: usize) void {
+    const words = bitmap_words[g * WORDS_PER_BITMAP_BLOCK ..][0..WORDS_PER_BITMAP_BLOCK];
+    var free: u32 = 0;
+    var run: u32 = 0;
+    var longest: u32 = 0;
+    for (words) |w| {
+        if (w == 0) {
+            free += 64;
+            run += 64;
+            continue;
+        }
+        if (w == ~@as(u64, 0)) {
+            longest = @max(longest, run);
+            run = 0;
+            continue;
+        }
+        var i: usize = 0;
+        while (i < 64) : (i += 1) {
+            if ((w >> @as(u6, @intCast(i))) & 1 == 0) {
+                free += 1;
+                run += 1;
+            } else {
+                longest = @max(longest, run);
+                run = 0;
+            }
+        }
+    }
+    const sum = &bitmap_summary[g];
+    sum.free = free;
+    sum.longest = @max(longest, run);
+    sum.exact = true;
 }
 
-fn clearBit(block: u64) void {
-    if (!ensureBitmapBlock(block)) return;
-    const local_bit = block % BITS_PER_BITMAP_BLOCK;
-    const byte_idx = local_bit / 8;
-    const bit_idx: u3 = @intCast(local_bit % 8);
-    bitmap_buf[byte_idx] &= ~(@as(u8, 1) << bit_idx);
-    bitmap_dirty = true;
+fn isBitSet(block: u64) bool {
+    return (bitmap_words[@intCast(block / 64)] >> @as(u6, @intCast(block % 64))) & 1 != 0;
+}
+
+/// Mark [start, start + count) allocated (`used`) or free, keeping the
+/// summaries conservative: a freed bit may lengthen a run, so `longest`
+/// falls back to the free count until the next full scan of the block.
+fn bitmapMark(start: u64, count: u64, used: bool) void {
+    var b = start;
+    while (b < start + count) : (b += 1) {
+        const word = &bitmap_words[@intCast(b / 64)];
+        const mask = @as(u64, 1) << @as(u6, @intCast(b % 64));
+        const sum = &bitmap_summary[@intCast(b / BITS_PER_BITMAP_BLOCK)];
+        if (used) {
+            if (word.* & mask != 0) continue;
+            word.* |= mask;
+            sum.free -= 1;
+            sum.longest = @min(sum.longest, sum.free);
+        } else {
+            if (word.* & mask == 0) continue;
+            word.* &= ~mask;
+            sum.free += 1;
+            sum.longest = sum.free;
+        }
+        sum.exact = false;
+        sum.dirty = true;
+        bitmap_dirty = true;
+    }
 }
 
+/// Write every bitmap block changed since the last flush, neighbouring
+/// dirty blocks in one pwrite.
 fn flushBitmap() bool {
-    if (!bitmap_loaded or !bitmap_dirty) return true;
-    if (!writeBlock(sb_bitmap_start + bitmap_cached_idx, &bitmap_buf)) return false;
+    if (!bitmap_dirty) return true;
+    const raw: [*]const u8 = @ptrCast(bitmap_words.ptr);
+    var g: usize = 0;
+    while (g < bitmap_summary.len) {
+        if (!bitmap_summary[g].dirty) {
+            g += 1;
+            continue;
+        }
+        var end = g;
+        while (end < bitmap_summary.len and bitmap_summary[end].dirty) end += 1;
+        if (!writeBlocks(sb_bitmap_start + g, raw[g * BLOCK_SIZE .. end * BLOCK_SIZE])) return false;
+        for (bitmap_summary[g..end]) |*sum| sum.dirty = false;
+        g = end;
+    }
     bitmap_dirty = false;
     return true;
 }
 
-fn allocBlock() ?u64 {
-    // Start search from hint for O(1) sequential allocation
-    const start = if (alloc_hint >= sb_data_start and alloc_hint < sb_total_blocks) alloc_hint else sb_data_start;
-    var block: u64 = start;
-    while (block < sb_total_blocks) : (block += 1) {
-        if (!isBitSet(block)) {
-            setBit(block);
-            sb_free_blocks -%= 1;
-            alloc_hint = block + 1;
-            return block;
-        }
-    }
-    // Wrap around from data_start to hint
-    block = sb_data_start;
-    while (block < start) : (block += 1) {
-        if (!isBitSet(block)) {
-            setBit(block);
-            sb_free_blocks -%= 1;
-            alloc_hint = block + 1;
-            return block;
+/// Find the first run of at least `want` free blocks in [lo, hi). If there
+/// is none, return the longest shorter run. Sets `len` (capped at `want`).
+fn findFreeRun(lo: u64, hi: u64, want: u64, len: *u64) ?u64 {
+    var best_start: u64 = 0;
+    var best_len: u64 = 0;
+    var run_start: u64 = 0;
+    var run_len: u64 = 0;
+    var b = lo;
+    while (b < hi) {
+        // Whole words at a time where possible
+        if (b % 64 == 0 and b + 64 <= hi) {
+            const w = bitmap_words[@intCast(b / 64)];
+            if (w == 0 or w == ~@as(u64, 0)) {
+                if (w == 0) {
+                    if (run_len == 0) run_start = b;
+                    run_len += 64;
+                } else {
+                    if (run_len > best_len) {
+                        best_start = run_start;
+                        best_len = run_len;
+                    }
+                    run_len = 0;
+                }
+                b += 64;
+                if (run_len >= want) break;
+                continue;
+            }
+        }
+        if (!isBitSet(b)) {
+            if (run_len == 0) run_start = b;
+            run_len += 1;
+            if (run_len >= want) break;
+        } else {
+            if (run_len > best_len) {
+                best_start = run_start;
+                best_len = run_len;
+            }
+            run_len = 0;
         }
+        b += 1;
     }
-    return null;
+    if (run_len > best_len) {
+        best_start = run_start;
+        best_len = run_len;
+    }
+    if (best_len == 0) return null;
+    len.* = @min(best_len, want);
+    return best_start;
+}
+
+/// Allocate up to `want` contiguous blocks, searching from alloc_hint.
+/// A run of the full length anywhere on disk is preferred; only if none
+/// exists is the longest shorter run taken. Returns the first block and
+/// sets `got` (1..want).
+fn allocExtent(want: u64, got: *u64) ?u64 {
+    const ngroups = bitmap_summary.len;
+    if (ngroups == 0 or want == 0) return null;
+    const hint = if (alloc_hint >= sb_data_start and alloc_hint < sb_total_blocks) alloc_hint else sb_data_start;
+    const first_group: usize = @intCast(hint / BITS_PER_BITMAP_BLOCK);
+
+    var best_start: u64 = 0;
+    var best_len: u64 = 0;
+    // The hint's block is visited twice: from the hint on, and at the end
+    // of the wrap-around for the part before the hint
+    var i: usize = 0;
+    while (i <= ngroups) : (i += 1) {
+        const g = (first_group + i) % ngroups;
+        const sum = &bitmap_summary[g];
+        if (sum.free == 0) continue;
+        if (sum.longest < want and sum.longest <= best_len) continue;
+
+        const group_lo = @as(u64, g) * BITS_PER_BITMAP_BLOCK;
+        const group_hi = @min(group_lo + BITS_PER_BITMAP_BLOCK, sb_total_blocks);
+        var lo = @max(group_lo, sb_data_start);
+        var hi = group_hi;
+        if (i == 0) lo = @max(lo, hint);
+        if (i == ngroups) hi = @min(hi, hint);
+        if (lo >= hi) continue;
+
+        var len: u64 = 0;
+        const found = findFreeRun(lo, hi, want, &len);
+        if (found) |start| {
+            if (len >= want) return allocTake(start, want, got);
+            if (len > best_len) {
+                best_start = start;
+                best_len = len;
+            }
+        }
+        // Scanned the whole block without a full-length run: its longest
+        // run is now known exactly
+        if (lo == @max(group_lo, sb_data_start) and hi == group_hi) {
+            sum.longest = if (found != null) @intCast(len) else 0;
+            sum.exact = true;
+        }
+    }
+    if (best_len == 0) return null;
+    return allocTake(best_start, best_len, got);
+}
+
+fn allocTake(start: u64, count: u64, got: *u64) u64 {
+    bitmapMark(start, count, true);
+    sb_free_blocks -%= count;
+    alloc_hint = start + count;
+    _ = rangeAdd(&group_allocs, &group_alloc_count, start, count);
+    got.* = count;
+    return start;
+}
+
+fn allocBlock() ?u64 {
+    var got: u64 = 0;
+    return allocExtent(1, &got);
 }
 
 fn freeBlock(block: u64) void {
-    clearBit(block);
-    sb_free_blocks +%= 1;
     cacheInvalidate(block);
+    raInvalidate(block, 1);
+    if (rangeContains(group_allocs[0..group_alloc_count], block)) {
+        // Allocated since the last commit — the on-disk tree cannot use it
+        bitmapMark(block, 1, false);
+        sb_free_blocks +%= 1;
+        return;
+    }
+    // The committed tree may still reference it: keep it allocated until
+    // the superblock that drops it is on disk. If the queue is full the
+    // block is leaked rather than risk overwriting live on-disk data.
+    if (!rangeAdd(&pending_frees, &pending_free_count, block, 1)) {
+        if (leaked_blocks == 0) _ = fx.write(1, "fxfs: pending free queue full, leaking blocks\n");
+        leaked_blocks += 1;
+    }
+}
+
+/// Commit mid-request if pending_frees is nearly full. Only call between
+/// complete tree operations, once no item references the queued blocks;
+/// the partial request is counted so the superblock is written.
+fn commitIfFreesFull() void {
+    if (pending_free_count + PENDING_FREE_HEADROOM < PENDING_FREE_RANGES) return;
+    group_txns += 1;
+    _ = flushMetadata();
+}
+
+// ── Group commit state ─────────────────────────────────────────────
+
+const BlockRange = struct { start: u64, count: u64 };
+
+var group_allocs: [GROUP_ALLOC_RANGES]BlockRange linksection(".bss") = undefined;
+var group_alloc_count: usize = 0;
+var pending_frees: [PENDING_FREE_RANGES]BlockRange linksection(".bss") = undefined;
+var pending_free_count: usize = 0;
+var leaked_blocks: u64 = 0; // freed blocks dropped because the queue was full
+var group_txns: u64 = 0; // transactions since the last commit
+
+/// Record [start, start + n) in a range list, extending the last range
+/// when contiguous. Returns false if the list is full.
+fn rangeAdd(list: []BlockRange, count: *usize, start: u64, n: u64) bool {
+    if (count.* > 0) {
+        const last = &list[count.* - 1];
+        if (last.start + last.count == start) {
+            last.count += n;
+            return true;
+        }
+    }
+    if (count.* >= list.len) return false;
+    list[count.*] = .{ .start = start, .count = n };
+    count.* += 1;
+    return true;
+}
+
+fn rangeContains(list: []const BlockRange, block: u64) bool {
+    for (list) |r| {
+        if (block >= r.start and block < r.start + r.count) return true;
+    }
+    return false;
 }
 
 // ── B-tree node writing (for CoW) ──────────────────────────────────
@@ -908,13 +1776,19 @@ fn writeNodeHeader(buf: *[BLOCK_SIZE]u8, level: u8, num_items: u16, generation:
     writeU32LE(buf[12..16], 0); // checksum placeholder
 }
 
-/// Write a B-tree node block with CRC32 checksum at bytes 12-15.
-fn writeTreeNode(block_nr: u64, buf: *[BLOCK_SIZE]u8) bool {
+/// Store the CRC32 checksum of a B-tree node at bytes 12-15.
+fn sealTreeNode(buf: *[BLOCK_SIZE]u8) void {
     // Compute CRC32 with checksum field zeroed
     writeU32LE(buf[12..16], 0);
     const cksum = crc32(buf);
     writeU32LE(buf[12..16], cksum);
-    return writeBlock(block_nr, buf);
+}
+
+/// Write a B-tree node block. The node goes into the cache dirty and
+/// reaches disk at the next group commit.
+fn writeTreeNode(block_nr: u64, buf: *[BLOCK_SIZE]u8) bool {
+    sealTreeNode(buf);
+    return cacheInsertDirty(block_nr, buf);
 }
 
 fn writeLeafItem(buf: *[BLOCK_SIZE]u8, idx: u16, key: Key, data_offset: u16, data_size: u16) void {
@@ -962,9 +1836,6 @@ fn cowNode(old_block: u64) ?u64 {
         return null;
     }
 
-    // Insert into cache
-    _ = cacheInsert(new_block, &new_data);
-
     return new_block;
 }
 
@@ -1589,23 +2460,82 @@ fn btreeUpdate(key: Key, data: []const u8) bool {
     return btreeInsert(key, data);
 }
 
+/// End a mutating request. The transaction joins the current group; the
+/// group is committed now only if it has grown past one of its limits,
+/// otherwise by the flusher thread within GROUP_COMMIT_MS.
 fn commitTransaction() bool {
-    sb_generation += 1;
+    group_txns += 1;
+    if (group_txns >= GROUP_MAX_TXNS or
+        cacheDirtyCount() >= cache_entries.len / 4 or
+        pending_free_count >= PENDING_FREE_COMMIT or
+        group_alloc_count >= GROUP_ALLOC_RANGES)
+    {
+        return flushMetadata();
+    }
+    return true;
+}
+
+/// Commit the current group from a mutating request, which holds
+/// write_lock and tree_lock exclusive. The in-memory tree is already
+/// consistent, so tree_lock is dropped for the I/O and readers proceed
+/// while metadata goes to disk. write_lock keeps other writers (and thus
+/// any change to the bitmap or sb_* fields) out until it is done.
+fn flushMetadata() bool {
+    tree_lock.unlock();
+    defer tree_lock.lock();
+    return groupCommit();
+}
+
+/// Make every transaction since the last commit durable. Caller holds
+/// write_lock. Order: data blocks were written by their requests, then
+/// dirty nodes, bitmap, and finally the superblock naming the new root —
+/// until that lands, the previous superblock and the tree it points to
+/// are intact, since none of their blocks have been reused.
+fn groupCommit() bool {
+    if (group_txns == 0 and !bitmap_dirty) return true;
+    if (!cacheFlushDirty()) return false;
     if (!flushBitmap()) return false;
-    if (!writeSuperblock()) return false;
+    if (group_txns > 0) {
+        sb_generation += 1;
+        if (!writeSuperblock()) {
+            sb_generation -= 1;
+            return false;
+        }
+    }
+
+    // The old root is gone: blocks only it referenced may now be reused
+    for (pending_frees[0..pending_free_count]) |r| {
+        bitmapMark(r.start, r.count, false);
+        sb_free_blocks +%= r.count;
+    }
+    pending_free_count = 0;
+    group_alloc_count = 0;
+    group_txns = 0;
     return true;
 }
 
+/// Flusher thread: commits a partial group every GROUP_COMMIT_MS.
+fn flusherEntry(_: *anyopaque) callconv(.c) void {
+    while (true) {
+        fx.sleep(GROUP_COMMIT_MS);
+        write_lock.lock();
+        if (group_txns > 0) _ = groupCommit();
+        write_lock.unlock();
+    }
+}
+
 
 // ── IPC handlers ───────────────────────────────────────────────────
 
 var msg: fx.IpcMessage linksection(".bss") = undefined;
 var reply: fx.IpcMessage linksection(".bss") = undefined;
 
-/// Protects all B-tree, bitmap, superblock, cache, and IO buffer state.
-var fs_lock: Mutex = .{};
-/// Protects the handles[] array.
-var handle_lock: Mutex = .{};
+/// Readers (T_OPEN/T_READ/T_STAT) hold this shared; a mutating request
+/// holds it exclusive while it changes the tree and in-memory superblock.
+var tree_lock: RwLock = .{};
+/// Serializes mutating requests end to end: bitmap, allocator, superblock
+/// write. Held across commitTransaction's I/O after tree_lock is dropped.
+var write_lock: Mutex = .{};
 
 fn ctlAppendStr(buf: []u8, pos: usize, s: []const u8) usize {
     if (pos + s.len > buf.len) return pos;
@@ -1638,37 +2568,39 @@ fn ctlAppendDec(buf: []u8, pos: usize, val: u64) usize {
 
 /// Free all extent data blocks and delete all EXTENT_DATA B-tree items for an inode.
 fn freeAllExtents(inode_nr: u64) void {
-    // First pass: free data blocks and collect keys to delete
+    // Collect a batch of extents, delete their items, then free the data
+    // blocks: once no item references them the group may be committed.
+    const Ext = struct { key: Key, block: u64, count: u32 };
     const Ctx = struct {
-        keys: [32]Key,
+        exts: [32]Ext,
         count: usize,
     };
-    var ctx = Ctx{ .keys = undefined, .count = 0 };
-
-    _ = btreeScan(inode_nr, EXTENT_DATA, &ctx, struct {
-        fn cb(c: *Ctx, k: Key, data: []const u8) void {
-            // Free data blocks if this is an extent reference (not inline)
-            if (data.len == EXTENT_DATA_SIZE) {
-                const disk_block = readU64LE(data[0..8]);
-                const num_blocks = readU32LE(data[8..12]);
-                if (disk_block != 0) {
-                    var b: u64 = 0;
-                    while (b < num_blocks) : (b += 1) {
-                        freeBlock(disk_block + b);
-                    }
-                }
-            }
-            if (c.count < 32) {
-                c.keys[c.count] = k;
+    while (true) {
+        var ctx = Ctx{ .exts = undefined, .count = 0 };
+        _ = btreeScan(inode_nr, EXTENT_DATA, &ctx, struct {
+            fn cb(c: *Ctx, k: Key, data: []const u8) void {
+                if (c.count >= 32) return;
+                // Inline extents hold no blocks
+                const ref = data.len == EXTENT_DATA_SIZE;
+                c.exts[c.count] = .{
+                    .key = k,
+                    .block = if (ref) readU64LE(data[0..8]) else 0,
+                    .count = if (ref) readU32LE(data[8..12]) else 0,
+                };
                 c.count += 1;
             }
+        }.cb);
+        if (ctx.count == 0) return;
+
+        for (ctx.exts[0..ctx.count]) |e| {
+            if (!btreeDelete(e.key)) return;
+            if (e.block == 0) continue;
+            var b: u64 = 0;
+            while (b < e.count) : (b += 1) {
+                freeBlock(e.block + b);
+            }
         }
-    }.cb);
-
-    // Second pass: delete B-tree items
-    var i: usize = 0;
-    while (i < ctx.count) : (i += 1) {
-        _ = btreeDelete(ctx.keys[i]);
+        commitIfFreesFull();
     }
 }
 
@@ -1723,10 +2655,15 @@ fn handleRead(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
         return;
     };
 
+    if (count > 4096) {
+        handleReadBulk(&h, req, resp);
+        return;
+    }
+
     // Virtual ctl file: return filesystem stats
     if (h.inode_nr == 0xFFFF_FFFF_FFFF_FFFF) {
         resp.* = fx.IpcMessage.init(fx.R_OK);
-        var ctl_buf: [256]u8 = undefined;
+        var ctl_buf: [768]u8 = undefined;
         var pos: usize = 0;
         pos = ctlAppendStr(&ctl_buf, pos, "TOTAL=");
         pos = ctlAppendDec(&ctl_buf, pos, sb_total_blocks);
@@ -1738,6 +2675,28 @@ fn handleRead(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
         pos = ctlAppendDec(&ctl_buf, pos, sb_generation);
         pos = ctlAppendStr(&ctl_buf, pos, "\nDIRTY=");
         pos = ctlAppendDec(&ctl_buf, pos, if (bitmap_dirty) @as(u64, 1) else 0);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nGROUP_TXNS=");
+        pos = ctlAppendDec(&ctl_buf, pos, group_txns);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nDIRTY_NODES=");
+        pos = ctlAppendDec(&ctl_buf, pos, cacheDirtyCount());
+        pos = ctlAppendStr(&ctl_buf, pos, "\nCACHE=");
+        pos = ctlAppendDec(&ctl_buf, pos, cache_entries.len);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nCACHE_HITS=");
+        pos = ctlAppendDec(&ctl_buf, pos, cache_hits);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nCACHE_MISSES=");
+        pos = ctlAppendDec(&ctl_buf, pos, cache_misses);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nCACHE_EVICTIONS=");
+        pos = ctlAppendDec(&ctl_buf, pos, cache_evictions);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nCACHE_SPILLS=");
+        pos = ctlAppendDec(&ctl_buf, pos, cache_spills);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nLEAKED_BLOCKS=");
+        pos = ctlAppendDec(&ctl_buf, pos, leaked_blocks);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nDCACHE_HITS=");
+        pos = ctlAppendDec(&ctl_buf, pos, dcache_hits);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nDCACHE_NEG_HITS=");
+        pos = ctlAppendDec(&ctl_buf, pos, dcache_neg_hits);
+        pos = ctlAppendStr(&ctl_buf, pos, "\nDCACHE_MISSES=");
+        pos = ctlAppendDec(&ctl_buf, pos, dcache_misses);
         pos = ctlAppendStr(&ctl_buf, pos, "\n");
         if (offset >= pos) {
             resp.data_len = 0;
@@ -1767,6 +2726,44 @@ fn handleRead(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
     resp.data_len = n;
 }
 
+/// Bulk T_READ: regular file data is copied into the client's grant chunk
+/// by chunk. Directories and the ctl file produce one message's worth as
+/// usual, which is forwarded through the grant the same way.
+fn handleReadBulk(h: *const Handle, req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
+    const offset = readU32LE(req.data[4..8]);
+    const count = readU32LE(req.data[8..12]);
+
+    const regular = h.inode_nr != 0xFFFF_FFFF_FFFF_FFFF and
+        (if (readInode(h.inode_nr)) |inode| !isDirectory(inode) else false);
+
+    var done: u32 = 0;
+    if (regular) {
+        var chunk: [BULK_READ_CHUNK]u8 = undefined;
+        while (done < count) {
+            const want = @min(count - done, BULK_READ_CHUNK);
+            // readFileData stops at block boundaries; fillBulk keeps going.
+            const n = fx.ipc.fillBulk(h.inode_nr, readFileData, chunk[0..want], @as(u64, offset) + done);
+            if (n == 0) break;
+            const copied = fx.ipc_grant_write(SERVER_FD, done, chunk[0..n]);
+            if (copied <= 0) break;
+            done += @intCast(copied);
+            if (n < want) break; // end of file
+        }
+    } else {
+        writeU32LE(req.data[8..12], 4096);
+        handleRead(req, resp);
+        if (resp.tag != fx.R_OK) return;
+        if (resp.data_len > 0) {
+            const copied = fx.ipc_grant_write(SERVER_FD, 0, resp.data[0..resp.data_len]);
+            if (copied > 0) done = @intCast(copied);
+        }
+    }
+
+    resp.* = fx.IpcMessage.init(fx.R_OK);
+    writeU32LE(resp.data[0..4], done);
+    resp.data_len = 4;
+}
+
 fn readDirectory(inode_nr: u64, offset: u32, count: u32, resp: *fx.IpcMessage) void {
     resp.* = fx.IpcMessage.init(fx.R_OK);
 
@@ -1971,6 +2968,7 @@ fn handleCreate(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
     @memcpy(dir_data[10..][0..file_name.len], file_name);
     const dir_len: usize = 10 + file_name.len;
 
+    dcacheInvalidate(parent_inode, file_name);
     if (!btreeInsert(.{ .inode_nr = parent_inode, .item_type = DIR_ENTRY, .offset = name_hash }, dir_data[0..dir_len])) {
         _ = fx.write(1, "fxfs: DIR_ENTRY insert failed\n");
         resp.* = fx.IpcMessage.init(fx.R_ERROR);
@@ -2003,8 +3001,11 @@ fn appendBlocks(inode_nr: u64, file_offset: u64, data: []const u8) bool {
     var num_runs: usize = 0;
     var total_allocated: usize = 0;
 
+    // One allocExtent per run: normally a single extent for the whole write
     while (total_allocated < num_blocks) {
-        const block = allocBlock() orelse {
+        var got: u64 = 0;
+        const start = if (num_runs < MAX_RUNS) allocExtent(num_blocks - total_allocated, &got) else null;
+        if (start == null) {
             for (runs[0..num_runs]) |run| {
                 var f: u32 = 0;
                 while (f < run.count) : (f += 1) {
@@ -2012,43 +3013,29 @@ fn appendBlocks(inode_nr: u64, file_offset: u64, data: []const u8) bool {
                 }
             }
             return false;
-        };
-
-        if (num_runs == 0 or block != runs[num_runs - 1].start + runs[num_runs - 1].count) {
-            if (num_runs >= MAX_RUNS) {
-                freeBlock(block);
-                for (runs[0..num_runs]) |run| {
-                    var f: u32 = 0;
-                    while (f < run.count) : (f += 1) {
-                        freeBlock(run.start + f);
-                    }
-                }
-                return false;
-            }
-            runs[num_runs] = .{ .start = block, .count = 1 };
-            num_runs += 1;
-        } else {
-            runs[num_runs - 1].count += 1;
         }
-        total_allocated += 1;
+        runs[num_runs] = .{ .start = start.?, .count = @intCast(got) };
+        num_runs += 1;
+        total_allocated += @intCast(got);
     }
 
-    // Write data to blocks
+    // Write data to blocks: whole blocks of each run go out in one pwrite,
+    // a trailing partial block is zero-padded
     var block_buf: [BLOCK_SIZE]u8 = [_]u8{0} ** BLOCK_SIZE;
     var data_pos: usize = 0;
-    var block_idx: usize = 0;
     for (runs[0..num_runs]) |run| {
-        var r: u32 = 0;
-        while (r < run.count) : (r += 1) {
+        const run_bytes = @min(@as(usize, run.count) * BLOCK_SIZE, data.len - data_pos);
+        const full_blocks = run_bytes / BLOCK_SIZE;
+        if (full_blocks > 0) {
+            if (!writeBlocks(run.start, data[data_pos..][0 .. full_blocks * BLOCK_SIZE])) return false;
+            data_pos += full_blocks * BLOCK_SIZE;
+        }
+        if (full_blocks < run.count) {
             @memset(&block_buf, 0);
-            if (data_pos < data.len) {
-                const remaining = data.len - data_pos;
-                const to_copy = @min(remaining, BLOCK_SIZE);
-                @memcpy(block_buf[0..to_copy], data[data_pos..][0..to_copy]);
-                data_pos += to_copy;
-            }
-            if (!writeBlock(run.start + r, &block_buf)) return false;
-            block_idx += 1;
+            const tail = data.len - data_pos;
+            @memcpy(block_buf[0..tail], data[data_pos..][0..tail]);
+            data_pos += tail;
+            if (!writeBlock(run.start + @as(u64, full_blocks), &block_buf)) return false;
         }
     }
 
@@ -2095,7 +3082,7 @@ fn handleWrite(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
     const handle_id = readU32LE(req.data[0..4]);
     const write_data = req.data[4..req.data_len];
 
-    const h = getHandle(handle_id) orelse {
+    var h = getHandle(handle_id) orelse {
         resp.* = fx.IpcMessage.init(fx.R_ERROR);
         return;
     };
@@ -2110,7 +3097,7 @@ fn handleWrite(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
             write_data;
         if (cmd.len == 4 and cmd[0] == 's' and cmd[1] == 'y' and cmd[2] == 'n' and cmd[3] == 'c') {
             // sync: flush bitmap + write superblock
-            if (!flushBitmap() or !writeSuperblock()) {
+            if (!flushMetadata()) {
                 resp.* = fx.IpcMessage.init(fx.R_ERROR);
             }
         } else if (cmd.len == 5 and cmd[0] == 'c' and cmd[1] == 'h' and cmd[2] == 'e' and cmd[3] == 'c' and cmd[4] == 'k') {
@@ -2122,6 +3109,51 @@ fn handleWrite(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
         return;
     }
 
+    writeAt(handle_id, &h, write_data, resp);
+}
+
+/// Bulk write: pull the client's grant in BULK_WRITE_CHUNK pieces and write
+/// each at the handle's write offset. Caller holds write_lock (which also
+/// guards bulk_write_buf). A short grant read ends the write early.
+fn handleWriteBulk(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
+    if (req.data_len < 8) {
+        resp.* = fx.IpcMessage.init(fx.R_ERROR);
+        return;
+    }
+
+    const handle_id = readU32LE(req.data[0..4]);
+    var h = getHandle(handle_id) orelse {
+        resp.* = fx.IpcMessage.init(fx.R_ERROR);
+        return;
+    };
+    if (h.inode_nr == 0xFFFF_FFFF_FFFF_FFFF) {
+        resp.* = fx.IpcMessage.init(fx.R_ERROR);
+        return;
+    }
+    const len = readU32LE(req.data[4..8]);
+
+    var done: u32 = 0;
+    while (done < len) {
+        const want = @min(len - done, BULK_WRITE_CHUNK);
+        const got = fx.ipc_grant_read(SERVER_FD, done, bulk_write_buf[0..want]);
+        if (got <= 0) break;
+        writeAt(handle_id, &h, bulk_write_buf[0..@intCast(got)], resp);
+        if (resp.tag != fx.R_OK) {
+            if (done == 0) return;
+            break;
+        }
+        done += @intCast(got);
+    }
+
+    resp.* = fx.IpcMessage.init(fx.R_OK);
+    writeU32LE(resp.data[0..4], done);
+    resp.data_len = 4;
+}
+
+/// Write `write_data` to a regular file at h.write_offset and advance it,
+/// in `h` (the caller's copy of handle `handle_id`) and in the table.
+/// Sets resp to R_OK(bytes_written) or R_ERROR.
+fn writeAt(handle_id: u32, h: *Handle, write_data: []const u8, resp: *fx.IpcMessage) void {
     const inode = readInode(h.inode_nr) orelse {
         resp.* = fx.IpcMessage.init(fx.R_ERROR);
         return;
@@ -2306,7 +3338,9 @@ fn handleWrite(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
         var total_allocated: usize = 0;
 
         while (total_allocated < num_blocks) {
-            const block = allocBlock() orelse {
+            var got: u64 = 0;
+            const start = if (num_runs < MAX_RUNS) allocExtent(num_blocks - total_allocated, &got) else null;
+            if (start == null) {
                 for (runs[0..num_runs]) |run| {
                     var f: u32 = 0;
                     while (f < run.count) : (f += 1) {
@@ -2315,26 +3349,10 @@ fn handleWrite(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
                 }
                 resp.* = fx.IpcMessage.init(fx.R_ERROR);
                 return;
-            };
-
-            if (num_runs == 0 or block != runs[num_runs - 1].start + runs[num_runs - 1].count) {
-                if (num_runs >= MAX_RUNS) {
-                    freeBlock(block);
-                    for (runs[0..num_runs]) |run| {
-                        var f: u32 = 0;
-                        while (f < run.count) : (f += 1) {
-                            freeBlock(run.start + f);
-                        }
-                    }
-                    resp.* = fx.IpcMessage.init(fx.R_ERROR);
-                    return;
-                }
-                runs[num_runs] = .{ .start = block, .count = 1 };
-                num_runs += 1;
-            } else {
-                runs[num_runs - 1].count += 1;
             }
-            total_allocated += 1;
+            runs[num_runs] = .{ .start = start.?, .count = @intCast(got) };
+            num_runs += 1;
+            total_allocated += @intCast(got);
         }
 
         // Write blocks with old + new data merged
@@ -2415,6 +3433,7 @@ fn handleWrite(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
 
     // Advance write offset
     h.write_offset = new_end;
+    setWriteOffset(handle_id, h.inode_nr, new_end);
 
     resp.* = fx.IpcMessage.init(fx.R_OK);
     const written: u32 = @intCast(write_data.len);
@@ -2472,6 +3491,7 @@ fn handleRemove(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
     }
 
     // Delete DIR_ENTRY from parent
+    dcacheInvalidate(parent_inode, file_name);
     const name_hash = fnvHash(file_name);
     _ = btreeDelete(.{ .inode_nr = parent_inode, .item_type = DIR_ENTRY, .offset = name_hash });
 
@@ -2482,11 +3502,13 @@ fn handleRemove(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
     _ = btreeDelete(.{ .inode_nr = inode_nr, .item_type = INODE_ITEM, .offset = 0 });
 
     // Invalidate handles
+    handle_lock.lock();
     for (1..MAX_HANDLES) |i| {
         if (handles[i].active and handles[i].inode_nr == inode_nr) {
             handles[i].active = false;
         }
     }
+    handle_lock.unlock();
 
     if (!commitTransaction()) {
         resp.* = fx.IpcMessage.init(fx.R_ERROR);
@@ -2589,6 +3611,10 @@ fn handleRename(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
         }
     }
 
+    // Both names change meaning; nothing below resolves paths again
+    dcacheInvalidate(old_parent, old_name);
+    dcacheInvalidate(new_parent, new_name);
+
     // Delete old DIR_ENTRY
     const old_hash = fnvHash(old_name);
     _ = btreeDelete(.{ .inode_nr = old_parent, .item_type = DIR_ENTRY, .offset = old_hash });
@@ -2679,9 +3705,7 @@ fn handleTruncate(req: *fx.IpcMessage, resp: *fx.IpcMessage) void {
     }
 
     // Reset write offset if needed
-    if (h.write_offset > new_size) {
-        h.write_offset = new_size;
-    }
+    clampWriteOffset(handle_id, h.inode_nr, new_size);
 
     if (!commitTransaction()) {
         resp.* = fx.IpcMessage.init(fx.R_ERROR);
@@ -2829,7 +3853,8 @@ fn formatDisk() bool {
     writeU16LE(leaf_buf[data_offset + 6..][0..2], 2); // nlinks
     // size, atime, mtime, ctime all zero (already zeroed)
 
-    if (!writeTreeNode(root_block, &leaf_buf)) return false;
+    sealTreeNode(&leaf_buf);
+    if (!writeBlock(root_block, &leaf_buf)) return false;
 
     // Write superblock
     var sb_buf_fmt: [BLOCK_SIZE]u8 = [_]u8{0} ** BLOCK_SIZE;
@@ -2866,27 +3891,42 @@ fn workerLoop() noreturn {
         const rc = fx.ipc_recv(SERVER_FD, &wmsg);
         if (rc < 0) continue;
 
-        // Coarse lock: protects all shared state (B-tree, bitmap, cache, handles, IO buffers)
-        fs_lock.lock();
-
         switch (wmsg.tag) {
-            fx.T_OPEN => handleOpen(&wmsg, &wreply),
-            fx.T_CREATE => handleCreate(&wmsg, &wreply),
-            fx.T_READ => handleRead(&wmsg, &wreply),
-            fx.T_WRITE => handleWrite(&wmsg, &wreply),
+            // Read-only: run concurrently with each other
+            fx.T_OPEN, fx.T_READ, fx.T_STAT => {
+                tree_lock.lockShared();
+                const pin = cachePin();
+                switch (wmsg.tag) {
+                    fx.T_OPEN => handleOpen(&wmsg, &wreply),
+                    fx.T_READ => handleRead(&wmsg, &wreply),
+                    else => handleStat(&wmsg, &wreply),
+                }
+                cacheUnpin(pin);
+                tree_lock.unlockShared();
+            },
+            // Handle table only
             fx.T_CLOSE => handleClose(&wmsg, &wreply),
-            fx.T_STAT => handleStat(&wmsg, &wreply),
-            fx.T_REMOVE => handleRemove(&wmsg, &wreply),
-            fx.T_RENAME => handleRename(&wmsg, &wreply),
-            fx.T_TRUNCATE => handleTruncate(&wmsg, &wreply),
-            fx.T_WSTAT => handleWstat(&wmsg, &wreply),
+            // Mutating: one at a time, excluding readers except during commit I/O
+            fx.T_CREATE, fx.T_WRITE, fx.T_WRITE_BULK, fx.T_REMOVE, fx.T_RENAME, fx.T_TRUNCATE, fx.T_WSTAT => {
+                write_lock.lock();
+                tree_lock.lock();
+                switch (wmsg.tag) {
+                    fx.T_CREATE => handleCreate(&wmsg, &wreply),
+                    fx.T_WRITE => handleWrite(&wmsg, &wreply),
+                    fx.T_WRITE_BULK => handleWriteBulk(&wmsg, &wreply),
+                    fx.T_REMOVE => handleRemove(&wmsg, &wreply),
+                    fx.T_RENAME => handleRename(&wmsg, &wreply),
+                    fx.T_TRUNCATE => handleTruncate(&wmsg, &wreply),
+                    else => handleWstat(&wmsg, &wreply),
+                }
+                tree_lock.unlock();
+                write_lock.unlock();
+            },
             else => {
                 wreply = fx.IpcMessage.init(fx.R_ERROR);
             },
         }
 
-        fs_lock.unlock();
-
         _ = fx.ipc_reply(SERVER_FD, &wreply);
     }
 }
@@ -2894,8 +3934,30 @@ fn workerLoop() noreturn {
 export fn _start() noreturn {
     // Initialize
     cacheInit();
-    for (0..MAX_HANDLES) |i| {
-        handles[i] = .{ .inode_nr = 0, .write_offset = 0, .active = false };
+    dcacheInit();
+
+    // Hot standby: park here, ahead of anything that reads the disk or
+    // the state region — the active instance may change both until then
+    fx.svcStandby();
+
+    // The magic stays cleared until the restored table has been checked,
+    // so a crash partway through the restore makes the next instance
+    // wipe the table instead of trusting it again.
+    var state: ?*SavedState = null;
+    var resuming = false;
+    if (fx.svcState()) |region| {
+        const saved: *SavedState = @ptrCast(region.ptr);
+        resuming = saved.magic == STATE_MAGIC;
+        saved.magic = 0;
+        if (!resuming) {
+            for (&saved.handles) |*h| h.* = .{ .inode_nr = 0, .write_offset = 0, .active = false };
+        }
+        handles = &saved.handles;
+        state = saved;
+    } else {
+        for (0..MAX_HANDLES) |i| {
+            handles[i] = .{ .inode_nr = 0, .write_offset = 0, .active = false };
+        }
     }
 
     // Load superblock from /dev/blk0 (fd 4)
@@ -2911,8 +3973,24 @@ export fn _start() noreturn {
         }
     }
 
-    // Spawn worker threads (3 workers + main thread = 4 total)
-    const NUM_WORKERS = 3;
+    if (!bitmapLoad()) {
+        _ = fx.write(1, "fxfs: failed to load bitmap\n");
+        fx.exit(1);
+    }
+
+    if (state) |saved| {
+        if (resuming) {
+            _ = fx.write(1, "fxfs: resuming handle table\n");
+            if (validateHandles() > 0) _ = fx.write(1, "fxfs: dropped stale handles\n");
+        }
+        saved.magic = STATE_MAGIC;
+    }
+
+    _ = fx.ipc_grant_enable(SERVER_FD);
+
+    _ = fx.thread.spawnThread(flusherEntry, null) catch {};
+
+    // Spawn worker threads (NUM_WORKERS + main thread)
     var i: usize = 0;
     while (i < NUM_WORKERS) : (i += 1) {
         _ = fx.thread.spawnThread(workerEntry, null) catch {};
@@ -9,21 +9,32 @@
 ///   - Frame RX thread: reads /dev/ether0, dispatches to protocol handlers
 ///   - Timer thread: periodic tick (retransmission, DNS retry, ICMP timeout)
 ///
-/// Blocking reads: when no data available, the IPC worker thread polls
-/// with short sleeps until data arrives or connection resets.
+/// Blocking reads: when no data is available, the IPC worker thread waits
+/// on a condition (per TCP/ICMP connection, one for DNS) under net_lock.
+/// The RX and timer threads signal it the moment the stack's state
+/// changes, so a reply goes out as soon as the data lands. /dev/ether0
+/// reads block in the kernel until the virtio-net RX interrupt delivers
+/// a frame.
+///
+/// /dev/ether0 is switched to batch framing: one read returns every frame
+/// queued for us, and outgoing frames are collected in a TX batch that is
+/// written (one syscall, one device notify) at the end of each RX batch,
+/// timer tick and IPC request, and before a worker blocks.
 const fx = @import("fornax");
 const net = fx.net;
 
 const Mutex = fx.thread.Mutex;
+const Condition = fx.thread.Condition;
 
 // ── Configuration ─────────────────────────────────────────────────
 const SERVER_FD: i32 = 3;
 const ETHER_FD: i32 = 4;
 const MAX_HANDLES = 64;
 const TICK_MS: u32 = 55;
-const POLL_SLEEP_MS: u32 = 10;
-const MAX_POLL_ITERS: u32 = 3000; // ~30 seconds max block
+const BLOCK_TIMEOUT_SECS: u64 = 30; // max time a read/connect/query blocks
 const NUM_WORKERS = 3; // + main thread = 4
+const RX_BATCH_BYTES = 64 * 1024; // kernel ether batch limit
+const TX_BATCH_BYTES = 16 * 1520; // one device notify's worth of frames
 
 // Network config (QEMU defaults)
 var our_mac: [6]u8 = .{ 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
@@ -94,6 +105,12 @@ var icmp_handler: net.icmp.IcmpHandler linksection(".bss") = undefined;
 
 var net_lock: Mutex = .{};
 
+// Readiness conditions, all used with net_lock. Signalled on every state
+// change a blocked worker may be waiting for.
+var tcp_events: [net.tcp.MAX_CONNECTIONS]Condition = [_]Condition{.{}} ** net.tcp.MAX_CONNECTIONS;
+var icmp_events: [net.icmp.MAX_CONNECTIONS]Condition = [_]Condition{.{}} ** net.icmp.MAX_CONNECTIONS;
+var dns_event: Condition = .{};
+
 // Packet ID counter for IP headers
 var packet_id_counter: u16 = 1;
 
@@ -118,7 +135,7 @@ fn sendIpPacket(dst_ip: [4]u8, ip_packet: []const u8) void {
         // Send ARP request and drop this packet (caller will retry)
         var arp_buf: [64]u8 = undefined;
         if (net.arp.ArpTable.buildRequest(&arp_buf, our_mac, our_ip, target_ip)) |arp_len| {
-            _ = fx.write(ETHER_FD, arp_buf[0..arp_len]);
+            queueFrame(arp_buf[0..arp_len]);
         }
         return;
     };
@@ -126,7 +143,38 @@ fn sendIpPacket(dst_ip: [4]u8, ip_packet: []const u8) void {
     // Wrap in Ethernet frame
     var frame_buf: [1600]u8 = undefined;
     const frame_len = net.ethernet.build(&frame_buf, mac, our_mac, net.ethernet.ETHER_IPV4, ip_packet) orelse return;
-    _ = fx.write(ETHER_FD, frame_buf[0..frame_len]);
+    queueFrame(frame_buf[0..frame_len]);
+}
+
+// ── TX batching ───────────────────────────────────────────────────
+
+var tx_batch: [TX_BATCH_BYTES]u8 linksection(".bss") = undefined;
+var tx_batch_len: usize = 0;
+/// Guards tx_batch. Lock ordering: net_lock → tx_lock.
+var tx_lock: Mutex = .{};
+
+/// Append a frame to the TX batch, writing the batch out first if full.
+fn queueFrame(frame: []const u8) void {
+    tx_lock.lock();
+    defer tx_lock.unlock();
+    if (tx_batch_len + 2 + frame.len > tx_batch.len) flushTxLocked();
+    tx_batch[tx_batch_len] = @truncate(frame.len);
+    tx_batch[tx_batch_len + 1] = @truncate(frame.len >> 8);
+    @memcpy(tx_batch[tx_batch_len + 2 ..][0..frame.len], frame);
+    tx_batch_len += 2 + frame.len;
+}
+
+/// Write out any queued frames.
+fn flushTx() void {
+    tx_lock.lock();
+    flushTxLocked();
+    tx_lock.unlock();
+}
+
+fn flushTxLocked() void {
+    if (tx_batch_len == 0) return;
+    _ = fx.write(ETHER_FD, tx_batch[0..tx_batch_len]);
+    tx_batch_len = 0;
 }
 
 fn sendIcmpIpPacket(ctx: *anyopaque, dst_ip: [4]u8, ip_packet: []const u8) void {
@@ -153,23 +201,60 @@ fn getOurIp() [4]u8 {
     return our_ip;
 }
 
+/// The stack's ~18 Hz ticks, from the kernel's monotonic clock.
 fn getTicks() u32 {
-    const info = fx.sysinfo() orelse return 0;
-    // Convert uptime_secs to ~18Hz ticks (approximate)
-    return @truncate(info.uptime_secs * 18);
+    return @truncate(fx.clockNs() / (1_000_000_000 / 18));
+}
+
+/// TCP connection buffers: page-granular anonymous mappings, so a connection
+/// only costs memory while it is open and grows with its traffic.
+fn allocTcpBuf(len: usize) ?[*]u8 {
+    const MAP_ANONYMOUS: u64 = 0x20;
+    const MAP_PRIVATE: u64 = 0x02;
+    const PROT_RW: u64 = 0x3;
+    const base = fx.mmap(0, len, PROT_RW, MAP_ANONYMOUS | MAP_PRIVATE);
+    if (base == 0 or base > 0xFFFF_FFFF_FFFF_0000) return null;
+    return @ptrFromInt(base);
+}
+
+fn freeTcpBuf(ptr: [*]u8, len: usize) void {
+    _ = fx.munmap(@intFromPtr(ptr), len);
 }
 
 fn getTimeMs(ctx: *anyopaque) u64 {
     _ = ctx;
-    const info = fx.sysinfo() orelse return 0;
-    return info.uptime_secs * 1000;
+    return fx.clockNs() / 1_000_000;
 }
 
 fn tcpWaiterCallback(conn_idx: u8, event: net.tcp.WaiterEvent) void {
-    // The blocked IPC worker thread polls for data changes,
-    // so we don't need to do anything here for v1.
-    _ = conn_idx;
+    // Called from the stack with net_lock held. Every event (data, EOF,
+    // reset, connect, accept) is something a blocked worker re-checks.
     _ = event;
+    tcp_events[conn_idx].broadcast();
+}
+
+fn signalIcmp() void {
+    for (&icmp_events) |*c| c.broadcast();
+}
+
+fn uptimeSecs() u64 {
+    return fx.clockNs() / 1_000_000_000;
+}
+
+fn blockDeadline() u64 {
+    return uptimeSecs() + BLOCK_TIMEOUT_SECS;
+}
+
+/// Wait on `cond` (net_lock held) until it is signalled or `deadline`
+/// (uptime seconds) passes. Returns false once the deadline has passed.
+fn waitEvent(cond: *Condition, deadline: u64) bool {
+    const now = uptimeSecs();
+    if (now >= deadline) return false;
+    // Whatever we are waiting for (SYN-ACK, DNS reply, ...) needs our
+    // request on the wire first.
+    flushTx();
+    _ = cond.timedWait(&net_lock, (deadline - now) * 1000);
+    return true;
 }
 
 fn sameSubnet(ip: [4]u8) bool {
@@ -335,10 +420,10 @@ fn handleRead(msg: *fx.IpcMessage, reply: *fx.IpcMessage) void {
             h.read_done = true;
         },
         .tcp_data => {
-            // Poll for data with sleep
-            var iters: u32 = 0;
-            while (iters < MAX_POLL_ITERS) : (iters += 1) {
-                net_lock.lock();
+            // Wait for data, EOF or reset
+            const deadline = blockDeadline();
+            net_lock.lock();
+            while (true) {
                 if (tcp_stack.hasData(h.conn)) {
                     var buf: [4092]u8 = undefined;
                     const n = tcp_stack.recvData(h.conn, &buf);
@@ -354,9 +439,9 @@ fn handleRead(msg: *fx.IpcMessage, reply: *fx.IpcMessage) void {
                     reply.data_len = 0;
                     return;
                 }
-                net_lock.unlock();
-                fx.sleep(POLL_SLEEP_MS);
+                if (!waitEvent(&tcp_events[h.conn], deadline)) break;
             }
+            net_lock.unlock();
             // Timeout — return 0 bytes (EOF)
             reply.* = fx.IpcMessage.init(fx.R_OK);
             reply.data_len = 0;
@@ -438,14 +523,13 @@ fn handleRead(msg: *fx.IpcMessage, reply: *fx.IpcMessage) void {
         },
         .tcp_listen => {
             // Block until a new connection arrives on the listener
-            var iters: u32 = 0;
-            while (iters < MAX_POLL_ITERS) : (iters += 1) {
-                net_lock.lock();
+            const deadline = blockDeadline();
+            net_lock.lock();
+            while (true) {
                 // Check if a child connection appeared (syn_received → established)
-                const state = tcp_stack.getState(h.conn);
-                net_lock.unlock();
-                if (state == null) {
+                if (tcp_stack.getState(h.conn) == null) {
                     // Listener was closed
+                    net_lock.unlock();
                     reply.* = fx.IpcMessage.init(fx.R_ERROR);
                     return;
                 }
@@ -453,8 +537,9 @@ fn handleRead(msg: *fx.IpcMessage, reply: *fx.IpcMessage) void {
                 // For netd, the listener stays in .listen and new connections
                 // get their own indices — handled by tcp_stack.handlePacket.
                 // For now, just indicate listen is active.
-                fx.sleep(POLL_SLEEP_MS);
+                if (!waitEvent(&tcp_events[h.conn], deadline)) break;
             }
+            net_lock.unlock();
             reply.* = fx.IpcMessage.init(fx.R_OK);
             reply.data_len = 0;
         },
@@ -521,10 +606,10 @@ fn handleRead(msg: *fx.IpcMessage, reply: *fx.IpcMessage) void {
             h.read_done = true;
         },
         .icmp_data => {
-            // Poll for reply
-            var iters: u32 = 0;
-            while (iters < MAX_POLL_ITERS) : (iters += 1) {
-                net_lock.lock();
+            // Wait for a reply or timeout
+            const deadline = blockDeadline();
+            net_lock.lock();
+            while (true) {
                 if (icmp_handler.hasReply(h.conn)) {
                     var buf: [128]u8 = undefined;
                     const n = icmp_handler.getReplyText(h.conn, &buf);
@@ -545,9 +630,9 @@ fn handleRead(msg: *fx.IpcMessage, reply: *fx.IpcMessage) void {
                     reply.data_len = timeout_msg.len;
                     return;
                 }
-                net_lock.unlock();
-                fx.sleep(POLL_SLEEP_MS);
+                if (!waitEvent(&icmp_events[h.conn], deadline)) break;
             }
+            net_lock.unlock();
             reply.* = fx.IpcMessage.init(fx.R_OK);
             reply.data_len = 0;
         },
@@ -736,16 +821,16 @@ fn handleWrite(msg: *fx.IpcMessage, reply: *fx.IpcMessage) void {
                 reply.* = fx.IpcMessage.init(fx.R_OK);
                 setReplyLen(reply, n);
             } else {
-                // Connect: poll for completion
-                var iters: u32 = 0;
-                while (iters < MAX_POLL_ITERS) : (iters += 1) {
-                    net_lock.lock();
+                // Connect: wait for completion or reset
+                const deadline = blockDeadline();
+                net_lock.lock();
+                while (true) {
                     const state = tcp_stack.getState(h.conn);
-                    net_lock.unlock();
                     if (state == null or state.? == .established) break;
                     if (state.? == .closed) break;
-                    fx.sleep(POLL_SLEEP_MS);
+                    if (!waitEvent(&tcp_events[h.conn], deadline)) break;
                 }
+                net_lock.unlock();
                 reply.* = fx.IpcMessage.init(fx.R_OK);
                 setReplyLen(reply, @intCast(data.len));
             }
@@ -765,21 +850,16 @@ fn handleWrite(msg: *fx.IpcMessage, reply: *fx.IpcMessage) void {
                 reply.* = fx.IpcMessage.init(fx.R_OK);
                 setReplyLen(reply, n);
             } else {
-                // DNS query sent, poll for response
-                var iters: u32 = 0;
-                while (iters < MAX_POLL_ITERS) : (iters += 1) {
-                    net_lock.lock();
-                    if (dns_resolver.getResult() != null) {
-                        net_lock.unlock();
-                        break;
-                    }
-                    if (dns_resolver.hasPendingTimeout()) {
-                        net_lock.unlock();
-                        break;
-                    }
-                    net_lock.unlock();
-                    fx.sleep(POLL_SLEEP_MS);
+                // DNS query sent, wait for the response or a timeout
+                const deadline = blockDeadline();
+                net_lock.lock();
+                while (true) {
+                    if (dns_resolver.getResult() != null) break;
+                    if (dns_resolver.hasPendingTimeout()) break;
+                    if (dns_resolver.pending_name_len == 0) break; // gave up
+                    if (!waitEvent(&dns_event, deadline)) break;
                 }
+                net_lock.unlock();
                 reply.* = fx.IpcMessage.init(fx.R_OK);
                 setReplyLen(reply, @intCast(data.len));
             }
@@ -1004,54 +1084,65 @@ fn rxThreadEntry(_: *anyopaque) callconv(.c) void {
 }
 
 fn rxLoop() noreturn {
-    var frame_buf: [1600]u8 = undefined;
-
     while (true) {
-        const n = fx.read(ETHER_FD, &frame_buf);
+        // Blocks in the kernel until the RX interrupt delivers a frame;
+        // fails only if the device went away.
+        const n = fx.read(ETHER_FD, &rx_batch);
         if (n <= 0) {
             fx.sleep(1);
             continue;
         }
 
-        const frame = frame_buf[0..@intCast(n)];
-        const eth = net.ethernet.parse(frame) orelse continue;
+        // [len: u16 LE][frame] records
+        const batch = rx_batch[0..@intCast(n)];
+        var pos: usize = 0;
+        while (pos + 2 <= batch.len) {
+            const len = @as(usize, batch[pos]) | @as(usize, batch[pos + 1]) << 8;
+            if (pos + 2 + len > batch.len) break;
+            handleFrame(batch[pos + 2 ..][0..len]);
+            pos += 2 + len;
+        }
+        flushTx();
+    }
+}
 
-        net_lock.lock();
+var rx_batch: [RX_BATCH_BYTES]u8 linksection(".bss") = undefined;
 
-        if (eth.header.ethertype == net.ethernet.ETHER_ARP) {
-            var reply_buf: [64]u8 = undefined;
-            if (arp_table.handlePacket(eth.payload, our_mac, our_ip, &reply_buf)) |reply_len| {
-                net_lock.unlock();
-                _ = fx.write(ETHER_FD, reply_buf[0..reply_len]);
-                continue;
+fn handleFrame(frame: []const u8) void {
+    const eth = net.ethernet.parse(frame) orelse return;
+
+    net_lock.lock();
+    defer net_lock.unlock();
+
+    if (eth.header.ethertype == net.ethernet.ETHER_ARP) {
+        var reply_buf: [64]u8 = undefined;
+        if (arp_table.handlePacket(eth.payload, our_mac, our_ip, &reply_buf)) |reply_len| {
+            queueFrame(reply_buf[0..reply_len]);
+        }
+    } else if (eth.header.ethertype == net.ethernet.ETHER_IPV4) {
+        const ip_result = net.ipv4.parse(eth.payload) orelse return;
+        const ip_hdr = ip_result.header;
+        const ip_payload = ip_result.payload;
+
+        if (ip_hdr.protocol == net.ipv4.PROTO_TCP) {
+            tcp_stack.handlePacket(ip_payload, ip_hdr);
+        } else if (ip_hdr.protocol == net.ipv4.PROTO_ICMP) {
+            var reply_buf: [1600]u8 = undefined;
+            const reply = icmp_handler.handlePacket(ip_payload, ip_hdr, our_ip, &reply_buf);
+            signalIcmp();
+            if (reply) |reply_len| {
+                sendIpPacket(ip_hdr.src, reply_buf[0..reply_len]);
             }
-        } else if (eth.header.ethertype == net.ethernet.ETHER_IPV4) {
-            if (net.ipv4.parse(eth.payload)) |ip_result| {
-                const ip_hdr = ip_result.header;
-                const ip_payload = ip_result.payload;
-
-                if (ip_hdr.protocol == net.ipv4.PROTO_TCP) {
-                    tcp_stack.handlePacket(ip_payload, ip_hdr);
-                } else if (ip_hdr.protocol == net.ipv4.PROTO_ICMP) {
-                    var reply_buf: [1600]u8 = undefined;
-                    if (icmp_handler.handlePacket(ip_payload, ip_hdr, our_ip, &reply_buf)) |reply_len| {
-                        net_lock.unlock();
-                        sendIpPacket(ip_hdr.src, reply_buf[0..reply_len]);
-                        continue;
-                    }
-                } else if (ip_hdr.protocol == net.ipv4.PROTO_UDP) {
-                    // Check if it's a DNS response (from port 53)
-                    if (ip_payload.len >= 8) {
-                        const src_port = @as(u16, ip_payload[0]) << 8 | ip_payload[1];
-                        if (src_port == 53 and ip_payload.len > 8) {
-                            _ = dns_resolver.handleResponse(ip_payload[8..]);
-                        }
-                    }
+        } else if (ip_hdr.protocol == net.ipv4.PROTO_UDP) {
+            // Check if it's a DNS response (from port 53)
+            if (ip_payload.len >= 8) {
+                const src_port = @as(u16, ip_payload[0]) << 8 | ip_payload[1];
+                if (src_port == 53 and ip_payload.len > 8) {
+                    _ = dns_resolver.handleResponse(ip_payload[8..]);
+                    dns_event.broadcast();
                 }
             }
         }
-
-        net_lock.unlock();
     }
 }
 
@@ -1071,14 +1162,17 @@ fn timerLoop() noreturn {
         const now = getTicks();
         tcp_stack.tick(now);
 
-        // DNS retry
+        // DNS retry; wake the waiting query once the resolver gives up
+        const dns_was_pending = dns_resolver.pending_name_len > 0;
         _ = dns_resolver.checkRetry();
+        if (dns_was_pending and dns_resolver.pending_name_len == 0) dns_event.broadcast();
 
         // ICMP timeouts
         var timeout_buf: [4]u8 = undefined;
-        _ = icmp_handler.checkTimeouts(&timeout_buf);
+        if (icmp_handler.checkTimeouts(&timeout_buf) > 0) signalIcmp();
 
         net_lock.unlock();
+        flushTx();
     }
 }
 
@@ -1106,6 +1200,7 @@ fn workerLoop() noreturn {
                 wreply = fx.IpcMessage.init(fx.R_ERROR);
             },
         }
+        flushTx();
 
         _ = fx.ipc_reply(SERVER_FD, &wreply);
     }
@@ -1123,6 +1218,7 @@ export fn _start() noreturn {
     tcp_stack = net.tcp.TcpStack.init(&sendTcpIpPacket, &getOurIp, &getTicks);
     tcp_stack.setWaiterCallback(&tcpWaiterCallback);
     tcp_stack.setMaxConnections(32);
+    tcp_stack.setBufferAllocator(&allocTcpBuf, &freeTcpBuf);
 
     // DNS resolver needs an opaque context; use a dummy
     var dummy_ctx: u8 = 0;
@@ -1140,10 +1236,14 @@ export fn _start() noreturn {
         @ptrCast(&dummy_ctx),
     );
 
+    // Length-prefixed multi-frame reads and writes on /dev/ether0
+    _ = fx.write(ETHER_FD, "batch");
+
     // Send gratuitous ARP to populate gateway's ARP cache
     var arp_buf: [64]u8 = undefined;
     if (net.arp.ArpTable.buildRequest(&arp_buf, our_mac, our_ip, gateway_ip)) |arp_len| {
-        _ = fx.write(ETHER_FD, arp_buf[0..arp_len]);
+        queueFrame(arp_buf[0..arp_len]);
+        flushTx();
     }
 
     // Spawn RX thread
@@ -0,0 +1,74 @@
+const std = @import("std");
+const bench = @import("bench");
+
+const expect = std.testing.expect;
+const expectEqual = std.testing.expectEqual;
+
+// ── Sorting ─────────────────────────────────────────────────────────
+
+test "sort orders random samples" {
+    var buf: [257]u64 = undefined;
+    var prng = std.Random.DefaultPrng.init(7);
+    for (0..buf.len) |len| {
+        const s = buf[0..len];
+        for (s) |*v| v.* = prng.random().uintLessThan(u64, 50);
+        bench.sort(s);
+        for (1..len) |i| try expect(s[i - 1] <= s[i]);
+    }
+}
+
+test "sort handles sorted and reversed input" {
+    var up: [100]u64 = undefined;
+    var down: [100]u64 = undefined;
+    for (0..100) |i| {
+        up[i] = i;
+        down[i] = 99 - i;
+    }
+    bench.sort(&up);
+    bench.sort(&down);
+    try std.testing.expectEqualSlices(u64, &up, &down);
+    try expectEqual(@as(u64, 0), up[0]);
+    try expectEqual(@as(u64, 99), up[99]);
+}
+
+// ── Percentiles ─────────────────────────────────────────────────────
+
+test "percentile uses nearest rank" {
+    var s: [100]u64 = undefined;
+    for (&s, 1..) |*v, i| v.* = i;
+    try expectEqual(@as(u64, 50), bench.percentile(&s, 50));
+    try expectEqual(@as(u64, 90), bench.percentile(&s, 90));
+    try expectEqual(@as(u64, 99), bench.percentile(&s, 99));
+    try expectEqual(@as(u64, 100), bench.percentile(&s, 100));
+    try expectEqual(@as(u64, 1), bench.percentile(&s, 0));
+
+    const few = [_]u64{ 10, 20, 30 };
+    try expectEqual(@as(u64, 20), bench.percentile(&few, 50));
+    try expectEqual(@as(u64, 30), bench.percentile(&few, 90));
+}
+
+test "summarize a single sample" {
+    var s = [_]u64{42};
+    const sum = bench.summarize(&s);
+    try expectEqual(@as(usize, 1), sum.n);
+    try expectEqual(@as(u64, 42), sum.min);
+    try expectEqual(@as(u64, 42), sum.p50);
+    try expectEqual(@as(u64, 42), sum.p99);
+    try expectEqual(@as(u64, 42), sum.max);
+}
+
+test "summarize sorts in place" {
+    var s = [_]u64{ 9, 3, 7, 1, 5 };
+    const sum = bench.summarize(&s);
+    try std.testing.expectEqualSlices(u64, &.{ 1, 3, 5, 7, 9 }, &s);
+    try expectEqual(@as(u64, 1), sum.min);
+    try expectEqual(@as(u64, 5), sum.p50);
+    try expectEqual(@as(u64, 9), sum.p90);
+    try expectEqual(@as(u64, 9), sum.max);
+}
+
+test "cycles does not go backwards" {
+    const a = bench.cycles();
+    const b = bench.cycles();
+    try expect(b >= a);
+}
@@ -0,0 +1,220 @@
+const std = @import("std");
+const deflate = @import("deflate");
+
+const expect = std.testing.expect;
+const expectEqual = std.testing.expectEqual;
+const expectEqualSlices = std.testing.expectEqualSlices;
+
+fn hexToBytes(comptime hex: []const u8) [hex.len / 2]u8 {
+    var result: [hex.len / 2]u8 = undefined;
+    for (0..hex.len / 2) |i| {
+        result[i] = @as(u8, hexChar(hex[i * 2])) << 4 | hexChar(hex[i * 2 + 1]);
+    }
+    return result;
+}
+
+fn hexChar(c: u8) u8 {
+    return switch (c) {
+        '0'...'9' => c - '0',
+        'a'...'f' => c - 'a' + 10,
+        else => 0,
+    };
+}
+
+// ── Harness: input in chunks of at most `chunk` bytes ───────────────
+
+const SliceSource = struct {
+    data: []const u8,
+    pos: usize = 0,
+    chunk: usize,
+
+    fn read(ctx: *anyopaque, buf: []u8) isize {
+        const self: *SliceSource = @ptrCast(@alignCast(ctx));
+        const n = @min(buf.len, self.chunk, self.data.len - self.pos);
+        @memcpy(buf[0..n], self.data[self.pos..][0..n]);
+        self.pos += n;
+        return @intCast(n);
+    }
+};
+
+var window: [deflate.WINDOW_SIZE]u8 = undefined;
+var in_buf: [64]u8 = undefined;
+var out: [48 * 1024]u8 = undefined;
+
+/// Inflate `data` with readBytes() in `piece`-byte reads.
+fn inflate(data: []const u8, chunk: usize, piece: usize) ![]const u8 {
+    var src = SliceSource{ .data = data, .chunk = chunk };
+    var reader = deflate.BitReader.init(&SliceSource.read, @ptrCast(&src), &in_buf);
+    var inflater = deflate.Inflater.init(&window);
+    var len: usize = 0;
+    while (!inflater.done) {
+        const n = inflater.readBytes(&reader, out[len..][0..@min(piece, out.len - len)]);
+        if (n == 0) break;
+        len += n;
+    }
+    try expect(inflater.done);
+    return out[0..len];
+}
+
+// ── Test vectors (raw deflate, checked against zlib) ────────────────
+
+/// zlib -9 of text_lines: one dynamic block with matches.
+const dynamic_vec = hexToBytes(
+    "9dd4cb1182401045d13d517408bc5151c90671f8e8c8281f05a2a73403efbaebaefad40b6de72dcd6d6cbcbda6b6bc" ++
+        "dba58f9fceaa38db6d7a3c078b6fdfffcea15817bbc63a09df46a071a0d981660f9a036832d01c417302cd99fc1441" ++
+        "20124428885810c120a24184838807111022221c11e1d0361011ee4f111b",
+);
+
+/// zlib Z_FIXED of "hello, hello, hello, hello world\n" x 4: fixed codes,
+/// overlapping matches.
+const fixed_vec = hexToBytes("cb48cdc9c9d751c8c0a414caf38b7252b83268af0000");
+
+/// Hand-built dynamic block whose 'a'..'o' codes are 1..15 bits long and
+/// EOB 15 bits, so five of them decode through subtables.
+const long_codes_vec = hexToBytes(
+    "05e0d19224499224cb7e2b128b9a4756cf9efbff6f17b47bdfefefdf7ffffbbffff7fffdffc0ffeffffbff03",
+);
+
+fn textLines(buf: []u8) []const u8 {
+    var len: usize = 0;
+    for (0..24) |i| {
+        const line = std.fmt.bufPrint(buf[len..], "line {d}: the quick brown fox jumps over the lazy dog\n", .{i}) catch unreachable;
+        len += line.len;
+    }
+    return buf[0..len];
+}
+
+// ── Block types ─────────────────────────────────────────────────────
+
+test "stored block" {
+    const data = [_]u8{ 0x01, 0x05, 0x00, 0xFA, 0xFF } ++ "hello".*;
+    try expectEqualSlices(u8, "hello", try inflate(&data, 64, 4096));
+}
+
+test "fixed Huffman block" {
+    const expected = "hello, hello, hello, hello world\n" ** 4;
+    try expectEqualSlices(u8, expected, try inflate(&fixed_vec, 64, 4096));
+}
+
+test "dynamic Huffman block" {
+    var buf: [2048]u8 = undefined;
+    const expected = textLines(&buf);
+    try expectEqualSlices(u8, expected, try inflate(&dynamic_vec, 64, 4096));
+}
+
+test "codes longer than the root table" {
+    try expectEqualSlices(u8, "abcdefghijklmnoaaaaaon", try inflate(&long_codes_vec, 64, 4096));
+}
+
+// ── Input and output granularity ────────────────────────────────────
+
+test "byte-at-a-time input and small reads" {
+    var buf: [2048]u8 = undefined;
+    const expected = textLines(&buf);
+    try expectEqualSlices(u8, expected, try inflate(&dynamic_vec, 1, 7));
+    try expectEqualSlices(u8, "abcdefghijklmnoaaaaaon", try inflate(&long_codes_vec, 3, 1));
+}
+
+const Collect = struct {
+    len: usize = 0,
+    calls: usize = 0,
+
+    fn write(ctx: *anyopaque, data: []const u8) bool {
+        const self: *Collect = @ptrCast(@alignCast(ctx));
+        @memcpy(out[self.len..][0..data.len], data);
+        self.len += data.len;
+        self.calls += 1;
+        return true;
+    }
+};
+
+test "stream across the window wrap" {
+    // Stored block of 40000 bytes, then a fixed block copying 258 bytes
+    // from exactly 32 KiB back.
+    const N = 40000;
+    var data: [5 + N + 5]u8 = undefined;
+    @memcpy(data[0..5], &hexToBytes("00409cbf63"));
+    for (0..N) |i| data[5 + i] = @intCast((i * 7 + i / 251) % 251);
+    @memcpy(data[5 + N ..], &hexToBytes("1bbdff1f00"));
+
+    var src = SliceSource{ .data = &data, .chunk = 4096 };
+    var reader = deflate.BitReader.init(&SliceSource.read, @ptrCast(&src), &in_buf);
+    var inflater = deflate.Inflater.init(&window);
+    var sink = Collect{};
+    const total = inflater.stream(&reader, ~@as(u64, 0), &Collect.write, @ptrCast(&sink));
+
+    try expect(inflater.done);
+    try expectEqual(@as(u64, N + 258), total);
+    try expectEqualSlices(u8, data[5..][0..N], out[0..N]);
+    try expectEqualSlices(u8, data[5 + N - 32768 ..][0..258], out[N..][0..258]);
+}
+
+test "stream stops at limit and resumes" {
+    const expected = "hello, hello, hello, hello world\n" ** 4;
+    var src = SliceSource{ .data = &fixed_vec, .chunk = 64 };
+    var reader = deflate.BitReader.init(&SliceSource.read, @ptrCast(&src), &in_buf);
+    var inflater = deflate.Inflater.init(&window);
+    var sink = Collect{};
+    try expectEqual(@as(u64, 50), inflater.stream(&reader, 50, &Collect.write, @ptrCast(&sink)));
+    try expect(!inflater.done);
+    try expectEqual(@as(u64, expected.len - 50), inflater.stream(&reader, 1000, &Collect.write, @ptrCast(&sink)));
+    try expect(inflater.done);
+    try expectEqualSlices(u8, expected, out[0..sink.len]);
+}
+
+// ── Errors ──────────────────────────────────────────────────────────
+
+test "reserved block type fails" {
+    const data = [_]u8{ 0x07, 0x00 };
+    var src = SliceSource{ .data = &data, .chunk = 64 };
+    var reader = deflate.BitReader.init(&SliceSource.read, @ptrCast(&src), &in_buf);
+    var inflater = deflate.Inflater.init(&window);
+    var dest: [16]u8 = undefined;
+    try expectEqual(@as(usize, 0), inflater.readBytes(&reader, &dest));
+    try expect(!inflater.done);
+    try expect(inflater.failed);
+}
+
+test "truncated stream fails" {
+    var src = SliceSource{ .data = dynamic_vec[0 .. dynamic_vec.len / 2], .chunk = 64 };
+    var reader = deflate.BitReader.init(&SliceSource.read, @ptrCast(&src), &in_buf);
+    var inflater = deflate.Inflater.init(&window);
+    var dest: [4096]u8 = undefined;
+    while (inflater.readBytes(&reader, &dest) != 0) {}
+    try expect(!inflater.done);
+    try expect(inflater.failed);
+}
+
+test "match reaching before the output fails" {
+    // Fixed block: a distance-1 match with no byte decoded yet
+    const far = [_]u8{ 0x03, 0x02, 0x00 };
+    var src = SliceSource{ .data = &far, .chunk = 64 };
+    var reader = deflate.BitReader.init(&SliceSource.read, @ptrCast(&src), &in_buf);
+    var inflater = deflate.Inflater.init(&window);
+    var dest: [16]u8 = undefined;
+    try expectEqual(@as(usize, 0), inflater.readBytes(&reader, &dest));
+    try expect(inflater.failed);
+
+    // One literal first makes the same match valid: "aaaa"
+    try expectEqualSlices(u8, "aaaa", try inflate(&hexToBytes("4b4c4c4c0400"), 64, 16));
+}
+
+test "over-subscribed code lengths are rejected" {
+    var table: deflate.HuffmanTable = undefined;
+    try expect(!table.build(&[_]u8{ 1, 1, 1 }));
+    try expect(table.build(&[_]u8{ 1, 2, 2 }));
+    try expect(table.build(&[_]u8{ 2, 2, 0, 0 }));
+}
+
+// ── Gzip header ─────────────────────────────────────────────────────
+
+test "gzip header with file name" {
+    const data = [_]u8{ 0x1f, 0x8b, 8, 0x08, 0, 0, 0, 0, 0, 3 } ++ "a.txt".* ++ [_]u8{0} ++ fixed_vec;
+    var src = SliceSource{ .data = &data, .chunk = 64 };
+    var reader = deflate.BitReader.init(&SliceSource.read, @ptrCast(&src), &in_buf);
+    try expect(deflate.skipGzipHeader(&reader));
+    var inflater = deflate.Inflater.init(&window);
+    var dest: [256]u8 = undefined;
+    const n = inflater.readBytes(&reader, &dest);
+    try expectEqualSlices(u8, "hello, hello, hello, hello world\n" ** 4, dest[0..n]);
+}
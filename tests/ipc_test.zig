@@ -0,0 +1,53 @@
+const std = @import("std");
+const ipc = @import("ipc");
+
+const expect = std.testing.expect;
+const expectEqual = std.testing.expectEqual;
+
+// ── fillBulk ────────────────────────────────────────────────────────
+
+/// A file that, like fxfs's readFileData, returns at most the rest of
+/// one 4 KiB block per call.
+const BlockFile = struct {
+    data: []const u8,
+    calls: u32 = 0,
+
+    fn readAt(self: *BlockFile, off: u64, dest: []u8) u32 {
+        self.calls += 1;
+        if (off >= self.data.len) return 0;
+        const in_block = 4096 - off % 4096;
+        const n: usize = @intCast(@min(dest.len, @min(in_block, self.data.len - off)));
+        @memcpy(dest[0..n], self.data[@intCast(off)..][0..n]);
+        return @intCast(n);
+    }
+};
+
+fn pattern(buf: []u8) void {
+    for (buf, 0..) |*b, i| b.* = @truncate(i *% 7 +% i / 4096);
+}
+
+test "fillBulk reads across several blocks" {
+    var file_data: [5 * 4096 + 100]u8 = undefined;
+    pattern(&file_data);
+    var file = BlockFile{ .data = &file_data };
+
+    var dest: [16 * 1024]u8 = undefined;
+    // Unaligned start: a partial block, then whole blocks.
+    const n = ipc.fillBulk(&file, BlockFile.readAt, &dest, 1000);
+    try expectEqual(@as(u32, dest.len), n);
+    try expect(std.mem.eql(u8, &dest, file_data[1000..][0..dest.len]));
+    try expectEqual(@as(u32, 5), file.calls);
+}
+
+test "fillBulk stops short only at end of file" {
+    var file_data: [3 * 4096 + 10]u8 = undefined;
+    pattern(&file_data);
+    var file = BlockFile{ .data = &file_data };
+
+    var dest: [16 * 1024]u8 = undefined;
+    const n = ipc.fillBulk(&file, BlockFile.readAt, &dest, 4096 + 5);
+    try expectEqual(@as(u32, file_data.len - 4096 - 5), n);
+    try expect(std.mem.eql(u8, dest[0..n], file_data[4096 + 5 ..]));
+
+    try expectEqual(@as(u32, 0), ipc.fillBulk(&file, BlockFile.readAt, &dest, file_data.len));
+}
@@ -0,0 +1,191 @@
+const std = @import("std");
+const ring = @import("ring");
+
+const expect = std.testing.expect;
+const expectEqual = std.testing.expectEqual;
+
+// ── Harness: lay the ring out and play the kernel's side ────────────
+
+const ENTRIES = 4;
+
+var mem: [ring.ringSize(ENTRIES)]u8 align(4096) = undefined;
+
+fn fresh() ring.Ring {
+    @memset(&mem, 0);
+    const hdr: *ring.Header = @ptrCast(&mem);
+    hdr.sq_entries = ENTRIES;
+    hdr.cq_entries = 2 * ENTRIES;
+    hdr.sqe_off = @sizeOf(ring.Header);
+    hdr.cqe_off = @sizeOf(ring.Header) + ENTRIES * @sizeOf(ring.Sqe);
+    return ring.Ring.init(&mem);
+}
+
+/// Consume one SQE as the kernel would.
+fn consume(r: *ring.Ring) ?ring.Sqe {
+    const head = r.hdr.sq_head;
+    if (head == r.hdr.sq_tail) return null;
+    const sqe = r.sqes[head & (ENTRIES - 1)];
+    r.hdr.sq_head = head +% 1;
+    return sqe;
+}
+
+/// Post a completion as the kernel would.
+fn post(r: *ring.Ring, user_data: u64, res: i64) void {
+    const tail = r.hdr.cq_tail;
+    r.cqes[tail & (2 * ENTRIES - 1)] = .{ .user_data = user_data, .res = res };
+    r.hdr.cq_tail = tail +% 1;
+}
+
+// ── Submission queue ────────────────────────────────────────────────
+
+test "push until full" {
+    var r = fresh();
+    for (0..ENTRIES) |i| try expect(r.push(ring.Sqe.nop(i)));
+    try expect(!r.push(ring.Sqe.nop(99)));
+    try expectEqual(@as(u32, ENTRIES), r.pending());
+
+    _ = consume(&r).?;
+    try expectEqual(@as(u32, ENTRIES - 1), r.pending());
+    try expect(r.push(ring.Sqe.nop(4)));
+    try expect(!r.push(ring.Sqe.nop(5)));
+}
+
+test "entries come out in order across the wrap" {
+    var r = fresh();
+    var next: u64 = 0;
+    var expected: u64 = 0;
+    for (0..5) |_| {
+        while (r.push(ring.Sqe.nop(next))) next += 1;
+        for (0..3) |_| {
+            const sqe = consume(&r).?;
+            try expectEqual(expected, sqe.user_data);
+            expected += 1;
+        }
+    }
+    while (consume(&r)) |sqe| {
+        try expectEqual(expected, sqe.user_data);
+        expected += 1;
+    }
+    try expectEqual(next, expected);
+    try expectEqual(@as(u32, 0), r.pending());
+}
+
+test "indices wrap past u32" {
+    var r = fresh();
+    r.hdr.sq_head = 0xFFFF_FFFE;
+    r.hdr.sq_tail = 0xFFFF_FFFE;
+    for (0..ENTRIES) |i| try expect(r.push(ring.Sqe.nop(i)));
+    try expect(!r.push(ring.Sqe.nop(9)));
+    try expectEqual(@as(u32, 2), r.hdr.sq_tail);
+    try expectEqual(@as(u64, 0), consume(&r).?.user_data);
+    try expectEqual(@as(u64, 1), consume(&r).?.user_data);
+    try expectEqual(@as(u64, 2), consume(&r).?.user_data);
+}
+
+// ── SQE encoding ────────────────────────────────────────────────────
+
+test "sqe constructors" {
+    var buf: [100]u8 = undefined;
+    const rd = ring.Sqe.pread(5, &buf, 4096, 7);
+    try expectEqual(@intFromEnum(ring.Op.pread), rd.op);
+    try expectEqual(@as(i32, 5), rd.fd);
+    try expectEqual(@as(u64, 4096), rd.off);
+    try expectEqual(@intFromPtr(&buf), rd.addr);
+    try expectEqual(@as(u32, 100), rd.len);
+    try expectEqual(@as(u64, 7), rd.user_data);
+    try expectEqual(@as(u8, 0), rd.flags);
+
+    const path = "/etc/passwd";
+    const op = ring.Sqe.open(path, 1).linked();
+    try expectEqual(@intFromEnum(ring.Op.open), op.op);
+    try expectEqual(@as(u32, path.len), op.len);
+    try expectEqual(ring.SQE_LINK, op.flags);
+
+    const cl = ring.Sqe.close(ring.FD_LINKED, 2);
+    try expectEqual(@as(i32, -1), cl.fd);
+    try expectEqual(@as(u8, 0), cl.flags);
+}
+
+// ── Completion queue ────────────────────────────────────────────────
+
+test "completions pop in order and wrap" {
+    var r = fresh();
+    try expect(r.popCqe() == null);
+    var n: u64 = 0;
+    for (0..6) |_| {
+        for (0..5) |_| {
+            post(&r, n, -@as(i64, @intCast(n)));
+            n += 1;
+        }
+        try expectEqual(@as(u32, 5), r.ready());
+        for (0..5) |_| {
+            const cqe = r.popCqe().?;
+            try expectEqual(-@as(i64, @intCast(cqe.user_data)), cqe.res);
+        }
+        try expect(r.popCqe() == null);
+    }
+    try expectEqual(@as(u32, 30), r.hdr.cq_head);
+}
+
+// ── Chains ──────────────────────────────────────────────────────────
+
+/// Play the kernel's chain rule over everything queued: `results` are
+/// what each entry would return if started.
+fn runChain(r: *ring.Ring, results: []const i64) void {
+    var broken = false;
+    var i: usize = 0;
+    while (consume(r)) |sqe| : (i += 1) {
+        const linked = sqe.flags & ring.SQE_LINK != 0;
+        if (broken and sqe.op != @intFromEnum(ring.Op.close)) {
+            post(r, sqe.user_data, ring.ECANCELED);
+        } else {
+            post(r, sqe.user_data, results[i]);
+            if (linked and ring.breaksChain(sqe, results[i])) broken = true;
+        }
+        if (!linked) broken = false;
+    }
+}
+
+test "breaksChain on errors and short transfers" {
+    var buf: [100]u8 = undefined;
+    const rd = ring.Sqe.read(3, &buf, 0);
+    try expect(!ring.breaksChain(rd, 100));
+    try expect(ring.breaksChain(rd, 99));
+    try expect(ring.breaksChain(rd, -5));
+    try expect(ring.breaksChain(ring.Sqe.write(3, &buf, 0), 0));
+    // stat and open succeed with 0 / an fd, not a byte count
+    var st: [64]u8 = undefined;
+    try expect(!ring.breaksChain(ring.Sqe.stat(3, &st, 0), 0));
+    try expect(!ring.breaksChain(ring.Sqe.open("/x", 0), 4));
+    try expect(ring.breaksChain(ring.Sqe.open("/x", 0), -2));
+}
+
+test "short write cancels the rest of its chain" {
+    var r = fresh();
+    const data = "abcd";
+    try expect(r.push(ring.Sqe.write(3, data, 0).linked()));
+    try expect(r.push(ring.Sqe.write(3, data, 1).linked()));
+    try expect(r.push(ring.Sqe.write(3, data, 2)));
+    try expect(r.push(ring.Sqe.write(3, data, 3)));
+    runChain(&r, &.{ 4, 2, 4, 4 });
+
+    const want = [_]i64{ 4, 2, ring.ECANCELED, 4 };
+    for (want, 0..) |res, i| {
+        const cqe = r.popCqe().?;
+        try expectEqual(@as(u64, i), cqe.user_data);
+        try expectEqual(res, cqe.res);
+    }
+}
+
+test "failed open cancels stat but still closes" {
+    var r = fresh();
+    var st: [64]u8 = undefined;
+    try expect(r.push(ring.Sqe.open("/missing", 0).linked()));
+    try expect(r.push(ring.Sqe.stat(ring.FD_LINKED, &st, 1).linked()));
+    try expect(r.push(ring.Sqe.close(ring.FD_LINKED, 2)));
+    runChain(&r, &.{ -2, 0, -9 });
+
+    try expectEqual(@as(i64, -2), r.popCqe().?.res);
+    try expectEqual(ring.ECANCELED, r.popCqe().?.res);
+    try expectEqual(@as(i64, -9), r.popCqe().?.res);
+}
@@ -14,4 +14,9 @@ comptime {
     _ = @import("dns_test.zig");
     _ = @import("icmp_test.zig");
     _ = @import("time_test.zig");
+    _ = @import("deflate_test.zig");
+    _ = @import("ring_test.zig");
+    _ = @import("scan_test.zig");
+    _ = @import("ipc_test.zig");
+    _ = @import("bench_test.zig");
 }
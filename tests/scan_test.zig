@@ -0,0 +1,162 @@
+const std = @import("std");
+const scan = @import("scan");
+
+const expect = std.testing.expect;
+const expectEqual = std.testing.expectEqual;
+
+// Every width gets the same checks: scalar, SSE2-sized, AVX2-sized and
+// whatever this host compiles natively.
+const widths = .{ 0, 16, 32, scan.VEC_LEN };
+
+// ── Reference implementations ───────────────────────────────────────
+
+fn refCount(buf: []const u8, c: u8) usize {
+    var n: usize = 0;
+    for (buf) |b| n += @intFromBool(b == c);
+    return n;
+}
+
+fn refWords(buf: []const u8) usize {
+    var n: usize = 0;
+    var in_word = false;
+    for (buf) |b| {
+        if (b == ' ' or b == '\t' or b == '\n' or b == '\r') {
+            in_word = false;
+        } else {
+            if (!in_word) n += 1;
+            in_word = true;
+        }
+    }
+    return n;
+}
+
+fn refIndexOf(haystack: []const u8, needle: []const u8, fold: bool) ?usize {
+    if (haystack.len < needle.len) return null;
+    for (0..haystack.len - needle.len + 1) |i| {
+        const window = haystack[i..][0..needle.len];
+        if (if (fold) scan.eqlIgnoreCase(window, needle) else std.mem.eql(u8, window, needle)) return i;
+    }
+    return null;
+}
+
+/// Text from a small alphabet, so matches and near-misses are common.
+fn fill(buf: []u8, seed: u64) void {
+    const alphabet = "abAB \n\t\rxyz";
+    var prng = std.Random.DefaultPrng.init(seed);
+    for (buf) |*b| b.* = alphabet[prng.random().uintLessThan(usize, alphabet.len)];
+}
+
+// ── Counting ────────────────────────────────────────────────────────
+
+test "countByte matches reference at every length and offset" {
+    var buf: [300]u8 = undefined;
+    fill(&buf, 1);
+    inline for (widths) |w| {
+        const K = scan.Kernels(w);
+        for (0..40) |start| {
+            for (start..buf.len) |end| {
+                const s = buf[start..end];
+                try expectEqual(refCount(s, '\n'), K.countLines(s));
+                try expectEqual(refCount(s, 'a'), K.countByte(s, 'a'));
+            }
+        }
+    }
+}
+
+test "countByte flushes lane counters on long runs" {
+    var buf: [40000]u8 = undefined;
+    @memset(&buf, '\n');
+    buf[12345] = 'x';
+    inline for (widths) |w| {
+        try expectEqual(@as(usize, buf.len - 1), scan.Kernels(w).countLines(&buf));
+    }
+}
+
+test "countWords matches reference and carries across blocks" {
+    var buf: [500]u8 = undefined;
+    fill(&buf, 2);
+    inline for (widths) |w| {
+        const K = scan.Kernels(w);
+        for (0..buf.len) |len| {
+            var in_word = false;
+            try expectEqual(refWords(buf[0..len]), K.countWords(buf[0..len], &in_word));
+        }
+        // Split one stream at every point; a word straddling the cut counts once.
+        for (0..buf.len) |cut| {
+            var in_word = false;
+            const n = K.countWords(buf[0..cut], &in_word) + K.countWords(buf[cut..], &in_word);
+            try expectEqual(refWords(&buf), n);
+        }
+    }
+}
+
+test "countWords basics" {
+    var in_word = false;
+    try expectEqual(@as(usize, 3), scan.countWords("  one two\tthree\n", &in_word));
+    try expect(!in_word);
+    try expectEqual(@as(usize, 1), scan.countWords("abc", &in_word));
+    try expect(in_word);
+    try expectEqual(@as(usize, 0), scan.countWords("def", &in_word));
+}
+
+// ── Searching ───────────────────────────────────────────────────────
+
+test "indexOfByte finds the first occurrence" {
+    var buf: [200]u8 = undefined;
+    @memset(&buf, '.');
+    inline for (widths) |w| {
+        const K = scan.Kernels(w);
+        try expect(K.indexOfByte(&buf, '\n') == null);
+        try expect(K.indexOfByte("", '\n') == null);
+        for (0..buf.len) |pos| {
+            buf[pos] = '\n';
+            if (pos + 7 < buf.len) buf[pos + 7] = '\n';
+            try expectEqual(@as(?usize, pos), K.indexOfByte(&buf, '\n'));
+            try expectEqual(@as(?usize, 0), K.indexOfByte(buf[pos..], '\n'));
+            @memset(&buf, '.');
+        }
+    }
+}
+
+test "indexOf matches reference" {
+    var buf: [400]u8 = undefined;
+    fill(&buf, 3);
+    const needles = [_][]const u8{ "a", "ab", "ba", "a b", "xyz", "aab", "b\na", "abababab", "zzz" };
+    inline for (widths) |w| {
+        const K = scan.Kernels(w);
+        for (needles) |needle| {
+            for (0..50) |start| {
+                const s = buf[start..];
+                try expectEqual(refIndexOf(s, needle, false), K.indexOf(s, needle));
+                try expectEqual(refIndexOf(s, needle, true), K.indexOfIgnoreCase(s, needle));
+            }
+        }
+    }
+}
+
+test "indexOf edge cases" {
+    inline for (widths) |w| {
+        const K = scan.Kernels(w);
+        try expectEqual(@as(?usize, 0), K.indexOf("abc", ""));
+        try expect(K.indexOf("ab", "abc") == null);
+        try expectEqual(@as(?usize, 0), K.indexOf("abc", "abc"));
+        // Match ending on the last byte, after a long run of near-misses.
+        const hay = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab";
+        try expectEqual(@as(?usize, hay.len - 3), K.indexOf(hay, "aab"));
+        try expect(K.indexOf(hay, "aac") == null);
+    }
+}
+
+test "indexOfIgnoreCase folds only ASCII letters" {
+    inline for (widths) |w| {
+        const K = scan.Kernels(w);
+        const line = "2026-10-14 kernel: WARNING: fxfs: Journal replay took 12ms [id=0x1F]";
+        try expectEqual(@as(?usize, 19), K.indexOfIgnoreCase(line, "warning"));
+        try expectEqual(@as(?usize, 19), K.indexOfIgnoreCase(line, "WaRnInG"));
+        try expectEqual(@as(?usize, 34), K.indexOfIgnoreCase(line, "journal REPLAY"));
+        try expectEqual(@as(?usize, 63), K.indexOfIgnoreCase(line, "0X1f]"));
+        // '@' and '[' sit next to 'A' and 'Z' but have no case.
+        try expect(K.indexOfIgnoreCase("`{", "@[") == null);
+        try expect(K.indexOf(line, "warning") == null);
+    }
+}
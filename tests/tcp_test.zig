@@ -40,16 +40,27 @@ fn resetMock() void {
     mock_send_dst = .{ 0, 0, 0, 0 };
 }
 
-// TcpStack is ~5MB, use heap allocation for tests
+fn mockBufAlloc(len: usize) ?[*]u8 {
+    const buf = std.testing.allocator.alloc(u8, len) catch return null;
+    return buf.ptr;
+}
+
+fn mockBufFree(ptr: [*]u8, len: usize) void {
+    std.testing.allocator.free(ptr[0..len]);
+}
+
+// TcpStack is large, use heap allocation for tests
 fn createStack() !*tcp.TcpStack {
     const allocator = std.testing.allocator;
     const stack = try allocator.create(tcp.TcpStack);
     stack.* = tcp.TcpStack.init(&mockSend, &mockGetIp, &mockGetTicks);
     stack.setMaxConnections(8); // small for testing
+    stack.setBufferAllocator(&mockBufAlloc, &mockBufFree);
     return stack;
 }
 
 fn destroyStack(stack: *tcp.TcpStack) void {
+    stack.deinit();
     std.testing.allocator.destroy(stack);
 }
 
@@ -293,6 +304,151 @@ test "isEof on closed connection" {
     try expect(stack.isEof(idx));
 }
 
+// ── Options, windowing, SACK, buffer growth ────────────────────────
+
+test "SYN offers MSS, window scale, SACK and timestamps" {
+    resetMock();
+    const stack = try createStack();
+    defer destroyStack(stack);
+
+    const idx = stack.alloc() orelse return error.TestUnexpectedResult;
+    try expect(stack.connect(idx, REMOTE_IP, 80));
+
+    const hdr_len = @as(usize, mock_send_buf[12] >> 4) * 4;
+    try expect(hdr_len > tcp.HEADER_SIZE);
+    const opts = tcp.parseOptions(mock_send_buf[tcp.HEADER_SIZE..hdr_len]);
+    try expectEqual(tcp.DEFAULT_MSS, opts.mss);
+    try expectEqual(@as(?u8, tcp.WINDOW_SHIFT), opts.wscale);
+    try expect(opts.sack_permitted);
+    try expect(opts.has_ts);
+}
+
+test "SYN-ACK options are negotiated and windows scaled" {
+    resetMock();
+    const stack = try createStack();
+    defer destroyStack(stack);
+
+    const idx = stack.alloc() orelse return error.TestUnexpectedResult;
+    try expect(stack.connect(idx, REMOTE_IP, 80));
+    const c = &stack.connections[idx];
+
+    const synack_opts = [_]u8{
+        tcp.OPT_MSS, 4, 0x03, 0xE8, // 1000
+        tcp.OPT_NOP, tcp.OPT_WSCALE, 3, 7,
+        tcp.OPT_SACK_PERM, 2, tcp.OPT_TIMESTAMP, 10,
+        0, 0, 0, 42, 0, 0, 0, 0,
+    };
+    deliver(stack, c, 5000, c.snd_una +% 1, tcp.SYN | tcp.ACK, 65535, &synack_opts, "");
+
+    try expectEqual(tcp.TcpState.established, stack.getState(idx).?);
+    try expectEqual(@as(u16, 1000), c.mss);
+    try expectEqual(@as(u8, 7), c.snd_wscale);
+    try expectEqual(tcp.WINDOW_SHIFT, c.rcv_wscale);
+    try expect(c.sack_ok and c.ts_ok);
+    try expectEqual(@as(u32, 42), c.ts_recent);
+
+    // Windows on later segments are scaled by the peer's shift
+    deliver(stack, c, 5001, c.snd_nxt, tcp.ACK, 100, &tsOption(43, 0), "");
+    try expectEqual(@as(u32, 100 << 7), c.snd_wnd);
+}
+
+test "sendData fills the window with several segments" {
+    resetMock();
+    const stack = try createStack();
+    defer destroyStack(stack);
+
+    const idx = stack.alloc() orelse return error.TestUnexpectedResult;
+    try expect(stack.connect(idx, REMOTE_IP, 80));
+    transitionToEstablished(stack, idx);
+
+    // No MSS option in the SYN-ACK: 536-byte segments, 10-segment cwnd
+    var data: [4000]u8 = undefined;
+    @memset(&data, 'x');
+    mock_send_count = 0;
+    try expectEqual(@as(u16, 4000), stack.sendData(idx, &data));
+    try expectEqual(@as(u32, 8), mock_send_count);
+    const c = &stack.connections[idx];
+    try expectEqual(@as(u32, 4000), c.snd_nxt -% c.snd_una);
+}
+
+test "three duplicate ACKs trigger fast retransmit" {
+    resetMock();
+    const stack = try createStack();
+    defer destroyStack(stack);
+
+    const idx = stack.alloc() orelse return error.TestUnexpectedResult;
+    try expect(stack.connect(idx, REMOTE_IP, 80));
+    transitionToEstablished(stack, idx);
+    const c = &stack.connections[idx];
+
+    var data: [3000]u8 = undefined;
+    @memset(&data, 'y');
+    _ = stack.sendData(idx, &data);
+    const una = c.snd_una;
+
+    for (0..3) |_| deliver(stack, c, c.rcv_nxt, una, tcp.ACK, 65535, "", "");
+
+    try expectEqual(@as(u64, 1), stack.retransmits);
+    try expect(c.in_recovery);
+    try expectEqual(una, std.mem.readInt(u32, mock_send_buf[4..8], .big));
+}
+
+test "out-of-order data is SACKed and reassembled" {
+    resetMock();
+    const stack = try createStack();
+    defer destroyStack(stack);
+
+    const idx = stack.alloc() orelse return error.TestUnexpectedResult;
+    try expect(stack.connect(idx, REMOTE_IP, 80));
+    const c = &stack.connections[idx];
+    const sack_perm = [_]u8{ tcp.OPT_NOP, tcp.OPT_NOP, tcp.OPT_SACK_PERM, 2 };
+    deliver(stack, c, 5000, c.snd_una +% 1, tcp.SYN | tcp.ACK, 65535, &sack_perm, "");
+    try expect(c.sack_ok);
+
+    const base = c.rcv_nxt;
+    deliver(stack, c, base +% 10, c.snd_nxt, tcp.ACK, 65535, "", "world");
+    try expect(!stack.hasData(idx));
+
+    // The duplicate ACK reports the out-of-order block
+    const hdr_len = @as(usize, mock_send_buf[12] >> 4) * 4;
+    const opts = tcp.parseOptions(mock_send_buf[tcp.HEADER_SIZE..hdr_len]);
+    try expectEqual(base, std.mem.readInt(u32, mock_send_buf[8..12], .big));
+    try expectEqual(@as(u8, 1), opts.sack_count);
+    try expectEqual(base +% 10, opts.sack[0].start);
+    try expectEqual(base +% 15, opts.sack[0].end);
+
+    // Filling the hole delivers everything in order
+    deliver(stack, c, base, c.snd_nxt, tcp.ACK, 65535, "", "0123456789");
+    try expectEqual(base +% 15, c.rcv_nxt);
+    var buf: [32]u8 = undefined;
+    const n = stack.recvData(idx, &buf);
+    try expectEqualSlices(u8, "0123456789world", buf[0..n]);
+}
+
+test "receive buffer grows when a round trip fills it" {
+    resetMock();
+    const stack = try createStack();
+    defer destroyStack(stack);
+
+    const idx = stack.alloc() orelse return error.TestUnexpectedResult;
+    try expect(stack.connect(idx, REMOTE_IP, 80));
+    transitionToEstablished(stack, idx);
+    const c = &stack.connections[idx];
+    try expectEqual(@as(u32, tcp.MIN_BUF_SIZE), c.rx_cap);
+
+    var data: [1000]u8 = undefined;
+    for (0..4) |i| {
+        for (&data, 0..) |*b, j| b.* = @truncate(i * 1000 + j);
+        if (i == 3) mock_tick_count += 1; // one round trip later
+        deliver(stack, c, c.rcv_nxt, c.snd_nxt, tcp.ACK, 65535, "", &data);
+    }
+    try expectEqual(@as(u32, 2 * tcp.MIN_BUF_SIZE), c.rx_cap);
+
+    var buf: [4000]u8 = undefined;
+    try expectEqual(@as(u16, 4000), stack.recvData(idx, &buf));
+    for (buf, 0..) |b, j| try expectEqual(@as(u8, @truncate(j)), b);
+}
+
 // ── tcpChecksum ─────────────────────────────────────────────────────
 
 test "tcpChecksum: verify round-trip" {
@@ -336,6 +492,26 @@ fn makeIpHdr(src: [4]u8, dst: [4]u8) ipv4.Header {
     };
 }
 
+fn tsOption(val: u32, ecr: u32) [12]u8 {
+    var o = [_]u8{ tcp.OPT_NOP, tcp.OPT_NOP, tcp.OPT_TIMESTAMP, 10 } ++ [_]u8{0} ** 8;
+    ipv4.writeBe32(&o, 4, val);
+    ipv4.writeBe32(&o, 8, ecr);
+    return o;
+}
+
+/// Hand the stack a segment from the connection's peer.
+fn deliver(stack: *tcp.TcpStack, c: *const tcp.Connection, seq: u32, ack: u32, flags: u8, window: u16, opts: []const u8, payload: []const u8) void {
+    var buf: [tcp.MAX_HEADER_SIZE + 1500]u8 = undefined;
+    const hdr_len = tcp.HEADER_SIZE + opts.len;
+    buildTcpHeader(buf[0..tcp.HEADER_SIZE], c.remote_port, c.local_port, seq, ack, flags, window);
+    buf[12] = @intCast((hdr_len / 4) << 4);
+    @memcpy(buf[tcp.HEADER_SIZE..hdr_len], opts);
+    @memcpy(buf[hdr_len..][0..payload.len], payload);
+    const seg = buf[0 .. hdr_len + payload.len];
+    ipv4.writeBe16(seg, 16, tcp.tcpChecksum(c.remote_ip, c.local_ip, seg));
+    stack.handlePacket(seg, makeIpHdr(c.remote_ip, c.local_ip));
+}
+
 fn transitionToEstablished(stack: *tcp.TcpStack, idx: u8) void {
     const c = &stack.connections[idx];
     const our_seq = c.snd_una;